@@ -11,6 +11,7 @@
 #include <boost/mpl/remove_if.hpp>
 #include <boost/mpl/transform.hpp>
 #include <dxtbx/error.h>
+#include <dxtbx/array_family/flex_table_index.h>
 #include <scitbx/array_family/shared.h>
 #include <scitbx/array_family/versa.h>
 #include <scitbx/array_family/tiny_types.h>
@@ -101,6 +102,7 @@ namespace dxtbx { namespace af {
         for (std::size_t i = 0; i < this_column.size(); ++i) {
           this_column[i] = other_column[i];
         }
+        t_->invalidate_indexes(k_);
       }
     };
 
@@ -123,6 +125,7 @@ namespace dxtbx { namespace af {
         for (std::size_t i = 0; i < this_column.size(); ++i) {
           this_column[i] = other_column[i];
         }
+        t_->invalidate_indexes(k_);
       }
 
       /**
@@ -373,6 +376,9 @@ namespace dxtbx { namespace af {
      */
     void resize(size_type n) {
       DXTBX_ASSERT(is_consistent());
+      if (n < nrows()) {
+        invalidate_indexes(n);
+      }
       resize_visitor visitor(n);
       for (iterator it = begin(); it != end(); ++it) {
         it->second.apply_visitor(visitor);
@@ -401,6 +407,7 @@ namespace dxtbx { namespace af {
       for (iterator it = begin(); it != end(); ++it) {
         it->second.apply_visitor(visitor);
       }
+      invalidate_indexes(pos);
       DXTBX_ASSERT(is_consistent());
       default_nrows_ = nr + n;
     }
@@ -425,6 +432,11 @@ namespace dxtbx { namespace af {
       for (iterator it = begin(); it != end(); ++it) {
         it->second.apply_visitor(visitor);
       }
+      if (indexes_) {
+        scitbx::af::shared<bool> flags(nr, false);
+        std::fill(flags.begin() + pos, flags.begin() + pos + n, true);
+        indexes_->remove_rows(flags.const_ref());
+      }
       DXTBX_ASSERT(is_consistent());
       default_nrows_ = nr - n;
     }
@@ -435,6 +447,7 @@ namespace dxtbx { namespace af {
      * @returns The number of columns removed
      */
     size_type erase(const key_type &key) {
+      invalidate_indexes(key);
       return table_->erase(key);
     }
 
@@ -444,14 +457,65 @@ namespace dxtbx { namespace af {
       resize(0);
     }
 
+    /**
+     * Add a column which shares its data with the given array, rather than
+     * copying it, replacing any column of the same name
+     * @param key The column name
+     * @param column The column, which must have one element for each row
+     */
+    void share_column(const key_type &key, const mapped_type &column) {
+      size_visitor visitor;
+      DXTBX_ASSERT(column.apply_visitor(visitor) == nrows());
+      invalidate_indexes(key);
+      (*table_)[key] = column;
+    }
+
     /** @returns Does the table contain the key. */
     bool contains(const key_type &key) const {
       const_iterator it = find(key);
       return it != end();
     }
 
+    /**
+     * Get the secondary indexes on the columns, which are shared by copies
+     * of the table made after they are first used
+     * @returns The set of indexes
+     */
+    flex_table_index_set &indexes() {
+      if (!indexes_) {
+        indexes_ = std::make_shared<flex_table_index_set>();
+      }
+      return *indexes_;
+    }
+
+    /** @returns Does the table have any secondary indexes */
+    bool has_indexes() const {
+      return indexes_ && !indexes_->indexes().empty();
+    }
+
+    /**
+     * Mark the indexes to be rebuilt, if they cover the given row or later
+     * @param first_row The first row which changed
+     */
+    void invalidate_indexes(size_type first_row = 0) {
+      if (indexes_) {
+        indexes_->invalidate_from(first_row);
+      }
+    }
+
+    /**
+     * Mark the indexes on a column to be rebuilt
+     * @param key The column which changed
+     */
+    void invalidate_indexes(const key_type &key) {
+      if (indexes_) {
+        indexes_->invalidate(key);
+      }
+    }
+
   private:
     std::shared_ptr<map_type> table_;
+    std::shared_ptr<flex_table_index_set> indexes_;
     size_type default_nrows_;
   };
 
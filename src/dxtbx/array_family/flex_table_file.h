@@ -0,0 +1,505 @@
+/*
+ * flex_table_file.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_ARRAY_FAMILY_FLEX_TABLE_FILE_H
+#define DXTBX_ARRAY_FAMILY_FLEX_TABLE_FILE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/size.hpp>
+#include <boost/variant.hpp>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/shared_plain.h>
+#include <dxtbx/error.h>
+#include <dxtbx/array_family/flex_table.h>
+#include <dxtbx/format/mapped_image.h>
+
+namespace dxtbx { namespace af {
+
+  /**
+   * The columnar table file format. The file starts with a 64 byte header,
+   * followed by one block for each column. Each block is a 64 byte header,
+   * the column name, and then the column data, which is the elements as
+   * they are held in memory. Every header and every column starts on a
+   * multiple of 64 bytes, so each column can be used where it lies in a
+   * memory mapping of the file. String columns are stored as the offsets
+   * of each string, then the characters, and are copied when they are
+   * read. Numbers are stored in the byte order of the host, which must match
+   * when the file is read, and column types are stored by their position in
+   * the table's list of types, so a file is read by the same kind of table
+   * that wrote it.
+   */
+  namespace table_file {
+
+    const std::size_t alignment = 64;
+
+    const std::uint32_t version = 1;
+
+    const std::uint32_t byte_order_mark = 0x01020304;
+
+    enum column_kind { plain_column = 0, string_column = 1 };
+
+    struct file_header {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t byte_order;
+      std::uint64_t nrows;
+      std::uint64_t ncols;
+      std::uint64_t ntypes;
+      char padding[24];
+    };
+
+    struct column_header {
+      char magic[8];
+      std::uint32_t which;
+      std::uint32_t kind;
+      std::uint64_t element_size;
+      std::uint64_t name_size;
+      std::uint64_t data_offset;
+      std::uint64_t data_size;
+      std::uint64_t next_offset;
+      char padding[8];
+    };
+
+    static_assert(sizeof(file_header) == alignment, "Bad file header size");
+    static_assert(sizeof(column_header) == alignment, "Bad column header size");
+
+    inline const char *file_magic() {
+      return "DXTBXTBL";
+    }
+
+    inline const char *column_magic() {
+      return "DXTBXCOL";
+    }
+
+    inline std::uint64_t aligned(std::uint64_t n) {
+      return (n + alignment - 1) / alignment * alignment;
+    }
+
+  }  // namespace table_file
+
+  /**
+   * A sharing handle for array data held in a memory mapped file, which
+   * keeps the mapping alive while any array uses it. The file is mapped
+   * copy on write, so elements can be changed without touching the file.
+   * If the array grows past the mapped block, it takes over the memory
+   * allocated for it and from then on owns that like any other array.
+   */
+  class mapped_sharing_handle : public scitbx::af::sharing_handle {
+  public:
+    mapped_sharing_handle(std::shared_ptr<format::MappedFile> file,
+                          std::size_t offset,
+                          std::size_t nbytes)
+        : file_(file), owned_(false) {
+      DXTBX_ASSERT(file->copy_on_write());
+      DXTBX_ASSERT(offset + nbytes <= file->size());
+      size = capacity = nbytes;
+      data = const_cast<char *>(file->data()) + offset;
+    }
+
+    virtual ~mapped_sharing_handle() {
+      deallocate();
+    }
+
+    virtual void deallocate() {
+      if (owned_) {
+        scitbx::af::sharing_handle::deallocate();
+      } else {
+        file_.reset();
+        size = capacity = 0;
+        data = NULL;
+      }
+    }
+
+    virtual void swap(scitbx::af::sharing_handle &other) {
+      mapped_sharing_handle *other_mapped =
+        dynamic_cast<mapped_sharing_handle *>(&other);
+      scitbx::af::sharing_handle::swap(other);
+      if (other_mapped != NULL) {
+        std::swap(file_, other_mapped->file_);
+        std::swap(owned_, other_mapped->owned_);
+      } else if (!owned_) {
+        // The other handle now points into the mapping, which it must not free
+        other.size = other.capacity = 0;
+        other.data = NULL;
+        file_.reset();
+        owned_ = true;
+      }
+    }
+
+    /** @returns The mapped file, or nothing once the array owns its data */
+    std::shared_ptr<format::MappedFile> file() const {
+      return file_;
+    }
+
+  private:
+    std::shared_ptr<format::MappedFile> file_;
+    bool owned_;
+  };
+
+  namespace detail {
+
+    /**
+     * Write a file one block at a time, keeping track of the position. The
+     * blocks go to a temporary file in the same directory, which is renamed
+     * over the path when it is closed. An existing file at the path is
+     * replaced rather than truncated, so tables still mapping it keep
+     * reading the old file instead of faulting on pages past its new end.
+     */
+    class table_file_writer {
+    public:
+      explicit table_file_writer(const std::string &path)
+          : path_(path),
+            temporary_path_(path + ".tmp" + std::to_string(std::random_device()())),
+            out_(temporary_path_.c_str(), std::ios::binary),
+            position_(0),
+            closed_(false) {
+        if (!out_) {
+          throw DXTBX_ERROR("Unable to open " + temporary_path_);
+        }
+      }
+
+      ~table_file_writer() {
+        if (!closed_) {
+          out_.close();
+          std::remove(temporary_path_.c_str());
+        }
+      }
+
+      std::uint64_t position() const {
+        return position_;
+      }
+
+      void write(const void *data, std::size_t nbytes) {
+        out_.write((const char *)data, nbytes);
+        if (!out_) {
+          throw DXTBX_ERROR("Unable to write " + path_);
+        }
+        position_ += nbytes;
+      }
+
+      void pad() {
+        static const char zeros[table_file::alignment] = {0};
+        write(zeros, table_file::aligned(position_) - position_);
+      }
+
+      void close() {
+        out_.close();
+        if (!out_) {
+          throw DXTBX_ERROR("Unable to write " + path_);
+        }
+#ifdef _WIN32
+        // Windows does not rename over an existing file
+        std::remove(path_.c_str());
+#endif
+        if (std::rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+          throw DXTBX_ERROR("Unable to write " + path_);
+        }
+        closed_ = true;
+      }
+
+    private:
+      std::string path_;
+      std::string temporary_path_;
+      std::ofstream out_;
+      std::uint64_t position_;
+      bool closed_;
+    };
+
+    /**
+     * A visitor to check that a column can be written to a table file
+     */
+    struct writable_column_visitor : public boost::static_visitor<bool> {
+      bool operator()(const scitbx::af::shared<std::string> &) const {
+        return true;
+      }
+
+      template <typename T>
+      bool operator()(const scitbx::af::shared<T> &) const {
+        return std::is_trivially_copyable<T>::value;
+      }
+    };
+
+    /**
+     * A visitor to write one column block of a table file
+     */
+    struct write_column_visitor : public boost::static_visitor<void> {
+      table_file_writer &writer;
+      const std::string &name;
+      int which;
+
+      write_column_visitor(table_file_writer &writer_,
+                           const std::string &name_,
+                           int which_)
+          : writer(writer_), name(name_), which(which_) {}
+
+      void operator()(const scitbx::af::shared<std::string> &column) const {
+        std::vector<std::uint64_t> offsets(1, 0);
+        for (std::size_t i = 0; i < column.size(); ++i) {
+          offsets.push_back(offsets.back() + column[i].size());
+        }
+        std::size_t nbytes = offsets.size() * sizeof(std::uint64_t) + offsets.back();
+        write_header(table_file::string_column, 1, nbytes);
+        writer.write(&offsets[0], offsets.size() * sizeof(std::uint64_t));
+        for (std::size_t i = 0; i < column.size(); ++i) {
+          writer.write(column[i].data(), column[i].size());
+        }
+        writer.pad();
+      }
+
+      template <typename T>
+      void operator()(const scitbx::af::shared<T> &column) const {
+        write_header(table_file::plain_column, sizeof(T), column.size() * sizeof(T));
+        writer.write(column.begin(), column.size() * sizeof(T));
+        writer.pad();
+      }
+
+      void write_header(std::uint32_t kind,
+                        std::uint64_t element_size,
+                        std::uint64_t nbytes) const {
+        table_file::column_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, table_file::column_magic(), 8);
+        header.which = which;
+        header.kind = kind;
+        header.element_size = element_size;
+        header.name_size = name.size();
+        header.data_offset =
+          writer.position() + sizeof(header) + table_file::aligned(name.size());
+        header.data_size = nbytes;
+        header.next_offset = table_file::aligned(header.data_offset + nbytes);
+        writer.write(&header, sizeof(header));
+        writer.write(name.data(), name.size());
+        writer.pad();
+      }
+    };
+
+    /**
+     * The description of one column in a mapped table file
+     */
+    struct table_file_column {
+      std::string name;
+      table_file::column_header header;
+    };
+
+    /**
+     * An MPL function to create a column with a given type index from a
+     * block of a table file. The state is held by reference, because
+     * boost::mpl::for_each passes the function by value.
+     */
+    template <typename T>
+    struct column_from_file {
+      T &table;
+      const table_file_column &column;
+      const std::shared_ptr<format::MappedFile> &file;
+      int &index;
+
+      template <typename U>
+      void operator()(const U &) const {
+        if (index++ == (int)column.header.which) {
+          typedef typename U::value_type value_type;
+          create((value_type *)NULL, std::is_trivially_copyable<value_type>());
+        }
+      }
+
+      template <typename V>
+      void create(V *, std::true_type) const {
+        check(table_file::plain_column, sizeof(V));
+        DXTBX_ASSERT(column.header.data_size == table.nrows() * sizeof(V));
+        mapped_sharing_handle *handle = new mapped_sharing_handle(
+          file, column.header.data_offset, column.header.data_size);
+        scitbx::af::shared<V> data(handle);
+        // Release our interest in the shared handle
+        handle->use_count--;
+        table.share_column(column.name, data);
+      }
+
+      void create(std::string *, std::false_type) const {
+        check(table_file::string_column, 1);
+        std::size_t n = table.nrows();
+        std::size_t offsets_size = (n + 1) * sizeof(std::uint64_t);
+        DXTBX_ASSERT(column.header.data_size >= offsets_size);
+        const char *block = file->data() + column.header.data_offset;
+        std::vector<std::uint64_t> offsets(n + 1);
+        std::memcpy(&offsets[0], block, offsets_size);
+        DXTBX_ASSERT(offsets[0] == 0);
+        DXTBX_ASSERT(offsets[n] == column.header.data_size - offsets_size);
+        scitbx::af::shared<std::string> data;
+        data.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+          DXTBX_ASSERT(offsets[i] <= offsets[i + 1]);
+          data.push_back(std::string(block + offsets_size + offsets[i],
+                                     offsets[i + 1] - offsets[i]));
+        }
+        table.share_column(column.name, data);
+      }
+
+      template <typename V>
+      void create(V *, std::false_type) const {
+        throw DXTBX_ERROR("Column '" + column.name + "' can not be read from a file");
+      }
+
+      void check(std::uint32_t kind, std::size_t element_size) const {
+        if (column.header.kind != kind || column.header.element_size != element_size) {
+          throw DXTBX_ERROR("Column '" + column.name + "' has the wrong type");
+        }
+      }
+    };
+
+  }  // namespace detail
+
+  /**
+   * Write a table to a columnar table file
+   * @param table The table
+   * @param path The file path
+   */
+  template <typename T>
+  void write_table_file(const T &table, const std::string &path) {
+    typedef typename T::const_iterator iterator;
+    DXTBX_ASSERT(table.is_consistent());
+    detail::writable_column_visitor writable;
+    for (iterator it = table.begin(); it != table.end(); ++it) {
+      if (!it->second.apply_visitor(writable)) {
+        throw DXTBX_ERROR("Column '" + it->first + "' can not be written to a file");
+      }
+    }
+
+    table_file::file_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, table_file::file_magic(), 8);
+    header.version = table_file::version;
+    header.byte_order = table_file::byte_order_mark;
+    header.nrows = table.nrows();
+    header.ncols = table.ncols();
+    header.ntypes = boost::mpl::size<typename T::mapped_type::types>::value;
+
+    detail::table_file_writer writer(path);
+    writer.write(&header, sizeof(header));
+    for (iterator it = table.begin(); it != table.end(); ++it) {
+      detail::write_column_visitor visitor(writer, it->first, it->second.which());
+      it->second.apply_visitor(visitor);
+    }
+    writer.close();
+  }
+
+  /**
+   * A columnar table file, mapped into memory. Reading only the block
+   * headers, it makes tables whose columns are views of the mapped file,
+   * so nothing further is read until the elements of a column are used,
+   * and then only the pages used.
+   */
+  class table_file_mapping {
+  public:
+    /**
+     * Map the file and read the column headers
+     * @param path The file path
+     */
+    explicit table_file_mapping(const std::string &path)
+        : file_(std::make_shared<format::MappedFile>(path, true)) {
+      std::size_t size = file_->size();
+      if (size < sizeof(header_)) {
+        throw DXTBX_ERROR(path + " is not a table file");
+      }
+      std::memcpy(&header_, file_->data(), sizeof(header_));
+      if (std::memcmp(header_.magic, table_file::file_magic(), 8) != 0) {
+        throw DXTBX_ERROR(path + " is not a table file");
+      }
+      if (header_.version != table_file::version) {
+        throw DXTBX_ERROR(path + " has an unknown table file version");
+      }
+      if (header_.byte_order != table_file::byte_order_mark) {
+        throw DXTBX_ERROR(path + " was written with a different byte order");
+      }
+
+      std::uint64_t offset = sizeof(header_);
+      for (std::size_t i = 0; i < header_.ncols; ++i) {
+        detail::table_file_column column;
+        if (offset + sizeof(column.header) > size) {
+          throw DXTBX_ERROR(path + " is truncated");
+        }
+        std::memcpy(&column.header, file_->data() + offset, sizeof(column.header));
+        const table_file::column_header &h = column.header;
+        if (std::memcmp(h.magic, table_file::column_magic(), 8) != 0
+            || offset + sizeof(h) + h.name_size > h.data_offset
+            || h.data_offset % table_file::alignment != 0 || h.data_offset > size
+            || h.data_size > size - h.data_offset || h.next_offset <= offset) {
+          throw DXTBX_ERROR(path + " has a corrupt column header");
+        }
+        column.name.assign(file_->data() + offset + sizeof(h), h.name_size);
+        columns_.push_back(column);
+        offset = h.next_offset;
+      }
+    }
+
+    /** @returns The number of rows */
+    std::size_t nrows() const {
+      return header_.nrows;
+    }
+
+    /** @returns The column names */
+    std::vector<std::string> keys() const {
+      std::vector<std::string> result;
+      for (std::size_t i = 0; i < columns_.size(); ++i) {
+        result.push_back(columns_[i].name);
+      }
+      return result;
+    }
+
+    /** @returns The mapped file */
+    std::shared_ptr<format::MappedFile> file() const {
+      return file_;
+    }
+
+    /**
+     * Make a table of views onto the columns
+     * @param keys The columns to include, or all of them if empty
+     * @returns The table
+     */
+    template <typename T>
+    T table(const std::vector<std::string> &keys = std::vector<std::string>()) const {
+      typedef typename T::mapped_type::types types;
+      if (header_.ntypes != (std::uint64_t)boost::mpl::size<types>::value) {
+        throw DXTBX_ERROR(file_->path() + " was written by a different kind of table");
+      }
+      T result(nrows());
+      for (std::size_t i = 0; i < columns_.size(); ++i) {
+        const std::string &name = columns_[i].name;
+        if (keys.empty() || std::find(keys.begin(), keys.end(), name) != keys.end()) {
+          int index = 0;
+          detail::column_from_file<T> creator = {result, columns_[i], file_, index};
+          boost::mpl::for_each<types>(creator);
+          if (!result.contains(name)) {
+            throw DXTBX_ERROR("Column '" + name + "' has an unknown type");
+          }
+        }
+      }
+      for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (!result.contains(keys[i])) {
+          throw DXTBX_ERROR("No column '" + keys[i] + "' in " + file_->path());
+        }
+      }
+      return result;
+    }
+
+  private:
+    std::shared_ptr<format::MappedFile> file_;
+    table_file::file_header header_;
+    std::vector<detail::table_file_column> columns_;
+  };
+
+}}  // namespace dxtbx::af
+
+#endif  // DXTBX_ARRAY_FAMILY_FLEX_TABLE_FILE_H
@@ -0,0 +1,602 @@
+/*
+ * flex_table_index.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_ARRAY_FAMILY_FLEX_TABLE_INDEX_H
+#define DXTBX_ARRAY_FAMILY_FLEX_TABLE_INDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/variant.hpp>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/tiny_plain.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace af {
+
+  namespace detail {
+
+    /**
+     * Marks the end of a hash chain, or a deleted row
+     */
+    const std::size_t no_row = (std::size_t)-1;
+
+    /**
+     * Mix the bits of a hash, so that keys which differ only in their low
+     * bits, such as sequential ids, spread over all the buckets
+     */
+    inline std::size_t mix_hash(std::uint64_t x) {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return (std::size_t)x;
+    }
+
+    inline std::size_t combine_hash(std::size_t seed, std::size_t value) {
+      return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, std::size_t>::type
+    hash_element(const T &x) {
+      return std::hash<T>()(x);
+    }
+
+    inline std::size_t hash_element(const std::string &x) {
+      return std::hash<std::string>()(x);
+    }
+
+    /**
+     * Hash a fixed size array of integers, which covers miller indices,
+     * bounding boxes and integer vectors
+     */
+    template <typename I, std::size_t N>
+    typename std::enable_if<std::is_integral<I>::value, std::size_t>::type
+    hash_element(const scitbx::af::tiny_plain<I, N> &x) {
+      std::size_t seed = 0;
+      for (std::size_t i = 0; i < N; ++i) {
+        seed = combine_hash(seed, std::hash<I>()(x[i]));
+      }
+      return seed;
+    }
+
+    template <typename I, std::size_t N>
+    std::true_type is_tiny_test(const scitbx::af::tiny_plain<I, N> *);
+
+    std::false_type is_tiny_test(...);
+
+    /**
+     * Is the type a fixed size array, or derived from one
+     */
+    template <typename T>
+    struct is_tiny : decltype(is_tiny_test((const T *)NULL)) {};
+
+    template <typename T>
+    bool equal_element(const T &a, const T &b, std::false_type) {
+      return a == b;
+    }
+
+    template <typename T>
+    bool equal_element(const T &a, const T &b, std::true_type) {
+      return std::equal(a.begin(), a.end(), b.begin());
+    }
+
+    template <typename T>
+    bool equal_element(const T &a, const T &b) {
+      return equal_element(a, b, is_tiny<T>());
+    }
+
+    /**
+     * Can the elements of a column be used in a hash index
+     */
+    template <typename T, typename = void>
+    struct is_hashable : std::false_type {};
+
+    template <typename T>
+    struct is_hashable<T, decltype((void)hash_element(std::declval<const T &>()))>
+        : std::true_type {};
+
+    /**
+     * Can the elements of a column be used in an ordered index
+     */
+    template <typename T>
+    struct is_orderable
+        : std::integral_constant<bool,
+                                 std::is_arithmetic<T>::value
+                                   || std::is_same<T, std::string>::value> {};
+
+  }  // namespace detail
+
+  /**
+   * A column of a table as an index sees it, with the element type hidden
+   */
+  class index_column_base {
+  public:
+    virtual ~index_column_base() {}
+
+    /** @returns The identity of the column storage, which survives resizing */
+    virtual const void *id() const = 0;
+
+    /** @returns The number of elements */
+    virtual std::size_t size() const = 0;
+
+    /** @returns Can the column be used in a hash index */
+    virtual bool hashable() const = 0;
+
+    /** @returns Can the column be used in an ordered index */
+    virtual bool orderable() const = 0;
+
+    /** @returns Does the other column have the same element type */
+    virtual bool same_type(const index_column_base &other) const = 0;
+
+    /** @returns The hash of element i */
+    virtual std::size_t hash(std::size_t i) const = 0;
+
+    /**
+     * @returns Is element i equal to element j of another column, which must
+     *          have the same type
+     */
+    virtual bool equal(std::size_t i,
+                       const index_column_base &other,
+                       std::size_t j) const = 0;
+
+    /**
+     * @returns Is element i less than element j of another column, which
+     *          must have the same type
+     */
+    virtual bool less(std::size_t i,
+                      const index_column_base &other,
+                      std::size_t j) const = 0;
+  };
+
+  template <typename T>
+  class index_column : public index_column_base {
+  public:
+    index_column(const scitbx::af::shared<T> &column)
+        : column_(column), id_(column_.handle()) {}
+
+    const void *id() const {
+      return id_;
+    }
+
+    std::size_t size() const {
+      return column_.size();
+    }
+
+    bool hashable() const {
+      return detail::is_hashable<T>::value;
+    }
+
+    bool orderable() const {
+      return detail::is_orderable<T>::value;
+    }
+
+    bool same_type(const index_column_base &other) const {
+      return dynamic_cast<const index_column *>(&other) != NULL;
+    }
+
+    std::size_t hash(std::size_t i) const {
+      return hash_impl(i, detail::is_hashable<T>());
+    }
+
+    bool equal(std::size_t i, const index_column_base &other, std::size_t j) const {
+      const T &value = static_cast<const index_column &>(other).column_[j];
+      return equal_impl(i, value, detail::is_hashable<T>());
+    }
+
+    bool less(std::size_t i, const index_column_base &other, std::size_t j) const {
+      const T &value = static_cast<const index_column &>(other).column_[j];
+      return less_impl(i, value, detail::is_orderable<T>());
+    }
+
+  private:
+    std::size_t hash_impl(std::size_t i, std::true_type) const {
+      return detail::hash_element(column_[i]);
+    }
+
+    std::size_t hash_impl(std::size_t, std::false_type) const {
+      throw DXTBX_ERROR("Column type cannot be hashed");
+    }
+
+    bool equal_impl(std::size_t i, const T &value, std::true_type) const {
+      return detail::equal_element(column_[i], value);
+    }
+
+    bool equal_impl(std::size_t, const T &, std::false_type) const {
+      throw DXTBX_ERROR("Column type cannot be hashed");
+    }
+
+    bool less_impl(std::size_t i, const T &value, std::true_type) const {
+      return column_[i] < value;
+    }
+
+    bool less_impl(std::size_t, const T &, std::false_type) const {
+      throw DXTBX_ERROR("Column type cannot be ordered");
+    }
+
+    scitbx::af::shared<T> column_;
+    const void *id_;
+  };
+
+  /**
+   * A visitor to view a table column as an index column
+   */
+  struct make_index_column_visitor
+      : public boost::static_visitor<std::shared_ptr<index_column_base> > {
+    template <typename T>
+    std::shared_ptr<index_column_base> operator()(
+      const scitbx::af::shared<T> &column) const {
+      return std::make_shared<index_column<T> >(column);
+    }
+  };
+
+  /**
+   * A secondary index on one or more columns of a flex_table. A hash index
+   * finds the rows with a given key, on integer, string, miller index or
+   * other integer array columns, and an ordered index on a single numeric
+   * or string column finds the rows with values in a range.
+   *
+   * The index is brought up to date with the table before each use. Rows
+   * added to the end of the table are indexed incrementally and deleted
+   * rows are removed without rehashing, while other changes made through
+   * the table mark the index to be rebuilt. Elements written directly into
+   * a column array are not seen until the index is rebuilt.
+   */
+  class flex_table_index {
+  public:
+    typedef std::vector<std::shared_ptr<index_column_base> > column_list;
+
+    /**
+     * @param keys The names of the indexed columns
+     * @param ordered True for an ordered index, False for a hash index
+     */
+    flex_table_index(const std::vector<std::string> &keys, bool ordered)
+        : keys_(keys), ordered_(ordered), nrows_(0), valid_(false) {
+      DXTBX_ASSERT(keys.size() > 0);
+      DXTBX_ASSERT(!ordered || keys.size() == 1);
+    }
+
+    /** @returns The names of the indexed columns */
+    const std::vector<std::string> &keys() const {
+      return keys_;
+    }
+
+    /** @returns Is this an ordered index */
+    bool ordered() const {
+      return ordered_;
+    }
+
+    /** @returns Does the index use the column */
+    bool uses(const std::string &key) const {
+      return std::find(keys_.begin(), keys_.end(), key) != keys_.end();
+    }
+
+    /** @returns The number of rows indexed */
+    std::size_t nrows() const {
+      return nrows_;
+    }
+
+    /** Mark the index to be rebuilt */
+    void invalidate() {
+      valid_ = false;
+    }
+
+    /**
+     * Mark the index to be rebuilt if any rows from the given one on have
+     * been indexed
+     */
+    void invalidate_from(std::size_t row) {
+      if (row < nrows_) {
+        valid_ = false;
+      }
+    }
+
+    /**
+     * Bring the index up to date with the columns of the table. Rows added
+     * to the end since the last update are indexed on their own, and
+     * anything else rebuilds the index.
+     * @param columns The indexed columns, in the order of the keys
+     * @param nrows The number of rows in the table
+     */
+    void update(const column_list &columns, std::size_t nrows) {
+      DXTBX_ASSERT(columns.size() == keys_.size());
+      bool same = valid_ && nrows >= nrows_;
+      for (std::size_t i = 0; i < columns.size(); ++i) {
+        DXTBX_ASSERT(columns[i]->size() == nrows);
+        if (ordered_ ? !columns[i]->orderable() : !columns[i]->hashable()) {
+          throw DXTBX_ERROR("Column '" + keys_[i] + "' cannot be indexed");
+        }
+        same = same && columns_[i]->id() == columns[i]->id();
+      }
+      if (!same) {
+        nrows_ = 0;
+        hash_.clear();
+        next_.clear();
+        head_.clear();
+        order_.clear();
+      }
+      columns_ = columns;
+      valid_ = true;
+      if (nrows > nrows_) {
+        if (ordered_) {
+          add_ordered_rows(nrows);
+        } else {
+          add_hashed_rows(nrows);
+        }
+      }
+    }
+
+    /**
+     * Remove rows which have been deleted from the table, renumbering the
+     * rest. Rows added since the last update are left to the next one.
+     * @param flags True for each row of the table which was deleted
+     */
+    void remove_rows(const scitbx::af::const_ref<bool> &flags) {
+      if (!valid_ || flags.size() < nrows_) {
+        valid_ = false;
+        return;
+      }
+      std::vector<std::size_t> position(nrows_, detail::no_row);
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < nrows_; ++i) {
+        if (!flags[i]) {
+          position[i] = n++;
+        }
+      }
+      if (ordered_) {
+        std::size_t j = 0;
+        for (std::size_t i = 0; i < order_.size(); ++i) {
+          if (position[order_[i]] != detail::no_row) {
+            order_[j++] = position[order_[i]];
+          }
+        }
+        order_.resize(j);
+      } else {
+        for (std::size_t i = 0; i < hash_.size(); ++i) {
+          if (position[i] != detail::no_row) {
+            hash_[position[i]] = hash_[i];
+          }
+        }
+        hash_.resize(n);
+        next_.resize(n);
+        rehash(n);
+      }
+      nrows_ = n;
+    }
+
+    /**
+     * Check that probe columns can be looked up in a hash index
+     * @param probe The columns to look up, in the order of the keys
+     */
+    void check_probe(const column_list &probe) const {
+      DXTBX_ASSERT(!ordered_ && valid_);
+      DXTBX_ASSERT(probe.size() == columns_.size());
+      for (std::size_t i = 0; i < probe.size(); ++i) {
+        if (!columns_[i]->same_type(*probe[i])) {
+          throw DXTBX_ERROR("Column '" + keys_[i] + "' has a different type");
+        }
+      }
+    }
+
+    /**
+     * Find the rows with the same key as a row of the probe columns, which
+     * must have been checked with check_probe
+     * @param probe The columns to look up
+     * @param j The row of the probe columns
+     * @param rows The matching rows, in ascending order
+     */
+    void find(const column_list &probe,
+              std::size_t j,
+              std::vector<std::size_t> &rows) const {
+      rows.clear();
+      if (nrows_ == 0) {
+        return;
+      }
+      std::size_t h = row_hash(probe, j);
+      std::size_t i = head_[h & (head_.size() - 1)];
+      for (; i != detail::no_row; i = next_[i]) {
+        if (hash_[i] == h && row_equal(i, probe, j)) {
+          rows.push_back(i);
+        }
+      }
+      // Rows are chained from the last one added
+      std::reverse(rows.begin(), rows.end());
+    }
+
+    /**
+     * Find the rows with values in a range, from an ordered index
+     * @param low The lower bound, as the first element of a column, or NULL
+     * @param high The upper bound, which is excluded, or NULL
+     * @returns The rows in the order of their values
+     */
+    scitbx::af::shared<std::size_t> range(const index_column_base *low,
+                                          const index_column_base *high) const {
+      DXTBX_ASSERT(ordered_ && valid_);
+      const index_column_base &column = *columns_[0];
+      const std::size_t *first = order_.data();
+      const std::size_t *last = first + order_.size();
+      if (low != NULL) {
+        DXTBX_ASSERT(column.same_type(*low));
+        first = std::lower_bound(first, last, 0, [&](std::size_t row, int) {
+          return column.less(row, *low, 0);
+        });
+      }
+      if (high != NULL) {
+        DXTBX_ASSERT(column.same_type(*high));
+        last = std::lower_bound(first, last, 0, [&](std::size_t row, int) {
+          return column.less(row, *high, 0);
+        });
+      }
+      return scitbx::af::shared<std::size_t>(first, last);
+    }
+
+  private:
+    std::size_t row_hash(const column_list &columns, std::size_t row) const {
+      std::size_t seed = 0;
+      for (std::size_t i = 0; i < columns.size(); ++i) {
+        seed = detail::combine_hash(seed, columns[i]->hash(row));
+      }
+      return detail::mix_hash(seed);
+    }
+
+    bool row_equal(std::size_t i, const column_list &probe, std::size_t j) const {
+      for (std::size_t k = 0; k < columns_.size(); ++k) {
+        if (!columns_[k]->equal(i, *probe[k], j)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void link(std::size_t row) {
+      std::size_t bucket = hash_[row] & (head_.size() - 1);
+      next_[row] = head_[bucket];
+      head_[bucket] = row;
+    }
+
+    /**
+     * Chain the rows into a bucket array of at least twice their number,
+     * from their stored hashes
+     */
+    void rehash(std::size_t n) {
+      std::size_t nbuckets = 16;
+      while (nbuckets < 2 * n) {
+        nbuckets *= 2;
+      }
+      head_.assign(nbuckets, detail::no_row);
+      for (std::size_t i = 0; i < n; ++i) {
+        link(i);
+      }
+    }
+
+    void add_hashed_rows(std::size_t n) {
+      for (std::size_t i = nrows_; i < n; ++i) {
+        hash_.push_back(row_hash(columns_, i));
+        next_.push_back(detail::no_row);
+      }
+      if (head_.size() < n) {
+        rehash(n);
+      } else {
+        for (std::size_t i = nrows_; i < n; ++i) {
+          link(i);
+        }
+      }
+      nrows_ = n;
+    }
+
+    void add_ordered_rows(std::size_t n) {
+      const index_column_base &column = *columns_[0];
+      auto compare = [&](std::size_t a, std::size_t b) {
+        return column.less(a, column, b);
+      };
+      std::size_t middle = order_.size();
+      for (std::size_t i = nrows_; i < n; ++i) {
+        order_.push_back(i);
+      }
+      // Both parts keep equal values in row order, and so does the merge
+      std::stable_sort(order_.begin() + middle, order_.end(), compare);
+      std::inplace_merge(
+        order_.begin(), order_.begin() + middle, order_.end(), compare);
+      nrows_ = n;
+    }
+
+    std::vector<std::string> keys_;
+    bool ordered_;
+    std::size_t nrows_;
+    bool valid_;
+    column_list columns_;
+    std::vector<std::size_t> hash_;
+    std::vector<std::size_t> next_;
+    std::vector<std::size_t> head_;
+    std::vector<std::size_t> order_;
+  };
+
+  /**
+   * The secondary indexes on a flex_table
+   */
+  class flex_table_index_set {
+  public:
+    typedef std::vector<std::shared_ptr<flex_table_index> > index_list;
+
+    /** @returns The indexes */
+    const index_list &indexes() const {
+      return indexes_;
+    }
+
+    /**
+     * @returns The index on exactly the given columns, or an empty pointer
+     */
+    std::shared_ptr<flex_table_index> find(const std::vector<std::string> &keys,
+                                           bool ordered) const {
+      for (std::size_t i = 0; i < indexes_.size(); ++i) {
+        if (indexes_[i]->keys() == keys && indexes_[i]->ordered() == ordered) {
+          return indexes_[i];
+        }
+      }
+      return std::shared_ptr<flex_table_index>();
+    }
+
+    /**
+     * Add an index, replacing any on the same columns
+     * @param index The index
+     */
+    void add(std::shared_ptr<flex_table_index> index) {
+      remove(index->keys(), index->ordered());
+      indexes_.push_back(index);
+    }
+
+    /**
+     * Remove an index
+     * @returns Was there an index on the columns
+     */
+    bool remove(const std::vector<std::string> &keys, bool ordered) {
+      for (index_list::iterator it = indexes_.begin(); it != indexes_.end(); ++it) {
+        if ((*it)->keys() == keys && (*it)->ordered() == ordered) {
+          indexes_.erase(it);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /** Mark the indexes on a column to be rebuilt */
+    void invalidate(const std::string &key) {
+      for (std::size_t i = 0; i < indexes_.size(); ++i) {
+        if (indexes_[i]->uses(key)) {
+          indexes_[i]->invalidate();
+        }
+      }
+    }
+
+    /** Mark any indexes that cover the given row or later to be rebuilt */
+    void invalidate_from(std::size_t row) {
+      for (std::size_t i = 0; i < indexes_.size(); ++i) {
+        indexes_[i]->invalidate_from(row);
+      }
+    }
+
+    /** Remove deleted rows from the indexes */
+    void remove_rows(const scitbx::af::const_ref<bool> &flags) {
+      for (std::size_t i = 0; i < indexes_.size(); ++i) {
+        indexes_[i]->remove_rows(flags);
+      }
+    }
+
+  private:
+    index_list indexes_;
+  };
+
+}}  // namespace dxtbx::af
+
+#endif  // DXTBX_ARRAY_FAMILY_FLEX_TABLE_INDEX_H
@@ -1,8 +1,13 @@
 #ifndef DXTBX_ARRAY_FAMILY_FLEX_TABLE_SUITE_H
 #define DXTBX_ARRAY_FAMILY_FLEX_TABLE_SUITE_H
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <iterator>
+#include <type_traits>
+#include <vector>
 #include <iostream>
 #include <sstream>
 #include <set>
@@ -15,9 +20,11 @@
 #include <scitbx/boost_python/slice.h>
 #include <scitbx/boost_python/utils.h>
 #include <dxtbx/array_family/flex_table.h>
+#include <dxtbx/array_family/flex_table_file.h>
 #include <scitbx/array_family/shared.h>
 #include <scitbx/array_family/versa.h>
 #include <dxtbx/error.h>
+#include <dxtbx/parallel.h>
 
 #include "ref_pickle_double_buffered.h"
 
@@ -89,6 +96,60 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
     }
   };
 
+  /**
+   * A visitor to make a new column of the same type as another
+   */
+  template <typename V>
+  struct new_column_visitor : public boost::static_visitor<V> {
+    std::size_t n;
+
+    new_column_visitor(std::size_t n_) : n(n_) {}
+
+    template <typename U>
+    V operator()(const U &) const {
+      return V(U(n));
+    }
+  };
+
+  /**
+   * The rows of one column of a concatenated table that come from one table
+   */
+  template <typename V>
+  struct concatenate_piece {
+    V *column;
+    const V *other;
+    std::size_t row;
+    int id_offset;
+  };
+
+  /**
+   * A visitor to copy a column of one table into its rows of a column of
+   * the concatenated table. Non-negative values of an id column are offset.
+   */
+  template <typename V>
+  struct concatenate_column_visitor : public boost::static_visitor<void> {
+    const concatenate_piece<V> &piece;
+
+    concatenate_column_visitor(const concatenate_piece<V> &piece_) : piece(piece_) {}
+
+    template <typename U>
+    void operator()(U &self_column) const {
+      const U &other_column = boost::get<U>(*piece.other);
+      std::copy(
+        other_column.begin(), other_column.end(), self_column.begin() + piece.row);
+    }
+
+    void operator()(scitbx::af::shared<int> &self_column) const {
+      const scitbx::af::shared<int> &other_column =
+        boost::get<scitbx::af::shared<int> >(*piece.other);
+      int *result = self_column.begin() + piece.row;
+      for (std::size_t i = 0; i < other_column.size(); ++i) {
+        int id = other_column[i];
+        result[i] = id >= 0 ? id + piece.id_offset : id;
+      }
+    }
+  };
+
   /**
    * A visitor to add new columns (and over-write old columns) in the table.
    */
@@ -279,6 +340,124 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
     }
   };
 
+  /**
+   * A visitor to permute the elements of a column in place, following the
+   * cycles of the permutation so that no copy of the column is made
+   */
+  struct permute_in_place_visitor : public boost::static_visitor<void> {
+    const std::size_t *index;
+    const std::vector<std::size_t> &leaders;
+
+    permute_in_place_visitor(const std::size_t *index_,
+                             const std::vector<std::size_t> &leaders_)
+        : index(index_), leaders(leaders_) {}
+
+    template <typename T>
+    void operator()(T &column) const {
+      typename T::value_type *data = column.begin();
+      for (std::size_t i = 0; i < leaders.size(); ++i) {
+        const std::size_t start = leaders[i];
+        typename T::value_type temp = std::move(data[start]);
+        std::size_t j = start;
+        for (std::size_t k = index[j]; k != start; j = k, k = index[j]) {
+          data[j] = std::move(data[k]);
+        }
+        data[j] = std::move(temp);
+      }
+    }
+  };
+
+  /**
+   * Find the cycles of a permutation
+   * @param index The permutation, where element i moves from index[i]
+   * @param leaders Set to the first element of each cycle longer than one
+   * @returns False if the index is not a permutation
+   */
+  inline bool permutation_cycles(const scitbx::af::const_ref<std::size_t> &index,
+                                 std::vector<std::size_t> &leaders) {
+    const std::size_t n = index.size();
+    std::vector<bool> visited(n, false);
+    leaders.clear();
+    for (std::size_t start = 0; start < n; ++start) {
+      if (visited[start]) {
+        continue;
+      }
+      visited[start] = true;
+      if (index[start] == start) {
+        continue;
+      }
+      for (std::size_t j = index[start]; j != start; j = index[j]) {
+        if (j >= n || visited[j]) {
+          return false;
+        }
+        visited[j] = true;
+      }
+      leaders.push_back(start);
+    }
+    return true;
+  }
+
+  namespace detail {
+
+    /**
+     * A key to sort rows by, comparing elements of one column
+     */
+    struct sort_key_base {
+      virtual ~sort_key_base() {}
+
+      /**
+       * @returns Negative, zero or positive as row a sorts before, with or
+       *          after row b
+       */
+      virtual int compare(std::size_t a, std::size_t b) const = 0;
+    };
+
+    template <typename T>
+    struct sort_key : public sort_key_base {
+      scitbx::af::shared<T> column;
+      const T *data;
+      bool reverse;
+
+      sort_key(const scitbx::af::shared<T> &column_, bool reverse_)
+          : column(column_), data(column_.begin()), reverse(reverse_) {}
+
+      int compare(std::size_t a, std::size_t b) const {
+        int result = data[a] < data[b] ? -1 : (data[b] < data[a] ? 1 : 0);
+        return reverse ? -result : result;
+      }
+    };
+
+    struct make_sort_key_visitor
+        : public boost::static_visitor<std::shared_ptr<sort_key_base> > {
+      bool reverse;
+      make_sort_key_visitor(bool reverse_) : reverse(reverse_) {}
+      template <typename T>
+      std::shared_ptr<sort_key_base> operator()(
+        const scitbx::af::shared<T> &col) const {
+        return std::make_shared<sort_key<T> >(col, reverse);
+      }
+    };
+
+    /**
+     * Compare rows by each key in turn, and then by position if stable
+     */
+    struct compare_rows {
+      const std::vector<std::shared_ptr<sort_key_base> > *keys;
+      bool stable;
+
+      bool operator()(std::size_t a, std::size_t b) const {
+        for (std::size_t i = 0; i < keys->size(); ++i) {
+          int result = (*keys)[i]->compare(a, b);
+          if (result != 0) {
+            return result < 0;
+          }
+        }
+        return stable && a < b;
+      }
+    };
+
+  }  // namespace detail
+
   /**
    * Functor to compare elements by index
    */
@@ -529,6 +708,7 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       DXTBX_ASSERT(it != self.end());
       it->second.apply_visitor(visitor);
     }
+    self.invalidate_indexes(n);
   }
 
   /**
@@ -563,6 +743,9 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
     for (iterator it = self.begin(); it != self.end(); ++it) {
       it->second.apply_visitor(visitor);
     }
+    if (self.has_indexes()) {
+      self.indexes().remove_rows(flags);
+    }
     self.resize(n);
   }
 
@@ -603,6 +786,7 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       copy_from_slice_visitor<T> visitor(self, it->first, as, other.nrows());
       it->second.apply_visitor(visitor);
     }
+    self.invalidate_indexes();
   }
 
   /**
@@ -676,6 +860,107 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
     }
   }
 
+  /**
+   * Concatenate a list of tables. The tables must all have the same columns,
+   * although tables with no columns at all are skipped. Each column of the
+   * result is allocated once, and the tables are then copied into it with
+   * the (column, table) pieces shared out over the threads.
+   *
+   * If id_key names an int column, the ids of each table are offset by the
+   * number used by the tables before it, i.e. by the sum of their largest
+   * ids plus one, so that tables of separate experiment lists can be merged.
+   * Negative ids mark rows without an id and are left as they are.
+   * @param tables The list of tables
+   * @param id_key The id column to offset, or None
+   * @param nthreads The number of threads, zero for the default
+   * @returns The concatenated table
+   */
+  template <typename T>
+  T concatenate(object tables, object id_key, std::size_t nthreads) {
+    typedef typename T::const_iterator const_iterator;
+    typedef typename T::mapped_type mapped_type;
+
+    // Check that the tables agree and find their place in the result
+    std::vector<T> inputs;
+    std::vector<std::size_t> first_row;
+    std::size_t nrows = 0;
+    for (std::size_t i = 0, n = len(tables); i < n; ++i) {
+      T table = extract<T>(tables[i])();
+      DXTBX_ASSERT(table.is_consistent());
+      if (table.empty()) {
+        continue;
+      }
+      if (!inputs.empty()) {
+        const T &first = inputs.front();
+        bool same = table.ncols() == first.ncols();
+        for (const_iterator it = first.begin(); same && it != first.end(); ++it) {
+          const_iterator other = table.find(it->first);
+          same = other != table.end() && other->second.which() == it->second.which();
+        }
+        if (!same) {
+          throw DXTBX_ERROR("Tables to concatenate have different columns");
+        }
+      }
+      inputs.push_back(table);
+      first_row.push_back(nrows);
+      nrows += table.nrows();
+    }
+    T result(nrows);
+    if (inputs.empty()) {
+      return result;
+    }
+
+    // Offset each table's ids by those used before it
+    std::string id_name;
+    std::vector<int> id_offset(inputs.size(), 0);
+    if (!id_key.is_none()) {
+      id_name = extract<std::string>(id_key)();
+      const_iterator it = inputs.front().find(id_name);
+      if (it == inputs.front().end()) {
+        PyErr_Format(PyExc_KeyError, "Unknown column '%s'", id_name.c_str());
+        throw_error_already_set();
+      }
+      if (boost::get<scitbx::af::shared<int> >(&it->second) == NULL) {
+        throw DXTBX_ERROR("The id column must be an int column");
+      }
+      int offset = 0;
+      for (std::size_t i = 0; i < inputs.size(); ++i) {
+        id_offset[i] = offset;
+        const scitbx::af::shared<int> &ids =
+          boost::get<scitbx::af::shared<int> >(inputs[i].find(id_name)->second);
+        if (ids.size() > 0) {
+          offset += std::max(*std::max_element(ids.begin(), ids.end()) + 1, 0);
+        }
+      }
+    }
+
+    // Allocate each column once, and then copy the pieces into their rows
+    std::vector<concatenate_piece<mapped_type> > pieces;
+    const T &first = inputs.front();
+    for (const_iterator it = first.begin(); it != first.end(); ++it) {
+      new_column_visitor<mapped_type> visitor(nrows);
+      result.share_column(it->first, it->second.apply_visitor(visitor));
+    }
+    for (typename T::iterator it = result.begin(); it != result.end(); ++it) {
+      for (std::size_t i = 0; i < inputs.size(); ++i) {
+        concatenate_piece<mapped_type> piece = {
+          &it->second,
+          &inputs[i].find(it->first)->second,
+          first_row[i],
+          it->first == id_name ? id_offset[i] : 0};
+        pieces.push_back(piece);
+      }
+    }
+    dxtbx::parallel_for(
+      pieces.size(), nthreads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          concatenate_column_visitor<mapped_type> visitor(pieces[i]);
+          pieces[i].column->apply_visitor(visitor);
+        }
+      });
+    return result;
+  }
+
   /**
    * Select a number of rows from the table via an index array
    * @param self The current table
@@ -766,6 +1051,7 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       copy_to_indices_visitor<T> visitor(self, it->first, index);
       it->second.apply_visitor(visitor);
     }
+    self.invalidate_indexes();
   }
 
   /**
@@ -787,6 +1073,7 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       copy_to_indices_with_mask_visitor<T> visitor(self, it->first, index, mask);
       it->second.apply_visitor(visitor);
     }
+    self.invalidate_indexes();
   }
 
   /**
@@ -823,6 +1110,7 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       typename T::const_iterator it = other.find(keys[i]);
       DXTBX_ASSERT(it != other.end());
       it->second.apply_visitor(visitor);
+      self.invalidate_indexes(keys[i]);
     }
   }
 
@@ -919,18 +1207,57 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
   }
 
   /**
-   * Reorder all the columns according to the input indices
+   * Reorder all the columns according to the input indices. A permutation
+   * is applied in place, with the columns shared out over the threads, and
+   * anything else copies each column. Either way the new values are written
+   * into the existing column arrays, so a column fetched from the table
+   * before the call shares its storage and sees the rows reordered.
    * @param self The table object
    * @param indices The array of indices
+   * @param nthreads The number of threads, zero for the default
    */
   template <typename T>
-  void reorder(T &self, const scitbx::af::const_ref<std::size_t> &index) {
+  void reorder_rows(T &self,
+                    const scitbx::af::const_ref<std::size_t> &index,
+                    std::size_t nthreads) {
     typedef typename T::iterator iterator;
     DXTBX_ASSERT(self.is_consistent());
-    reorder_visitor visitor(index);
+    self.invalidate_indexes();
+    std::vector<std::size_t> leaders;
+    if (index.size() != self.nrows() || !permutation_cycles(index, leaders)) {
+      // Not a permutation, so rows may be repeated and each column is copied
+      reorder_visitor visitor(index);
+      for (iterator it = self.begin(); it != self.end(); ++it) {
+        it->second.apply_visitor(visitor);
+      }
+      return;
+    }
+
+    // Permute the columns in place, with one column per thread
+    std::vector<typename T::mapped_type *> columns;
     for (iterator it = self.begin(); it != self.end(); ++it) {
-      it->second.apply_visitor(visitor);
+      columns.push_back(&it->second);
     }
+    permute_in_place_visitor visitor(index.begin(), leaders);
+    dxtbx::parallel_for(
+      columns.size(), nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          columns[i]->apply_visitor(visitor);
+        }
+      });
+  }
+
+  /**
+   * Reorder all the columns according to the input indices, over several
+   * threads if the table is large
+   * @param self The table object
+   * @param indices The array of indices
+   */
+  template <typename T>
+  void reorder(T &self, const scitbx::af::const_ref<std::size_t> &index) {
+    // Tables smaller than this are reordered on the calling thread
+    const std::size_t parallel_rows = 1 << 16;
+    reorder_rows(self, index, self.nrows() >= parallel_rows ? 0 : 1);
   }
 
   /**
@@ -951,6 +1278,268 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
     reorder(self, index.const_ref());
   }
 
+  /**
+   * Sort the table by several columns, comparing by the first and then by
+   * each of the others in turn to break ties. The rows are sorted with a
+   * parallel merge sort and the permutation is then applied to the columns
+   * in place.
+   * @param self The table object
+   * @param keys The column keys
+   * @param reverse Whether to sort descending, either for all the keys or
+   *                as a list with one for each key
+   * @param stable Keep rows that compare equal in their original order
+   * @param nthreads The number of threads, zero for the default
+   * @returns The permutation applied to the rows
+   */
+  template <typename T>
+  scitbx::af::shared<std::size_t> sort_by_columns(T &self,
+                                                  boost::python::object keys,
+                                                  boost::python::object reverse,
+                                                  bool stable,
+                                                  std::size_t nthreads) {
+    DXTBX_ASSERT(self.is_consistent());
+    std::size_t nkeys = len(keys);
+    DXTBX_ASSERT(nkeys > 0);
+    extract<bool> reverse_all(reverse);
+    if (!reverse_all.check()) {
+      DXTBX_ASSERT(len(reverse) == nkeys);
+    }
+    std::vector<std::shared_ptr<detail::sort_key_base> > sort_keys;
+    for (std::size_t i = 0; i < nkeys; ++i) {
+      typename T::key_type key = extract<typename T::key_type>(keys[i]);
+      bool descending =
+        reverse_all.check() ? reverse_all() : extract<bool>(reverse[i])();
+      detail::make_sort_key_visitor visitor(descending);
+      sort_keys.push_back(self[key].variant().apply_visitor(visitor));
+    }
+
+    scitbx::af::shared<std::size_t> index(self.nrows());
+    for (std::size_t i = 0; i < index.size(); ++i) {
+      index[i] = i;
+    }
+    detail::compare_rows compare = {&sort_keys, stable};
+    dxtbx::parallel_sort(index.begin(), index.end(), compare, nthreads);
+    reorder_rows(self, index.const_ref(), nthreads);
+    return index;
+  }
+
+  /**
+   * A visitor to hold a python value as a one element column of the same
+   * type as the visited column, to compare against it
+   */
+  struct make_bound_column_visitor
+      : public boost::static_visitor<std::shared_ptr<index_column_base> > {
+    object value;
+    make_bound_column_visitor(object value_) : value(value_) {}
+    template <typename U>
+    std::shared_ptr<index_column_base> operator()(
+      const scitbx::af::shared<U> &) const {
+      scitbx::af::shared<U> bound(1, extract<U>(value)());
+      return std::make_shared<index_column<U> >(bound);
+    }
+  };
+
+  /**
+   * @returns The column names for an index, from one name or a sequence
+   */
+  inline std::vector<std::string> index_keys(object keys) {
+    std::vector<std::string> result;
+    extract<std::string> single(keys);
+    if (single.check()) {
+      result.push_back(single());
+    } else {
+      for (std::size_t i = 0; i < len(keys); ++i) {
+        result.push_back(extract<std::string>(keys[i]));
+      }
+    }
+    DXTBX_ASSERT(result.size() > 0);
+    return result;
+  }
+
+  /**
+   * @returns The columns of the table used by an index
+   */
+  template <typename T>
+  flex_table_index::column_list index_columns(T &self,
+                                              const std::vector<std::string> &keys) {
+    flex_table_index::column_list result;
+    make_index_column_visitor visitor;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      result.push_back(self[keys[i]].variant().apply_visitor(visitor));
+    }
+    return result;
+  }
+
+  /**
+   * Get the index of the table on the given columns, up to date with the
+   * table. If the table has no such index, one is built and not kept.
+   */
+  template <typename T>
+  std::shared_ptr<flex_table_index> updated_index(T &self,
+                                                  const std::vector<std::string> &keys,
+                                                  bool ordered) {
+    std::shared_ptr<flex_table_index> index;
+    if (self.has_indexes()) {
+      index = self.indexes().find(keys, ordered);
+    }
+    if (!index) {
+      index = std::make_shared<flex_table_index>(keys, ordered);
+    }
+    index->update(index_columns(self, keys), self.nrows());
+    return index;
+  }
+
+  /**
+   * @returns Does the table have an index on the columns
+   */
+  template <typename T>
+  bool has_index(T &self, object keys, bool ordered) {
+    return self.has_indexes() && self.indexes().find(index_keys(keys), ordered);
+  }
+
+  /**
+   * Add a secondary index on one or more columns, which is kept up to date
+   * as the table changes
+   * @param self The table
+   * @param keys The column name, or a list of names for a hash index
+   * @param ordered True for an ordered index, for range queries, or False
+   *                for a hash index, for lookups and joins
+   */
+  template <typename T>
+  void create_index(T &self, object keys, bool ordered) {
+    std::vector<std::string> names = index_keys(keys);
+    if (!has_index(self, keys, ordered)) {
+      std::shared_ptr<flex_table_index> index =
+        std::make_shared<flex_table_index>(names, ordered);
+      index->update(index_columns(self, names), self.nrows());
+      self.indexes().add(index);
+    }
+  }
+
+  /**
+   * Remove a secondary index
+   * @param self The table
+   * @param keys The columns of the index
+   * @param ordered Whether the index is ordered
+   */
+  template <typename T>
+  void drop_index(T &self, object keys, bool ordered) {
+    if (!self.indexes().remove(index_keys(keys), ordered)) {
+      PyErr_SetString(PyExc_KeyError, "No index on the columns");
+      boost::python::throw_error_already_set();
+    }
+  }
+
+  /**
+   * Find the rows of this table that match each row of another on the
+   * given columns, using a hash index.
+   * @param self The table to search
+   * @param other The table whose rows to look up
+   * @param keys The columns to match on, which both tables must have
+   * @returns The matching pairs of rows in this table and the other, in
+   *          the order of the rows of the other table
+   */
+  template <typename T>
+  boost::python::tuple join(T &self, T &other, object keys) {
+    std::vector<std::string> names = index_keys(keys);
+    std::shared_ptr<flex_table_index> index = updated_index(self, names, false);
+    flex_table_index::column_list probe = index_columns(other, names);
+    index->check_probe(probe);
+    scitbx::af::shared<std::size_t> self_rows;
+    scitbx::af::shared<std::size_t> other_rows;
+    std::vector<std::size_t> rows;
+    for (std::size_t j = 0; j < other.nrows(); ++j) {
+      index->find(probe, j, rows);
+      for (std::size_t i = 0; i < rows.size(); ++i) {
+        self_rows.push_back(rows[i]);
+        other_rows.push_back(j);
+      }
+    }
+    return boost::python::make_tuple(self_rows, other_rows);
+  }
+
+  /**
+   * Find the first row of this table that matches each row of another on
+   * the given columns, using a hash index.
+   * @param self The table to search
+   * @param other The table whose rows to look up
+   * @param keys The columns to match on, which both tables must have
+   * @returns For each row of the other table, the first matching row or -1
+   */
+  template <typename T>
+  scitbx::af::shared<int> lookup(T &self, T &other, object keys) {
+    std::vector<std::string> names = index_keys(keys);
+    std::shared_ptr<flex_table_index> index = updated_index(self, names, false);
+    flex_table_index::column_list probe = index_columns(other, names);
+    index->check_probe(probe);
+    scitbx::af::shared<int> result(other.nrows(), -1);
+    std::vector<std::size_t> rows;
+    for (std::size_t j = 0; j < result.size(); ++j) {
+      index->find(probe, j, rows);
+      if (!rows.empty()) {
+        result[j] = (int)rows[0];
+      }
+    }
+    return result;
+  }
+
+  /**
+   * Find the rows with values of a column in a range, using an ordered
+   * index.
+   * @param self The table
+   * @param key The column
+   * @param low The lowest value to include, or None
+   * @param high The value to stop before, or None
+   * @returns The rows in the order of their values
+   */
+  template <typename T>
+  scitbx::af::shared<std::size_t> select_range(T &self,
+                                               const typename T::key_type &key,
+                                               object low,
+                                               object high) {
+    std::shared_ptr<flex_table_index> index =
+      updated_index(self, std::vector<std::string>(1, key), true);
+    typename T::mapped_type column = self[key].variant();
+    std::shared_ptr<index_column_base> low_bound, high_bound;
+    if (!low.is_none()) {
+      make_bound_column_visitor visitor(low);
+      low_bound = column.apply_visitor(visitor);
+    }
+    if (!high.is_none()) {
+      make_bound_column_visitor visitor(high);
+      high_bound = column.apply_visitor(visitor);
+    }
+    return index->range(low_bound.get(), high_bound.get());
+  }
+
+  /**
+   * Write the table to a columnar file, which can be mapped back into
+   * memory with from_columnar_file
+   * @param self The table
+   * @param filename The file path
+   */
+  template <typename T>
+  void as_columnar_file(const T &self, const std::string &filename) {
+    write_table_file(self, filename);
+  }
+
+  /**
+   * Make a table from a columnar file. The columns are views of a copy on
+   * write memory mapping of the file, so only the pages of the columns
+   * that are used are ever read, and changes are not written back.
+   * @param filename The file path
+   * @param keys The columns to use, or None for all of them
+   * @returns The table
+   */
+  template <typename T>
+  T from_columnar_file(const std::string &filename, object keys) {
+    std::vector<std::string> names;
+    if (!keys.is_none()) {
+      names = index_keys(keys);
+    }
+    return table_file_mapping(filename).table<T>(names);
+  }
+
   /**
    * Perform a shallow copy
    */
@@ -1157,8 +1746,175 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
     }
   };
 
+  namespace detail {
+
+    /**
+     * Type erased ownership of a column, for the column buffer
+     */
+    struct column_holder_base {
+      virtual ~column_holder_base() {}
+      virtual void *data() = 0;
+      virtual std::size_t nbytes() const = 0;
+    };
+
+    template <typename T>
+    struct column_holder : public column_holder_base {
+      scitbx::af::shared<T> column;
+      column_holder(const scitbx::af::shared<T> &column_) : column(column_) {}
+      void *data() {
+        return column.begin();
+      }
+      std::size_t nbytes() const {
+        return column.size() * sizeof(T);
+      }
+    };
+
+    /**
+     * A Python object exposing the memory of a column through the buffer
+     * protocol, read only. It holds a reference to the column, so the
+     * memory stays valid for as long as the buffer is in use.
+     */
+    struct column_buffer_object {
+      PyObject_HEAD column_holder_base *holder;
+    };
+
+    inline int column_buffer_getbuffer(PyObject *self, Py_buffer *view, int flags) {
+      column_holder_base *holder = ((column_buffer_object *)self)->holder;
+      return PyBuffer_FillInfo(
+        view, self, holder->data(), (Py_ssize_t)holder->nbytes(), 1, flags);
+    }
+
+    inline void column_buffer_dealloc(PyObject *self) {
+      delete ((column_buffer_object *)self)->holder;
+      PyObject_Del(self);
+    }
+
+    inline PyTypeObject *column_buffer_type() {
+      static PyBufferProcs buffer_procs = {&column_buffer_getbuffer, NULL};
+      static PyTypeObject type = {PyVarObject_HEAD_INIT(NULL, 0)};
+      if (type.tp_name == NULL) {
+        type.tp_name = "dxtbx.flex_table_column_buffer";
+        type.tp_basicsize = sizeof(column_buffer_object);
+        type.tp_flags = Py_TPFLAGS_DEFAULT;
+        type.tp_dealloc = &column_buffer_dealloc;
+        type.tp_as_buffer = &buffer_procs;
+        if (PyType_Ready(&type) < 0) {
+          throw_error_already_set();
+        }
+      }
+      return &type;
+    }
+
+    template <typename T>
+    object make_column_buffer(const scitbx::af::shared<T> &column) {
+      column_buffer_object *buffer =
+        PyObject_New(column_buffer_object, column_buffer_type());
+      if (buffer == NULL) {
+        throw_error_already_set();
+      }
+      buffer->holder = new column_holder<T>(column);
+      return object(handle<>((PyObject *)buffer));
+    }
+
+    /**
+     * A visitor to convert a column for a protocol 5 pickle. Columns of
+     * plain data become (type index, element size, PickleBuffer), and any
+     * other column type is given as an object, as in a version 1 state.
+     */
+    struct column_to_pickle_visitor : public boost::static_visitor<object> {
+      int which_;
+      column_to_pickle_visitor(int which) : which_(which) {}
+
+      template <typename T>
+      object operator()(const scitbx::af::shared<T> &col) const {
+        return convert(col, std::is_trivially_copyable<T>());
+      }
+
+      template <typename T>
+      object convert(const scitbx::af::shared<T> &col, std::true_type) const {
+        object buffer = make_column_buffer(col);
+        object pickle_buffer(handle<>(PyPickleBuffer_FromObject(buffer.ptr())));
+        return boost::python::make_tuple(which_, sizeof(T), pickle_buffer);
+      }
+
+      template <typename T>
+      object convert(const scitbx::af::shared<T> &col, std::false_type) const {
+        return object(col);
+      }
+    };
+
+    /**
+     * Hold a contiguous buffer view of a Python object
+     */
+    class scoped_buffer {
+    public:
+      explicit scoped_buffer(object obj) {
+        if (PyObject_GetBuffer(obj.ptr(), &view_, PyBUF_C_CONTIGUOUS) < 0) {
+          throw_error_already_set();
+        }
+      }
+      ~scoped_buffer() {
+        PyBuffer_Release(&view_);
+      }
+      const void *data() const {
+        return view_.buf;
+      }
+      std::size_t nbytes() const {
+        return view_.len;
+      }
+
+    private:
+      scoped_buffer(const scoped_buffer &);
+      scoped_buffer &operator=(const scoped_buffer &);
+      Py_buffer view_;
+    };
+
+    /**
+     * An MPL function to create the column with a given type index from
+     * the bytes of a buffer. The state is held by reference, because
+     * boost::mpl::for_each passes the function by value.
+     */
+    template <typename T>
+    struct column_from_buffer {
+      T &table;
+      const typename T::key_type &key;
+      int which;
+      std::size_t element_size;
+      const scoped_buffer &buffer;
+      int &index;
+
+      template <typename U>
+      void operator()(const U &) const {
+        if (index++ == which) {
+          typedef typename U::value_type value_type;
+          copy(std::is_trivially_copyable<value_type>(), (value_type *)NULL);
+        }
+      }
+
+      template <typename V>
+      void copy(std::true_type, V *) const {
+        DXTBX_ASSERT(element_size == sizeof(V));
+        DXTBX_ASSERT(buffer.nbytes() == table.nrows() * sizeof(V));
+        scitbx::af::shared<V> column = table[key];
+        if (buffer.nbytes() > 0) {
+          std::memcpy(column.begin(), buffer.data(), buffer.nbytes());
+        }
+      }
+
+      template <typename V>
+      void copy(std::false_type, V *) const {
+        throw DXTBX_ERROR("Column type can not be unpickled from a buffer");
+      }
+    };
+
+  }  // namespace detail
+
   /**
-   * Class to pickle and unpickle the table
+   * Class to pickle and unpickle the table. Version 1 states hold each
+   * column as a flex array, pickled with its own pickler. Version 2 states,
+   * used for pickle protocol 5 through reduce_ex, hand out the memory of
+   * plain data columns as PickleBuffers, so out-of-band pickling copies
+   * nothing when dumping and once when loading.
    */
   template <typename T>
   struct flex_table_pickle_suite : boost::python::pickle_suite {
@@ -1180,9 +1936,38 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       return boost::python::make_tuple(version, self.nrows(), self.ncols(), columns);
     }
 
+    /**
+     * Get a version 2 state, with plain data columns as PickleBuffers
+     */
+    static boost::python::tuple getstate_buffers(const flex_table_type &self) {
+      DXTBX_ASSERT(self.is_consistent());
+      unsigned int version = 2;
+
+      dict columns;
+      for (const_iterator it = self.begin(); it != self.end(); ++it) {
+        detail::column_to_pickle_visitor visitor(it->second.which());
+        columns[it->first] = it->second.apply_visitor(visitor);
+      }
+      return boost::python::make_tuple(version, self.nrows(), self.ncols(), columns);
+    }
+
+    /**
+     * Reduce the table for pickling. Protocol 5 and above get a version 2
+     * state, and anything older falls back to the version 1 state.
+     */
+    static object reduce_ex(object self, int protocol) {
+      if (protocol < 5) {
+        return self.attr("__reduce__")();
+      }
+      const flex_table_type &table = extract<const flex_table_type &>(self)();
+      return boost::python::make_tuple(
+        self.attr("__class__"), boost::python::tuple(), getstate_buffers(table));
+    }
+
     static void setstate(flex_table_type &self, boost::python::tuple state) {
       DXTBX_ASSERT(boost::python::len(state) == 4);
-      DXTBX_ASSERT(extract<unsigned int>(state[0]) == 1);
+      unsigned int version = extract<unsigned int>(state[0]);
+      DXTBX_ASSERT(version == 1 || version == 2);
       std::size_t nrows = extract<std::size_t>(state[1]);
       std::size_t ncols = extract<std::size_t>(state[2]);
       self.resize(nrows);
@@ -1195,8 +1980,25 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
       object self_obj(self);
       for (std::size_t i = 0; i < ncols; ++i) {
         object item = items[i];
-        DXTBX_ASSERT(len(item[1]) == nrows);
         std::string name = extract<std::string>(item[0]);
+        if (version == 2 && PyTuple_Check(object(item[1]).ptr())) {
+          // Plain data, as (type index, element size, buffer)
+          object column = item[1];
+          DXTBX_ASSERT(len(column) == 3);
+          detail::scoped_buffer buffer(column[2]);
+          int index = 0;
+          detail::column_from_buffer<flex_table_type> creator = {
+            self,
+            name,
+            extract<int>(column[0]),
+            extract<std::size_t>(column[1]),
+            buffer,
+            index};
+          boost::mpl::for_each<typename flex_table_type::mapped_type::types>(creator);
+          DXTBX_ASSERT(self.contains(name));
+          continue;
+        }
+        DXTBX_ASSERT(len(item[1]) == nrows);
         self_obj[name] = item[1];
       }
       DXTBX_ASSERT(self.is_consistent());
@@ -1240,6 +2042,10 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
         .def("insert", &insert<flex_table_type>)
         .def("extend", &extend<flex_table_type>)
         .def("update", &update<flex_table_type>)
+        .def("concatenate",
+             &concatenate<flex_table_type>,
+             (arg("tables"), arg("id_key") = object(), arg("nthreads") = 0))
+        .staticmethod("concatenate")
         .def("nrows", &flex_table_type::nrows)
         .def("ncols", &flex_table_type::ncols)
         .def("is_consistent", &flex_table_type::is_consistent)
@@ -1272,6 +2078,31 @@ namespace dxtbx { namespace af { namespace flex_table_suite {
         .def("del_selected", &del_selected_cols_keys<flex_table_type>)
         .def("del_selected", &del_selected_cols_tuple<flex_table_type>)
         .def("reorder", &reorder<flex_table_type>)
+        .def("sort_by_columns",
+             &sort_by_columns<flex_table_type>,
+             (arg("keys"),
+              arg("reverse") = false,
+              arg("stable") = false,
+              arg("nthreads") = 0))
+        .def("create_index",
+             &create_index<flex_table_type>,
+             (arg("keys"), arg("ordered") = false))
+        .def("drop_index",
+             &drop_index<flex_table_type>,
+             (arg("keys"), arg("ordered") = false))
+        .def("has_index",
+             &has_index<flex_table_type>,
+             (arg("keys"), arg("ordered") = false))
+        .def("join", &join<flex_table_type>, (arg("other"), arg("keys")))
+        .def("lookup", &lookup<flex_table_type>, (arg("other"), arg("keys")))
+        .def("select_range",
+             &select_range<flex_table_type>,
+             (arg("key"), arg("low") = object(), arg("high") = object()))
+        .def("as_columnar_file", &as_columnar_file<flex_table_type>)
+        .def("from_columnar_file",
+             &from_columnar_file<flex_table_type>,
+             (arg("filename"), arg("keys") = object()))
+        .staticmethod("from_columnar_file")
         .def("__copy__", &copy<flex_table_type>)
         .def("__deepcopy__", &deepcopy<flex_table_type>);
 
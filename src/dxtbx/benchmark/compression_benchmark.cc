@@ -0,0 +1,352 @@
+/*
+ * compression_benchmark.cc
+ *
+ *  Micro-benchmark for the CBF byte-offset and Rigaku TY6 codecs in
+ *  boost_python/compression.cc.
+ *
+ *  Usage: dxtbx_compression_benchmark [-r repeats] [-t threads] [file.cbf ...]
+ *
+ *  Synthetic low- and high-count frames are always measured, at
+ *  Pilatus 6M and Eiger 16M sizes. Any CBF files given on the command line
+ *  are decoded from their binary section and measured in the same way. Every
+ *  codec is checked for an exact round trip before it is timed.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dxtbx/boost_python/compression.h>
+
+using dxtbx::boost_python::cbf_compress;
+using dxtbx::boost_python::cbf_decompress;
+using dxtbx::boost_python::cbf_decompress_scalar;
+using dxtbx::boost_python::rod_TY6_decompress;
+
+namespace {
+
+  struct Frame {
+    std::string name;
+    int slow;
+    int fast;
+    std::vector<int> data;
+  };
+
+  // A flat background with Poisson noise and a scattering of bright spots
+  Frame make_frame(const std::string &name,
+                   int slow,
+                   int fast,
+                   double background,
+                   double peak,
+                   unsigned int seed) {
+    Frame frame;
+    frame.name = name;
+    frame.slow = slow;
+    frame.fast = fast;
+    frame.data.resize((std::size_t)slow * fast);
+
+    std::mt19937 rng(seed);
+    std::poisson_distribution<int> noise(background);
+    for (auto &v : frame.data) {
+      v = noise(rng);
+    }
+
+    std::uniform_int_distribution<int> pick_y(2, slow - 3);
+    std::uniform_int_distribution<int> pick_x(2, fast - 3);
+    std::exponential_distribution<double> intensity(1.0 / peak);
+    const std::size_t nspots = frame.data.size() / 2000;
+    for (std::size_t i = 0; i < nspots; ++i) {
+      int y = pick_y(rng);
+      int x = pick_x(rng);
+      double total = intensity(rng);
+      for (int dy = -2; dy <= 2; ++dy) {
+        for (int dx = -2; dx <= 2; ++dx) {
+          double w = std::exp(-0.5 * (dy * dy + dx * dx));
+          frame.data[(std::size_t)(y + dy) * fast + x + dx] += (int)(total * w / 6.3);
+        }
+      }
+    }
+    return frame;
+  }
+
+  // Read the first binary section of a byte-offset compressed CBF
+  bool read_cbf(const std::string &filename, Frame &frame) {
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file) {
+      return false;
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+    const std::string marker("\x0c\x1a\x04\xd5", 4);
+    std::size_t start = contents.find(marker);
+    if (start == std::string::npos) {
+      return false;
+    }
+    std::string header = contents.substr(0, start);
+
+    auto header_value = [&](const std::string &key) -> long {
+      std::size_t pos = header.find(key);
+      if (pos == std::string::npos) {
+        return -1;
+      }
+      return std::atol(header.c_str() + pos + key.size());
+    };
+    long size = header_value("X-Binary-Size:");
+    long fast = header_value("X-Binary-Size-Fastest-Dimension:");
+    long slow = header_value("X-Binary-Size-Second-Dimension:");
+    start += marker.size();
+    if (size < 0 || fast <= 0 || slow <= 0 || start + size > contents.size()) {
+      return false;
+    }
+
+    frame.name = filename;
+    frame.slow = (int)slow;
+    frame.fast = (int)fast;
+    frame.data.resize((std::size_t)slow * fast);
+    unsigned int n = cbf_decompress(
+      contents.data() + start, (std::size_t)size, frame.data.data(), frame.data.size());
+    return n == frame.data.size();
+  }
+
+  void ty6_put_offset(std::vector<char> &out, int d) {
+    if (d >= -127 && d <= 126) {
+      out.push_back((char)(d + 127));
+    } else if (d >= -32768 && d <= 32767) {
+      out.push_back((char)254);
+      out.push_back((char)(d & 0xff));
+      out.push_back((char)((d >> 8) & 0xff));
+    } else {
+      out.push_back((char)255);
+      for (int k = 0; k < 4; ++k) {
+        out.push_back((char)((d >> (8 * k)) & 0xff));
+      }
+    }
+  }
+
+  // A straightforward TY6 encoder, so that the decoder has something to read
+  void ty6_compress(const Frame &frame,
+                    std::vector<char> &data,
+                    std::vector<char> &offsets) {
+    const int fast = frame.fast;
+    data.clear();
+    offsets.clear();
+    for (int y = 0; y < frame.slow; ++y) {
+      const unsigned int pos = (unsigned int)data.size();
+      for (int k = 0; k < 4; ++k) {
+        offsets.push_back((char)((pos >> (8 * k)) & 0xff));
+      }
+      const int *row = &frame.data[(std::size_t)y * fast];
+      ty6_put_offset(data, row[0]);
+      int p = 1;
+      for (int block = 0; block < (fast - 1) / 16; ++block, p += 16) {
+        int delta[16];
+        for (int i = 0; i < 16; ++i) {
+          delta[i] = row[p + i] - row[p + i - 1];
+        }
+        // Pick the narrowest bit width that holds each half block
+        int nbits[2];
+        for (int h = 0; h < 2; ++h) {
+          int n = 1;
+          for (; n < 8; ++n) {
+            int zero_at = n > 1 ? (1 << (n - 1)) - 1 : 0;
+            bool fits = true;
+            for (int i = 0; i < 8; ++i) {
+              int v = delta[h * 8 + i] + zero_at;
+              fits = fits && v >= 0 && v < (1 << n);
+            }
+            if (fits) break;
+          }
+          nbits[h] = n;
+        }
+        data.push_back((char)(nbits[0] | (nbits[1] << 4)));
+        std::vector<char> overflow;
+        for (int h = 0; h < 2; ++h) {
+          const int n = nbits[h];
+          const int zero_at = n > 1 ? (1 << (n - 1)) - 1 : 0;
+          unsigned long long bits = 0;
+          for (int i = 0; i < 8; ++i) {
+            int d = delta[h * 8 + i];
+            unsigned int raw = d + zero_at;
+            if (n == 8 && (d < -127 || d > 126)) {
+              std::vector<char> escaped;
+              ty6_put_offset(escaped, d);
+              raw = (unsigned char)escaped[0];
+              overflow.insert(overflow.end(), escaped.begin() + 1, escaped.end());
+            }
+            bits |= (unsigned long long)raw << (n * i);
+          }
+          for (int j = 0; j < n; ++j) {
+            data.push_back((char)((bits >> (8 * j)) & 0xff));
+          }
+        }
+        data.insert(data.end(), overflow.begin(), overflow.end());
+      }
+      for (; p < fast; ++p) {
+        ty6_put_offset(data, row[p] - row[p - 1]);
+      }
+    }
+  }
+
+  // Run func repeatedly, returning the best time for one call in seconds
+  template <typename Function>
+  double best_time(int repeats, Function func) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      func();
+      auto end = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+  }
+
+  void report(const Frame &frame, const char *codec, double seconds, double ratio) {
+    const double megabytes = frame.data.size() * sizeof(int) / 1e6;
+    std::printf("%-24s %-22s %5dx%-5d %7.2f %10.1f %9.1f\n",
+                frame.name.c_str(),
+                codec,
+                frame.slow,
+                frame.fast,
+                ratio,
+                megabytes / seconds,
+                1.0 / seconds);
+  }
+
+  bool benchmark(const Frame &frame, int repeats, std::size_t nthreads) {
+    const std::size_t n = frame.data.size();
+    const double raw_size = n * sizeof(int);
+    std::vector<int> decoded(n);
+
+    // Byte offset: check the round trip through every implementation first
+    std::vector<char> packed = cbf_compress(frame.data.data(), n);
+    if (cbf_compress(frame.data.data(), n, nthreads) != packed) {
+      std::printf("%s: threaded compression differs\n", frame.name.c_str());
+      return false;
+    }
+    if (cbf_decompress(packed.data(), packed.size(), decoded.data(), n) != n
+        || decoded != frame.data) {
+      std::printf("%s: byte offset round trip failed\n", frame.name.c_str());
+      return false;
+    }
+    std::fill(decoded.begin(), decoded.end(), 0);
+    if (cbf_decompress_scalar(packed.data(), packed.size(), decoded.data(), n) != n
+        || decoded != frame.data) {
+      std::printf("%s: scalar byte offset round trip failed\n", frame.name.c_str());
+      return false;
+    }
+    const double ratio = raw_size / packed.size();
+
+    report(frame,
+           "cbf_compress",
+           best_time(repeats, [&] { cbf_compress(frame.data.data(), n); }),
+           ratio);
+    report(frame,
+           "cbf_compress threaded",
+           best_time(repeats, [&] { cbf_compress(frame.data.data(), n, nthreads); }),
+           ratio);
+    report(frame,
+           "cbf_decompress_scalar",
+           best_time(repeats,
+                     [&] {
+                       cbf_decompress_scalar(
+                         packed.data(), packed.size(), decoded.data(), n);
+                     }),
+           ratio);
+    report(frame,
+           "cbf_decompress",
+           best_time(
+             repeats,
+             [&] { cbf_decompress(packed.data(), packed.size(), decoded.data(), n); }),
+           ratio);
+
+    // TY6
+    std::vector<char> ty6_data, ty6_offsets;
+    ty6_compress(frame, ty6_data, ty6_offsets);
+    std::fill(decoded.begin(), decoded.end(), 0);
+    rod_TY6_decompress(
+      decoded.data(), ty6_data.data(), ty6_offsets.data(), frame.slow, frame.fast);
+    if (decoded != frame.data) {
+      std::printf("%s: TY6 round trip failed\n", frame.name.c_str());
+      return false;
+    }
+    const double ty6_ratio = raw_size / ty6_data.size();
+    report(frame,
+           "rod_TY6_decompress",
+           best_time(repeats,
+                     [&] {
+                       rod_TY6_decompress(decoded.data(),
+                                          ty6_data.data(),
+                                          ty6_offsets.data(),
+                                          frame.slow,
+                                          frame.fast);
+                     }),
+           ty6_ratio);
+    report(frame,
+           "rod_TY6 threaded",
+           best_time(repeats,
+                     [&] {
+                       rod_TY6_decompress(decoded.data(),
+                                          ty6_data.data(),
+                                          ty6_offsets.data(),
+                                          frame.slow,
+                                          frame.fast,
+                                          nthreads);
+                     }),
+           ty6_ratio);
+    return true;
+  }
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int repeats = 5;
+  std::size_t nthreads = 0;
+  std::vector<std::string> filenames;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeats = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      nthreads = (std::size_t)std::max(0, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-h") == 0) {
+      std::printf("Usage: %s [-r repeats] [-t threads] [file.cbf ...]\n", argv[0]);
+      return 0;
+    } else {
+      filenames.push_back(argv[i]);
+    }
+  }
+
+  std::vector<Frame> frames;
+  frames.push_back(make_frame("pilatus6m-low", 2527, 2463, 0.2, 50, 1));
+  frames.push_back(make_frame("pilatus6m-high", 2527, 2463, 200, 5e4, 2));
+  frames.push_back(make_frame("eiger16m-low", 4362, 4148, 0.05, 20, 3));
+  frames.push_back(make_frame("eiger16m-high", 4362, 4148, 50, 1e4, 4));
+  for (const auto &filename : filenames) {
+    Frame frame;
+    if (!read_cbf(filename, frame)) {
+      std::printf("Could not read byte offset data from %s\n", filename.c_str());
+      return 1;
+    }
+    frames.push_back(frame);
+  }
+
+  std::printf("%-24s %-22s %11s %7s %10s %9s\n",
+              "frame",
+              "codec",
+              "size",
+              "ratio",
+              "MB/s",
+              "frames/s");
+  bool ok = true;
+  for (const auto &frame : frames) {
+    ok = benchmark(frame, repeats, nthreads) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -1,292 +1,782 @@
 #include "compression.h"
 #include "dxtbx/error.h"
+#include "dxtbx/parallel.h"
 #include <assert.h>
-
-typedef union {
-  char b[2];
-  short s;
-} union_short;
-
-typedef union {
-  char b[4];
-  int i;
-} union_int;
-
-void byte_swap_short(char *b) {
-  char c;
-  c = b[0];
-  b[0] = b[1];
-  b[1] = c;
-  return;
-}
-
-void byte_swap_int(char *b) {
-  char c;
-  c = b[0];
-  b[0] = b[3];
-  b[3] = c;
-  c = b[1];
-  b[1] = b[2];
-  b[2] = c;
-  return;
-}
-
-bool little_endian() {
-  int i = 0x1;
-  char b = ((union_int *)&i)[0].b[0];
-  if (b == 0) {
-    return false;
-  } else {
-    return true;
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// Vectorised byte-offset decoding is available on little-endian x86-64 (SSE2
+// always, AVX2 chosen at runtime) and aarch64 (NEON). Anything else uses the
+// scalar decoder.
+#if defined(__x86_64__) || defined(_M_X64)
+#define DXTBX_CBF_DECOMPRESS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define DXTBX_TARGET_AVX2
+#else
+#define DXTBX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON) \
+  && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define DXTBX_CBF_DECOMPRESS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+  // Number of bytes the byte-offset encoding of one delta takes
+  inline std::size_t cbf_encoded_size(int delta) {
+    if ((-0x7f <= delta) && (delta < 0x80)) {
+      return 1;
+    }
+    if ((-0x7fff <= delta) && (delta < 0x8000)) {
+      return 3;
+    }
+    return 7;
   }
-}
 
-std::vector<char> dxtbx::boost_python::cbf_compress(const int *values,
-                                                    const std::size_t &sz) {
-  std::vector<char> packed(0);
-  int current = 0;
-  int delta, i;
-  unsigned int j;
-  bool le = little_endian();
-  short s;
-  char c;
-  char *b;
-
-  for (j = 0; j < sz; j++) {
-    delta = values[j] - current;
+  // Difference between consecutive values, wrapping on overflow as the
+  // decoder does when it adds the delta back on
+  inline int cbf_delta(int value, int previous) {
+    return (int)((unsigned int)value - (unsigned int)previous);
+  }
 
+  // Write the byte-offset encoding of one delta to out, returning the position
+  // just past it. Multi-byte deltas are always stored little-endian.
+  inline char *cbf_write_delta(int delta, char *out) {
     if ((-0x7f <= delta) && (delta < 0x80)) {
-      c = (char)delta;
-      packed.push_back(c);
-      current += delta;
-      continue;
+      *out++ = (char)delta;
+      return out;
     }
 
-    packed.push_back(-0x80);
+    *out++ = (char)0x80;
 
     if ((-0x7fff <= delta) && (delta < 0x8000)) {
-      s = (short)delta;
-      b = ((union_short *)&s)[0].b;
-
-      if (!le) {
-        byte_swap_short(b);
-      }
-
-      packed.push_back(b[0]);
-      packed.push_back(b[1]);
-      current += delta;
-      continue;
+      *out++ = (char)(delta & 0xff);
+      *out++ = (char)((delta >> 8) & 0xff);
+      return out;
     }
 
-    s = -0x8000;
-    b = ((union_short *)&s)[0].b;
-
-    if (!le) {
-      byte_swap_short(b);
-    }
+    *out++ = (char)0x00;
+    *out++ = (char)0x80;
+    *out++ = (char)(delta & 0xff);
+    *out++ = (char)((delta >> 8) & 0xff);
+    *out++ = (char)((delta >> 16) & 0xff);
+    *out++ = (char)((delta >> 24) & 0xff);
+    return out;
+  }
 
-    packed.push_back(b[0]);
-    packed.push_back(b[1]);
+  // Smallest number of values worth handing to a separate thread
+  const std::size_t CBF_COMPRESS_MIN_BLOCK = 1 << 16;
 
-    assert(delta != -0x8000000);
+}  // namespace
 
-    i = delta;
-    b = ((union_int *)&i)[0].b;
+std::vector<char> dxtbx::boost_python::cbf_compress(const int *values,
+                                                    const std::size_t &sz) {
+  return cbf_compress(values, sz, 1);
+}
 
-    if (!le) {
-      byte_swap_int(b);
+std::vector<char> dxtbx::boost_python::cbf_compress(const int *values,
+                                                    const std::size_t &sz,
+                                                    std::size_t nthreads) {
+  // Each delta only depends on the value before it, so blocks of values can be
+  // encoded independently. First size the encoded output of every block, then
+  // encode each block straight into its place in the output buffer.
+  nthreads = dxtbx::resolve_thread_count(nthreads);
+  const std::size_t nblocks = std::max<std::size_t>(
+    1, std::min(nthreads, sz / CBF_COMPRESS_MIN_BLOCK));
+  std::vector<std::size_t> block_offset(nblocks + 1, 0);
+
+  auto block_begin = [&](std::size_t block) { return block * sz / nblocks; };
+
+  dxtbx::parallel_for(nblocks, nthreads, [&](std::size_t first, std::size_t last) {
+    for (std::size_t block = first; block < last; ++block) {
+      const std::size_t begin = block_begin(block);
+      const std::size_t end = block_begin(block + 1);
+      int current = begin > 0 ? values[begin - 1] : 0;
+      std::size_t size = 0;
+      for (std::size_t j = begin; j < end; j++) {
+        size += cbf_encoded_size(cbf_delta(values[j], current));
+        current = values[j];
+      }
+      block_offset[block + 1] = size;
     }
+  });
 
-    packed.push_back(b[0]);
-    packed.push_back(b[1]);
-    packed.push_back(b[2]);
-    packed.push_back(b[3]);
-    current += delta;
+  for (std::size_t block = 0; block < nblocks; ++block) {
+    block_offset[block + 1] += block_offset[block];
   }
 
+  std::vector<char> packed(block_offset[nblocks]);
+
+  dxtbx::parallel_for(nblocks, nthreads, [&](std::size_t first, std::size_t last) {
+    for (std::size_t block = first; block < last; ++block) {
+      const std::size_t begin = block_begin(block);
+      const std::size_t end = block_begin(block + 1);
+      int current = begin > 0 ? values[begin - 1] : 0;
+      char *out = packed.data() + block_offset[block];
+      for (std::size_t j = begin; j < end; j++) {
+        out = cbf_write_delta(cbf_delta(values[j], current), out);
+        current = values[j];
+      }
+      DXTBX_ASSERT(out == packed.data() + block_offset[block + 1]);
+    }
+  });
+
   return packed;
 }
 
-unsigned int dxtbx::boost_python::cbf_decompress(const char *packed,
-                                                 std::size_t packed_sz,
-                                                 int *values,
-                                                 std::size_t values_sz) {
-  int current = 0;
-  int *original = values;
-  unsigned int j = 0;
-  short s;
-  char c;
-  int i;
-  bool le = little_endian();
-
-  while ((j < packed_sz) && ((values - original) < values_sz)) {
-    c = packed[j];
+inline uint32_t read_uint32_from_bytearray(const char *buf) {
+  // `char` can be signed or unsigned depending on the platform.
+  // For bit shift operations, we need unsigned values.
+  // If `char` on the platform is signed, converting directly to "unsigned int" can
+  // produce huge numbers because modulo 2^n is taken by the integral conversion
+  // rules. Thus, we have to explicitly cast to `unsigned char` first.
+  // Then the automatic integral promotion converts them to `int`.
+  // Note that the unsigned to signed conversion is implementation-dependent
+  // and might not produce the intended result if two's complement is not used.
+  // Fortunately, DIALS targets only two's complement.
+  //    https://github.com/cctbx/dxtbx/issues/11#issuecomment-1657809645
+  // Moreover, C++20 standarized this:
+  //    https://stackoverflow.com/questions/54947427/going-from-signed-integers-to-unsigned-integers-and-vice-versa-in-c20
+
+  return ((unsigned char)buf[0]) | (((unsigned char)buf[1]) << 8)
+         | (((unsigned char)buf[2]) << 16) | (((unsigned char)buf[3]) << 24);
+}
+
+inline uint16_t read_uint16_from_bytearray(const char *buf) {
+  return ((unsigned char)buf[0]) | ((unsigned char)buf[1] << 8);
+}
+
+namespace {
+
+  // Read one delta from a byte-offset stream starting at packed[j], advancing j
+  // past it. Deltas are one signed byte, or an 0x80 escape followed by a
+  // little-endian short, or a further 0x8000 escape followed by an int.
+  inline int cbf_read_delta(const char *packed, std::size_t packed_sz, std::size_t &j) {
+    // Use signed char explicitly, as plain char is unsigned on e.g. aarch64
+    signed char c = (signed char)packed[j];
     j += 1;
 
     if (c != -0x80) {
-      current += c;
-      *values = current;
-      values++;
-      continue;
+      return c;
     }
 
     DXTBX_ASSERT(j + 1 < packed_sz);
-    ((union_short *)&s)[0].b[0] = packed[j];
-    ((union_short *)&s)[0].b[1] = packed[j + 1];
+    short s = (signed short)read_uint16_from_bytearray(packed + j);
     j += 2;
 
-    if (!le) {
-      byte_swap_short((char *)&s);
-    }
-
     if (s != -0x8000) {
-      current += s;
-      *values = current;
-      values++;
-      continue;
+      return s;
     }
 
     DXTBX_ASSERT(j + 3 < packed_sz);
-    ((union_int *)&i)[0].b[0] = packed[j];
-    ((union_int *)&i)[0].b[1] = packed[j + 1];
-    ((union_int *)&i)[0].b[2] = packed[j + 2];
-    ((union_int *)&i)[0].b[3] = packed[j + 3];
+    int i = (signed int)read_uint32_from_bytearray(packed + j);
     j += 4;
 
-    if (!le) {
-      byte_swap_int((char *)&i);
+    return i;
+  }
+
+  // Position in a byte-offset stream, so that decoding can be resumed
+  struct cbf_decode_state {
+    cbf_decode_state() : j(0), current(0) {}
+
+    std::size_t j;
+    int current;
+  };
+
+  std::size_t cbf_decode_scalar(const char *packed,
+                                std::size_t packed_sz,
+                                cbf_decode_state &state,
+                                int *values,
+                                std::size_t values_sz) {
+    int current = state.current;
+    std::size_t j = state.j;
+    std::size_t n = 0;
+
+    while ((j < packed_sz) && (n < values_sz)) {
+      current += cbf_read_delta(packed, packed_sz, j);
+      values[n++] = current;
+    }
+
+    state.j = j;
+    state.current = current;
+    return n;
+  }
+
+  // The vectorised decoders below all work the same way: look at a block of
+  // bytes and, if it holds no 0x80 escape marker, prefix-sum the single-byte
+  // deltas in registers. Blocks containing an escape are decoded by the scalar
+  // path up to the end of the block, which keeps escape-dense data (e.g. high
+  // count frames) no slower than the plain decoder.
+
+#if defined(DXTBX_CBF_DECOMPRESS_X86)
+
+  // Prefix-sum 16 single-byte deltas on top of `current`, writing 16 values
+  inline void cbf_decode_block_sse2(__m128i bytes, int current, int *out) {
+    // Sign-extend to 2x8 shorts. The partial sums of 16 deltas of magnitude
+    // at most 127 fit comfortably in 16 bits.
+    __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), bytes);
+    __m128i lo = _mm_unpacklo_epi8(bytes, sign);
+    __m128i hi = _mm_unpackhi_epi8(bytes, sign);
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+    // Carry the last partial sum of the lower half into the upper half
+    __m128i lo_last = _mm_shufflehi_epi16(lo, 0xff);
+    hi = _mm_add_epi16(hi, _mm_unpackhi_epi64(lo_last, lo_last));
+
+    // Widen to int and add the running value
+    __m128i base = _mm_set1_epi32(current);
+    __m128i lo_sign = _mm_srai_epi16(lo, 15);
+    __m128i hi_sign = _mm_srai_epi16(hi, 15);
+    __m128i *dst = (__m128i *)out;
+    _mm_storeu_si128(dst + 0, _mm_add_epi32(base, _mm_unpacklo_epi16(lo, lo_sign)));
+    _mm_storeu_si128(dst + 1, _mm_add_epi32(base, _mm_unpackhi_epi16(lo, lo_sign)));
+    _mm_storeu_si128(dst + 2, _mm_add_epi32(base, _mm_unpacklo_epi16(hi, hi_sign)));
+    _mm_storeu_si128(dst + 3, _mm_add_epi32(base, _mm_unpackhi_epi16(hi, hi_sign)));
+  }
+
+  std::size_t cbf_decode_sse2(const char *packed,
+                              std::size_t packed_sz,
+                              cbf_decode_state &state,
+                              int *values,
+                              std::size_t values_sz) {
+    const std::size_t width = 16;
+    const __m128i escape = _mm_set1_epi8(-0x80);
+    int current = state.current;
+    std::size_t j = state.j;
+    std::size_t n = 0;
+
+    while (j + width <= packed_sz && n + width <= values_sz) {
+      __m128i bytes = _mm_loadu_si128((const __m128i *)(packed + j));
+      unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, escape));
+      if (mask == 0) {
+        cbf_decode_block_sse2(bytes, current, values + n);
+        current = values[n + width - 1];
+        j += width;
+        n += width;
+        continue;
+      }
+      const std::size_t block_end = j + width;
+      while (j < block_end && n < values_sz) {
+        current += cbf_read_delta(packed, packed_sz, j);
+        values[n++] = current;
+      }
+    }
+
+    while (j < packed_sz && n < values_sz) {
+      current += cbf_read_delta(packed, packed_sz, j);
+      values[n++] = current;
+    }
+
+    state.j = j;
+    state.current = current;
+    return n;
+  }
+
+  DXTBX_TARGET_AVX2 void cbf_decode_block_avx2(const char *packed,
+                                               int current,
+                                               int *out) {
+    __m256i carry = _mm256_set1_epi32(current);
+    const __m256i lower_last = _mm256_setr_epi32(0, 0, 0, 0, 3, 3, 3, 3);
+    const __m256i last = _mm256_set1_epi32(7);
+    for (std::size_t k = 0; k < 4; k++) {
+      __m256i x =
+        _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(packed + 8 * k)));
+      // Prefix sum within each 128-bit lane, then add the lower lane total
+      // into the upper lane
+      x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+      x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+      __m256i lane_carry = _mm256_blend_epi32(
+        _mm256_setzero_si256(), _mm256_permutevar8x32_epi32(x, lower_last), 0xf0);
+      x = _mm256_add_epi32(_mm256_add_epi32(x, lane_carry), carry);
+      _mm256_storeu_si256((__m256i *)(out + 8 * k), x);
+      carry = _mm256_permutevar8x32_epi32(x, last);
+    }
+  }
+
+  DXTBX_TARGET_AVX2 std::size_t cbf_decode_avx2(const char *packed,
+                                                std::size_t packed_sz,
+                                                cbf_decode_state &state,
+                                                int *values,
+                                                std::size_t values_sz) {
+    const std::size_t width = 32;
+    const __m256i escape = _mm256_set1_epi8(-0x80);
+    int current = state.current;
+    std::size_t j = state.j;
+    std::size_t n = 0;
+
+    while (j + width <= packed_sz && n + width <= values_sz) {
+      __m256i bytes = _mm256_loadu_si256((const __m256i *)(packed + j));
+      unsigned int mask =
+        (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, escape));
+      if (mask == 0) {
+        cbf_decode_block_avx2(packed + j, current, values + n);
+        current = values[n + width - 1];
+        j += width;
+        n += width;
+        continue;
+      }
+      const std::size_t block_end = j + width;
+      while (j < block_end && n < values_sz) {
+        current += cbf_read_delta(packed, packed_sz, j);
+        values[n++] = current;
+      }
+    }
+
+    while (j < packed_sz && n < values_sz) {
+      current += cbf_read_delta(packed, packed_sz, j);
+      values[n++] = current;
+    }
+
+    state.j = j;
+    state.current = current;
+    return n;
+  }
+
+  bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+      return false;
+    }
+    __cpuid(regs, 1);
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+    // The OS must also save the YMM registers on context switch
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+      return false;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+  }
+
+#endif  // DXTBX_CBF_DECOMPRESS_X86
+
+#if defined(DXTBX_CBF_DECOMPRESS_NEON)
+
+  // Prefix-sum 16 single-byte deltas on top of `current`, writing 16 values
+  inline void cbf_decode_block_neon(int8x16_t bytes, int current, int *out) {
+    const int16x8_t zero = vdupq_n_s16(0);
+    int16x8_t lo = vmovl_s8(vget_low_s8(bytes));
+    int16x8_t hi = vmovl_s8(vget_high_s8(bytes));
+    // vextq_s16(zero, x, 8 - k) shifts x up by k lanes
+    lo = vaddq_s16(lo, vextq_s16(zero, lo, 7));
+    hi = vaddq_s16(hi, vextq_s16(zero, hi, 7));
+    lo = vaddq_s16(lo, vextq_s16(zero, lo, 6));
+    hi = vaddq_s16(hi, vextq_s16(zero, hi, 6));
+    lo = vaddq_s16(lo, vextq_s16(zero, lo, 4));
+    hi = vaddq_s16(hi, vextq_s16(zero, hi, 4));
+    hi = vaddq_s16(hi, vdupq_laneq_s16(lo, 7));
+
+    const int32x4_t base = vdupq_n_s32(current);
+    vst1q_s32(out + 0, vaddw_s16(base, vget_low_s16(lo)));
+    vst1q_s32(out + 4, vaddw_s16(base, vget_high_s16(lo)));
+    vst1q_s32(out + 8, vaddw_s16(base, vget_low_s16(hi)));
+    vst1q_s32(out + 12, vaddw_s16(base, vget_high_s16(hi)));
+  }
+
+  std::size_t cbf_decode_neon(const char *packed,
+                              std::size_t packed_sz,
+                              cbf_decode_state &state,
+                              int *values,
+                              std::size_t values_sz) {
+    const std::size_t width = 16;
+    const int8x16_t escape = vdupq_n_s8(-0x80);
+    int current = state.current;
+    std::size_t j = state.j;
+    std::size_t n = 0;
+
+    while (j + width <= packed_sz && n + width <= values_sz) {
+      int8x16_t bytes = vld1q_s8((const int8_t *)(packed + j));
+      // Narrow the comparison result to 4 bits per byte to get a scalar mask
+      uint8x16_t is_escape = vceqq_s8(bytes, escape);
+      unsigned long long mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(is_escape), 4)), 0);
+      if (mask == 0) {
+        cbf_decode_block_neon(bytes, current, values + n);
+        current = values[n + width - 1];
+        j += width;
+        n += width;
+        continue;
+      }
+      const std::size_t block_end = j + width;
+      while (j < block_end && n < values_sz) {
+        current += cbf_read_delta(packed, packed_sz, j);
+        values[n++] = current;
+      }
+    }
+
+    while (j < packed_sz && n < values_sz) {
+      current += cbf_read_delta(packed, packed_sz, j);
+      values[n++] = current;
+    }
+
+    state.j = j;
+    state.current = current;
+    return n;
+  }
+
+#endif  // DXTBX_CBF_DECOMPRESS_NEON
+
+  typedef std::size_t (*cbf_decode_function)(const char *,
+                                              std::size_t,
+                                              cbf_decode_state &,
+                                              int *,
+                                              std::size_t);
+
+  cbf_decode_function select_cbf_decode() {
+#if defined(DXTBX_CBF_DECOMPRESS_X86)
+    if (cpu_has_avx2()) {
+      return cbf_decode_avx2;
     }
+    return cbf_decode_sse2;
+#elif defined(DXTBX_CBF_DECOMPRESS_NEON)
+    return cbf_decode_neon;
+#else
+    return cbf_decode_scalar;
+#endif
+  }
 
-    current += i;
-    *values = current;
-    values++;
+  // Pick the best implementation for this CPU on first use
+  std::size_t cbf_decode(const char *packed,
+                         std::size_t packed_sz,
+                         cbf_decode_state &state,
+                         int *values,
+                         std::size_t values_sz) {
+    static const cbf_decode_function implementation = select_cbf_decode();
+    return implementation(packed, packed_sz, state, values, values_sz);
   }
 
-  return values - original;
+  // Decode into a narrower integer type through a small buffer of ints,
+  // clamping values that do not fit and counting them in n_overflow
+  template <typename T>
+  unsigned int cbf_decompress_narrow(const char *packed,
+                                     std::size_t packed_sz,
+                                     T *values,
+                                     std::size_t values_sz,
+                                     std::size_t &n_overflow) {
+    const std::size_t chunk = 4096;
+    const int lowest = std::numeric_limits<T>::min();
+    const int highest = std::numeric_limits<T>::max();
+    int buffer[chunk];
+    cbf_decode_state state;
+    std::size_t n = 0;
+    n_overflow = 0;
+
+    while (n < values_sz) {
+      std::size_t nn = cbf_decode(
+        packed, packed_sz, state, buffer, std::min(chunk, values_sz - n));
+      if (nn == 0) {
+        break;
+      }
+      for (std::size_t i = 0; i < nn; ++i) {
+        int v = buffer[i];
+        n_overflow += (v < lowest) | (v > highest);
+        values[n + i] = (T)std::min(std::max(v, lowest), highest);
+      }
+      n += nn;
+    }
+
+    return n;
+  }
+
+}  // namespace
+
+unsigned int dxtbx::boost_python::cbf_decompress_scalar(const char *packed,
+                                                        std::size_t packed_sz,
+                                                        int *values,
+                                                        std::size_t values_sz) {
+  cbf_decode_state state;
+  return cbf_decode_scalar(packed, packed_sz, state, values, values_sz);
 }
 
-inline uint32_t read_uint32_from_bytearray(const char *buf) {
-  // `char` can be signed or unsigned depending on the platform.
-  // For bit shift operations, we need unsigned values.
-  // If `char` on the platform is signed, converting directly to "unsigned int" can
-  // produce huge numbers because modulo 2^n is taken by the integral conversion
-  // rules. Thus, we have to explicitly cast to `unsigned char` first.
-  // Then the automatic integral promotion converts them to `int`.
-  // Note that the unsigned to signed conversion is implementation-dependent
-  // and might not produce the intended result if two's complement is not used.
-  // Fortunately, DIALS targets only two's complement.
-  //    https://github.com/cctbx/dxtbx/issues/11#issuecomment-1657809645
-  // Moreover, C++20 standarized this:
-  //    https://stackoverflow.com/questions/54947427/going-from-signed-integers-to-unsigned-integers-and-vice-versa-in-c20
+unsigned int dxtbx::boost_python::cbf_decompress(const char *packed,
+                                                 std::size_t packed_sz,
+                                                 int *values,
+                                                 std::size_t values_sz) {
+  cbf_decode_state state;
+  return cbf_decode(packed, packed_sz, state, values, values_sz);
+}
 
-  return ((unsigned char)buf[0]) | (((unsigned char)buf[1]) << 8)
-         | (((unsigned char)buf[2]) << 16) | (((unsigned char)buf[3]) << 24);
+unsigned int dxtbx::boost_python::cbf_decompress(const char *packed,
+                                                 std::size_t packed_sz,
+                                                 uint16_t *values,
+                                                 std::size_t values_sz,
+                                                 std::size_t &n_overflow) {
+  return cbf_decompress_narrow(packed, packed_sz, values, values_sz, n_overflow);
 }
 
-inline uint16_t read_uint16_from_bytearray(const char *buf) {
-  return ((unsigned char)buf[0]) | ((unsigned char)buf[1] << 8);
+unsigned int dxtbx::boost_python::cbf_decompress(const char *packed,
+                                                 std::size_t packed_sz,
+                                                 int16_t *values,
+                                                 std::size_t values_sz,
+                                                 std::size_t &n_overflow) {
+  return cbf_decompress_narrow(packed, packed_sz, values, values_sz, n_overflow);
 }
 
-void dxtbx::boost_python::rod_TY6_decompress(int *const ret,
-                                             const char *const buf_data,
-                                             const char *const buf_offsets,
-                                             const int slow,
-                                             const int fast) {
-  const size_t BLOCKSIZE = 8;             // Codes below assume this is at most 8
-  const signed int SHORT_OVERFLOW = 127;  // after 127 is subtracted
-  const signed int LONG_OVERFLOW = 128;
+namespace {
 
-  const size_t nblock = (fast - 1) / (BLOCKSIZE * 2);
-  const size_t nrest = (fast - 1) % (BLOCKSIZE * 2);
+  // TY6 stores pixel differences in pairs of blocks of BLOCKSIZE values, each
+  // value packed into `nbit` bits of a little-endian word
+  const std::size_t TY6_BLOCKSIZE = 8;      // Codes below assume this is at most 8
+  const signed int TY6_SHORT_OVERFLOW = 127;  // after 127 is subtracted
+  const signed int TY6_LONG_OVERFLOW = 128;
 
-  for (size_t iy = 0; iy < slow; iy++) {
-    size_t ipos = read_uint32_from_bytearray(buf_offsets + iy * sizeof(uint32_t));
-    size_t opos = fast * iy;
+#if defined(__GNUC__)
+#define DXTBX_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define DXTBX_FORCE_INLINE __forceinline
+#else
+#define DXTBX_FORCE_INLINE inline
+#endif
 
-    // Values from -127 to +126 (inclusive) are stored with an offset of 127
-    // as 0 to 253. 254 and 255 mark short and long overflows.
-    // Other values ("overflows") are represented in two's complement.
+  // Read a TY6 difference stored as a byte offset by 127, with overflows
+  // stored in the following two or four bytes
+  inline int ty6_read_offset(const char *buf_data, std::size_t &ipos) {
+    int offset = (unsigned char)buf_data[ipos++] - 127;
 
-    int firstpx = (unsigned char)buf_data[ipos++] - 127;
-    if (firstpx == LONG_OVERFLOW) {
+    if (offset == TY6_LONG_OVERFLOW) {
       // See comments in read_uint32_from_bytearray() about
       // the safety of the unsigned to signed conversion.
-      firstpx = (signed int)read_uint32_from_bytearray(buf_data + ipos);
+      offset = (signed int)read_uint32_from_bytearray(buf_data + ipos);
       ipos += 4;
-    } else if (firstpx == SHORT_OVERFLOW) {
-      firstpx = (signed short)read_uint16_from_bytearray(buf_data + ipos);
+    } else if (offset == TY6_SHORT_OVERFLOW) {
+      offset = (signed short)read_uint16_from_bytearray(buf_data + ipos);
       ipos += 2;
     }
-    ret[opos++] = firstpx;
-
-    // For every two blocks
-    for (int k = 0; k < nblock; k++) {
-      const size_t bittypes = buf_data[ipos++];
-      const size_t nbits[2] = {bittypes & 15, (bittypes >> 4) & 15};
-
-      // One pixel is stored using `nbit` bits.
-      // Although `nbit` itself is stored using 4 bits,
-      // only values 1 (0001b) to 8 (1000b) are allowed.
-      // Negative values are encoded as follows. (Not 2's complement!)
-      // - When nbit = 1, the pixel value is 0 or 1
-      // - When nbit = 2, the pixel value is -1, 0, 1, 2
-      // - When nbit = 3, the pixel value is -3, -2, 1, 0, 1, 2, 3, 4
-      // - When nbit - 8, the pixel value is -127, -126, ...,
-      //   127 (== // SHORT_OVERFLOW), 128 (== LONG_OVERFLOW)
-
-      // Load values
-      for (int i = 0; i < 2; i++) {
-        const size_t nbit = nbits[i];
-        assert(nbit >= 0 && nbit <= 8);
-
-        int zero_at = 0;
-        if (nbit > 1) {
-          zero_at = (1 << (nbit - 1)) - 1;
-        }
+    return offset;
+  }
+
+  // One pixel is stored using `nbit` bits.
+  // Although `nbit` itself is stored using 4 bits,
+  // only values 1 (0001b) to 8 (1000b) are allowed.
+  // Negative values are encoded as follows. (Not 2's complement!)
+  // - When nbit = 1, the pixel value is 0 or 1
+  // - When nbit = 2, the pixel value is -1, 0, 1, 2
+  // - When nbit = 3, the pixel value is -3, -2, 1, 0, 1, 2, 3, 4
+  // - When nbit - 8, the pixel value is -127, -126, ...,
+  //   127 (== // SHORT_OVERFLOW), 128 (== LONG_OVERFLOW)
+  inline int ty6_zero_at(std::size_t nbit) {
+    return nbit > 1 ? (1 << (nbit - 1)) - 1 : 0;
+  }
+
+  // Since nbit is at most 8, 8 * 8 (= BLOCKSIZE) = 64 bits are sufficient.
+  inline unsigned long long ty6_load_bits(const char *bits, std::size_t nbit) {
+    unsigned long long v = 0;
+    for (std::size_t j = 0; j < nbit; j++) {
+      // Implicit promotion is only up to 32 bits, not 64 bits so we have to be
+      // explicit.
+      v |= (unsigned long long)((unsigned char)bits[j]) << (TY6_BLOCKSIZE * j);
+    }
+    return v;
+  }
 
-        // Since nbit is at most 8, 8 * 8 (= BLOCKSIZE) = 64 bits are sufficient.
-        unsigned long long v = 0;
-        for (int j = 0; j < nbit; j++) {
-          // Implicit promotion is only up to 32 bits, not 64 bits so we have to be
-          // explicit.
-          v |= (long long)((unsigned char)buf_data[ipos++]) << (BLOCKSIZE * j);
+  // Unpack one block of BLOCKSIZE values from `nbit` bits each
+  struct ty6_unpack_scalar {
+    DXTBX_FORCE_INLINE void operator()(const char *bits,
+                                       std::size_t nbit,
+                                       int *out) const {
+      const unsigned long long v = ty6_load_bits(bits, nbit);
+      const unsigned long long mask = (1ull << nbit) - 1;
+      const int zero_at = ty6_zero_at(nbit);
+      for (std::size_t j = 0; j < TY6_BLOCKSIZE; j++) {
+        out[j] = (int)((v >> (nbit * j)) & mask) - zero_at;
+      }
+    }
+  };
+
+#if defined(DXTBX_CBF_DECOMPRESS_X86)
+  // The first four values of a block always lie in the low 32 bits, and the
+  // last four in the 32 bits starting at 4 * nbit, so the whole block can be
+  // unpacked with one variable shift of 8 x 32-bit lanes.
+  struct ty6_unpack_avx2 {
+    DXTBX_TARGET_AVX2 inline void operator()(const char *bits,
+                                             std::size_t nbit,
+                                             int *out) const {
+      const unsigned long long v = ty6_load_bits(bits, nbit);
+      const int lo = (int)(unsigned int)v;
+      const int hi = (int)(unsigned int)(v >> (4 * nbit));
+      const int n = (int)nbit;
+      const __m256i words = _mm256_setr_epi32(lo, lo, lo, lo, hi, hi, hi, hi);
+      const __m256i shifts =
+        _mm256_setr_epi32(0, n, 2 * n, 3 * n, 0, n, 2 * n, 3 * n);
+      const __m256i mask = _mm256_set1_epi32((1 << nbit) - 1);
+      const __m256i zero_at = _mm256_set1_epi32(ty6_zero_at(nbit));
+      __m256i x = _mm256_and_si256(_mm256_srlv_epi32(words, shifts), mask);
+      _mm256_storeu_si256((__m256i *)out, _mm256_sub_epi32(x, zero_at));
+    }
+  };
+#endif
+
+#if defined(DXTBX_CBF_DECOMPRESS_NEON)
+  // As for AVX2, but as two 4 x 32-bit shifts (by negative amounts, to the right)
+  struct ty6_unpack_neon {
+    inline void operator()(const char *bits, std::size_t nbit, int *out) const {
+      const unsigned long long v = ty6_load_bits(bits, nbit);
+      const int n = (int)nbit;
+      const int32_t shift_values[4] = {0, -n, -2 * n, -3 * n};
+      const int32x4_t shifts = vld1q_s32(shift_values);
+      const uint32x4_t mask = vdupq_n_u32((1u << nbit) - 1);
+      const int32x4_t zero_at = vdupq_n_s32(ty6_zero_at(nbit));
+      uint32x4_t lo = vandq_u32(vshlq_u32(vdupq_n_u32((uint32_t)v), shifts), mask);
+      uint32x4_t hi = vandq_u32(
+        vshlq_u32(vdupq_n_u32((uint32_t)(v >> (4 * nbit))), shifts), mask);
+      vst1q_s32(out, vsubq_s32(vreinterpretq_s32_u32(lo), zero_at));
+      vst1q_s32(out + 4, vsubq_s32(vreinterpretq_s32_u32(hi), zero_at));
+    }
+  };
+  typedef ty6_unpack_neon ty6_unpack_native;
+#else
+  typedef ty6_unpack_scalar ty6_unpack_native;
+#endif
+
+  // Decode rows [first, last) of a TY6 image. Each row starts at the position
+  // given in the offset table, so rows can be decoded independently.
+  template <typename Unpack>
+  DXTBX_FORCE_INLINE void ty6_decode_rows(int *const ret,
+                                          const char *const buf_data,
+                                          const char *const buf_offsets,
+                                          const std::size_t fast,
+                                          const std::size_t first,
+                                          const std::size_t last) {
+    const Unpack unpack = Unpack();
+    const std::size_t nblock = (fast - 1) / (TY6_BLOCKSIZE * 2);
+    const std::size_t nrest = (fast - 1) % (TY6_BLOCKSIZE * 2);
+
+    for (std::size_t iy = first; iy < last; iy++) {
+      std::size_t ipos =
+        read_uint32_from_bytearray(buf_offsets + iy * sizeof(uint32_t));
+      std::size_t opos = fast * iy;
+
+      // Values from -127 to +126 (inclusive) are stored with an offset of 127
+      // as 0 to 253. 254 and 255 mark short and long overflows.
+      // Other values ("overflows") are represented in two's complement.
+      ret[opos] = ty6_read_offset(buf_data, ipos);
+      opos++;
+
+      // For every two blocks
+      for (std::size_t k = 0; k < nblock; k++) {
+        const unsigned char bittypes = (unsigned char)buf_data[ipos++];
+        const std::size_t nbits[2] = {(std::size_t)(bittypes & 15),
+                                      (std::size_t)((bittypes >> 4) & 15)};
+        DXTBX_ASSERT(nbits[0] <= 8 && nbits[1] <= 8);
+
+        // Load values
+        for (std::size_t i = 0; i < 2; i++) {
+          unpack(buf_data + ipos, nbits[i], ret + opos);
+          ipos += nbits[i];
+          opos += TY6_BLOCKSIZE;
         }
 
-        const unsigned long long mask = (1 << nbit) - 1;
-        for (int j = 0; j < BLOCKSIZE; j++) {
-          ret[opos++] = ((v >> (nbit * j)) & mask) - zero_at;
+        // Apply differences. Only 8-bit blocks can hold overflow markers, so
+        // the others are a plain running sum.
+        int *block = ret + opos - 2 * TY6_BLOCKSIZE;
+        if (nbits[0] < 8 && nbits[1] < 8) {
+          for (std::size_t i = 0; i < 2 * TY6_BLOCKSIZE; i++) {
+            block[i] += block[i - 1];
+          }
+          continue;
         }
-      }
 
-      // Apply differences. Load more values when overflown.
-      for (size_t i = opos - 2 * BLOCKSIZE; i < opos; i++) {
-        int offset = ret[i];
+        // Load more values when overflown.
+        for (std::size_t i = 0; i < 2 * TY6_BLOCKSIZE; i++) {
+          int offset = block[i];
 
-        if (offset == LONG_OVERFLOW) {
-          offset = (signed int)read_uint32_from_bytearray(buf_data + ipos);
-          ipos += 4;
-        } else if (offset == SHORT_OVERFLOW) {
-          offset = (signed short)read_uint16_from_bytearray(buf_data + ipos);
-          ipos += 2;
+          if (offset == TY6_LONG_OVERFLOW) {
+            offset = (signed int)read_uint32_from_bytearray(buf_data + ipos);
+            ipos += 4;
+          } else if (offset == TY6_SHORT_OVERFLOW) {
+            offset = (signed short)read_uint16_from_bytearray(buf_data + ipos);
+            ipos += 2;
+          }
+
+          block[i] = offset + block[i - 1];
         }
+      }
 
-        ret[i] = offset + ret[i - 1];
+      for (std::size_t i = 0; i < nrest; i++) {
+        ret[opos] = ret[opos - 1] + ty6_read_offset(buf_data, ipos);
+        opos++;
       }
     }
+  }
 
-    for (int i = 0; i < nrest; i++) {
-      int offset = (unsigned char)buf_data[ipos++] - 127;
-
-      if (offset == LONG_OVERFLOW) {
-        offset = (signed int)read_uint32_from_bytearray(buf_data + ipos);
-        ipos += 4;
-      } else if (offset == SHORT_OVERFLOW) {
-        offset = (signed short)read_uint16_from_bytearray(buf_data + ipos);
-        ipos += 2;
-      }
+  void ty6_decode_rows_native(int *const ret,
+                              const char *const buf_data,
+                              const char *const buf_offsets,
+                              const std::size_t fast,
+                              const std::size_t first,
+                              const std::size_t last) {
+    ty6_decode_rows<ty6_unpack_native>(ret, buf_data, buf_offsets, fast, first, last);
+  }
 
-      ret[opos] = ret[opos - 1] + offset;
-      opos++;
+#if defined(DXTBX_CBF_DECOMPRESS_X86)
+  DXTBX_TARGET_AVX2 void ty6_decode_rows_avx2(int *const ret,
+                                              const char *const buf_data,
+                                              const char *const buf_offsets,
+                                              const std::size_t fast,
+                                              const std::size_t first,
+                                              const std::size_t last) {
+    ty6_decode_rows<ty6_unpack_avx2>(ret, buf_data, buf_offsets, fast, first, last);
+  }
+#endif
+
+  typedef void (*ty6_decode_rows_function)(int *const,
+                                           const char *const,
+                                           const char *const,
+                                           const std::size_t,
+                                           const std::size_t,
+                                           const std::size_t);
+
+  ty6_decode_rows_function select_ty6_decode_rows() {
+#if defined(DXTBX_CBF_DECOMPRESS_X86)
+    if (cpu_has_avx2()) {
+      return ty6_decode_rows_avx2;
     }
+#endif
+    return ty6_decode_rows_native;
+  }
+
+  // Smallest number of rows worth handing to a separate thread
+  const std::size_t TY6_MIN_ROWS_PER_THREAD = 64;
+
+}  // namespace
+
+void dxtbx::boost_python::rod_TY6_decompress(int *const ret,
+                                             const char *const buf_data,
+                                             const char *const buf_offsets,
+                                             const int slow,
+                                             const int fast) {
+  rod_TY6_decompress(ret, buf_data, buf_offsets, slow, fast, 1);
+}
+
+void dxtbx::boost_python::rod_TY6_decompress(int *const ret,
+                                             const char *const buf_data,
+                                             const char *const buf_offsets,
+                                             const int slow,
+                                             const int fast,
+                                             std::size_t nthreads) {
+  // Pick the best implementation for this CPU on first use
+  static const ty6_decode_rows_function decode_rows = select_ty6_decode_rows();
+
+  if (slow <= 0 || fast <= 0) {
+    return;
   }
+  nthreads = std::min(dxtbx::resolve_thread_count(nthreads),
+                      std::max<std::size_t>(1, slow / TY6_MIN_ROWS_PER_THREAD));
+  dxtbx::parallel_for(slow, nthreads, [&](std::size_t first, std::size_t last) {
+    decode_rows(ret, buf_data, buf_offsets, fast, first, last);
+  });
 }
@@ -1,17 +1,45 @@
 #ifndef DXTBX_COMPRESSION
 #define DXTBX_COMPRESSION
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace dxtbx { namespace boost_python {
   unsigned int cbf_decompress(const char*, std::size_t, int*, const std::size_t);
+  // Decompress into a narrower type. Values that don't fit are clamped to the
+  // range of the type, and the number of them is returned in the last argument.
+  unsigned int cbf_decompress(const char*,
+                              std::size_t,
+                              uint16_t*,
+                              const std::size_t,
+                              std::size_t&);
+  unsigned int cbf_decompress(const char*,
+                              std::size_t,
+                              int16_t*,
+                              const std::size_t,
+                              std::size_t&);
+  // Reference byte-offset decoder, without any vectorisation
+  unsigned int cbf_decompress_scalar(const char*,
+                                     std::size_t,
+                                     int*,
+                                     const std::size_t);
   std::vector<char> cbf_compress(const int*, const std::size_t&);
+  // Compress in independent blocks over nthreads threads (0 for all cores)
+  std::vector<char> cbf_compress(const int*, const std::size_t&, std::size_t);
   // Decompress Rigaku Oxford diffractometer TY6 compression
   void rod_TY6_decompress(int* const,
                           const char* const,
                           const char* const,
                           const int,
                           const int);
+  // Decompress TY6, decoding independent rows over nthreads threads (0 for
+  // all cores)
+  void rod_TY6_decompress(int* const,
+                          const char* const,
+                          const char* const,
+                          const int,
+                          const int,
+                          std::size_t);
 }}  // namespace dxtbx::boost_python
 
 #endif
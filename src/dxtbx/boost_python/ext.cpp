@@ -7,11 +7,18 @@
 #include <boost_adaptbx/python_streambuf.h>
 #include <cstdint>
 #include <cctype>
+#include <cstring>
 #include <fstream>
+#include <algorithm>
 #include <vector>
 #include <limits>
+#include <utility>
 #include <dxtbx/error.h>
+#include <dxtbx/parallel.h>
 #include "compression.h"
+#include "gil.h"
+#include "parallel.h"
+#include "radial_average.h"
 
 namespace dxtbx { namespace boost_python {
 
@@ -24,148 +31,229 @@ namespace dxtbx { namespace boost_python {
     return (buff[0] == 0);
   }
 
-  scitbx::af::shared<int> read_uint8(boost_adaptbx::python::streambuf &input,
-                                     size_t count) {
-    scitbx::af::shared<int> result;
+  /**
+   * Read count elements of type T from a C++ wrapped Python stream. Anything
+   * not read (at end of file) is left as zero.
+   */
+  template <typename T>
+  void read_elements(boost_adaptbx::python::streambuf &input, T *data, size_t count) {
     boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<unsigned char> data;
-    data.resize(count);
-
-    is.read((char *)&data[0], count * sizeof(unsigned char));
+    char *buffer = (char *)data;
+    const size_t nbytes = count * sizeof(T);
+    is.read(buffer, nbytes);
+    size_t nread = std::min((size_t)is.gcount(), nbytes);
+    std::fill(buffer + nread, buffer + nbytes, 0);
+  }
 
-    for (size_t j = 0; j < count; j++) {
-      result.push_back((int)data[j]);
+  /**
+   * A writable memoryview onto native memory, which is released when the
+   * native read into it finishes. The memory is not owned by Python, so a
+   * file object which kept the view would otherwise be able to write to it
+   * after the read has returned, as BufferedReader guards against too.
+   */
+  class scoped_memory_view {
+  public:
+    scoped_memory_view(char *data, size_t size)
+        : view_(boost::python::handle<>(
+          PyMemoryView_FromMemory(data, size, PyBUF_WRITE))),
+          released_(false) {}
+
+    ~scoped_memory_view() {
+      if (!released_) {
+        // Unwinding from a Python error, which must be kept for the caller
+        PyObject *type, *value, *traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        PyObject *result = PyObject_CallMethod(view_.ptr(), "release", NULL);
+        Py_XDECREF(result);
+        PyErr_Restore(type, value, traceback);
+      }
     }
 
-    return result;
-  }
+    const boost::python::object &object() const {
+      return view_;
+    }
 
-  scitbx::af::shared<int> read_uint16(boost_adaptbx::python::streambuf &input,
-                                      size_t count) {
-    scitbx::af::shared<int> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<unsigned short> data;
-    data.resize(count);
+    /**
+     * Release the view, failing if the file object holds an export of it
+     */
+    void release() {
+      released_ = true;
+      PyObject *result = PyObject_CallMethod(view_.ptr(), "release", NULL);
+      if (result == NULL) {
+        PyErr_Clear();
+        throw DXTBX_ERROR("readinto still holds an export of the read buffer");
+      }
+      Py_DECREF(result);
+    }
 
-    is.read((char *)&data[0], count * sizeof(unsigned short));
+  private:
+    boost::python::object view_;
+    bool released_;
+  };
+
+  /**
+   * Read count elements of type T from a Python binary file object. Where the
+   * object supports readinto, the data is read straight into the destination
+   * with one call rather than through a chunked stream buffer. Anything not
+   * read (at end of file) is left as zero.
+   */
+  template <typename T>
+  void read_elements(const boost::python::object &file, T *data, size_t count) {
+    char *buffer = (char *)data;
+    const size_t nbytes = count * sizeof(T);
+    size_t nread = 0;
+    if (PyObject_HasAttrString(file.ptr(), "readinto")) {
+      while (nread < nbytes) {
+        scoped_memory_view view(buffer + nread, nbytes - nread);
+        boost::python::object result = file.attr("readinto")(view.object());
+        view.release();
+        size_t n = result.is_none() ? 0 : boost::python::extract<size_t>(result)();
+        if (n == 0) {
+          break;
+        }
+        nread += n;
+      }
+    } else {
+      std::string bytes =
+        boost::python::extract<std::string>(file.attr("read")(nbytes));
+      nread = std::min(bytes.size(), nbytes);
+      std::copy(bytes.data(), bytes.data() + nread, buffer);
+    }
+    std::fill(buffer + nread, buffer + nbytes, 0);
+  }
 
+  inline void swap_bytes(uint16_t *data, size_t count) {
     for (size_t j = 0; j < count; j++) {
-      result.push_back((int)data[j]);
+      uint16_t x = data[j];
+      data[j] = (uint16_t)(x >> 8 | x << 8);
     }
-
-    return result;
   }
 
-  scitbx::af::shared<int> read_uint32(boost_adaptbx::python::streambuf &input,
-                                      size_t count) {
-    scitbx::af::shared<int> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<unsigned int> data;
-    data.resize(count);
-
-    is.read((char *)&data[0], count * sizeof(unsigned int));
-
+  inline void swap_bytes(uint32_t *data, size_t count) {
     for (size_t j = 0; j < count; j++) {
-      DXTBX_ASSERT(data[j] <= std::numeric_limits<int>::max());
-      result.push_back((int)data[j]);
+      uint32_t x = data[j];
+      data[j] = (x << 24) | (x << 8 & 0xff0000) | (x >> 8 & 0xff00) | (x >> 24);
     }
-
-    return result;
   }
 
-  scitbx::af::shared<int> read_uint16_bs(boost_adaptbx::python::streambuf &input,
-                                         size_t count) {
-    scitbx::af::shared<int> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<unsigned short> data;
-    data.resize(count);
-
-    is.read((char *)&data[0], count * sizeof(unsigned short));
+  inline void swap_bytes(int16_t *data, size_t count) {
+    swap_bytes((uint16_t *)data, count);
+  }
 
-    /* swap bytes */
+  inline void swap_bytes(int32_t *data, size_t count) {
+    swap_bytes((uint32_t *)data, count);
+  }
 
-    for (size_t j = 0; j < count; j++) {
-      unsigned short x = data[j];
-      data[j] = x >> 8 | x << 8;
+  inline void swap_bytes(uint8_t *, size_t) {}
+
+  /**
+   * Read count raw elements of type T and widen them to int (or double for
+   * float) in a single pass over a preallocated array. Elements the same size
+   * as the output are read directly into it.
+   */
+  template <typename T, typename Output, typename Source>
+  scitbx::af::shared<Output> read_widened(Source &source, size_t count, bool swap) {
+    scitbx::af::shared<Output> result(count, scitbx::af::init_functor_null<Output>());
+    if (count == 0) {
+      return result;
     }
-
-    for (size_t j = 0; j < count; j++) {
-      result.push_back((int)data[j]);
+    if (sizeof(T) == sizeof(Output) && std::numeric_limits<T>::is_integer
+        && std::numeric_limits<Output>::is_integer) {
+      T *data = (T *)result.begin();
+      read_elements(source, data, count);
+      if (swap) {
+        swap_bytes(data, count);
+      }
+      if (!std::numeric_limits<T>::is_signed) {
+        for (size_t j = 0; j < count; j++) {
+          DXTBX_ASSERT(data[j] <= (T)std::numeric_limits<Output>::max());
+        }
+      }
+      return result;
     }
-
+    std::vector<T> data(count);
+    read_elements(source, &data[0], count);
+    if (swap) {
+      swap_bytes(&data[0], count);
+    }
+    std::copy(data.begin(), data.end(), result.begin());
     return result;
   }
 
-  scitbx::af::shared<int> read_uint32_bs(boost_adaptbx::python::streambuf &input,
-                                         size_t count) {
-    scitbx::af::shared<int> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<unsigned int> data;
-    data.resize(count);
-
-    is.read((char *)&data[0], count * sizeof(unsigned int));
-
-    /* swap bytes */
-
-    for (size_t j = 0; j < count; j++) {
-      unsigned int x = data[j];
-      data[j] = (x << 24) | (x << 8 & 0xff0000) | (x >> 8 & 0xff00) | (x >> 24);
-    }
-
-    for (size_t j = 0; j < count; j++) {
-      DXTBX_ASSERT(data[j] <= std::numeric_limits<int>::max());
-      result.push_back((int)data[j]);
+  /**
+   * Read count raw elements of type T, keeping the native element type
+   */
+  template <typename T>
+  scitbx::af::versa<T, scitbx::af::flex_grid<> > read_native(
+    const boost::python::object &file,
+    size_t count,
+    bool swap) {
+    scitbx::af::versa<T, scitbx::af::flex_grid<> > result(
+      scitbx::af::flex_grid<>(count), scitbx::af::init_functor_null<T>());
+    if (count > 0) {
+      read_elements(file, result.begin(), count);
+      if (swap) {
+        swap_bytes(result.begin(), count);
+      }
     }
-
     return result;
   }
 
-  scitbx::af::shared<int> read_int16(boost_adaptbx::python::streambuf &input,
-                                     size_t count) {
-    scitbx::af::shared<int> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<short> data;
-    data.resize(count);
-
-    is.read((char *)&data[0], count * sizeof(short));
-
-    for (size_t j = 0; j < count; j++) {
-      result.push_back((int)data[j]);
+  scitbx::af::versa<float, scitbx::af::flex_grid<> > read_native_float32(
+    const boost::python::object &file,
+    size_t count,
+    bool swap) {
+    scitbx::af::versa<float, scitbx::af::flex_grid<> > result(
+      scitbx::af::flex_grid<>(count), scitbx::af::init_functor_null<float>());
+    if (count > 0) {
+      std::vector<uint32_t> data(count);
+      read_elements(file, &data[0], count);
+      if (swap) {
+        swap_bytes(&data[0], count);
+      }
+      std::memcpy(result.begin(), &data[0], count * sizeof(float));
     }
-
     return result;
   }
 
-  scitbx::af::shared<int> read_int32(boost_adaptbx::python::streambuf &input,
-                                     size_t count) {
-    scitbx::af::shared<int> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<int> data;
-    data.resize(count);
+  template <typename Source>
+  scitbx::af::shared<int> read_uint8(Source &input, size_t count) {
+    return read_widened<uint8_t, int>(input, count, false);
+  }
 
-    is.read((char *)&data[0], count * sizeof(int));
+  template <typename Source>
+  scitbx::af::shared<int> read_uint16(Source &input, size_t count) {
+    return read_widened<uint16_t, int>(input, count, false);
+  }
 
-    for (size_t j = 0; j < count; j++) {
-      result.push_back((int)data[j]);
-    }
+  template <typename Source>
+  scitbx::af::shared<int> read_uint32(Source &input, size_t count) {
+    return read_widened<uint32_t, int>(input, count, false);
+  }
 
-    return result;
+  template <typename Source>
+  scitbx::af::shared<int> read_uint16_bs(Source &input, size_t count) {
+    return read_widened<uint16_t, int>(input, count, true);
   }
 
-  scitbx::af::shared<double> read_float32(boost_adaptbx::python::streambuf &input,
-                                          size_t count) {
-    scitbx::af::shared<double> result;
-    boost_adaptbx::python::streambuf::istream is(input);
-    std::vector<float> data;
-    data.resize(count);
+  template <typename Source>
+  scitbx::af::shared<int> read_uint32_bs(Source &input, size_t count) {
+    return read_widened<uint32_t, int>(input, count, true);
+  }
 
-    is.read((char *)&data[0], count * sizeof(float));
+  template <typename Source>
+  scitbx::af::shared<int> read_int16(Source &input, size_t count) {
+    return read_widened<int16_t, int>(input, count, false);
+  }
 
-    for (size_t j = 0; j < count; j++) {
-      result.push_back((double)data[j]);
-    }
+  template <typename Source>
+  scitbx::af::shared<int> read_int32(Source &input, size_t count) {
+    return read_widened<int32_t, int>(input, count, false);
+  }
 
-    return result;
+  template <typename Source>
+  scitbx::af::shared<double> read_float32(Source &input, size_t count) {
+    return read_widened<float, double>(input, count, false);
   }
 
   scitbx::af::flex_int uncompress(const boost::python::object &packed,
@@ -186,19 +274,207 @@ namespace dxtbx { namespace boost_python {
     return z;
   }
 
-  PyObject *compress(const scitbx::af::flex_int z) {
+  /**
+   * Get a pointer to the contents of a bytes object. The pointer is only valid
+   * while the object is alive.
+   */
+  std::pair<const char *, std::size_t> get_byte_buffer(
+    const boost::python::object &item) {
+    char *data = NULL;
+    Py_ssize_t size = 0;
+    if (!PyBytes_Check(item.ptr())
+        || PyBytes_AsStringAndSize(item.ptr(), &data, &size) != 0) {
+      PyErr_Clear();
+      throw DXTBX_ERROR("Expected a bytes object");
+    }
+    return std::make_pair(data, (std::size_t)size);
+  }
+
+  inline unsigned int cbf_decompress_into(const char *packed,
+                                          std::size_t packed_sz,
+                                          int *values,
+                                          std::size_t values_sz,
+                                          std::size_t &n_overflow) {
+    n_overflow = 0;
+    return cbf_decompress(packed, packed_sz, values, values_sz);
+  }
+
+  template <typename T>
+  inline unsigned int cbf_decompress_into(const char *packed,
+                                          std::size_t packed_sz,
+                                          T *values,
+                                          std::size_t values_sz,
+                                          std::size_t &n_overflow) {
+    return cbf_decompress(packed, packed_sz, values, values_sz, n_overflow);
+  }
+
+  /**
+   * Decompress a byte-offset frame of slow x fast pixels into an existing
+   * array, starting at a flat offset into it. This lets readers reuse one
+   * buffer, or fill one frame of a larger stack. Returns the number of
+   * values that had to be clamped to fit the output type, which for int
+   * output is always 0.
+   */
+  template <typename T>
+  std::size_t uncompress_into_buffer(
+    const boost::python::object &packed,
+    scitbx::af::versa<T, scitbx::af::flex_grid<> > out,
+    const int &slow,
+    const int &fast,
+    std::size_t offset) {
+    std::pair<const char *, std::size_t> buffer = get_byte_buffer(packed);
+    const std::size_t frame_size = (std::size_t)slow * fast;
+    DXTBX_ASSERT(offset + frame_size <= out.size());
+    T *begin = out.begin() + offset;
+    std::size_t n_overflow = 0;
+    unsigned int nn = 0;
+    {
+      scoped_gil_release release_gil;
+      nn = cbf_decompress_into(
+        buffer.first, buffer.second, begin, frame_size, n_overflow);
+    }
+    DXTBX_ASSERT(nn == frame_size);
+    return n_overflow;
+  }
+
+  /**
+   * Get a pointer to the contents of each bytes object in a Python sequence.
+   * The objects are kept in `owners` so that the pointers stay valid after the
+   * GIL is released.
+   */
+  std::vector<std::pair<const char *, std::size_t> > get_byte_buffers(
+    const boost::python::object &sequence,
+    std::vector<boost::python::object> &owners) {
+    std::size_t n = boost::python::len(sequence);
+    std::vector<std::pair<const char *, std::size_t> > buffers;
+    buffers.reserve(n);
+    owners.reserve(owners.size() + n);
+    for (std::size_t i = 0; i < n; ++i) {
+      boost::python::object item = sequence[i];
+      owners.push_back(item);
+      buffers.push_back(get_byte_buffer(item));
+    }
+    return buffers;
+  }
+
+  // Decompress many byte-offset frames of the same shape into one
+  // (n, slow, fast) array, across nthreads threads and without the GIL
+  scitbx::af::flex_int uncompress_batch(const boost::python::object &packed,
+                                        const int &slow,
+                                        const int &fast,
+                                        std::size_t nthreads) {
+    std::vector<boost::python::object> owners;
+    std::vector<std::pair<const char *, std::size_t> > buffers =
+      get_byte_buffers(packed, owners);
+    const std::size_t n = buffers.size();
+    const std::size_t frame_size = (std::size_t)slow * fast;
+
+    scitbx::af::flex_int z((scitbx::af::flex_grid<>(n, slow, fast)),
+                           scitbx::af::init_functor_null<int>());
+    int *begin = z.begin();
+
+    {
+      scoped_gil_release release_gil;
+      dxtbx::parallel_for(n, nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          unsigned int nn = dxtbx::boost_python::cbf_decompress(
+            buffers[i].first, buffers[i].second, begin + i * frame_size, frame_size);
+          DXTBX_ASSERT(nn == frame_size);
+        }
+      });
+    }
+
+    return z;
+  }
+
+  PyObject *compress(const scitbx::af::flex_int z, std::size_t nthreads) {
     const int *begin = z.begin();
     std::size_t sz = z.size();
 
-    std::vector<char> packed = dxtbx::boost_python::cbf_compress(begin, sz);
+    std::vector<char> packed = dxtbx::boost_python::cbf_compress(begin, sz, nthreads);
 
     return PyBytes_FromStringAndSize(&*packed.begin(), packed.size());
   }
 
-  double distance_between_points(scitbx::vec2<int> const &a,
-                                 scitbx::vec2<int> const &b) {
-    return std::sqrt(
-      (std::pow(double(b[0] - a[0]), 2) + std::pow(double(b[1] - a[1]), 2)));
+  RadialAverage make_radial_average(
+    const scitbx::af::versa<bool, scitbx::af::flex_grid<> > &mask,
+    scitbx::vec2<int> const &beam_center,
+    std::size_t n_bins,
+    double pixel_size,
+    double distance,
+    scitbx::vec2<int> const &upper_left,
+    scitbx::vec2<int> const &lower_right) {
+    DXTBX_ASSERT(mask.accessor().nd() == 2);
+    return RadialAverage(mask.begin(),
+                         mask.accessor().all()[0],
+                         mask.accessor().all()[1],
+                         beam_center,
+                         n_bins,
+                         pixel_size,
+                         distance,
+                         upper_left,
+                         lower_right);
+  }
+
+  RadialAverage *make_radial_average_ptr(
+    const scitbx::af::versa<bool, scitbx::af::flex_grid<> > &mask,
+    scitbx::vec2<int> const &beam_center,
+    std::size_t n_bins,
+    double pixel_size,
+    double distance,
+    scitbx::vec2<int> const &upper_left,
+    scitbx::vec2<int> const &lower_right) {
+    return new RadialAverage(make_radial_average(
+      mask, beam_center, n_bins, pixel_size, distance, upper_left, lower_right));
+  }
+
+  void check_radial_average_frame(
+    const RadialAverage &self,
+    const scitbx::af::versa<double, scitbx::af::flex_grid<> > &data) {
+    DXTBX_ASSERT(data.accessor().nd() == 2);
+    DXTBX_ASSERT(data.accessor().all()[0] == self.slow());
+    DXTBX_ASSERT(data.accessor().all()[1] == self.fast());
+  }
+
+  void RadialAverage_accumulate(
+    const RadialAverage &self,
+    const scitbx::af::versa<double, scitbx::af::flex_grid<> > &data,
+    scitbx::af::shared<double> sums,
+    scitbx::af::shared<double> sums_sq,
+    scitbx::af::shared<int> counts,
+    std::size_t nthreads) {
+    check_radial_average_frame(self, data);
+    DXTBX_ASSERT(sums.size() == self.n_bins());
+    DXTBX_ASSERT(sums_sq.size() == self.n_bins());
+    DXTBX_ASSERT(counts.size() == self.n_bins());
+    scoped_gil_release release_gil;
+    self.accumulate(
+      data.begin(), sums.begin(), sums_sq.begin(), counts.begin(), nthreads);
+  }
+
+  // Reduce a sequence of frames into (n, n_bins) sums, sums of squares and counts
+  boost::python::tuple RadialAverage_accumulate_batch(const RadialAverage &self,
+                                                      boost::python::object frames,
+                                                      std::size_t nthreads) {
+    typedef scitbx::af::versa<double, scitbx::af::flex_grid<> > frame_type;
+    std::vector<frame_type> owners;
+    std::vector<const double *> pointers;
+    for (std::size_t i = 0; i < boost::python::len(frames); ++i) {
+      owners.push_back(boost::python::extract<frame_type>(frames[i])());
+      check_radial_average_frame(self, owners.back());
+      pointers.push_back(owners.back().begin());
+    }
+
+    scitbx::af::flex_grid<> grid(pointers.size(), self.n_bins());
+    scitbx::af::flex_double sums(grid, 0);
+    scitbx::af::flex_double sums_sq(grid, 0);
+    scitbx::af::flex_int counts(grid, 0);
+    {
+      scoped_gil_release release_gil;
+      self.accumulate_batch(
+        pointers, sums.begin(), sums_sq.begin(), counts.begin(), nthreads);
+    }
+    return boost::python::make_tuple(sums, sums_sq, counts);
   }
 
   void radial_average(scitbx::af::versa<double, scitbx::af::flex_grid<> > &data,
@@ -211,34 +487,20 @@ namespace dxtbx { namespace boost_python {
                       double distance,
                       scitbx::vec2<int> const &upper_left,
                       scitbx::vec2<int> const &lower_right) {
-    std::size_t extent = sums.size();
-    double extent_in_mm = extent * pixel_size;
-    double extent_two_theta =
-      std::atan(extent_in_mm / distance) * 180 / scitbx::constants::pi;
-
-    for (std::size_t y = upper_left[1]; y < lower_right[1]; y++) {
-      for (std::size_t x = upper_left[0]; x < lower_right[0]; x++) {
-        double val = data(x, y);
-        if (val > 0 && mask(x, y)) {
-          scitbx::vec2<int> point((int)x, (int)y);
-          double d_in_mm = distance_between_points(point, beam_center) * pixel_size;
-          double twotheta = std::atan(d_in_mm / distance) * 180 / scitbx::constants::pi;
-          std::size_t bin =
-            (std::size_t)std::floor(twotheta * extent / extent_two_theta);
-          if (bin >= extent) continue;
-          sums[bin] += val;
-          sums_sq[bin] += val * val;
-          counts[bin]++;
-        }
-      }
-    }
+    RadialAverage integrator = make_radial_average(
+      mask, beam_center, sums.size(), pixel_size, distance, upper_left, lower_right);
+    DXTBX_ASSERT(data.accessor().all().all_eq(mask.accessor().all()));
+    DXTBX_ASSERT(sums_sq.size() == sums.size() && counts.size() == sums.size());
+    integrator.accumulate(
+      data.begin(), sums.begin(), sums_sq.begin(), counts.begin(), 1);
   }
 
   // Python entry point to decompress Rigaku Oxford Diffractometer TY6 compression
   scitbx::af::flex_int uncompress_rod_TY6(const boost::python::object &data,
                                           const boost::python::object &offsets,
                                           const int &slow,
-                                          const int &fast) {
+                                          const int &fast,
+                                          std::size_t nthreads) {
     // Cannot I extract const char* directly?
     std::string str_data = boost::python::extract<std::string>(data);
     std::string str_offsets = boost::python::extract<std::string>(offsets);
@@ -247,27 +509,148 @@ namespace dxtbx { namespace boost_python {
                            scitbx::af::init_functor_null<int>());
 
     dxtbx::boost_python::rod_TY6_decompress(
-      z.begin(), str_data.c_str(), str_offsets.c_str(), slow, fast);
+      z.begin(), str_data.c_str(), str_offsets.c_str(), slow, fast, nthreads);
+
+    return z;
+  }
+
+  // Decompress many TY6 frames of the same shape into one (n, slow, fast) array,
+  // across nthreads threads and without the GIL
+  scitbx::af::flex_int uncompress_rod_TY6_batch(const boost::python::object &data,
+                                                const boost::python::object &offsets,
+                                                const int &slow,
+                                                const int &fast,
+                                                std::size_t nthreads) {
+    std::vector<boost::python::object> owners;
+    std::vector<std::pair<const char *, std::size_t> > data_buffers =
+      get_byte_buffers(data, owners);
+    std::vector<std::pair<const char *, std::size_t> > offset_buffers =
+      get_byte_buffers(offsets, owners);
+    DXTBX_ASSERT(data_buffers.size() == offset_buffers.size());
+    const std::size_t n = data_buffers.size();
+    const std::size_t frame_size = (std::size_t)slow * fast;
+    for (std::size_t i = 0; i < n; ++i) {
+      DXTBX_ASSERT(offset_buffers[i].second >= (std::size_t)slow * sizeof(uint32_t));
+    }
+
+    scitbx::af::flex_int z((scitbx::af::flex_grid<>(n, slow, fast)),
+                           scitbx::af::init_functor_null<int>());
+    int *begin = z.begin();
+
+    {
+      scoped_gil_release release_gil;
+      dxtbx::parallel_for(n, nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          dxtbx::boost_python::rod_TY6_decompress(begin + i * frame_size,
+                                                  data_buffers[i].first,
+                                                  offset_buffers[i].first,
+                                                  slow,
+                                                  fast);
+        }
+      });
+    }
 
     return z;
   }
 
   void init_module() {
     using namespace boost::python;
-    def("read_uint8", read_uint8, (arg("file"), arg("count")));
-    def("read_uint16", read_uint16, (arg("file"), arg("count")));
-    def("read_uint32", read_uint32, (arg("file"), arg("count")));
-    def("read_uint16_bs", read_uint16_bs, (arg("file"), arg("count")));
-    def("read_uint32_bs", read_uint32_bs, (arg("file"), arg("count")));
-    def("read_int16", read_int16, (arg("file"), arg("count")));
-    def("read_int32", read_int32, (arg("file"), arg("count")));
-    def("read_float32", read_float32, (arg("file"), arg("count")));
+    typedef boost_adaptbx::python::streambuf streambuf;
+    typedef const boost::python::object file_object;
+
+    // The readers accept either a plain Python file object, which is read with
+    // a single readinto call, or a streambuf wrapper. Overloads are tried in
+    // reverse order, so the streambuf versions are registered last.
+    def("read_uint8", read_uint8<file_object>, (arg("file"), arg("count")));
+    def("read_uint16", read_uint16<file_object>, (arg("file"), arg("count")));
+    def("read_uint32", read_uint32<file_object>, (arg("file"), arg("count")));
+    def("read_uint16_bs", read_uint16_bs<file_object>, (arg("file"), arg("count")));
+    def("read_uint32_bs", read_uint32_bs<file_object>, (arg("file"), arg("count")));
+    def("read_int16", read_int16<file_object>, (arg("file"), arg("count")));
+    def("read_int32", read_int32<file_object>, (arg("file"), arg("count")));
+    def("read_float32", read_float32<file_object>, (arg("file"), arg("count")));
+    def("read_uint8", read_uint8<streambuf>, (arg("file"), arg("count")));
+    def("read_uint16", read_uint16<streambuf>, (arg("file"), arg("count")));
+    def("read_uint32", read_uint32<streambuf>, (arg("file"), arg("count")));
+    def("read_uint16_bs", read_uint16_bs<streambuf>, (arg("file"), arg("count")));
+    def("read_uint32_bs", read_uint32_bs<streambuf>, (arg("file"), arg("count")));
+    def("read_int16", read_int16<streambuf>, (arg("file"), arg("count")));
+    def("read_int32", read_int32<streambuf>, (arg("file"), arg("count")));
+    def("read_float32", read_float32<streambuf>, (arg("file"), arg("count")));
+
+    // Readers that keep the element type of the file
+    def("read_native_uint8",
+        read_native<uint8_t>,
+        (arg("file"), arg("count"), arg("byte_swap") = false));
+    def("read_native_uint16",
+        read_native<uint16_t>,
+        (arg("file"), arg("count"), arg("byte_swap") = false));
+    def("read_native_uint32",
+        read_native<uint32_t>,
+        (arg("file"), arg("count"), arg("byte_swap") = false));
+    def("read_native_int16",
+        read_native<int16_t>,
+        (arg("file"), arg("count"), arg("byte_swap") = false));
+    def("read_native_int32",
+        read_native<int32_t>,
+        (arg("file"), arg("count"), arg("byte_swap") = false));
+    def("read_native_float32",
+        read_native_float32,
+        (arg("file"), arg("count"), arg("byte_swap") = false));
     def("is_big_endian", is_big_endian);
     def("uncompress", &uncompress, (arg_("packed"), arg_("slow"), arg_("fast")));
-    def("compress", &compress);
+    def("uncompress_into",
+        &uncompress_into_buffer<int>,
+        (arg_("packed"),
+         arg_("out"),
+         arg_("slow"),
+         arg_("fast"),
+         arg_("offset") = 0));
+    def("uncompress_into",
+        &uncompress_into_buffer<uint16_t>,
+        (arg_("packed"),
+         arg_("out"),
+         arg_("slow"),
+         arg_("fast"),
+         arg_("offset") = 0));
+    def("uncompress_into",
+        &uncompress_into_buffer<int16_t>,
+        (arg_("packed"),
+         arg_("out"),
+         arg_("slow"),
+         arg_("fast"),
+         arg_("offset") = 0));
+    def("uncompress_batch",
+        &uncompress_batch,
+        (arg_("packed"), arg_("slow"), arg_("fast"), arg_("nthreads") = 0));
+    def("compress", &compress, (arg("array"), arg("nthreads") = 1));
+    class_<RadialAverage>("RadialAverage", no_init)
+      .def("__init__",
+           make_constructor(&make_radial_average_ptr,
+                            default_call_policies(),
+                            (arg("mask"),
+                             arg("beam_center"),
+                             arg("n_bins"),
+                             arg("pixel_size"),
+                             arg("distance"),
+                             arg("upper_left"),
+                             arg("lower_right"))))
+      .def("n_bins", &RadialAverage::n_bins)
+      .def("n_pixels", &RadialAverage::n_pixels)
+      .def("accumulate",
+           &RadialAverage_accumulate,
+           (arg("data"),
+            arg("sums"),
+            arg("sums_sq"),
+            arg("counts"),
+            arg("nthreads") = 1))
+      .def("accumulate_batch",
+           &RadialAverage_accumulate_batch,
+           (arg("frames"), arg("nthreads") = 0));
     def("radial_average",
         &radial_average,
         (arg("data"),
+         arg("mask"),
          arg("beam_center"),
          arg("sums"),
          arg("sums_sq"),
@@ -278,11 +661,23 @@ namespace dxtbx { namespace boost_python {
          arg("lower_right")));
     def("uncompress_rod_TY6",
         &uncompress_rod_TY6,
-        (arg_("data"), arg_("offsets"), arg_("slow"), arg_("fast")));
+        (arg_("data"),
+         arg_("offsets"),
+         arg_("slow"),
+         arg_("fast"),
+         arg_("nthreads") = 1));
+    def("uncompress_rod_TY6_batch",
+        &uncompress_rod_TY6_batch,
+        (arg_("data"),
+         arg_("offsets"),
+         arg_("slow"),
+         arg_("fast"),
+         arg_("nthreads") = 0));
   }
 
   BOOST_PYTHON_MODULE(dxtbx_ext) {
     init_module();
+    export_parallel();
   }
 
 }}  // namespace dxtbx::boost_python
@@ -10,6 +10,7 @@
 #include <utility>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 #include <complex>
 #include <memory>
 #include <assert.h>
@@ -25,6 +26,8 @@
 #include <scitbx/vec3.h>
 #include <scitbx/mat3.h>
 #include <cctbx/miller.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/format/image.h>
 
 using boost::optional;
 using std::cout;
@@ -57,6 +60,67 @@ bool is_array_c_contiguous(py::array array) {
   return array.attr("flags")["C_CONTIGUOUS"].cast<bool>();
 }
 
+// Gathers of at least this many bytes are split over all cores
+const std::size_t PARALLEL_GATHER_BYTES = std::size_t(1) << 22;
+
+/** Get a c-contiguous version of an array
+ *
+ * An array that is already c-contiguous is returned as it is, so that it
+ * can be shared without copying. Anything else - slices, strided views,
+ * fortran order - is gathered into a new array in one pass, a row of the
+ * last dimension at a time, with the GIL released and over several threads
+ * if the array is large.
+ *
+ * */
+py::array as_c_contiguous(py::array np_array) {
+  if (is_array_c_contiguous(np_array)) {
+    return np_array;
+  }
+  // Only plain numeric data can be copied byte for byte
+  auto kind = np_array.attr("dtype").attr("kind").cast<char>();
+  if (std::string("biufc").find(kind) == std::string::npos) {
+    throw ERR_NON_CONTIGUOUS;
+  }
+
+  // Zero dimensional and empty arrays are always c-contiguous, so there is
+  // at least one dimension and one element here
+  const std::size_t nd = np_array.ndim();
+  const std::vector<py::ssize_t> shape(np_array.shape(), np_array.shape() + nd);
+  const std::vector<py::ssize_t> strides(np_array.strides(), np_array.strides() + nd);
+  py::array result(np_array.dtype(), shape);
+
+  const std::size_t itemsize = np_array.itemsize();
+  const std::size_t ncols = shape[nd - 1];
+  const std::size_t nrows = result.size() / ncols;
+  const py::ssize_t col_stride = strides[nd - 1];
+  const char *src = reinterpret_cast<const char *>(np_array.data());
+  char *dst = reinterpret_cast<char *>(result.mutable_data());
+  const std::size_t nthreads = result.nbytes() >= PARALLEL_GATHER_BYTES ? 0 : 1;
+
+  py::gil_scoped_release release;
+  dxtbx::parallel_for(nrows, nthreads, [&](std::size_t first, std::size_t last) {
+    for (std::size_t row = first; row < last; ++row) {
+      // Find the start of the row from its index in the outer dimensions
+      const char *in = src;
+      std::size_t index = row;
+      for (std::size_t d = nd - 1; d-- > 0;) {
+        in += (py::ssize_t)(index % shape[d]) * strides[d];
+        index /= shape[d];
+      }
+      char *out = dst + row * ncols * itemsize;
+      if (col_stride == (py::ssize_t)itemsize) {
+        std::memcpy(out, in, ncols * itemsize);
+      } else {
+        for (std::size_t col = 0; col < ncols; ++col) {
+          std::memcpy(
+            out + col * itemsize, in + (py::ssize_t)col * col_stride, itemsize);
+        }
+      }
+    }
+  });
+  return result;
+}
+
 template <typename T>
 py::buffer_info get_buffer_specific(grid<T> flex) {
   // Build the strides for each dimension by iterating over the sub-dimensions
@@ -336,6 +400,101 @@ private:
   py::array _np_array;
 };
 
+py::object to_numpy(py::object flex_array);
+
+/** View an array_family array as numpy, through a flex object sharing its handle
+ * **/
+template <typename T, typename Accessor>
+py::object array_to_numpy(const af::versa<T, Accessor> &data) {
+  af::flex_grid<>::index_type dims;
+  for (std::size_t i = 0; i < data.accessor().size(); ++i) {
+    dims.push_back(data.accessor()[i]);
+  }
+  bpy::object flex_obj(grid<T>(data.handle(), af::flex_grid<>(dims)));
+  return to_numpy(py::reinterpret_borrow<py::object>(flex_obj.ptr()));
+}
+
+/** View an image as numpy
+ *
+ * A contiguous image becomes one (n_tiles, slow, fast) array, otherwise
+ * each tile becomes its own array, returned together as a tuple. Either
+ * way the arrays share memory with the tiles.
+ *
+ * */
+template <typename T>
+py::object image_to_numpy(const dxtbx::format::Image<T> &image) {
+  if (image.is_contiguous()) {
+    return array_to_numpy(image.as_block());
+  }
+  py::tuple result(image.n_tiles());
+  for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+    result[i] = array_to_numpy(image.tile(i).data());
+  }
+  return result;
+}
+
+/** View a memory mapped image as a read-only numpy array of its raw pixels
+ *
+ * The array holds on to the mapping, so it stays valid after the image
+ * itself has gone.
+ *
+ * */
+py::object mapped_image_to_numpy(const dxtbx::format::MappedImage &image) {
+  typedef dxtbx::format::MappedImage mapped;
+  const char *codes[] = {"u1", "i2", "u2", "i4", "u4", "f4", "f8"};
+  py::dtype dtype(std::string(image.is_big_endian() ? ">" : "<")
+                  + codes[image.type() - mapped::uint8]);
+  auto owner = new std::shared_ptr<dxtbx::format::MappedFile>(image.file());
+  py::capsule base(owner, [](void *ptr) {
+    delete reinterpret_cast<std::shared_ptr<dxtbx::format::MappedFile> *>(ptr);
+  });
+  std::vector<py::ssize_t> shape{(py::ssize_t)image.accessor()[0],
+                                 (py::ssize_t)image.accessor()[1]};
+  py::array result(dtype, shape, image.data(), base);
+  py::setattr(result.attr("flags"), "writeable", py::bool_(false));
+  return result;
+}
+
+/** Visit an ImageBuffer, viewing whichever type it holds without converting
+ * **/
+class ImageBufferToNumpyVisitor : public boost::static_visitor<py::object> {
+public:
+  py::object operator()(const dxtbx::format::ImageBuffer::empty_type &) const {
+    throw std::invalid_argument("ImageBuffer is empty");
+  }
+
+  py::object operator()(const dxtbx::format::MappedImage &image) const {
+    return mapped_image_to_numpy(image);
+  }
+
+  template <typename T>
+  py::object operator()(const dxtbx::format::Image<T> &image) const {
+    return image_to_numpy(image);
+  }
+};
+
+/** Try to view an Image or ImageBuffer object as numpy
+ * **/
+optional<py::object> image_object_to_numpy(py::object obj) {
+  if (bpy::extract<const dxtbx::format::ImageBuffer &>(obj.ptr()).check()) {
+    const dxtbx::format::ImageBuffer &buffer =
+      bpy::extract<const dxtbx::format::ImageBuffer &>(obj.ptr());
+    return buffer.apply_visitor(ImageBufferToNumpyVisitor());
+  }
+  if (bpy::extract<const dxtbx::format::Image<int> &>(obj.ptr()).check()) {
+    return image_to_numpy(bpy::extract<const dxtbx::format::Image<int> &>(obj.ptr())());
+  }
+  if (bpy::extract<const dxtbx::format::Image<double> &>(obj.ptr()).check()) {
+    return image_to_numpy(
+      bpy::extract<const dxtbx::format::Image<double> &>(obj.ptr())());
+  }
+  if (bpy::extract<const dxtbx::format::Image<bool> &>(obj.ptr()).check()) {
+    return image_to_numpy(
+      bpy::extract<const dxtbx::format::Image<bool> &>(obj.ptr())());
+  }
+  return boost::none;
+}
+
 /** Convert a flex object directly to numpy
  *
  * Without creating an intermediate object. This creates a Scuffer
@@ -354,6 +513,10 @@ py::object to_numpy(py::object flex_array) {
       return as_numpy_handle->base();
     }
   }
+  // Images are viewed tile by tile, or as one block if they are contiguous
+  if (auto as_image = image_object_to_numpy(flex_array)) {
+    return *as_image;
+  }
   py::object scuffer = py::cast(Scuffer(flex_array));
   auto numpy = py::module_::import("numpy");
   return numpy.attr("asarray")(scuffer);
@@ -402,12 +565,7 @@ py::object from_numpy(py::object array) {
     throw std::invalid_argument(
       "Cannot currently convert from non-numpy array format to flex");
   }
-  auto np_array = py::array(array);
-
-  // Check that this array is contiguous
-  if (!is_array_c_contiguous(np_array)) {
-    throw ERR_NON_CONTIGUOUS;
-  }
+  auto np_array = as_c_contiguous(py::array(array));
 
   // If this was directly converted from a flex array, give back the original
   // object; In any other case we want to wrap, because of slicing/metadata
@@ -513,10 +671,7 @@ py::object from_numpy(py::object array) {
 /// More structured arrays need to be explicitly requested
 template <template <class> class VecType>
 py::object vec_from_numpy(py::array np_array) {
-  // Check that this array is contiguous
-  if (!is_array_c_contiguous(np_array)) {
-    throw ERR_NON_CONTIGUOUS;
-  }
+  np_array = as_c_contiguous(np_array);
 
   static_assert(VecType<int>::fixed_size == 2 || VecType<int>::fixed_size == 3,
                 "Only vec2/vec3 supported");
@@ -593,10 +748,7 @@ py::object miller_index_from_numpy(py::array np_array) {
 }
 
 py::object mat3_from_numpy(py::array np_array) {
-  // Check that this array is contiguous
-  if (!is_array_c_contiguous(np_array)) {
-    throw ERR_NON_CONTIGUOUS;
-  }
+  np_array = as_c_contiguous(np_array);
 
   auto nd = np_array.ndim();
   // Check our last dimension(s) are either x9 or x3x3
@@ -630,10 +782,13 @@ PYBIND11_MODULE(dxtbx_flumpy, m) {
     .def_buffer(&Scuffer::get_buffer_info);
   m.def("to_numpy",
         &to_numpy,
-        "Convert a flex object into a numpy array with zero copying");
+        "Convert a flex object into a numpy array with zero copying. An Image "
+        "or ImageBuffer becomes a tuple of arrays, one for each tile, or a "
+        "single (n_tiles, slow, fast) array if its tiles are contiguous");
   m.def("from_numpy",
         &from_numpy,
-        "Convert a numpy object into the equivalent (flat) flex array");
+        "Convert a numpy object into the equivalent (flat) flex array. A "
+        "c-contiguous array is shared, anything else is copied");
   m.def("vec_from_numpy",
         &vecs_from_numpy,
         "Convert a numpy object to a flex.vec2 or .vec3, depending on input array");
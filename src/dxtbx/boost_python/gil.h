@@ -0,0 +1,71 @@
+#ifndef DXTBX_BOOST_PYTHON_GIL_H
+#define DXTBX_BOOST_PYTHON_GIL_H
+
+#include <Python.h>
+
+namespace dxtbx { namespace boost_python {
+
+  /**
+   * Release the Python global interpreter lock for the lifetime of this
+   * object. Nothing touching Python objects may run while it is released.
+   * If the calling thread does not hold the lock, or Python is not running,
+   * this does nothing.
+   */
+  class scoped_gil_release {
+  public:
+    /**
+     * @param release Whether to release the lock at all
+     */
+    explicit scoped_gil_release(bool release = true)
+        : state_(release && Py_IsInitialized() && PyGILState_Check()
+                   ? PyEval_SaveThread()
+                   : NULL) {}
+
+    ~scoped_gil_release() {
+      if (state_ != NULL) {
+        PyEval_RestoreThread(state_);
+      }
+    }
+
+  private:
+    scoped_gil_release(const scoped_gil_release &);
+    scoped_gil_release &operator=(const scoped_gil_release &);
+
+    PyThreadState *state_;
+  };
+
+  /**
+   * Acquire the Python global interpreter lock for the lifetime of this
+   * object, from a thread which may not have been created by Python. The
+   * lock may already be held by the calling thread. If Python is not
+   * running, this does nothing.
+   */
+  class scoped_gil_acquire {
+  public:
+    /**
+     * @param acquire Whether to acquire the lock at all
+     */
+    explicit scoped_gil_acquire(bool acquire = true)
+        : acquired_(acquire && Py_IsInitialized()) {
+      if (acquired_) {
+        state_ = PyGILState_Ensure();
+      }
+    }
+
+    ~scoped_gil_acquire() {
+      if (acquired_) {
+        PyGILState_Release(state_);
+      }
+    }
+
+  private:
+    scoped_gil_acquire(const scoped_gil_acquire &);
+    scoped_gil_acquire &operator=(const scoped_gil_acquire &);
+
+    bool acquired_;
+    PyGILState_STATE state_;
+  };
+
+}}  // namespace dxtbx::boost_python
+
+#endif  // DXTBX_BOOST_PYTHON_GIL_H
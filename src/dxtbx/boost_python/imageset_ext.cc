@@ -209,6 +209,7 @@ namespace dxtbx { namespace boost_python {
     }
 
     static boost::python::tuple getstate(ImageSetData obj) {
+      // A native reader is not kept, so the copy reads with the Python reader
       return boost::python::make_tuple(ImageSetDataPickleSuite::get_model_tuple(obj),
                                        ImageSetDataPickleSuite::get_lookup_tuple(obj),
                                        obj.get_template(),
@@ -430,22 +431,56 @@ namespace dxtbx { namespace boost_python {
     return boost::python::tuple(result);
   }
 
-  boost::python::tuple ImageSet_get_raw_data(ImageSet &self, std::size_t index) {
+  boost::python::tuple image_buffer_as_tuple(const ImageBuffer &buffer) {
     boost::python::tuple result;
-    ImageBuffer buffer = self.get_raw_data(index);
     if (buffer.is_int()) {
       result = image_as_tuple<int>(buffer.as_int());
     } else if (buffer.is_double()) {
       result = image_as_tuple<double>(buffer.as_double());
     } else if (buffer.is_float()) {
       result = image_as_tuple<float>(buffer.as_float());
+    } else if (buffer.is_uint16() || buffer.is_uint8()) {
+      // Narrow integer data is widened for Python, which expects int
+      result = image_as_tuple<int>(buffer.as_int());
+    } else if (buffer.is_mapped()) {
+      // Convert to the nearest type to that stored in the file
+      MappedImage mapped = buffer.as_mapped();
+      if (mapped.is_integer()) {
+        result = image_as_tuple<int>(buffer.as_int());
+      } else if (mapped.type() == MappedImage::float32) {
+        result = image_as_tuple<float>(buffer.as_float());
+      } else {
+        result = image_as_tuple<double>(buffer.as_double());
+      }
     } else {
       throw DXTBX_ERROR("Problem reading raw data");
     }
     return result;
   }
 
-  boost::python::tuple ImageSet_get_corrected_data(ImageSet &self, std::size_t index) {
+  boost::python::tuple ImageSet_get_raw_data(ImageSet &self, std::size_t index) {
+    return image_buffer_as_tuple(self.get_raw_data(index));
+  }
+
+  /**
+   * Whether to return corrected data in single precision. None means use
+   * the setting of the imageset.
+   */
+  bool use_single_precision(const ImageSet &self,
+                            boost::python::object single_precision) {
+    if (single_precision.is_none()) {
+      return self.get_single_precision();
+    }
+    return boost::python::extract<bool>(single_precision)();
+  }
+
+  boost::python::tuple ImageSet_get_corrected_data(
+    ImageSet &self,
+    std::size_t index,
+    boost::python::object single_precision) {
+    if (use_single_precision(self, single_precision)) {
+      return image_as_tuple<float>(self.get_corrected_data_as<float>(index));
+    }
     return image_as_tuple<double>(self.get_corrected_data(index));
   }
 
@@ -461,6 +496,128 @@ namespace dxtbx { namespace boost_python {
     return image_as_tuple<bool>(self.get_mask(index));
   }
 
+  template <typename T>
+  boost::python::tuple block_as_tuple(
+    const std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > > &block) {
+    boost::python::list result;
+    for (std::size_t i = 0; i < block.size(); ++i) {
+      scitbx::af::c_grid<3> grid = block[i].accessor();
+      result.append(scitbx::af::versa<T, scitbx::af::flex_grid<> >(
+        block[i].handle(), scitbx::af::flex_grid<>(grid[0], grid[1], grid[2])));
+    }
+    return boost::python::tuple(result);
+  }
+
+  boost::python::tuple ImageSet_get_raw_data_block(ImageSet &self,
+                                                   std::size_t first,
+                                                   std::size_t last,
+                                                   std::size_t nthreads) {
+    // Use the type of the first image, as for get_raw_data
+    DXTBX_ASSERT(first < last && last <= self.size());
+    ImageBuffer buffer = self.get_raw_data(first);
+    bool is_mapped = buffer.is_mapped();
+    if (buffer.is_int() || buffer.is_uint16() || buffer.is_uint8()
+        || (is_mapped && buffer.as_mapped().is_integer())) {
+      return block_as_tuple(self.get_raw_data_block<int>(first, last, nthreads));
+    } else if (buffer.is_float()
+               || (is_mapped && buffer.as_mapped().type() == MappedImage::float32)) {
+      return block_as_tuple(self.get_raw_data_block<float>(first, last, nthreads));
+    }
+    return block_as_tuple(self.get_raw_data_block<double>(first, last, nthreads));
+  }
+
+  boost::python::tuple ImageSet_get_corrected_data_block(
+    ImageSet &self,
+    std::size_t first,
+    std::size_t last,
+    std::size_t nthreads,
+    boost::python::object single_precision) {
+    if (use_single_precision(self, single_precision)) {
+      return block_as_tuple(
+        self.get_corrected_data_block<float>(first, last, nthreads));
+    }
+    return block_as_tuple(self.get_corrected_data_block<double>(first, last, nthreads));
+  }
+
+  template <typename T>
+  boost::python::tuple frame_as_tuple(ImageSet &self, std::size_t index) {
+    ImageBuffer data;
+    Image<bool> mask;
+    Image<T> corrected;
+    self.get_frame(index, data, mask, corrected);
+    return boost::python::make_tuple(image_buffer_as_tuple(data),
+                                     image_as_tuple<bool>(mask),
+                                     image_as_tuple<T>(corrected));
+  }
+
+  boost::python::tuple ImageSet_get_frame(ImageSet &self,
+                                          std::size_t index,
+                                          boost::python::object single_precision) {
+    if (use_single_precision(self, single_precision)) {
+      return frame_as_tuple<float>(self, index);
+    }
+    return frame_as_tuple<double>(self, index);
+  }
+
+  /**
+   * Get the hit and miss counts and sizes of the image caches
+   */
+  boost::python::dict ImageSet_cache_statistics(const ImageSet &self) {
+    boost::python::dict result;
+    result["hits"] = self.data_cache().hits();
+    result["misses"] = self.data_cache().misses();
+    result["size"] = self.data_cache().size();
+    result["nbytes"] = self.data_cache().nbytes();
+    result["double_hits"] = self.double_raw_data_cache().hits();
+    result["double_misses"] = self.double_raw_data_cache().misses();
+    result["double_size"] = self.double_raw_data_cache().size();
+    result["double_nbytes"] = self.double_raw_data_cache().nbytes();
+    return result;
+  }
+
+  /**
+   * Get the time and count of each read path stage, e.g. "read_time" and
+   * "read_count", with the bytes read and the image cache hits and misses
+   */
+  boost::python::dict ImageSet_read_statistics(const ImageSet &self) {
+    const ReadStatistics &stats = self.read_statistics();
+    boost::python::dict result;
+    result["enabled"] = stats.enabled();
+    for (std::size_t i = 0; i < ReadStatistics::NUM_STAGES; ++i) {
+      ReadStatistics::Stage stage = (ReadStatistics::Stage)i;
+      std::string name = ReadStatistics::stage_name(stage);
+      result[name + "_count"] = stats.count(stage);
+      result[name + "_time"] = stats.seconds(stage);
+    }
+    result["bytes_read"] = stats.bytes();
+    result["cache_hits"] = self.data_cache().hits();
+    result["cache_misses"] = self.data_cache().misses();
+    result["double_cache_hits"] = self.double_raw_data_cache().hits();
+    result["double_cache_misses"] = self.double_raw_data_cache().misses();
+    return result;
+  }
+
+  bool ImageSet_get_read_statistics_enabled(const ImageSet &self) {
+    return self.read_statistics().enabled();
+  }
+
+  void ImageSet_set_read_statistics_enabled(ImageSet &self, bool enabled) {
+    self.read_statistics().set_enabled(enabled);
+  }
+
+  /**
+   * Get the hit and miss counts and size of the shadow mask cache
+   */
+  boost::python::dict ImageSequence_dynamic_mask_cache_statistics(
+    const ImageSequence &self) {
+    boost::python::dict result;
+    result["hits"] = self.dynamic_mask_cache().hits();
+    result["misses"] = self.dynamic_mask_cache().misses();
+    result["size"] = self.dynamic_mask_cache().size();
+    result["nbytes"] = self.dynamic_mask_cache().nbytes();
+    return result;
+  }
+
   /**
    * Wrapper for the external lookup items
    */
@@ -584,6 +741,9 @@ namespace dxtbx { namespace boost_python {
                              arg("format") = boost::python::object())))
       .def("reader", &ImageSetData::reader)
       .def("masker", &ImageSetData::masker)
+      .def("set_native_reader", &ImageSetData::set_native_reader)
+      .def("native_reader", &ImageSetData::native_reader)
+      .def("has_native_reader", &ImageSetData::has_native_reader)
       .def("get_data", &ImageSetData::get_data)
       .def("has_single_file_reader", &ImageSetData::has_single_file_reader)
       .def("get_path", &ImageSetData::get_path)
@@ -624,10 +784,28 @@ namespace dxtbx { namespace boost_python {
       .def("__len__", &ImageSet::size)
       .def("has_dynamic_mask", &ImageSet::has_dynamic_mask)
       .def("get_raw_data", &ImageSet_get_raw_data)
-      .def("get_corrected_data", &ImageSet_get_corrected_data)
+      .def("get_corrected_data",
+           &ImageSet_get_corrected_data,
+           (arg("index"), arg("single_precision") = boost::python::object()))
+      .def("get_single_precision", &ImageSet::get_single_precision)
+      .def("set_single_precision",
+           &ImageSet::set_single_precision,
+           (arg("single_precision")))
       .def("get_gain", &ImageSet_get_gain)
       .def("get_pedestal", &ImageSet_get_pedestal)
       .def("get_mask", &ImageSet_get_mask)
+      .def("get_frame",
+           &ImageSet_get_frame,
+           (arg("index"), arg("single_precision") = boost::python::object()))
+      .def("get_raw_data_block",
+           &ImageSet_get_raw_data_block,
+           (arg("first"), arg("last"), arg("nthreads") = 0))
+      .def("get_corrected_data_block",
+           &ImageSet_get_corrected_data_block,
+           (arg("first"),
+            arg("last"),
+            arg("nthreads") = 0,
+            arg("single_precision") = boost::python::object()))
       .def("get_beam", &ImageSet::get_beam_for_image, (arg("index") = 0))
       .def("get_detector", &ImageSet::get_detector_for_image, (arg("index") = 0))
       .def("get_goniometer", &ImageSet::get_goniometer_for_image, (arg("index") = 0))
@@ -644,6 +822,17 @@ namespace dxtbx { namespace boost_python {
       .def("complete_set", &ImageSet::complete_set)
       .def("partial_set", &ImageSet::partial_set)
       .def("clear_cache", &ImageSet::clear_cache)
+      .def("get_cache_size", &ImageSet::get_cache_size)
+      .def("set_cache_size", &ImageSet::set_cache_size, (arg("nbytes")))
+      .def("cache_statistics", &ImageSet_cache_statistics)
+      .def("read_statistics", &ImageSet_read_statistics)
+      .def("is_thread_safe", &ImageSet::is_thread_safe)
+      .def("set_thread_safe", &ImageSet::set_thread_safe, (arg("thread_safe")))
+      .def("reset_read_statistics", &ImageSet::reset_read_statistics)
+      .def("get_read_statistics_enabled", &ImageSet_get_read_statistics_enabled)
+      .def("set_read_statistics_enabled",
+           &ImageSet_set_read_statistics_enabled,
+           (arg("enabled")))
       .def("__eq__", &ImageSet::operator==)
       .def("__ne__", &ImageSet::operator!=)
       .def("update_detector_px_mm_data", &ImageSet_update_detector_px_mm_data)
@@ -696,6 +885,21 @@ namespace dxtbx { namespace boost_python {
       .def("set_goniometer", &ImageSequence::set_goniometer)
       .def("set_scan", &ImageSequence::set_scan)
       .def("get_array_range", &ImageSequence::get_array_range)
+      .def("enable_prefetch",
+           &ImageSequence::enable_prefetch,
+           (arg("depth") = 4, arg("nthreads") = 1))
+      .def("disable_prefetch", &ImageSequence::disable_prefetch)
+      .def("get_prefetch_depth", &ImageSequence::get_prefetch_depth)
+      .def("enable_dynamic_mask_cache",
+           &ImageSequence::enable_dynamic_mask_cache,
+           (arg("tolerance"), arg("nbytes")))
+      .def("disable_dynamic_mask_cache", &ImageSequence::disable_dynamic_mask_cache)
+      .def("get_dynamic_mask_tolerance", &ImageSequence::get_dynamic_mask_tolerance)
+      .def("precompute_dynamic_masks",
+           &ImageSequence::precompute_dynamic_masks,
+           (arg("nthreads") = 0))
+      .def("dynamic_mask_cache_statistics",
+           &ImageSequence_dynamic_mask_cache_statistics)
       .def("complete_set", &ImageSequence::complete_sequence)
       .def("partial_set", &ImageSequence::partial_sequence)
       .def("update_detector_px_mm_data", &ImageSequence_update_detector_px_mm_data)
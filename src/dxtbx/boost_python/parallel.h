@@ -0,0 +1,22 @@
+#ifndef DXTBX_BOOST_PYTHON_PARALLEL_H
+#define DXTBX_BOOST_PYTHON_PARALLEL_H
+
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <dxtbx/parallel.h>
+
+namespace dxtbx { namespace boost_python {
+
+  /**
+   * Export the default thread count. It lives in the dxtbx_parallel library
+   * with the thread pool, so it is the same for every extension.
+   */
+  inline void export_parallel() {
+    using namespace boost::python;
+    def("_set_max_threads", &dxtbx::set_max_threads, (arg("nthreads")));
+    def("_get_max_threads", &dxtbx::get_max_threads);
+  }
+
+}}  // namespace dxtbx::boost_python
+
+#endif  // DXTBX_BOOST_PYTHON_PARALLEL_H
@@ -0,0 +1,215 @@
+#ifndef DXTBX_BOOST_PYTHON_RADIAL_AVERAGE_H
+#define DXTBX_BOOST_PYTHON_RADIAL_AVERAGE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <scitbx/constants.h>
+#include <scitbx/vec2.h>
+#include <dxtbx/error.h>
+#include <dxtbx/parallel.h>
+
+namespace dxtbx { namespace boost_python {
+
+  /**
+   * A radial average with the bin of every pixel precomputed, for reducing
+   * many frames that share a detector geometry and mask.
+   *
+   * The lookup table holds the index and bin of each pixel in the region
+   * that is unmasked and falls inside the binned range, so a frame is
+   * reduced with one pass over the table and no trigonometry. Bins are
+   * equally spaced in two theta out to n_bins pixels from the beam centre.
+   */
+  class RadialAverage {
+  public:
+    /**
+     * Build the lookup table
+     * @param mask The pixel mask, of size (slow, fast)
+     * @param slow The slow image dimension
+     * @param fast The fast image dimension
+     * @param beam_center The beam centre as (slow, fast) in pixels
+     * @param n_bins The number of bins
+     * @param pixel_size The pixel size in mm
+     * @param distance The detector distance in mm
+     * @param upper_left The first (slow, fast) pixel of the region
+     * @param lower_right One past the last (slow, fast) pixel of the region
+     */
+    RadialAverage(const bool *mask,
+                  std::size_t slow,
+                  std::size_t fast,
+                  scitbx::vec2<int> const &beam_center,
+                  std::size_t n_bins,
+                  double pixel_size,
+                  double distance,
+                  scitbx::vec2<int> const &upper_left,
+                  scitbx::vec2<int> const &lower_right)
+        : slow_(slow), fast_(fast), n_bins_(n_bins) {
+      DXTBX_ASSERT(upper_left[0] >= 0 && upper_left[1] >= 0);
+      DXTBX_ASSERT((std::size_t)lower_right[0] <= slow);
+      DXTBX_ASSERT((std::size_t)lower_right[1] <= fast);
+
+      double extent_in_mm = n_bins * pixel_size;
+      double extent_two_theta =
+        std::atan(extent_in_mm / distance) * 180 / scitbx::constants::pi;
+
+      // Walk the region in memory order, so frames are read sequentially
+      for (std::size_t x = upper_left[0]; x < (std::size_t)lower_right[0]; x++) {
+        for (std::size_t y = upper_left[1]; y < (std::size_t)lower_right[1]; y++) {
+          std::size_t index = x * fast + y;
+          if (!mask[index]) continue;
+          double dx = double(beam_center[0] - (int)x);
+          double dy = double(beam_center[1] - (int)y);
+          double d_in_mm = std::sqrt(dx * dx + dy * dy) * pixel_size;
+          double twotheta = std::atan(d_in_mm / distance) * 180 / scitbx::constants::pi;
+          std::size_t bin =
+            (std::size_t)std::floor(twotheta * n_bins / extent_two_theta);
+          if (bin >= n_bins) continue;
+          pixels_.push_back(index);
+          bins_.push_back((std::uint32_t)bin);
+        }
+      }
+    }
+
+    /**
+     * @returns The number of bins
+     */
+    std::size_t n_bins() const {
+      return n_bins_;
+    }
+
+    /**
+     * @returns The number of pixels in the lookup table
+     */
+    std::size_t n_pixels() const {
+      return pixels_.size();
+    }
+
+    /**
+     * @returns The image size the table was built for
+     */
+    std::size_t slow() const {
+      return slow_;
+    }
+
+    std::size_t fast() const {
+      return fast_;
+    }
+
+    /**
+     * Add the positive pixels of a frame to the bin sums, sums of squares
+     * and counts. With more than one thread each thread fills its own
+     * histograms, which are added to the output in a fixed order.
+     * @param data The frame, of size (slow, fast)
+     * @param sums The bin sums
+     * @param sums_sq The bin sums of squares
+     * @param counts The bin counts
+     * @param nthreads The number of threads, zero for the default
+     */
+    void accumulate(const double *data,
+                    double *sums,
+                    double *sums_sq,
+                    int *counts,
+                    std::size_t nthreads) const {
+      const std::size_t n = pixels_.size();
+      const std::size_t nchunks = std::min(
+        resolve_thread_count(nthreads), std::max<std::size_t>(n / MIN_PIXELS, 1));
+      if (nchunks <= 1) {
+        accumulate_range(data, 0, n, sums, sums_sq, counts);
+        return;
+      }
+
+      std::vector<double> part_sums(nchunks * n_bins_, 0);
+      std::vector<double> part_sums_sq(nchunks * n_bins_, 0);
+      std::vector<int> part_counts(nchunks * n_bins_, 0);
+      parallel_for(nchunks, nchunks, [&](std::size_t first, std::size_t last) {
+        for (std::size_t c = first; c < last; ++c) {
+          accumulate_range(data,
+                           c * n / nchunks,
+                           (c + 1) * n / nchunks,
+                           &part_sums[c * n_bins_],
+                           &part_sums_sq[c * n_bins_],
+                           &part_counts[c * n_bins_]);
+        }
+      });
+      for (std::size_t c = 0; c < nchunks; ++c) {
+        for (std::size_t b = 0; b < n_bins_; ++b) {
+          sums[b] += part_sums[c * n_bins_ + b];
+          sums_sq[b] += part_sums_sq[c * n_bins_ + b];
+          counts[b] += part_counts[c * n_bins_ + b];
+        }
+      }
+    }
+
+    /**
+     * Reduce a batch of frames, one row of n_bins outputs per frame. The
+     * frames are shared out between the threads.
+     * @param frames Pointers to the frames, each of size (slow, fast)
+     * @param sums The (n_frames, n_bins) bin sums
+     * @param sums_sq The (n_frames, n_bins) bin sums of squares
+     * @param counts The (n_frames, n_bins) bin counts
+     * @param nthreads The number of threads, zero for the default
+     */
+    void accumulate_batch(const std::vector<const double *> &frames,
+                          double *sums,
+                          double *sums_sq,
+                          int *counts,
+                          std::size_t nthreads) const {
+      const std::size_t nframes = frames.size();
+      const std::size_t nthreads_total = resolve_thread_count(nthreads);
+      if (nframes < nthreads_total) {
+        // Too few frames to go around, so split each frame instead
+        for (std::size_t i = 0; i < nframes; ++i) {
+          accumulate(frames[i],
+                     sums + i * n_bins_,
+                     sums_sq + i * n_bins_,
+                     counts + i * n_bins_,
+                     nthreads_total);
+        }
+        return;
+      }
+      parallel_for(nframes, nthreads_total, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          accumulate_range(frames[i],
+                           0,
+                           pixels_.size(),
+                           sums + i * n_bins_,
+                           sums_sq + i * n_bins_,
+                           counts + i * n_bins_);
+        }
+      });
+    }
+
+  private:
+    // Below this many pixels per thread, threads cost more than they save
+    static const std::size_t MIN_PIXELS = 1 << 16;
+
+    void accumulate_range(const double *data,
+                          std::size_t first,
+                          std::size_t last,
+                          double *sums,
+                          double *sums_sq,
+                          int *counts) const {
+      for (std::size_t i = first; i < last; ++i) {
+        double val = data[pixels_[i]];
+        if (val > 0) {
+          std::uint32_t bin = bins_[i];
+          sums[bin] += val;
+          sums_sq[bin] += val * val;
+          counts[bin]++;
+        }
+      }
+    }
+
+    std::size_t slow_;
+    std::size_t fast_;
+    std::size_t n_bins_;
+    std::vector<std::size_t> pixels_;
+    std::vector<std::uint32_t> bins_;
+  };
+
+}}  // namespace dxtbx::boost_python
+
+#endif  // DXTBX_BOOST_PYTHON_RADIAL_AVERAGE_H
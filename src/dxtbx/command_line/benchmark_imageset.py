@@ -0,0 +1,301 @@
+# LIBTBX_SET_DISPATCHER_NAME dev.dxtbx.benchmark_imageset
+
+"""
+Benchmark the full image load path of an ImageSet: reading and decoding the
+raw data, converting it to an image buffer, correcting it and computing the
+mask, for synthetic CBF, raw and HDF5 sweeps and for reference images.
+"""
+
+from __future__ import annotations
+
+import argparse
+import os
+import sys
+import tempfile
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+
+from scitbx.array_family import flex
+
+import dxtbx.util
+from dxtbx.ext import compress
+from dxtbx.format.image import CBFByteOffsetReader, HDF5ImageReader, RawImageReader
+from dxtbx.imageset import ImageSequence, ImageSetData, ImageSetFactory
+from dxtbx.model import BeamFactory, DetectorFactory, GoniometerFactory, ScanFactory
+
+SYNTHETIC_FORMATS = ("cbf", "raw", "hdf5")
+
+# The stages timed by the ImageSet read statistics
+STAGES = ("read", "decompress", "convert", "correct", "mask")
+
+# The header written before the frame in the synthetic raw files
+RAW_HEADER = b"DXTBX-BENCHMARK\x00"
+
+
+class _PathReader:
+    """
+    The Python reader of a synthetic sweep. The data are read by the native
+    reader, so this only describes the files.
+    """
+
+    def __init__(self, paths):
+        self._paths = paths
+
+    def copy(self, paths):
+        return _PathReader(paths)
+
+    def paths(self):
+        return self._paths
+
+    def identifiers(self):
+        return self.paths()
+
+    def __len__(self):
+        return len(self._paths)
+
+    def read(self, index):
+        raise RuntimeError("Synthetic sweeps are only read by the native reader")
+
+    @staticmethod
+    def is_single_file_reader():
+        return False
+
+    @staticmethod
+    def master_path():
+        return ""
+
+
+def _write_cbf(path, frame):
+    slow, fast = frame.shape
+    packed = compress(flex.int(frame.astype(np.int32).ravel().tolist()))
+    header = (
+        "###CBF: VERSION 1.5\r\n"
+        "--CIF-BINARY-FORMAT-SECTION--\r\n"
+        "Content-Type: application/octet-stream;\r\n"
+        '     conversions="x-CBF_BYTE_OFFSET"\r\n'
+        f"X-Binary-Size: {len(packed)}\r\n"
+        f"X-Binary-Number-of-Elements: {frame.size}\r\n"
+        f"X-Binary-Size-Fastest-Dimension: {fast}\r\n"
+        f"X-Binary-Size-Second-Dimension: {slow}\r\n"
+        "\r\n"
+    )
+    with open(path, "wb") as f:
+        f.write(header.encode() + b"\x0c\x1a\x04\xd5" + packed + b"\r\n--")
+
+
+def make_synthetic_sweep(directory, fmt, nframes=10, shape=(512, 512), seed=0):
+    """
+    Write a sweep of Poisson noise frames and make an ImageSequence to read
+    it with a native reader.
+
+    Args:
+        directory: The directory to write the files in
+        fmt: The file format, one of "cbf", "raw" or "hdf5"
+        nframes: The number of frames
+        shape: The (slow, fast) size of each frame
+        seed: The seed of the random frames
+
+    Returns:
+        The ImageSequence of the sweep
+    """
+    rng = np.random.default_rng(seed)
+    slow, fast = shape
+    frames = [rng.poisson(10.0, size=shape).astype(np.uint16) for i in range(nframes)]
+
+    if fmt == "cbf":
+        paths = [os.path.join(directory, f"image_{i:05d}.cbf") for i in range(nframes)]
+        for path, frame in zip(paths, frames):
+            _write_cbf(path, frame)
+        native_reader = CBFByteOffsetReader(paths)
+    elif fmt == "raw":
+        paths = [os.path.join(directory, f"image_{i:05d}.raw") for i in range(nframes)]
+        for path, frame in zip(paths, frames):
+            with open(path, "wb") as f:
+                f.write(RAW_HEADER + frame.astype("<u2").tobytes())
+        native_reader = RawImageReader(paths, len(RAW_HEADER), "uint16", False, shape)
+    elif fmt == "hdf5":
+        import h5py
+
+        filename = os.path.join(directory, "data.h5")
+        with h5py.File(filename, "w") as f:
+            f.create_dataset(
+                "entry/data", data=np.stack(frames), chunks=(1, slow, fast)
+            )
+        paths = [filename] * nframes
+        native_reader = HDF5ImageReader(filename, "entry/data")
+    else:
+        raise ValueError(f"Unknown synthetic format: {fmt}")
+
+    data = ImageSetData(_PathReader(paths), None)
+    data.set_native_reader(native_reader)
+    return ImageSequence(
+        data,
+        beam=BeamFactory.simple(1.0),
+        detector=DetectorFactory.simple(
+            "PAD",
+            100.0,
+            (fast * 0.075 / 2, slow * 0.075 / 2),
+            "+x",
+            "-y",
+            (0.075, 0.075),
+            (fast, slow),
+            (-1.0, 65535.0),
+        ),
+        goniometer=GoniometerFactory.known_axis((1.0, 0.0, 0.0)),
+        scan=ScanFactory.make_scan((1, nframes), 0.1, (0.0, 0.1), list(range(nframes))),
+    )
+
+
+def _peak_rss_megabytes():
+    """The peak resident set size of the process, or None if not known"""
+    try:
+        import resource
+    except ImportError:
+        return None
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # Linux reports kilobytes, macOS bytes
+    if sys.platform == "darwin":
+        return peak / 1e6
+    return peak / 1e3
+
+
+def _bytes_on_disk(imageset):
+    return sum(os.path.getsize(path) for path in set(imageset.paths()) if path)
+
+
+def benchmark_imageset(imageset, nthreads=1):
+    """
+    Load every frame of an imageset, as processing would, and time it.
+
+    The raw data, corrected data and mask of each frame are read in turn. With
+    more than one thread the frames are shared between a pool of threads; the
+    imageset is made thread safe so the native readers decode frames in
+    parallel.
+
+    Args:
+        imageset: The imageset to read
+        nthreads: The number of threads
+
+    Returns:
+        A dictionary of the frames read, the time taken, the frames and
+        megabytes read per second, the peak resident set size and the time
+        spent in each stage of the load path
+    """
+    indices = list(range(len(imageset)))
+    imageset.clear_cache()
+    imageset.reset_read_statistics()
+    imageset.set_thread_safe(nthreads > 1)
+
+    def load(index):
+        imageset.get_raw_data(index)
+        imageset.get_corrected_data(index)
+        imageset.get_mask(index)
+
+    start = time.perf_counter()
+    if nthreads > 1:
+        with ThreadPoolExecutor(max_workers=nthreads) as pool:
+            list(pool.map(load, indices))
+    else:
+        for index in indices:
+            load(index)
+    seconds = time.perf_counter() - start
+    imageset.set_thread_safe(False)
+
+    nbytes = _bytes_on_disk(imageset)
+    stats = imageset.read_statistics()
+    return {
+        "frames": len(indices),
+        "nthreads": nthreads,
+        "seconds": seconds,
+        "frames_per_second": len(indices) / seconds if seconds else 0.0,
+        "megabytes_per_second": nbytes / 1e6 / seconds if seconds else 0.0,
+        "peak_rss_megabytes": _peak_rss_megabytes(),
+        "stages": (
+            {stage: stats[stage + "_time"] for stage in STAGES}
+            if stats["enabled"]
+            else {}
+        ),
+    }
+
+
+def _print_result(name, result):
+    rss = result["peak_rss_megabytes"]
+    line = (
+        f"{name:<24} {result['nthreads']:>3} {result['frames']:>6} "
+        f"{result['frames_per_second']:>10.1f} "
+        f"{result['megabytes_per_second']:>8.1f} "
+        f"{rss if rss is not None else float('nan'):>9.1f}"
+    )
+    line += "".join(f" {result['stages'].get(s, 0.0):>8.3f}" for s in STAGES)
+    print(line)
+
+
+def run(args=None):
+    dxtbx.util.encode_output_as_utf8()
+    parser = argparse.ArgumentParser(
+        description="Benchmark the throughput of loading images through an ImageSet"
+    )
+    parser.add_argument(
+        "images", metavar="IMAGE", nargs="*", help="Reference images to read"
+    )
+    parser.add_argument(
+        "--formats",
+        nargs="*",
+        default=list(SYNTHETIC_FORMATS),
+        choices=SYNTHETIC_FORMATS,
+        help="The formats of the synthetic sweeps",
+    )
+    parser.add_argument(
+        "--frames", type=int, default=50, help="The frames in each synthetic sweep"
+    )
+    parser.add_argument(
+        "--size",
+        type=int,
+        nargs=2,
+        default=(2048, 2048),
+        metavar=("SLOW", "FAST"),
+        help="The size of the synthetic frames",
+    )
+    parser.add_argument(
+        "--nthreads",
+        type=int,
+        nargs="+",
+        default=[1, 2, 4],
+        help="The thread counts to run with",
+    )
+    parser.add_argument(
+        "--repeats", type=int, default=1, help="The runs of each benchmark"
+    )
+    options = parser.parse_args(args)
+
+    print(
+        f"{'sweep':<24} {'thr':>3} {'frames':>6} {'frames/s':>10} {'MB/s':>8} "
+        f"{'RSS (MB)':>9}" + "".join(f" {s:>8}" for s in STAGES)
+    )
+    with tempfile.TemporaryDirectory() as directory:
+        sweeps = []
+        for fmt in options.formats:
+            subdirectory = os.path.join(directory, fmt)
+            os.mkdir(subdirectory)
+            sweeps.append(
+                (
+                    f"synthetic-{fmt}",
+                    make_synthetic_sweep(
+                        subdirectory, fmt, options.frames, tuple(options.size)
+                    ),
+                )
+            )
+        if options.images:
+            for i, imageset in enumerate(ImageSetFactory.new(options.images)):
+                sweeps.append((f"reference-{i}", imageset))
+
+        for name, imageset in sweeps:
+            for nthreads in options.nthreads:
+                for repeat in range(options.repeats):
+                    _print_result(name, benchmark_imageset(imageset, nthreads))
+
+
+if __name__ == "__main__":
+    run()
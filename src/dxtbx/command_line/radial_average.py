@@ -19,7 +19,7 @@ from scitbx.matrix import col
 
 import dxtbx
 import dxtbx.util
-from dxtbx.ext import radial_average
+from dxtbx.ext import RadialAverage
 from dxtbx.model.experiment_list import ExperimentListFactory
 
 master_phil = iotbx.phil.parse(
@@ -174,6 +174,9 @@ def run(args=None, imageset=None):
         def load_func(x):
             return x
 
+    # Bin lookup tables, reused for every image with the same panel geometry
+    integrators = {}
+
     # Iterate over each file provided
     for item in iterable:
         iset = load_func(item)
@@ -235,11 +238,6 @@ def run(args=None, imageset=None):
                 if params.panel is not None and tile != params.panel:
                     continue
 
-                if params.mask is None:
-                    mask = flex.bool(flex.grid(data.focus()), True)
-                else:
-                    mask = params.mask[tile]
-
                 if hasattr(data, "as_double"):
                     data = data.as_double()
 
@@ -261,18 +259,29 @@ def run(args=None, imageset=None):
                 bc = int(round(bc[1])), int(round(bc[0]))
 
                 # compute the average
-                radial_average(
-                    data,
-                    mask,
+                key = (
+                    tile,
+                    data.focus(),
                     bc,
-                    sums,
-                    sums_sq,
-                    counts,
                     panel.get_pixel_size()[0],
                     panel.get_distance(),
-                    (x1, y1),
-                    (x2, y2),
+                    params.n_bins,
                 )
+                if key not in integrators:
+                    if params.mask is None:
+                        mask = flex.bool(flex.grid(data.focus()), True)
+                    else:
+                        mask = params.mask[tile]
+                    integrators[key] = RadialAverage(
+                        mask,
+                        bc,
+                        params.n_bins,
+                        panel.get_pixel_size()[0],
+                        panel.get_distance(),
+                        (x1, y1),
+                        (x2, y2),
+                    )
+                integrators[key].accumulate(data, sums, sums_sq, counts, nthreads=0)
 
             # average the results, avoiding division by zero
             results = sums.set_selected(counts <= 0, 0)
@@ -1,16 +1,95 @@
 from __future__ import annotations
 
+from typing import BinaryIO, Sequence
+
 from boost_adaptbx.boost.python import streambuf
 from scitbx.array_family import flex
 
-def compress(array: flex.int) -> bytes: ...
+class RadialAverage:
+    def __init__(
+        self,
+        mask: flex.bool,
+        beam_center: tuple[int, int],
+        n_bins: int,
+        pixel_size: float,
+        distance: float,
+        upper_left: tuple[int, int],
+        lower_right: tuple[int, int],
+    ) -> None: ...
+    def n_bins(self) -> int: ...
+    def n_pixels(self) -> int: ...
+    def accumulate(
+        self,
+        data: flex.double,
+        sums: flex.double,
+        sums_sq: flex.double,
+        counts: flex.int,
+        nthreads: int = 1,
+    ) -> None: ...
+    def accumulate_batch(
+        self, frames: Sequence[flex.double], nthreads: int = 0
+    ) -> tuple[flex.double, flex.double, flex.int]: ...
+
+def compress(array: flex.int, nthreads: int = 1) -> bytes: ...
 def is_big_endian() -> bool: ...
-def read_float32(file: streambuf, count: int) -> float: ...
-def read_int16(file: streambuf, count: int) -> int: ...
-def read_int32(file: streambuf, count: int) -> int: ...
-def read_uint16(file: streambuf, count: int) -> int: ...
-def read_uint16_bs(file: streambuf, count: int) -> int: ...
-def read_uint32(file: streambuf, count: int) -> int: ...
-def read_uint32_bs(file: streambuf, count: int) -> int: ...
-def read_uint8(file: streambuf, count: int) -> int: ...
+def radial_average(
+    data: flex.double,
+    mask: flex.bool,
+    beam_center: tuple[int, int],
+    sums: flex.double,
+    sums_sq: flex.double,
+    counts: flex.int,
+    pixel_size: float,
+    distance: float,
+    upper_left: tuple[int, int],
+    lower_right: tuple[int, int],
+) -> None: ...
+def read_float32(file: BinaryIO | streambuf, count: int) -> flex.double: ...
+def read_int16(file: BinaryIO | streambuf, count: int) -> flex.int: ...
+def read_int32(file: BinaryIO | streambuf, count: int) -> flex.int: ...
+def read_native_float32(
+    file: BinaryIO, count: int, byte_swap: bool = False
+) -> flex.float: ...
+def read_native_int16(
+    file: BinaryIO, count: int, byte_swap: bool = False
+) -> flex.int16: ...
+def read_native_int32(
+    file: BinaryIO, count: int, byte_swap: bool = False
+) -> flex.int: ...
+def read_native_uint8(
+    file: BinaryIO, count: int, byte_swap: bool = False
+) -> flex.uint8: ...
+def read_native_uint16(
+    file: BinaryIO, count: int, byte_swap: bool = False
+) -> flex.uint16: ...
+def read_native_uint32(
+    file: BinaryIO, count: int, byte_swap: bool = False
+) -> flex.uint32: ...
+def read_uint16(file: BinaryIO | streambuf, count: int) -> flex.int: ...
+def read_uint16_bs(file: BinaryIO | streambuf, count: int) -> flex.int: ...
+def read_uint32(file: BinaryIO | streambuf, count: int) -> flex.int: ...
+def read_uint32_bs(file: BinaryIO | streambuf, count: int) -> flex.int: ...
+def read_uint8(file: BinaryIO | streambuf, count: int) -> flex.int: ...
 def uncompress(packed: bytes, slow: int, fast: int) -> flex.int: ...
+def uncompress_into(
+    packed: bytes,
+    out: flex.int | flex.uint16 | flex.int16,
+    slow: int,
+    fast: int,
+    offset: int = 0,
+) -> int: ...
+def uncompress_batch(
+    packed: Sequence[bytes], slow: int, fast: int, nthreads: int = 0
+) -> flex.int: ...
+def uncompress_rod_TY6(
+    data: bytes, offsets: bytes, slow: int, fast: int, nthreads: int = 1
+) -> flex.int: ...
+def uncompress_rod_TY6_batch(
+    data: Sequence[bytes],
+    offsets: Sequence[bytes],
+    slow: int,
+    fast: int,
+    nthreads: int = 0,
+) -> flex.int: ...
+def _get_max_threads() -> int: ...
+def _set_max_threads(nthreads: int) -> None: ...
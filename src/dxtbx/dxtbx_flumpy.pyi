@@ -1,11 +1,13 @@
 from __future__ import annotations
 
-from typing import Union
+from typing import Tuple, Union
 
 import numpy as np
 
 from scitbx.array_family import flex
 
+from dxtbx.format.image import ImageBool, ImageBuffer, ImageDouble, ImageInt
+
 # Simple, flat array types
 FlexSimpleArray = Union[
     flex.bool,
@@ -25,6 +27,7 @@ FlexSimpleArray = Union[
 ]
 FlexVecArray = Union[flex.vec2_double, flex.vec3_double, flex.vec3_int]
 FlexArray = Union[FlexSimpleArray, FlexVecArray]
+ImageObject = Union[ImageBool, ImageBuffer, ImageDouble, ImageInt]
 
 class Scuffer:
     def __init__(self, arg0: FlexArray) -> None: ...
@@ -33,5 +36,5 @@ class Scuffer:
 
 def from_numpy(array: np.ndarray) -> FlexSimpleArray: ...
 def mat3_from_numpy(array: np.ndarray) -> flex.mat3_double: ...
-def to_numpy(array: FlexArray) -> np.ndarray: ...
+def to_numpy(array: FlexArray | ImageObject) -> np.ndarray | Tuple[np.ndarray, ...]: ...
 def vec_from_numpy(array: np.ndarray) -> FlexVecArray: ...
@@ -4,10 +4,14 @@ from typing import Any
 
 import pycbf
 
+from scitbx.array_family import flex
+
 class ImageBool:
     def __init__(self, *args, **kwargs) -> None: ...
     def append(self, *args, **kwargs) -> Any: ...
+    def as_block(self) -> Any: ...
     def empty(dxtbx) -> Any: ...
+    def is_contiguous(self) -> bool: ...
     def n_tiles(dxtbx) -> Any: ...
     def tile(dxtbx, unsignedlong) -> Any: ...
     def tile_names(dxtbx) -> Any: ...
@@ -23,16 +27,23 @@ class ImageBuffer:
     def as_double(dxtbx) -> Any: ...
     def as_float(dxtbx) -> Any: ...
     def as_int(dxtbx) -> Any: ...
+    def copy_to(self, out: Any) -> None: ...
     def is_double(dxtbx) -> Any: ...
     def is_empty(dxtbx) -> Any: ...
     def is_float(dxtbx) -> Any: ...
     def is_int(dxtbx) -> Any: ...
+    def is_mapped(dxtbx) -> Any: ...
+    def is_uint16(self) -> bool: ...
+    def is_uint8(self) -> bool: ...
+    def as_mapped(dxtbx) -> MappedImage: ...
     def __reduce__(self) -> Any: ...
 
 class ImageDouble:
     def __init__(self, *args, **kwargs) -> None: ...
     def append(self, *args, **kwargs) -> Any: ...
+    def as_block(self) -> Any: ...
     def empty(dxtbx) -> Any: ...
+    def is_contiguous(self) -> bool: ...
     def n_tiles(dxtbx) -> Any: ...
     def tile(dxtbx, unsignedlong) -> Any: ...
     def tile_names(dxtbx) -> Any: ...
@@ -46,7 +57,9 @@ class ImageDouble:
 class ImageInt:
     def __init__(self, *args, **kwargs) -> None: ...
     def append(self, *args, **kwargs) -> Any: ...
+    def as_block(self) -> Any: ...
     def empty(dxtbx) -> Any: ...
+    def is_contiguous(self) -> bool: ...
     def n_tiles(dxtbx) -> Any: ...
     def tile(dxtbx, unsignedlong) -> Any: ...
     def tile_names(dxtbx) -> Any: ...
@@ -81,6 +94,74 @@ class ImageTileInt:
     def __getinitargs__(dxtbx) -> Any: ...
     def __reduce__(self) -> Any: ...
 
+class MappedFile:
+    def __init__(self, path: str) -> None: ...
+    def path(self) -> str: ...
+    def __len__(self) -> int: ...
+
+class MappedImage:
+    def __init__(
+        self,
+        path: str,
+        offset: int,
+        dtype: str,
+        big_endian: bool,
+        shape: tuple[int, int],
+    ) -> None: ...
+    def path(self) -> str: ...
+    def offset(self) -> int: ...
+    def dtype(self) -> str: ...
+    def is_big_endian(self) -> bool: ...
+    def is_integer(self) -> bool: ...
+    def shape(self) -> tuple[int, int]: ...
+    def nbytes(self) -> int: ...
+    def at_offset(self, offset: int) -> MappedImage: ...
+    def as_int(self) -> flex.int: ...
+    def as_float(self) -> flex.float: ...
+    def as_double(self) -> flex.double: ...
+    def __len__(self) -> int: ...
+    def __getinitargs__(self) -> tuple[str, int, str, bool, tuple[int, int]]: ...
+
+class ImageReader:
+    def read(self, index: int) -> ImageBuffer: ...
+    def __len__(self) -> int: ...
+
+class RawImageReader(ImageReader):
+    def __init__(
+        self,
+        paths: list[str],
+        offset: int,
+        dtype: str,
+        big_endian: bool,
+        shape: tuple[int, int],
+        images_per_file: int = 1,
+    ) -> None: ...
+    def paths(self) -> list[str]: ...
+    def offset(self) -> int: ...
+    def dtype(self) -> str: ...
+    def is_big_endian(self) -> bool: ...
+    def shape(self) -> tuple[int, int]: ...
+    def images_per_file(self) -> int: ...
+    def __getinitargs__(
+        self,
+    ) -> tuple[list[str], int, str, bool, tuple[int, int], int]: ...
+
+class CBFByteOffsetReader(ImageReader):
+    def __init__(self, paths: list[str]) -> None: ...
+    def paths(self) -> list[str]: ...
+    def __getinitargs__(self) -> tuple[list[str]]: ...
+
+class HDF5ImageReader(ImageReader):
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def filename(self) -> str: ...
+    def dataset(self) -> str: ...
+
 def cbf_read_buffer(
     handle: pycbf.cbf_handle_struct, buffer: bytes, flags: int
 ) -> None: ...
+def cbf_read_mapped_file(
+    handle: pycbf.cbf_handle_struct, path: str, flags: int
+) -> MappedFile: ...
+def read_cbf_images(
+    paths: list[str], nthreads: int = ...
+) -> list[tuple[str, flex.int]]: ...
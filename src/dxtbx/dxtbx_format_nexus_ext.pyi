@@ -1,9 +1,124 @@
 from __future__ import annotations
 
-from typing import Any, Tuple
+from typing import Any, Sequence, Tuple
 
 from scitbx.array_family import flex
 
+class FrameStreamDouble:
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def __len__(self) -> int: ...
+    def next(self, max_frames: int = ...) -> flex.double: ...
+    def position(self) -> int: ...
+    def read(self, index: int) -> flex.double: ...
+    def refresh(self) -> int: ...
+    def seek(self, position: int) -> None: ...
+    def wait(self, timeout: float, interval: float = ...) -> int: ...
+
+class FrameStreamFloat:
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def __len__(self) -> int: ...
+    def next(self, max_frames: int = ...) -> flex.float: ...
+    def position(self) -> int: ...
+    def read(self, index: int) -> flex.float: ...
+    def refresh(self) -> int: ...
+    def seek(self, position: int) -> None: ...
+    def wait(self, timeout: float, interval: float = ...) -> int: ...
+
+class FrameStreamInt:
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def __len__(self) -> int: ...
+    def next(self, max_frames: int = ...) -> flex.int: ...
+    def position(self) -> int: ...
+    def read(self, index: int) -> flex.int: ...
+    def refresh(self) -> int: ...
+    def seek(self, position: int) -> None: ...
+    def wait(self, timeout: float, interval: float = ...) -> int: ...
+
+class FrameStreamUInt16:
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def __len__(self) -> int: ...
+    def next(self, max_frames: int = ...) -> flex.uint16: ...
+    def position(self) -> int: ...
+    def read(self, index: int) -> flex.uint16: ...
+    def refresh(self) -> int: ...
+    def seek(self, position: int) -> None: ...
+    def wait(self, timeout: float, interval: float = ...) -> int: ...
+
+class FrameStreamUInt32:
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def __len__(self) -> int: ...
+    def next(self, max_frames: int = ...) -> flex.uint32: ...
+    def position(self) -> int: ...
+    def read(self, index: int) -> flex.uint32: ...
+    def refresh(self) -> int: ...
+    def seek(self, position: int) -> None: ...
+    def wait(self, timeout: float, interval: float = ...) -> int: ...
+
+class FrameStreamUInt8:
+    def __init__(self, filename: str, dataset: str) -> None: ...
+    def __len__(self) -> int: ...
+    def next(self, max_frames: int = ...) -> flex.uint8: ...
+    def position(self) -> int: ...
+    def read(self, index: int) -> flex.uint8: ...
+    def refresh(self) -> int: ...
+    def seek(self, position: int) -> None: ...
+    def wait(self, timeout: float, interval: float = ...) -> int: ...
+
 def dataset_as_flex_double(dataset_id: Any, selection: Tuple[slice]) -> flex.double: ...
 def dataset_as_flex_float(dataset_id: Any, selection: Tuple[slice]) -> flex.float: ...
 def dataset_as_flex_int(dataset_id: Any, selection: Tuple[slice]) -> flex.int: ...
+def dataset_as_flex_uint16(dataset_id: Any, selection: Tuple[slice]) -> flex.uint16: ...
+def dataset_as_flex_uint32(dataset_id: Any, selection: Tuple[slice]) -> flex.uint32: ...
+def dataset_as_flex_uint8(dataset_id: Any, selection: Tuple[slice]) -> flex.uint8: ...
+def dataset_frames_as_flex_double(
+    dataset_id: Any, frames: Sequence[int]
+) -> flex.double: ...
+def dataset_frames_as_flex_float(
+    dataset_id: Any, frames: Sequence[int]
+) -> flex.float: ...
+def dataset_frames_as_flex_int(dataset_id: Any, frames: Sequence[int]) -> flex.int: ...
+def dataset_frames_as_flex_uint16(
+    dataset_id: Any, frames: Sequence[int]
+) -> flex.uint16: ...
+def dataset_frames_as_flex_uint32(
+    dataset_id: Any, frames: Sequence[int]
+) -> flex.uint32: ...
+def dataset_frames_as_flex_uint8(
+    dataset_id: Any, frames: Sequence[int]
+) -> flex.uint8: ...
+def dataset_frames_into_flex_double(
+    dataset_id: Any, frames: Sequence[int], data: flex.double
+) -> None: ...
+def dataset_frames_into_flex_float(
+    dataset_id: Any, frames: Sequence[int], data: flex.float
+) -> None: ...
+def dataset_frames_into_flex_int(
+    dataset_id: Any, frames: Sequence[int], data: flex.int
+) -> None: ...
+def dataset_frames_into_flex_uint16(
+    dataset_id: Any, frames: Sequence[int], data: flex.uint16
+) -> None: ...
+def dataset_frames_into_flex_uint32(
+    dataset_id: Any, frames: Sequence[int], data: flex.uint32
+) -> None: ...
+def dataset_frames_into_flex_uint8(
+    dataset_id: Any, frames: Sequence[int], data: flex.uint8
+) -> None: ...
+def dataset_into_flex_double(
+    dataset_id: Any, selection: Tuple[slice], data: flex.double
+) -> None: ...
+def dataset_into_flex_float(
+    dataset_id: Any, selection: Tuple[slice], data: flex.float
+) -> None: ...
+def dataset_into_flex_int(
+    dataset_id: Any, selection: Tuple[slice], data: flex.int
+) -> None: ...
+def dataset_into_flex_uint16(
+    dataset_id: Any, selection: Tuple[slice], data: flex.uint16
+) -> None: ...
+def dataset_into_flex_uint32(
+    dataset_id: Any, selection: Tuple[slice], data: flex.uint32
+) -> None: ...
+def dataset_into_flex_uint8(
+    dataset_id: Any, selection: Tuple[slice], data: flex.uint8
+) -> None: ...
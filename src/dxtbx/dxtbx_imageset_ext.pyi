@@ -4,6 +4,8 @@ from typing import Any, Tuple, Union
 
 from scitbx.array_family import flex
 
+from dxtbx.format.image import ImageReader
+
 ImageData = Union[flex.int, flex.double, flex.float]
 
 class ExternalLookup:
@@ -44,12 +46,20 @@ class ImageGrid(ImageSet):
 class ImageSequence(ImageSet):
     def __init__(self, *args, **kwargs) -> None: ...
     def complete_set(self) -> Any: ...
+    def disable_dynamic_mask_cache(self) -> None: ...
+    def disable_prefetch(self) -> None: ...
+    def dynamic_mask_cache_statistics(self) -> dict[str, int]: ...
+    def enable_dynamic_mask_cache(self, tolerance: float, nbytes: int) -> None: ...
+    def enable_prefetch(self, depth: int = ..., nthreads: int = ...) -> None: ...
     def get_array_range(self) -> Any: ...
     def get_beam(self) -> Any: ...
     def get_detector(self) -> Any: ...
+    def get_dynamic_mask_tolerance(self) -> float: ...
     def get_goniometer(self) -> Any: ...
+    def get_prefetch_depth(self) -> int: ...
     def get_scan(self) -> Any: ...
     def partial_set(self, *args, **kwargs) -> Any: ...
+    def precompute_dynamic_masks(self, nthreads: int = ...) -> None: ...
     def set_beam(self, boost) -> Any: ...
     def set_detector(self, boost) -> Any: ...
     def set_goniometer(self, boost) -> Any: ...
@@ -61,12 +71,26 @@ class ImageSequence(ImageSet):
 class ImageSet:
     def __init__(boost, dxtbx) -> None: ...
     def as_imageset(self) -> Any: ...
+    def cache_statistics(self) -> dict[str, int]: ...
     def clear_cache(self) -> Any: ...
     def complete_set(self) -> Any: ...
     def data(self) -> Any: ...
     def get_beam(self) -> Any: ...
-    def get_corrected_data(self, int) -> Any: ...
+    def get_cache_size(self) -> int: ...
+    def get_corrected_data(
+        self, index: int, single_precision: bool | None = ...
+    ) -> tuple[flex.double, ...] | tuple[flex.float, ...]: ...
+    def get_corrected_data_block(
+        self,
+        first: int,
+        last: int,
+        nthreads: int = ...,
+        single_precision: bool | None = ...,
+    ) -> tuple[flex.double, ...] | tuple[flex.float, ...]: ...
     def get_detector(self) -> Any: ...
+    def get_frame(
+        self, index: int, single_precision: bool | None = ...
+    ) -> tuple[tuple, tuple, tuple]: ...
     def get_gain(self, int) -> Any: ...
     def get_goniometer(self) -> Any: ...
     def get_image_identifier(self, int) -> Any: ...
@@ -74,16 +98,28 @@ class ImageSet:
     def get_path(self, int) -> Any: ...
     def get_pedestal(self, int) -> Any: ...
     def get_raw_data(self, index: int) -> Tuple[ImageData]: ...
+    def get_raw_data_block(
+        self, first: int, last: int, nthreads: int = ...
+    ) -> Tuple[ImageData]: ...
+    def get_read_statistics_enabled(self) -> bool: ...
     def get_scan(self) -> Any: ...
+    def get_single_precision(self) -> bool: ...
     def has_dynamic_mask(self) -> Any: ...
     def indices(self) -> Any: ...
     def is_marked_for_rejection(self, int) -> Any: ...
+    def is_thread_safe(self) -> bool: ...
     def mark_for_rejection(self, int, bool) -> Any: ...
     def partial_set(self, *args, **kwargs) -> Any: ...
+    def read_statistics(self) -> dict[str, int | float | bool]: ...
+    def reset_read_statistics(self) -> None: ...
     def set_beam(self, boost) -> Any: ...
+    def set_cache_size(self, nbytes: int) -> None: ...
     def set_detector(self, boost) -> Any: ...
     def set_goniometer(self, boost) -> Any: ...
+    def set_read_statistics_enabled(self, enabled: bool) -> None: ...
     def set_scan(self, boost) -> Any: ...
+    def set_single_precision(self, single_precision: bool) -> None: ...
+    def set_thread_safe(self, thread_safe: bool) -> None: ...
     def size(self) -> Any: ...
     def update_detector_px_mm_data(self) -> Any: ...
     def __eq__(self, other) -> Any: ...
@@ -108,11 +144,14 @@ class ImageSetData:
     def get_scan(self, int) -> Any: ...
     def get_template(self) -> Any: ...
     def get_vendor(self) -> Any: ...
+    def has_native_reader(self) -> bool: ...
     def has_single_file_reader(self) -> Any: ...
     def is_marked_for_rejection(self, int) -> Any: ...
     def mark_for_rejection(self, int, bool) -> Any: ...
     def masker(self) -> Any: ...
+    def native_reader(self) -> ImageReader | None: ...
     def reader(self) -> Any: ...
+    def set_native_reader(self, reader: ImageReader | None) -> None: ...
     def set_beam(self, boost, int) -> Any: ...
     def set_detector(self, boost, int) -> Any: ...
     def set_format_class(self, boost) -> Any: ...
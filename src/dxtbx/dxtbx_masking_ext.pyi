@@ -1,6 +1,6 @@
 from __future__ import annotations
 
-from typing import Any, Tuple
+from typing import Any, List, Tuple, overload
 
 from scitbx.array_family import flex
 
@@ -13,11 +13,20 @@ def mask_untrusted_rectangle(
 def mask_untrusted_circle(
     mask: flex.bool, xc: float, yc: float, radius: float
 ) -> None: ...
-def mask_untrusted_polygon(mask: flex.bool, polygon: flex.vec2_double) -> None: ...
+def mask_untrusted_polygon(
+    mask: flex.bool, polygon: flex.vec2_double, nthreads: int = 1
+) -> None: ...
 def mask_untrusted_resolution_range(
     mask: flex.bool, beam: BeamBase, panel: Panel, d_min: float, d_max: float
 ) -> None: ...
 
+class ResolutionMaskGenerator:
+    def __init__(self, beam: BeamBase, panel: Panel) -> None: ...
+    @overload
+    def apply(self, mask: flex.bool, d_min: float, d_max: float) -> None: ...
+    @overload
+    def apply(self, mask: flex.bool, ranges: flex.vec2_double) -> None: ...
+
 class GoniometerShadowMasker:
     def __init__(
         self,
@@ -31,8 +40,19 @@ class GoniometerShadowMasker:
     def project_extrema(
         self, detector: Detector, scan_angle: float
     ) -> flex.vec2_double: ...
-    def get_mask(self, detector: Detector, scan_angle: float) -> Tuple[flex.bool]: ...
+    def get_mask(
+        self, detector: Detector, scan_angle: float, nthreads: int = 1
+    ) -> Tuple[flex.bool]: ...
 
 class SmarGonShadowMasker(GoniometerShadowMasker):
     def __init__(self, goniometer: MultiAxisGoniometer) -> None: ...
     def extrema_at_scan_angle(self, scan_angle: float) -> flex.vec3_double: ...
+
+class GoniometerShadowSweepMasker:
+    def __init__(self, masker: GoniometerShadowMasker, detector: Detector) -> None: ...
+    def extrema_at_scan_angle(self, scan_angle: float) -> flex.vec3_double: ...
+    def project_extrema(self, scan_angle: float) -> List[flex.vec2_double]: ...
+    def get_mask(self, scan_angle: float) -> Tuple[flex.bool]: ...
+    def get_masks(
+        self, scan_angles: flex.double, nthreads: int = 0
+    ) -> List[Tuple[flex.bool]]: ...
@@ -57,6 +57,7 @@ class BeamBase:
     def set_polarization_fraction(self, polarization_fraction: float) -> None: ...
     def get_polarization_normal(self) -> Vec3Float: ...
     def set_polarization_normal(self, polarization_normal: Vec3Float) -> None: ...
+    def get_revision(self) -> int: ...
     def get_s0(self) -> Vec3Float: ...
     def set_s0(self, s0: Vec3Float) -> None: ...
     def get_s0_at_scan_point(self, index: int) -> Vec3Float: ...
@@ -307,7 +308,13 @@ class Detector:
     def get_max_resolution(self, s0: Vec3Float) -> float: ...
     def get_names(self) -> flex.std_string: ...
     def get_panel_intersection(self, s1: Vec3Float) -> int: ...
+    @overload
     def get_ray_intersection(self, s1: Vec3Float) -> Tuple[int, Vec2Float]: ...
+    @overload
+    def get_ray_intersection(
+        self, s1: flex.vec3_double, nthreads: int = ...
+    ) -> Tuple[flex.int, flex.vec2_double]: ...
+    def get_revision(self) -> int: ...
     def has_projection_2d(self) -> bool: ...
     def is_similar_to(
         self,
@@ -318,6 +325,12 @@ class Detector:
         static_only: bool = ...,
         ignore_trusted_range: bool = ...,
     ) -> bool: ...
+    def millimeter_to_pixel(
+        self, panel: flex.size_t, xy: flex.vec2_double
+    ) -> flex.vec2_double: ...
+    def pixel_to_millimeter(
+        self, panel: flex.size_t, xy: flex.vec2_double
+    ) -> flex.vec2_double: ...
     def rotate_around_origin(
         self, axis: Vec3Float, angle: float, deg: bool = ...
     ) -> Any: ...
@@ -388,7 +401,15 @@ class ExperimentList:
         imageset: object,
         scaling_model: object,
     ) -> flex.size_t: ...
+    def beams(self) -> List[Optional[BeamBase]]: ...
+    def detectors(self) -> List[Optional[Detector]]: ...
+    def goniometers(self) -> List[Optional[Goniometer]]: ...
+    def scans(self) -> List[Optional[Scan]]: ...
+    def crystals(self) -> List[Optional[CrystalBase]]: ...
     def is_consistent(self) -> bool: ...
+    def to_bytes(self) -> bytes: ...
+    @staticmethod
+    def from_bytes(data: bytes, nthreads: int = ...) -> ExperimentList: ...
     def __len__(self) -> int: ...
 
 class GoniometerBase:
@@ -416,8 +437,12 @@ class Goniometer(GoniometerBase):
     def from_dict(data: Dict) -> Goniometer: ...
     def get_fixed_rotation(self) -> Vec9Float: ...
     def get_num_scan_points(self) -> int: ...
+    def get_revision(self) -> int: ...
     def get_rotation_axis(self) -> Vec3Float: ...
     def get_rotation_axis_datum(self) -> Vec3Float: ...
+    def get_rotation_matrices(
+        self, angles: flex.double, deg: bool = ..., nthreads: int = ...
+    ) -> flex.mat3_double: ...
     def get_setting_rotation(self) -> Vec9Float: ...
     def get_setting_rotation_at_scan_point(self, index: int) -> Vec9Float: ...
     def get_setting_rotation_at_scan_points(self) -> flex.mat3_double: ...
@@ -432,6 +457,13 @@ class Goniometer(GoniometerBase):
     def rotate_around_origin(
         self, axis: Vec3Float, angle: float, deg: bool = ...
     ) -> None: ...
+    def rotate_vectors(
+        self,
+        vectors: flex.vec3_double,
+        angles: flex.double,
+        deg: bool = ...,
+        nthreads: int = ...,
+    ) -> flex.vec3_double: ...
     def set_fixed_rotation(self, rotation: Vec9Float) -> None: ...
     def set_rotation_axis(self, axis: Vec3Float) -> None: ...
     def set_rotation_axis_datum(self, axis_datum: Vec3Float) -> None: ...
@@ -526,6 +558,7 @@ class VirtualPanelFrame:
     def get_parent_origin(self) -> Vec3Float: ...
     def get_parent_slow_axis(self) -> Vec3Float: ...
     def get_ray_intersection(self, s1: Vec3Float) -> Vec2Float: ...
+    def get_revision(self) -> int: ...
     def get_slow_axis(self) -> Vec3Float: ...
     def set_frame(
         self, fast_axis: Vec3Float, slow_axis: Vec3Float, origin: Vec3Float
@@ -585,6 +618,33 @@ class PanelData(VirtualPanel):
         ignore_trusted_range: bool = ...,
     ) -> bool: ...
 
+class PanelGeometryField(Enum):
+    LAB_COORD = ...
+    TWO_THETA = ...
+    RESOLUTION = ...
+    OBLIQUITY = ...
+    ALL = ...
+
+class PanelGeometryMaps:
+    def fields(self) -> int: ...
+    def offset(self) -> float: ...
+    def s0(self) -> Vec3Float: ...
+    def has(self, field: Union[PanelGeometryField, int]) -> bool: ...
+    def lab_coord(self) -> flex.double: ...
+    def two_theta(self) -> flex.double: ...
+    def resolution(self) -> flex.double: ...
+    def obliquity(self) -> flex.double: ...
+
+class PanelGeometryMapsFloat:
+    def fields(self) -> int: ...
+    def offset(self) -> float: ...
+    def s0(self) -> Vec3Float: ...
+    def has(self, field: Union[PanelGeometryField, int]) -> bool: ...
+    def lab_coord(self) -> flex.float: ...
+    def two_theta(self) -> flex.float: ...
+    def resolution(self) -> flex.float: ...
+    def obliquity(self) -> flex.float: ...
+
 class Panel(PanelData):
     @overload
     def __init__(
@@ -619,6 +679,7 @@ class Panel(PanelData):
         mu: float = ...,
         identifier: str = ...,
     ) -> None: ...
+    def clear_geometry_maps(self) -> None: ...
     @staticmethod
     @overload
     def from_dict(data: Dict) -> Panel: ...
@@ -629,6 +690,20 @@ class Panel(PanelData):
     def get_bidirectional_ray_intersection_px(self, s1: Vec3Float) -> Vec2Float: ...
     def get_cos2_two_theta_array(self, s0: Vec3Float) -> flex.double: ...
     def get_gain(self) -> float: ...
+    def get_geometry_maps(
+        self,
+        s0: Vec3Float,
+        fields: Union[PanelGeometryField, int] = ...,
+        offset: float = ...,
+        nthreads: int = ...,
+    ) -> PanelGeometryMaps: ...
+    def get_geometry_maps_float(
+        self,
+        s0: Vec3Float,
+        fields: Union[PanelGeometryField, int] = ...,
+        offset: float = ...,
+        nthreads: int = ...,
+    ) -> PanelGeometryMapsFloat: ...
     def get_identifier(self) -> str: ...
     def get_image_size_mm(self) -> Vec2Float: ...
     def get_max_resolution_at_corners(self, s0: Vec3Float) -> float: ...
@@ -708,16 +783,24 @@ class DetectorNode(Panel):
 
 class PxMmStrategy:
     def name(self) -> str: ...
+    @overload
     def to_millimeter(self, panel: Panel, xy: Vec2Float) -> Vec2Float: ...
+    @overload
+    def to_millimeter(self, panel: Panel, xy: flex.vec2_double) -> flex.vec2_double: ...
+    @overload
     def to_pixel(self, panel: Panel, xy: Vec2Float) -> Vec2Float: ...
+    @overload
+    def to_pixel(self, panel: Panel, xy: flex.vec2_double) -> flex.vec2_double: ...
 
 class SimplePxMmStrategy(PxMmStrategy):
     pass
 
 class ParallaxCorrectedPxMmStrategy(PxMmStrategy):
-    def __init__(self, mu: float, t0: float) -> None: ...
+    def __init__(self, mu: float, t0: float, lookup_step: float = ...) -> None: ...
     def mu(self) -> float: ...
     def t0(self) -> float: ...
+    def lookup_step(self) -> float: ...
+    def lookup_error(self, panel: Panel) -> float: ...
 
 class OffsetPxMmStrategy(PxMmStrategy):
     def __init__(self, dx: flex.double, dy: flex.double) -> None: ...
@@ -731,6 +814,24 @@ class OffsetParallaxCorrectedPxMmStrategy(ParallaxCorrectedPxMmStrategy):
     def dx(self) -> flex.double: ...
     def dy(self) -> flex.double: ...
 
+class ScanVaryingInterpolator:
+    def __init__(
+        self,
+        crystal: CrystalBase,
+        beam: BeamBase,
+        goniometer: Goniometer,
+        scan: Scan,
+    ) -> None: ...
+    def get_frame_range(self) -> Vec2Float: ...
+    def get_A(self, frame: flex.double, nthreads: int = ...) -> flex.mat3_double: ...
+    def get_s0(self, frame: flex.double, nthreads: int = ...) -> flex.vec3_double: ...
+    def get_setting_rotation(
+        self, frame: flex.double, nthreads: int = ...
+    ) -> flex.mat3_double: ...
+    def interpolate(
+        self, frame: flex.double, nthreads: int = ...
+    ) -> Tuple[flex.mat3_double, flex.vec3_double, flex.mat3_double]: ...
+
 class ScanBase:
     pass
 
@@ -770,8 +871,13 @@ class Scan(ScanBase):
     def get_angle_from_array_index(
         self, index: flex.double, deg: bool = ...
     ) -> flex.double: ...
+    @overload
     def get_angle_from_image_index(self, index: float, deg: bool = ...) -> float: ...
     @overload
+    def get_angle_from_image_index(
+        self, index: flex.double, deg: bool = ...
+    ) -> flex.double: ...
+    @overload
     def get_array_index_from_angle(self, angle: float, deg: bool = ...) -> float: ...
     @overload
     def get_array_index_from_angle(
@@ -780,6 +886,9 @@ class Scan(ScanBase):
     def get_array_indices_with_angle(
         self, angle: float, deg: bool = ...
     ) -> flex.vec2_double: ...
+    def get_array_indices_with_angles(
+        self, angles: flex.double, padding: float = ..., deg: bool = ...
+    ) -> Tuple[flex.size_t, flex.vec2_double]: ...
     def get_array_range(self) -> Vec2Int: ...
     def get_batch_for_array_index(self, index: int) -> int: ...
     def get_batch_for_image_index(self, index: int) -> int: ...
@@ -791,7 +900,12 @@ class Scan(ScanBase):
     def get_exposure_times(self) -> flex.double: ...
     def set_exposure_times(self, times: flex.double) -> None: ...
     def get_image_epoch(self, index: int) -> float: ...
+    @overload
     def get_image_index_from_angle(self, angle: float, deg: bool = ...) -> float: ...
+    @overload
+    def get_image_index_from_angle(
+        self, angle: flex.double, deg: bool = ...
+    ) -> flex.double: ...
     def get_image_indices_with_angle(
         self, angle: float, deg: bool = ...
     ) -> flex.vec2_double: ...
@@ -855,6 +969,28 @@ class Spectrum:
     def get_weights(self) -> flex.double: ...
     def to_dict(self) -> Dict: ...
 
+class SpectrumBatch:
+    @overload
+    def __init__(self) -> None: ...
+    @overload
+    def __init__(self, energies: flex.double, weights: flex.double) -> None: ...
+    @overload
+    def __init__(self, spectra: Sequence[Spectrum]) -> None: ...
+    def __len__(self) -> int: ...
+    def num_bins(self) -> int: ...
+    def has_common_energies(self) -> bool: ...
+    def get_energies_eV(self) -> flex.double: ...
+    def get_weights(self) -> flex.double: ...
+    def get_spectrum(self, index: int) -> Spectrum: ...
+    def compute_weighted_energy(
+        self, nthreads: int = ...
+    ) -> Tuple[flex.double, flex.double]: ...
+    def get_weighted_energy_eV(self, nthreads: int = ...) -> flex.double: ...
+    def get_weighted_energy_variance(self, nthreads: int = ...) -> flex.double: ...
+    def get_weighted_wavelength(self, nthreads: int = ...) -> flex.double: ...
+    def get_bandwidth_98_percent(self, nthreads: int = ...) -> flex.vec2_double: ...
+    def rebin(self, grid: flex.double, nthreads: int = ...) -> SpectrumBatch: ...
+
 class flex_Beam(FlexPlain[Beam]):
     pass
 
@@ -12,6 +12,7 @@ from __future__ import annotations
 import bz2
 import functools
 import os
+import threading
 from io import IOBase
 from typing import Callable, ClassVar
 
@@ -34,6 +35,7 @@ except ImportError:
 
 
 _cache_controller = dxtbx.filecache_controller.simple_controller()
+_instance_lock = threading.RLock()
 
 
 def abstract(cls):
@@ -266,15 +268,17 @@ class Format:
 
     @classmethod
     def get_instance(Class, filename, **kwargs):
-        if (
-            not hasattr(Class, "_current_instance_")
-            or Class._current_filename_ != filename
-            or Class._current_kwargs_ != kwargs
-        ):
-            Class._current_instance_ = Class(filename, **kwargs)
-            Class._current_filename_ = filename
-            Class._current_kwargs_ = kwargs
-        return Class._current_instance_
+        # Images may be read from several threads when prefetching
+        with _instance_lock:
+            if (
+                not hasattr(Class, "_current_instance_")
+                or Class._current_filename_ != filename
+                or Class._current_kwargs_ != kwargs
+            ):
+                Class._current_instance_ = Class(filename, **kwargs)
+                Class._current_filename_ = filename
+                Class._current_kwargs_ = kwargs
+            return Class._current_instance_
 
     @classmethod
     def get_reader(cls):
@@ -283,6 +287,15 @@ class Format:
         """
         return functools.partial(Reader, cls)
 
+    @classmethod
+    def get_native_reader(cls, filenames, **kwargs):
+        """
+        Overload this to return a C++ ImageReader for the files, which reads
+        the same data as get_raw_data without calling into Python. Return
+        None to read through get_raw_data.
+        """
+        return None
+
     def get_masker(self, goniometer=None):
         """
         Return a masker class
@@ -331,6 +344,7 @@ class Format:
 
         # Get some information from the format class
         reader = Class.get_reader()(filenames, **format_kwargs)
+        native_reader = Class.get_native_reader(filenames, **format_kwargs)
 
         # Get the format instance
         if check_format is True:
@@ -379,15 +393,15 @@ class Format:
         if not is_sequence:
 
             # Create the imageset
-            iset = ImageSet(
-                ImageSetData(
-                    reader=reader,
-                    masker=None,
-                    vendor=vendor,
-                    params=params,
-                    format=Class,
-                )
+            data = ImageSetData(
+                reader=reader,
+                masker=None,
+                vendor=vendor,
+                params=params,
+                format=Class,
             )
+            data.set_native_reader(native_reader)
+            iset = ImageSet(data)
 
             # If any are None then read from format
             if [beam, detector, goniometer, scan].count(None) != 0:
@@ -450,15 +464,17 @@ class Format:
                 masker = None
 
             # Create the sequence
+            data = ImageSetData(
+                reader=reader,
+                masker=masker,
+                vendor=vendor,
+                params=params,
+                format=Class,
+                template=template,
+            )
+            data.set_native_reader(native_reader)
             iset = ImageSequence(
-                ImageSetData(
-                    reader=reader,
-                    masker=masker,
-                    vendor=vendor,
-                    params=params,
-                    format=Class,
-                    template=template,
-                ),
+                data,
                 beam=beam,
                 detector=detector,
                 goniometer=goniometer,
@@ -1,6 +1,5 @@
 from __future__ import annotations
 
-from boost_adaptbx.boost.python import streambuf
 from scitbx import matrix
 from scitbx.array_family import flex
 
@@ -232,7 +231,7 @@ class FormatBrukerED1(FormatBruker):
         nrows = int(self.header_dict["NROWS"].split()[0])
         ncols = int(self.header_dict["NCOLS"].split()[0])
 
-        raw_data = read_data(streambuf(f), nrows * ncols)
+        raw_data = read_data(f, nrows * ncols)
 
         image_size = (nrows, ncols)
         raw_data.reshape(flex.grid(*image_size))
@@ -245,7 +244,7 @@ class FormatBrukerED1(FormatBruker):
         if num_underflows > 0:
             # stored values are padded to a multiple of 16 bytes
             nbytes = num_underflows + 15 & ~(15)
-            underflow_vals = read_uint8(streambuf(f), nbytes)[:num_underflows]
+            underflow_vals = read_uint8(f, nbytes)[:num_underflows]
         else:
             underflow_vals = None
 
@@ -253,7 +252,7 @@ class FormatBrukerED1(FormatBruker):
         if num_2b_overflows > 0:
             # stored values are padded to a multiple of 16 bytes
             nbytes = num_2b_overflows * 2 + 15 & ~(15)
-            overflow_vals = read_2b(streambuf(f), nbytes // 2)[:num_2b_overflows]
+            overflow_vals = read_2b(f, nbytes // 2)[:num_2b_overflows]
             overflow = flex.int(nrows * ncols, 0)
             sel = (raw_data == 255).as_1d()
             overflow.set_selected(sel, overflow_vals - 255)
@@ -264,7 +263,7 @@ class FormatBrukerED1(FormatBruker):
         if num_4b_overflows > 0:
             # stored values are padded to a multiple of 16 bytes
             nbytes = num_4b_overflows * 4 + 15 & ~(15)
-            overflow_vals = read_4b(streambuf(f), nbytes // 4)[:num_4b_overflows]
+            overflow_vals = read_4b(f, nbytes // 4)[:num_4b_overflows]
             overflow = flex.int(nrows * ncols, 0)
             sel = (raw_data == 65535).as_1d()
             overflow.set_selected(sel, overflow_vals - 65535)
@@ -28,6 +28,11 @@ if hasattr(pycbf.cbf_handle_struct, "read_buffer"):
 else:
     from dxtbx.format.image import cbf_read_buffer
 
+try:
+    from dxtbx.format.image import cbf_read_mapped_file
+except ImportError:
+    cbf_read_mapped_file = None
+
 
 class FormatCBFFull(FormatCBF):
     """An image reading class for full CBF format images i.e. those from
@@ -72,6 +77,11 @@ class FormatCBFFull(FormatCBF):
 
             if buffer:
                 cbf_read_buffer(self._cbf_handle, buffer, pycbf.MSG_DIGEST)
+            elif cbf_read_mapped_file:
+                # CBFlib reads from the mapping for as long as the handle lives
+                self._cbf_mapping = cbf_read_mapped_file(
+                    self._cbf_handle, self._image_file, pycbf.MSG_DIGEST
+                )
             else:
                 self._cbf_handle.read_widefile(
                     self._image_file.encode(), pycbf.MSG_DIGEST
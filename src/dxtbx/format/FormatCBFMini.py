@@ -15,7 +15,6 @@ import sys
 
 import pycbf
 
-from boost_adaptbx.boost.python import streambuf
 from cctbx import factor_ev_angstrom
 from cctbx.eltbx import attenuation_coefficient
 from iotbx.detectors.pilatus_minicbf import PilatusImage
@@ -25,7 +24,9 @@ from dxtbx.ext import read_int32, uncompress
 from dxtbx.format.FormatCBF import FormatCBF
 from dxtbx.format.FormatCBFMiniPilatusHelpers import get_pilatus_timestamp
 from dxtbx.format.FormatCBFMultiTile import cbf_wrapper
+from dxtbx.format.image import CBFByteOffsetReader
 from dxtbx.model import ParallaxCorrectedPxMmStrategy, SimplePxMmStrategy
+from dxtbx.util import get_url_scheme
 
 dxtbx_overload_scale = float(os.getenv("DXTBX_OVERLOAD_SCALE", "1"))
 
@@ -264,7 +265,7 @@ class FormatCBFMini(FormatCBF):
             assert len(self.get_detector()) == 1
             with self.open_file(self._image_file) as f:
                 f.read(data_offset)
-                pixel_values = read_int32(streambuf(f), cbf_header["length"])
+                pixel_values = read_int32(f, cbf_header["length"])
             pixel_values.reshape(flex.grid(cbf_header["slow"], cbf_header["fast"]))
 
         else:
@@ -281,6 +282,23 @@ class FormatCBFMini(FormatCBF):
 
         return self._raw_data
 
+    @classmethod
+    def get_native_reader(cls, filenames, **kwargs):
+        if cls.get_raw_data is not FormatCBFMini.get_raw_data:
+            return None
+        return cls._get_cbf_reader(filenames)
+
+    @classmethod
+    def _get_cbf_reader(cls, filenames):
+        """Get a native reader for classes which read the image with
+        _read_cbf_image unchanged, if the files are local and uncompressed."""
+        if cls._read_cbf_image is not FormatCBFMini._read_cbf_image:
+            return None
+        for filename in filenames:
+            if get_url_scheme(filename) or filename.endswith((".gz", ".bz2")):
+                return None
+        return CBFByteOffsetReader(filenames)
+
     def detectorbase_start(self):
         self.detectorbase = PilatusImage(self._image_file)
         self.detectorbase.readHeader()  # necessary for LABELIT
@@ -223,6 +223,15 @@ class FormatCBFMiniPilatus(FormatCBFMini):
             self._raw_data = tuple(self._raw_data)
         return self._raw_data
 
+    @classmethod
+    def get_native_reader(cls, filenames, **kwargs):
+        if (
+            kwargs.get("multi_panel", False)
+            or cls.get_raw_data is not FormatCBFMiniPilatus.get_raw_data
+        ):
+            return None
+        return cls._get_cbf_reader(filenames)
+
 
 if __name__ == "__main__":
     for arg in sys.argv[1:]:
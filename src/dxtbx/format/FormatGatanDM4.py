@@ -7,7 +7,6 @@ from __future__ import annotations
 
 import struct
 
-from boost_adaptbx.boost.python import streambuf
 from scitbx.array_family import flex
 
 from dxtbx import IncorrectFormatError
@@ -381,17 +380,17 @@ class FormatGatanDM4(Format):
         assert self._data_type in ["h", "f", "B", "l", "b", "H", "I", "d"]
 
         if self._data_type == "f":
-            raw_data = read_float32(streambuf(f), self._image_num_elements)
+            raw_data = read_float32(f, self._image_num_elements)
         elif self._data_type == "B":
-            raw_data = read_uint8(streambuf(f), self._image_num_elements)
+            raw_data = read_uint8(f, self._image_num_elements)
         elif self._data_type == "h":
-            raw_data = read_int16(streambuf(f), self._image_num_elements)
+            raw_data = read_int16(f, self._image_num_elements)
         elif self._data_type == "H":
-            raw_data = read_uint16(streambuf(f), self._image_num_elements)
+            raw_data = read_uint16(f, self._image_num_elements)
         elif self._data_type == "l":
-            raw_data = read_int32(streambuf(f), self._image_num_elements)
+            raw_data = read_int32(f, self._image_num_elements)
         elif self._data_type == "I":
-            raw_data = read_uint32(streambuf(f), self._image_num_elements)
+            raw_data = read_uint32(f, self._image_num_elements)
 
         # no C++ reader for remaining types (should be unusual anyway)
         else:
@@ -42,6 +42,14 @@ def inverted_distance_detector(detector):
 class FormatNXmx(FormatNexus):
     """Read NXmx-flavour NeXus-format HDF5 data."""
 
+    # The raw data chunk cache for each dataset, in bytes and hash table
+    # slots. HDF5 gives 1 MB by default, less than the chunks of one image
+    # from most detectors, so reading an image a module at a time would
+    # decompress its chunks again for every module. HDF5 only fills the
+    # cache as chunks are read, and frees it when the dataset is closed.
+    _chunk_cache_bytes: int = 128 * 1024 * 1024
+    _chunk_cache_slots: int = 10007
+
     @staticmethod
     def understand(image_file):
         with h5py.File(image_file) as handle:
@@ -61,7 +69,12 @@ class FormatNXmx(FormatNexus):
     def _start(self):
         self._static_mask = None
 
-        self._cached_file_handle = h5py.File(self._image_file, swmr=True)
+        self._cached_file_handle = h5py.File(
+            self._image_file,
+            swmr=True,
+            rdcc_nbytes=self._chunk_cache_bytes,
+            rdcc_nslots=self._chunk_cache_slots,
+        )
         nxmx_obj = self._get_nxmx(self._cached_file_handle)
         nxentry = nxmx_obj.entries[0]
         nxsample = nxentry.samples[0]
@@ -15,7 +15,6 @@ from pathlib import Path
 
 import numpy as np
 
-from boost_adaptbx.boost.python import streambuf
 from scitbx.array_family import flex
 
 import dxtbx.ext
@@ -369,7 +368,7 @@ class FormatSER(Format):
             d["ArraySizeX"] = struct.unpack("<I", f.read(4))[0]
             d["ArraySizeY"] = struct.unpack("<I", f.read(4))[0]
             nelts = d["ArraySizeX"] * d["ArraySizeY"]
-            raw_data = read_pixel(streambuf(f), nelts)
+            raw_data = read_pixel(f, nelts)
 
         # Check image size is as expected (same as the first image)
         if d["ArraySizeX"] != self._header_dictionary["ArraySizeX"]:
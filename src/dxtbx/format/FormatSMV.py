@@ -11,7 +11,6 @@ representations.
 
 from __future__ import annotations
 
-from boost_adaptbx.boost.python import streambuf
 from scitbx.array_family import flex
 
 from dxtbx import IncorrectFormatError
@@ -73,9 +72,9 @@ class FormatSMV(Format):
             fh.seek(self._header_size)
 
             if big_endian == is_big_endian():
-                raw_data = read_uint16(streambuf(fh), int(size[0] * size[1]))
+                raw_data = read_uint16(fh, int(size[0] * size[1]))
             else:
-                raw_data = read_uint16_bs(streambuf(fh), int(size[0] * size[1]))
+                raw_data = read_uint16_bs(fh, int(size[0] * size[1]))
 
         # note that x and y are reversed here
         raw_data.reshape(flex.grid(size[1], size[0]))
@@ -7,7 +7,6 @@ import calendar
 import sys
 import time
 
-from boost_adaptbx.boost.python import streambuf
 from scitbx import matrix
 from scitbx.array_family import flex
 
@@ -183,7 +182,7 @@ class FormatSMVCMOS1(FormatSMV):
         image_size = self.get_detector()[0].get_image_size()
         with self.open_file(self._image_file) as fh:
             fh.seek(self._header_size)
-            raw_data = read_uint16(streambuf(fh), int(image_size[0] * image_size[1]))
+            raw_data = read_uint16(fh, int(image_size[0] * image_size[1]))
         raw_data.reshape(flex.grid(image_size[1], image_size[0]))
 
         return raw_data
@@ -8,7 +8,6 @@ from __future__ import annotations
 import sys
 import time
 
-from boost_adaptbx.boost.python import streambuf
 from scitbx import matrix
 from scitbx.array_family import flex
 
@@ -147,7 +146,7 @@ class FormatSMVRigakuPilatus(FormatSMVRigaku):
         size = self.get_detector()[0].get_image_size()
         f = self.open_file(self._image_file)
         f.read(int(self._header_dictionary["HEADER_BYTES"]))
-        raw_data = read_int32(streambuf(f), int(size[0] * size[1]))
+        raw_data = read_int32(f, int(size[0] * size[1]))
         raw_data.reshape(flex.grid(size[1], size[0]))
 
         return raw_data
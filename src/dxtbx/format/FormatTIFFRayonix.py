@@ -8,7 +8,6 @@ import struct
 import sys
 import time
 
-from boost_adaptbx.boost.python import streambuf
 from iotbx.detectors.mar import MARImage
 from scitbx.array_family import flex
 
@@ -345,7 +344,7 @@ class FormatTIFFRayonix(FormatTIFF):
         size = self.get_detector()[0].get_image_size()
         f = FormatTIFF.open_file(self._image_file)
         f.read(self._header_size)
-        raw_data = read_uint16(streambuf(f), int(size[0] * size[1])) - bias
+        raw_data = read_uint16(f, int(size[0] * size[1])) - bias
         image_size = self.get_detector()[0].get_image_size()
         raw_data.reshape(flex.grid(image_size[1], image_size[0]))
 
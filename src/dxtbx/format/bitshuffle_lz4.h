@@ -0,0 +1,245 @@
+/*
+ * bitshuffle_lz4.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_BITSHUFFLE_LZ4_H
+#define DXTBX_FORMAT_BITSHUFFLE_LZ4_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace format {
+
+  /**
+   * The HDF5 filter id registered for bitshuffle, as written by Eiger and
+   * Jungfrau detectors and hdf5plugin
+   */
+  const unsigned int BITSHUFFLE_FILTER_ID = 32008;
+
+  /**
+   * The bitshuffle filter compression option for LZ4
+   */
+  const unsigned int BITSHUFFLE_COMPRESS_LZ4 = 2;
+
+  namespace detail {
+
+    inline std::uint64_t read_big_endian(const unsigned char *data,
+                                         std::size_t nbytes) {
+      std::uint64_t value = 0;
+      for (std::size_t i = 0; i < nbytes; ++i) {
+        value = (value << 8) | data[i];
+      }
+      return value;
+    }
+
+    inline std::size_t lz4_length(const unsigned char *&ip,
+                                  const unsigned char *end,
+                                  std::size_t length) {
+      if (length == 15) {
+        unsigned char byte;
+        do {
+          if (ip == end) {
+            throw DXTBX_ERROR("Truncated LZ4 block");
+          }
+          byte = *ip++;
+          length += byte;
+        } while (byte == 255);
+      }
+      return length;
+    }
+
+    /**
+     * Decompress one LZ4 block, without the frame format
+     * @param src The compressed data
+     * @param src_size The size of the compressed data in bytes
+     * @param dst The destination
+     * @param dst_size The size of the destination in bytes
+     * @returns The number of bytes written
+     */
+    inline std::size_t lz4_decompress_block(const unsigned char *src,
+                                            std::size_t src_size,
+                                            unsigned char *dst,
+                                            std::size_t dst_size) {
+      const unsigned char *ip = src;
+      const unsigned char *const iend = src + src_size;
+      unsigned char *op = dst;
+      unsigned char *const oend = dst + dst_size;
+      while (ip < iend) {
+        const unsigned char token = *ip++;
+
+        // Literals, which end the block if nothing follows them
+        std::size_t length = lz4_length(ip, iend, token >> 4);
+        if (length > (std::size_t)(iend - ip) || length > (std::size_t)(oend - op)) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        std::memcpy(op, ip, length);
+        ip += length;
+        op += length;
+        if (ip == iend) {
+          break;
+        }
+
+        // A match, which may overlap the bytes it writes
+        if (iend - ip < 2) {
+          throw DXTBX_ERROR("Truncated LZ4 block");
+        }
+        const std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (std::size_t)(op - dst)) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        length = lz4_length(ip, iend, token & 15) + 4;
+        if (length > (std::size_t)(oend - op)) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        const unsigned char *match = op - offset;
+        if (offset >= 8) {
+          std::size_t i = 0;
+          for (; i + 8 <= length; i += 8) {
+            std::memcpy(op + i, match + i, 8);
+          }
+          for (; i < length; ++i) {
+            op[i] = match[i];
+          }
+        } else {
+          for (std::size_t i = 0; i < length; ++i) {
+            op[i] = match[i];
+          }
+        }
+        op += length;
+      }
+      return op - dst;
+    }
+
+    /**
+     * Transpose an 8x8 bit matrix held in the bytes of a 64 bit integer
+     */
+    inline std::uint64_t transpose_bits_8x8(std::uint64_t x) {
+      std::uint64_t t;
+      t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+      x = x ^ t ^ (t << 7);
+      t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+      x = x ^ t ^ (t << 14);
+      t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+      x = x ^ t ^ (t << 28);
+      return x;
+    }
+
+    /**
+     * Undo the bitshuffle of one block, on a little endian host. The block
+     * is stored as one row of bits for each bit of each byte of the
+     * elements, from the lowest bit of the first byte.
+     * @param src The shuffled block
+     * @param dst The elements
+     * @param tmp Scratch space the size of the block
+     * @param n The number of elements, a multiple of 8
+     * @param elem_size The size of an element in bytes
+     */
+    inline void bitunshuffle_block(const unsigned char *src,
+                                   unsigned char *dst,
+                                   unsigned char *tmp,
+                                   std::size_t n,
+                                   std::size_t elem_size) {
+      // Gather the rows so that each 8 bytes hold one byte of 8 elements
+      const std::size_t nrow = n / 8;
+      for (std::size_t j = 0; j < elem_size; ++j) {
+        for (std::size_t i = 0; i < nrow; ++i) {
+          unsigned char *out = tmp + i * 8 * elem_size + j * 8;
+          for (std::size_t k = 0; k < 8; ++k) {
+            out[k] = src[(j * 8 + k) * nrow + i];
+          }
+        }
+      }
+
+      // Then transpose the bits of each of those back into the bytes
+      const std::size_t nbytes = n * elem_size;
+      for (std::size_t i = 0; i < nbytes; i += 8 * elem_size) {
+        for (std::size_t j = 0; j < elem_size; ++j) {
+          std::uint64_t x;
+          std::memcpy(&x, tmp + i + j * 8, 8);
+          x = transpose_bits_8x8(x);
+          for (std::size_t k = 0; k < 8; ++k) {
+            dst[i + j + k * elem_size] = (unsigned char)x;
+            x >>= 8;
+          }
+        }
+      }
+    }
+
+  }  // namespace detail
+
+  /**
+   * Decompress a chunk written by the HDF5 bitshuffle filter with LZ4
+   * compression, as read with H5Dread_chunk. The chunk starts with its size
+   * and block size, and each block is LZ4 compressed, with any elements
+   * left over after the last multiple of 8 stored as they are at the end.
+   * @param src The chunk
+   * @param src_size The size of the chunk in bytes
+   * @param dst The destination
+   * @param dst_size The uncompressed size of the chunk in bytes
+   * @param elem_size The size of an element in bytes
+   */
+  inline void bitshuffle_lz4_decompress(const unsigned char *src,
+                                        std::size_t src_size,
+                                        unsigned char *dst,
+                                        std::size_t dst_size,
+                                        std::size_t elem_size) {
+    DXTBX_ASSERT(elem_size > 0);
+    if (src_size < 12) {
+      throw DXTBX_ERROR("Truncated bitshuffle chunk");
+    }
+    const std::uint64_t total = detail::read_big_endian(src, 8);
+    const std::size_t block_bytes = (std::size_t)detail::read_big_endian(src + 8, 4);
+    const std::size_t block_size = block_bytes / elem_size;
+    if (total != dst_size || block_size == 0 || block_size % 8 != 0) {
+      throw DXTBX_ERROR("Corrupt bitshuffle chunk");
+    }
+
+    const std::size_t n = dst_size / elem_size;
+    const unsigned char *ip = src + 12;
+    const unsigned char *const iend = src + src_size;
+    std::vector<unsigned char> shuffled(block_bytes);
+    std::vector<unsigned char> tmp(block_bytes);
+    std::size_t done = 0;
+    while (done < n) {
+      std::size_t count = std::min(block_size, n - done);
+      count -= count % 8;
+      if (count == 0) {
+        break;
+      }
+      if (iend - ip < 4) {
+        throw DXTBX_ERROR("Truncated bitshuffle chunk");
+      }
+      const std::size_t compressed = (std::size_t)detail::read_big_endian(ip, 4);
+      ip += 4;
+      if (compressed > (std::size_t)(iend - ip)) {
+        throw DXTBX_ERROR("Truncated bitshuffle chunk");
+      }
+      const std::size_t nbytes = count * elem_size;
+      if (detail::lz4_decompress_block(ip, compressed, &shuffled[0], nbytes)
+          != nbytes) {
+        throw DXTBX_ERROR("Corrupt bitshuffle chunk");
+      }
+      ip += compressed;
+      detail::bitunshuffle_block(
+        &shuffled[0], dst + done * elem_size, &tmp[0], count, elem_size);
+      done += count;
+    }
+
+    const std::size_t leftover = (n - done) * elem_size;
+    if (leftover > (std::size_t)(iend - ip)) {
+      throw DXTBX_ERROR("Truncated bitshuffle chunk");
+    }
+    std::memcpy(dst + done * elem_size, ip, leftover);
+  }
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_BITSHUFFLE_LZ4_H
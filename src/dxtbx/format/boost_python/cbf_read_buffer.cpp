@@ -1,10 +1,14 @@
 
 #include <memory>
+#include <string>
 
 #include <stdio.h>
 
 #include <boost/python.hpp>
 
+#include <dxtbx/boost_python/gil.h>
+#include <dxtbx/format/mapped_image.h>
+
 //#include <cbf.h>
 extern "C" {
 typedef struct cbf_handle_struct;
@@ -62,6 +66,32 @@ namespace dxtbx { namespace format { namespace boost_python {
     return data;
   }
 
+  /// Memory map a file and pass the mapping to cbflib, with the GIL released
+  std::shared_ptr<MappedFile> cbf_read_mapped_file(py::object handle,
+                                                   const std::string &path,
+                                                   int flags = 0) {
+    cbf_handle_struct *cbf_handle =
+      reinterpret_cast<cbf_handle_struct *>(extract_swig_wrapped_pointer(handle.ptr()));
+    if (cbf_handle == NULL) {
+      PyErr_SetString(PyExc_ValueError, "handle must be a pycbf.cbf_handle_struct");
+      py::throw_error_already_set();
+    }
+
+    std::shared_ptr<MappedFile> file;
+    int err;
+    {
+      dxtbx::boost_python::scoped_gil_release release_gil;
+      file = std::make_shared<MappedFile>(path);
+      err = cbf_read_buffered_file(cbf_handle, NULL, flags, file->data(), file->size());
+    }
+
+    if (err) {
+      PyErr_Format(PyExc_RuntimeError, "cbflib read_file returned error %d", err);
+      py::throw_error_already_set();
+    }
+    return file;
+  }
+
   /// Declare the cbf-reading classes
   void export_cbf_read_buffer() {
     using namespace boost::python;
@@ -74,5 +104,18 @@ namespace dxtbx { namespace format { namespace boost_python {
         "    handle (pycbf.cbf_handle_struct): The CBF handle object\n"
         "    data (bytes): The data buffer containing the CBF file\n"
         "    flags (int): The flags to pass to");
+
+    def("cbf_read_mapped_file",
+        cbf_read_mapped_file,
+        args("handle", "path", "flags"),
+        "Memory map a file and open it as a CBF file with CBFlib. The GIL is\n"
+        "released while CBFlib parses the file.\n\n"
+        "Args:\n"
+        "    handle (pycbf.cbf_handle_struct): The CBF handle object\n"
+        "    path (str): The path of the CBF file\n"
+        "    flags (int): The flags to pass to CBFlib\n\n"
+        "Returns:\n"
+        "    The MappedFile, which CBFlib reads from, and so must be kept\n"
+        "    for as long as the handle is used");
   }
 }}}  // namespace dxtbx::format::boost_python
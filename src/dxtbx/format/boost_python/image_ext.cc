@@ -9,6 +9,7 @@
  *  included in the root directory of this package.
  */
 #include <memory>
+#include <string>
 #include <vector>
 #include <hdf5.h>
 #include <boost/python.hpp>
@@ -16,8 +17,14 @@
 #include <boost/python/tuple.hpp>
 #include <boost/python/slice.hpp>
 #include <scitbx/array_family/flex_types.h>
+#include <scitbx/array_family/tiny_types.h>
 #include <dxtbx/error.h>
 #include <dxtbx/format/image.h>
+#include <dxtbx/format/mapped_image.h>
+#include <dxtbx/format/image_reader.h>
+#include <dxtbx/format/cbf_reader.h>
+#include <dxtbx/format/hdf5_reader.h>
+#include <dxtbx/boost_python/gil.h>
 
 #include "cbf_read_buffer.h"
 
@@ -101,6 +108,112 @@ namespace dxtbx { namespace format { namespace boost_python {
     }
   };
 
+  template <typename T>
+  scitbx::af::versa<T, scitbx::af::flex_grid<> > image_as_block(const Image<T> &self) {
+    scitbx::af::versa<T, scitbx::af::c_grid<3> > block = self.as_block();
+    scitbx::af::c_grid<3> grid = block.accessor();
+    return scitbx::af::versa<T, scitbx::af::flex_grid<> >(
+      block.handle(), scitbx::af::flex_grid<>(grid[0], grid[1], grid[2]));
+  }
+
+  scitbx::af::int2 mapped_image_shape(const MappedImage &obj) {
+    return scitbx::af::int2(obj.accessor()[0], obj.accessor()[1]);
+  }
+
+  struct MappedImagePickleSuite : boost::python::pickle_suite {
+    static boost::python::tuple getinitargs(const MappedImage &obj) {
+      return boost::python::make_tuple(obj.path(),
+                                       obj.offset(),
+                                       obj.dtype(),
+                                       obj.is_big_endian(),
+                                       mapped_image_shape(obj));
+    }
+  };
+
+  std::vector<std::string> path_vector(boost::python::object paths) {
+    std::vector<std::string> result;
+    for (std::size_t i = 0; i < boost::python::len(paths); ++i) {
+      result.push_back(boost::python::extract<std::string>(paths[i])());
+    }
+    return result;
+  }
+
+  boost::python::list path_list(const std::vector<std::string> &paths) {
+    boost::python::list result;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      result.append(paths[i]);
+    }
+    return result;
+  }
+
+  template <typename T>
+  void image_buffer_copy_to(const ImageBuffer &self, Image<T> &out) {
+    self.copy_to(out);
+  }
+
+  ImageBuffer image_reader_read(const ImageReader &self, std::size_t index) {
+    dxtbx::boost_python::scoped_gil_release release_gil;
+    return self.read(index);
+  }
+
+  std::shared_ptr<RawImageReader> make_raw_image_reader(boost::python::object paths,
+                                                        std::size_t offset,
+                                                        std::string dtype,
+                                                        bool big_endian,
+                                                        scitbx::af::int2 shape,
+                                                        std::size_t images_per_file) {
+    return std::make_shared<RawImageReader>(
+      path_vector(paths), offset, dtype, big_endian, shape, images_per_file);
+  }
+
+  boost::python::list raw_image_reader_paths(const RawImageReader &self) {
+    return path_list(self.paths());
+  }
+
+  struct RawImageReaderPickleSuite : boost::python::pickle_suite {
+    static boost::python::tuple getinitargs(const RawImageReader &obj) {
+      return boost::python::make_tuple(path_list(obj.paths()),
+                                       obj.offset(),
+                                       obj.dtype(),
+                                       obj.is_big_endian(),
+                                       obj.shape(),
+                                       obj.images_per_file());
+    }
+  };
+
+  std::shared_ptr<CBFByteOffsetReader> make_cbf_byte_offset_reader(
+    boost::python::object paths) {
+    return std::make_shared<CBFByteOffsetReader>(path_vector(paths));
+  }
+
+  boost::python::list cbf_byte_offset_reader_paths(const CBFByteOffsetReader &self) {
+    return path_list(self.paths());
+  }
+
+  struct CBFByteOffsetReaderPickleSuite : boost::python::pickle_suite {
+    static boost::python::tuple getinitargs(const CBFByteOffsetReader &obj) {
+      return boost::python::make_tuple(path_list(obj.paths()));
+    }
+  };
+
+  boost::python::list read_cbf_images_wrapper(boost::python::object paths,
+                                              std::size_t nthreads) {
+    std::vector<std::string> path_list = path_vector(paths);
+    std::vector<CBFImageData> images;
+    {
+      dxtbx::boost_python::scoped_gil_release release_gil;
+      images = read_cbf_images(path_list, nthreads);
+    }
+    boost::python::list result;
+    for (std::size_t i = 0; i < images.size(); ++i) {
+      scitbx::af::c_grid<2> grid = images[i].data.accessor();
+      scitbx::af::versa<int, scitbx::af::flex_grid<> > data(
+        images[i].data.handle(), scitbx::af::flex_grid<>(grid[0], grid[1]));
+      result.append(boost::python::make_tuple(images[i].header, data));
+    }
+    return result;
+  }
+
   template <typename T>
   void image_tile_wrapper(const char *name) {
     typedef ImageTile<T> image_tile_type;
@@ -129,6 +242,8 @@ namespace dxtbx { namespace format { namespace boost_python {
       .def("n_tiles", &image_type::n_tiles)
       .def("empty", &image_type::empty)
       .def("append", &image_type::push_back)
+      .def("is_contiguous", &image_type::is_contiguous)
+      .def("as_block", &image_as_block<T>)
       .def("__len__", &image_type::n_tiles)
       .def("__iter__", range(&image_type::begin, &image_type::end))
       .def_pickle(ImagePickleSuite<T>());
@@ -142,16 +257,99 @@ namespace dxtbx { namespace format { namespace boost_python {
     image_wrapper<int>("ImageInt");
     image_wrapper<double>("ImageDouble");
 
+    class_<MappedFile, std::shared_ptr<MappedFile>, boost::noncopyable>("MappedFile",
+                                                                      no_init)
+      .def(init<std::string>((arg("path"))))
+      .def("path", &MappedFile::path, return_value_policy<copy_const_reference>())
+      .def("__len__", &MappedFile::size);
+
+    class_<MappedImage>("MappedImage", no_init)
+      .def(init<std::string, std::size_t, std::string, bool, scitbx::af::int2>(
+        (arg("path"), arg("offset"), arg("dtype"), arg("big_endian"), arg("shape"))))
+      .def("path", &MappedImage::path)
+      .def("offset", &MappedImage::offset)
+      .def("dtype", &MappedImage::dtype)
+      .def("is_big_endian", &MappedImage::is_big_endian)
+      .def("is_integer", &MappedImage::is_integer)
+      .def("shape", &mapped_image_shape)
+      .def("nbytes", &MappedImage::nbytes)
+      .def("at_offset", &MappedImage::at_offset)
+      .def("as_int", &MappedImage::as_array<int>)
+      .def("as_float", &MappedImage::as_array<float>)
+      .def("as_double", &MappedImage::as_array<double>)
+      .def("__len__", &MappedImage::size)
+      .def_pickle(MappedImagePickleSuite());
+
     class_<ImageBuffer>("ImageBuffer")
       .def(init<Image<int> >())
       .def(init<Image<double> >())
+      .def(init<MappedImage>())
       .def("is_empty", &ImageBuffer::is_empty)
       .def("is_int", &ImageBuffer::is_int)
       .def("is_float", &ImageBuffer::is_float)
       .def("is_double", &ImageBuffer::is_double)
+      .def("is_uint16", &ImageBuffer::is_uint16)
+      .def("is_uint8", &ImageBuffer::is_uint8)
+      .def("is_mapped", &ImageBuffer::is_mapped)
+      .def("as_mapped", &ImageBuffer::as_mapped)
       .def("as_int", &ImageBuffer::as_int)
       .def("as_float", &ImageBuffer::as_float)
-      .def("as_double", &ImageBuffer::as_double);
+      .def("as_double", &ImageBuffer::as_double)
+      .def("copy_to", &image_buffer_copy_to<int>)
+      .def("copy_to", &image_buffer_copy_to<double>);
+
+    class_<ImageReader, std::shared_ptr<ImageReader>, boost::noncopyable>("ImageReader",
+                                                                         no_init)
+      .def("read", &image_reader_read)
+      .def("__len__", &ImageReader::size);
+
+    class_<RawImageReader, std::shared_ptr<RawImageReader>, bases<ImageReader> >(
+      "RawImageReader", no_init)
+      .def("__init__",
+           make_constructor(&make_raw_image_reader,
+                            default_call_policies(),
+                            (arg("paths"),
+                             arg("offset"),
+                             arg("dtype"),
+                             arg("big_endian"),
+                             arg("shape"),
+                             arg("images_per_file") = 1)))
+      .def("paths", &raw_image_reader_paths)
+      .def("offset", &RawImageReader::offset)
+      .def("dtype", &RawImageReader::dtype)
+      .def("is_big_endian", &RawImageReader::is_big_endian)
+      .def("shape", &RawImageReader::shape)
+      .def("images_per_file", &RawImageReader::images_per_file)
+      .def_pickle(RawImageReaderPickleSuite());
+
+    class_<CBFByteOffsetReader,
+           std::shared_ptr<CBFByteOffsetReader>,
+           bases<ImageReader> >("CBFByteOffsetReader", no_init)
+      .def("__init__",
+           make_constructor(&make_cbf_byte_offset_reader,
+                            default_call_policies(),
+                            (arg("paths"))))
+      .def("paths", &cbf_byte_offset_reader_paths)
+      .def_pickle(CBFByteOffsetReaderPickleSuite());
+
+    def("read_cbf_images",
+        &read_cbf_images_wrapper,
+        (arg("paths"), arg("nthreads") = 0),
+        "Read single image CBF files in parallel, with the GIL released.\n\n"
+        "Args:\n"
+        "    paths (list[str]): The file paths\n"
+        "    nthreads (int): The number of threads, zero for the default\n\n"
+        "Returns:\n"
+        "    A list of (header, data) for each file, where header is the text\n"
+        "    before the binary section and data a flex.int of the pixels");
+
+    class_<HDF5ImageReader,
+           std::shared_ptr<HDF5ImageReader>,
+           bases<ImageReader>,
+           boost::noncopyable>("HDF5ImageReader", no_init)
+      .def(init<std::string, std::string>((arg("filename"), arg("dataset"))))
+      .def("filename", &HDF5ImageReader::filename)
+      .def("dataset", &HDF5ImageReader::dataset);
 
 #ifdef BUILD_CBF
     export_cbf_read_buffer();
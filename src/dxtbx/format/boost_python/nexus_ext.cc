@@ -14,6 +14,13 @@
 #include <boost/python/slice.hpp>
 #include <scitbx/array_family/flex_types.h>
 #include <dxtbx/error.h>
+#include <dxtbx/boost_python/gil.h>
+#include <dxtbx/format/hdf5_chunks.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
 #include <vector>
 #include <hdf5.h>
 #include <iostream>
@@ -22,61 +29,141 @@ namespace dxtbx { namespace format { namespace boost_python {
 
   using namespace boost::python;
   template <typename T>
-  inline herr_t custom_read(hid_t,
-                            hid_t,
-                            hid_t,
-                            scitbx::af::versa<T, scitbx::af::flex_grid<> >);
+  inline herr_t custom_read(hid_t, hid_t, hid_t, T *);
 
   /**
    * Custom read function for integers
    */
   template <>
-  inline herr_t custom_read<int>(
-    hid_t dataset_id,
-    hid_t mem_space_id,
-    hid_t file_space_id,
-    scitbx::af::versa<int, scitbx::af::flex_grid<> > data) {
+  inline herr_t custom_read<int>(hid_t dataset_id,
+                                 hid_t mem_space_id,
+                                 hid_t file_space_id,
+                                 int *data) {
     return H5Dread(
-      dataset_id, H5T_NATIVE_INT, mem_space_id, file_space_id, H5P_DEFAULT, &data[0]);
+      dataset_id, H5T_NATIVE_INT, mem_space_id, file_space_id, H5P_DEFAULT, data);
   }
 
   /**
    * Custom read function for floats
    */
   template <>
-  inline herr_t custom_read<float>(
-    hid_t dataset_id,
-    hid_t mem_space_id,
-    hid_t file_space_id,
-    scitbx::af::versa<float, scitbx::af::flex_grid<> > data) {
+  inline herr_t custom_read<float>(hid_t dataset_id,
+                                   hid_t mem_space_id,
+                                   hid_t file_space_id,
+                                   float *data) {
     return H5Dread(
-      dataset_id, H5T_NATIVE_FLOAT, mem_space_id, file_space_id, H5P_DEFAULT, &data[0]);
+      dataset_id, H5T_NATIVE_FLOAT, mem_space_id, file_space_id, H5P_DEFAULT, data);
   }
 
   /**
    * Custom read function for doubles
    */
   template <>
-  inline herr_t custom_read<double>(
-    hid_t dataset_id,
-    hid_t mem_space_id,
-    hid_t file_space_id,
-    scitbx::af::versa<double, scitbx::af::flex_grid<> > data) {
-    return H5Dread(dataset_id,
-                   H5T_NATIVE_DOUBLE,
-                   mem_space_id,
-                   file_space_id,
-                   H5P_DEFAULT,
-                   &data[0]);
+  inline herr_t custom_read<double>(hid_t dataset_id,
+                                    hid_t mem_space_id,
+                                    hid_t file_space_id,
+                                    double *data) {
+    return H5Dread(
+      dataset_id, H5T_NATIVE_DOUBLE, mem_space_id, file_space_id, H5P_DEFAULT, data);
   }
 
   /**
-   * A function to extract data from hdf5 dataset directly into a flex array
+   * Custom read function for unsigned 8 bit integers
+   */
+  template <>
+  inline herr_t custom_read<std::uint8_t>(hid_t dataset_id,
+                                          hid_t mem_space_id,
+                                          hid_t file_space_id,
+                                          std::uint8_t *data) {
+    return H5Dread(
+      dataset_id, H5T_NATIVE_UINT8, mem_space_id, file_space_id, H5P_DEFAULT, data);
+  }
+
+  /**
+   * Custom read function for unsigned 16 bit integers
+   */
+  template <>
+  inline herr_t custom_read<std::uint16_t>(hid_t dataset_id,
+                                           hid_t mem_space_id,
+                                           hid_t file_space_id,
+                                           std::uint16_t *data) {
+    return H5Dread(
+      dataset_id, H5T_NATIVE_UINT16, mem_space_id, file_space_id, H5P_DEFAULT, data);
+  }
+
+  /**
+   * Custom read function for unsigned 32 bit integers
+   */
+  template <>
+  inline herr_t custom_read<std::uint32_t>(hid_t dataset_id,
+                                           hid_t mem_space_id,
+                                           hid_t file_space_id,
+                                           std::uint32_t *data) {
+    return H5Dread(
+      dataset_id, H5T_NATIVE_UINT32, mem_space_id, file_space_id, H5P_DEFAULT, data);
+  }
+
+  /**
+   * Read a hyperslab into memory through HDF5
+   * @param dataset_id The dataset
+   * @param start The start of the selection in each dimension
+   * @param count The size of the selection in each dimension
+   * @param out The destination, with the shape of the selection in C order
    */
   template <typename T>
-  inline scitbx::af::versa<T, scitbx::af::flex_grid<> > dataset_as_flex(
+  inline void h5d_read_hyperslab(hid_t dataset_id,
+                                 const std::vector<hsize_t> &start,
+                                 const std::vector<hsize_t> &count,
+                                 T *out) {
+    // Create the dataspace id
+    hid_t file_space_id = H5Dget_space(dataset_id);
+    herr_t status1 = H5Sselect_hyperslab(
+      file_space_id, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL);
+    DXTBX_ASSERT(status1 >= 0);
+
+    // Create the memory space size
+    hid_t mem_space_id = H5Screate_simple(count.size(), &count[0], NULL);
+
+    // Copy the data
+    herr_t status2 = custom_read<T>(dataset_id, mem_space_id, file_space_id, out);
+    if (status2 < 0) {
+      H5Eprint2(H5E_DEFAULT, stderr);
+    }
+
+    // Close some stuff
+    H5Sclose(mem_space_id);
+    H5Sclose(file_space_id);
+    DXTBX_ASSERT(status2 >= 0);
+  }
+
+  /**
+   * Read a hyperslab into memory. The stored chunks are fetched and then
+   * decompressed in parallel with the GIL released if the dataset allows,
+   * otherwise HDF5 reads it.
+   */
+  template <typename T>
+  inline void read_hyperslab(hid_t dataset_id,
+                             const std::vector<hsize_t> &start,
+                             const std::vector<hsize_t> &count,
+                             T *out) {
+    ChunkedRead read(dataset_id, start, count);
+    if (read.is_supported<T>() && read.fetch()) {
+      dxtbx::boost_python::scoped_gil_release release_gil;
+      read.assemble(out);
+      return;
+    }
+    h5d_read_hyperslab(dataset_id, start, count, out);
+  }
+
+  /**
+   * Turn a tuple of slices into the start and size of a hyperslab
+   * @returns The size of the selection
+   */
+  inline scitbx::af::flex_grid<>::index_type parse_selection(
     hid_t dataset_id,
-    boost::python::tuple selection) {
+    boost::python::tuple selection,
+    std::vector<hsize_t> &start,
+    std::vector<hsize_t> &count) {
     // Check validity of the dataset
     DXTBX_ASSERT(H5Iis_valid(dataset_id) > 0);
 
@@ -86,14 +173,15 @@ namespace dxtbx { namespace format { namespace boost_python {
     // Get the file space
     hid_t file_space_id = H5Dget_space(dataset_id);
     std::size_t rank = H5Sget_simple_extent_ndims(file_space_id);
-    DXTBX_ASSERT(rank == ndims);
     std::vector<hsize_t> dataset_dims(rank);
     H5Sget_simple_extent_dims(file_space_id, &dataset_dims[0], NULL);
+    H5Sclose(file_space_id);
+    DXTBX_ASSERT(rank == ndims);
 
     // Create the grid
     scitbx::af::flex_grid<>::index_type dims(ndims);
-    std::vector<hsize_t> start(ndims);
-    std::vector<hsize_t> count(ndims);
+    start.resize(ndims);
+    count.resize(ndims);
     for (std::size_t i = 0; i < ndims; ++i) {
       boost::python::slice slice =
         boost::python::extract<boost::python::slice>(selection[i]);
@@ -107,39 +195,417 @@ namespace dxtbx { namespace format { namespace boost_python {
       count[i] = dims[i];
       DXTBX_ASSERT(start[i] + count[i] <= dataset_dims[i]);
     }
+    return dims;
+  }
+
+  /**
+   * A function to extract data from hdf5 dataset directly into a flex array
+   */
+  template <typename T>
+  inline scitbx::af::versa<T, scitbx::af::flex_grid<> > dataset_as_flex(
+    hid_t dataset_id,
+    boost::python::tuple selection) {
+    std::vector<hsize_t> start, count;
+    scitbx::af::flex_grid<>::index_type dims =
+      parse_selection(dataset_id, selection, start, count);
 
     // Create the data array
     scitbx::af::flex_grid<> grid(dims);
     scitbx::af::versa<T, scitbx::af::flex_grid<> > data(
       grid, scitbx::af::init_functor_null<T>());
 
-    // Create the dataspace id
-    herr_t status1 = H5Sselect_hyperslab(
-      file_space_id, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL);
-    DXTBX_ASSERT(status1 >= 0);
+    // Copy the data
+    read_hyperslab(dataset_id, start, count, data.begin());
 
-    // Create the memory space size
-    hid_t mem_space_id = H5Screate_simple(ndims, &count[0], NULL);
+    // Return the data
+    return data;
+  }
 
-    // Copy the data
-    herr_t status2 = custom_read<T>(dataset_id, mem_space_id, file_space_id, data);
-    if (status2 < 0) {
-      H5Eprint2(H5E_DEFAULT, stderr);
-    }
-    DXTBX_ASSERT(status2 >= 0);
+  /**
+   * Extract data from an hdf5 dataset into an existing flex array, such as
+   * one reused between reads or one made by flumpy.from_numpy to share the
+   * memory of a numpy array. The array must have as many elements as the
+   * selection, and its shape is left as it is.
+   */
+  template <typename T>
+  inline void dataset_into_flex(hid_t dataset_id,
+                                boost::python::tuple selection,
+                                scitbx::af::versa<T, scitbx::af::flex_grid<> > data) {
+    std::vector<hsize_t> start, count;
+    scitbx::af::flex_grid<>::index_type dims =
+      parse_selection(dataset_id, selection, start, count);
+    DXTBX_ASSERT(data.size() == scitbx::af::flex_grid<>(dims).size_1d());
+    read_hyperslab(dataset_id, start, count, data.begin());
+  }
 
-    // Close some stuff
-    H5Sclose(mem_space_id);
+  /**
+   * Get the frame indices to read, and the dimensions of the dataset
+   * @param dataset_id The dataset
+   * @param frames A sequence of frame indices, such as a list or range
+   * @param dataset_dims The dimensions of the dataset
+   * @returns The frame indices
+   */
+  inline std::vector<hsize_t> parse_frames(hid_t dataset_id,
+                                           boost::python::object frames,
+                                           std::vector<hsize_t> &dataset_dims) {
+    DXTBX_ASSERT(H5Iis_valid(dataset_id) > 0);
+
+    // Get the file space
+    hid_t file_space_id = H5Dget_space(dataset_id);
+    int rank = H5Sget_simple_extent_ndims(file_space_id);
+    dataset_dims.resize(std::max(rank, 0));
+    if (rank > 0) {
+      H5Sget_simple_extent_dims(file_space_id, &dataset_dims[0], NULL);
+    }
     H5Sclose(file_space_id);
+    DXTBX_ASSERT(rank > 0);
 
-    // Return the data
+    // Get the frame indices
+    std::size_t nframes = boost::python::len(frames);
+    DXTBX_ASSERT(nframes > 0);
+    std::vector<hsize_t> index(nframes);
+    for (std::size_t i = 0; i < nframes; ++i) {
+      long frame = boost::python::extract<long>(frames[i]);
+      DXTBX_ASSERT(frame >= 0 && (hsize_t)frame < dataset_dims[0]);
+      index[i] = frame;
+    }
+    return index;
+  }
+
+  /**
+   * Read whole frames into a stack. Runs of consecutive frames are each
+   * read as a single hyperslab, and where the stored chunks can be read
+   * directly those of every run are fetched first and then decompressed
+   * together.
+   * @param dataset_id The dataset
+   * @param index The frame indices
+   * @param dataset_dims The dimensions of the dataset
+   * @param out The stack
+   */
+  template <typename T>
+  inline void read_frames(hid_t dataset_id,
+                          const std::vector<hsize_t> &index,
+                          const std::vector<hsize_t> &dataset_dims,
+                          T *out) {
+    std::size_t nframes = index.size();
+    std::size_t frame_size = 1;
+    for (std::size_t i = 1; i < dataset_dims.size(); ++i) {
+      frame_size *= dataset_dims[i];
+    }
+
+    // Split the frames into runs of consecutive ones, as (first, count)
+    std::vector<std::pair<std::size_t, std::size_t> > runs;
+    for (std::size_t i = 0, j = 1; i < nframes; i = j++) {
+      while (j < nframes && index[j] == index[j - 1] + 1) {
+        j++;
+      }
+      runs.push_back(std::make_pair(i, j - i));
+    }
+    std::vector<std::vector<hsize_t> > starts, counts;
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+      std::vector<hsize_t> start(dataset_dims.size(), 0), count(dataset_dims);
+      start[0] = index[runs[r].first];
+      count[0] = runs[r].second;
+      starts.push_back(start);
+      counts.push_back(count);
+    }
+
+    // Read the stored chunks directly if we can
+    std::vector<ChunkedRead> reads;
+    reads.reserve(runs.size());
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+      reads.push_back(ChunkedRead(dataset_id, starts[r], counts[r]));
+      if (!reads.back().is_supported<T>() || !reads.back().fetch()) {
+        reads.clear();
+        break;
+      }
+    }
+    if (!reads.empty()) {
+      dxtbx::boost_python::scoped_gil_release release_gil;
+      for (std::size_t r = 0; r < runs.size(); ++r) {
+        reads[r].assemble(out + runs[r].first * frame_size);
+      }
+      return;
+    }
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+      h5d_read_hyperslab(
+        dataset_id, starts[r], counts[r], out + runs[r].first * frame_size);
+    }
+  }
+
+  /**
+   * Read whole frames, the slices along the first dimension of a dataset,
+   * into one stack
+   * @param dataset_id The dataset
+   * @param frames A sequence of frame indices, such as a list or range
+   * @returns The frames, with the shape of the dataset but for the first
+   * dimension, which is the number of frames
+   */
+  template <typename T>
+  inline scitbx::af::versa<T, scitbx::af::flex_grid<> > dataset_frames_as_flex(
+    hid_t dataset_id,
+    boost::python::object frames) {
+    std::vector<hsize_t> dataset_dims;
+    std::vector<hsize_t> index = parse_frames(dataset_id, frames, dataset_dims);
+
+    // Create the stack
+    scitbx::af::flex_grid<>::index_type dims(dataset_dims.size());
+    dims[0] = index.size();
+    for (std::size_t i = 1; i < dataset_dims.size(); ++i) {
+      dims[i] = dataset_dims[i];
+    }
+    scitbx::af::versa<T, scitbx::af::flex_grid<> > data(
+      (scitbx::af::flex_grid<>(dims)), scitbx::af::init_functor_null<T>());
+
+    read_frames(dataset_id, index, dataset_dims, data.begin());
     return data;
   }
 
+  /**
+   * Read whole frames into an existing flex array, which must have as many
+   * elements as the frames. Its shape is left as it is.
+   */
+  template <typename T>
+  inline void dataset_frames_into_flex(
+    hid_t dataset_id,
+    boost::python::object frames,
+    scitbx::af::versa<T, scitbx::af::flex_grid<> > data) {
+    std::vector<hsize_t> dataset_dims;
+    std::vector<hsize_t> index = parse_frames(dataset_id, frames, dataset_dims);
+    std::size_t size = index.size();
+    for (std::size_t i = 1; i < dataset_dims.size(); ++i) {
+      size *= dataset_dims[i];
+    }
+    DXTBX_ASSERT(data.size() == size);
+    read_frames(dataset_id, index, dataset_dims, data.begin());
+  }
+
+  /**
+   * Read the frames of a dataset that is still being written, from a file
+   * opened in SWMR (single writer, multiple reader) mode. Each refresh picks
+   * up the frames that the writer has flushed since the last one. A frame
+   * counts as complete once every chunk it touches has been written, and
+   * frames are given out in order, each only once.
+   *
+   * The file must have been written with SWMR, and so in the HDF5 1.10 file
+   * format. The dataset is read through the same machinery as
+   * dataset_frames_as_flex.
+   */
+  template <typename T>
+  class FrameStream {
+  public:
+    /**
+     * Open the dataset
+     * @param filename The HDF5 file path
+     * @param dataset The path of the dataset in the file
+     */
+    FrameStream(const std::string &filename, const std::string &dataset)
+        : dataset_path_(dataset), file_(-1), dataset_(-1), complete_(0), position_(0) {
+#if H5_VERSION_GE(1, 10, 0)
+      file_ =
+        H5Fopen(filename.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT);
+#endif
+      if (file_ < 0) {
+        throw DXTBX_ERROR("Unable to open " + filename + " for SWMR reading");
+      }
+      dataset_ = H5Dopen2(file_, dataset.c_str(), H5P_DEFAULT);
+      if (dataset_ < 0) {
+        close();
+        throw DXTBX_ERROR("Unable to open " + dataset + " in " + filename);
+      }
+      refresh();
+    }
+
+    ~FrameStream() {
+      close();
+    }
+
+    /**
+     * Pick up the frames written since the last refresh
+     * @returns The number of complete frames
+     */
+    std::size_t refresh() {
+#if H5_VERSION_GE(1, 10, 0)
+      if (H5Drefresh(dataset_) < 0) {
+        throw DXTBX_ERROR("Unable to refresh " + dataset_path_);
+      }
+#endif
+      hid_t space = H5Dget_space(dataset_);
+      int rank = H5Sget_simple_extent_ndims(space);
+      dims_.resize(std::max(rank, 0));
+      if (rank > 0) {
+        H5Sget_simple_extent_dims(space, &dims_[0], NULL);
+      }
+      H5Sclose(space);
+      DXTBX_ASSERT(rank > 0);
+
+      // Frames are written in order, so stop at the first one not complete
+      std::vector<hsize_t> start(dims_.size(), 0), count(dims_);
+      count[0] = 1;
+      while (complete_ < dims_[0]) {
+        start[0] = complete_;
+        if (!hyperslab_written(dataset_, start, count)) {
+          break;
+        }
+        complete_++;
+      }
+      return complete_;
+    }
+
+    /**
+     * @returns The number of complete frames at the last refresh
+     */
+    std::size_t size() const {
+      return complete_;
+    }
+
+    /**
+     * @returns The index of the next frame to give out
+     */
+    std::size_t position() const {
+      return position_;
+    }
+
+    /**
+     * Set the index of the next frame to give out
+     */
+    void seek(std::size_t position) {
+      position_ = position;
+    }
+
+    /**
+     * Refresh until there are frames after the position. The GIL is
+     * released while waiting, and the wait stops for any signal raised.
+     * @param timeout The longest time to wait in seconds
+     * @param interval The time between refreshes in seconds
+     * @returns The number of frames waiting, which is zero on timeout
+     */
+    std::size_t wait(double timeout, double interval) {
+      typedef std::chrono::steady_clock clock;
+      const clock::time_point deadline =
+        clock::now()
+        + std::chrono::duration_cast<clock::duration>(
+          std::chrono::duration<double>(timeout));
+      while (refresh() <= position_) {
+        if (clock::now() >= deadline) {
+          return 0;
+        }
+        {
+          dxtbx::boost_python::scoped_gil_release release_gil;
+          std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+        }
+        if (PyErr_CheckSignals() != 0) {
+          boost::python::throw_error_already_set();
+        }
+      }
+      return complete_ - position_;
+    }
+
+    /**
+     * Give out the frames after the position that were complete at the last
+     * refresh, and move past them
+     * @param max_frames The most frames to give out, or zero for all
+     * @returns The frames, which may be none, as one stack
+     */
+    scitbx::af::versa<T, scitbx::af::flex_grid<> > next(std::size_t max_frames) {
+      std::size_t n = complete_ > position_ ? complete_ - position_ : 0;
+      if (max_frames > 0) {
+        n = std::min(n, max_frames);
+      }
+      std::vector<hsize_t> index(n);
+      for (std::size_t i = 0; i < n; ++i) {
+        index[i] = position_ + i;
+      }
+      scitbx::af::versa<T, scitbx::af::flex_grid<> > data(
+        (scitbx::af::flex_grid<>(stack_dims(n))), scitbx::af::init_functor_null<T>());
+      if (n > 0) {
+        read_frames(dataset_, index, dims_, data.begin());
+      }
+      position_ += n;
+      return data;
+    }
+
+    /**
+     * Read a complete frame, without moving the position
+     * @param index The frame index
+     * @returns The frame
+     */
+    scitbx::af::versa<T, scitbx::af::flex_grid<> > read(std::size_t index) {
+      DXTBX_ASSERT(index < complete_);
+      scitbx::af::versa<T, scitbx::af::flex_grid<> > data(
+        (scitbx::af::flex_grid<>(stack_dims(1))), scitbx::af::init_functor_null<T>());
+      read_frames(dataset_, std::vector<hsize_t>(1, index), dims_, data.begin());
+      return data;
+    }
+
+  private:
+    FrameStream(const FrameStream &);
+    FrameStream &operator=(const FrameStream &);
+
+    scitbx::af::flex_grid<>::index_type stack_dims(std::size_t n) const {
+      scitbx::af::flex_grid<>::index_type dims(dims_.size());
+      dims[0] = n;
+      for (std::size_t i = 1; i < dims_.size(); ++i) {
+        dims[i] = dims_[i];
+      }
+      return dims;
+    }
+
+    void close() {
+      if (dataset_ >= 0) {
+        H5Dclose(dataset_);
+        dataset_ = -1;
+      }
+      if (file_ >= 0) {
+        H5Fclose(file_);
+        file_ = -1;
+      }
+    }
+
+    std::string dataset_path_;
+    hid_t file_;
+    hid_t dataset_;
+    std::vector<hsize_t> dims_;
+    std::size_t complete_;
+    std::size_t position_;
+  };
+
+  template <typename T>
+  void export_dataset_functions(const char *suffix) {
+    std::string name(suffix);
+    def(("dataset_as_flex_" + name).c_str(), &dataset_as_flex<T>);
+    def(("dataset_into_flex_" + name).c_str(), &dataset_into_flex<T>);
+    def(("dataset_frames_as_flex_" + name).c_str(), &dataset_frames_as_flex<T>);
+    def(("dataset_frames_into_flex_" + name).c_str(), &dataset_frames_into_flex<T>);
+  }
+
+  template <typename T>
+  void export_frame_stream(const char *name) {
+    class_<FrameStream<T>, boost::noncopyable>(
+      name, init<const std::string &, const std::string &>())
+      .def("refresh", &FrameStream<T>::refresh)
+      .def("position", &FrameStream<T>::position)
+      .def("seek", &FrameStream<T>::seek)
+      .def("wait", &FrameStream<T>::wait, (arg("timeout"), arg("interval") = 0.001))
+      .def("next", &FrameStream<T>::next, (arg("max_frames") = 0))
+      .def("read", &FrameStream<T>::read)
+      .def("__len__", &FrameStream<T>::size);
+  }
+
   BOOST_PYTHON_MODULE(dxtbx_format_nexus_ext) {
-    def("dataset_as_flex_int", &dataset_as_flex<int>);
-    def("dataset_as_flex_double", &dataset_as_flex<double>);
-    def("dataset_as_flex_float", &dataset_as_flex<float>);
+    export_dataset_functions<int>("int");
+    export_dataset_functions<double>("double");
+    export_dataset_functions<float>("float");
+    export_dataset_functions<std::uint8_t>("uint8");
+    export_dataset_functions<std::uint16_t>("uint16");
+    export_dataset_functions<std::uint32_t>("uint32");
+
+    export_frame_stream<int>("FrameStreamInt");
+    export_frame_stream<double>("FrameStreamDouble");
+    export_frame_stream<float>("FrameStreamFloat");
+    export_frame_stream<std::uint8_t>("FrameStreamUInt8");
+    export_frame_stream<std::uint16_t>("FrameStreamUInt16");
+    export_frame_stream<std::uint32_t>("FrameStreamUInt32");
   }
 
 }}}  // namespace dxtbx::format::boost_python
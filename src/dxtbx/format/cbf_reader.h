@@ -0,0 +1,225 @@
+/*
+ * cbf_reader.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_CBF_READER_H
+#define DXTBX_FORMAT_CBF_READER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dxtbx/error.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/instrumentation.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/format/image_reader.h>
+#include <dxtbx/format/mapped_image.h>
+#include <dxtbx/boost_python/compression.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+
+namespace dxtbx { namespace format {
+
+  namespace detail {
+
+    /**
+     * The binary section header of a CBF image, as parsed by
+     * FormatCBF._parse_cbf_header
+     */
+    struct CBFBinaryHeader {
+      std::size_t fast;
+      std::size_t slow;
+      std::size_t length;
+      std::size_t size;
+      bool byte_offset;
+      bool no_compression;
+
+      CBFBinaryHeader()
+          : fast(0),
+            slow(0),
+            length(0),
+            size(0),
+            byte_offset(false),
+            no_compression(false) {}
+    };
+
+    inline bool starts_with(const std::string &record, const char *prefix) {
+      return record.compare(0, std::strlen(prefix), prefix) == 0;
+    }
+
+    /**
+     * @returns The last whitespace separated field of a record as a number
+     */
+    inline std::size_t last_field_as_size(const std::string &record) {
+      std::size_t end = record.find_last_not_of(" \t\r");
+      DXTBX_ASSERT(end != std::string::npos);
+      std::size_t begin = record.find_last_of(" \t", end);
+      begin = begin == std::string::npos ? 0 : begin + 1;
+      return (std::size_t)std::strtoull(
+        record.substr(begin, end + 1 - begin).c_str(), NULL, 10);
+    }
+
+    inline CBFBinaryHeader parse_cbf_binary_header(const char *data,
+                                                   std::size_t size) {
+      CBFBinaryHeader header;
+      std::size_t begin = 0;
+      while (begin < size) {
+        const char *newline =
+          (const char *)std::memchr(data + begin, '\n', size - begin);
+        std::size_t end = newline == NULL ? size : newline - data;
+        std::string record(data + begin, end - begin);
+        if (starts_with(record, "X-Binary-Size-Fastest-Dimension:")) {
+          header.fast = last_field_as_size(record);
+        } else if (starts_with(record, "X-Binary-Size-Second-Dimension:")) {
+          header.slow = last_field_as_size(record);
+        } else if (starts_with(record, "X-Binary-Number-of-Elements:")) {
+          header.length = last_field_as_size(record);
+        } else if (starts_with(record, "X-Binary-Size:")) {
+          header.size = last_field_as_size(record);
+        } else if (record.find("conversions") != std::string::npos) {
+          if (record.find("x-CBF_BYTE_OFFSET") != std::string::npos) {
+            header.byte_offset = true;
+          } else if (record.find("x-CBF_NONE") != std::string::npos) {
+            header.no_compression = true;
+          }
+        }
+        begin = end + 1;
+      }
+      DXTBX_ASSERT(header.length == header.fast * header.slow);
+      return header;
+    }
+
+    /**
+     * Decode the image in a memory mapped CBF file
+     * @param file The mapped file
+     * @param header_text If not NULL, set to the text before the binary data
+     * @param stats The statistics to record the decompression in, or NULL
+     * @returns The pixels
+     */
+    inline scitbx::af::versa<int, scitbx::af::c_grid<2> > decode_cbf_image(
+      const MappedFile &file,
+      std::string *header_text,
+      ReadStatistics *stats) {
+      static const char start_tag[] = {'\x0c', '\x1a', '\x04', '\xd5'};
+
+      const char *begin = file.data();
+      const char *end = begin + file.size();
+      const char *tag = std::search(begin, end, start_tag, start_tag + 4);
+      if (tag == end) {
+        throw DXTBX_ERROR("No binary section in " + file.path());
+      }
+      CBFBinaryHeader header = parse_cbf_binary_header(begin, tag - begin);
+      if (header_text != NULL) {
+        header_text->assign(begin, tag);
+      }
+      const char *packed = tag + 4;
+      const std::size_t available = end - packed;
+
+      scitbx::af::versa<int, scitbx::af::c_grid<2> > data(
+        scitbx::af::c_grid<2>(header.slow, header.fast),
+        scitbx::af::init_functor_null<int>());
+      ScopedStageTimer timer(stats, ReadStatistics::DECOMPRESS);
+      if (header.byte_offset) {
+        DXTBX_ASSERT(header.size <= available);
+        std::size_t n = boost_python::cbf_decompress(
+          packed, header.size, data.begin(), header.length);
+        DXTBX_ASSERT(n == header.length);
+      } else if (header.no_compression) {
+        DXTBX_ASSERT(header.length * sizeof(std::int32_t) <= available);
+        int *out = data.begin();
+        bool swap = host_is_big_endian();
+        for (std::size_t i = 0; i < header.length; ++i) {
+          std::int32_t value;
+          std::memcpy(&value, packed + i * sizeof(value), sizeof(value));
+          out[i] = swap ? byte_swapped(value) : value;
+        }
+      } else {
+        throw DXTBX_ERROR("Compression of type other than byte_offset or none is "
+                          "not supported in "
+                          + file.path());
+      }
+      return data;
+    }
+
+  }  // namespace detail
+
+  /**
+   * The header and pixels of a CBF file read by read_cbf_images
+   */
+  struct CBFImageData {
+    std::string header;
+    scitbx::af::versa<int, scitbx::af::c_grid<2> > data;
+  };
+
+  /**
+   * Read a list of single image CBF files, memory mapping each and
+   * decoding them in parallel. No Python objects are touched, so this may
+   * be called with the GIL released.
+   * @param paths The file paths
+   * @param nthreads The number of threads, zero for the default
+   * @returns The header text and pixels of each file, in order
+   */
+  inline std::vector<CBFImageData> read_cbf_images(
+    const std::vector<std::string> &paths,
+    std::size_t nthreads = 0) {
+    std::vector<CBFImageData> result(paths.size());
+    parallel_for(paths.size(), nthreads, [&](std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; ++i) {
+        MappedFile file(paths[i]);
+        result[i].data = detail::decode_cbf_image(file, &result[i].header, NULL);
+      }
+    });
+    return result;
+  }
+
+  /**
+   * Read single image CBF files, as written by Pilatus and Eiger detectors,
+   * with byte offset compressed or uncompressed 32 bit integer pixels. The
+   * file is memory mapped and decompressed straight into the image.
+   */
+  class CBFByteOffsetReader : public ImageReader {
+  public:
+    /**
+     * Construct the reader
+     * @param paths The file paths, one image per file
+     */
+    explicit CBFByteOffsetReader(const std::vector<std::string> &paths)
+        : paths_(paths) {}
+
+    std::size_t size() const {
+      return paths_.size();
+    }
+
+    ImageBuffer read(std::size_t index) const {
+      return read_with_statistics(index, NULL);
+    }
+
+    ImageBuffer read_with_statistics(std::size_t index, ReadStatistics *stats) const {
+      DXTBX_ASSERT(index < size());
+      MappedFile file(paths_[index]);
+      scitbx::af::versa<int, scitbx::af::c_grid<2> > data =
+        detail::decode_cbf_image(file, NULL, stats);
+      return ImageBuffer(Image<int>(ImageTile<int>(data)));
+    }
+
+    /**
+     * @returns The file paths
+     */
+    const std::vector<std::string> &paths() const {
+      return paths_;
+    }
+
+  private:
+    std::vector<std::string> paths_;
+  };
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_CBF_READER_H
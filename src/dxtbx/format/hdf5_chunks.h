@@ -0,0 +1,418 @@
+/*
+ * hdf5_chunks.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_HDF5_CHUNKS_H
+#define DXTBX_FORMAT_HDF5_CHUNKS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <hdf5.h>
+
+#include <dxtbx/error.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/format/bitshuffle_lz4.h>
+#include <dxtbx/format/mapped_image.h>
+#include <dxtbx/format/pixel_conversion.h>
+
+// H5Dread_chunk, which reads a chunk as it is stored, first appeared in 1.10.3
+#if H5_VERSION_GE(1, 10, 3)
+#define DXTBX_HDF5_DIRECT_CHUNK_READ
+#endif
+
+namespace dxtbx { namespace format {
+
+  namespace detail {
+
+    /**
+     * @returns The offsets of the chunks that a hyperslab touches, with the
+     * last dimension fastest
+     */
+    inline std::vector<std::vector<hsize_t> > chunk_offsets(
+      const std::vector<hsize_t> &start,
+      const std::vector<hsize_t> &count,
+      const std::vector<hsize_t> &chunk_dims) {
+      const std::size_t rank = start.size();
+      std::vector<hsize_t> first(rank), last(rank);
+      for (std::size_t i = 0; i < rank; ++i) {
+        DXTBX_ASSERT(count[i] > 0);
+        first[i] = start[i] / chunk_dims[i];
+        last[i] = (start[i] + count[i] - 1) / chunk_dims[i];
+      }
+      std::vector<std::vector<hsize_t> > offsets;
+      std::vector<hsize_t> index = first;
+      for (;;) {
+        std::vector<hsize_t> offset(rank);
+        for (std::size_t i = 0; i < rank; ++i) {
+          offset[i] = index[i] * chunk_dims[i];
+        }
+        offsets.push_back(offset);
+
+        std::size_t dim = rank;
+        while (dim > 0 && index[dim - 1] == last[dim - 1]) {
+          index[dim - 1] = first[dim - 1];
+          dim--;
+        }
+        if (dim == 0) {
+          break;
+        }
+        index[dim - 1]++;
+      }
+      return offsets;
+    }
+
+#ifdef DXTBX_HDF5_DIRECT_CHUNK_READ
+    /**
+     * @returns The stored size of a chunk in bytes, or zero if it has not
+     * been written
+     */
+    inline hsize_t chunk_storage_size(hid_t dataset,
+                                      const std::vector<hsize_t> &offset) {
+      hsize_t nbytes = 0;
+      herr_t status;
+      H5E_BEGIN_TRY {
+        status = H5Dget_chunk_storage_size(dataset, &offset[0], &nbytes);
+      }
+      H5E_END_TRY;
+      return status < 0 ? 0 : nbytes;
+    }
+#endif
+
+  }  // namespace detail
+
+  /**
+   * Check that every chunk a hyperslab touches has been written, as for a
+   * dataset that is still being written. Datasets that are not chunked, and
+   * any dataset with HDF5 older than 1.10.3, count as written.
+   * @param dataset The dataset
+   * @param start The start of the selection in each dimension
+   * @param count The size of the selection in each dimension
+   */
+  inline bool hyperslab_written(hid_t dataset,
+                                const std::vector<hsize_t> &start,
+                                const std::vector<hsize_t> &count) {
+#ifdef DXTBX_HDF5_DIRECT_CHUNK_READ
+    hid_t plist = H5Dget_create_plist(dataset);
+    DXTBX_ASSERT(plist >= 0);
+    std::vector<hsize_t> chunk_dims(start.size());
+    bool chunked = H5Pget_layout(plist) == H5D_CHUNKED
+                   && H5Pget_chunk(plist, (int)start.size(), &chunk_dims[0])
+                        == (int)start.size();
+    H5Pclose(plist);
+    if (!chunked) {
+      return true;
+    }
+    std::vector<std::vector<hsize_t> > offsets =
+      detail::chunk_offsets(start, count, chunk_dims);
+    for (std::size_t c = 0; c < offsets.size(); ++c) {
+      if (detail::chunk_storage_size(dataset, offsets[c]) == 0) {
+        return false;
+      }
+    }
+#endif
+    return true;
+  }
+
+  /**
+   * A read of a hyperslab of a chunked HDF5 dataset which bypasses the HDF5
+   * filter pipeline. The chunks that the selection touches are read as they
+   * are stored with H5Dread_chunk, which is quick since it does no work,
+   * and are then decompressed and copied into place over several threads
+   * without calling into HDF5 at all.
+   *
+   * Only datasets with no filters, or with just the bitshuffle filter with
+   * LZ4 compression, and with integer or floating point pixels in the byte
+   * order of the host can be read this way. The caller should check
+   * is_supported, and fall back to H5Dread if it is false or fetch fails.
+   */
+  class ChunkedRead {
+  public:
+    /**
+     * Plan the read of a hyperslab
+     * @param dataset The dataset
+     * @param start The start of the selection in each dimension
+     * @param count The size of the selection in each dimension
+     */
+    ChunkedRead(hid_t dataset,
+                const std::vector<hsize_t> &start,
+                const std::vector<hsize_t> &count)
+        : dataset_(dataset),
+          start_(start),
+          count_(count),
+          supported_(false),
+          source_type_(INT8),
+          compression_(NONE),
+          elem_size_(0) {
+      DXTBX_ASSERT(start.size() == count.size());
+#ifdef DXTBX_HDF5_DIRECT_CHUNK_READ
+      supported_ = check_layout() && check_type();
+#endif
+    }
+
+    /**
+     * @returns Can the selection be read into an array of type T. Floating
+     * point data is only read into a type at least as wide, and never into
+     * an integer type, since those conversions are left to HDF5.
+     */
+    template <typename T>
+    bool is_supported() const {
+      if (!supported_) {
+        return false;
+      }
+      if (source_type_ == FLOAT32 || source_type_ == FLOAT64) {
+        return std::is_floating_point<T>::value && elem_size_ <= sizeof(T);
+      }
+      return true;
+    }
+
+    /**
+     * Read the stored chunks. This calls HDF5, so must be done under the
+     * same lock as any other HDF5 call.
+     * @returns False if a chunk has not been written, so that the read
+     * must go through H5Dread to get the fill value
+     */
+    bool fetch() {
+      DXTBX_ASSERT(supported_);
+      chunks_.clear();
+#ifdef DXTBX_HDF5_DIRECT_CHUNK_READ
+      std::vector<std::vector<hsize_t> > offsets =
+        detail::chunk_offsets(start_, count_, chunk_dims_);
+      for (std::size_t c = 0; c < offsets.size(); ++c) {
+        Chunk chunk;
+        chunk.offset = offsets[c];
+        hsize_t nbytes = detail::chunk_storage_size(dataset_, chunk.offset);
+        if (nbytes == 0) {
+          chunks_.clear();
+          return false;
+        }
+        chunk.data.resize(nbytes);
+        std::uint32_t filter_mask = 0;
+        herr_t status = H5Dread_chunk(
+          dataset_, H5P_DEFAULT, &chunk.offset[0], &filter_mask, &chunk.data[0]);
+        if (status < 0) {
+          chunks_.clear();
+          throw DXTBX_ERROR("Unable to read chunk");
+        }
+        chunk.compressed = compression_ != NONE && (filter_mask & 1) == 0;
+        chunks_.push_back(chunk);
+      }
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    /**
+     * Decompress the chunks and copy the selection into an array. This does
+     * not call HDF5, so may be done without any lock.
+     * @param out The array, with the shape of the selection in C order
+     * @param nthreads The number of threads, or zero for the default
+     */
+    template <typename T>
+    void assemble(T *out, std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(is_supported<T>());
+      switch (source_type_) {
+      case INT8:
+        assemble_as<std::int8_t>(out, nthreads);
+        break;
+      case UINT8:
+        assemble_as<std::uint8_t>(out, nthreads);
+        break;
+      case INT16:
+        assemble_as<std::int16_t>(out, nthreads);
+        break;
+      case UINT16:
+        assemble_as<std::uint16_t>(out, nthreads);
+        break;
+      case INT32:
+        assemble_as<std::int32_t>(out, nthreads);
+        break;
+      case UINT32:
+        assemble_as<std::uint32_t>(out, nthreads);
+        break;
+      case INT64:
+        assemble_as<std::int64_t>(out, nthreads);
+        break;
+      case UINT64:
+        assemble_as<std::uint64_t>(out, nthreads);
+        break;
+      case FLOAT32:
+        assemble_as<float>(out, nthreads);
+        break;
+      case FLOAT64:
+        assemble_as<double>(out, nthreads);
+        break;
+      }
+    }
+
+  private:
+    enum source_type {
+      INT8,
+      UINT8,
+      INT16,
+      UINT16,
+      INT32,
+      UINT32,
+      INT64,
+      UINT64,
+      FLOAT32,
+      FLOAT64
+    };
+
+    enum compression_type { NONE, BITSHUFFLE_LZ4 };
+
+    struct Chunk {
+      std::vector<hsize_t> offset;
+      std::vector<unsigned char> data;
+      bool compressed;
+    };
+
+    bool check_layout() {
+      const std::size_t rank = start_.size();
+      hid_t space = H5Dget_space(dataset_);
+      bool valid = space >= 0 && rank > 0
+                   && H5Sget_simple_extent_ndims(space) == (int)rank;
+      if (space >= 0) {
+        H5Sclose(space);
+      }
+      hid_t plist = valid ? H5Dget_create_plist(dataset_) : -1;
+      if (plist < 0) {
+        return false;
+      }
+
+      chunk_dims_.resize(rank);
+      valid = H5Pget_layout(plist) == H5D_CHUNKED
+              && H5Pget_chunk(plist, (int)rank, &chunk_dims_[0]) == (int)rank;
+      int nfilters = valid ? H5Pget_nfilters(plist) : -1;
+      if (nfilters == 0) {
+        compression_ = NONE;
+      } else if (nfilters == 1) {
+        unsigned int flags = 0;
+        std::size_t nvalues = 8;
+        unsigned int values[8];
+        H5Z_filter_t filter =
+          H5Pget_filter2(plist, 0, &flags, &nvalues, values, 0, NULL, NULL);
+        valid = filter == BITSHUFFLE_FILTER_ID && nvalues > 4
+                && values[4] == BITSHUFFLE_COMPRESS_LZ4
+                && !detail::host_is_big_endian();
+        compression_ = BITSHUFFLE_LZ4;
+      } else {
+        valid = false;
+      }
+      H5Pclose(plist);
+      return valid;
+    }
+
+    bool check_type() {
+      static const struct {
+        hid_t type;
+        source_type source;
+      } types[] = {{H5T_NATIVE_INT8, INT8},
+                   {H5T_NATIVE_UINT8, UINT8},
+                   {H5T_NATIVE_INT16, INT16},
+                   {H5T_NATIVE_UINT16, UINT16},
+                   {H5T_NATIVE_INT32, INT32},
+                   {H5T_NATIVE_UINT32, UINT32},
+                   {H5T_NATIVE_INT64, INT64},
+                   {H5T_NATIVE_UINT64, UINT64},
+                   {H5T_NATIVE_FLOAT, FLOAT32},
+                   {H5T_NATIVE_DOUBLE, FLOAT64}};
+      hid_t type = H5Dget_type(dataset_);
+      if (type < 0) {
+        return false;
+      }
+      bool valid = false;
+      for (std::size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+        if (H5Tequal(type, types[i].type) > 0) {
+          source_type_ = types[i].source;
+          elem_size_ = H5Tget_size(type);
+          valid = true;
+          break;
+        }
+      }
+      H5Tclose(type);
+      return valid;
+    }
+
+    template <typename Source, typename T>
+    void assemble_as(T *out, std::size_t nthreads) const {
+      DXTBX_ASSERT(sizeof(Source) == elem_size_);
+      const std::size_t rank = start_.size();
+      std::size_t chunk_size = 1;
+      for (std::size_t i = 0; i < rank; ++i) {
+        chunk_size *= chunk_dims_[i];
+      }
+
+      parallel_for(chunks_.size(), nthreads, [&](std::size_t begin, std::size_t end) {
+        std::vector<Source> scratch;
+        std::vector<hsize_t> lo(rank), hi(rank), index(rank);
+        for (std::size_t c = begin; c < end; ++c) {
+          const Chunk &chunk = chunks_[c];
+          const Source *data;
+          if (chunk.compressed) {
+            scratch.resize(chunk_size);
+            bitshuffle_lz4_decompress(&chunk.data[0],
+                                      chunk.data.size(),
+                                      (unsigned char *)&scratch[0],
+                                      chunk_size * sizeof(Source),
+                                      sizeof(Source));
+            data = &scratch[0];
+          } else {
+            if (chunk.data.size() != chunk_size * sizeof(Source)) {
+              throw DXTBX_ERROR("Unexpected chunk size");
+            }
+            data = (const Source *)&chunk.data[0];
+          }
+
+          // The part of the selection in this chunk, in dataset coordinates
+          for (std::size_t i = 0; i < rank; ++i) {
+            lo[i] = std::max(chunk.offset[i], start_[i]);
+            hi[i] = std::min(chunk.offset[i] + chunk_dims_[i], start_[i] + count_[i]);
+          }
+
+          // Copy it a run along the last dimension at a time
+          const std::size_t run = hi[rank - 1] - lo[rank - 1];
+          index = lo;
+          for (;;) {
+            std::size_t src = 0, dst = 0;
+            for (std::size_t i = 0; i < rank; ++i) {
+              src = src * chunk_dims_[i] + (index[i] - chunk.offset[i]);
+              dst = dst * count_[i] + (index[i] - start_[i]);
+            }
+            detail::convert_clamped(
+              data + src, run, out + dst, detail::needs_clamp<Source, T>());
+
+            std::size_t dim = rank - 1;
+            while (dim > 0 && index[dim - 1] + 1 == hi[dim - 1]) {
+              index[dim - 1] = lo[dim - 1];
+              dim--;
+            }
+            if (dim == 0) {
+              break;
+            }
+            index[dim - 1]++;
+          }
+        }
+      });
+    }
+
+    hid_t dataset_;
+    std::vector<hsize_t> start_;
+    std::vector<hsize_t> count_;
+    std::vector<hsize_t> chunk_dims_;
+    bool supported_;
+    source_type source_type_;
+    compression_type compression_;
+    std::size_t elem_size_;
+    std::vector<Chunk> chunks_;
+  };
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_HDF5_CHUNKS_H
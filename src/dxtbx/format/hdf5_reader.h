@@ -0,0 +1,199 @@
+/*
+ * hdf5_reader.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_HDF5_READER_H
+#define DXTBX_FORMAT_HDF5_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <hdf5.h>
+
+#include <dxtbx/error.h>
+#include <dxtbx/format/hdf5_chunks.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/format/image_reader.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+
+namespace dxtbx { namespace format {
+
+  /**
+   * Read images from a three dimensional (image, slow, fast) HDF5 dataset,
+   * such as the data of a NeXus NXdetector. Unsigned 16 and 8 bit data is
+   * kept in its own type, other integer data is read as int and floating
+   * point data as float or double, as with dataset_as_flex.
+   *
+   * The file is kept open for the lifetime of the reader. HDF5 calls from
+   * all readers are serialised by a single lock, since the library may not
+   * be built thread safe. Where the dataset allows, the stored chunks are
+   * read under the lock and decompressed outside it, so that readers on
+   * several threads decompress at the same time. Any HDF5 access from
+   * Python on other threads, such as through h5py, is outside that lock and
+   * needs a thread safe library.
+   */
+  class HDF5ImageReader : public ImageReader {
+  public:
+    /**
+     * Open the dataset
+     * @param filename The HDF5 file path
+     * @param dataset The path of the dataset in the file
+     */
+    HDF5ImageReader(const std::string &filename, const std::string &dataset)
+        : filename_(filename), dataset_path_(dataset), file_(-1), dataset_(-1) {
+      std::lock_guard<std::mutex> lock(hdf5_mutex());
+      file_ = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+      if (file_ < 0) {
+        throw DXTBX_ERROR("Unable to open " + filename);
+      }
+      dataset_ = H5Dopen2(file_, dataset.c_str(), H5P_DEFAULT);
+      if (dataset_ < 0) {
+        close();
+        throw DXTBX_ERROR("Unable to open " + dataset + " in " + filename);
+      }
+
+      hid_t space = H5Dget_space(dataset_);
+      int rank = H5Sget_simple_extent_ndims(space);
+      if (rank == 3) {
+        H5Sget_simple_extent_dims(space, dims_, NULL);
+      }
+      H5Sclose(space);
+
+      hid_t type = H5Dget_type(dataset_);
+      H5T_class_t type_class = H5Tget_class(type);
+      std::size_t type_size = H5Tget_size(type);
+      bool is_unsigned = type_class == H5T_INTEGER && H5Tget_sign(type) == H5T_SGN_NONE;
+      H5Tclose(type);
+
+      if (rank != 3) {
+        close();
+        throw DXTBX_ERROR("Expected a three dimensional dataset " + dataset);
+      }
+      if (type_class == H5T_INTEGER && is_unsigned && type_size == 1) {
+        native_type_ = UINT8;
+      } else if (type_class == H5T_INTEGER && is_unsigned && type_size == 2) {
+        native_type_ = UINT16;
+      } else if (type_class == H5T_INTEGER) {
+        native_type_ = INT;
+      } else if (type_class == H5T_FLOAT) {
+        native_type_ = type_size <= sizeof(float) ? FLOAT : DOUBLE;
+      } else {
+        close();
+        throw DXTBX_ERROR("Unsupported data type in " + dataset);
+      }
+    }
+
+    ~HDF5ImageReader() {
+      std::lock_guard<std::mutex> lock(hdf5_mutex());
+      close();
+    }
+
+    std::size_t size() const {
+      return (std::size_t)dims_[0];
+    }
+
+    ImageBuffer read(std::size_t index) const {
+      DXTBX_ASSERT(index < size());
+      switch (native_type_) {
+      case INT:
+        return ImageBuffer(Image<int>(read_frame<int>(index, H5T_NATIVE_INT)));
+      case FLOAT:
+        return ImageBuffer(Image<float>(read_frame<float>(index, H5T_NATIVE_FLOAT)));
+      case UINT16:
+        return ImageBuffer(
+          Image<std::uint16_t>(read_frame<std::uint16_t>(index, H5T_NATIVE_UINT16)));
+      case UINT8:
+        return ImageBuffer(
+          Image<std::uint8_t>(read_frame<std::uint8_t>(index, H5T_NATIVE_UINT8)));
+      default:
+        return ImageBuffer(
+          Image<double>(read_frame<double>(index, H5T_NATIVE_DOUBLE)));
+      }
+    }
+
+    /**
+     * @returns The file path
+     */
+    std::string filename() const {
+      return filename_;
+    }
+
+    /**
+     * @returns The dataset path
+     */
+    std::string dataset() const {
+      return dataset_path_;
+    }
+
+  private:
+    enum data_type { INT, FLOAT, DOUBLE, UINT16, UINT8 };
+
+    HDF5ImageReader(const HDF5ImageReader &);
+    HDF5ImageReader &operator=(const HDF5ImageReader &);
+
+    static std::mutex &hdf5_mutex() {
+      static std::mutex mutex;
+      return mutex;
+    }
+
+    void close() {
+      if (dataset_ >= 0) {
+        H5Dclose(dataset_);
+        dataset_ = -1;
+      }
+      if (file_ >= 0) {
+        H5Fclose(file_);
+        file_ = -1;
+      }
+    }
+
+    template <typename T>
+    ImageTile<T> read_frame(std::size_t index, hid_t mem_type) const {
+      scitbx::af::versa<T, scitbx::af::c_grid<2> > data(
+        scitbx::af::c_grid<2>(dims_[1], dims_[2]),
+        scitbx::af::init_functor_null<T>());
+
+      std::unique_lock<std::mutex> lock(hdf5_mutex());
+      hsize_t start[3] = {(hsize_t)index, 0, 0};
+      hsize_t count[3] = {1, dims_[1], dims_[2]};
+      ChunkedRead direct(dataset_,
+                         std::vector<hsize_t>(start, start + 3),
+                         std::vector<hsize_t>(count, count + 3));
+      if (direct.is_supported<T>() && direct.fetch()) {
+        lock.unlock();
+        direct.assemble(data.begin(), 1);
+        return ImageTile<T>(data);
+      }
+
+      hid_t file_space = H5Dget_space(dataset_);
+      herr_t status = H5Sselect_hyperslab(
+        file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+      hid_t mem_space = H5Screate_simple(2, &count[1], NULL);
+      if (status >= 0) {
+        status =
+          H5Dread(dataset_, mem_type, mem_space, file_space, H5P_DEFAULT, data.begin());
+      }
+      H5Sclose(mem_space);
+      H5Sclose(file_space);
+      if (status < 0) {
+        throw DXTBX_ERROR("Unable to read image from " + dataset_path_);
+      }
+      return ImageTile<T>(data);
+    }
+
+    std::string filename_;
+    std::string dataset_path_;
+    hid_t file_;
+    hid_t dataset_;
+    hsize_t dims_[3];
+    data_type native_type_;
+  };
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_HDF5_READER_H
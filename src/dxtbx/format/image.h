@@ -13,9 +13,13 @@
 
 #include <vector>
 #include <algorithm>
+#include <cstdint>
 #include <boost/variant.hpp>
 
 #include <dxtbx/error.h>
+#include <dxtbx/format/image_arena.h>
+#include <dxtbx/format/mapped_image.h>
+#include <dxtbx/format/pixel_conversion.h>
 #include <scitbx/array_family/tiny.h>
 #include <scitbx/array_family/versa.h>
 #include <scitbx/array_family/shared.h>
@@ -70,13 +74,22 @@ namespace dxtbx { namespace format {
       return data_.accessor();
     }
 
+    /**
+     * Get a pointer to the first pixel, without copying the array handle
+     */
+    const T *begin() const {
+      return data_.begin();
+    }
+
   protected:
     array_type data_;
     std::string name_;
   };
 
   /**
-   * An image containing data from all detector panels
+   * An image containing data from all detector panels. The tiles are
+   * normally separate arrays, but an image made with allocate keeps them
+   * back to back in one arena, so that it can be seen as a single block.
    */
   template <typename T>
   class Image {
@@ -99,6 +112,30 @@ namespace dxtbx { namespace format {
       tiles_.push_back(tile);
     }
 
+    /**
+     * Allocate an image with all tiles in one arena from a pool. The pixels
+     * are not initialised, and the tiles cannot be grown.
+     * @param grids The size of each tile
+     * @param pool The pool to take the arena from
+     * @returns The image
+     */
+    static Image<T> allocate(const std::vector<scitbx::af::c_grid<2> > &grids,
+                             ImageArenaPool &pool = ImageArenaPool::global()) {
+      std::size_t nbytes = 0;
+      for (std::size_t i = 0; i < grids.size(); ++i) {
+        nbytes += grids[i].size_1d() * sizeof(T);
+      }
+      Image<T> result;
+      result.arena_ = pool.acquire(nbytes);
+      std::size_t offset = 0;
+      for (std::size_t i = 0; i < grids.size(); ++i) {
+        result.tiles_.push_back(
+          ImageTile<T>(detail::arena_array<T>(result.arena_, offset, grids[i])));
+        offset += grids[i].size_1d() * sizeof(T);
+      }
+      return result;
+    }
+
     /**
      * Add a tile
      */
@@ -125,6 +162,14 @@ namespace dxtbx { namespace format {
       return tiles_[index];
     }
 
+    /**
+     * Get a reference to an image tile, without copying the array handle
+     */
+    const ImageTile<T> &tile_ref(std::size_t index) const {
+      DXTBX_ASSERT(index < n_tiles());
+      return tiles_[index];
+    }
+
     /**
      * Get the number of tiles
      */
@@ -139,6 +184,58 @@ namespace dxtbx { namespace format {
       return tiles_.empty();
     }
 
+    /**
+     * Get the size of the data in all tiles in bytes
+     */
+    std::size_t nbytes() const {
+      std::size_t result = 0;
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        result += tiles_[i].data().size() * sizeof(T);
+      }
+      return result;
+    }
+
+    /**
+     * Are the tiles all the same size and back to back in one arena
+     */
+    bool is_contiguous() const {
+      if (!arena_ || tiles_.empty()) {
+        return false;
+      }
+      const T *next = (const T *)arena_.get();
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        if (tiles_[i].begin() != next
+            || !tiles_[i].accessor().all_eq(tiles_[0].accessor())) {
+          return false;
+        }
+        next += tiles_[i].accessor().size_1d();
+      }
+      return true;
+    }
+
+    /**
+     * Get the image as one (n_tiles, slow, fast) array. For a contiguous
+     * image this is a view sharing its memory, otherwise the tiles, which
+     * must all be the same size, are copied.
+     */
+    scitbx::af::versa<T, scitbx::af::c_grid<3> > as_block() const {
+      DXTBX_ASSERT(!tiles_.empty());
+      scitbx::af::c_grid<2> grid = tiles_[0].accessor();
+      scitbx::af::c_grid<3> block_grid(tiles_.size(), grid[0], grid[1]);
+      if (is_contiguous()) {
+        return detail::arena_array<T>(arena_, 0, block_grid);
+      }
+      scitbx::af::versa<T, scitbx::af::c_grid<3> > result(
+        block_grid, scitbx::af::init_functor_null<T>());
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        DXTBX_ASSERT(tiles_[i].accessor().all_eq(grid));
+        std::copy(tiles_[i].begin(),
+                  tiles_[i].begin() + grid.size_1d(),
+                  result.begin() + i * grid.size_1d());
+      }
+      return result;
+    }
+
     /**
      * Get the begin iterator
      */
@@ -155,10 +252,14 @@ namespace dxtbx { namespace format {
 
   protected:
     scitbx::af::shared<ImageTile<T> > tiles_;
+    ImageArenaPool::arena_type arena_;
   };
 
   /**
-   * A class to hold image data which can be either int, float, or double
+   * A class to hold image data which can be either int, float, or double, or
+   * a memory mapped image which is converted when one of those is requested.
+   * Unsigned 16 and 8 bit data can be held in its own type, at a half or a
+   * quarter of the memory, and is only widened when converted.
    */
   class ImageBuffer {
   public:
@@ -166,15 +267,24 @@ namespace dxtbx { namespace format {
     typedef Image<int> int_image_type;
     typedef Image<float> float_image_type;
     typedef Image<double> double_image_type;
+    typedef MappedImage mapped_image_type;
+    typedef Image<std::uint16_t> uint16_image_type;
+    typedef Image<std::uint8_t> uint8_image_type;
 
     // The variant type
-    typedef boost::
-      variant<empty_type, int_image_type, float_image_type, double_image_type>
-        variant_type;
+    typedef boost::variant<empty_type,
+                           int_image_type,
+                           float_image_type,
+                           double_image_type,
+                           mapped_image_type,
+                           uint16_image_type,
+                           uint8_image_type>
+      variant_type;
 
     /**
      * A visitor class to convert from/to different types.
-     * Data is copied except when the to/from types are the same
+     * Data is copied except when the to/from types are the same, when the
+     * existing tiles are returned
      */
     template <typename ImageType>
     class ConverterVisitor : public boost::static_visitor<ImageType> {
@@ -188,22 +298,81 @@ namespace dxtbx { namespace format {
         return v;
       }
 
+      ImageType operator()(const mapped_image_type &v) const {
+        typedef typename ImageType::data_type data_type;
+        return ImageType(typename ImageType::tile_type(v.as_array<data_type>()));
+      }
+
       template <typename OtherImageType>
       ImageType operator()(const OtherImageType &v) const {
-        ImageType result;
+        std::vector<scitbx::af::c_grid<2> > grids;
+        for (std::size_t i = 0; i < v.n_tiles(); ++i) {
+          grids.push_back(v.tile_ref(i).accessor());
+        }
+        ImageType result = ImageType::allocate(grids);
         for (std::size_t i = 0; i < v.n_tiles(); ++i) {
-          typedef typename ImageType::tile_type ImageTileType;
-          typedef typename ImageType::array_type ArrayType;
-          ArrayType data(
-            v.tile(i).accessor(),
-            scitbx::af::init_functor_null<typename ArrayType::value_type>());
-          std::transform(v.tile(i).data().begin(),
-                         v.tile(i).data().end(),
-                         data.begin(),
-                         [](typename OtherImageType::data_type a) {
-                           return static_cast<typename ImageType::data_type>(a);
-                         });
-          result.push_back(ImageTileType(data));
+          const typename OtherImageType::tile_type &tile = v.tile_ref(i);
+          detail::convert_pixels(
+            tile.begin(), grids[i].size_1d(), result.tile_ref(i).data().begin());
+        }
+        return result;
+      }
+    };
+
+    /**
+     * A visitor class to convert the data into caller supplied memory, one
+     * pointer per tile. No array handles are copied, so it may be applied
+     * with the GIL released.
+     */
+    template <typename T>
+    class CopyToVisitor : public boost::static_visitor<void> {
+    public:
+      CopyToVisitor(const std::vector<T *> &out) : out_(out) {}
+
+      void operator()(const empty_type &) const {
+        throw DXTBX_ERROR("ImageBuffer is empty");
+      }
+
+      void operator()(const mapped_image_type &v) const {
+        DXTBX_ASSERT(out_.size() == 1);
+        v.copy_to(out_[0]);
+      }
+
+      template <typename OtherImageType>
+      void operator()(const OtherImageType &v) const {
+        DXTBX_ASSERT(out_.size() == v.n_tiles());
+        for (std::size_t i = 0; i < v.n_tiles(); ++i) {
+          const typename OtherImageType::tile_type &tile = v.tile_ref(i);
+          if ((const void *)tile.begin() != (const void *)out_[i]) {
+            detail::convert_pixels(tile.begin(), tile.accessor().size_1d(), out_[i]);
+          }
+        }
+      }
+
+    private:
+      const std::vector<T *> &out_;
+    };
+
+    /**
+     * Get the size of each tile
+     */
+    class AccessorsVisitor
+        : public boost::static_visitor<std::vector<scitbx::af::c_grid<2> > > {
+    public:
+      std::vector<scitbx::af::c_grid<2> > operator()(const empty_type &) const {
+        return std::vector<scitbx::af::c_grid<2> >();
+      }
+
+      std::vector<scitbx::af::c_grid<2> > operator()(
+        const mapped_image_type &v) const {
+        return std::vector<scitbx::af::c_grid<2> >(1, v.accessor());
+      }
+
+      template <typename OtherImageType>
+      std::vector<scitbx::af::c_grid<2> > operator()(const OtherImageType &v) const {
+        std::vector<scitbx::af::c_grid<2> > result;
+        for (std::size_t i = 0; i < v.n_tiles(); ++i) {
+          result.push_back(v.tile_ref(i).accessor());
         }
         return result;
       }
@@ -269,6 +438,66 @@ namespace dxtbx { namespace format {
       }
     };
 
+    /**
+     * Is the data an unsigned 16 bit type
+     */
+    class IsUInt16Visitor : public boost::static_visitor<bool> {
+    public:
+      bool operator()(const uint16_image_type &v) const {
+        return true;
+      }
+
+      template <typename OtherImageType>
+      bool operator()(const OtherImageType &v) const {
+        return false;
+      }
+    };
+
+    /**
+     * Is the data an unsigned 8 bit type
+     */
+    class IsUInt8Visitor : public boost::static_visitor<bool> {
+    public:
+      bool operator()(const uint8_image_type &v) const {
+        return true;
+      }
+
+      template <typename OtherImageType>
+      bool operator()(const OtherImageType &v) const {
+        return false;
+      }
+    };
+
+    /**
+     * Is the data a memory mapped image
+     */
+    class IsMappedVisitor : public boost::static_visitor<bool> {
+    public:
+      bool operator()(const mapped_image_type &v) const {
+        return true;
+      }
+
+      template <typename OtherImageType>
+      bool operator()(const OtherImageType &v) const {
+        return false;
+      }
+    };
+
+    /**
+     * The memory held by the image data in bytes
+     */
+    class NBytesVisitor : public boost::static_visitor<std::size_t> {
+    public:
+      std::size_t operator()(const empty_type &v) const {
+        return 0;
+      }
+
+      template <typename OtherImageType>
+      std::size_t operator()(const OtherImageType &v) const {
+        return v.nbytes();
+      }
+    };
+
     /**
      * Construct an empty buffer
      */
@@ -307,6 +536,52 @@ namespace dxtbx { namespace format {
       return boost::apply_visitor(IsDoubleVisitor(), data_);
     }
 
+    /**
+     * @returns Is the buffer an unsigned 16 bit image
+     */
+    bool is_uint16() const {
+      return boost::apply_visitor(IsUInt16Visitor(), data_);
+    }
+
+    /**
+     * @returns Is the buffer an unsigned 8 bit image
+     */
+    bool is_uint8() const {
+      return boost::apply_visitor(IsUInt8Visitor(), data_);
+    }
+
+    /**
+     * @returns Is the buffer a memory mapped image
+     */
+    bool is_mapped() const {
+      return boost::apply_visitor(IsMappedVisitor(), data_);
+    }
+
+    /**
+     * @returns The memory mapped image
+     */
+    MappedImage as_mapped() const {
+      const MappedImage *mapped = boost::get<MappedImage>(&data_);
+      if (mapped == NULL) {
+        throw DXTBX_ERROR("ImageBuffer is not memory mapped");
+      }
+      return *mapped;
+    }
+
+    /**
+     * @returns The size of the image data in bytes
+     */
+    std::size_t nbytes() const {
+      return boost::apply_visitor(NBytesVisitor(), data_);
+    }
+
+    /**
+     * @returns The size of each tile
+     */
+    std::vector<scitbx::af::c_grid<2> > tile_accessors() const {
+      return boost::apply_visitor(AccessorsVisitor(), data_);
+    }
+
     /**
      * @returns The buffer as an int image
      */
@@ -328,6 +603,67 @@ namespace dxtbx { namespace format {
       return boost::apply_visitor(ConverterVisitor<Image<double> >(), data_);
     }
 
+    /**
+     * @returns The buffer as an unsigned 16 bit image
+     */
+    Image<std::uint16_t> as_uint16() const {
+      return boost::apply_visitor(ConverterVisitor<Image<std::uint16_t> >(), data_);
+    }
+
+    /**
+     * @returns The buffer as an unsigned 8 bit image
+     */
+    Image<std::uint8_t> as_uint8() const {
+      return boost::apply_visitor(ConverterVisitor<Image<std::uint8_t> >(), data_);
+    }
+
+    /**
+     * @returns The buffer as an image of the requested type
+     */
+    template <typename T>
+    Image<T> as_type() const {
+      return boost::apply_visitor(ConverterVisitor<Image<T> >(), data_);
+    }
+
+    /**
+     * Convert the data into caller supplied memory, saving the allocation
+     * that as_type makes. Nothing is copied if the memory is the buffer's
+     * own. Safe to call with the GIL released, provided no other thread
+     * changes the buffer.
+     * @param out A pointer for each tile to room for its pixels
+     */
+    template <typename T>
+    void copy_to(const std::vector<T *> &out) const {
+      boost::apply_visitor(CopyToVisitor<T>(out), data_);
+    }
+
+    /**
+     * Convert the data into an existing image with tiles of the same sizes
+     * @param out The image to write to
+     */
+    template <typename T>
+    void copy_to(Image<T> &out) const {
+      std::vector<scitbx::af::c_grid<2> > grids = tile_accessors();
+      DXTBX_ASSERT(out.n_tiles() == grids.size());
+      std::vector<T *> pointers;
+      for (std::size_t i = 0; i < grids.size(); ++i) {
+        ImageTile<T> tile = out.tile(i);
+        DXTBX_ASSERT(tile.accessor().all_eq(grids[i]));
+        pointers.push_back(tile.data().begin());
+      }
+      copy_to(pointers);
+    }
+
+    /**
+     * Apply a visitor to the data as whichever type it is held in
+     * @param visitor The boost::static_visitor
+     * @returns The result of the visitor
+     */
+    template <typename Visitor>
+    typename Visitor::result_type apply_visitor(const Visitor &visitor) const {
+      return boost::apply_visitor(visitor, data_);
+    }
+
   protected:
     variant_type data_;
   };
@@ -9,11 +9,16 @@ except ModuleNotFoundError:
 
 
 __all__ = (  # noqa: F405
+    "CBFByteOffsetReader",
+    "HDF5ImageReader",
     "ImageBool",
     "ImageBuffer",
     "ImageDouble",
     "ImageInt",
+    "ImageReader",
     "ImageTileBool",
     "ImageTileDouble",
     "ImageTileInt",
+    "MappedImage",
+    "RawImageReader",
 )
@@ -0,0 +1,280 @@
+/*
+ * image_arena.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_IMAGE_ARENA_H
+#define DXTBX_FORMAT_IMAGE_ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+#include <dxtbx/error.h>
+#include <scitbx/array_family/shared_plain.h>
+#include <scitbx/array_family/versa.h>
+
+namespace dxtbx { namespace format {
+
+  /**
+   * A pool of arenas, the single allocations that hold every tile of a
+   * contiguous image. When the last array using an arena goes away the
+   * arena is handed back to the pool, so reading a run of frames of the
+   * same size reuses the same few allocations rather than making one per
+   * tile per frame.
+   *
+   * The pool may be used from several threads. Arenas released after the
+   * pool is destroyed are simply freed.
+   *
+   * The tiles made from an arena are views of it, so like numpy-backed
+   * flex arrays they cannot be grown; resizing one past its size raises.
+   */
+  class ImageArenaPool {
+  public:
+    typedef std::shared_ptr<char> arena_type;
+
+    /** The default most memory to keep in free arenas, in bytes */
+    static const std::size_t default_max_bytes = 32 * 1024 * 1024;
+
+    /**
+     * @param max_bytes The most memory to keep in free arenas
+     */
+    explicit ImageArenaPool(std::size_t max_bytes = default_max_bytes)
+        : state_(std::make_shared<State>(max_bytes)) {}
+
+    ~ImageArenaPool() {
+      clear();
+    }
+
+    /**
+     * The pool used by Image::allocate by default. Each extension module
+     * which allocates images makes its own, which keeps at most
+     * environment_max_bytes() bytes of free arenas.
+     */
+    static ImageArenaPool &global() {
+      static ImageArenaPool pool(environment_max_bytes());
+      return pool;
+    }
+
+    /**
+     * @returns The size in bytes from the environment variable
+     * DXTBX_IMAGE_ARENA_MAX_BYTES, where 0 keeps no free arenas, or
+     * default_max_bytes if it is unset or not a number
+     */
+    static std::size_t environment_max_bytes() {
+      const char *value = std::getenv("DXTBX_IMAGE_ARENA_MAX_BYTES");
+      if (value == NULL) {
+        return default_max_bytes;
+      }
+      char *end = NULL;
+      unsigned long long nbytes = std::strtoull(value, &end, 10);
+      return end != value && *end == '\0' && value[0] != '-' ? nbytes
+                                                              : default_max_bytes;
+    }
+
+    /**
+     * Get an arena, reusing a free one of the same size if there is one.
+     * The memory is not initialised.
+     * @param nbytes The size of the arena in bytes
+     * @returns The arena
+     */
+    arena_type acquire(std::size_t nbytes) {
+      char *data = NULL;
+      {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        std::multimap<std::size_t, char *>::iterator it = state_->free.find(nbytes);
+        if (it != state_->free.end()) {
+          data = it->second;
+          state_->free.erase(it);
+          state_->free_bytes -= nbytes;
+          state_->hits++;
+        } else {
+          state_->misses++;
+        }
+      }
+      if (data == NULL) {
+        data = static_cast<char *>(::operator new(nbytes > 0 ? nbytes : 1));
+      }
+      return arena_type(data, Release(state_, nbytes));
+    }
+
+    /**
+     * @returns The memory held in free arenas in bytes
+     */
+    std::size_t free_bytes() const {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      return state_->free_bytes;
+    }
+
+    /**
+     * @returns The most memory kept in free arenas in bytes
+     */
+    std::size_t max_bytes() const {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      return state_->max_bytes;
+    }
+
+    /**
+     * Set the most memory kept in free arenas, freeing any over the limit
+     * @param max_bytes The size in bytes
+     */
+    void set_max_bytes(std::size_t max_bytes) {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      state_->max_bytes = max_bytes;
+      state_->trim();
+    }
+
+    /**
+     * @returns The number of arenas that were reused
+     */
+    std::size_t hits() const {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      return state_->hits;
+    }
+
+    /**
+     * @returns The number of arenas that had to be allocated
+     */
+    std::size_t misses() const {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      return state_->misses;
+    }
+
+    /**
+     * Free all the free arenas
+     */
+    void clear() {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      std::size_t max_bytes = state_->max_bytes;
+      state_->max_bytes = 0;
+      state_->trim();
+      state_->max_bytes = max_bytes;
+    }
+
+  private:
+    ImageArenaPool(const ImageArenaPool &);
+    ImageArenaPool &operator=(const ImageArenaPool &);
+
+    struct State {
+      std::mutex mutex;
+      std::multimap<std::size_t, char *> free;
+      std::size_t free_bytes;
+      std::size_t max_bytes;
+      std::size_t hits;
+      std::size_t misses;
+
+      explicit State(std::size_t max_bytes_)
+          : free_bytes(0), max_bytes(max_bytes_), hits(0), misses(0) {}
+
+      ~State() {
+        max_bytes = 0;
+        trim();
+      }
+
+      // Free the largest arenas until the free memory is within the limit
+      void trim() {
+        while (free_bytes > max_bytes && !free.empty()) {
+          std::multimap<std::size_t, char *>::iterator last = --free.end();
+          free_bytes -= last->first;
+          ::operator delete(last->second);
+          free.erase(last);
+        }
+      }
+    };
+
+    // Hands an arena back to the pool, if it still exists
+    struct Release {
+      std::weak_ptr<State> state;
+      std::size_t nbytes;
+
+      Release(std::shared_ptr<State> state_, std::size_t nbytes_)
+          : state(state_), nbytes(nbytes_) {}
+
+      void operator()(char *data) const {
+        std::shared_ptr<State> pool = state.lock();
+        if (pool) {
+          std::lock_guard<std::mutex> lock(pool->mutex);
+          if (nbytes <= pool->max_bytes) {
+            pool->free.insert(std::make_pair(nbytes, data));
+            pool->free_bytes += nbytes;
+            pool->trim();
+            return;
+          }
+        }
+        ::operator delete(data);
+      }
+    };
+
+    std::shared_ptr<State> state_;
+  };
+
+  namespace detail {
+
+    /**
+     * An array family sharing handle onto part of an arena. The arena is
+     * kept alive for as long as the handle, as numpy_sharing_handle does
+     * for numpy memory in flumpy. The memory belongs to the arena, so the
+     * array cannot be grown.
+     */
+    class arena_sharing_handle : public scitbx::af::sharing_handle {
+    public:
+      arena_sharing_handle(ImageArenaPool::arena_type arena,
+                           std::size_t offset,
+                           std::size_t nbytes)
+          : arena_(arena) {
+        size = capacity = nbytes;
+        data = arena_.get() + offset;
+      }
+
+      virtual ~arena_sharing_handle() {
+        deallocate();
+      }
+
+      virtual void deallocate() {
+        arena_.reset();
+        size = capacity = 0;
+        data = NULL;
+      }
+
+      virtual void swap(scitbx::af::sharing_handle &other) {
+        arena_sharing_handle *other_arena =
+          dynamic_cast<arena_sharing_handle *>(&other);
+        if (other_arena == NULL) {
+          throw std::invalid_argument("Cannot resize an array in an image arena");
+        }
+        std::swap(other_arena->arena_, arena_);
+        scitbx::af::sharing_handle::swap(other);
+      }
+
+    private:
+      ImageArenaPool::arena_type arena_;
+    };
+
+    /**
+     * Make an array that is a view onto part of an arena
+     * @param arena The arena
+     * @param offset The offset of the array in the arena in bytes
+     * @param accessor The array accessor
+     */
+    template <typename T, typename Accessor>
+    scitbx::af::versa<T, Accessor> arena_array(ImageArenaPool::arena_type arena,
+                                               std::size_t offset,
+                                               const Accessor &accessor) {
+      arena_sharing_handle *handle =
+        new arena_sharing_handle(arena, offset, accessor.size_1d() * sizeof(T));
+      scitbx::af::versa<T, Accessor> result(handle, accessor);
+      // The array now holds its own reference to the handle
+      handle->use_count--;
+      return result;
+    }
+
+  }  // namespace detail
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_IMAGE_ARENA_H
@@ -0,0 +1,161 @@
+/*
+ * image_reader.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_IMAGE_READER_H
+#define DXTBX_FORMAT_IMAGE_READER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <dxtbx/error.h>
+#include <dxtbx/instrumentation.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/format/mapped_image.h>
+#include <scitbx/array_family/tiny_types.h>
+
+namespace dxtbx { namespace format {
+
+  /**
+   * An image reader implemented in C++, which an ImageSetData can call in
+   * place of the Python reader of the format class.
+   *
+   * Implementations must not touch Python objects, so that images can be
+   * read with the GIL released, and read must be safe to call from several
+   * threads at once.
+   */
+  class ImageReader {
+  public:
+    virtual ~ImageReader() {}
+
+    /**
+     * @returns The number of images
+     */
+    virtual std::size_t size() const = 0;
+
+    /**
+     * Read an image
+     * @param index The image index
+     * @returns The image data
+     */
+    virtual ImageBuffer read(std::size_t index) const = 0;
+
+    /**
+     * Read an image, adding the times of the stages inside the reader, such
+     * as decompression, to the statistics
+     * @param index The image index
+     * @param stats The statistics, which may be NULL
+     * @returns The image data
+     */
+    virtual ImageBuffer read_with_statistics(std::size_t index,
+                                             ReadStatistics *stats) const {
+      return read(index);
+    }
+  };
+
+  /**
+   * Read raw pixels at a fixed offset in each file, for formats with a fixed
+   * size header. Each file holds one or more images stored back to back, and
+   * the images are returned as memory mapped views.
+   */
+  class RawImageReader : public ImageReader {
+  public:
+    /**
+     * Construct the reader
+     * @param paths The file paths
+     * @param offset The offset of the first image in each file in bytes
+     * @param dtype The pixel type name, e.g. "uint16" or "float32"
+     * @param big_endian Whether the pixel data is stored big endian
+     * @param shape The image size as (slow, fast)
+     * @param images_per_file The number of images in each file
+     */
+    RawImageReader(const std::vector<std::string> &paths,
+                   std::size_t offset,
+                   const std::string &dtype,
+                   bool big_endian,
+                   scitbx::af::int2 shape,
+                   std::size_t images_per_file = 1)
+        : paths_(paths),
+          offset_(offset),
+          dtype_(dtype),
+          big_endian_(big_endian),
+          shape_(shape),
+          images_per_file_(images_per_file) {
+      DXTBX_ASSERT(images_per_file_ > 0);
+    }
+
+    std::size_t size() const {
+      return paths_.size() * images_per_file_;
+    }
+
+    ImageBuffer read(std::size_t index) const {
+      DXTBX_ASSERT(index < size());
+      MappedImage first(paths_[index / images_per_file_],
+                        offset_,
+                        dtype_,
+                        big_endian_,
+                        shape_);
+      std::size_t frame = index % images_per_file_;
+      if (frame == 0) {
+        return ImageBuffer(first);
+      }
+      return ImageBuffer(first.at_offset(offset_ + frame * first.nbytes()));
+    }
+
+    /**
+     * @returns The file paths
+     */
+    const std::vector<std::string> &paths() const {
+      return paths_;
+    }
+
+    /**
+     * @returns The offset of the first image in each file in bytes
+     */
+    std::size_t offset() const {
+      return offset_;
+    }
+
+    /**
+     * @returns The pixel type name
+     */
+    std::string dtype() const {
+      return dtype_;
+    }
+
+    /**
+     * @returns Is the pixel data big endian
+     */
+    bool is_big_endian() const {
+      return big_endian_;
+    }
+
+    /**
+     * @returns The image size as (slow, fast)
+     */
+    scitbx::af::int2 shape() const {
+      return shape_;
+    }
+
+    /**
+     * @returns The number of images in each file
+     */
+    std::size_t images_per_file() const {
+      return images_per_file_;
+    }
+
+  private:
+    std::vector<std::string> paths_;
+    std::size_t offset_;
+    std::string dtype_;
+    bool big_endian_;
+    scitbx::af::int2 shape_;
+    std::size_t images_per_file_;
+  };
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_IMAGE_READER_H
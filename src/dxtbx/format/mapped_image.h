@@ -0,0 +1,476 @@
+/*
+ * mapped_image.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_MAPPED_IMAGE_H
+#define DXTBX_FORMAT_MAPPED_IMAGE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <dxtbx/error.h>
+#include <dxtbx/format/pixel_conversion.h>
+#include <scitbx/array_family/tiny_types.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+
+namespace dxtbx { namespace format {
+
+  /**
+   * A read-only memory mapping of a whole file. The mapping is released
+   * when the object is destroyed, so it is normally held by a shared_ptr
+   * which every view onto the file keeps a copy of.
+   */
+  class MappedFile {
+  public:
+    /**
+     * Map the file
+     * @param path The file path
+     * @param copy_on_write Map the pages privately and writable, so that
+     *                      writes go to copies of them and never the file
+     */
+    explicit MappedFile(const std::string &path, bool copy_on_write = false)
+        : path_(path), data_(NULL), size_(0), copy_on_write_(copy_on_write) {
+#ifdef _WIN32
+      HANDLE file = CreateFileA(path.c_str(),
+                                GENERIC_READ,
+                                FILE_SHARE_READ,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+      if (file == INVALID_HANDLE_VALUE) {
+        throw DXTBX_ERROR("Unable to open " + path);
+      }
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw DXTBX_ERROR("Unable to get the size of " + path);
+      }
+      size_ = (std::size_t)size.QuadPart;
+      if (size_ > 0) {
+        HANDLE mapping = CreateFileMappingA(
+          file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+          data_ = (const char *)MapViewOfFile(
+            mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+          CloseHandle(mapping);
+        }
+      }
+      CloseHandle(file);
+#else
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw DXTBX_ERROR("Unable to open " + path);
+      }
+      struct stat info;
+      if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw DXTBX_ERROR("Unable to get the size of " + path);
+      }
+      size_ = (std::size_t)info.st_size;
+      if (size_ > 0) {
+        void *ptr = copy_on_write
+                      ? ::mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                      : ::mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED) {
+          data_ = (const char *)ptr;
+        }
+      }
+      ::close(fd);
+#endif
+      if (size_ > 0 && data_ == NULL) {
+        throw DXTBX_ERROR("Unable to memory map " + path);
+      }
+    }
+
+    ~MappedFile() {
+      if (data_ != NULL) {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        ::munmap((void *)data_, size_);
+#endif
+      }
+    }
+
+    /**
+     * @returns The file path
+     */
+    const std::string &path() const {
+      return path_;
+    }
+
+    /**
+     * @returns A pointer to the start of the mapped file
+     */
+    const char *data() const {
+      return data_;
+    }
+
+    /**
+     * @returns The size of the file in bytes
+     */
+    std::size_t size() const {
+      return size_;
+    }
+
+    /**
+     * @returns Are the pages mapped privately and writable
+     */
+    bool copy_on_write() const {
+      return copy_on_write_;
+    }
+
+  private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    std::string path_;
+    const char *data_;
+    std::size_t size_;
+    bool copy_on_write_;
+  };
+
+  namespace detail {
+
+    inline bool host_is_big_endian() {
+      const std::uint16_t one = 1;
+      unsigned char first;
+      std::memcpy(&first, &one, 1);
+      return first == 0;
+    }
+
+    template <typename T>
+    inline T byte_swapped(T value) {
+      unsigned char bytes[sizeof(T)];
+      std::memcpy(bytes, &value, sizeof(T));
+      std::reverse(bytes, bytes + sizeof(T));
+      std::memcpy(&value, bytes, sizeof(T));
+      return value;
+    }
+
+    /**
+     * Whether a raw pixel value fits the requested type. Only unsigned
+     * 32 bit data can overflow an int.
+     */
+    template <typename T, typename Source>
+    struct pixel_in_range {
+      static bool check(Source) {
+        return true;
+      }
+    };
+
+    template <>
+    struct pixel_in_range<int, std::uint32_t> {
+      static bool check(std::uint32_t value) {
+        return value <= (std::uint32_t)std::numeric_limits<int>::max();
+      }
+    };
+
+  }  // namespace detail
+
+  /**
+   * A view onto a block of raw pixels at a fixed offset in a memory mapped
+   * file. Nothing is read until the data is requested as a particular type,
+   * and then the pixels are converted straight out of the mapped pages, so
+   * reading the same file again is served from the page cache.
+   */
+  class MappedImage {
+  public:
+    enum pixel_type { uint8, int16, uint16, int32, uint32, float32, float64 };
+
+    /**
+     * Map the image
+     * @param path The file path
+     * @param offset The offset of the pixel data in bytes
+     * @param dtype The pixel type name, e.g. "uint16" or "float32"
+     * @param big_endian Whether the pixel data is stored big endian
+     * @param shape The image size as (slow, fast)
+     */
+    MappedImage(const std::string &path,
+                std::size_t offset,
+                const std::string &dtype,
+                bool big_endian,
+                scitbx::af::int2 shape)
+        : file_(std::make_shared<MappedFile>(path)),
+          offset_(offset),
+          type_(pixel_type_from_name(dtype)),
+          big_endian_(big_endian),
+          grid_(checked_grid(shape)) {
+      check_bounds();
+    }
+
+    /**
+     * Construct a view onto an already mapped file
+     * @param file The mapped file
+     * @param offset The offset of the pixel data in bytes
+     * @param dtype The pixel type name
+     * @param big_endian Whether the pixel data is stored big endian
+     * @param shape The image size as (slow, fast)
+     */
+    MappedImage(std::shared_ptr<MappedFile> file,
+                std::size_t offset,
+                const std::string &dtype,
+                bool big_endian,
+                scitbx::af::int2 shape)
+        : file_(file),
+          offset_(offset),
+          type_(pixel_type_from_name(dtype)),
+          big_endian_(big_endian),
+          grid_(checked_grid(shape)) {
+      DXTBX_ASSERT(file_ != NULL);
+      check_bounds();
+    }
+
+    /**
+     * Get a view of the same shape and type at another offset, sharing the
+     * mapping. Useful for files holding a stack of frames.
+     * @param offset The offset of the pixel data in bytes
+     * @returns The new view
+     */
+    MappedImage at_offset(std::size_t offset) const {
+      MappedImage result(*this);
+      result.offset_ = offset;
+      result.check_bounds();
+      return result;
+    }
+
+    /**
+     * @returns The mapped file
+     */
+    std::shared_ptr<MappedFile> file() const {
+      return file_;
+    }
+
+    /**
+     * @returns The file path
+     */
+    std::string path() const {
+      return file_->path();
+    }
+
+    /**
+     * @returns The offset of the pixel data in bytes
+     */
+    std::size_t offset() const {
+      return offset_;
+    }
+
+    /**
+     * @returns The pixel type
+     */
+    pixel_type type() const {
+      return type_;
+    }
+
+    /**
+     * @returns The pixel type name
+     */
+    std::string dtype() const {
+      switch (type_) {
+      case uint8:
+        return "uint8";
+      case int16:
+        return "int16";
+      case uint16:
+        return "uint16";
+      case int32:
+        return "int32";
+      case uint32:
+        return "uint32";
+      case float32:
+        return "float32";
+      default:
+        return "float64";
+      }
+    }
+
+    /**
+     * @returns Is the pixel data big endian
+     */
+    bool is_big_endian() const {
+      return big_endian_;
+    }
+
+    /**
+     * @returns Is the pixel type an integer type
+     */
+    bool is_integer() const {
+      return type_ != float32 && type_ != float64;
+    }
+
+    /**
+     * @returns The image accessor
+     */
+    scitbx::af::c_grid<2> accessor() const {
+      return grid_;
+    }
+
+    /**
+     * @returns The number of pixels
+     */
+    std::size_t size() const {
+      return grid_.size_1d();
+    }
+
+    /**
+     * @returns The size of a single pixel in bytes
+     */
+    std::size_t element_size() const {
+      return element_size(type_);
+    }
+
+    /**
+     * @returns The size of the pixel data in bytes
+     */
+    std::size_t nbytes() const {
+      return size() * element_size();
+    }
+
+    /**
+     * @returns A pointer to the raw pixel data in the mapping
+     */
+    const char *data() const {
+      return file_->data() + offset_;
+    }
+
+    /**
+     * Convert the pixels into a buffer of the requested type
+     * @param out The output buffer, of at least size() elements
+     */
+    template <typename T>
+    void copy_to(T *out) const {
+      switch (type_) {
+      case uint8:
+        convert<std::uint8_t>(out);
+        break;
+      case int16:
+        convert<std::int16_t>(out);
+        break;
+      case uint16:
+        convert<std::uint16_t>(out);
+        break;
+      case int32:
+        convert<std::int32_t>(out);
+        break;
+      case uint32:
+        convert<std::uint32_t>(out);
+        break;
+      case float32:
+        convert<float>(out);
+        break;
+      default:
+        convert<double>(out);
+        break;
+      }
+    }
+
+    /**
+     * @returns The pixels converted to the requested type
+     */
+    template <typename T>
+    scitbx::af::versa<T, scitbx::af::c_grid<2> > as_array() const {
+      scitbx::af::versa<T, scitbx::af::c_grid<2> > result(
+        grid_, scitbx::af::init_functor_null<T>());
+      copy_to(result.begin());
+      return result;
+    }
+
+  private:
+    static pixel_type pixel_type_from_name(const std::string &name) {
+      if (name == "uint8") {
+        return uint8;
+      } else if (name == "int16") {
+        return int16;
+      } else if (name == "uint16") {
+        return uint16;
+      } else if (name == "int32") {
+        return int32;
+      } else if (name == "uint32") {
+        return uint32;
+      } else if (name == "float32") {
+        return float32;
+      } else if (name == "float64") {
+        return float64;
+      }
+      throw DXTBX_ERROR("Unknown pixel type " + name);
+    }
+
+    static std::size_t element_size(pixel_type type) {
+      switch (type) {
+      case uint8:
+        return 1;
+      case int16:
+      case uint16:
+        return 2;
+      case float64:
+        return 8;
+      default:
+        return 4;
+      }
+    }
+
+    static scitbx::af::c_grid<2> checked_grid(scitbx::af::int2 shape) {
+      DXTBX_ASSERT(shape[0] >= 0 && shape[1] >= 0);
+      return scitbx::af::c_grid<2>(shape[0], shape[1]);
+    }
+
+    void check_bounds() const {
+      if (offset_ > file_->size() || nbytes() > file_->size() - offset_) {
+        throw DXTBX_ERROR("Image data extends past the end of " + file_->path());
+      }
+    }
+
+    template <typename Source, typename T>
+    void convert(T *out) const {
+      const char *src = data();
+      const std::size_t n = size();
+      bool valid = true;
+      if (big_endian_ != detail::host_is_big_endian()) {
+        for (std::size_t i = 0; i < n; ++i) {
+          Source value;
+          std::memcpy(&value, src + i * sizeof(Source), sizeof(Source));
+          value = detail::byte_swapped(value);
+          valid &= detail::pixel_in_range<T, Source>::check(value);
+          out[i] = detail::clamped_cast<T>(value);
+        }
+      } else {
+        for (std::size_t i = 0; i < n; ++i) {
+          Source value;
+          std::memcpy(&value, src + i * sizeof(Source), sizeof(Source));
+          valid &= detail::pixel_in_range<T, Source>::check(value);
+          out[i] = detail::clamped_cast<T>(value);
+        }
+      }
+      DXTBX_ASSERT(valid);
+    }
+
+    std::shared_ptr<MappedFile> file_;
+    std::size_t offset_;
+    pixel_type type_;
+    bool big_endian_;
+    scitbx::af::c_grid<2> grid_;
+  };
+
+}}  // namespace dxtbx::format
+
+#endif  // DXTBX_FORMAT_MAPPED_IMAGE_H
@@ -30,15 +30,45 @@ from dxtbx.model import (
 try:
     try:
         from ..dxtbx_format_nexus_ext import (
+            FrameStreamDouble,
+            FrameStreamFloat,
+            FrameStreamInt,
+            FrameStreamUInt8,
+            FrameStreamUInt16,
+            FrameStreamUInt32,
             dataset_as_flex_double,
             dataset_as_flex_float,
             dataset_as_flex_int,
+            dataset_as_flex_uint8,
+            dataset_as_flex_uint16,
+            dataset_as_flex_uint32,
+            dataset_frames_as_flex_double,
+            dataset_frames_as_flex_float,
+            dataset_frames_as_flex_int,
+            dataset_frames_as_flex_uint8,
+            dataset_frames_as_flex_uint16,
+            dataset_frames_as_flex_uint32,
         )
     except ModuleNotFoundError:
         from dxtbx_format_nexus_ext import (  # type: ignore
+            FrameStreamDouble,
+            FrameStreamFloat,
+            FrameStreamInt,
+            FrameStreamUInt8,
+            FrameStreamUInt16,
+            FrameStreamUInt32,
             dataset_as_flex_double,
             dataset_as_flex_float,
             dataset_as_flex_int,
+            dataset_as_flex_uint8,
+            dataset_as_flex_uint16,
+            dataset_as_flex_uint32,
+            dataset_frames_as_flex_double,
+            dataset_frames_as_flex_float,
+            dataset_frames_as_flex_int,
+            dataset_frames_as_flex_uint8,
+            dataset_frames_as_flex_uint16,
+            dataset_frames_as_flex_uint32,
         )
 except ImportError:
     # Workaround for psana build, which doesn't link HDF5 properly
@@ -61,9 +91,68 @@ def h5str(h5_value: str | numpy.string_ | bytes) -> str:
     return h5_value
 
 
-def dataset_as_flex(dataset, selection):
-    if numpy.issubdtype(dataset.dtype, numpy.integer):
-        return dataset_as_flex_int(dataset.id.id, selection)
+def dataset_as_flex(dataset, selection, native=False):
+    """
+    Read a selection of a dataset into a flex array. Integer data is read as
+    flex.int, unless native is set and the data is unsigned 8, 16 or 32 bit,
+    in which case it is read as flex.uint8, flex.uint16 or flex.uint32.
+    """
+    return _flex_reader(
+        dataset,
+        native,
+        dataset_as_flex_int,
+        dataset_as_flex_float,
+        dataset_as_flex_double,
+        (dataset_as_flex_uint8, dataset_as_flex_uint16, dataset_as_flex_uint32),
+    )(dataset.id.id, selection)
+
+
+def dataset_frames_as_flex(dataset, frames, native=False):
+    """
+    Read whole frames of a dataset, such as a list or range of image indices,
+    into one flex array with the number of frames as its first dimension.
+    The type of the array is chosen as for dataset_as_flex.
+    """
+    return _flex_reader(
+        dataset,
+        native,
+        dataset_frames_as_flex_int,
+        dataset_frames_as_flex_float,
+        dataset_frames_as_flex_double,
+        (
+            dataset_frames_as_flex_uint8,
+            dataset_frames_as_flex_uint16,
+            dataset_frames_as_flex_uint32,
+        ),
+    )(dataset.id.id, frames)
+
+
+def frame_stream(filename, path, native=False):
+    """
+    Open a dataset that is still being written, in a file written in SWMR
+    mode, to read its frames as they are flushed. The type of the frames is
+    chosen as for dataset_as_flex.
+    """
+    with h5py.File(filename, "r", swmr=True) as handle:
+        stream_type = _flex_reader(
+            handle[path],
+            native,
+            FrameStreamInt,
+            FrameStreamFloat,
+            FrameStreamDouble,
+            (FrameStreamUInt8, FrameStreamUInt16, FrameStreamUInt32),
+        )
+    return stream_type(filename, path)
+
+
+def _flex_reader(
+    dataset, native, int_reader, float_reader, double_reader, uint_readers
+):
+    dtype = dataset.dtype
+    if native and dtype.kind == "u" and dtype.itemsize in (1, 2, 4):
+        return dict(zip((1, 2, 4), uint_readers))[dtype.itemsize]
+    elif numpy.issubdtype(dataset.dtype, numpy.integer):
+        return int_reader
     else:
         assert numpy.issubdtype(dataset.dtype, numpy.floating)
         double_types = [
@@ -82,9 +171,9 @@ def dataset_as_flex(dataset, selection):
             numpy.float16,
             numpy.float32,
         ]:
-            return dataset_as_flex_float(dataset.id.id, selection)
+            return float_reader
         elif dataset.dtype in double_types:
-            return dataset_as_flex_double(dataset.id.id, selection)
+            return double_reader
         else:
             assert False, "unknown floating data type (%s)" % str(dataset.dtype)
 
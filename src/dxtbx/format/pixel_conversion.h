@@ -0,0 +1,268 @@
+/*
+ * pixel_conversion.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_PIXEL_CONVERSION_H
+#define DXTBX_FORMAT_PIXEL_CONVERSION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+// Vectorised conversions are available on x86-64 (SSE2, which every x86-64
+// processor has) and little-endian aarch64 (NEON), for int to float and
+// double, float to double and unsigned 16 bit to int and float. Anything
+// else, and any other pair of types, uses the scalar loop.
+#if defined(__x86_64__) || defined(_M_X64)
+#define DXTBX_PIXEL_CONVERSION_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) \
+  && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define DXTBX_PIXEL_CONVERSION_NEON
+#include <arm_neon.h>
+#endif
+
+namespace dxtbx { namespace format { namespace detail {
+
+  /**
+   * Convert n pixels from one type to another, as static_cast does
+   * @param src The source pixels
+   * @param n The number of pixels
+   * @param dst The destination, which must not overlap the source
+   */
+  template <typename Source, typename T>
+  inline void convert_pixels(const Source *src, std::size_t n, T *dst) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<T>(src[i]);
+    }
+  }
+
+  template <typename T>
+  inline void convert_pixels(const T *src, std::size_t n, T *dst) {
+    std::copy(src, src + n, dst);
+  }
+
+#if defined(DXTBX_PIXEL_CONVERSION_SSE2)
+
+  inline void convert_pixels(const int *src, std::size_t n, float *dst) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+      _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(a));
+      _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(b));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const int *src, std::size_t n, double *dst) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_pd(dst + i, _mm_cvtepi32_pd(a));
+      _mm_storeu_pd(dst + i + 2, _mm_cvtepi32_pd(_mm_unpackhi_epi64(a, a)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<double>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const float *src, std::size_t n, double *dst) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128 a = _mm_loadu_ps(src + i);
+      _mm_storeu_pd(dst + i, _mm_cvtps_pd(a));
+      _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<double>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const std::uint16_t *src, std::size_t n, int *dst) {
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(a, zero));
+      _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(a, zero));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<int>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const std::uint16_t *src, std::size_t n, float *dst) {
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero)));
+      _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(a, zero)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i]);
+    }
+  }
+
+#elif defined(DXTBX_PIXEL_CONVERSION_NEON)
+
+  inline void convert_pixels(const int *src, std::size_t n, float *dst) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      vst1q_f32(dst + i, vcvtq_f32_s32(vld1q_s32(src + i)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const int *src, std::size_t n, double *dst) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      int32x4_t a = vld1q_s32(src + i);
+      vst1q_f64(dst + i, vcvtq_f64_s64(vmovl_s32(vget_low_s32(a))));
+      vst1q_f64(dst + i + 2, vcvtq_f64_s64(vmovl_high_s32(a)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<double>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const float *src, std::size_t n, double *dst) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t a = vld1q_f32(src + i);
+      vst1q_f64(dst + i, vcvt_f64_f32(vget_low_f32(a)));
+      vst1q_f64(dst + i + 2, vcvt_high_f64_f32(a));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<double>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const std::uint16_t *src, std::size_t n, int *dst) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      uint16x8_t a = vld1q_u16(src + i);
+      vst1q_s32(dst + i, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(a))));
+      vst1q_s32(dst + i + 4, vreinterpretq_s32_u32(vmovl_high_u16(a)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<int>(src[i]);
+    }
+  }
+
+  inline void convert_pixels(const std::uint16_t *src, std::size_t n, float *dst) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      uint16x8_t a = vld1q_u16(src + i);
+      vst1q_f32(dst + i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(a))));
+      vst1q_f32(dst + i + 4, vcvtq_f32_u32(vmovl_high_u16(a)));
+    }
+    for (; i < n; ++i) {
+      dst[i] = static_cast<float>(src[i]);
+    }
+  }
+
+#endif
+
+  /**
+   * Whether a Source value may not fit in T: an integer into a narrower
+   * integer type, or a floating point value into any integer type
+   */
+  template <typename Source, typename T>
+  struct needs_clamp
+      : std::integral_constant<
+          bool,
+          std::is_integral<T>::value
+            && (std::is_floating_point<Source>::value
+                || (std::is_integral<Source>::value
+                    && ((std::uintmax_t)std::numeric_limits<Source>::max()
+                          > (std::uintmax_t)std::numeric_limits<T>::max()
+                        || (std::intmax_t)std::numeric_limits<Source>::min()
+                             < (std::intmax_t)std::numeric_limits<T>::min())))> {};
+
+  template <typename T, typename Source>
+  inline T clamped_cast(Source value, std::false_type, std::false_type) {
+    return static_cast<T>(value);
+  }
+
+  template <typename T, typename Source>
+  inline T clamped_cast(Source value, std::false_type, std::true_type) {
+    return static_cast<T>(value);
+  }
+
+  template <typename T, typename Source>
+  inline T clamped_cast(Source value, std::true_type, std::false_type) {
+    typedef typename std::common_type<Source, T>::type wide_type;
+    const bool source_signed = std::numeric_limits<Source>::is_signed;
+    const bool dest_signed = std::numeric_limits<T>::is_signed;
+    if (source_signed && !dest_signed && value < 0) {
+      return 0;
+    } else if (source_signed && dest_signed
+               && (wide_type)value < (wide_type)std::numeric_limits<T>::min()) {
+      return std::numeric_limits<T>::min();
+    } else if (!(source_signed && value < 0)
+               && (std::uintmax_t)value
+                    > (std::uintmax_t)std::numeric_limits<T>::max()) {
+      return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(value);
+  }
+
+  template <typename T, typename Source>
+  inline T clamped_cast(Source value, std::true_type, std::true_type) {
+    // The limits of T are powers of two, give or take one, so converting
+    // them to Source rounds outwards and every value between them fits
+    if (value != value) {
+      return 0;
+    } else if (value <= (Source)std::numeric_limits<T>::min()) {
+      return std::numeric_limits<T>::min();
+    } else if (value >= (Source)std::numeric_limits<T>::max()) {
+      return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(value);
+  }
+
+  /**
+   * Convert a pixel as H5Dread does, which clamps values that do not fit in
+   * the destination type rather than wrapping them, and turns NaN into 0
+   * when converting to an integer
+   */
+  template <typename T, typename Source>
+  inline T clamped_cast(Source value) {
+    return clamped_cast<T>(
+      value, needs_clamp<Source, T>(), std::is_floating_point<Source>());
+  }
+
+  /**
+   * Convert a run of pixels, clamping as clamped_cast does
+   */
+  template <typename Source, typename T>
+  inline void convert_clamped(const Source *src,
+                              std::size_t n,
+                              T *dst,
+                              std::false_type) {
+    convert_pixels(src, n, dst);
+  }
+
+  template <typename Source, typename T>
+  inline void convert_clamped(const Source *src,
+                              std::size_t n,
+                              T *dst,
+                              std::true_type) {
+    for (std::size_t i = 0; i < n; ++i) {
+      dst[i] = clamped_cast<T>(src[i]);
+    }
+  }
+
+}}}  // namespace dxtbx::format::detail
+
+#endif  // DXTBX_FORMAT_PIXEL_CONVERSION_H
@@ -12,8 +12,18 @@
 #ifndef DXTBX_IMAGESET_H
 #define DXTBX_IMAGESET_H
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 #include <boost/python.hpp>
 
@@ -24,16 +34,23 @@
 #include <dxtbx/model/beam.h>
 #include <dxtbx/model/detector.h>
 #include <dxtbx/model/goniometer.h>
+#include <dxtbx/model/model_helpers.h>
 #include <dxtbx/model/scan.h>
 #include <dxtbx/format/image.h>
+#include <dxtbx/format/image_reader.h>
 #include <dxtbx/error.h>
+#include <dxtbx/instrumentation.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/boost_python/gil.h>
 #include <dxtbx/masking/goniometer_shadow_masking.h>
 
 namespace dxtbx {
 
 using format::Image;
 using format::ImageBuffer;
+using format::ImageReader;
 using format::ImageTile;
+using format::MappedImage;
 using masking::GoniometerShadowMasker;
 using model::BeamBase;
 using model::Detector;
@@ -56,6 +73,268 @@ namespace detail {
     return *item;
   }
 
+  /**
+   * Raise exception if we can't dereference pointer, otherwise get a
+   * reference to the item without copying it. The pointer must be kept
+   * while the reference is used.
+   */
+  template <typename T>
+  const T &safe_const_reference(const std::shared_ptr<T> &ptr) {
+    DXTBX_ASSERT(ptr.get() != NULL);
+    return *ptr;
+  }
+
+  /**
+   * Compute (raw - dark) * inverse_gain in a single pass, in the precision
+   * of the output. Either correction may be NULL. The branches are outside
+   * the loops so that each loop is a simple stream the compiler can
+   * vectorise.
+   */
+  template <typename T, typename F>
+  void correct_pixels(const T *raw,
+                      const F *dark,
+                      const F *inverse_gain,
+                      F *out,
+                      std::size_t n) {
+    if (dark != NULL && inverse_gain != NULL) {
+      for (std::size_t j = 0; j < n; ++j) {
+        out[j] = ((F)raw[j] - dark[j]) * inverse_gain[j];
+      }
+    } else if (dark != NULL) {
+      for (std::size_t j = 0; j < n; ++j) {
+        out[j] = (F)raw[j] - dark[j];
+      }
+    } else if (inverse_gain != NULL) {
+      for (std::size_t j = 0; j < n; ++j) {
+        out[j] = (F)raw[j] * inverse_gain[j];
+      }
+    } else {
+      for (std::size_t j = 0; j < n; ++j) {
+        out[j] = (F)raw[j];
+      }
+    }
+  }
+
+  /**
+   * A value for each panel, along with the panel sizes
+   */
+  struct PanelValues {
+    std::vector<double> values;
+    std::vector<std::size_t> sizes;
+
+    bool operator==(const PanelValues &other) const {
+      return values == other.values && sizes == other.sizes;
+    }
+  };
+
+  /**
+   * Holds the constant per-panel map last built, so it is only rebuilt
+   * when the panel values or sizes change
+   */
+  class PanelMapCache {
+  public:
+    PanelMapCache() : revision_(0) {}
+
+    Image<double> get(const PanelValues &key) {
+      if (!(key == key_) || map_.n_tiles() != key.values.size()) {
+        Image<double> result;
+        for (std::size_t i = 0; i < key.values.size(); ++i) {
+          scitbx::af::c_grid<2> grid(key.sizes[2 * i], key.sizes[2 * i + 1]);
+          scitbx::af::versa<double, scitbx::af::c_grid<2> > data(grid,
+                                                                  key.values[i]);
+          result.push_back(ImageTile<double>(data));
+        }
+        key_ = key;
+        map_ = result;
+        revision_ = dxtbx::model::next_revision();
+      }
+      return map_;
+    }
+
+    /** @returns The revision of the map last built */
+    std::size_t get_revision() const {
+      return revision_;
+    }
+
+  private:
+    PanelValues key_;
+    Image<double> map_;
+    std::size_t revision_;
+  };
+
+  /**
+   * Compute (raw - offset) * scale for constant offset and scale
+   */
+  template <typename T, typename F>
+  void correct_pixels(const T *raw, F offset, F scale, F *out, std::size_t n) {
+    for (std::size_t j = 0; j < n; ++j) {
+      out[j] = ((F)raw[j] - offset) * scale;
+    }
+  }
+
+  /**
+   * Copy the pixels of an image into a new contiguous image
+   */
+  template <typename T>
+  Image<T> copy_image(const Image<T> &image) {
+    std::vector<scitbx::af::c_grid<2> > grids;
+    for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+      grids.push_back(image.tile_ref(i).accessor());
+    }
+    Image<T> result = Image<T>::allocate(grids);
+    for (std::size_t i = 0; i < grids.size(); ++i) {
+      const T *a = image.tile_ref(i).begin();
+      std::copy(a, a + grids[i].size_1d(), result.tile_ref(i).data().begin());
+    }
+    return result;
+  }
+
+  /**
+   * Copy the pixels of an image into new arrays with the GIL released. The
+   * GIL must be held on entry, since the array handles of the original are
+   * only touched while it is held; the copy shares no handles with it.
+   */
+  template <typename T>
+  Image<T> copy_image_without_gil(const Image<T> &image) {
+    std::vector<const T *> source;
+    std::vector<scitbx::af::c_grid<2> > grids;
+    for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+      source.push_back(image.tile(i).data().begin());
+      grids.push_back(image.tile(i).data().accessor());
+    }
+    boost_python::scoped_gil_release release_gil;
+    Image<T> result = Image<T>::allocate(grids);
+    for (std::size_t i = 0; i < grids.size(); ++i) {
+      std::copy(source[i],
+                source[i] + grids[i].size_1d(),
+                result.tile_ref(i).data().begin());
+    }
+    return result;
+  }
+
+  /**
+   * Copy an image buffer as copy_image_without_gil. A mapped image only
+   * shares the mapping, which is safe to share between threads.
+   */
+  inline ImageBuffer copy_buffer_without_gil(const ImageBuffer &buffer) {
+    if (buffer.is_int()) {
+      return ImageBuffer(copy_image_without_gil(buffer.as_int()));
+    } else if (buffer.is_float()) {
+      return ImageBuffer(copy_image_without_gil(buffer.as_float()));
+    } else if (buffer.is_double()) {
+      return ImageBuffer(copy_image_without_gil(buffer.as_double()));
+    } else if (buffer.is_uint16()) {
+      return ImageBuffer(copy_image_without_gil(buffer.as_uint16()));
+    } else if (buffer.is_uint8()) {
+      return ImageBuffer(copy_image_without_gil(buffer.as_uint8()));
+    }
+    return buffer;
+  }
+
+  /**
+   * Holds a single precision copy of the double image last converted, so
+   * it is only converted again when the revision of the source changes
+   */
+  class FloatImageCache {
+  public:
+    FloatImageCache() : revision_(0) {}
+
+    Image<float> get(const Image<double> &source, std::size_t revision) {
+      if (revision != revision_) {
+        converted_ = ImageBuffer(source).as_float();
+        revision_ = revision;
+      }
+      return converted_;
+    }
+
+  private:
+    std::size_t revision_;
+    Image<float> converted_;
+  };
+
+  /**
+   * What the static mask depends on: the revision of the external mask and
+   * the size and untrusted rectangles of each panel
+   */
+  struct StaticMaskKey {
+    std::size_t external;
+    std::vector<int> panels;
+
+    StaticMaskKey() : external(0) {}
+
+    bool operator==(const StaticMaskKey &other) const {
+      return external == other.external && panels == other.panels;
+    }
+  };
+
+  /**
+   * What the cached goniometer shadow masks depend on besides the angle:
+   * the masker, and the revisions of its goniometer, the detector and the
+   * goniometer of the sequence
+   */
+  struct ShadowMaskKey {
+    const GoniometerShadowMasker *masker;
+    std::size_t masker_goniometer;
+    std::size_t detector;
+    std::size_t goniometer;
+
+    ShadowMaskKey() : masker(NULL), masker_goniometer(0), detector(0), goniometer(0) {}
+
+    bool operator==(const ShadowMaskKey &other) const {
+      return masker == other.masker && masker_goniometer == other.masker_goniometer
+             && detector == other.detector && goniometer == other.goniometer;
+    }
+  };
+
+  /**
+   * The pedestal and gain corrections for an image, applied in precision F.
+   * Each tile has either a constant offset and scale, or pedestal and
+   * inverse gain maps. Raw map pointers are kept so that tiles can be
+   * corrected without the GIL.
+   */
+  template <typename F>
+  struct ImageCorrection {
+    bool apply;
+    std::vector<double> offset;
+    std::vector<double> scale;
+    std::vector<const F *> dark;
+    std::vector<const F *> inverse_gain;
+    Image<F> dark_map;
+    Image<F> inverse_gain_map;
+
+    ImageCorrection() : apply(false) {}
+
+    /**
+     * Check the corrections fit the image
+     */
+    template <typename T>
+    void check(const Image<T> &data) const {
+      DXTBX_ASSERT(data.n_tiles() == offset.size());
+      for (std::size_t i = 0; i < data.n_tiles(); ++i) {
+        if (dark[i] != NULL) {
+          DXTBX_ASSERT(
+            data.tile(i).data().accessor().all_eq(dark_map.tile(i).data().accessor()));
+        }
+        if (inverse_gain[i] != NULL) {
+          DXTBX_ASSERT(data.tile(i).data().accessor().all_eq(
+            inverse_gain_map.tile(i).data().accessor()));
+        }
+      }
+    }
+
+    /**
+     * Correct the pixels of one tile
+     */
+    template <typename T>
+    void correct(std::size_t tile, const T *raw, F *out, std::size_t n) const {
+      if (dark[tile] == NULL && inverse_gain[tile] == NULL) {
+        correct_pixels(raw, (F)offset[tile], (F)scale[tile], out, n);
+      } else {
+        correct_pixels(raw, dark[tile], inverse_gain[tile], out, n);
+      }
+    }
+  };
+
 }  // namespace detail
 
 /**
@@ -65,7 +344,7 @@ template <typename T>
 class ExternalLookupItem {
 public:
   /** Construct the external lookup item */
-  ExternalLookupItem() {}
+  ExternalLookupItem() : revision_(0) {}
 
   /**
    * Get the filename
@@ -95,11 +374,21 @@ public:
    */
   void set_data(const Image<T> &data) {
     data_ = data;
+    revision_ = dxtbx::model::next_revision();
+  }
+
+  /**
+   * Get the revision of the data, which changes each time it is set. The
+   * arrays are shared, so changes made to them in place are not counted.
+   */
+  std::size_t get_revision() const {
+    return revision_;
   }
 
 protected:
   std::string filename_;
   Image<T> data_;
+  std::size_t revision_;
 };
 
 /**
@@ -160,8 +449,9 @@ public:
   typedef std::shared_ptr<Goniometer> goniometer_ptr;
   typedef std::shared_ptr<Scan> scan_ptr;
   typedef std::shared_ptr<GoniometerShadowMasker> masker_ptr;
+  typedef std::shared_ptr<ImageReader> native_reader_ptr;
 
-  ImageSetData() {}
+  ImageSetData() : statistics_(std::make_shared<ReadStatistics>()) {}
 
   /**
    * Construct the imageset data object
@@ -175,7 +465,8 @@ public:
         detectors_(boost::python::len(reader)),
         goniometers_(boost::python::len(reader)),
         scans_(boost::python::len(reader)),
-        reject_(boost::python::len(reader)) {}
+        reject_(boost::python::len(reader)),
+        statistics_(std::make_shared<ReadStatistics>()) {}
 
   /**
    * @returns The reader object
@@ -191,6 +482,38 @@ public:
     return masker_;
   }
 
+  /**
+   * Read the images with a C++ reader rather than the Python reader. The
+   * Python reader is still used for the paths and identifiers.
+   * @param reader The native reader, or null to use the Python reader
+   */
+  void set_native_reader(native_reader_ptr reader) {
+    DXTBX_ASSERT(reader == NULL || reader->size() == size());
+    native_reader_ = reader;
+  }
+
+  /**
+   * @returns The native reader, or null if the Python reader is used
+   */
+  native_reader_ptr native_reader() const {
+    return native_reader_;
+  }
+
+  /**
+   * @returns Are the images read with a native reader
+   */
+  bool has_native_reader() const {
+    return native_reader_ != NULL;
+  }
+
+  /**
+   * @returns The read path statistics, shared by all copies of this data
+   *          and the partial data made from it
+   */
+  ReadStatistics &statistics() const {
+    return *statistics_;
+  }
+
   /**
    * @returns Does the imageset have a dynamic mask.
    */
@@ -204,23 +527,12 @@ public:
    * @returns The image data
    */
   ImageBuffer get_data(std::size_t index) {
-    // Create the return buffer
     ImageBuffer buffer;
-
-    // Get the image data object
-    boost::python::object data = reader_.attr("read")(index);
-
-    // Get the class name
-    std::string name =
-      boost::python::extract<std::string>(data.attr("__class__").attr("__name__"))();
-
-    // Extract the image buffer
-    if (name == "tuple") {
-      buffer = get_image_buffer_from_tuple(
-        boost::python::extract<boost::python::tuple>(data)());
-    } else {
-      buffer = get_image_buffer_from_object(data);
+    {
+      ScopedStageTimer timer(statistics_.get(), ReadStatistics::READ);
+      buffer = read_data(index);
     }
+    statistics_->add_bytes(buffer.nbytes());
     return buffer;
   }
 
@@ -441,6 +753,10 @@ public:
                             std::size_t last) const {
     DXTBX_ASSERT(last > first);
     ImageSetData partial = ImageSetData(reader, masker_);
+    if (native_reader_ != NULL && native_reader_->size() == partial.size()) {
+      // The new reader covers the same images, so still read them natively
+      partial.native_reader_ = native_reader_;
+    }
     for (size_t i = 0; i < last - first; i++) {
       partial.beams_[i] = beams_[i + first];
       partial.detectors_[i] = detectors_[i + first];
@@ -453,11 +769,43 @@ public:
     partial.vendor_ = vendor_;
     partial.params_ = params_;
     partial.format_ = format_;
+    partial.statistics_ = statistics_;
 
     return partial;
   }
 
 protected:
+  ImageBuffer read_data(std::size_t index) {
+    // A native reader needs neither Python nor the GIL, so other threads
+    // can read at the same time
+    if (native_reader_ != NULL) {
+      boost_python::scoped_gil_release release_gil;
+      return native_reader_->read_with_statistics(index, statistics_.get());
+    }
+
+    // Create the return buffer
+    ImageBuffer buffer;
+
+    // Get the image data object
+    boost::python::object data = reader_.attr("read")(index);
+
+    // Get the class name
+    std::string name =
+      boost::python::extract<std::string>(data.attr("__class__").attr("__name__"))();
+
+    // Extract the image buffer
+    if (name == "tuple") {
+      buffer = get_image_buffer_from_tuple(
+        boost::python::extract<boost::python::tuple>(data)());
+    } else if (name == "MappedImage") {
+      // Keep the mapping, only converting when the data are requested
+      buffer = ImageBuffer(boost::python::extract<MappedImage>(data)());
+    } else {
+      buffer = get_image_buffer_from_object(data);
+    }
+    return buffer;
+  }
+
   ImageBuffer get_image_buffer_from_tuple(boost::python::tuple obj) {
     // Get the class name
     std::string name =
@@ -471,6 +819,10 @@ protected:
       buffer = ImageBuffer(get_image_from_tuple<float>(obj));
     } else if (name == "int") {
       buffer = ImageBuffer(get_image_from_tuple<int>(obj));
+    } else if (name == "uint16") {
+      buffer = ImageBuffer(get_image_from_tuple<std::uint16_t>(obj));
+    } else if (name == "uint8") {
+      buffer = ImageBuffer(get_image_from_tuple<std::uint8_t>(obj));
     } else {
       throw DXTBX_ERROR("Unknown type " + name);
     }
@@ -490,6 +842,12 @@ protected:
       buffer = ImageBuffer(Image<float>(get_image_tile_from_object<float>(obj)));
     } else if (name == "int") {
       buffer = ImageBuffer(Image<int>(get_image_tile_from_object<int>(obj)));
+    } else if (name == "uint16") {
+      buffer = ImageBuffer(
+        Image<std::uint16_t>(get_image_tile_from_object<std::uint16_t>(obj)));
+    } else if (name == "uint8") {
+      buffer = ImageBuffer(
+        Image<std::uint8_t>(get_image_tile_from_object<std::uint8_t>(obj)));
     } else {
       throw DXTBX_ERROR("Unknown type " + name);
     }
@@ -518,6 +876,7 @@ protected:
   }
 
   boost::python::object reader_;
+  native_reader_ptr native_reader_;
   std::shared_ptr<GoniometerShadowMasker> masker_;
   scitbx::af::shared<beam_ptr> beams_;
   scitbx::af::shared<detector_ptr> detectors_;
@@ -530,6 +889,169 @@ protected:
   std::string vendor_;
   std::string params_;
   std::string format_;
+  std::shared_ptr<ReadStatistics> statistics_;
+};
+
+/**
+ * Read images on background threads ahead of the consumer.
+ *
+ * Every read of a prefetched imageset goes through the worker threads, so
+ * with one worker the reader is never called from two threads at once. The
+ * workers take the GIL only to call the reader, and images are only copied
+ * with the GIL held, since array handles are not reference counted
+ * atomically. A native reader runs with the GIL released, so then several
+ * workers read in parallel.
+ */
+class ImagePrefetcher {
+public:
+  /**
+   * Start the workers
+   * @param data The imageset data
+   * @param indices The image indices of the imageset
+   * @param nthreads The number of workers, zero for the default
+   */
+  ImagePrefetcher(const ImageSetData &data,
+                  const scitbx::af::shared<std::size_t> &indices,
+                  std::size_t nthreads)
+      : data_(data), indices_(indices.begin(), indices.end()), stop_(false) {
+    nthreads = resolve_thread_count(nthreads);
+    for (std::size_t i = 0; i < nthreads; ++i) {
+      workers_.push_back(std::thread(&ImagePrefetcher::run, this));
+    }
+  }
+
+  /**
+   * Stop and join the workers. Must be called with the GIL held.
+   */
+  ~ImagePrefetcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_.notify_all();
+    boost_python::scoped_gil_release release_gil;
+    for (std::size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].join();
+    }
+  }
+
+  /**
+   * Get an image, waiting for it if it is being read. If it is not yet
+   * queued then it goes to the front of the queue.
+   * @param index The image index
+   * @param image Set to the image
+   * @returns False if the image could not be read, in which case the
+   *          caller should read it directly to get the error
+   */
+  bool get(std::size_t index, ImageBuffer &image) {
+    {
+      boost_python::scoped_gil_release release_gil;
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (ready_.count(index) == 0 && in_flight_.count(index) == 0) {
+        pending_.erase(std::remove(pending_.begin(), pending_.end(), index),
+                       pending_.end());
+        pending_.push_front(index);
+        work_.notify_one();
+      }
+      done_.wait(lock, [&] {
+        return in_flight_.count(index) == 0
+               && std::find(pending_.begin(), pending_.end(), index)
+                    == pending_.end();
+      });
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::size_t, ImageBuffer>::iterator it = ready_.find(index);
+    if (it == ready_.end()) {
+      return false;
+    }
+    image = it->second;
+    ready_.erase(it);
+    return true;
+  }
+
+  /**
+   * Replace the queue with the images the consumer will want next, in
+   * order. Images already read but no longer wanted are dropped.
+   * @param wanted The image indices
+   */
+  void schedule(const std::vector<std::size_t> &wanted) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::set<std::size_t> keep(wanted.begin(), wanted.end());
+    for (std::map<std::size_t, ImageBuffer>::iterator it = ready_.begin();
+         it != ready_.end();) {
+      if (keep.count(it->first) == 0) {
+        ready_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    pending_.clear();
+    for (std::size_t i = 0; i < wanted.size(); ++i) {
+      if (ready_.count(wanted[i]) == 0 && in_flight_.count(wanted[i]) == 0) {
+        pending_.push_back(wanted[i]);
+      }
+    }
+    work_.notify_all();
+  }
+
+  /**
+   * Drop any images which have been read but not yet used
+   */
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.clear();
+    pending_.clear();
+  }
+
+private:
+  ImagePrefetcher(const ImagePrefetcher &);
+  ImagePrefetcher &operator=(const ImagePrefetcher &);
+
+  void run() {
+    for (;;) {
+      std::size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        if (stop_) {
+          return;
+        }
+        index = pending_.front();
+        pending_.pop_front();
+        in_flight_.insert(index);
+      }
+      {
+        boost_python::scoped_gil_acquire acquire_gil;
+        ImageBuffer image;
+        bool success = true;
+        try {
+          image = data_.get_data(indices_[index]);
+        } catch (boost::python::error_already_set const &) {
+          PyErr_Clear();
+          success = false;
+        } catch (std::exception const &) {
+          success = false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_.erase(index);
+        if (success && !stop_) {
+          ready_[index] = image;
+        }
+      }
+      done_.notify_all();
+    }
+  }
+
+  ImageSetData data_;
+  std::vector<std::size_t> indices_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable done_;
+  std::deque<std::size_t> pending_;
+  std::set<std::size_t> in_flight_;
+  std::map<std::size_t, ImageBuffer> ready_;
+  bool stop_;
 };
 
 /**
@@ -543,15 +1065,190 @@ public:
   typedef ImageSetData::scan_ptr scan_ptr;
 
   /**
-   * Cache an image
+   * A least recently used cache of images, keyed by image index unless
+   * another key type is given, and bounded by the memory the images hold.
+   * The most recent image is always kept, even if on its own it is over
+   * the limit, so a limit of zero caches a single image.
    */
-  template <class T>
+  template <class T, class Key = std::size_t>
   class DataCache {
   public:
-    T image;
-    int index;
+    DataCache() : max_bytes_(0), nbytes_(0), hits_(0), misses_(0) {}
+
+    /**
+     * Look up an image, marking it as the most recently used
+     * @param index The image index
+     * @param image Set to the image if it is cached
+     * @returns True if the image was cached
+     */
+    bool get(Key index, T &image) {
+      for (typename std::list<Entry>::iterator it = entries_.begin();
+           it != entries_.end();
+           ++it) {
+        if (it->index == index) {
+          entries_.splice(entries_.begin(), entries_, it);
+          image = it->image;
+          hits_++;
+          return true;
+        }
+      }
+      misses_++;
+      return false;
+    }
+
+    /**
+     * @param index The image index
+     * @returns True if the image is cached. Not counted as a lookup.
+     */
+    bool contains(Key index) const {
+      for (typename std::list<Entry>::const_iterator it = entries_.begin();
+           it != entries_.end();
+           ++it) {
+        if (it->index == index) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Add an image, evicting the least recently used images to stay inside
+     * the memory limit
+     * @param index The image index
+     * @param image The image
+     */
+    void put(Key index, const T &image) {
+      erase(index);
+      Entry entry;
+      entry.index = index;
+      entry.image = image;
+      entry.nbytes = image.nbytes();
+      entries_.push_front(entry);
+      nbytes_ += entry.nbytes;
+      trim();
+    }
+
+    /**
+     * Set the hit and miss counts back to zero
+     */
+    void reset_counters() {
+      hits_ = 0;
+      misses_ = 0;
+    }
+
+    /**
+     * Remove all images. The memory limit and counters are kept.
+     */
+    void clear() {
+      entries_.clear();
+      nbytes_ = 0;
+    }
+
+    /**
+     * @returns The memory limit in bytes
+     */
+    std::size_t max_bytes() const {
+      return max_bytes_;
+    }
+
+    /**
+     * Set the memory limit, evicting images if needed
+     * @param max_bytes The memory limit in bytes
+     */
+    void set_max_bytes(std::size_t max_bytes) {
+      max_bytes_ = max_bytes;
+      trim();
+    }
+
+    /**
+     * @returns The number of cached images
+     */
+    std::size_t size() const {
+      return entries_.size();
+    }
+
+    /**
+     * @returns The memory held by the cached images in bytes
+     */
+    std::size_t nbytes() const {
+      return nbytes_;
+    }
+
+    /**
+     * @returns The number of lookups which found the image
+     */
+    std::size_t hits() const {
+      return hits_;
+    }
+
+    /**
+     * @returns The number of lookups which did not find the image
+     */
+    std::size_t misses() const {
+      return misses_;
+    }
+
+  private:
+    struct Entry {
+      Key index;
+      T image;
+      std::size_t nbytes;
+    };
+
+    void erase(Key index) {
+      for (typename std::list<Entry>::iterator it = entries_.begin();
+           it != entries_.end();
+           ++it) {
+        if (it->index == index) {
+          nbytes_ -= it->nbytes;
+          entries_.erase(it);
+          return;
+        }
+      }
+    }
+
+    void trim() {
+      while (entries_.size() > 1 && nbytes_ > max_bytes_) {
+        nbytes_ -= entries_.back().nbytes;
+        entries_.pop_back();
+      }
+    }
+
+    std::list<Entry> entries_;
+    std::size_t max_bytes_;
+    std::size_t nbytes_;
+    std::size_t hits_;
+    std::size_t misses_;
+  };
+
+  /**
+   * The prefetcher of one imageset. Copying an imageset does not copy its
+   * prefetcher, whose queue follows the reads of a single consumer, so the
+   * copy starts its own when it first reads.
+   */
+  class PrefetcherSlot {
+  public:
+    PrefetcherSlot() {}
+
+    PrefetcherSlot(const PrefetcherSlot &) {}
+
+    PrefetcherSlot &operator=(const PrefetcherSlot &) {
+      prefetcher_.reset();
+      return *this;
+    }
+
+    /** @returns The prefetcher, or NULL if there is none */
+    ImagePrefetcher *get() const {
+      return prefetcher_.get();
+    }
 
-    DataCache() : index(-1) {}
+    /** Replace the prefetcher, stopping any previous one */
+    void reset(ImagePrefetcher *prefetcher = NULL) {
+      prefetcher_.reset(prefetcher);
+    }
+
+  private:
+    std::unique_ptr<ImagePrefetcher> prefetcher_;
   };
 
   /**
@@ -572,7 +1269,14 @@ public:
    * Construct the imageset
    * @param data The imageset data
    */
-  ImageSet(const ImageSetData &data) : data_(data), indices_(data.size()) {
+  ImageSet(const ImageSetData &data)
+      : data_(data),
+        indices_(data.size()),
+        prefetch_depth_(0),
+        prefetch_threads_(0),
+        single_precision_(false),
+        thread_safe_(false),
+        inverse_gain_revision_(0) {
     // Check number of images
     if (data.size() == 0) {
       throw DXTBX_ERROR("No images specified in ImageSetData");
@@ -590,7 +1294,13 @@ public:
    * @param indices The image indices
    */
   ImageSet(const ImageSetData &data, const scitbx::af::const_ref<std::size_t> &indices)
-      : data_(data), indices_(indices.begin(), indices.end()) {
+      : data_(data),
+        indices_(indices.begin(), indices.end()),
+        prefetch_depth_(0),
+        prefetch_threads_(0),
+        single_precision_(false),
+        thread_safe_(false),
+        inverse_gain_revision_(0) {
     // Check number of images
     if (data.size() == 0) {
       throw DXTBX_ERROR("No images specified in ImageSetData");
@@ -645,12 +1355,24 @@ public:
    */
   ImageBuffer get_raw_data(std::size_t index) {
     DXTBX_ASSERT(index < indices_.size());
-    if (data_cache_.index == index) {
-      return data_cache_.image;
+    if (thread_safe_) {
+      boost_python::scoped_gil_acquire acquire_gil;
+      ImageBuffer image;
+      if (!data_cache_.get(index, image)) {
+        image = data_.get_data(indices_[index]);
+        data_cache_.put(index, image);
+      }
+      return detail::copy_buffer_without_gil(image);
+    }
+    ImageBuffer image;
+    if (!data_cache_.get(index, image)) {
+      ImagePrefetcher *prefetcher = get_prefetcher();
+      if (prefetcher == NULL || !prefetcher->get(index, image)) {
+        image = data_.get_data(indices_[index]);
+      }
+      data_cache_.put(index, image);
     }
-    ImageBuffer image = data_.get_data(indices_[index]);
-    data_cache_.index = index;
-    data_cache_.image = image;
+    schedule_prefetch(index);
     return image;
   }
 
@@ -660,68 +1382,94 @@ public:
    * @returns The corrected data array
    */
   Image<double> get_corrected_data(std::size_t index) {
-    typedef scitbx::af::versa<double, scitbx::af::c_grid<2> > array_type;
-    typedef scitbx::af::const_ref<double, scitbx::af::c_grid<2> > const_ref_type;
+    return get_corrected_data_as<double>(index);
+  }
 
-    // Get the multi-tile data, gain and pedestal
+  /**
+   * Get the corrected data array (raw - pedestal) / gain, computed in the
+   * precision of T. A float image takes half the memory of a double image,
+   * and the correction is done with twice as many pixels per vector.
+   * @param index The image index
+   * @returns The corrected data array
+   */
+  template <typename T>
+  Image<T> get_corrected_data_as(std::size_t index) {
     DXTBX_ASSERT(index < indices_.size());
-    Image<double> data = get_raw_data_as_double(index);
-    Image<double> gain = get_gain(index);
-    Image<double> dark = get_pedestal(index);
-    DXTBX_ASSERT(gain.n_tiles() == 0 || data.n_tiles() == gain.n_tiles());
-    DXTBX_ASSERT(dark.n_tiles() == 0 || data.n_tiles() == dark.n_tiles());
-
-    // Loop through tiles
-    Image<double> result;
-    for (std::size_t i = 0; i < data.n_tiles(); ++i) {
-      // Get the data
-      const_ref_type r = data.tile(i).data().const_ref();
-
-      // Get the gain and dark
-      const_ref_type g = gain.n_tiles() > 0
-                           ? gain.tile(i).data().const_ref()
-                           : const_ref_type(NULL, scitbx::af::c_grid<2>(0, 0));
-      const_ref_type p = dark.n_tiles() > 0
-                           ? dark.tile(i).data().const_ref()
-                           : const_ref_type(NULL, scitbx::af::c_grid<2>(0, 0));
-
-      // Check gain and dark sizes
-      DXTBX_ASSERT(g.size() == 0 || r.accessor().all_eq(g.accessor()));
-      DXTBX_ASSERT(p.size() == 0 || r.accessor().all_eq(p.accessor()));
-
-      if (p.size() == 0 && g.size() == 0) {
-        // Nothing to apply, save the copy
-        result.push_back(ImageTile<double>(data.tile(i).data()));
-      } else {
-        // Create the result array
-        array_type c(r.accessor(),
-                     scitbx::af::init_functor_null<array_type::value_type>());
+    if (thread_safe_) {
+      return get_corrected_data_thread_safe<T>(index);
+    }
+    detail::ImageCorrection<T> correction = get_correction<T>(index);
+    if (!correction.apply) {
+      // Nothing to apply, save the copy
+      return get_raw_data_as(index, T());
+    }
+    return correct_raw_data(get_raw_data(index), correction);
+  }
 
-        // Copy the data values
-        std::uninitialized_copy(r.begin(), r.end(), c.begin());
+  /**
+   * Get the corrected data array from a raw image which has already been
+   * read, computed in the precision of T
+   * @param index The image index
+   * @param buffer The raw data for the image
+   * @returns The corrected data array
+   */
+  template <typename T>
+  Image<T> get_corrected_data_as(std::size_t index, const ImageBuffer &buffer) {
+    DXTBX_ASSERT(index < indices_.size());
+    if (thread_safe_) {
+      return get_corrected_data_thread_safe<T>(index, buffer);
+    }
+    detail::ImageCorrection<T> correction = get_correction<T>(index);
+    if (!correction.apply) {
+      return convert_raw_data(buffer, T());
+    }
+    return correct_raw_data(buffer, correction);
+  }
 
-        // Apply dark
-        if (p.size() > 0) {
-          for (std::size_t j = 0; j < r.size(); ++j) {
-            c[j] = c[j] - p[j];
-          }
-        }
+  /**
+   * @returns Whether the corrected data is returned to Python in single
+   *          precision by default
+   */
+  bool get_single_precision() const {
+    return single_precision_;
+  }
 
-        // Apply gain
-        if (g.size() > 0) {
-          for (std::size_t j = 0; j < r.size(); ++j) {
-            DXTBX_ASSERT(g[j] > 0);
-            c[j] = c[j] / g[j];
-          }
-        }
+  /**
+   * Choose the default precision of the corrected data returned to Python.
+   * Each call can still ask for the other precision.
+   * @param single_precision True for float, false for double
+   */
+  void set_single_precision(bool single_precision) {
+    single_precision_ = single_precision;
+  }
 
-        // Add the image tile
-        result.push_back(ImageTile<double>(c));
+  /**
+   * Get the reciprocal of the gain map, checking that the gain is positive.
+   * This is only recomputed when the revision of the gain map changes.
+   * @param index The image index
+   * @returns The inverse gain
+   */
+  Image<double> get_inverse_gain(std::size_t index) {
+    std::size_t revision = 0;
+    Image<double> gain = get_gain(index, revision);
+    if (revision != inverse_gain_revision_) {
+      Image<double> result;
+      for (std::size_t i = 0; i < gain.n_tiles(); ++i) {
+        scitbx::af::versa<double, scitbx::af::c_grid<2> > g = gain.tile(i).data();
+        scitbx::af::versa<double, scitbx::af::c_grid<2> > inverse(
+          g.accessor(), scitbx::af::init_functor_null<double>());
+        bool valid = true;
+        for (std::size_t j = 0; j < g.size(); ++j) {
+          valid &= g[j] > 0;
+          inverse[j] = 1.0 / g[j];
+        }
+        DXTBX_ASSERT(valid);
+        result.push_back(ImageTile<double>(inverse));
       }
+      inverse_gain_revision_ = revision;
+      inverse_gain_ = result;
     }
-
-    // Return the result
-    return result;
+    return inverse_gain_;
   }
 
   /**
@@ -731,40 +1479,8 @@ public:
    * @returns The gain
    */
   Image<double> get_gain(std::size_t index) {
-    // If the external lookup is empty
-    DXTBX_ASSERT(index < indices_.size());
-    if (external_lookup().gain().get_data().empty()) {
-      // Get the detector
-      Detector detector = detail::safe_dereference(get_detector_for_image(index));
-
-      // Compute the gain for each panel
-      bool use_detector_gain = true;
-      bool need_gain_map = false;
-      std::vector<double> gain(detector.size(), 0);
-      for (std::size_t i = 0; i < detector.size(); ++i) {
-        gain[i] = detector[i].get_gain();
-        if (gain[i] <= 0) {
-          use_detector_gain = false;
-          break;
-        } else if (std::abs(gain[i] - 1.0) > 1e-7) {
-          need_gain_map = true;
-        }
-      }
-
-      // If using the gain from the panel, construct a gain map
-      if (use_detector_gain && need_gain_map) {
-        Image<double> result;
-        for (std::size_t i = 0; i < detector.size(); ++i) {
-          std::size_t xsize = detector[i].get_image_size()[0];
-          std::size_t ysize = detector[i].get_image_size()[1];
-          scitbx::af::c_grid<2> grid(ysize, xsize);
-          scitbx::af::versa<double, scitbx::af::c_grid<2> > data(grid, gain[i]);
-          result.push_back(ImageTile<double>(data));
-        }
-        return result;
-      }
-    }
-    return external_lookup().gain().get_data();
+    std::size_t revision = 0;
+    return get_gain(index, revision);
   }
 
   /**
@@ -773,37 +1489,8 @@ public:
    * @returns The pedestal image
    */
   Image<double> get_pedestal(std::size_t index) {
-    //
-    // If the external lookup is empty
-    DXTBX_ASSERT(index < indices_.size());
-    if (external_lookup().pedestal().get_data().empty()) {
-      // Get the detector
-      Detector detector = detail::safe_dereference(get_detector_for_image(index));
-
-      // Compute the pedestal for each panel
-      bool use_detector_pedestal = false;
-      std::vector<double> pedestal(detector.size(), 0);
-      for (std::size_t i = 0; i < detector.size(); ++i) {
-        pedestal[i] = detector[i].get_pedestal();
-        if (std::abs(pedestal[i]) > 1e-7) {
-          use_detector_pedestal = true;
-        }
-      }
-
-      // If using the pedestal from the panel, construct a pedestal map
-      if (use_detector_pedestal) {
-        Image<double> result;
-        for (std::size_t i = 0; i < detector.size(); ++i) {
-          std::size_t xsize = detector[i].get_image_size()[0];
-          std::size_t ysize = detector[i].get_image_size()[1];
-          scitbx::af::c_grid<2> grid(ysize, xsize);
-          scitbx::af::versa<double, scitbx::af::c_grid<2> > data(grid, pedestal[i]);
-          result.push_back(ImageTile<double>(data));
-        }
-        return result;
-      }
-    }
-    return external_lookup().pedestal().get_data();
+    std::size_t revision = 0;
+    return get_pedestal(index, revision);
   }
 
   /**
@@ -819,7 +1506,8 @@ public:
    * @returns The mask
    */
   Image<bool> get_empty_mask() const {
-    Detector detector = detail::safe_dereference(get_detector_for_image(0));
+    detector_ptr detector_for_image = get_detector_for_image(0);
+    const Detector &detector = detail::safe_const_reference(detector_for_image);
     Image<bool> mask;
     for (std::size_t i = 0; i < detector.size(); ++i) {
       std::size_t xsize = detector[i].get_image_size()[0];
@@ -836,7 +1524,8 @@ public:
    * @returns The mask
    */
   Image<bool> get_untrusted_rectangle_mask(Image<bool> mask) const {
-    Detector detector = detail::safe_dereference(get_detector_for_image(0));
+    detector_ptr detector_for_image = get_detector_for_image(0);
+    const Detector &detector = detail::safe_const_reference(detector_for_image);
     DXTBX_ASSERT(mask.n_tiles() == detector.size());
     for (std::size_t i = 0; i < detector.size(); ++i) {
       detector[i].apply_untrusted_rectangle_mask(mask.tile(i).data().ref());
@@ -872,8 +1561,21 @@ public:
    * @returns The mask
    */
   Image<bool> get_static_mask(Image<bool> mask) {
-    return get_untrusted_rectangle_mask(
-      get_external_mask(mask.empty() ? get_empty_mask() : mask));
+    Image<bool> static_mask = get_cached_static_mask();
+    if (mask.empty()) {
+      return detail::copy_image(static_mask);
+    }
+    DXTBX_ASSERT(mask.n_tiles() == static_mask.n_tiles());
+    for (std::size_t i = 0; i < mask.n_tiles(); ++i) {
+      scitbx::af::ref<bool, scitbx::af::c_grid<2> > m1 = mask.tile(i).data().ref();
+      scitbx::af::const_ref<bool, scitbx::af::c_grid<2> > m2 =
+        static_mask.tile(i).data().const_ref();
+      DXTBX_ASSERT(m1.accessor().all_eq(m2.accessor()));
+      for (std::size_t j = 0; j < m1.size(); ++j) {
+        m1[j] = m1[j] & m2[j];
+      }
+    }
+    return mask;
   }
 
   /**
@@ -885,19 +1587,41 @@ public:
   }
 
   /**
-   * Get the trusted range mask for the index
+   * Get the trusted range mask for the index. The range is checked against
+   * the raw pixels in their own type, so no double copy is made.
    * @param mask The mask to write into
    * @param index The image index
    * @returns The mask
    */
   Image<bool> get_trusted_range_mask(Image<bool> mask, std::size_t index) {
-    Detector detector = detail::safe_dereference(get_detector_for_image(index));
-    Image<double> data = get_raw_data_as_double(index);
-    DXTBX_ASSERT(mask.n_tiles() == data.n_tiles());
-    DXTBX_ASSERT(data.n_tiles() == detector.size());
-    for (std::size_t i = 0; i < detector.size(); ++i) {
-      detector[i].apply_trusted_range_mask(data.tile(i).data().const_ref(),
-                                           mask.tile(i).data().ref());
+    return get_trusted_range_mask(mask, index, get_raw_data(index));
+  }
+
+  /**
+   * Get the trusted range mask from a raw image which has already been read
+   * @param mask The mask to write into
+   * @param index The image index
+   * @param buffer The raw data for the image
+   * @returns The mask
+   */
+  Image<bool> get_trusted_range_mask(Image<bool> mask,
+                                     std::size_t index,
+                                     const ImageBuffer &buffer) {
+    detector_ptr detector_for_image = get_detector_for_image(index);
+    const Detector &detector = detail::safe_const_reference(detector_for_image);
+    // In thread safe mode the image and mask are private to this thread,
+    // and the panels are only read, so the GIL is not needed for the check
+    boost_python::scoped_gil_release release_gil(thread_safe_);
+    if (buffer.is_int()) {
+      apply_trusted_range_mask(detector, buffer.as_int(), mask);
+    } else if (buffer.is_float()) {
+      apply_trusted_range_mask(detector, buffer.as_float(), mask);
+    } else if (buffer.is_uint16()) {
+      apply_trusted_range_mask(detector, buffer.as_uint16(), mask);
+    } else if (buffer.is_uint8()) {
+      apply_trusted_range_mask(detector, buffer.as_uint8(), mask);
+    } else {
+      apply_trusted_range_mask(detector, buffer.as_double(), mask);
     }
     return mask;
   }
@@ -907,8 +1631,18 @@ public:
    * @param index The image index
    * @returns The image mask
    */
-  virtual Image<bool> get_dynamic_mask(std::size_t index) {
-    return get_trusted_range_mask(get_static_mask(), index);
+  Image<bool> get_dynamic_mask(std::size_t index) {
+    return get_dynamic_mask(index, get_raw_data(index));
+  }
+
+  /**
+   * Get the dynamic mask for an image which has already been read
+   * @param index The image index
+   * @param buffer The raw data for the image
+   * @returns The image mask
+   */
+  virtual Image<bool> get_dynamic_mask(std::size_t index, const ImageBuffer &buffer) {
+    return get_trusted_range_mask(get_static_mask(), index, buffer);
   }
 
   /**
@@ -917,9 +1651,209 @@ public:
    * @returns The image mask
    */
   Image<bool> get_mask(std::size_t index) {
+    ScopedStageTimer timer(&data_.statistics(), ReadStatistics::MASK);
+    if (thread_safe_) {
+      // The masks are built from the models and caches, so hold the GIL.
+      // The masks returned share no arrays with them.
+      boost_python::scoped_gil_acquire acquire_gil;
+      return get_dynamic_mask(index);
+    }
     return get_dynamic_mask(index);
   }
 
+  /**
+   * Compute the mask for an image which has already been read
+   * @param index The image index
+   * @param buffer The raw data for the image
+   * @returns The image mask
+   */
+  Image<bool> get_mask(std::size_t index, const ImageBuffer &buffer) {
+    ScopedStageTimer timer(&data_.statistics(), ReadStatistics::MASK);
+    if (thread_safe_) {
+      boost_python::scoped_gil_acquire acquire_gil;
+      return get_dynamic_mask(index, buffer);
+    }
+    return get_dynamic_mask(index, buffer);
+  }
+
+  /**
+   * @returns Is the imageset in thread safe mode
+   */
+  bool is_thread_safe() const {
+    return thread_safe_;
+  }
+
+  /**
+   * Allow get_raw_data, get_corrected_data, get_mask and get_frame to be
+   * called from several threads at once, including threads which do not
+   * hold the GIL. Models and caches are then only touched with the GIL
+   * held, and the images returned are copies which share no arrays with the
+   * caches, so they can be used and freed on any thread. Reading, copying,
+   * converting and correcting the images is done with the GIL released.
+   * A Python reader is still called with the GIL held, so only native
+   * readers read in parallel.
+   *
+   * The models, external lookups and cache size must not be changed while
+   * other threads are reading, and prefetching is not used in this mode.
+   * @param thread_safe True to allow access from several threads
+   */
+  void set_thread_safe(bool thread_safe) {
+    DXTBX_ASSERT(!thread_safe || prefetch_depth_ == 0);
+    thread_safe_ = thread_safe;
+  }
+
+  /**
+   * Get the raw data, mask and corrected data for an image together. The
+   * image is read once, and the mask and corrected data are computed from
+   * the same raw data.
+   * @param index The image index
+   * @param data Set to the raw data
+   * @param mask Set to the image mask
+   * @param corrected Set to the corrected data, in the precision of T
+   */
+  template <typename T>
+  void get_frame(std::size_t index,
+                 ImageBuffer &data,
+                 Image<bool> &mask,
+                 Image<T> &corrected) {
+    data = get_raw_data(index);
+    mask = get_mask(index, data);
+    corrected = get_corrected_data_as<T>(index, data);
+  }
+
+  /**
+   * Get a block of images as one contiguous (n, slow, fast) array for each
+   * panel. The images are read in turn, then converted straight into the
+   * block in parallel with the GIL released.
+   * @param first The first image index
+   * @param last One past the last image index
+   * @param nthreads The number of threads, zero for the default
+   * @returns The block for each panel
+   */
+  template <typename T>
+  std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > >
+  get_raw_data_block(std::size_t first, std::size_t last, std::size_t nthreads) {
+    DXTBX_ASSERT(first < last && last <= size());
+    std::vector<ImageBuffer> frames;
+    for (std::size_t index = first; index < last; ++index) {
+      frames.push_back(get_raw_data(index));
+    }
+    std::vector<scitbx::af::c_grid<2> > grids = frames[0].tile_accessors();
+    check_block_shape(grids, frames);
+    std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > > block =
+      allocate_block<T>(grids, frames.size());
+
+    // Take the pointers while holding the GIL, as array handles are not
+    // thread safe
+    const std::size_t n_tiles = grids.size();
+    std::vector<std::vector<T *> > target(frames.size());
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+      for (std::size_t j = 0; j < n_tiles; ++j) {
+        target[i].push_back(block[j].begin() + i * grids[j].size_1d());
+      }
+    }
+
+    {
+      // Converting into the block needs no array handles
+      boost_python::scoped_gil_release release_gil;
+      ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CONVERT);
+      parallel_for(frames.size(), nthreads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          frames[i].copy_to(target[i]);
+        }
+      });
+    }
+    return block;
+  }
+
+  /**
+   * Get a block of corrected images as one contiguous (n, slow, fast)
+   * array for each panel. The corrections are applied straight from the
+   * raw pixels into the block, in parallel with the GIL released.
+   * @param first The first image index
+   * @param last One past the last image index
+   * @param nthreads The number of threads, zero for the default
+   * @returns The block for each panel, in the precision of T
+   */
+  template <typename T = double>
+  std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > >
+  get_corrected_data_block(std::size_t first, std::size_t last, std::size_t nthreads) {
+    DXTBX_ASSERT(first < last && last <= size());
+    // The corrections come from the caches
+    boost_python::scoped_gil_acquire acquire_gil(thread_safe_);
+
+    // Keep the raw images in their own type where possible, and take the
+    // pointers while holding the GIL
+    std::vector<ImageBuffer> raw;
+    std::vector<PixelType> types;
+    std::vector<const void *> source;
+    std::vector<detail::ImageCorrection<T> > corrections;
+    for (std::size_t index = first; index < last; ++index) {
+      ImageBuffer buffer = get_raw_data(index);
+      detail::ImageCorrection<T> correction = get_correction<T>(index);
+      if (buffer.is_int()) {
+        types.push_back(INT_PIXELS);
+        add_block_source(buffer.as_int(), correction, source);
+      } else if (buffer.is_float()) {
+        types.push_back(FLOAT_PIXELS);
+        add_block_source(buffer.as_float(), correction, source);
+      } else if (buffer.is_uint16()) {
+        types.push_back(UINT16_PIXELS);
+        add_block_source(buffer.as_uint16(), correction, source);
+      } else if (buffer.is_uint8()) {
+        types.push_back(UINT8_PIXELS);
+        add_block_source(buffer.as_uint8(), correction, source);
+      } else {
+        buffer = ImageBuffer(buffer.as_double());
+        types.push_back(DOUBLE_PIXELS);
+        add_block_source(buffer.as_double(), correction, source);
+      }
+      raw.push_back(buffer);
+      corrections.push_back(correction);
+    }
+    std::vector<scitbx::af::c_grid<2> > grids = raw[0].tile_accessors();
+    check_block_shape(grids, raw);
+    std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > > block =
+      allocate_block<T>(grids, raw.size());
+    const std::size_t n_tiles = grids.size();
+    std::vector<T *> target;
+    for (std::size_t j = 0; j < n_tiles; ++j) {
+      target.push_back(block[j].begin());
+    }
+
+    {
+      ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CORRECT);
+      boost_python::scoped_gil_release release_gil;
+      parallel_for(raw.size(), nthreads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          for (std::size_t j = 0; j < n_tiles; ++j) {
+            const std::size_t n = grids[j].size_1d();
+            const void *src = source[i * n_tiles + j];
+            T *dst = target[j] + i * n;
+            switch (types[i]) {
+            case INT_PIXELS:
+              corrections[i].correct(j, (const int *)src, dst, n);
+              break;
+            case FLOAT_PIXELS:
+              corrections[i].correct(j, (const float *)src, dst, n);
+              break;
+            case UINT16_PIXELS:
+              corrections[i].correct(j, (const std::uint16_t *)src, dst, n);
+              break;
+            case UINT8_PIXELS:
+              corrections[i].correct(j, (const std::uint8_t *)src, dst, n);
+              break;
+            default:
+              corrections[i].correct(j, (const double *)src, dst, n);
+              break;
+            }
+          }
+        }
+      });
+    }
+    return block;
+  }
+
   /**
    * @param index The image index
    * @returns the beam at index
@@ -1101,8 +2035,61 @@ public:
    * manually cleared before moving onto the next imageset.
    */
   void clear_cache() {
-    data_cache_ = DataCache<ImageBuffer>();
-    double_raw_data_cache_ = DataCache<Image<double> >();
+    data_cache_.clear();
+    double_raw_data_cache_.clear();
+    if (prefetcher_.get() != NULL) {
+      prefetcher_.get()->clear();
+    }
+  }
+
+  /**
+   * @returns The memory limit of the image caches in bytes
+   */
+  std::size_t get_cache_size() const {
+    return data_cache_.max_bytes();
+  }
+
+  /**
+   * Set the memory limit of the image caches. The raw images and the
+   * images converted to double are each held within this limit. The
+   * most recently read image is always kept, so the default of zero
+   * caches one image.
+   * @param max_bytes The memory limit in bytes
+   */
+  void set_cache_size(std::size_t max_bytes) {
+    data_cache_.set_max_bytes(max_bytes);
+    double_raw_data_cache_.set_max_bytes(max_bytes);
+  }
+
+  /**
+   * @returns The raw image cache
+   */
+  const DataCache<ImageBuffer> &data_cache() const {
+    return data_cache_;
+  }
+
+  /**
+   * @returns The cache of raw images converted to double
+   */
+  const DataCache<Image<double> > &double_raw_data_cache() const {
+    return double_raw_data_cache_;
+  }
+
+  /**
+   * @returns The read path statistics of the imageset data
+   */
+  ReadStatistics &read_statistics() const {
+    return data_.statistics();
+  }
+
+  /**
+   * Set the read path statistics and the cache hit and miss counts back
+   * to zero
+   */
+  void reset_read_statistics() {
+    data_.statistics().reset();
+    data_cache_.reset_counters();
+    double_raw_data_cache_.reset_counters();
   }
 
 protected:
@@ -1110,17 +2097,489 @@ protected:
   scitbx::af::shared<std::size_t> indices_;
   DataCache<ImageBuffer> data_cache_;
   DataCache<Image<double> > double_raw_data_cache_;
+  PrefetcherSlot prefetcher_;
+  std::size_t prefetch_depth_;
+  std::size_t prefetch_threads_;
+  bool single_precision_;
+  bool thread_safe_;
+  std::size_t inverse_gain_revision_;
+  Image<double> inverse_gain_;
+  detail::FloatImageCache float_pedestal_;
+  detail::FloatImageCache float_inverse_gain_;
+  detail::PanelMapCache gain_map_;
+  detail::PanelMapCache pedestal_map_;
+  detail::StaticMaskKey static_mask_key_;
+  Image<bool> static_mask_;
+
+  /**
+   * Get the gain map, along with the revision of its arrays
+   * @param index The image index
+   * @param revision The revision of the gain map
+   * @returns The gain
+   */
+  Image<double> get_gain(std::size_t index, std::size_t &revision) {
+    // If the external lookup is empty
+    DXTBX_ASSERT(index < indices_.size());
+    if (external_lookup().gain().get_data().empty()) {
+      // If using the gain from the panel, get the gain map
+      detail::PanelValues gain;
+      if (get_panel_gain(index, gain)) {
+        Image<double> result = gain_map_.get(gain);
+        revision = gain_map_.get_revision();
+        return result;
+      }
+    }
+    revision = external_lookup().gain().get_revision();
+    return external_lookup().gain().get_data();
+  }
+
+  /**
+   * Get the pedestal map, along with the revision of its arrays
+   * @param index The image index
+   * @param revision The revision of the pedestal map
+   * @returns The pedestal image
+   */
+  Image<double> get_pedestal(std::size_t index, std::size_t &revision) {
+    // If the external lookup is empty
+    DXTBX_ASSERT(index < indices_.size());
+    if (external_lookup().pedestal().get_data().empty()) {
+      // If using the pedestal from the panel, get the pedestal map
+      detail::PanelValues pedestal;
+      if (get_panel_pedestal(index, pedestal)) {
+        Image<double> result = pedestal_map_.get(pedestal);
+        revision = pedestal_map_.get_revision();
+        return result;
+      }
+    }
+    revision = external_lookup().pedestal().get_revision();
+    return external_lookup().pedestal().get_data();
+  }
+
+  /**
+   * Get the static mask, only rebuilding it when the external mask is
+   * set again or a panel size or untrusted rectangle changes. The result
+   * is shared with the cache so must not be modified.
+   */
+  Image<bool> get_cached_static_mask() {
+    detail::StaticMaskKey key;
+    key.external = external_lookup().mask().get_revision();
+    detector_ptr detector_for_image = get_detector_for_image(0);
+    const Detector &detector = detail::safe_const_reference(detector_for_image);
+    for (std::size_t i = 0; i < detector.size(); ++i) {
+      scitbx::af::shared<scitbx::af::int4> rectangles = detector[i].get_mask();
+      key.panels.push_back(detector[i].get_image_size()[0]);
+      key.panels.push_back(detector[i].get_image_size()[1]);
+      key.panels.push_back(rectangles.size());
+      for (std::size_t j = 0; j < rectangles.size(); ++j) {
+        key.panels.insert(key.panels.end(), rectangles[j].begin(), rectangles[j].end());
+      }
+    }
+    if (!(key == static_mask_key_) || static_mask_.n_tiles() != detector.size()) {
+      static_mask_ = get_untrusted_rectangle_mask(get_external_mask(get_empty_mask()));
+      static_mask_key_ = key;
+    }
+    return static_mask_;
+  }
+
+  /**
+   * Apply the trusted range of each panel to the mask
+   */
+  template <typename T>
+  static void apply_trusted_range_mask(const Detector &detector,
+                                       const Image<T> &data,
+                                       Image<bool> &mask) {
+    DXTBX_ASSERT(mask.n_tiles() == data.n_tiles());
+    DXTBX_ASSERT(data.n_tiles() == detector.size());
+    for (std::size_t i = 0; i < detector.size(); ++i) {
+      detector[i].apply_trusted_range_mask(data.tile(i).data().const_ref(),
+                                           mask.tile(i).data().ref());
+    }
+  }
+
+  /**
+   * Get the gain of each panel
+   * @param index The image index
+   * @param gain Set to the panel gains and sizes
+   * @returns True if the panel gains are usable and not all one
+   */
+  bool get_panel_gain(std::size_t index, detail::PanelValues &gain) {
+    detector_ptr detector_for_image = get_detector_for_image(index);
+    const Detector &detector = detail::safe_const_reference(detector_for_image);
+    bool need_gain_map = false;
+    for (std::size_t i = 0; i < detector.size(); ++i) {
+      double value = detector[i].get_gain();
+      if (value <= 0) {
+        return false;
+      } else if (std::abs(value - 1.0) > 1e-7) {
+        need_gain_map = true;
+      }
+      gain.values.push_back(value);
+      gain.sizes.push_back(detector[i].get_image_size()[1]);
+      gain.sizes.push_back(detector[i].get_image_size()[0]);
+    }
+    return need_gain_map;
+  }
+
+  /**
+   * Get the pedestal of each panel
+   * @param index The image index
+   * @param pedestal Set to the panel pedestals and sizes
+   * @returns True if any panel pedestal is not zero
+   */
+  bool get_panel_pedestal(std::size_t index, detail::PanelValues &pedestal) {
+    detector_ptr detector_for_image = get_detector_for_image(index);
+    const Detector &detector = detail::safe_const_reference(detector_for_image);
+    bool use_detector_pedestal = false;
+    for (std::size_t i = 0; i < detector.size(); ++i) {
+      double value = detector[i].get_pedestal();
+      if (std::abs(value) > 1e-7) {
+        use_detector_pedestal = true;
+      }
+      pedestal.values.push_back(value);
+      pedestal.sizes.push_back(detector[i].get_image_size()[1]);
+      pedestal.sizes.push_back(detector[i].get_image_size()[0]);
+    }
+    return use_detector_pedestal;
+  }
+
+  /**
+   * Get the corrections for an image. When neither the gain nor the
+   * pedestal comes from the external lookup they are constant per panel
+   * and no maps are needed.
+   * @param index The image index
+   * @returns The corrections
+   */
+  template <typename T>
+  detail::ImageCorrection<T> get_correction(std::size_t index) {
+    detail::ImageCorrection<T> result;
+    if (external_lookup().gain().get_data().empty()
+        && external_lookup().pedestal().get_data().empty()) {
+      detail::PanelValues gain, dark;
+      bool use_gain = get_panel_gain(index, gain);
+      bool use_dark = get_panel_pedestal(index, dark);
+      std::size_t n = dark.values.size();
+      result.apply = use_gain || use_dark;
+      result.offset.assign(n, 0);
+      result.scale.assign(n, 1);
+      result.dark.assign(n, NULL);
+      result.inverse_gain.assign(n, NULL);
+      for (std::size_t i = 0; i < n; ++i) {
+        if (use_dark) {
+          result.offset[i] = dark.values[i];
+        }
+        if (use_gain) {
+          result.scale[i] = 1.0 / gain.values[i];
+        }
+      }
+      return result;
+    }
+
+    // Get the multi-tile gain and pedestal
+    get_correction_maps(index, result.dark_map, result.inverse_gain_map);
+    std::size_t n =
+      std::max(result.dark_map.n_tiles(), result.inverse_gain_map.n_tiles());
+    DXTBX_ASSERT(result.dark_map.n_tiles() == 0 || result.dark_map.n_tiles() == n);
+    DXTBX_ASSERT(result.inverse_gain_map.n_tiles() == 0
+                 || result.inverse_gain_map.n_tiles() == n);
+    result.apply = n > 0;
+    result.offset.assign(n, 0);
+    result.scale.assign(n, 1);
+    result.dark.assign(n, NULL);
+    result.inverse_gain.assign(n, NULL);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (result.dark_map.n_tiles() > 0 && result.dark_map.tile(i).data().size() > 0) {
+        result.dark[i] = result.dark_map.tile(i).data().begin();
+      }
+      if (result.inverse_gain_map.n_tiles() > 0
+          && result.inverse_gain_map.tile(i).data().size() > 0) {
+        result.inverse_gain[i] = result.inverse_gain_map.tile(i).data().begin();
+      }
+    }
+    return result;
+  }
+
+  /**
+   * Get the pedestal and inverse gain maps
+   */
+  void get_correction_maps(std::size_t index,
+                           Image<double> &dark,
+                           Image<double> &inverse_gain) {
+    dark = get_pedestal(index);
+    inverse_gain = get_inverse_gain(index);
+  }
+
+  /**
+   * Get the pedestal and inverse gain maps in single precision
+   */
+  void get_correction_maps(std::size_t index,
+                           Image<float> &dark,
+                           Image<float> &inverse_gain) {
+    std::size_t revision = 0;
+    Image<double> pedestal = get_pedestal(index, revision);
+    dark = float_pedestal_.get(pedestal, revision);
+    Image<double> inverse = get_inverse_gain(index);
+    inverse_gain = float_inverse_gain_.get(inverse, inverse_gain_revision_);
+  }
+
+  /**
+   * Correct an image in thread safe mode. The correction maps come from
+   * the caches, so they are only touched with the GIL held, and the pixels
+   * are corrected with it released.
+   */
+  template <typename T>
+  Image<T> get_corrected_data_thread_safe(std::size_t index) {
+    boost_python::scoped_gil_acquire acquire_gil;
+    detail::ImageCorrection<T> correction = get_correction<T>(index);
+    if (!correction.apply) {
+      return get_raw_data_as(index, T());
+    }
+    return correct_raw_data_without_gil(get_raw_data(index), correction);
+  }
+
+  /**
+   * Correct a raw image which has already been read in thread safe mode
+   */
+  template <typename T>
+  Image<T> get_corrected_data_thread_safe(std::size_t index,
+                                          const ImageBuffer &buffer) {
+    boost_python::scoped_gil_acquire acquire_gil;
+    detail::ImageCorrection<T> correction = get_correction<T>(index);
+    if (!correction.apply) {
+      return convert_raw_data(buffer, T());
+    }
+    return correct_raw_data_without_gil(buffer, correction);
+  }
+
+  /**
+   * Correct straight from the raw pixels where the type allows, with the
+   * GIL released. The GIL must be held on entry.
+   */
+  template <typename T>
+  Image<T> correct_raw_data_without_gil(const ImageBuffer &buffer,
+                                        const detail::ImageCorrection<T> &correction) {
+    if (buffer.is_int()) {
+      return correct_image_without_gil(buffer.as_int(), correction);
+    } else if (buffer.is_float()) {
+      return correct_image_without_gil(buffer.as_float(), correction);
+    } else if (buffer.is_double()) {
+      return correct_image_without_gil(buffer.as_double(), correction);
+    } else if (buffer.is_uint16()) {
+      return correct_image_without_gil(buffer.as_uint16(), correction);
+    } else if (buffer.is_uint8()) {
+      return correct_image_without_gil(buffer.as_uint8(), correction);
+    }
+    return correct_image_without_gil(convert_raw_data(buffer, T()), correction);
+  }
+
+  /**
+   * Correct straight from the raw pixels where the type allows
+   */
+  template <typename T>
+  Image<T> correct_raw_data(const ImageBuffer &buffer,
+                            const detail::ImageCorrection<T> &correction) {
+    ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CORRECT);
+    if (buffer.is_int()) {
+      return correct_image(buffer.as_int(), correction);
+    } else if (buffer.is_float()) {
+      return correct_image(buffer.as_float(), correction);
+    } else if (buffer.is_double()) {
+      return correct_image(buffer.as_double(), correction);
+    } else if (buffer.is_uint16()) {
+      return correct_image(buffer.as_uint16(), correction);
+    } else if (buffer.is_uint8()) {
+      return correct_image(buffer.as_uint8(), correction);
+    }
+    return correct_image(convert_raw_data(buffer, T()), correction);
+  }
+
+  /**
+   * Apply the corrections to each tile of a raw image with the GIL
+   * released. The GIL must be held on entry.
+   */
+  template <typename T, typename F>
+  Image<F> correct_image_without_gil(const Image<T> &data,
+                                     const detail::ImageCorrection<F> &correction) {
+    correction.check(data);
+    Image<F> result = Image<F>::allocate(tile_grids(data));
+    std::vector<const T *> source;
+    std::vector<F *> target;
+    std::vector<std::size_t> sizes;
+    for (std::size_t i = 0; i < data.n_tiles(); ++i) {
+      source.push_back(data.tile_ref(i).begin());
+      target.push_back(result.tile_ref(i).data().begin());
+      sizes.push_back(data.tile_ref(i).accessor().size_1d());
+    }
+    boost_python::scoped_gil_release release_gil;
+    ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CORRECT);
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+      correction.correct(i, source[i], target[i], sizes[i]);
+    }
+    return result;
+  }
+
+  /**
+   * Apply the corrections to each tile of a raw image
+   */
+  template <typename T, typename F>
+  static Image<F> correct_image(const Image<T> &data,
+                                const detail::ImageCorrection<F> &correction) {
+    correction.check(data);
+    Image<F> result = Image<F>::allocate(tile_grids(data));
+    for (std::size_t i = 0; i < data.n_tiles(); ++i) {
+      const ImageTile<T> &tile = data.tile_ref(i);
+      correction.correct(
+        i, tile.begin(), result.tile_ref(i).data().begin(), tile.accessor().size_1d());
+    }
+    return result;
+  }
+
+  /**
+   * @returns The size of each tile of an image
+   */
+  template <typename T>
+  static std::vector<scitbx::af::c_grid<2> > tile_grids(const Image<T> &image) {
+    std::vector<scitbx::af::c_grid<2> > grids;
+    for (std::size_t j = 0; j < image.n_tiles(); ++j) {
+      grids.push_back(image.tile(j).data().accessor());
+    }
+    return grids;
+  }
+
+  /**
+   * Check every image has tiles of the given sizes
+   */
+  static void check_block_shape(const std::vector<scitbx::af::c_grid<2> > &grids,
+                                const std::vector<ImageBuffer> &frames) {
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+      std::vector<scitbx::af::c_grid<2> > frame_grids = frames[i].tile_accessors();
+      DXTBX_ASSERT(frame_grids.size() == grids.size());
+      for (std::size_t j = 0; j < grids.size(); ++j) {
+        DXTBX_ASSERT(frame_grids[j].all_eq(grids[j]));
+      }
+    }
+  }
+
+  /**
+   * The pixel type of a raw image in a corrected block
+   */
+  enum PixelType {
+    INT_PIXELS,
+    FLOAT_PIXELS,
+    DOUBLE_PIXELS,
+    UINT16_PIXELS,
+    UINT8_PIXELS
+  };
+
+  /**
+   * Check a raw image against its correction and add its tile pointers
+   */
+  template <typename R, typename F>
+  static void add_block_source(const Image<R> &image,
+                               const detail::ImageCorrection<F> &correction,
+                               std::vector<const void *> &source) {
+    correction.check(image);
+    for (std::size_t j = 0; j < image.n_tiles(); ++j) {
+      source.push_back(image.tile_ref(j).begin());
+    }
+  }
+
+  /**
+   * Allocate a block with one (n, slow, fast) array per tile
+   */
+  template <typename T>
+  static std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > > allocate_block(
+    const std::vector<scitbx::af::c_grid<2> > &grids,
+    std::size_t n) {
+    std::vector<scitbx::af::versa<T, scitbx::af::c_grid<3> > > block;
+    for (std::size_t j = 0; j < grids.size(); ++j) {
+      block.push_back(scitbx::af::versa<T, scitbx::af::c_grid<3> >(
+        scitbx::af::c_grid<3>(n, grids[j][0], grids[j][1]),
+        scitbx::af::init_functor_null<T>()));
+    }
+    return block;
+  }
+
+  /**
+   * Queue the images after index which are not already cached
+   */
+  void schedule_prefetch(std::size_t index) {
+    ImagePrefetcher *prefetcher = get_prefetcher();
+    if (prefetcher == NULL) {
+      return;
+    }
+    std::vector<std::size_t> wanted;
+    for (std::size_t i = index + 1; i <= index + prefetch_depth_ && i < size(); ++i) {
+      if (!data_cache_.contains(i)) {
+        wanted.push_back(i);
+      }
+    }
+    prefetcher->schedule(wanted);
+  }
+
+  /**
+   * @returns The prefetcher, started first if prefetching is enabled but
+   *          this copy of the imageset has none yet, or NULL if the
+   *          imageset is not prefetching
+   */
+  ImagePrefetcher *get_prefetcher() {
+    if (prefetch_depth_ > 0 && prefetcher_.get() == NULL) {
+      prefetcher_.reset(new ImagePrefetcher(data_, indices_, prefetch_threads_));
+    }
+    return prefetcher_.get();
+  }
 
   Image<double> get_raw_data_as_double(std::size_t index) {
     DXTBX_ASSERT(index < indices_.size());
-    if (double_raw_data_cache_.index == index) {
-      return double_raw_data_cache_.image;
+    if (thread_safe_) {
+      boost_python::scoped_gil_acquire acquire_gil;
+      Image<double> image;
+      if (!double_raw_data_cache_.get(index, image)) {
+        ImageBuffer buffer = get_raw_data(index);
+        {
+          boost_python::scoped_gil_release release_gil;
+          ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CONVERT);
+          image = buffer.as_double();
+        }
+        double_raw_data_cache_.put(index, image);
+      }
+      return detail::copy_image_without_gil(image);
+    }
+    Image<double> image;
+    if (double_raw_data_cache_.get(index, image)) {
+      return image;
     }
-    Image<double> image = get_raw_data(index).as_double();
-    double_raw_data_cache_.index = index;
-    double_raw_data_cache_.image = image;
+    ImageBuffer buffer = get_raw_data(index);
+    {
+      ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CONVERT);
+      image = buffer.as_double();
+    }
+    double_raw_data_cache_.put(index, image);
     return image;
   }
+
+  Image<double> get_raw_data_as(std::size_t index, double) {
+    return get_raw_data_as_double(index);
+  }
+
+  Image<float> get_raw_data_as(std::size_t index, float) {
+    return convert_raw_data(get_raw_data(index), float());
+  }
+
+  /**
+   * Convert a raw image which has already been read. The buffer is private
+   * to this thread in thread safe mode, so the GIL is released.
+   */
+  Image<double> convert_raw_data(const ImageBuffer &buffer, double) {
+    boost_python::scoped_gil_release release_gil(thread_safe_);
+    ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CONVERT);
+    return buffer.as_double();
+  }
+
+  Image<float> convert_raw_data(const ImageBuffer &buffer, float) {
+    boost_python::scoped_gil_release release_gil(thread_safe_);
+    ScopedStageTimer timer(&data_.statistics(), ReadStatistics::CONVERT);
+    return buffer.as_float();
+  }
 };
 
 /**
@@ -1231,7 +2690,8 @@ public:
         beam_(beam),
         detector_(detector),
         goniometer_(goniometer),
-        scan_(scan) {
+        scan_(scan),
+        shadow_tolerance_(0) {
     // Check the scan is the same length and number of images
     DXTBX_ASSERT(scan.get() != NULL);
     if (data.size() > 1) {
@@ -1268,7 +2728,8 @@ public:
         beam_(beam),
         detector_(detector),
         goniometer_(goniometer),
-        scan_(scan) {
+        scan_(scan),
+        shadow_tolerance_(0) {
     // Check the scan is the same length as number of indices
     DXTBX_ASSERT(scan.get() != NULL);
 
@@ -1296,12 +2757,15 @@ public:
    */
   virtual ~ImageSequence() {}
 
+  using ImageSet::get_dynamic_mask;
+
   /**
    * Get the dynamic mask for the requested image
    * @param index The image index
+   * @param buffer The raw data for the image
    * @returns The image mask
    */
-  virtual Image<bool> get_dynamic_mask(std::size_t index) {
+  virtual Image<bool> get_dynamic_mask(std::size_t index, const ImageBuffer &buffer) {
     // Get the masker
     ImageSetData::masker_ptr masker = data_.masker();
 
@@ -1312,13 +2776,154 @@ public:
     if (masker != NULL) {
       DXTBX_ASSERT(scan_ != NULL);
       DXTBX_ASSERT(detector_ != NULL);
-      double scan_angle = rad_as_deg(
-        scan_->get_angle_from_image_index(index + scan_->get_image_range()[0]));
-      dyn_mask = masker->get_mask(*detector_, scan_angle);
+      double scan_angle = get_scan_angle(index);
+      if (shadow_tolerance_ > 0) {
+        check_shadow_cache(masker);
+        long long bin = get_shadow_bin(scan_angle);
+        if (!shadow_cache_.get(bin, dyn_mask)) {
+          dyn_mask = masker->get_mask(*detector_, get_shadow_bin_angle(bin));
+          shadow_cache_.put(bin, dyn_mask);
+        }
+        // The static and trusted range masks are applied in place
+        dyn_mask = detail::copy_image(dyn_mask);
+      } else {
+        dyn_mask = masker->get_mask(*detector_, scan_angle);
+      }
     }
 
     // Return the dynamic mask
-    return get_trusted_range_mask(get_static_mask(dyn_mask), index);
+    return get_trusted_range_mask(get_static_mask(dyn_mask), index, buffer);
+  }
+
+  /**
+   * Cache the goniometer shadow masks. The scan angle is split into bins of
+   * the given width, and one mask, computed at the centre of the bin, is
+   * used for all the images in it. The shadow moves slowly with the scan
+   * angle, so with fine slicing many images share a bin.
+   * @param tolerance The bin width in degrees
+   * @param max_bytes The memory limit of the cache in bytes. The most
+   *        recently used mask is always kept.
+   */
+  void enable_dynamic_mask_cache(double tolerance, std::size_t max_bytes) {
+    DXTBX_ASSERT(tolerance > 0);
+    if (tolerance != shadow_tolerance_) {
+      shadow_cache_.clear();
+    }
+    shadow_tolerance_ = tolerance;
+    shadow_cache_.set_max_bytes(max_bytes);
+  }
+
+  /**
+   * Stop caching the goniometer shadow masks and free the cached masks
+   */
+  void disable_dynamic_mask_cache() {
+    shadow_tolerance_ = 0;
+    shadow_cache_.clear();
+  }
+
+  /**
+   * @returns The shadow mask cache bin width in degrees, zero if the cache
+   *          is not enabled
+   */
+  double get_dynamic_mask_tolerance() const {
+    return shadow_tolerance_;
+  }
+
+  /**
+   * @returns The cache of goniometer shadow masks, keyed by angle bin
+   */
+  const DataCache<Image<bool>, long long> &dynamic_mask_cache() const {
+    return shadow_cache_;
+  }
+
+  /**
+   * Compute the shadow masks for all the angle bins of the sequence ahead
+   * of time. The parts of the models that are needed are copied into a
+   * GoniometerShadowSweepMasker, and the shadows are projected and
+   * rasterised on up to nthreads threads, so the models are never shared
+   * between threads.
+   * Only as many bins as fit in the cache are computed, starting from the
+   * beginning of the scan.
+   * @param nthreads The number of threads, zero for the default
+   */
+  void precompute_dynamic_masks(std::size_t nthreads) {
+    DXTBX_ASSERT(shadow_tolerance_ > 0);
+    ImageSetData::masker_ptr masker = data_.masker();
+    if (masker == NULL || size() == 0) {
+      return;
+    }
+    DXTBX_ASSERT(scan_ != NULL);
+    DXTBX_ASSERT(detector_ != NULL);
+    check_shadow_cache(masker);
+
+    // The size of one mask
+    std::size_t mask_nbytes = 0;
+    for (std::size_t i = 0; i < detector_->size(); ++i) {
+      vec2<std::size_t> image_size = (*detector_)[i].get_image_size();
+      mask_nbytes += image_size[0] * image_size[1] * sizeof(bool);
+    }
+    std::size_t capacity = std::max<std::size_t>(
+      shadow_cache_.max_bytes() / std::max<std::size_t>(mask_nbytes, 1), 1);
+
+    // The bins not yet cached, in scan order
+    std::vector<long long> bins;
+    std::set<long long> seen;
+    for (std::size_t i = 0; i < size() && bins.size() < capacity; ++i) {
+      long long bin = get_shadow_bin(get_scan_angle(i));
+      if (seen.insert(bin).second && !shadow_cache_.contains(bin)) {
+        bins.push_back(bin);
+      }
+    }
+
+    // Project and rasterise the shadows in parallel
+    GoniometerShadowSweepMasker sweep(masker, *detector_);
+    scitbx::af::shared<double> angles;
+    for (std::size_t j = 0; j < bins.size(); ++j) {
+      angles.push_back(get_shadow_bin_angle(bins[j]));
+    }
+    std::vector<Image<bool> > masks;
+    {
+      boost_python::scoped_gil_release release_gil;
+      masks = sweep.get_masks(angles.const_ref(), nthreads);
+    }
+
+    // Add the last bins first, so the start of the scan is the most recent
+    for (std::size_t j = bins.size(); j > 0; --j) {
+      shadow_cache_.put(bins[j - 1], masks[j - 1]);
+    }
+  }
+
+  /**
+   * Read the images following each one requested on background threads,
+   * so that reading overlaps with processing. The images are read in scan
+   * order and go into the image cache when used, so the cache should be
+   * large enough to hold them if they are to be reused.
+   * @param depth The number of images to read ahead
+   * @param nthreads The number of reader threads. The reader is only
+   *        called from more than one thread at once if this is above one.
+   */
+  void enable_prefetch(std::size_t depth, std::size_t nthreads) {
+    DXTBX_ASSERT(depth > 0);
+    DXTBX_ASSERT(!thread_safe_);
+    prefetcher_.reset();
+    prefetcher_.reset(new ImagePrefetcher(data_, indices_, nthreads));
+    prefetch_depth_ = depth;
+    prefetch_threads_ = nthreads;
+  }
+
+  /**
+   * Stop reading ahead
+   */
+  void disable_prefetch() {
+    prefetcher_.reset();
+    prefetch_depth_ = 0;
+  }
+
+  /**
+   * @returns The number of images read ahead, zero if not prefetching
+   */
+  std::size_t get_prefetch_depth() const {
+    return prefetch_depth_;
   }
 
   /**
@@ -1374,6 +2979,7 @@ public:
    */
   void set_detector(const detector_ptr &detector) {
     detector_ = detector;
+    shadow_cache_.clear();
     for (std::size_t i = 0; i < size(); ++i) {
       ImageSet::set_detector_for_image(detector_, i);
     }
@@ -1413,6 +3019,10 @@ public:
       }
     }
     DXTBX_ASSERT(scan->get_num_images() == size());
+    if (prefetch_depth_ > 0) {
+      // The indices may have changed
+      enable_prefetch(prefetch_depth_, prefetch_threads_);
+    }
     scan_ = scan;
     for (std::size_t i = 0; i < size(); ++i) {
       ImageSet::set_scan_for_image(scan_ptr(new Scan((*scan)[i])), i);
@@ -1534,10 +3144,45 @@ public:
   }
 
 protected:
+  /**
+   * @returns The scan angle of an image in degrees
+   */
+  double get_scan_angle(std::size_t index) const {
+    return rad_as_deg(
+      scan_->get_angle_from_image_index(index + scan_->get_image_range()[0]));
+  }
+
+  long long get_shadow_bin(double scan_angle) const {
+    return (long long)std::floor(scan_angle / shadow_tolerance_);
+  }
+
+  double get_shadow_bin_angle(long long bin) const {
+    return (bin + 0.5) * shadow_tolerance_;
+  }
+
+  /**
+   * Empty the shadow mask cache if the masker, the detector or the
+   * goniometer has changed since the masks in it were made
+   */
+  void check_shadow_cache(const ImageSetData::masker_ptr &masker) {
+    detail::ShadowMaskKey key;
+    key.masker = masker.get();
+    key.masker_goniometer = masker->goniometer().get_revision();
+    key.detector = detector_->get_revision();
+    key.goniometer = goniometer_ != NULL ? goniometer_->get_revision() : 0;
+    if (!(key == shadow_key_)) {
+      shadow_cache_.clear();
+      shadow_key_ = key;
+    }
+  }
+
   beam_ptr beam_;
   detector_ptr detector_;
   goniometer_ptr goniometer_;
   scan_ptr scan_;
+  double shadow_tolerance_;
+  DataCache<Image<bool>, long long> shadow_cache_;
+  detail::ShadowMaskKey shadow_key_;
 };
 
 }  // namespace dxtbx
@@ -243,6 +243,14 @@ class ImageSetLazy(ImageSet):
             self._load_models(index)
         return self._get_item_from_parent_or_format("mask", index)
 
+    def get_frame(self, index, single_precision=None):
+        """
+        Load the models first, as for get_mask.
+        """
+        if getattr(super(), "get_detector")(index) is None:
+            self._load_models(index)
+        return super().get_frame(index, single_precision)
+
     def get_goniometer(self, index=None):
         return self._get_item_from_parent_or_format("goniometer", index)
 
@@ -275,9 +283,9 @@ class ImageSetLazy(ImageSet):
         self._load_models(item)
         return super().__getitem__(item)
 
-    def get_corrected_data(self, index):
+    def get_corrected_data(self, index, single_precision=None):
         self._load_models(index)
-        return super().get_corrected_data(index)
+        return super().get_corrected_data(index, single_precision)
 
     def get_gain(self, index):
         self._load_models(index)
@@ -0,0 +1,173 @@
+/*
+ * instrumentation.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_INSTRUMENTATION_H
+#define DXTBX_INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace dxtbx {
+
+  /**
+   * Cumulative times and counts for each stage of reading and processing
+   * an image, with the number of image bytes read. The counters are atomic
+   * so that images read on prefetch threads are counted too.
+   *
+   * Stage times are inclusive, so the time of a stage includes that of any
+   * stage run inside it, e.g. decompression inside a native read, or a read
+   * for an image that was not cached when its mask was asked for.
+   *
+   * Collection is on by default and can be switched off at run time with
+   * set_enabled, or at compile time by defining
+   * DXTBX_DISABLE_INSTRUMENTATION, which makes the timers do nothing.
+   */
+  class ReadStatistics {
+  public:
+    enum Stage { READ, DECOMPRESS, CONVERT, CORRECT, MASK, NUM_STAGES };
+
+    /**
+     * @returns The name of a stage
+     */
+    static const char *stage_name(Stage stage) {
+      static const char *names[NUM_STAGES] = {
+        "read", "decompress", "convert", "correct", "mask"};
+      return names[stage];
+    }
+
+    /**
+     * @returns Whether the instrumentation was compiled in
+     */
+    static bool compiled() {
+#ifdef DXTBX_DISABLE_INSTRUMENTATION
+      return false;
+#else
+      return true;
+#endif
+    }
+
+    ReadStatistics() : enabled_(compiled()) {
+      reset();
+    }
+
+    /**
+     * @returns Whether statistics are being collected
+     */
+    bool enabled() const {
+      return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Start or stop collecting statistics. They can only be collected if
+     * the instrumentation was compiled in.
+     * @param enabled True to collect statistics
+     */
+    void set_enabled(bool enabled) {
+      enabled_ = enabled && compiled();
+    }
+
+    /**
+     * Add a run of a stage
+     * @param stage The stage
+     * @param nanoseconds The time taken
+     */
+    void add_time(Stage stage, std::uint64_t nanoseconds) {
+      count_[stage].fetch_add(1, std::memory_order_relaxed);
+      nanoseconds_[stage].fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    /**
+     * Add to the number of image bytes read
+     * @param nbytes The number of bytes
+     */
+    void add_bytes(std::size_t nbytes) {
+      if (enabled()) {
+        bytes_.fetch_add(nbytes, std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * @returns The number of times a stage has run
+     */
+    std::uint64_t count(Stage stage) const {
+      return count_[stage].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @returns The total time spent in a stage in seconds
+     */
+    double seconds(Stage stage) const {
+      return nanoseconds_[stage].load(std::memory_order_relaxed) * 1e-9;
+    }
+
+    /**
+     * @returns The number of image bytes read
+     */
+    std::uint64_t bytes() const {
+      return bytes_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Set all the counters back to zero
+     */
+    void reset() {
+      for (std::size_t i = 0; i < NUM_STAGES; ++i) {
+        count_[i] = 0;
+        nanoseconds_[i] = 0;
+      }
+      bytes_ = 0;
+    }
+
+  private:
+    ReadStatistics(const ReadStatistics &);
+    ReadStatistics &operator=(const ReadStatistics &);
+
+    std::atomic<bool> enabled_;
+    std::atomic<std::uint64_t> count_[NUM_STAGES];
+    std::atomic<std::uint64_t> nanoseconds_[NUM_STAGES];
+    std::atomic<std::uint64_t> bytes_;
+  };
+
+  /**
+   * Time a stage from construction to destruction. Nothing is timed if the
+   * statistics are NULL or not enabled.
+   */
+  class ScopedStageTimer {
+  public:
+#ifdef DXTBX_DISABLE_INSTRUMENTATION
+    ScopedStageTimer(ReadStatistics *, ReadStatistics::Stage) {}
+#else
+    typedef std::chrono::steady_clock clock;
+
+    ScopedStageTimer(ReadStatistics *stats, ReadStatistics::Stage stage)
+        : stats_(stats != NULL && stats->enabled() ? stats : NULL), stage_(stage) {
+      if (stats_ != NULL) {
+        start_ = clock::now();
+      }
+    }
+
+    ~ScopedStageTimer() {
+      if (stats_ != NULL) {
+        std::chrono::nanoseconds elapsed = clock::now() - start_;
+        stats_->add_time(stage_, elapsed.count());
+      }
+    }
+
+  private:
+    ScopedStageTimer(const ScopedStageTimer &);
+    ScopedStageTimer &operator=(const ScopedStageTimer &);
+
+    ReadStatistics *stats_;
+    ReadStatistics::Stage stage_;
+    clock::time_point start_;
+#endif
+  };
+
+}  // namespace dxtbx
+
+#endif  // DXTBX_INSTRUMENTATION_H
@@ -11,6 +11,8 @@ from dxtbx.model import MultiAxisGoniometer
 try:
     from ..dxtbx_masking_ext import (
         GoniometerShadowMasker,
+        GoniometerShadowSweepMasker,
+        ResolutionMaskGenerator,
         SmarGonShadowMasker,
         is_inside_polygon,
         mask_untrusted_circle,
@@ -20,6 +22,8 @@ try:
 except ModuleNotFoundError:
     from dxtbx_masking_ext import (  # type: ignore
         GoniometerShadowMasker,
+        GoniometerShadowSweepMasker,
+        ResolutionMaskGenerator,
         SmarGonShadowMasker,
         is_inside_polygon,
         mask_untrusted_circle,
@@ -29,6 +33,8 @@ except ModuleNotFoundError:
 
 __all__ = [
     "GoniometerShadowMasker",
+    "GoniometerShadowSweepMasker",
+    "ResolutionMaskGenerator",
     "SmarGonShadowMasker",
     "is_inside_polygon",
     "mask_untrusted_circle",
@@ -42,11 +42,46 @@ namespace dxtbx { namespace masking { namespace boost_python {
   }
 
   boost::python::tuple GoniometerShadowMasker_get_mask(
-
     GoniometerShadowMasker &masker,
     const Detector &detector,
+    double scan_angle,
+    std::size_t nthreads) {
+    return image_as_tuple<bool>(masker.get_mask(detector, scan_angle, nthreads));
+  }
+
+  std::shared_ptr<GoniometerShadowSweepMasker> make_sweep_masker(
+    std::shared_ptr<GoniometerShadowMasker> masker,
+    const Detector &detector) {
+    return std::make_shared<GoniometerShadowSweepMasker>(masker, detector);
+  }
+
+  static boost::python::list GoniometerShadowSweepMasker_project_extrema(
+    const GoniometerShadowSweepMasker &masker,
     double scan_angle) {
-    return image_as_tuple<bool>(masker.get_mask(detector, scan_angle));
+    boost::python::list list;
+    for (scitbx::af::shared<scitbx::vec2<double> > item :
+         masker.project_extrema(scan_angle)) {
+      list.append(item);
+    }
+    return list;
+  }
+
+  boost::python::tuple GoniometerShadowSweepMasker_get_mask(
+    const GoniometerShadowSweepMasker &masker,
+    double scan_angle) {
+    return image_as_tuple<bool>(masker.get_mask(scan_angle));
+  }
+
+  boost::python::list GoniometerShadowSweepMasker_get_masks(
+    const GoniometerShadowSweepMasker &masker,
+    const scitbx::af::const_ref<double> &scan_angles,
+    std::size_t nthreads) {
+    std::vector<Image<bool> > masks = masker.get_masks(scan_angles, nthreads);
+    boost::python::list result;
+    for (std::size_t i = 0; i < masks.size(); ++i) {
+      result.append(image_as_tuple<bool>(masks[i]));
+    }
+    return result;
   }
 
   struct GoniometerShadowMaskerPickleSuite : boost::python::pickle_suite {
@@ -70,12 +105,27 @@ namespace dxtbx { namespace masking { namespace boost_python {
 
     def("mask_untrusted_resolution_range", &mask_untrusted_resolution_range);
 
-    def("mask_untrusted_polygon", &mask_untrusted_polygon);
+    def("mask_untrusted_polygon",
+        &mask_untrusted_polygon,
+        (arg("mask"), arg("polygon"), arg("nthreads") = 1));
 
     def("is_inside_polygon", &is_inside_polygon);
 
     def("is_inside_polygon", &is_inside_polygon_a);
 
+    void (ResolutionMaskGenerator::*apply_range)(
+      scitbx::af::ref<bool, scitbx::af::c_grid<2> >, double, double) const =
+      &ResolutionMaskGenerator::apply;
+    void (ResolutionMaskGenerator::*apply_ranges)(
+      scitbx::af::ref<bool, scitbx::af::c_grid<2> >,
+      const scitbx::af::const_ref<vec2<double> > &) const =
+      &ResolutionMaskGenerator::apply;
+
+    class_<ResolutionMaskGenerator>("ResolutionMaskGenerator", no_init)
+      .def(init<const BeamBase &, const Panel &>((arg("beam"), arg("panel"))))
+      .def("apply", apply_range, (arg("mask"), arg("d_min"), arg("d_max")))
+      .def("apply", apply_ranges, (arg("mask"), arg("ranges")));
+
     class_<GoniometerShadowMasker>("GoniometerShadowMasker", no_init)
       .def(init<const MultiAxisGoniometer &,
                 const scitbx::af::const_ref<scitbx::vec3<double> > &,
@@ -84,7 +134,9 @@ namespace dxtbx { namespace masking { namespace boost_python {
       .def("extrema_at_scan_angle", &GoniometerShadowMasker::extrema_at_scan_angle)
       .def("set_goniometer_angles", &GoniometerShadowMasker::set_goniometer_angles)
       .def("project_extrema", GoniometerShadowMasker_project_extrema)
-      .def("get_mask", GoniometerShadowMasker_get_mask)
+      .def("get_mask",
+           GoniometerShadowMasker_get_mask,
+           (arg("detector"), arg("scan_angle"), arg("nthreads") = 1))
       .def_pickle(GoniometerShadowMaskerPickleSuite());
 
     class_<SmarGonShadowMasker, bases<GoniometerShadowMasker> >("SmarGonShadowMasker",
@@ -92,5 +144,19 @@ namespace dxtbx { namespace masking { namespace boost_python {
       .def(init<const MultiAxisGoniometer &>())
       .def("extrema_at_scan_angle", &SmarGonShadowMasker::extrema_at_scan_angle)
       .def_pickle(SmarGonShadowMaskerPickleSuite());
+
+    class_<GoniometerShadowSweepMasker, std::shared_ptr<GoniometerShadowSweepMasker> >(
+      "GoniometerShadowSweepMasker", no_init)
+      .def("__init__",
+           make_constructor(&make_sweep_masker,
+                            default_call_policies(),
+                            (arg("masker"), arg("detector"))))
+      .def("extrema_at_scan_angle",
+           &GoniometerShadowSweepMasker::extrema_at_scan_angle)
+      .def("project_extrema", GoniometerShadowSweepMasker_project_extrema)
+      .def("get_mask", GoniometerShadowSweepMasker_get_mask)
+      .def("get_masks",
+           GoniometerShadowSweepMasker_get_masks,
+           (arg("scan_angles"), arg("nthreads") = 0));
   }
 }}}  // namespace dxtbx::masking::boost_python
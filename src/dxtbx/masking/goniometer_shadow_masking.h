@@ -7,6 +7,8 @@
 #include <boost/geometry/geometries/adapted/boost_tuple.hpp>
 #include <boost/geometry/geometries/geometries.hpp>
 #include <cmath>
+#include <memory>
+#include <vector>
 #include <scitbx/array_family/shared.h>
 #include <dxtbx/error.h>
 #include <dxtbx/masking/masking.h>
@@ -14,6 +16,7 @@
 #include <dxtbx/model/detector.h>
 #include <dxtbx/model/multi_axis_goniometer.h>
 #include <dxtbx/model/panel.h>
+#include <dxtbx/parallel.h>
 #include <scitbx/math/r3_rotation.h>
 
 BOOST_GEOMETRY_REGISTER_BOOST_TUPLE_CS(boost::geometry::cs::cartesian)
@@ -29,82 +32,45 @@ namespace dxtbx { namespace masking {
   using scitbx::vec3;
   using scitbx::constants::pi;
 
-  /**
-   * A class to mask multiple resolution ranges
-   */
-  class GoniometerShadowMasker {
-  public:
+  namespace detail {
+
     /**
-     * Initialise the resolution at each pixel
-     * @param beam The beam model
-     * @param panel The panel model
+     * The parts of a panel needed to project a shadow onto it. These are
+     * taken once, so that shadows may be projected for many scan angles, and
+     * from several threads.
      */
-    GoniometerShadowMasker(const MultiAxisGoniometer &goniometer,
-                           const scitbx::af::const_ref<vec3<double> > &extrema_at_datum,
-                           const scitbx::af::const_ref<std::size_t> &axis,
-                           bool invert_mask = false)
-        : goniometer_(goniometer),
-          extrema_at_datum_(extrema_at_datum.begin(), extrema_at_datum.end()),
-          axis_(axis.begin(), axis.end()),
-          invert_mask_(invert_mask) {}
-
-    GoniometerShadowMasker(const MultiAxisGoniometer &goniometer)
-        : goniometer_(goniometer), invert_mask_(false) {}
-
-    MultiAxisGoniometer goniometer() const {
-      return goniometer_;
-    }
-
-    scitbx::af::shared<vec3<double> > extrema_at_datum() const {
-      return scitbx::af::shared<vec3<double> >(extrema_at_datum_.begin(),
-                                               extrema_at_datum_.end());
-    }
-
-    scitbx::af::shared<std::size_t> axis() const {
-      return scitbx::af::shared<std::size_t>(axis_.begin(), axis_.end());
-    }
-
-    virtual scitbx::af::shared<vec3<double> > extrema_at_scan_angle(
-      double scan_angle) const {
-      scitbx::af::shared<vec3<double> > axes = goniometer_.get_axes();
-      scitbx::af::shared<double> angles = goniometer_.get_angles();
-      std::size_t scan_axis = goniometer_.get_scan_axis();
-      angles[scan_axis] = scan_angle;
-      scitbx::af::shared<vec3<double> > extrema(extrema_at_datum_.begin(),
-                                                extrema_at_datum_.end());
-
-      for (std::size_t i = 0; i < axes.size(); i++) {
-        scitbx::mat3<double> rotation =
-          scitbx::math::r3_rotation::axis_and_angle_as_matrix(axes[i], angles[i], true);
-        for (std::size_t j = 0; j < axis_.size(); j++) {
-          if (axis_[j] > i) {
-            continue;
-          }
-          extrema[j] = rotation * extrema[j];
-        }
-      }
-      return extrema;
-    }
-
-    scitbx::af::shared<scitbx::af::shared<vec2<double> > > project_extrema(
-      const Detector &detector,
-      double scan_angle) const {
-      scitbx::af::shared<vec3<double> > coords = extrema_at_scan_angle(scan_angle);
-
+    class shadow_projector {
+    public:
       typedef boost::tuple<double, double> point_t;
       typedef boost::geometry::model::polygon<point_t> polygon_t;
       typedef boost::geometry::model::multi_point<point_t> multi_point_t;
 
-      scitbx::af::shared<scitbx::af::shared<vec2<double> > > result;
+      explicit shadow_projector(const Panel &panel)
+          : D_(panel.get_D_matrix()), pixel_size_(panel.get_pixel_size()) {
+        // Construct detector polygon - points should be clockwise
+        std::vector<point_t> corners;
+        corners.push_back(point_t(0, 0));
+        corners.push_back(point_t(0, panel.get_image_size_mm()[1]));
+        corners.push_back(
+          point_t(panel.get_image_size_mm()[0], panel.get_image_size_mm()[1]));
+        corners.push_back(point_t(panel.get_image_size_mm()[0], 0));
+        corners.push_back(point_t(0, 0));
+        boost::geometry::assign_points(det_, corners);
+      }
 
-      for (std::size_t i = 0; i < detector.size(); i++) {
-        Panel panel = detector[i];
+      /**
+       * Project the extrema onto the panel, and clip the shadow to it
+       * @param coords The extrema in the laboratory frame
+       * @returns The pixel coordinates of the shadow, empty if there is none
+       */
+      scitbx::af::shared<vec2<double> > project(
+        const scitbx::af::const_ref<vec3<double> > &coords) const {
         multi_point_t points;
         scitbx::af::shared<vec2<double> > shadow_points;
 
         /* project coordinates onto panel plane */
         for (std::size_t j = 0; j < coords.size(); j++) {
-          vec3<double> coord = panel.get_D_matrix() * coords[j];
+          vec3<double> coord = D_ * coords[j];
           double z = coord[2];
           double eps = 1e-5;
           if (z > eps) {
@@ -114,29 +80,16 @@ namespace dxtbx { namespace masking {
           }
         }
         if (points.size() < 3) {
-          result.push_back(shadow_points);
-          continue;
+          return shadow_points;
         }
 
         polygon_t poly;
         boost::geometry::convex_hull(points, poly);
 
         if (poly.outer().size() == 0) {
-          result.push_back(shadow_points);
-          continue;
+          return shadow_points;
         }
 
-        // Construct detector polygon - points should be clockwise
-        std::vector<point_t> corners;
-        corners.push_back(point_t(0, 0));
-        corners.push_back(point_t(0, panel.get_image_size_mm()[1]));
-        corners.push_back(
-          point_t(panel.get_image_size_mm()[0], panel.get_image_size_mm()[1]));
-        corners.push_back(point_t(panel.get_image_size_mm()[0], 0));
-        corners.push_back(point_t(0, 0));
-        polygon_t det;
-        boost::geometry::assign_points(det, corners);
-
         // Check the validity of the polygon
         boost::geometry::validity_failure_type failure;
         bool valid = boost::geometry::is_valid(poly, failure);
@@ -156,8 +109,7 @@ namespace dxtbx { namespace masking {
           std::cout << "Invalid polygon geometry (" << failure
                     << "): " << boost::geometry::dsv(poly) << std::endl;
           std::cout << boost::geometry::dsv(points) << std::endl;
-          result.push_back(shadow_points);
-          continue;
+          return shadow_points;
         }
 
         polygon_t shadow;
@@ -166,50 +118,196 @@ namespace dxtbx { namespace masking {
         // Compute the intersection of the shadow in the detector plane with the
         // detector
         std::deque<polygon_t> output;
-        boost::geometry::intersection(det, shadow, output);
+        boost::geometry::intersection(det_, shadow, output);
 
         // Extract the coordinates of the shadow on the detector, and convert from
         // mm to pixel coordinates
         if (output.size()) {
-          vec2<double> px = panel.get_pixel_size();
           polygon_t hull = output[0];
           for (point_t const &point : hull.outer()) {
-            vec2<double> p(boost::geometry::get<0>(point) / px[0],
-                           boost::geometry::get<1>(point) / px[1]);
+            vec2<double> p(boost::geometry::get<0>(point) / pixel_size_[0],
+                           boost::geometry::get<1>(point) / pixel_size_[1]);
             shadow_points.push_back(p);
           }
         }
-        result.push_back(shadow_points);
+        return shadow_points;
       }
-      return result;
+
+    private:
+      scitbx::mat3<double> D_;
+      vec2<double> pixel_size_;
+      polygon_t det_;
+    };
+
+  }  // namespace detail
+
+  /**
+   * A class to mask multiple resolution ranges
+   */
+  class GoniometerShadowMasker {
+  public:
+    /**
+     * Initialise the resolution at each pixel
+     * @param beam The beam model
+     * @param panel The panel model
+     */
+    GoniometerShadowMasker(const MultiAxisGoniometer &goniometer,
+                           const scitbx::af::const_ref<vec3<double> > &extrema_at_datum,
+                           const scitbx::af::const_ref<std::size_t> &axis,
+                           bool invert_mask = false)
+        : goniometer_(goniometer),
+          extrema_at_datum_(extrema_at_datum.begin(), extrema_at_datum.end()),
+          axis_(axis.begin(), axis.end()),
+          invert_mask_(invert_mask) {}
+
+    GoniometerShadowMasker(const MultiAxisGoniometer &goniometer)
+        : goniometer_(goniometer), invert_mask_(false) {}
+
+    MultiAxisGoniometer goniometer() const {
+      return goniometer_;
     }
 
-    Image<bool> get_mask(const Detector &detector, double scan_angle) const {
-      scitbx::af::shared<scitbx::af::shared<vec2<double> > > shadow_boundary =
-        project_extrema(detector, scan_angle);
+    scitbx::af::shared<vec3<double> > extrema_at_datum() const {
+      return scitbx::af::shared<vec3<double> >(extrema_at_datum_.begin(),
+                                               extrema_at_datum_.end());
+    }
 
-      Image<bool> mask;
+    scitbx::af::shared<std::size_t> axis() const {
+      return scitbx::af::shared<std::size_t>(axis_.begin(), axis_.end());
+    }
 
-      for (std::size_t i = 0; i < detector.size(); i++) {
-        Panel panel = detector[i];
+    /**
+     * @returns True if the extrema at a scan angle are just the extrema at
+     *          the datum moved by the goniometer axes, as here, so that the
+     *          rotations may be split as in GoniometerShadowSweepMasker
+     */
+    virtual bool has_rigid_extrema() const {
+      return true;
+    }
 
-        vec2<std::size_t> image_size = panel.get_image_size();
-        scitbx::af::versa<bool, scitbx::af::c_grid<2> > mask_data(
-          scitbx::af::c_grid<2>(image_size[1], image_size[0]), true);
+    virtual scitbx::af::shared<vec3<double> > extrema_at_scan_angle(
+      double scan_angle) const {
+      scitbx::af::shared<vec3<double> > axes = goniometer_.get_axes();
+      scitbx::af::shared<double> angles = goniometer_.get_angles();
+      std::size_t scan_axis = goniometer_.get_scan_axis();
+      angles[scan_axis] = scan_angle;
+      scitbx::af::shared<vec3<double> > extrema(extrema_at_datum_.begin(),
+                                                extrema_at_datum_.end());
 
-        ImageTile<bool> mask_tile(mask_data);
+      for (std::size_t i = 0; i < axes.size(); i++) {
+        scitbx::mat3<double> rotation =
+          scitbx::math::r3_rotation::axis_and_angle_as_matrix(axes[i], angles[i], true);
+        for (std::size_t j = 0; j < axis_.size(); j++) {
+          if (axis_[j] > i) {
+            continue;
+          }
+          extrema[j] = rotation * extrema[j];
+        }
+      }
+      return extrema;
+    }
+
+    scitbx::af::shared<scitbx::af::shared<vec2<double> > > project_extrema(
+      const Detector &detector,
+      double scan_angle) const {
+      scitbx::af::shared<vec3<double> > coords = extrema_at_scan_angle(scan_angle);
+      scitbx::af::shared<scitbx::af::shared<vec2<double> > > result;
+      for (std::size_t i = 0; i < detector.size(); i++) {
+        detail::shadow_projector projector(detector[i]);
+        result.push_back(projector.project(coords.const_ref()));
+      }
+      return result;
+    }
 
+    /**
+     * Compute the shadow mask at a scan angle
+     * @param detector The detector model
+     * @param scan_angle The scan angle
+     * @param nthreads The number of threads, zero for the default
+     * @returns The mask
+     */
+    Image<bool> get_mask(const Detector &detector,
+                         double scan_angle,
+                         std::size_t nthreads = 1) const {
+      scitbx::af::shared<vec2<std::size_t> > image_size;
+      for (std::size_t i = 0; i < detector.size(); i++) {
+        image_size.push_back(detector[i].get_image_size());
+      }
+      return mask_from_shadow(image_size.const_ref(),
+                              project_extrema(detector, scan_angle).const_ref(),
+                              nthreads);
+    }
+
+    /**
+     * Rasterise projected shadow boundaries into a mask. Only the arrays
+     * passed in are read, so this may be called from several threads at once
+     * as long as they are not modified. The panels are split into bands of
+     * rows, which are rasterised over the given number of threads.
+     * @param image_size The image size of each panel
+     * @param shadow_boundary The shadow on each panel, from project_extrema
+     * @param nthreads The number of threads, zero for the default
+     * @returns The mask
+     */
+    Image<bool> mask_from_shadow(
+      const scitbx::af::const_ref<vec2<std::size_t> > &image_size,
+      const scitbx::af::const_ref<scitbx::af::shared<vec2<double> > > &shadow_boundary,
+      std::size_t nthreads = 1) const {
+      DXTBX_ASSERT(image_size.size() == shadow_boundary.size());
+      typedef scitbx::af::versa<bool, scitbx::af::c_grid<2> > mask_type;
+
+      // Allocate the masks, and find the rows each shadow covers
+      std::vector<mask_type> mask_data;
+      std::vector<vec2<int> > rows;
+      std::vector<vec2<int> > cols;
+      for (std::size_t i = 0; i < image_size.size(); i++) {
+        mask_data.push_back(
+          mask_type(scitbx::af::c_grid<2>(image_size[i][1], image_size[i][0]), true));
+        int x0 = 0, x1 = 0, y0 = 0, y1 = 0;
         if (shadow_boundary[i].size() >= 3) {
-          mask_untrusted_polygon(mask_data.ref(), shadow_boundary[i].const_ref());
+          detail::polygon_bounds(
+            mask_data[i].ref(), shadow_boundary[i].const_ref(), x0, x1, y0, y1);
         }
-        if (invert_mask_) {
-          for (std::size_t j = 0; j < mask_data.size(); j++) {
-            mask_data[j] = !mask_data[j];
+        rows.push_back(vec2<int>(y0, y1));
+        cols.push_back(vec2<int>(x0, x1));
+      }
+
+      // Split each panel into enough bands of rows to keep the threads busy
+      std::size_t npanels = image_size.size();
+      std::size_t nbands = 1;
+      if (npanels > 0) {
+        nbands = (resolve_thread_count(nthreads) + npanels - 1) / npanels;
+      }
+      std::vector<scitbx::af::ref<bool, scitbx::af::c_grid<2> > > refs;
+      for (std::size_t i = 0; i < npanels; i++) {
+        refs.push_back(mask_data[i].ref());
+      }
+      std::size_t ntasks = npanels * nbands;
+      parallel_for(ntasks, nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t t = first; t < last; ++t) {
+          std::size_t i = t / nbands, band = t % nbands;
+          const scitbx::af::ref<bool, scitbx::af::c_grid<2> > &mask = refs[i];
+          std::size_t height = mask.accessor()[0];
+          std::size_t width = mask.accessor()[1];
+          int j0 = (int)(band * height / nbands);
+          int j1 = (int)((band + 1) * height / nbands);
+          int y0 = std::max(j0, rows[i][0]);
+          int y1 = std::min(j1, rows[i][1]);
+          if (y0 < y1) {
+            detail::rasterise_polygon(
+              mask, shadow_boundary[i].const_ref(), cols[i][0], cols[i][1], y0, y1);
+          }
+          if (invert_mask_) {
+            for (std::size_t k = j0 * width; k < j1 * width; k++) {
+              mask[k] = !mask[k];
+            }
           }
         }
-        mask.push_back(mask_tile);
-      }
+      });
 
+      Image<bool> mask;
+      for (std::size_t i = 0; i < npanels; i++) {
+        mask.push_back(ImageTile<bool>(mask_data[i]));
+      }
       return mask;
     }
 
@@ -279,6 +377,10 @@ namespace dxtbx { namespace masking {
       axis_ = scitbx::af::shared<std::size_t>(extrema_at_datum_.size(), 1);
     }
 
+    bool has_rigid_extrema() const {
+      return false;
+    }
+
     scitbx::af::shared<vec3<double> > extrema_at_scan_angle(double scan_angle) const {
       scitbx::af::shared<vec3<double> > extrema =
         GoniometerShadowMasker::extrema_at_scan_angle(scan_angle);
@@ -333,6 +435,146 @@ namespace dxtbx { namespace masking {
     scitbx::af::shared<vec3<double> > faceB;
     scitbx::af::shared<vec3<double> > faceE;
   };
+
+  /**
+   * Compute the shadow masks of a goniometer at many scan angles of a sweep,
+   * for a fixed detector and fixed angles of the other goniometer axes.
+   *
+   * The rotations of the extrema by the axes before the scan axis, the
+   * rotation matrices of the axes after it, and the parts of each panel
+   * needed to project and clip the shadow are found once, when the object
+   * is made. The arithmetic is done in the same order, so the masks are the
+   * same as from GoniometerShadowMasker::get_mask. If the masker's extrema
+   * are not rigid, as for SmarGonShadowMasker, they are taken from the
+   * masker at each angle.
+   */
+  class GoniometerShadowSweepMasker {
+  public:
+    /**
+     * @param masker The masker, whose goniometer angles are taken as they
+     *        are now
+     * @param detector The detector model
+     */
+    GoniometerShadowSweepMasker(std::shared_ptr<const GoniometerShadowMasker> masker,
+                                const Detector &detector)
+        : masker_(masker) {
+      DXTBX_ASSERT(masker != NULL);
+      for (std::size_t i = 0; i < detector.size(); i++) {
+        image_size_.push_back(detector[i].get_image_size());
+        projectors_.push_back(detail::shadow_projector(detector[i]));
+      }
+      rigid_ = masker->has_rigid_extrema();
+      if (!rigid_) {
+        return;
+      }
+
+      // Apply the rotations before the scan axis, which do not change
+      MultiAxisGoniometer goniometer = masker->goniometer();
+      scitbx::af::shared<vec3<double> > axes = goniometer.get_axes();
+      scitbx::af::shared<double> angles = goniometer.get_angles();
+      scan_axis_ = goniometer.get_scan_axis();
+      scan_axis_direction_ = axes[scan_axis_];
+      axis_ = masker->axis();
+      extrema_ = masker->extrema_at_datum();
+      for (std::size_t i = 0; i < scan_axis_; i++) {
+        scitbx::mat3<double> rotation =
+          scitbx::math::r3_rotation::axis_and_angle_as_matrix(axes[i], angles[i], true);
+        for (std::size_t j = 0; j < axis_.size(); j++) {
+          if (axis_[j] > i) {
+            continue;
+          }
+          extrema_[j] = rotation * extrema_[j];
+        }
+      }
+      for (std::size_t i = scan_axis_ + 1; i < axes.size(); i++) {
+        rotations_.push_back(scitbx::math::r3_rotation::axis_and_angle_as_matrix(
+          axes[i], angles[i], true));
+      }
+    }
+
+    /** @returns The extrema in the laboratory frame at a scan angle */
+    scitbx::af::shared<vec3<double> > extrema_at_scan_angle(double scan_angle) const {
+      if (!rigid_) {
+        return masker_->extrema_at_scan_angle(scan_angle);
+      }
+      scitbx::af::shared<vec3<double> > extrema(extrema_.begin(), extrema_.end());
+      scitbx::mat3<double> rotation =
+        scitbx::math::r3_rotation::axis_and_angle_as_matrix(
+          scan_axis_direction_, scan_angle, true);
+      for (std::size_t j = 0; j < axis_.size(); j++) {
+        if (axis_[j] <= scan_axis_) {
+          extrema[j] = rotation * extrema[j];
+        }
+      }
+      for (std::size_t k = 0; k < rotations_.size(); k++) {
+        std::size_t i = scan_axis_ + 1 + k;
+        for (std::size_t j = 0; j < axis_.size(); j++) {
+          if (axis_[j] <= i) {
+            extrema[j] = rotations_[k] * extrema[j];
+          }
+        }
+      }
+      return extrema;
+    }
+
+    /** @returns The shadow on each panel at a scan angle, in pixels */
+    scitbx::af::shared<scitbx::af::shared<vec2<double> > > project_extrema(
+      double scan_angle) const {
+      return project(extrema_at_scan_angle(scan_angle).const_ref());
+    }
+
+    /** @returns The mask at a scan angle */
+    Image<bool> get_mask(double scan_angle) const {
+      return masker_->mask_from_shadow(image_size_.const_ref(),
+                                       project_extrema(scan_angle).const_ref());
+    }
+
+    /**
+     * Compute the masks at many scan angles. The extrema are found on this
+     * thread, and the shadows are projected and rasterised over up to
+     * nthreads threads.
+     * @param scan_angles The scan angles
+     * @param nthreads The number of threads, zero for the default
+     * @returns The mask at each scan angle
+     */
+    std::vector<Image<bool> > get_masks(
+      const scitbx::af::const_ref<double> &scan_angles,
+      std::size_t nthreads) const {
+      std::vector<scitbx::af::shared<vec3<double> > > extrema;
+      for (std::size_t j = 0; j < scan_angles.size(); j++) {
+        extrema.push_back(extrema_at_scan_angle(scan_angles[j]));
+      }
+      std::vector<Image<bool> > masks(scan_angles.size());
+      parallel_for(
+        scan_angles.size(), nthreads, [&](std::size_t first, std::size_t last) {
+          for (std::size_t j = first; j < last; j++) {
+            masks[j] = masker_->mask_from_shadow(
+              image_size_.const_ref(), project(extrema[j].const_ref()).const_ref());
+          }
+        });
+      return masks;
+    }
+
+  private:
+    scitbx::af::shared<scitbx::af::shared<vec2<double> > > project(
+      const scitbx::af::const_ref<vec3<double> > &coords) const {
+      scitbx::af::shared<scitbx::af::shared<vec2<double> > > result;
+      for (std::size_t i = 0; i < projectors_.size(); i++) {
+        result.push_back(projectors_[i].project(coords));
+      }
+      return result;
+    }
+
+    std::shared_ptr<const GoniometerShadowMasker> masker_;
+    scitbx::af::shared<vec2<std::size_t> > image_size_;
+    std::vector<detail::shadow_projector> projectors_;
+    bool rigid_;
+    std::size_t scan_axis_;
+    vec3<double> scan_axis_direction_;
+    scitbx::af::shared<std::size_t> axis_;
+    scitbx::af::shared<vec3<double> > extrema_;
+    std::vector<scitbx::mat3<double> > rotations_;
+  };
 }}  // namespace dxtbx::masking
 
 #endif /* DXTBX_MASKING_GONIOMETER_SHADOW_MASKING_H */
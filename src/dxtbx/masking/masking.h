@@ -12,15 +12,19 @@
 #define DXTBX_MASKING_H
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 #include <scitbx/array_family/shared.h>
 #include <dxtbx/model/beam.h>
 #include <dxtbx/model/panel.h>
+#include <dxtbx/parallel.h>
 #include <dxtbx/error.h>
 
 namespace dxtbx { namespace masking {
 
   using dxtbx::model::BeamBase;
   using dxtbx::model::Panel;
+  using dxtbx::model::PanelGeometryMaps;
   using scitbx::vec2;
   using scitbx::vec3;
 
@@ -112,41 +116,139 @@ namespace dxtbx { namespace masking {
     return inside;
   }
 
+  namespace detail {
+
+    /**
+     * Find the bounding box of the pixels a polygon may cover
+     * @param mask The mask array
+     * @param polygon The polygon
+     * @param x0 The first column
+     * @param x1 One past the last column
+     * @param y0 The first row
+     * @param y1 One past the last row
+     */
+    inline void polygon_bounds(
+      const scitbx::af::ref<bool, scitbx::af::c_grid<2> > &mask,
+      const scitbx::af::const_ref<vec2<double> > &polygon,
+      int &x0,
+      int &x1,
+      int &y0,
+      int &y1) {
+      DXTBX_ASSERT(polygon.size() > 3);
+      std::size_t height = mask.accessor()[0];
+      std::size_t width = mask.accessor()[1];
+      x0 = (int)std::floor(polygon[0][0]);
+      y0 = (int)std::floor(polygon[0][1]);
+      x1 = x0;
+      y1 = y0;
+      for (std::size_t i = 1; i < polygon.size(); ++i) {
+        int x = (int)std::floor(polygon[i][0]);
+        int y = (int)std::floor(polygon[i][1]);
+        if (x < x0) x0 = x;
+        if (y < y0) y0 = y;
+        if (x > x1) x1 = x;
+        if (y > y1) y1 = y;
+      }
+      x0 = std::max(x0, 0);
+      y0 = std::max(y0, 0);
+      x1 = std::min(x1 + 1, (int)width);
+      y1 = std::min(y1 + 1, (int)height);
+      DXTBX_ASSERT(x0 < x1);
+      DXTBX_ASSERT(y0 < y1);
+    }
+
+    /**
+     * @returns The first column in [first, last) whose pixel centre is not
+     *          left of x, or last if there is none
+     */
+    inline int first_pixel_from(double x, int first, int last) {
+      int i = last;
+      if (x - 0.5 <= first) {
+        i = first;
+      } else if (x - 0.5 < last) {
+        i = (int)std::ceil(x - 0.5);
+      }
+      while (i > first && (i - 1) + 0.5 >= x) --i;
+      while (i < last && i + 0.5 < x) ++i;
+      return i;
+    }
+
+    /**
+     * Mask the pixels of some rows whose centres are inside a polygon.
+     *
+     * Each row is filled in spans between the points where the polygon
+     * edges cross the line through the pixel centres. The crossings are
+     * found with the same tests and arithmetic as is_inside_polygon, so the
+     * same pixels are masked, but the cost is per edge and per span rather
+     * than per edge and per pixel.
+     * @param mask The mask array
+     * @param polygon The polygon
+     * @param x0 The first column
+     * @param x1 One past the last column
+     * @param y0 The first row
+     * @param y1 One past the last row
+     */
+    inline void rasterise_polygon(
+      const scitbx::af::ref<bool, scitbx::af::c_grid<2> > &mask,
+      const scitbx::af::const_ref<vec2<double> > &polygon,
+      int x0,
+      int x1,
+      int y0,
+      int y1) {
+      std::size_t width = mask.accessor()[1];
+      std::size_t num = polygon.size();
+      std::vector<double> crossings;
+      crossings.reserve(num);
+      for (int j = y0; j < y1; ++j) {
+        double y = j + 0.5;
+        crossings.clear();
+        std::size_t e = num - 1;
+        for (std::size_t i = 0; i < num; ++i) {
+          if ((polygon[i][1] > y) != (polygon[e][1] > y)) {
+            double x = (polygon[e][0] - polygon[i][0]) * (y - polygon[i][1])
+                         / (polygon[e][1] - polygon[i][1])
+                       + polygon[i][0];
+            // A NaN crossing never toggles the point in polygon test
+            if (x == x) {
+              crossings.push_back(x);
+            }
+          }
+          e = i;
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        // A pixel is inside if an odd number of crossings are right of it
+        bool *row = mask.begin() + j * width;
+        std::size_t m = crossings.size();
+        int i = x0;
+        for (std::size_t k = 0; k <= m && i < x1; ++k) {
+          int end = k < m ? first_pixel_from(crossings[k], i, x1) : x1;
+          if ((m - k) % 2 == 1) {
+            std::fill(row + i, row + end, false);
+          }
+          i = end;
+        }
+      }
+    }
+
+  }  // namespace detail
+
   /**
-   * Apply a polygon mask
+   * Apply a polygon mask. Pixels are masked if their centre is inside the
+   * polygon, by the even-odd rule of is_inside_polygon.
    * @param mask The mask array
    * @param polygon The polygon
+   * @param nthreads The number of threads to split the rows over, zero for
+   *        the default
    */
   void mask_untrusted_polygon(scitbx::af::ref<bool, scitbx::af::c_grid<2> > mask,
-                              const scitbx::af::const_ref<vec2<double> > &polygon) {
-    DXTBX_ASSERT(polygon.size() > 3);
-    std::size_t height = mask.accessor()[0];
-    std::size_t width = mask.accessor()[1];
-    int x0 = (int)std::floor(polygon[0][0]);
-    int y0 = (int)std::floor(polygon[0][1]);
-    int x1 = x0;
-    int y1 = y0;
-    for (std::size_t i = 1; i < polygon.size(); ++i) {
-      int x = (int)std::floor(polygon[i][0]);
-      int y = (int)std::floor(polygon[i][1]);
-      if (x < x0) x0 = x;
-      if (y < y0) y0 = y;
-      if (x > x1) x1 = x;
-      if (y > y1) y1 = y;
-    }
-    x0 = std::max(x0, 0);
-    y0 = std::max(y0, 0);
-    x1 = std::min(x1 + 1, (int)width);
-    y1 = std::min(y1 + 1, (int)height);
-    DXTBX_ASSERT(x0 < x1);
-    DXTBX_ASSERT(y0 < y1);
-    for (std::size_t j = y0; j < y1; ++j) {
-      for (std::size_t i = x0; i < x1; ++i) {
-        if (is_inside_polygon(polygon, i + 0.5, j + 0.5)) {
-          mask(j, i) = false;
-        }
-      }
-    }
+                              const scitbx::af::const_ref<vec2<double> > &polygon,
+                              std::size_t nthreads = 1) {
+    int x0, x1, y0, y1;
+    detail::polygon_bounds(mask, polygon, x0, x1, y0, y1);
+    parallel_for(y1 - y0, nthreads, [&](std::size_t first, std::size_t last) {
+      detail::rasterise_polygon(mask, polygon, x0, x1, y0 + first, y0 + last);
+    });
   }
 
   /**
@@ -168,44 +270,44 @@ namespace dxtbx { namespace masking {
     std::size_t height = panel.get_image_size()[1];
     DXTBX_ASSERT(height == mask.accessor()[0]);
     DXTBX_ASSERT(width == mask.accessor()[1]);
-    vec3<double> s0 = beam.get_s0();
-    for (std::size_t j = 0; j < height; ++j) {
-      for (std::size_t i = 0; i < width; ++i) {
-        vec2<double> px(i + 0.5, j + 0.5);
-        double d = panel.get_resolution_at_pixel(s0, px);
-        if (d_min <= d && d <= d_max) {
-          mask(j, i) = false;
-        }
+    std::shared_ptr<const PanelGeometryMaps<double> > maps =
+      panel.compute_geometry_maps<double>(beam.get_s0(),
+                                          PanelGeometryMaps<double>::RESOLUTION);
+    const scitbx::af::versa<double, scitbx::af::c_grid<2> > &resolution =
+      maps->resolution();
+    for (std::size_t k = 0; k < resolution.size(); ++k) {
+      double d = resolution[k];
+      if (d_min <= d && d <= d_max) {
+        mask[k] = false;
       }
     }
   }
 
   /**
-   * A class to mask multiple resolution ranges
+   * A class to mask multiple resolution ranges.
+   *
+   * The resolution at each pixel is kept in single precision, in a map
+   * held by the generator. Any number of ranges are masked
+   * in one pass over the map, by a binary search over the merged ranges.
+   * Rounding to single precision keeps the order of values, so a pixel can
+   * only be on the wrong side of a range limit if it rounds to the same
+   * value as the limit. The resolution of those pixels is computed again in
+   * double precision, so the mask is the same as from
+   * mask_untrusted_resolution_range.
    */
   class ResolutionMaskGenerator {
   public:
     /**
-     * Initialise the resolution at each pixel
+     * Initialise the resolution at each pixel. Pixels at which the
+     * resolution is undefined hold zero.
      * @param beam The beam model
      * @param panel The panel model
      */
     ResolutionMaskGenerator(const BeamBase &beam, const Panel &panel)
-        : resolution_(
-          scitbx::af::c_grid<2>(panel.get_image_size()[1], panel.get_image_size()[0])) {
-      vec3<double> s0 = beam.get_s0();
-      for (std::size_t j = 0; j < resolution_.accessor()[0]; ++j) {
-        for (std::size_t i = 0; i < resolution_.accessor()[1]; ++i) {
-          vec2<double> px(i + 0.5, j + 0.5);
-          try {
-            resolution_(j, i) = panel.get_resolution_at_pixel(s0, px);
-          } catch (dxtbx::error const &) {
-            // Known failure: resolution at beam center is undefined
-            resolution_(j, i) = 0.0;
-          }
-        }
-      }
-    }
+        : panel_(panel),
+          s0_(beam.get_s0()),
+          maps_(panel.compute_geometry_maps<float>(
+            beam.get_s0(), PanelGeometryMaps<float>::RESOLUTION)) {}
 
     /**
      * Apply the mask
@@ -216,21 +318,86 @@ namespace dxtbx { namespace masking {
     void apply(scitbx::af::ref<bool, scitbx::af::c_grid<2> > mask,
                double d_min,
                double d_max) const {
-      DXTBX_ASSERT(d_min < d_max);
-      DXTBX_ASSERT(resolution_.accessor()[0] == mask.accessor()[0]);
-      DXTBX_ASSERT(resolution_.accessor()[1] == mask.accessor()[1]);
-      for (std::size_t j = 0; j < resolution_.accessor()[0]; ++j) {
-        for (std::size_t i = 0; i < resolution_.accessor()[1]; ++i) {
-          double d = resolution_(j, i);
-          if (d_min <= d && d <= d_max) {
-            mask(j, i) = false;
-          }
+      vec2<double> range(d_min, d_max);
+      apply(mask, scitbx::af::const_ref<vec2<double> >(&range, 1));
+    }
+
+    /**
+     * Apply the mask for several ranges at once
+     * @param mask The mask
+     * @param ranges The (d_min, d_max) of each range
+     */
+    void apply(scitbx::af::ref<bool, scitbx::af::c_grid<2> > mask,
+               const scitbx::af::const_ref<vec2<double> > &ranges) const {
+      const scitbx::af::versa<float, scitbx::af::c_grid<2> > &resolution =
+        maps_->resolution();
+      DXTBX_ASSERT(resolution.accessor()[0] == mask.accessor()[0]);
+      DXTBX_ASSERT(resolution.accessor()[1] == mask.accessor()[1]);
+
+      // Sort and merge the ranges, and round the limits to single precision
+      std::vector<vec2<double> > merged(ranges.begin(), ranges.end());
+      for (std::size_t i = 0; i < merged.size(); ++i) {
+        DXTBX_ASSERT(merged[i][0] < merged[i][1]);
+      }
+      std::sort(merged.begin(), merged.end(), range_less);
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < merged.size(); ++i) {
+        if (n > 0 && merged[i][0] <= merged[n - 1][1]) {
+          merged[n - 1][1] = std::max(merged[n - 1][1], merged[i][1]);
+        } else {
+          merged[n++] = merged[i];
+        }
+      }
+      merged.resize(n);
+      if (n == 0) {
+        return;
+      }
+      std::vector<float> lower(n), upper(n);
+      for (std::size_t i = 0; i < n; ++i) {
+        lower[i] = (float)merged[i][0];
+        upper[i] = (float)merged[i][1];
+      }
+
+      std::size_t width = resolution.accessor()[1];
+      for (std::size_t k = 0; k < resolution.size(); ++k) {
+        float d = resolution[k];
+        std::size_t i = std::lower_bound(upper.begin(), upper.end(), d) - upper.begin();
+        if (i == n || d < lower[i]) {
+          continue;
+        }
+        if ((d > lower[i] && d < upper[i])
+            || in_ranges(merged, exact_resolution(k % width, k / width))) {
+          mask[k] = false;
         }
       }
     }
 
   private:
-    scitbx::af::versa<double, scitbx::af::c_grid<2> > resolution_;
+    static bool range_less(const vec2<double> &a, const vec2<double> &b) {
+      return a[0] < b[0];
+    }
+
+    /** @returns True if a resolution is in one of the merged ranges */
+    static bool in_ranges(const std::vector<vec2<double> > &merged, double d) {
+      std::vector<vec2<double> >::const_iterator it = std::lower_bound(
+        merged.begin(), merged.end(), d, [](const vec2<double> &r, double x) {
+          return r[1] < x;
+        });
+      return it != merged.end() && (*it)[0] <= d;
+    }
+
+    /** @returns The resolution at a pixel centre in double precision */
+    double exact_resolution(std::size_t i, std::size_t j) const {
+      try {
+        return panel_.get_resolution_at_pixel(s0_, vec2<double>(i + 0.5, j + 0.5));
+      } catch (dxtbx::error const &) {
+        return 0;
+      }
+    }
+
+    Panel panel_;
+    vec3<double> s0_;
+    std::shared_ptr<const PanelGeometryMaps<float> > maps_;
   };
 
 }}  // namespace dxtbx::masking
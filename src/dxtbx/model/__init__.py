@@ -44,13 +44,16 @@ try:
         OffsetParallaxCorrectedPxMmStrategy,
         OffsetPxMmStrategy,
         Panel,
+        PanelGeometryField,
         ParallaxCorrectedPxMmStrategy,
         PolychromaticBeam,
         PxMmStrategy,
         Scan,
         ScanBase,
+        ScanVaryingInterpolator,
         SimplePxMmStrategy,
         Spectrum,
+        SpectrumBatch,
         VirtualPanel,
         VirtualPanelFrame,
         get_mod2pi_angles_in_range,
@@ -80,13 +83,16 @@ except ModuleNotFoundError:
         OffsetParallaxCorrectedPxMmStrategy,
         OffsetPxMmStrategy,
         Panel,
+        PanelGeometryField,
         ParallaxCorrectedPxMmStrategy,
         PolychromaticBeam,
         PxMmStrategy,
         Scan,
         ScanBase,
+        ScanVaryingInterpolator,
         SimplePxMmStrategy,
         Spectrum,
+        SpectrumBatch,
         VirtualPanel,
         VirtualPanelFrame,
         get_mod2pi_angles_in_range,
@@ -124,14 +130,17 @@ __all__ = (
     "OffsetParallaxCorrectedPxMmStrategy",
     "OffsetPxMmStrategy",
     "Panel",
+    "PanelGeometryField",
     "ParallaxCorrectedPxMmStrategy",
     "ProfileModelFactory",
     "PxMmStrategy",
     "Scan",
     "ScanBase",
     "ScanFactory",
+    "ScanVaryingInterpolator",
     "SimplePxMmStrategy",
     "Spectrum",
+    "SpectrumBatch",
     "VirtualPanel",
     "VirtualPanelFrame",
     "get_mod2pi_angles_in_range",
@@ -565,26 +574,6 @@ class _experimentlist:
         else:
             return "ExperimentList()"
 
-    def beams(self):
-        """Get a list of the unique beams (includes None)."""
-        return list(OrderedSet(e.beam for e in self))
-
-    def detectors(self):
-        """Get a list of the unique detectors (includes None)."""
-        return list(OrderedSet(e.detector for e in self))
-
-    def goniometers(self):
-        """Get a list of the unique goniometers (includes None)."""
-        return list(OrderedSet(e.goniometer for e in self))
-
-    def scans(self):
-        """Get a list of the unique scans (includes None)."""
-        return list(OrderedSet(e.scan for e in self))
-
-    def crystals(self):
-        """Get a list of the unique crystals (includes None)."""
-        return list(OrderedSet(e.crystal for e in self))
-
     def profiles(self):
         """Get a list of the unique profile models (includes None)."""
         return list(OrderedSet(e.profile for e in self))
@@ -50,6 +50,8 @@ namespace dxtbx { namespace model {
     virtual scitbx::af::shared<vec3<double> > get_s0_at_scan_points() const = 0;
     virtual vec3<double> get_s0_at_scan_point(std::size_t index) const = 0;
     virtual Probe get_probe() const = 0;
+    // Get a revision that changes whenever the beam does
+    virtual std::size_t get_revision() const = 0;
     virtual std::string get_probe_name() const = 0;
 
     virtual void set_direction(vec3<double> direction) = 0;
@@ -247,6 +249,11 @@ namespace dxtbx { namespace model {
 
     virtual ~Beam() {}
 
+    /** @returns The revision, which changes whenever the beam does */
+    std::size_t get_revision() const {
+      return revision_.value();
+    }
+
     vec3<double> get_sample_to_source_direction() const {
       return direction_;
     }
@@ -268,10 +275,12 @@ namespace dxtbx { namespace model {
     void set_direction(vec3<double> direction) {
       DXTBX_ASSERT(direction.length() > 0);
       direction_ = direction.normalize();
+      revision_.update();
     }
 
     virtual void set_wavelength(double wavelength) {
       wavelength_ = wavelength;
+      revision_.update();
     }
 
     virtual vec3<double> get_s0() const {
@@ -283,6 +292,7 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(s0.length() > 0);
       direction_ = -s0.normalize();
       wavelength_ = 1.0 / s0.length();
+      revision_.update();
     }
 
     vec3<double> get_unit_s0() const {
@@ -292,15 +302,18 @@ namespace dxtbx { namespace model {
     void set_unit_s0(vec3<double> unit_s0) {
       DXTBX_ASSERT(unit_s0.length() > 0);
       direction_ = -(unit_s0.normalize());
+      revision_.update();
     }
 
     void set_divergence(double divergence) {
       divergence_ = divergence;
+      revision_.update();
     }
 
     /** Set the standard deviation of the beam divergence */
     void set_sigma_divergence(double sigma_divergence) {
       sigma_divergence_ = sigma_divergence;
+      revision_.update();
     }
 
     vec3<double> get_polarization_normal() const {
@@ -313,18 +326,22 @@ namespace dxtbx { namespace model {
 
     void set_polarization_normal(vec3<double> polarization_normal) {
       polarization_normal_ = polarization_normal;
+      revision_.update();
     }
 
     void set_polarization_fraction(double polarization_fraction) {
       polarization_fraction_ = polarization_fraction;
+      revision_.update();
     }
 
     void set_flux(double flux) {
       flux_ = flux;
+      revision_.update();
     }
 
     void set_transmission(double transmission) {
       transmission_ = transmission;
+      revision_.update();
     }
 
     double get_flux() const {
@@ -341,6 +358,7 @@ namespace dxtbx { namespace model {
 
     void set_s0_at_scan_points(const scitbx::af::const_ref<vec3<double> > &s0) {
       s0_at_scan_points_ = scitbx::af::shared<vec3<double> >(s0.begin(), s0.end());
+      revision_.update();
     }
 
     scitbx::af::shared<vec3<double> > get_s0_at_scan_points() const {
@@ -388,10 +406,12 @@ namespace dxtbx { namespace model {
 
     void set_probe(Probe probe) {
       probe_ = probe;
+      revision_.update();
     }
 
     void reset_scan_points() {
       s0_at_scan_points_.clear();
+      revision_.update();
     }
 
     /* Distance from sample to source in mm */
@@ -403,6 +423,7 @@ namespace dxtbx { namespace model {
     void set_sample_to_source_distance(double sample_to_source_distance) {
       DXTBX_ASSERT(sample_to_source_distance >= 0.);
       sample_to_source_distance_ = sample_to_source_distance;
+      revision_.update();
     }
 
     virtual bool operator==(const BeamBase &rhs) const {
@@ -541,6 +562,7 @@ namespace dxtbx { namespace model {
     void rotate_around_origin(vec3<double> axis, double angle) {
       direction_ = direction_.rotate_around_origin(axis, angle);
       polarization_normal_ = polarization_normal_.rotate_around_origin(axis, angle);
+      revision_.update();
     }
 
     friend std::ostream &operator<<(std::ostream &os, const Beam &b);
@@ -555,6 +577,7 @@ namespace dxtbx { namespace model {
     double transmission_;
     Probe probe_;
     double sample_to_source_distance_;
+    ModelRevision revision_;
 
   private:
     double wavelength_;
@@ -0,0 +1,724 @@
+/*
+ * binary_encoding.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_BINARY_ENCODING_H
+#define DXTBX_MODEL_BINARY_ENCODING_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/size.hpp>
+#include <boost/optional.hpp>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/small.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <cctbx/uctbx.h>
+#include <cctbx/sgtbx/space_group.h>
+#include <dxtbx/model/beam.h>
+#include <dxtbx/model/crystal.h>
+#include <dxtbx/model/detector.h>
+#include <dxtbx/model/goniometer.h>
+#include <dxtbx/model/pixel_to_millimeter.h>
+#include <dxtbx/model/scan.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  /**
+   * The binary encoding of the models. Each model is written as a record of
+   * its values in a fixed order, with arrays written as their size and then
+   * their elements as they are held in memory. Numbers are stored in the
+   * byte order of the host, which is checked by the reader of an encoded
+   * experiment list. Only the model classes themselves can be encoded; a
+   * subclass, or a detector with an unknown pixel to millimeter strategy,
+   * is left to the caller to encode some other way.
+   */
+  namespace binary_encoding {
+
+    const std::uint32_t version = 1;
+
+    const std::uint32_t byte_order_mark = 0x01020304;
+
+    inline const char *magic() {
+      return "DXTBXEXP";
+    }
+
+    enum crystal_kind {
+      plain_crystal = 0,
+      kabsch2010_crystal = 1,
+      sauter2014_crystal = 2
+    };
+
+    enum px_mm_kind {
+      simple_px_mm = 0,
+      parallax_corrected_px_mm = 1,
+      offset_px_mm = 2,
+      offset_parallax_corrected_px_mm = 3
+    };
+
+    /**
+     * Append values to a block of memory
+     */
+    class writer {
+    public:
+      template <typename T>
+      void put(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Bad element type");
+        buffer_.append((const char *)&value, sizeof(T));
+      }
+
+      template <typename T>
+      void put_array(const T *data, std::size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "Bad element type");
+        put<std::uint64_t>(n);
+        buffer_.append((const char *)data, n * sizeof(T));
+      }
+
+      void put_string(const std::string &value) {
+        put_array(value.data(), value.size());
+      }
+
+      void put_bytes(const char *data, std::size_t n) {
+        buffer_.append(data, n);
+      }
+
+      std::size_t size() const {
+        return buffer_.size();
+      }
+
+      std::string &buffer() {
+        return buffer_;
+      }
+
+    private:
+      std::string buffer_;
+    };
+
+    /**
+     * Read values in turn from a block of memory, checking that they lie
+     * inside it
+     */
+    class reader {
+    public:
+      reader(const char *data, std::size_t size)
+          : data_(data), size_(size), position_(0) {}
+
+      template <typename T>
+      T get() {
+        static_assert(std::is_trivially_copyable<T>::value, "Bad element type");
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+      }
+
+      template <typename T>
+      scitbx::af::shared<T> get_array() {
+        static_assert(std::is_trivially_copyable<T>::value, "Bad element type");
+        std::uint64_t n = get<std::uint64_t>();
+        if (n > (size_ - position_) / sizeof(T)) {
+          throw DXTBX_ERROR("Encoded data is truncated");
+        }
+        scitbx::af::shared<T> result((std::size_t)n);
+        if (n > 0) {
+          std::memcpy(&result[0], take(n * sizeof(T)), n * sizeof(T));
+        }
+        return result;
+      }
+
+      std::string get_string() {
+        std::uint64_t n = get<std::uint64_t>();
+        if (n > size_ - position_) {
+          throw DXTBX_ERROR("Encoded data is truncated");
+        }
+        return std::string(take(n), n);
+      }
+
+      const char *take(std::size_t n) {
+        if (n > size_ - position_) {
+          throw DXTBX_ERROR("Encoded data is truncated");
+        }
+        const char *result = data_ + position_;
+        position_ += n;
+        return result;
+      }
+
+      std::size_t position() const {
+        return position_;
+      }
+
+      bool at_end() const {
+        return position_ == size_;
+      }
+
+    private:
+      const char *data_;
+      std::size_t size_;
+      std::size_t position_;
+    };
+
+    namespace detail {
+
+      /**
+       * A visitor to write one column of a scan property table
+       */
+      struct write_column_visitor : public boost::static_visitor<void> {
+        writer &out;
+
+        explicit write_column_visitor(writer &out_) : out(out_) {}
+
+        void operator()(const scitbx::af::shared<std::string> &column) const {
+          for (std::size_t i = 0; i < column.size(); ++i) {
+            out.put_string(column[i]);
+          }
+        }
+
+        template <typename T>
+        void operator()(const scitbx::af::shared<T> &column) const {
+          out.put_array(column.begin(), column.size());
+        }
+      };
+
+      /**
+       * An MPL function to read a column with a given type index into a
+       * table. The state is held by reference, because boost::mpl::for_each
+       * passes the function by value.
+       */
+      template <typename T>
+      struct read_column {
+        T &table;
+        reader &in;
+        const std::string &name;
+        std::uint32_t which;
+        std::uint32_t &index;
+
+        template <typename U>
+        void operator()(const U &) const {
+          if (index++ == which) {
+            typedef typename U::value_type value_type;
+            table.share_column(name, read((value_type *)NULL));
+          }
+        }
+
+        scitbx::af::shared<std::string> read(std::string *) const {
+          scitbx::af::shared<std::string> column;
+          column.reserve(table.nrows());
+          for (std::size_t i = 0; i < table.nrows(); ++i) {
+            column.push_back(in.get_string());
+          }
+          return column;
+        }
+
+        template <typename V>
+        scitbx::af::shared<V> read(V *) const {
+          scitbx::af::shared<V> column = in.get_array<V>();
+          if (column.size() != table.nrows()) {
+            throw DXTBX_ERROR("Column '" + name + "' has the wrong size");
+          }
+          return column;
+        }
+      };
+
+      /** Write a grid of doubles, as its dimensions and then its elements */
+      template <std::size_t N>
+      void put_grid(writer &out,
+                    const scitbx::af::versa<double, scitbx::af::c_grid<N> > &data) {
+        for (std::size_t i = 0; i < N; ++i) {
+          out.put<std::uint64_t>(data.accessor()[i]);
+        }
+        out.put_array(data.begin(), data.size());
+      }
+
+      /** Read a grid of doubles */
+      template <std::size_t N>
+      scitbx::af::versa<double, scitbx::af::c_grid<N> > get_grid(reader &in) {
+        scitbx::af::c_grid<N> grid;
+        for (std::size_t i = 0; i < N; ++i) {
+          grid[i] = (std::size_t)in.get<std::uint64_t>();
+        }
+        scitbx::af::shared<double> data = in.get_array<double>();
+        if (data.size() != grid.size_1d()) {
+          throw DXTBX_ERROR("Encoded array has the wrong size");
+        }
+        return scitbx::af::versa<double, scitbx::af::c_grid<N> >(data, grid);
+      }
+
+      /** Write a small array of doubles */
+      template <std::size_t N>
+      void put_small(writer &out, const scitbx::af::small<double, N> &data) {
+        out.put_array(data.begin(), data.size());
+      }
+
+      /** Read a small array of doubles */
+      template <std::size_t N>
+      scitbx::af::small<double, N> get_small(reader &in) {
+        scitbx::af::shared<double> data = in.get_array<double>();
+        if (data.size() > N) {
+          throw DXTBX_ERROR("Encoded array has the wrong size");
+        }
+        scitbx::af::small<double, N> result;
+        for (std::size_t i = 0; i < data.size(); ++i) {
+          result.push_back(data[i]);
+        }
+        return result;
+      }
+
+    }  // namespace detail
+
+    /** @returns Can the beam be encoded */
+    inline bool can_encode(const BeamBase &beam) {
+      return typeid(beam) == typeid(Beam);
+    }
+
+    /** @returns Can the goniometer be encoded */
+    inline bool can_encode(const Goniometer &goniometer) {
+      return typeid(goniometer) == typeid(Goniometer);
+    }
+
+    /** @returns Can the scan be encoded */
+    inline bool can_encode(const Scan &scan) {
+      return typeid(scan) == typeid(Scan);
+    }
+
+    /** @returns Can the crystal be encoded */
+    inline bool can_encode(const CrystalBase &crystal) {
+      return typeid(crystal) == typeid(Crystal)
+             || typeid(crystal) == typeid(MosaicCrystalKabsch2010)
+             || typeid(crystal) == typeid(MosaicCrystalSauter2014);
+    }
+
+    /** @returns Can the pixel to millimeter strategy be encoded */
+    inline bool can_encode(const PxMmStrategy &strategy) {
+      return typeid(strategy) == typeid(SimplePxMmStrategy)
+             || typeid(strategy) == typeid(ParallaxCorrectedPxMmStrategy)
+             || typeid(strategy) == typeid(OffsetPxMmStrategy)
+             || typeid(strategy) == typeid(OffsetParallaxCorrectedPxMmStrategy);
+    }
+
+    /** @returns Can the detector, and every panel strategy, be encoded */
+    inline bool can_encode(const Detector &detector) {
+      if (typeid(detector) != typeid(Detector)) {
+        return false;
+      }
+      for (std::size_t i = 0; i < detector.size(); ++i) {
+        std::shared_ptr<PxMmStrategy> strategy = detector[i].get_px_mm_strategy();
+        if (!strategy || !can_encode(*strategy)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /** Write a beam */
+    inline void write(writer &out, const BeamBase &beam) {
+      out.put(beam.get_sample_to_source_direction());
+      out.put(beam.get_wavelength());
+      out.put(beam.get_divergence());
+      out.put(beam.get_sigma_divergence());
+      out.put(beam.get_polarization_normal());
+      out.put(beam.get_polarization_fraction());
+      out.put(beam.get_flux());
+      out.put(beam.get_transmission());
+      out.put<std::int32_t>(beam.get_probe());
+      out.put(beam.get_sample_to_source_distance());
+      scitbx::af::shared<vec3<double> > s0 = beam.get_s0_at_scan_points();
+      out.put_array(s0.begin(), s0.size());
+    }
+
+    /** Read a beam */
+    inline std::shared_ptr<BeamBase> read_beam(reader &in) {
+      vec3<double> direction = in.get<vec3<double> >();
+      double wavelength = in.get<double>();
+      double divergence = in.get<double>();
+      double sigma_divergence = in.get<double>();
+      vec3<double> polarization_normal = in.get<vec3<double> >();
+      double polarization_fraction = in.get<double>();
+      double flux = in.get<double>();
+      double transmission = in.get<double>();
+      Probe probe = (Probe)in.get<std::int32_t>();
+      double sample_to_source_distance = in.get<double>();
+      std::shared_ptr<Beam> beam = std::make_shared<Beam>(direction,
+                                                          wavelength,
+                                                          divergence,
+                                                          sigma_divergence,
+                                                          polarization_normal,
+                                                          polarization_fraction,
+                                                          flux,
+                                                          transmission,
+                                                          probe,
+                                                          sample_to_source_distance);
+      scitbx::af::shared<vec3<double> > s0 = in.get_array<vec3<double> >();
+      beam->set_s0_at_scan_points(s0.const_ref());
+      return beam;
+    }
+
+    /** Write a goniometer */
+    inline void write(writer &out, const Goniometer &goniometer) {
+      out.put(goniometer.get_rotation_axis_datum());
+      out.put(goniometer.get_fixed_rotation());
+      out.put(goniometer.get_setting_rotation());
+      scitbx::af::shared<mat3<double> > S =
+        goniometer.get_setting_rotation_at_scan_points();
+      out.put_array(S.begin(), S.size());
+    }
+
+    /** Read a goniometer */
+    inline std::shared_ptr<Goniometer> read_goniometer(reader &in) {
+      vec3<double> rotation_axis = in.get<vec3<double> >();
+      mat3<double> fixed_rotation = in.get<mat3<double> >();
+      mat3<double> setting_rotation = in.get<mat3<double> >();
+      std::shared_ptr<Goniometer> goniometer =
+        std::make_shared<Goniometer>(rotation_axis, fixed_rotation, setting_rotation);
+      scitbx::af::shared<mat3<double> > S = in.get_array<mat3<double> >();
+      goniometer->set_setting_rotation_at_scan_points(S.const_ref());
+      return goniometer;
+    }
+
+    /** Write a scan, with all of its properties */
+    inline void write(writer &out, const Scan &scan) {
+      out.put(scan.get_image_range());
+      out.put<std::int32_t>(scan.get_batch_offset());
+      ExpImgRangeMap ranges = scan.get_valid_image_ranges_map();
+      out.put<std::uint64_t>(ranges.size());
+      for (ExpImgRangeMap::const_iterator it = ranges.begin(); it != ranges.end();
+           ++it) {
+        out.put_string(it->first);
+        out.put_array(it->second.begin(), it->second.size());
+      }
+      flex_table<scan_property_types> properties = scan.get_properties();
+      out.put<std::uint64_t>(properties.nrows());
+      out.put<std::uint64_t>(properties.ncols());
+      detail::write_column_visitor visitor(out);
+      for (flex_table<scan_property_types>::const_iterator it = properties.begin();
+           it != properties.end();
+           ++it) {
+        out.put_string(it->first);
+        out.put<std::uint32_t>(it->second.which());
+        it->second.apply_visitor(visitor);
+      }
+    }
+
+    /** Read a scan */
+    inline std::shared_ptr<Scan> read_scan(reader &in) {
+      typedef flex_table<scan_property_types> table_type;
+      typedef scan_property_types::types types;
+      vec2<int> image_range = in.get<vec2<int> >();
+      int batch_offset = in.get<std::int32_t>();
+      std::uint64_t nranges = in.get<std::uint64_t>();
+      std::vector<std::pair<std::string, scitbx::af::shared<vec2<int> > > > ranges;
+      for (std::size_t i = 0; i < nranges; ++i) {
+        std::string key = in.get_string();
+        ranges.push_back(std::make_pair(key, in.get_array<vec2<int> >()));
+      }
+      std::uint64_t nrows = in.get<std::uint64_t>();
+      std::uint64_t ncols = in.get<std::uint64_t>();
+      table_type properties((std::size_t)nrows);
+      for (std::size_t i = 0; i < ncols; ++i) {
+        std::string name = in.get_string();
+        std::uint32_t which = in.get<std::uint32_t>();
+        if (which >= (std::uint32_t)boost::mpl::size<types>::value) {
+          throw DXTBX_ERROR("Column '" + name + "' has an unknown type");
+        }
+        std::uint32_t index = 0;
+        detail::read_column<table_type> column_reader = {
+          properties, in, name, which, index};
+        boost::mpl::for_each<types>(column_reader);
+      }
+      std::shared_ptr<Scan> scan =
+        std::make_shared<Scan>(image_range, properties, batch_offset);
+      for (std::size_t i = 0; i < ranges.size(); ++i) {
+        scan->set_valid_image_ranges_array(ranges[i].first, ranges[i].second);
+      }
+      return scan;
+    }
+
+    /** Write a panel, or the frame and properties of a detector group */
+    inline void write(writer &out, const Panel &panel) {
+      out.put_string(panel.get_name());
+      out.put_string(panel.get_type());
+      out.put(panel.get_local_fast_axis());
+      out.put(panel.get_local_slow_axis());
+      out.put(panel.get_local_origin());
+      out.put(panel.get_parent_fast_axis());
+      out.put(panel.get_parent_slow_axis());
+      out.put(panel.get_parent_origin());
+      out.put(panel.get_raw_image_offset());
+      out.put(panel.get_image_size());
+      out.put(panel.get_pixel_size());
+      out.put(panel.get_trusted_range());
+      out.put(panel.get_thickness());
+      out.put(panel.get_gain());
+      out.put(panel.get_pedestal());
+      out.put_string(panel.get_material());
+      out.put_string(panel.get_identifier());
+      out.put(panel.get_mu());
+      scitbx::af::shared<int4> mask = panel.get_mask();
+      out.put_array(mask.begin(), mask.size());
+
+      const PxMmStrategy &strategy = *panel.get_px_mm_strategy();
+      DXTBX_ASSERT(can_encode(strategy));
+      if (typeid(strategy) == typeid(OffsetParallaxCorrectedPxMmStrategy)) {
+        const OffsetParallaxCorrectedPxMmStrategy &s =
+          static_cast<const OffsetParallaxCorrectedPxMmStrategy &>(strategy);
+        out.put<std::uint8_t>(offset_parallax_corrected_px_mm);
+        out.put(s.mu());
+        out.put(s.t0());
+        detail::put_grid(out, s.dx());
+        detail::put_grid(out, s.dy());
+      } else if (typeid(strategy) == typeid(OffsetPxMmStrategy)) {
+        const OffsetPxMmStrategy &s = static_cast<const OffsetPxMmStrategy &>(strategy);
+        out.put<std::uint8_t>(offset_px_mm);
+        detail::put_grid(out, s.dx());
+        detail::put_grid(out, s.dy());
+      } else if (typeid(strategy) == typeid(ParallaxCorrectedPxMmStrategy)) {
+        const ParallaxCorrectedPxMmStrategy &s =
+          static_cast<const ParallaxCorrectedPxMmStrategy &>(strategy);
+        out.put<std::uint8_t>(parallax_corrected_px_mm);
+        out.put(s.mu());
+        out.put(s.t0());
+        out.put(s.lookup_step());
+      } else {
+        out.put<std::uint8_t>(simple_px_mm);
+      }
+
+      boost::optional<Projection2D> projection_2d = panel.get_projection_2d();
+      out.put<std::uint8_t>(projection_2d ? 1 : 0);
+      if (projection_2d) {
+        out.put(projection_2d->rotation);
+        out.put(projection_2d->translation);
+      }
+    }
+
+    /** Read a panel */
+    inline Panel read_panel(reader &in) {
+      typedef scitbx::af::versa<double, scitbx::af::c_grid<2> > offset_type;
+      Panel panel;
+      panel.set_name(in.get_string());
+      panel.set_type(in.get_string());
+      vec3<double> fast_axis = in.get<vec3<double> >();
+      vec3<double> slow_axis = in.get<vec3<double> >();
+      vec3<double> origin = in.get<vec3<double> >();
+      panel.set_local_frame(fast_axis, slow_axis, origin);
+      fast_axis = in.get<vec3<double> >();
+      slow_axis = in.get<vec3<double> >();
+      origin = in.get<vec3<double> >();
+      panel.set_parent_frame(fast_axis, slow_axis, origin);
+      panel.set_raw_image_offset(in.get<int2>());
+      panel.set_image_size(in.get<tiny<std::size_t, 2> >());
+      panel.set_pixel_size(in.get<tiny<double, 2> >());
+      panel.set_trusted_range(in.get<tiny<double, 2> >());
+      panel.set_thickness(in.get<double>());
+      panel.set_gain(in.get<double>());
+      panel.set_pedestal(in.get<double>());
+      panel.set_material(in.get_string());
+      panel.set_identifier(in.get_string());
+      panel.set_mu(in.get<double>());
+      scitbx::af::shared<int4> mask = in.get_array<int4>();
+      panel.set_mask(mask.const_ref());
+
+      std::uint8_t kind = in.get<std::uint8_t>();
+      if (kind == offset_parallax_corrected_px_mm) {
+        double mu = in.get<double>();
+        double t0 = in.get<double>();
+        offset_type dx = detail::get_grid<2>(in);
+        offset_type dy = detail::get_grid<2>(in);
+        panel.set_px_mm_strategy(
+          std::make_shared<OffsetParallaxCorrectedPxMmStrategy>(mu, t0, dx, dy));
+      } else if (kind == offset_px_mm) {
+        offset_type dx = detail::get_grid<2>(in);
+        offset_type dy = detail::get_grid<2>(in);
+        panel.set_px_mm_strategy(std::make_shared<OffsetPxMmStrategy>(dx, dy));
+      } else if (kind == parallax_corrected_px_mm) {
+        double mu = in.get<double>();
+        double t0 = in.get<double>();
+        double lookup_step = in.get<double>();
+        panel.set_px_mm_strategy(
+          std::make_shared<ParallaxCorrectedPxMmStrategy>(mu, t0, lookup_step));
+      } else if (kind == simple_px_mm) {
+        panel.set_px_mm_strategy(std::make_shared<SimplePxMmStrategy>());
+      } else {
+        throw DXTBX_ERROR("Unknown pixel to millimeter strategy");
+      }
+
+      if (in.get<std::uint8_t>()) {
+        int4 rotation = in.get<int4>();
+        int2 translation = in.get<int2>();
+        panel.set_projection_2d(rotation, translation);
+      }
+      return panel;
+    }
+
+    namespace detail {
+
+      /** Write the children of a detector node, depth first */
+      inline void write_children(writer &out, Detector::const_node_pointer node) {
+        out.put<std::uint64_t>(node->size());
+        for (std::size_t i = 0; i < node->size(); ++i) {
+          Detector::const_node_pointer child = (*node)[i];
+          out.put<std::uint8_t>(child->is_panel() ? 1 : 0);
+          write(out, *child);
+          if (child->is_panel()) {
+            out.put<std::uint64_t>(child->index());
+          } else {
+            write_children(out, child);
+          }
+        }
+      }
+
+      /** Read the children of a detector node */
+      inline void read_children(reader &in, Detector::node_pointer node) {
+        std::uint64_t n = in.get<std::uint64_t>();
+        for (std::size_t i = 0; i < n; ++i) {
+          bool is_panel = in.get<std::uint8_t>() != 0;
+          Panel panel = read_panel(in);
+          if (is_panel) {
+            node->add_panel(panel, (std::size_t)in.get<std::uint64_t>());
+          } else {
+            read_children(in, node->add_group(panel));
+          }
+        }
+      }
+
+    }  // namespace detail
+
+    /** Write a detector, with its hierarchy */
+    inline void write(writer &out, const Detector &detector) {
+      out.put<std::uint64_t>(detector.size());
+      write(out, *detector.root());
+      detail::write_children(out, detector.root());
+    }
+
+    /** Read a detector */
+    inline std::shared_ptr<Detector> read_detector(reader &in) {
+      std::size_t npanels = in.get<std::uint64_t>();
+      std::shared_ptr<Detector> detector = std::make_shared<Detector>();
+      Panel root = read_panel(in);
+      std::swap(*((Panel *)detector->root()), root);
+      detail::read_children(in, detector->root());
+      if (detector->size() != npanels) {
+        throw DXTBX_ERROR("Encoded detector has the wrong number of panels");
+      }
+      for (std::size_t i = 0; i < npanels; ++i) {
+        if (detector->at(i) == NULL) {
+          throw DXTBX_ERROR("Encoded detector is missing a panel");
+        }
+      }
+      return detector;
+    }
+
+    /**
+     * Write a crystal. The space group is written by the caller, who passes
+     * its position in a table of the space groups of all the crystals.
+     */
+    inline void write(writer &out,
+                      const CrystalBase &crystal,
+                      std::uint32_t space_group_index) {
+      DXTBX_ASSERT(can_encode(crystal));
+      if (typeid(crystal) == typeid(MosaicCrystalKabsch2010)) {
+        out.put<std::uint8_t>(kabsch2010_crystal);
+      } else if (typeid(crystal) == typeid(MosaicCrystalSauter2014)) {
+        out.put<std::uint8_t>(sauter2014_crystal);
+      } else {
+        out.put<std::uint8_t>(plain_crystal);
+      }
+      out.put(space_group_index);
+      out.put(crystal.get_unit_cell().parameters());
+      boost::optional<cctbx::uctbx::unit_cell> recalculated =
+        crystal.get_recalculated_unit_cell();
+      out.put<std::uint8_t>(recalculated ? 1 : 0);
+      if (recalculated) {
+        out.put(recalculated->parameters());
+      }
+      out.put(crystal.get_U());
+      out.put(crystal.get_B());
+      scitbx::af::shared<mat3<double> > A = crystal.get_A_at_scan_points();
+      out.put_array(A.begin(), A.size());
+      detail::put_grid(out, crystal.get_B_covariance());
+      detail::put_grid(out, crystal.get_B_covariance_at_scan_points());
+      detail::put_small(out, crystal.get_cell_parameter_sd_no_calc());
+      detail::put_small(out, crystal.get_recalculated_cell_parameter_sd());
+      out.put(crystal.get_cell_volume_sd_no_calc());
+      out.put(crystal.get_recalculated_cell_volume_sd());
+      if (typeid(crystal) == typeid(MosaicCrystalKabsch2010)) {
+        out.put(static_cast<const MosaicCrystalKabsch2010 &>(crystal).get_mosaicity());
+      } else if (typeid(crystal) == typeid(MosaicCrystalSauter2014)) {
+        const MosaicCrystalSauter2014 &mosaic =
+          static_cast<const MosaicCrystalSauter2014 &>(crystal);
+        out.put(mosaic.get_half_mosaicity_deg());
+        out.put(mosaic.get_domain_size_ang());
+      }
+    }
+
+    /**
+     * Read a crystal
+     * @param space_groups The table of space groups
+     */
+    inline std::shared_ptr<CrystalBase> read_crystal(
+      reader &in,
+      const std::vector<cctbx::sgtbx::space_group> &space_groups) {
+      std::uint8_t kind = in.get<std::uint8_t>();
+      std::uint32_t space_group_index = in.get<std::uint32_t>();
+      if (space_group_index >= space_groups.size()) {
+        throw DXTBX_ERROR("Encoded crystal has an unknown space group");
+      }
+      cctbx::uctbx::unit_cell unit_cell(in.get<scitbx::af::double6>());
+      boost::optional<cctbx::uctbx::unit_cell> recalculated;
+      if (in.get<std::uint8_t>()) {
+        recalculated = cctbx::uctbx::unit_cell(in.get<scitbx::af::double6>());
+      }
+      mat3<double> U = in.get<mat3<double> >();
+      mat3<double> B = in.get<mat3<double> >();
+      scitbx::af::shared<mat3<double> > A = in.get_array<mat3<double> >();
+      scitbx::af::versa<double, scitbx::af::c_grid<2> > cov_B =
+        detail::get_grid<2>(in);
+      scitbx::af::versa<double, scitbx::af::c_grid<3> > cov_B_at_scan_points =
+        detail::get_grid<3>(in);
+      scitbx::af::small<double, 6> cell_sd = detail::get_small<6>(in);
+      scitbx::af::small<double, 6> recalculated_cell_sd = detail::get_small<6>(in);
+      double cell_volume_sd = in.get<double>();
+      double recalculated_cell_volume_sd = in.get<double>();
+      Crystal crystal(space_groups[space_group_index],
+                      unit_cell,
+                      recalculated,
+                      U,
+                      B,
+                      A,
+                      cov_B,
+                      cell_sd,
+                      recalculated_cell_sd,
+                      cell_volume_sd,
+                      recalculated_cell_volume_sd);
+      crystal.set_B_covariance_at_scan_points(cov_B_at_scan_points.const_ref());
+      if (kind == kabsch2010_crystal) {
+        std::shared_ptr<MosaicCrystalKabsch2010> result =
+          std::make_shared<MosaicCrystalKabsch2010>(crystal);
+        result->set_mosaicity(in.get<double>());
+        return result;
+      } else if (kind == sauter2014_crystal) {
+        std::shared_ptr<MosaicCrystalSauter2014> result =
+          std::make_shared<MosaicCrystalSauter2014>(crystal);
+        result->set_half_mosaicity_deg(in.get<double>());
+        result->set_domain_size_ang(in.get<double>());
+        return result;
+      } else if (kind != plain_crystal) {
+        throw DXTBX_ERROR("Unknown crystal kind");
+      }
+      return std::make_shared<Crystal>(crystal);
+    }
+
+  }  // namespace binary_encoding
+
+}}  // namespace dxtbx::model
+
+#endif  // DXTBX_MODEL_BINARY_ENCODING_H
@@ -433,6 +433,7 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_probe_name", &BeamBase::get_probe_name)
       .def("set_probe", &BeamBase::set_probe)
       .def("reset_scan_points", &BeamBase::reset_scan_points)
+      .def("get_revision", &BeamBase::get_revision)
       .def("rotate_around_origin",
            &rotate_around_origin,
            (arg("axis"), arg("angle"), arg("deg") = true))
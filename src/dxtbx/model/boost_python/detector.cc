@@ -22,6 +22,7 @@
 #include <dxtbx/model/detector.h>
 #include <dxtbx/model/boost_python/to_from_dict.h>
 #include <dxtbx/model/boost_python/pickle_suite.h>
+#include <dxtbx/boost_python/gil.h>
 #include <dxtbx/format/image.h>
 
 namespace dxtbx { namespace model { namespace boost_python {
@@ -71,6 +72,20 @@ namespace dxtbx { namespace model { namespace boost_python {
       return result;
     }
 
+    static boost::python::tuple get_ray_intersection_multiple(
+      const Detector &detector,
+      scitbx::af::flex<vec3<double> >::type const &s1,
+      std::size_t nthreads) {
+      scitbx::af::shared<int> panel(s1.size());
+      scitbx::af::shared<vec2<double> > xy(s1.size());
+      {
+        dxtbx::boost_python::scoped_gil_release release_gil;
+        detector.get_ray_intersection(
+          s1.const_ref().as_1d(), panel.ref(), xy.ref(), nthreads);
+      }
+      return boost::python::make_tuple(panel, xy);
+    }
+
     static void rotate_around_origin(Detector &detector,
                                      vec3<double> axis,
                                      double angle,
@@ -363,11 +378,24 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_max_inscribed_resolution",
            &Detector::get_max_inscribed_resolution,
            (arg("s0")))
-      .def("get_ray_intersection", &Detector::get_ray_intersection, (arg("s1")))
+      .def("get_ray_intersection",
+           (Detector::coord_type(Detector::*)(vec3<double>) const)
+             & Detector::get_ray_intersection,
+           (arg("s1")))
+      .def("get_ray_intersection",
+           &get_ray_intersection_multiple,
+           (arg("s1"), arg("nthreads") = 0))
       .def("get_panel_intersection", &Detector::get_panel_intersection, (arg("s1")))
+      .def("millimeter_to_pixel",
+           &Detector::millimeter_to_pixel,
+           (arg("panel"), arg("xy")))
+      .def("pixel_to_millimeter",
+           &Detector::pixel_to_millimeter,
+           (arg("panel"), arg("xy")))
       //.def("do_panels_intersect",
       //  &Detector::do_panels_intersect)
       .def("get_names", &get_names)
+      .def("get_revision", &Detector::get_revision)
       .def("rotate_around_origin",
            &rotate_around_origin,
            (arg("axis"), arg("angle"), arg("deg") = true))
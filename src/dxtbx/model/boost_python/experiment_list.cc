@@ -11,13 +11,23 @@
 #include <boost/python.hpp>
 #include <boost/python/def.hpp>
 #include <boost/python/slice.hpp>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <scitbx/constants.h>
 #include <scitbx/boost_python/slice.h>
 #include <scitbx/boost_python/utils.h>
+#include <cctbx/sgtbx/space_group_type.h>
+#include <cctbx/sgtbx/symbols.h>
 #include <dxtbx/model/experiment_list.h>
+#include <dxtbx/model/binary_encoding.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/boost_python/gil.h>
 #include <dxtbx/model/boost_python/to_from_dict.h>
 
 namespace dxtbx { namespace model { namespace boost_python {
@@ -34,13 +44,417 @@ namespace dxtbx { namespace model { namespace boost_python {
     return experiment;
   }
 
-  struct ExperimentListPickleSuite : boost::python::pickle_suite {
-    static boost::python::tuple getinitargs(const ExperimentList &obj) {
-      boost::python::list experiments;
-      for (std::size_t i = 0; i < obj.size(); ++i) {
-        experiments.append(obj[i]);
+  namespace experiment_list_binary {
+
+    using namespace binary_encoding;
+
+    /**
+     * The Python objects of an encoded experiment list, held once each, in
+     * a list which is pickled as a whole
+     */
+    struct python_objects {
+      boost::python::list objects;
+      std::unordered_map<PyObject *, std::int64_t> index;
+      std::int64_t size;
+
+      python_objects() : size(0) {}
+
+      /** @returns The position of the object in the list, or -1 for None */
+      std::int64_t add(boost::python::object obj) {
+        if (obj.is_none()) {
+          return -1;
+        }
+        auto it = index.find(obj.ptr());
+        if (it != index.end()) {
+          return it->second;
+        }
+        objects.append(obj);
+        index[obj.ptr()] = size;
+        return size++;
+      }
+    };
+
+    /** @returns The object at a position in the list, or None for -1 */
+    inline boost::python::object object_at(boost::python::list objects,
+                                           std::int64_t i) {
+      if (i < -1 || i >= boost::python::len(objects)) {
+        throw DXTBX_ERROR("Encoded experiment list has an unknown object");
+      }
+      return i < 0 ? boost::python::object() : objects[i];
+    }
+
+    /** @returns Is the object of exactly the Python class of the model type */
+    template <typename T>
+    bool is_python_class(boost::python::object obj) {
+      return Py_TYPE(obj.ptr())
+             == boost::python::converter::registered<T>::converters.get_class_object();
+    }
+
+    /** @returns Has the object no Python attributes of its own */
+    inline bool has_no_attributes(boost::python::object obj) {
+      return !PyObject_HasAttrString(obj.ptr(), "__dict__")
+             || boost::python::len(obj.attr("__dict__")) == 0;
+    }
+
+    inline bool is_plain(const BeamBase &, boost::python::object obj) {
+      return is_python_class<Beam>(obj);
+    }
+
+    inline bool is_plain(const Detector &, boost::python::object obj) {
+      return is_python_class<Detector>(obj);
+    }
+
+    inline bool is_plain(const Goniometer &, boost::python::object obj) {
+      return is_python_class<Goniometer>(obj);
+    }
+
+    inline bool is_plain(const Scan &, boost::python::object obj) {
+      return is_python_class<Scan>(obj);
+    }
+
+    inline bool is_plain(const CrystalBase &, boost::python::object obj) {
+      return is_python_class<Crystal>(obj)
+             || is_python_class<MosaicCrystalKabsch2010>(obj)
+             || is_python_class<MosaicCrystalSauter2014>(obj);
+    }
+
+    /**
+     * The unique models of one kind in an experiment list. A model which
+     * can not be encoded, because it is of another class or has Python
+     * attributes, is held as a Python object instead.
+     */
+    template <typename Model>
+    struct model_table {
+      std::vector<std::shared_ptr<Model> > models;
+      std::vector<std::int64_t> object;
+      std::vector<std::string> records;
+      std::vector<std::pair<const char *, std::size_t> > encoded;
+      std::unordered_map<const Model *, std::int64_t> index;
+
+      /** Collect the models, in order, skipping empty ones */
+      void add(const std::vector<std::shared_ptr<Model> > &unique,
+               python_objects &objects) {
+        for (std::size_t i = 0; i < unique.size(); ++i) {
+          if (unique[i]) {
+            boost::python::object obj(unique[i]);
+            bool native = can_encode(*unique[i]) && is_plain(*unique[i], obj)
+                          && has_no_attributes(obj);
+            index[unique[i].get()] = models.size();
+            models.push_back(unique[i]);
+            object.push_back(native ? -1 : objects.add(obj));
+          }
+        }
+        records.resize(models.size());
+      }
+
+      /** @returns The position of a model, or -1 for none */
+      std::int64_t find(const std::shared_ptr<Model> &model) const {
+        return model ? index.at(model.get()) : -1;
+      }
+
+      /**
+       * Encode the native models, on this thread. Copies of a model share
+       * arrays, whose reference counts are not atomic, and writing a model
+       * copies those handles, so two models can not be written at once.
+       */
+      template <typename Function>
+      void encode(Function write_model) {
+        for (std::size_t i = 0; i < models.size(); ++i) {
+          if (object[i] < 0) {
+            writer out;
+            write_model(out, i);
+            records[i].swap(out.buffer());
+          }
+        }
+      }
+
+      /** Write the table, with the records of the native models */
+      void write(writer &out) const {
+        out.put<std::uint64_t>(models.size());
+        for (std::size_t i = 0; i < models.size(); ++i) {
+          out.put(object[i]);
+          if (object[i] < 0) {
+            out.put_string(records[i]);
+          }
+        }
+      }
+
+      /** Read the table, keeping the records to decode */
+      void read(reader &in) {
+        std::uint64_t n = in.get<std::uint64_t>();
+        for (std::size_t i = 0; i < n; ++i) {
+          object.push_back(in.get<std::int64_t>());
+          std::pair<const char *, std::size_t> record(NULL, 0);
+          if (object.back() < 0) {
+            record.second = in.get<std::uint64_t>();
+            record.first = in.take(record.second);
+          }
+          encoded.push_back(record);
+        }
+        models.resize(object.size());
+      }
+
+      /** Decode the native models, over many threads */
+      template <typename Function>
+      void decode(std::size_t nthreads, Function read_model) {
+        parallel_for(models.size(), nthreads, [&](std::size_t first, std::size_t last) {
+          for (std::size_t i = first; i < last; ++i) {
+            if (object[i] < 0) {
+              reader in(encoded[i].first, encoded[i].second);
+              models[i] = read_model(in);
+              if (!in.at_end()) {
+                throw DXTBX_ERROR("Encoded model has the wrong size");
+              }
+            }
+          }
+        });
+      }
+
+      /**
+       * Take the models held as Python objects, and give each decoded model
+       * a Python object, so a model shared between experiments is the same
+       * object in each of them
+       */
+      void extract(boost::python::list objects) {
+        for (std::size_t i = 0; i < models.size(); ++i) {
+          boost::python::object obj = object[i] >= 0 ? object_at(objects, object[i])
+                                                     : boost::python::object(models[i]);
+          models[i] = boost::python::extract<std::shared_ptr<Model> >(obj)();
+        }
+      }
+
+      /** @returns The model at a position, or none for -1 */
+      std::shared_ptr<Model> at(std::int64_t i) const {
+        if (i < -1 || i >= (std::int64_t)models.size()) {
+          throw DXTBX_ERROR("Encoded experiment has an unknown model");
+        }
+        return i < 0 ? std::shared_ptr<Model>() : models[i];
+      }
+    };
+
+    /**
+     * Encode an experiment list. Each model shared between experiments is
+     * written once, and the experiments refer to it by position. The models
+     * are encoded without the GIL; the Python objects, which are the
+     * profile, imageset and scaling models, and any model which can not be
+     * encoded, are pickled together by Python.
+     * @param self The experiment list
+     * @returns The encoded experiment list, as bytes
+     */
+    inline boost::python::object to_bytes(const ExperimentList &self) {
+      python_objects objects;
+      model_table<BeamBase> beams;
+      model_table<Detector> detectors;
+      model_table<Goniometer> goniometers;
+      model_table<Scan> scans;
+      model_table<CrystalBase> crystals;
+      beams.add(self.beams(), objects);
+      detectors.add(self.detectors(), objects);
+      goniometers.add(self.goniometers(), objects);
+      scans.add(self.scans(), objects);
+      crystals.add(self.crystals(), objects);
+
+      // Each crystal refers to its space group in a table
+      std::vector<cctbx::sgtbx::space_group> space_groups;
+      std::vector<std::uint32_t> space_group_index(crystals.models.size(), 0);
+      for (std::size_t i = 0; i < crystals.models.size(); ++i) {
+        if (crystals.object[i] < 0) {
+          cctbx::sgtbx::space_group space_group = crystals.models[i]->get_space_group();
+          std::size_t j = 0;
+          while (j < space_groups.size() && !(space_groups[j] == space_group)) {
+            ++j;
+          }
+          if (j == space_groups.size()) {
+            space_groups.push_back(space_group);
+          }
+          space_group_index[i] = j;
+        }
+      }
+
+      std::vector<std::int64_t> experiment_objects;
+      experiment_objects.reserve(3 * self.size());
+      for (std::size_t i = 0; i < self.size(); ++i) {
+        experiment_objects.push_back(objects.add(self[i].get_profile()));
+        experiment_objects.push_back(objects.add(self[i].get_imageset()));
+        experiment_objects.push_back(objects.add(self[i].get_scaling_model()));
+      }
+      boost::python::object pickle = boost::python::import("pickle");
+      boost::python::object pickled =
+        pickle.attr("dumps")(objects.objects, pickle.attr("HIGHEST_PROTOCOL"));
+
+      {
+        dxtbx::boost_python::scoped_gil_release release_gil;
+        beams.encode([&](writer &out, std::size_t i) {
+          write(out, *beams.models[i]);
+        });
+        detectors.encode([&](writer &out, std::size_t i) {
+          write(out, *detectors.models[i]);
+        });
+        goniometers.encode([&](writer &out, std::size_t i) {
+          write(out, *goniometers.models[i]);
+        });
+        scans.encode([&](writer &out, std::size_t i) {
+          write(out, *scans.models[i]);
+        });
+        crystals.encode([&](writer &out, std::size_t i) {
+          write(out, *crystals.models[i], space_group_index[i]);
+        });
+      }
+
+      writer out;
+      out.put_bytes(magic(), 8);
+      out.put(version);
+      out.put(byte_order_mark);
+      out.put_string(std::string(PyBytes_AS_STRING(pickled.ptr()),
+                                 PyBytes_GET_SIZE(pickled.ptr())));
+      out.put<std::uint64_t>(space_groups.size());
+      for (std::size_t i = 0; i < space_groups.size(); ++i) {
+        out.put_string(space_groups[i].type().hall_symbol());
+      }
+      beams.write(out);
+      detectors.write(out);
+      goniometers.write(out);
+      scans.write(out);
+      crystals.write(out);
+      out.put<std::uint64_t>(self.size());
+      for (std::size_t i = 0; i < self.size(); ++i) {
+        const Experiment &experiment = self[i];
+        out.put(beams.find(experiment.get_beam()));
+        out.put(detectors.find(experiment.get_detector()));
+        out.put(goniometers.find(experiment.get_goniometer()));
+        out.put(scans.find(experiment.get_scan()));
+        out.put(crystals.find(experiment.get_crystal()));
+        out.put(experiment_objects[3 * i]);
+        out.put(experiment_objects[3 * i + 1]);
+        out.put(experiment_objects[3 * i + 2]);
+        out.put_string(experiment.get_identifier());
+      }
+      return boost::python::object(boost::python::handle<>(
+        PyBytes_FromStringAndSize(out.buffer().data(), out.buffer().size())));
+    }
+
+    /**
+     * Decode an experiment list, over many threads
+     * @param data The bytes from to_bytes
+     * @param nthreads The number of threads, zero for the default
+     * @returns The experiment list
+     */
+    inline ExperimentList from_bytes(boost::python::object data, std::size_t nthreads) {
+      if (!PyBytes_Check(data.ptr())) {
+        throw DXTBX_ERROR("Expected bytes");
+      }
+      reader in(PyBytes_AS_STRING(data.ptr()), PyBytes_GET_SIZE(data.ptr()));
+      if (std::memcmp(in.take(8), magic(), 8) != 0) {
+        throw DXTBX_ERROR("Not an encoded experiment list");
       }
-      return boost::python::make_tuple(experiments);
+      if (in.get<std::uint32_t>() != version) {
+        throw DXTBX_ERROR("Unknown experiment list encoding version");
+      }
+      if (in.get<std::uint32_t>() != byte_order_mark) {
+        throw DXTBX_ERROR("Experiment list was encoded with a different byte order");
+      }
+      std::string pickled = in.get_string();
+      boost::python::list objects = boost::python::extract<boost::python::list>(
+        boost::python::import("pickle").attr("loads")(boost::python::object(
+          boost::python::handle<>(
+            PyBytes_FromStringAndSize(pickled.data(), pickled.size())))));
+
+      std::vector<cctbx::sgtbx::space_group> space_groups;
+      std::uint64_t nspace_groups = in.get<std::uint64_t>();
+      for (std::size_t i = 0; i < nspace_groups; ++i) {
+        space_groups.push_back(cctbx::sgtbx::space_group(
+          cctbx::sgtbx::space_group_symbols("Hall:" + in.get_string())));
+      }
+
+      model_table<BeamBase> beams;
+      model_table<Detector> detectors;
+      model_table<Goniometer> goniometers;
+      model_table<Scan> scans;
+      model_table<CrystalBase> crystals;
+      beams.read(in);
+      detectors.read(in);
+      goniometers.read(in);
+      scans.read(in);
+      crystals.read(in);
+      {
+        dxtbx::boost_python::scoped_gil_release release_gil;
+        beams.decode(nthreads, [](reader &in) { return read_beam(in); });
+        detectors.decode(nthreads, [](reader &in) { return read_detector(in); });
+        goniometers.decode(nthreads, [](reader &in) { return read_goniometer(in); });
+        scans.decode(nthreads, [](reader &in) { return read_scan(in); });
+        // Each crystal copies its space group, which shares arrays with the
+        // table, so the crystals are decoded on this thread
+        crystals.decode(1, [&](reader &in) { return read_crystal(in, space_groups); });
+      }
+      beams.extract(objects);
+      detectors.extract(objects);
+      goniometers.extract(objects);
+      scans.extract(objects);
+      crystals.extract(objects);
+
+      ExperimentList result;
+      std::uint64_t nexperiments = in.get<std::uint64_t>();
+      for (std::size_t i = 0; i < nexperiments; ++i) {
+        std::shared_ptr<BeamBase> beam = beams.at(in.get<std::int64_t>());
+        std::shared_ptr<Detector> detector = detectors.at(in.get<std::int64_t>());
+        std::shared_ptr<Goniometer> goniometer = goniometers.at(in.get<std::int64_t>());
+        std::shared_ptr<Scan> scan = scans.at(in.get<std::int64_t>());
+        std::shared_ptr<CrystalBase> crystal = crystals.at(in.get<std::int64_t>());
+        boost::python::object profile = object_at(objects, in.get<std::int64_t>());
+        boost::python::object imageset = object_at(objects, in.get<std::int64_t>());
+        boost::python::object scaling_model =
+          object_at(objects, in.get<std::int64_t>());
+        std::string identifier = in.get_string();
+        result.append(Experiment(beam,
+                                 detector,
+                                 goniometer,
+                                 scan,
+                                 crystal,
+                                 profile,
+                                 imageset,
+                                 scaling_model,
+                                 identifier));
+      }
+      if (!in.at_end()) {
+        throw DXTBX_ERROR("Encoded experiment list has trailing data");
+      }
+      return result;
+    }
+
+  }  // namespace experiment_list_binary
+
+  static boost::python::object experiment_list_to_bytes(const ExperimentList &self) {
+    return experiment_list_binary::to_bytes(self);
+  }
+
+  static ExperimentList experiment_list_from_bytes(boost::python::object data,
+                                                   std::size_t nthreads) {
+    return experiment_list_binary::from_bytes(data, nthreads);
+  }
+
+  /**
+   * Pickle an experiment list in its binary encoding, which keeps the models
+   * shared between experiments. Pickles of the list of experiments, from
+   * before the encoding, are still read by the constructor.
+   */
+  struct ExperimentListPickleSuite : boost::python::pickle_suite {
+    static boost::python::tuple getstate(boost::python::object obj) {
+      const ExperimentList &self =
+        boost::python::extract<const ExperimentList &>(obj)();
+      return boost::python::make_tuple(obj.attr("__dict__"),
+                                       experiment_list_binary::to_bytes(self));
+    }
+
+    static void setstate(boost::python::object obj, boost::python::tuple state) {
+      DXTBX_ASSERT(boost::python::len(state) == 2);
+      ExperimentList &self = boost::python::extract<ExperimentList &>(obj)();
+      boost::python::extract<boost::python::dict>(obj.attr("__dict__"))().update(
+        state[0]);
+      self.extend(experiment_list_binary::from_bytes(state[1], 0));
+    }
+
+    static bool getstate_manages_dict() {
+      return true;
     }
   };
 
@@ -206,6 +620,20 @@ namespace dxtbx { namespace model { namespace boost_python {
     self.erase(n);
   }
 
+  /**
+   * Get the unique models of one kind as a list
+   */
+  template <typename Model,
+            std::vector<std::shared_ptr<Model> > (ExperimentList::*get)() const>
+  boost::python::list experiment_list_models(const ExperimentList &self) {
+    std::vector<std::shared_ptr<Model> > models = (self.*get)();
+    boost::python::list result;
+    for (std::size_t i = 0; i < models.size(); ++i) {
+      result.append(models[i]);
+    }
+    return result;
+  }
+
   void export_experiment_list() {
     class_<ExperimentList>("ExperimentList")
       .def("__init__", make_constructor(&make_experiment_list, default_call_policies()))
@@ -252,7 +680,20 @@ namespace dxtbx { namespace model { namespace boost_python {
             arg("profile") = boost::python::object(),
             arg("imageset") = boost::python::object(),
             arg("scaling_model") = boost::python::object()))
+      .def("beams", &experiment_list_models<BeamBase, &ExperimentList::beams>)
+      .def("detectors",
+           &experiment_list_models<Detector, &ExperimentList::detectors>)
+      .def("goniometers",
+           &experiment_list_models<Goniometer, &ExperimentList::goniometers>)
+      .def("scans", &experiment_list_models<Scan, &ExperimentList::scans>)
+      .def("crystals",
+           &experiment_list_models<CrystalBase, &ExperimentList::crystals>)
       .def("is_consistent", &ExperimentList::is_consistent)
+      .def("to_bytes", &experiment_list_to_bytes)
+      .def("from_bytes",
+           &experiment_list_from_bytes,
+           (arg("data"), arg("nthreads") = 0))
+      .staticmethod("from_bytes")
       .def("__len__", &ExperimentList::size)
       .def_pickle(ExperimentListPickleSuite());
   }
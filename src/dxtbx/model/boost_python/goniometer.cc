@@ -33,6 +33,37 @@ namespace dxtbx { namespace model { namespace boost_python {
       goniometer.rotate_around_origin(axis, angle_rad);
     }
 
+    static scitbx::af::shared<double> angles_as_rad(
+      const scitbx::af::const_ref<double> &angles,
+      bool deg) {
+      scitbx::af::shared<double> result(angles.begin(), angles.end());
+      if (deg) {
+        for (std::size_t i = 0; i < result.size(); ++i) {
+          result[i] = deg_as_rad(result[i]);
+        }
+      }
+      return result;
+    }
+
+    static scitbx::af::shared<mat3<double> > get_rotation_matrices(
+      const Goniometer &goniometer,
+      const scitbx::af::const_ref<double> &angles,
+      bool deg,
+      std::size_t nthreads) {
+      return goniometer.get_rotation_matrices(
+        angles_as_rad(angles, deg).const_ref(), nthreads);
+    }
+
+    static scitbx::af::shared<vec3<double> > rotate_vectors(
+      const Goniometer &goniometer,
+      const scitbx::af::const_ref<vec3<double> > &vectors,
+      const scitbx::af::const_ref<double> &angles,
+      bool deg,
+      std::size_t nthreads) {
+      return goniometer.rotate_vectors(
+        vectors, angles_as_rad(angles, deg).const_ref(), nthreads);
+    }
+
     std::string goniometer_to_string(const Goniometer &goniometer) {
       std::stringstream ss;
       ss << goniometer;
@@ -169,9 +200,16 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_setting_rotation_at_scan_point",
            &Goniometer::get_setting_rotation_at_scan_point)
       .def("reset_scan_points", &Goniometer::reset_scan_points)
+      .def("get_revision", &Goniometer::get_revision)
       .def("rotate_around_origin",
            &rotate_around_origin,
            (arg("axis"), arg("angle"), arg("deg") = true))
+      .def("get_rotation_matrices",
+           &get_rotation_matrices,
+           (arg("angles"), arg("deg") = true, arg("nthreads") = 0))
+      .def("rotate_vectors",
+           &rotate_vectors,
+           (arg("vectors"), arg("angles"), arg("deg") = true, arg("nthreads") = 0))
       .def("__eq__", &Goniometer::operator==)
       .def("__ne__", &Goniometer::operator!=)
       .def("is_similar_to",
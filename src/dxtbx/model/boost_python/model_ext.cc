@@ -24,6 +24,7 @@ namespace dxtbx { namespace model { namespace boost_python {
   void export_scan();
   void export_scan_helpers();
   void export_crystal();
+  void export_scan_varying_interpolator();
   void export_parallax_correction();
   void export_pixel_to_millimeter();
   void export_experiment();
@@ -40,6 +41,7 @@ namespace dxtbx { namespace model { namespace boost_python {
     export_scan();
     export_scan_helpers();
     export_crystal();
+    export_scan_varying_interpolator();
     export_parallax_correction();
     export_pixel_to_millimeter();
     export_experiment();
@@ -16,6 +16,7 @@
 #include <sstream>
 #include <boost_adaptbx/std_pair_conversion.h>
 #include <scitbx/array_family/boost_python/flex_wrapper.h>
+#include <scitbx/array_family/flex_types.h>
 #include <scitbx/constants.h>
 #include <dxtbx/model/panel.h>
 #include <dxtbx/model/boost_python/to_from_dict.h>
@@ -32,35 +33,82 @@ namespace dxtbx { namespace model { namespace boost_python {
     }
 
     static scitbx::af::shared<vec3<double> > get_lab_coord_multiple(
-      const Panel &panel,
+      const VirtualPanelFrame &frame,
       scitbx::af::flex<vec2<double> >::type const &xy) {
-      scitbx::af::shared<vec3<double> > result((scitbx::af::reserve(xy.size())));
-      for (std::size_t i = 0; i < xy.size(); i++) {
-        result.push_back(panel.get_lab_coord(xy[i]));
-      }
-      return result;
+      return frame.get_lab_coord_multiple(xy.const_ref().as_1d());
     }
 
     static scitbx::af::shared<vec2<double> > pixel_to_millimeter_multiple(
       const Panel &panel,
       scitbx::af::flex<vec2<double> >::type const &xy) {
-      scitbx::af::shared<vec2<double> > result((scitbx::af::reserve(xy.size())));
-      for (std::size_t i = 0; i < xy.size(); i++) {
-        result.push_back(panel.pixel_to_millimeter(xy[i]));
-      }
-      return result;
+      return panel.pixel_to_millimeter_multiple(xy.const_ref().as_1d());
     }
 
     static scitbx::af::shared<vec2<double> > millimeter_to_pixel_multiple(
       const Panel &panel,
       scitbx::af::flex<vec2<double> >::type const &xy) {
-      scitbx::af::shared<vec2<double> > result((scitbx::af::reserve(xy.size())));
-      for (std::size_t i = 0; i < xy.size(); i++) {
-        result.push_back(panel.millimeter_to_pixel(xy[i]));
+      return panel.millimeter_to_pixel_multiple(xy.const_ref().as_1d());
+    }
+
+    /** Copy a geometry map out of the cache into a new flex array */
+    template <typename T, typename Grid>
+    static scitbx::af::versa<T, scitbx::af::flex_grid<> > geometry_map_copy(
+      const scitbx::af::versa<T, Grid> &map) {
+      scitbx::af::flex_grid<>::index_type all;
+      for (std::size_t i = 0; i < map.accessor().size(); ++i) {
+        all.push_back(map.accessor()[i]);
       }
+      scitbx::af::versa<T, scitbx::af::flex_grid<> > result(
+        (scitbx::af::flex_grid<>(all)));
+      std::copy(map.begin(), map.end(), result.begin());
       return result;
     }
 
+    template <typename FloatType>
+    struct geometry_maps_wrapper {
+      typedef PanelGeometryMaps<FloatType> maps_type;
+      typedef scitbx::af::versa<FloatType, scitbx::af::flex_grid<> > flex_type;
+
+      static flex_type lab_coord(const maps_type &maps) {
+        return geometry_map_copy(maps.lab_coord());
+      }
+
+      static flex_type two_theta(const maps_type &maps) {
+        return geometry_map_copy(maps.two_theta());
+      }
+
+      static flex_type resolution(const maps_type &maps) {
+        return geometry_map_copy(maps.resolution());
+      }
+
+      static flex_type obliquity(const maps_type &maps) {
+        return geometry_map_copy(maps.obliquity());
+      }
+
+      static std::shared_ptr<maps_type> get(const Panel &panel,
+                                            vec3<double> s0,
+                                            int fields,
+                                            double offset,
+                                            std::size_t nthreads) {
+        return std::const_pointer_cast<maps_type>(
+          panel.get_geometry_maps<FloatType>(s0, fields, offset, nthreads));
+      }
+
+      static void wrap(const char *name) {
+        using namespace boost::python;
+        class_<maps_type, std::shared_ptr<maps_type>, boost::noncopyable>(name,
+                                                                          no_init)
+          .def("fields", &maps_type::fields)
+          .def("offset", &maps_type::offset)
+          .def("s0", &maps_type::s0)
+          .def("has", &maps_type::has, (arg("field")))
+          .def("lab_coord", &lab_coord)
+          .def("two_theta", &two_theta)
+          .def("resolution", &resolution)
+          .def("obliquity", &obliquity);
+      }
+    };
+
     static Panel panel_deepcopy(const Panel &panel, boost::python::object dict) {
       return Panel(panel);
     }
@@ -206,9 +254,13 @@ namespace dxtbx { namespace model { namespace boost_python {
           result->set_mu(mu);
           result->set_thickness(t0);
         }
+        double lookup_step = 0;
+        if (st.has_key("lookup_step")) {
+          lookup_step = boost::python::extract<double>(st["lookup_step"]);
+        }
         if (mu > 0 && t0 > 0) {
           std::shared_ptr<PxMmStrategy> strategy(
-            new ParallaxCorrectedPxMmStrategy(mu, t0));
+            new ParallaxCorrectedPxMmStrategy(mu, t0, lookup_step));
           result->set_px_mm_strategy(strategy);
         }
       } else if (name == "OffsetPxMmStrategy") {
@@ -269,6 +321,13 @@ namespace dxtbx { namespace model { namespace boost_python {
     boost::python::dict result;
     std::string name = obj->name();
     result["type"] = name;
+    if (name == "ParallaxCorrectedPxMmStrategy") {
+      double lookup_step =
+        std::static_pointer_cast<ParallaxCorrectedPxMmStrategy>(obj)->lookup_step();
+      if (lookup_step > 0) {
+        result["lookup_step"] = lookup_step;
+      }
+    }
     return result;
   }
   template <>
@@ -316,9 +375,13 @@ namespace dxtbx { namespace model { namespace boost_python {
           result->set_mu(mu);
           result->set_thickness(t0);
         }
+        double lookup_step = 0;
+        if (st.has_key("lookup_step")) {
+          lookup_step = boost::python::extract<double>(st["lookup_step"]);
+        }
         if (mu > 0 && t0 > 0) {
           std::shared_ptr<PxMmStrategy> strategy(
-            new ParallaxCorrectedPxMmStrategy(mu, t0));
+            new ParallaxCorrectedPxMmStrategy(mu, t0, lookup_step));
           result->set_px_mm_strategy(strategy);
         }
       } else if (name == "OffsetPxMmStrategy") {
@@ -373,6 +436,7 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_parent_d_matrix", &VirtualPanelFrame::get_parent_d_matrix)
       .def("get_d_matrix", &VirtualPanelFrame::get_d_matrix)
       .def("get_D_matrix", &VirtualPanelFrame::get_D_matrix)
+      .def("get_revision", &VirtualPanelFrame::get_revision)
       .def("get_origin", &VirtualPanelFrame::get_origin)
       .def("get_fast_axis", &VirtualPanelFrame::get_fast_axis)
       .def("get_slow_axis", &VirtualPanelFrame::get_slow_axis)
@@ -456,6 +520,16 @@ namespace dxtbx { namespace model { namespace boost_python {
             arg("static_only") = false,
             arg("ignore_trusted_range") = false));
 
+    enum_<PanelGeometryMaps<double>::Field>("PanelGeometryField")
+      .value("LAB_COORD", PanelGeometryMaps<double>::LAB_COORD)
+      .value("TWO_THETA", PanelGeometryMaps<double>::TWO_THETA)
+      .value("RESOLUTION", PanelGeometryMaps<double>::RESOLUTION)
+      .value("OBLIQUITY", PanelGeometryMaps<double>::OBLIQUITY)
+      .value("ALL", PanelGeometryMaps<double>::ALL);
+
+    geometry_maps_wrapper<double>::wrap("PanelGeometryMaps");
+    geometry_maps_wrapper<float>::wrap("PanelGeometryMapsFloat");
+
     class_<Panel, bases<PanelData> >("Panel")
       .def(init<std::string,
                 std::string,
@@ -528,6 +602,19 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("pixel_to_millimeter", pixel_to_millimeter)
       .def("pixel_to_millimeter", pixel_to_millimeter_multiple)
       .def("get_two_theta_at_pixel", &Panel::get_two_theta_at_pixel)
+      .def("get_geometry_maps",
+           &geometry_maps_wrapper<double>::get,
+           (arg("s0"),
+            arg("fields") = (int)PanelGeometryMaps<double>::ALL,
+            arg("offset") = 0.5,
+            arg("nthreads") = 0))
+      .def("get_geometry_maps_float",
+           &geometry_maps_wrapper<float>::get,
+           (arg("s0"),
+            arg("fields") = (int)PanelGeometryMaps<float>::ALL,
+            arg("offset") = 0.5,
+            arg("nthreads") = 0))
+      .def("clear_geometry_maps", &Panel::clear_geometry_maps)
       .def("get_two_theta_array", &Panel::get_two_theta_array)
       .def("get_cos2_two_theta_array", &Panel::get_cos2_two_theta_array)
       .def("get_resolution_at_pixel", &Panel::get_resolution_at_pixel)
@@ -62,7 +62,7 @@ namespace dxtbx { namespace model { namespace boost_python {
 
   struct ParallaxCorrectedPxMmStrategyPickleSuite : boost::python::pickle_suite {
     static boost::python::tuple getinitargs(const ParallaxCorrectedPxMmStrategy& obj) {
-      return boost::python::make_tuple(obj.mu(), obj.t0());
+      return boost::python::make_tuple(obj.mu(), obj.t0(), obj.lookup_step());
     }
   };
 
@@ -83,10 +83,30 @@ namespace dxtbx { namespace model { namespace boost_python {
     return strategy.to_millimeter(panel, xy);
   }
 
+  scitbx::af::shared<vec2<double> > to_millimeter_multiple(
+    PxMmStrategy& strategy,
+    Panel& panel,
+    const scitbx::af::const_ref<vec2<double> >& xy) {
+    scitbx::af::shared<vec2<double> > result(xy.size());
+    strategy.to_millimeter_multiple(panel, xy, result.ref());
+    return result;
+  }
+
+  scitbx::af::shared<vec2<double> > to_pixel_multiple(
+    PxMmStrategy& strategy,
+    Panel& panel,
+    const scitbx::af::const_ref<vec2<double> >& xy) {
+    scitbx::af::shared<vec2<double> > result(xy.size());
+    strategy.to_pixel_multiple(panel, xy, result.ref());
+    return result;
+  }
+
   void export_pixel_to_millimeter() {
     class_<PxMmStrategy, boost::noncopyable>("PxMmStrategy", no_init)
       .def("to_millimeter", to_millimeter, (arg("panel"), arg("xy")))
+      .def("to_millimeter", to_millimeter_multiple, (arg("panel"), arg("xy")))
       .def("to_pixel", &PxMmStrategy::to_pixel, (arg("panel"), arg("xy")))
+      .def("to_pixel", to_pixel_multiple, (arg("panel"), arg("xy")))
       .def("name", &PxMmStrategy::name)
       .def("__str__", &PxMmStrategy::strategy_name)
       .def("__eq__", &PxMmStrategy::operator==)
@@ -97,9 +117,12 @@ namespace dxtbx { namespace model { namespace boost_python {
 
     class_<ParallaxCorrectedPxMmStrategy, bases<SimplePxMmStrategy> >(
       "ParallaxCorrectedPxMmStrategy", no_init)
-      .def(init<double, double>((arg("mu"), arg("t0"))))
+      .def(init<double, double, optional<double> >(
+        (arg("mu"), arg("t0"), arg("lookup_step") = 0)))
       .def("mu", &ParallaxCorrectedPxMmStrategy::mu)
       .def("t0", &ParallaxCorrectedPxMmStrategy::t0)
+      .def("lookup_step", &ParallaxCorrectedPxMmStrategy::lookup_step)
+      .def("lookup_error", &ParallaxCorrectedPxMmStrategy::lookup_error, (arg("panel")))
       .def("__eq__", &ParallaxCorrectedPxMmStrategy::operator==)
       .def("__ne__", &ParallaxCorrectedPxMmStrategy::operator!=)
       .def_pickle(ParallaxCorrectedPxMmStrategyPickleSuite());
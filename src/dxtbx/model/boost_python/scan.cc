@@ -51,6 +51,17 @@ namespace dxtbx { namespace model { namespace boost_python {
     return angles_in_rad;
   }
 
+  static scitbx::af::shared<double> rad_as_deg(
+    scitbx::af::shared<double> angles_in_rad) {
+    scitbx::af::shared<double> angles_in_deg;
+    angles_in_deg.resize(angles_in_rad.size());
+    std::transform(angles_in_rad.begin(),
+                   angles_in_rad.end(),
+                   angles_in_deg.begin(),
+                   scitbx::rad_as_deg);
+    return angles_in_deg;
+  }
+
   std::string scan_to_string(const Scan &scan) {
     std::stringstream ss;
     ss << scan;
@@ -174,7 +185,11 @@ namespace dxtbx { namespace model { namespace boost_python {
     typedef typename base_type::class_type class_type;
 
     static class_type wrap(const char *name) {
-      return base_type::wrap(name);
+      typedef dxtbx::af::flex_table_suite::flex_table_pickle_suite<T> pickle_suite;
+      class_type table_class = base_type::wrap(name);
+      table_class.def_pickle(pickle_suite())
+        .def("__reduce_ex__", &pickle_suite::reduce_ex);
+      return table_class;
     }
   };
 
@@ -475,15 +490,27 @@ namespace dxtbx { namespace model { namespace boost_python {
     return deg ? rad_as_deg(angle) : angle;
   }
 
+  static scitbx::af::shared<double> angles_as_rad(
+    scitbx::af::const_ref<double> const &angle,
+    bool deg) {
+    scitbx::af::shared<double> result(angle.begin(), angle.end());
+    return deg ? deg_as_rad(result) : result;
+  }
+
+  static scitbx::af::shared<double> get_angle_from_image_index_multiple(
+    const Scan &scan,
+    scitbx::af::const_ref<double> const &index,
+    bool deg) {
+    scitbx::af::shared<double> angles = scan.get_angles_from_image_indices(index);
+    return deg ? rad_as_deg(angles) : angles;
+  }
+
   static scitbx::af::shared<double> get_angle_from_array_index_multiple(
     const Scan &scan,
     scitbx::af::const_ref<double> const &index,
     bool deg) {
-    scitbx::af::shared<double> result((scitbx::af::reserve(index.size())));
-    for (std::size_t i = 0; i < index.size(); i++) {
-      result.push_back(get_angle_from_array_index(scan, index[i], deg));
-    }
-    return result;
+    scitbx::af::shared<double> angles = scan.get_angles_from_array_indices(index);
+    return deg ? rad_as_deg(angles) : angles;
   }
 
   static double get_image_index_from_angle(const Scan &scan, double angle, bool deg) {
@@ -494,15 +521,18 @@ namespace dxtbx { namespace model { namespace boost_python {
     return scan.get_array_index_from_angle(deg ? deg_as_rad(angle) : angle);
   }
 
+  static scitbx::af::shared<double> get_image_index_from_angle_multiple(
+    const Scan &scan,
+    scitbx::af::const_ref<double> const &angle,
+    bool deg) {
+    return scan.get_image_indices_from_angles(angles_as_rad(angle, deg).const_ref());
+  }
+
   static scitbx::af::shared<double> get_array_index_from_angle_multiple(
     const Scan &scan,
     scitbx::af::const_ref<double> const &angle,
     bool deg) {
-    scitbx::af::shared<double> result((scitbx::af::reserve(angle.size())));
-    for (std::size_t i = 0; i < angle.size(); i++) {
-      result.push_back(get_array_index_from_angle(scan, angle[i], deg));
-    }
-    return result;
+    return scan.get_array_indices_from_angles(angles_as_rad(angle, deg).const_ref());
   }
 
   static scitbx::af::shared<vec2<double> >
@@ -515,6 +545,17 @@ namespace dxtbx { namespace model { namespace boost_python {
     return scan.get_array_indices_with_angle(deg ? deg_as_rad(angle) : angle);
   }
 
+  static boost::python::tuple get_array_indices_with_angles(
+    const Scan &scan,
+    scitbx::af::const_ref<double> const &angle,
+    double padding,
+    bool deg) {
+    scitbx::af::shared<std::size_t> which;
+    scitbx::af::shared<vec2<double> > result = scan.get_array_indices_with_angles(
+      angles_as_rad(angle, deg).const_ref(), which, padding, deg);
+    return boost::python::make_tuple(which, result);
+  }
+
   static Scan getitem_single(const Scan &scan, int index) {
     return scan[index];
   }
@@ -648,6 +689,9 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_angle_from_image_index",
            &get_angle_from_image_index,
            (arg("index"), arg("deg") = true))
+      .def("get_angle_from_image_index",
+           &get_angle_from_image_index_multiple,
+           (arg("index"), arg("deg") = true))
       .def("get_angle_from_array_index",
            &get_angle_from_array_index,
            (arg("index"), arg("deg") = true))
@@ -657,6 +701,9 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_image_index_from_angle",
            &get_image_index_from_angle,
            (arg("angle"), arg("deg") = true))
+      .def("get_image_index_from_angle",
+           &get_image_index_from_angle_multiple,
+           (arg("angle"), arg("deg") = true))
       .def("get_array_index_from_angle",
            &get_array_index_from_angle,
            (arg("angle"), arg("deg") = true))
@@ -669,6 +716,9 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_array_indices_with_angle",
            &get_array_indices_with_angle,
            (arg("angle"), arg("deg") = true))
+      .def("get_array_indices_with_angles",
+           &get_array_indices_with_angles,
+           (arg("angles"), arg("padding") = 0, arg("deg") = true))
       .def("__getitem__", &getitem_single)
       .def("__getitem__", &getitem_slice)
       .def("get_property",
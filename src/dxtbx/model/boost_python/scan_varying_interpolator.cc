@@ -0,0 +1,43 @@
+/*
+ * scan_varying_interpolator.cc
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <dxtbx/model/scan_varying_interpolator.h>
+
+namespace dxtbx { namespace model { namespace boost_python {
+
+  using namespace boost::python;
+
+  static boost::python::tuple interpolate(const ScanVaryingInterpolator &self,
+                                          scitbx::af::const_ref<double> const &frame,
+                                          std::size_t nthreads) {
+    scitbx::af::shared<mat3<double> > A(frame.size());
+    scitbx::af::shared<vec3<double> > s0(frame.size());
+    scitbx::af::shared<mat3<double> > S(frame.size());
+    self.interpolate(frame, A.ref(), s0.ref(), S.ref(), nthreads);
+    return boost::python::make_tuple(A, s0, S);
+  }
+
+  void export_scan_varying_interpolator() {
+    class_<ScanVaryingInterpolator>("ScanVaryingInterpolator", no_init)
+      .def(
+        init<const CrystalBase &, const BeamBase &, const Goniometer &, const Scan &>(
+          (arg("crystal"), arg("beam"), arg("goniometer"), arg("scan"))))
+      .def("get_frame_range", &ScanVaryingInterpolator::get_frame_range)
+      .def("get_A",
+           &ScanVaryingInterpolator::get_A,
+           (arg("frame"), arg("nthreads") = 0))
+      .def("get_s0",
+           &ScanVaryingInterpolator::get_s0,
+           (arg("frame"), arg("nthreads") = 0))
+      .def("get_setting_rotation",
+           &ScanVaryingInterpolator::get_setting_rotation,
+           (arg("frame"), arg("nthreads") = 0))
+      .def("interpolate", &interpolate, (arg("frame"), arg("nthreads") = 0));
+  }
+
+}}}  // namespace dxtbx::model::boost_python
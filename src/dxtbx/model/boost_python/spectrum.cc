@@ -7,8 +7,11 @@
 #include <string>
 #include <sstream>
 #include <dxtbx/model/spectrum.h>
+#include <dxtbx/model/spectrum_batch.h>
 #include <dxtbx/model/boost_python/to_from_dict.h>
+#include <dxtbx/boost_python/gil.h>
 #include <scitbx/array_family/boost_python/flex_wrapper.h>
+#include <scitbx/array_family/flex_types.h>
 
 namespace dxtbx { namespace model { namespace boost_python {
 
@@ -60,6 +63,90 @@ namespace dxtbx { namespace model { namespace boost_python {
     return s;
   }
 
+  /** Copy a grid of the batch into a new 2D flex array */
+  static scitbx::af::versa<double, scitbx::af::flex_grid<> > spectrum_batch_grid(
+    const SpectrumBatch::grid_type &grid) {
+    scitbx::af::versa<double, scitbx::af::flex_grid<> > result(
+      (scitbx::af::flex_grid<>(grid.accessor()[0], grid.accessor()[1])));
+    std::copy(grid.begin(), grid.end(), result.begin());
+    return result;
+  }
+
+  static SpectrumBatch *make_spectrum_batch(const scitbx::af::flex_double &energies,
+                                            const scitbx::af::flex_double &weights) {
+    DXTBX_ASSERT(weights.accessor().nd() == 2);
+    scitbx::af::const_ref<double, scitbx::af::c_grid<2> > weights_ref(
+      weights.begin(), scitbx::af::c_grid<2>(weights.accessor()));
+    if (energies.accessor().nd() == 1) {
+      return new SpectrumBatch(energies.const_ref().as_1d(), weights_ref);
+    }
+    DXTBX_ASSERT(energies.accessor().nd() == 2);
+    return new SpectrumBatch(
+      scitbx::af::const_ref<double, scitbx::af::c_grid<2> >(
+        energies.begin(), scitbx::af::c_grid<2>(energies.accessor())),
+      weights_ref);
+  }
+
+  static SpectrumBatch *make_spectrum_batch_from_spectra(
+    boost::python::object spectra) {
+    std::vector<Spectrum> items;
+    for (std::size_t i = 0; i < boost::python::len(spectra); ++i) {
+      items.push_back(boost::python::extract<Spectrum>(spectra[i])());
+    }
+    return new SpectrumBatch(
+      scitbx::af::const_ref<Spectrum>(items.empty() ? NULL : &items[0], items.size()));
+  }
+
+  static scitbx::af::versa<double, scitbx::af::flex_grid<> >
+  spectrum_batch_get_energies(const SpectrumBatch &self) {
+    return spectrum_batch_grid(self.get_energies_eV());
+  }
+
+  static scitbx::af::versa<double, scitbx::af::flex_grid<> >
+  spectrum_batch_get_weights(const SpectrumBatch &self) {
+    return spectrum_batch_grid(self.get_weights());
+  }
+
+  static boost::python::tuple spectrum_batch_compute_weighted_energy(
+    const SpectrumBatch &self,
+    std::size_t nthreads) {
+    scitbx::af::shared<double> mean(self.size());
+    scitbx::af::shared<double> variance(self.size());
+    {
+      dxtbx::boost_python::scoped_gil_release release_gil;
+      self.compute_weighted_energy(mean.ref(), variance.ref(), nthreads);
+    }
+    return boost::python::make_tuple(mean, variance);
+  }
+
+  /** Compute a statistic of every spectrum in a batch with the GIL released */
+  template <typename Result, Result (SpectrumBatch::*compute)(std::size_t) const>
+  static Result spectrum_batch_statistic(const SpectrumBatch &self,
+                                         std::size_t nthreads) {
+    dxtbx::boost_python::scoped_gil_release release_gil;
+    return (self.*compute)(nthreads);
+  }
+
+  static SpectrumBatch spectrum_batch_rebin(const SpectrumBatch &self,
+                                            const scitbx::af::const_ref<double> &grid,
+                                            std::size_t nthreads) {
+    dxtbx::boost_python::scoped_gil_release release_gil;
+    return self.rebin(grid, nthreads);
+  }
+
+  struct SpectrumBatchPickleSuite : boost::python::pickle_suite {
+    static boost::python::tuple getinitargs(const SpectrumBatch &obj) {
+      if (obj.has_common_energies()) {
+        SpectrumBatch::grid_type energies = obj.get_energies_eV();
+        return boost::python::make_tuple(
+          scitbx::af::shared<double>(energies.begin(), energies.end()),
+          spectrum_batch_get_weights(obj));
+      }
+      return boost::python::make_tuple(spectrum_batch_get_energies(obj),
+                                       spectrum_batch_get_weights(obj));
+    }
+  };
+
   void export_spectrum() {
     // Export Spectrum
     class_<Spectrum, std::shared_ptr<Spectrum> >("Spectrum")
@@ -79,6 +166,43 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def_pickle(SpectrumPickleSuite());
 
     scitbx::af::boost_python::flex_wrapper<Spectrum>::plain("flex_Spectrum");
+
+    class_<SpectrumBatch>("SpectrumBatch")
+      .def("__init__",
+           make_constructor(&make_spectrum_batch,
+                            default_call_policies(),
+                            (arg("energies"), arg("weights"))))
+      .def("__init__",
+           make_constructor(&make_spectrum_batch_from_spectra,
+                            default_call_policies(),
+                            (arg("spectra"))))
+      .def("__len__", &SpectrumBatch::size)
+      .def("num_bins", &SpectrumBatch::num_bins)
+      .def("has_common_energies", &SpectrumBatch::has_common_energies)
+      .def("get_energies_eV", &spectrum_batch_get_energies)
+      .def("get_weights", &spectrum_batch_get_weights)
+      .def("get_spectrum", &SpectrumBatch::get_spectrum)
+      .def("compute_weighted_energy",
+           &spectrum_batch_compute_weighted_energy,
+           (arg("nthreads") = 0))
+      .def("get_weighted_energy_eV",
+           &spectrum_batch_statistic<scitbx::af::shared<double>,
+                                     &SpectrumBatch::get_weighted_energy_eV>,
+           (arg("nthreads") = 0))
+      .def("get_weighted_energy_variance",
+           &spectrum_batch_statistic<scitbx::af::shared<double>,
+                                     &SpectrumBatch::get_weighted_energy_variance>,
+           (arg("nthreads") = 0))
+      .def("get_weighted_wavelength",
+           &spectrum_batch_statistic<scitbx::af::shared<double>,
+                                     &SpectrumBatch::get_weighted_wavelength>,
+           (arg("nthreads") = 0))
+      .def("get_bandwidth_98_percent",
+           &spectrum_batch_statistic<scitbx::af::shared<vec2<double> >,
+                                     &SpectrumBatch::get_bandwidth_98_percent>,
+           (arg("nthreads") = 0))
+      .def("rebin", &spectrum_batch_rebin, (arg("grid"), arg("nthreads") = 0))
+      .def_pickle(SpectrumBatchPickleSuite());
   }
 
 }}}  // namespace dxtbx::model::boost_python
@@ -11,7 +11,9 @@
 #ifndef DXTBX_MODEL_DETECTOR_H
 #define DXTBX_MODEL_DETECTOR_H
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <boost/ptr_container/ptr_vector.hpp>
@@ -22,6 +24,7 @@
 #include <scitbx/array_family/flex_types.h>
 #include <scitbx/array_family/tiny_types.h>
 #include <scitbx/array_family/shared.h>
+#include <dxtbx/model/detector_ray_index.h>
 #include <dxtbx/model/panel.h>
 #include <dxtbx/error.h>
 
@@ -117,9 +120,16 @@ namespace dxtbx { namespace model {
    * a hierarchy which encodes groups of panels. The panels can be accessed as a
    * flat data structure (i.e. an array) and the panels and groups can be accessed
    * through a tree interface.
+   *
+   * Copies of a detector share the node tree until one of them is changed.
+   * The tree is only shared while no references into it have been handed
+   * out to be changed; taking such a reference, through the non-const
+   * accessors, first gives the detector a private copy of the tree.
    */
   class Detector {
   public:
+    class DetectorData;
+
     /**
      * A class representing a node in the detector hierarchy. The node class
      * inherits from the panel class and adds some methods for adding children,
@@ -134,26 +144,31 @@ namespace dxtbx { namespace model {
       typedef boost::ptr_vector<Node>::const_iterator const_iterator;
 
       /**
-       * Construct using a parent detector reference. The detector reference keeps
+       * Construct using a reference to the detector data. The detector data keeps
        * hold of the flat array of panels so that when the hierarchy is built, the
        * panels are added automatically to the flat array of panels.
        */
-      Node(Detector *detector) : detector_(detector), parent_(NULL), is_panel_(false) {}
+      Node(DetectorData *data)
+          : data_(data), parent_(NULL), is_panel_(false), parent_changed_(false) {}
 
       /**
-       * Construct using a parent detector reference. The detector reference keeps
+       * Construct using a reference to the detector data. The detector data keeps
        * hold of the flat array of panels so that when the hierarchy is built, the
        * panels are added automatically to the flat array of panels.
        */
-      Node(Detector *detector, const Panel &panel)
-          : Panel(panel), detector_(detector), parent_(NULL), is_panel_(false) {}
+      Node(DetectorData *data, const Panel &panel)
+          : Panel(panel),
+            data_(data),
+            parent_(NULL),
+            is_panel_(false),
+            parent_changed_(false) {}
 
       /**
        * Add a group to the detector node.
        */
       pointer add_group() {
         DXTBX_ASSERT(!is_panel());
-        Node *node = new Node(detector_);
+        Node *node = new Node(data_);
         node->parent_ = this;
         node->is_panel_ = false;
         node->set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
@@ -166,7 +181,7 @@ namespace dxtbx { namespace model {
        */
       pointer add_group(const Panel &group) {
         DXTBX_ASSERT(!is_panel());
-        Node *node = new Node(detector_, group);
+        Node *node = new Node(data_, group);
         node->parent_ = this;
         node->is_panel_ = false;
         node->set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
@@ -179,12 +194,12 @@ namespace dxtbx { namespace model {
        */
       pointer add_panel() {
         DXTBX_ASSERT(!is_panel());
-        Node *node = new Node(detector_);
+        Node *node = new Node(data_);
         node->parent_ = this;
         node->is_panel_ = true;
         node->set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
         children_.push_back(node);
-        detector_->data_->panels.push_back(node);
+        data_->panels.push_back(node);
         return node;
       }
 
@@ -193,12 +208,12 @@ namespace dxtbx { namespace model {
        */
       pointer add_panel(const Panel &panel) {
         DXTBX_ASSERT(!is_panel());
-        Node *node = new Node(detector_, panel);
+        Node *node = new Node(data_, panel);
         node->parent_ = this;
         node->is_panel_ = true;
         node->set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
         children_.push_back(node);
-        detector_->data_->panels.push_back(node);
+        data_->panels.push_back(node);
         return node;
       }
 
@@ -207,16 +222,16 @@ namespace dxtbx { namespace model {
        */
       pointer add_panel(const Panel &panel, std::size_t index) {
         DXTBX_ASSERT(!is_panel());
-        Node *node = new Node(detector_, panel);
+        Node *node = new Node(data_, panel);
         node->parent_ = this;
         node->is_panel_ = true;
         node->set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
         children_.push_back(node);
-        if (detector_->data_->panels.size() <= index) {
-          detector_->data_->panels.resize(index + 1, NULL);
+        if (data_->panels.size() <= index) {
+          data_->panels.resize(index + 1, NULL);
         }
-        DXTBX_ASSERT(detector_->data_->panels[index] == NULL);
-        detector_->data_->panels[index] = node;
+        DXTBX_ASSERT(data_->panels[index] == NULL);
+        data_->panels[index] = node;
         return node;
       }
 
@@ -308,8 +323,8 @@ namespace dxtbx { namespace model {
 
       std::size_t index() const {
         DXTBX_ASSERT(is_panel());
-        for (std::size_t i = 0; i < detector_->size(); ++i) {
-          if (this == detector_->data_->panels[i]) {
+        for (std::size_t i = 0; i < data_->panels.size(); ++i) {
+          if (this == data_->panels[i]) {
             return i;
           }
         }
@@ -333,7 +348,8 @@ namespace dxtbx { namespace model {
 
       /**
        * Set the global frame. Normalize the d1 and d2 axes and update the
-       * local frame with this new information.
+       * local frame with this new information. The frames of the nodes
+       * below are brought up to date when they are next read.
        * @param d1 The fast axis
        * @param d2 The slow axis
        * @param d0 The origin vector.
@@ -342,14 +358,13 @@ namespace dxtbx { namespace model {
                      const vec3<double> &d2,
                      const vec3<double> &d0) {
         Panel::set_frame(d1, d2, d0);
-        for (std::size_t i = 0; i < children_.size(); ++i) {
-          children_[i].set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
-        }
+        invalidate_children();
       }
 
       /**
        * Set the local frame. Normalize the d1 and d2 axes and update the
-       * global frame with this new information.
+       * global frame with this new information. The frames of the nodes
+       * below are brought up to date when they are next read.
        * @param d1 The fast axis
        * @param d2 The slow axis
        * @param d0 The origin vector.
@@ -358,14 +373,13 @@ namespace dxtbx { namespace model {
                            const vec3<double> &d2,
                            const vec3<double> &d0) {
         Panel::set_local_frame(d1, d2, d0);
-        for (std::size_t i = 0; i < children_.size(); ++i) {
-          children_[i].set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
-        }
+        invalidate_children();
       }
 
       /**
        * Set the parent frame. Normalize the d1 and d2 axes and update the
-       * global frame with this new information.
+       * global frame with this new information. The frames of the nodes
+       * below are brought up to date when they are next read.
        * @param d1 The fast axis
        * @param d2 The slow axis
        * @param d0 The origin vector.
@@ -373,10 +387,22 @@ namespace dxtbx { namespace model {
       void set_parent_frame(const vec3<double> &d1,
                             const vec3<double> &d2,
                             const vec3<double> &d0) {
+        // Take any change to the parent node first, so it can't overwrite
+        // this frame later
+        refresh_global_frame();
         Panel::set_parent_frame(d1, d2, d0);
+        invalidate_children();
+      }
+
+      /**
+       * @returns The latest revision of this node and the nodes below it
+       */
+      std::size_t get_subtree_revision() const {
+        std::size_t revision = get_revision();
         for (std::size_t i = 0; i < children_.size(); ++i) {
-          children_[i].set_parent_frame(get_fast_axis(), get_slow_axis(), get_origin());
+          revision = std::max(revision, children_[i].get_subtree_revision());
         }
+        return revision;
       }
 
       /**
@@ -440,10 +466,63 @@ namespace dxtbx { namespace model {
       }
 
     protected:
-      Detector *detector_;
+      friend class Detector;
+
+      /**
+       * Add a copy of a node from another tree, without its children. The
+       * copy keeps the frames and revision of the node, so a copy of a
+       * whole tree has the revision of its source.
+       */
+      pointer add_copy(const Node &node) {
+        DXTBX_ASSERT(!is_panel());
+        Node *copy = new Node(data_, node);
+        copy->parent_ = this;
+        copy->is_panel_ = node.is_panel_;
+        children_.push_back(copy);
+        if (copy->is_panel_) {
+          std::size_t index = node.index();
+          if (data_->panels.size() <= index) {
+            data_->panels.resize(index + 1, NULL);
+          }
+          DXTBX_ASSERT(data_->panels[index] == NULL);
+          data_->panels[index] = copy;
+        }
+        return copy;
+      }
+
+      /** Take the parent frame from the parent node, if it has changed */
+      void update_parent_frame() const override {
+        if (parent_changed_ && parent_ != NULL) {
+          assign_parent_frame(
+            parent_->get_fast_axis(), parent_->get_slow_axis(), parent_->get_origin());
+          parent_changed_ = false;
+        }
+      }
+
+      /**
+       * Mark the frames of the nodes below out of date. A node already
+       * marked has the whole of its subtree marked, so the walk stops there;
+       * a node is only brought up to date after its parent is.
+       */
+      void invalidate_children() {
+        for (std::size_t i = 0; i < children_.size(); ++i) {
+          Node &child = children_[i];
+          if (!child.parent_changed_) {
+            child.parent_changed_ = true;
+            child.invalidate_global_frame();
+            child.invalidate_children();
+          }
+        }
+      }
+
+      DetectorData *data_;
       pointer parent_;
       boost::ptr_vector<Node> children_;
       bool is_panel_;
+
+      // True if the parent node frame has changed since this node last took
+      // it, guarded by the frame lock
+      mutable bool parent_changed_;
     };
 
     typedef std::pair<int, vec2<double> > coord_type;
@@ -459,73 +538,90 @@ namespace dxtbx { namespace model {
      */
     class DetectorData {
     public:
-      DetectorData(Detector *detector) : root(detector) {}
+      DetectorData() : root(this), frozen(false), snapshot_revision(0) {}
 
-      DetectorData(Detector *detector, const Panel &panel) : root(detector, panel) {}
+      DetectorData(const Panel &panel)
+          : root(this, panel), frozen(false), snapshot_revision(0) {}
 
       Node root;
       std::vector<Node::pointer> panels;
+
+      // True if no references into the tree have been handed out to be
+      // changed, so the tree may be shared between copies of the detector
+      bool frozen;
+
+      // A frozen copy of the tree, for sharing between copies of a detector
+      // whose own tree is not frozen, and the revision it was made at
+      std::shared_ptr<DetectorData> snapshot;
+      std::size_t snapshot_revision;
+      std::mutex snapshot_mutex;
+
+    private:
+      DetectorData(const DetectorData &);
+      DetectorData &operator=(const DetectorData &);
     };
 
     /**
      * Initialise the detector
      */
-    Detector() : data_(std::make_shared<DetectorData>(this)) {}
+    Detector() : data_(std::make_shared<DetectorData>()) {}
 
     /**
-     * Copy another detector
+     * Copy another detector. The copy shares the node tree of the other
+     * detector, or a frozen copy of it, until either of them is changed.
      */
-    Detector(const Detector &other)
-        : data_(std::make_shared<DetectorData>(this, *(other.root()))) {
-      // The initializer copies the main panel data; now do the rest
-      copy_node_subtree(root(), other.root());
-      // Validate that everything appears to have been copied
-      DXTBX_ASSERT(size() == other.size());
-      for (std::size_t i = 0; i < size(); ++i) {
-        DXTBX_ASSERT(at(i) != NULL);
-      }
-    }
+    Detector(const Detector &other) : data_(other.shared_data()) {}
 
     /**
      * Construct with a single panel
      */
-    Detector(const Panel &panel) : data_(std::make_shared<DetectorData>(this)) {
+    Detector(const Panel &panel) : data_(std::make_shared<DetectorData>()) {
       add_panel(panel);
     }
 
+    /**
+     * Copy another detector, as the copy constructor
+     */
+    Detector &operator=(const Detector &other) {
+      if (this != &other) {
+        data_ = other.shared_data();
+      }
+      return *this;
+    }
+
     /**
      * Add a group to the root node.
      */
     node_pointer add_group() {
-      return data_->root.add_group();
+      return mutable_data().root.add_group();
     }
 
     /**
      * Add a group to the root node.
      */
     node_pointer add_group(const Panel &group) {
-      return data_->root.add_group(group);
+      return mutable_data().root.add_group(group);
     }
 
     /**
      * Add a panel to the root node
      */
     node_pointer add_panel() {
-      return data_->root.add_panel();
+      return mutable_data().root.add_panel();
     }
 
     /**
      * Add a panel to the root node
      */
     node_pointer add_panel(const Panel &panel) {
-      return data_->root.add_panel(panel);
+      return mutable_data().root.add_panel(panel);
     }
 
     /**
      * Get the root node
      */
     node_pointer root() {
-      return &(data_->root);
+      return &(mutable_data().root);
     }
 
     /**
@@ -540,7 +636,7 @@ namespace dxtbx { namespace model {
      */
     panel_type &operator[](std::size_t i) {
       DXTBX_ASSERT(i < data_->panels.size());
-      return *(data_->panels[i]);
+      return *(mutable_data().panels[i]);
     }
 
     /** Return a const reference to a panel */
@@ -552,7 +648,7 @@ namespace dxtbx { namespace model {
     /** Return a pointer to a panel */
     panel_type *at(std::size_t i) {
       DXTBX_ASSERT(i < size());
-      return data_->panels[i];
+      return mutable_data().panels[i];
     }
 
     std::size_t size() const {
@@ -566,7 +662,7 @@ namespace dxtbx { namespace model {
 
     /** Get the begin iterator */
     iterator begin() {
-      return iterator(data_->panels.begin());
+      return iterator(mutable_data().panels.begin());
     }
 
     /** Get the end iterator */
@@ -576,7 +672,16 @@ namespace dxtbx { namespace model {
 
     /** Get the end iterator */
     iterator end() {
-      return iterator(data_->panels.end());
+      return iterator(mutable_data().panels.end());
+    }
+
+    /**
+     * @returns The revision of the detector. Since revisions only increase,
+     * this is the latest revision of the nodes, and changes whenever any
+     * panel or group changes or is added.
+     */
+    std::size_t get_revision() const {
+      return data_->root.get_subtree_revision();
     }
 
     /** Check the detector panels are the same */
@@ -739,7 +844,7 @@ namespace dxtbx { namespace model {
     }
 
     /** finds the panel id with which s1 intersects.  Returns -1 if none do. **/
-    int get_panel_intersection(vec3<double> s1) {
+    int get_panel_intersection(vec3<double> s1) const {
       int found_panel = -1;
       for (std::size_t i = 0; i < size(); ++i) {
         try {
@@ -755,6 +860,31 @@ namespace dxtbx { namespace model {
       return found_panel;
     }
 
+    /**
+     * Intersect many rays with the detector. Each ray gets the panel and mm
+     * coordinate that get_ray_intersection would give, or panel -1 where it
+     * would raise because the ray hits no panel. A panel in a plane through
+     * the sample, which has no D matrix, is skipped as it is by
+     * get_panel_intersection. The rays are only tested against the panels
+     * they could hit, found with a DetectorRayIndex that is kept until the
+     * detector changes.
+     * @param s1 The ray directions
+     * @param panel The panel for each ray
+     * @param xy The mm coordinate for each ray
+     * @param nthreads The number of threads, zero for the default
+     */
+    void get_ray_intersection(const scitbx::af::const_ref<vec3<double> > &s1,
+                              const scitbx::af::ref<int> &panel,
+                              const scitbx::af::ref<vec2<double> > &xy,
+                              std::size_t nthreads = 0) const {
+      get_ray_index()->intersect(s1, panel, xy, nthreads);
+    }
+
+    /** @returns The ray index for the current revision of the detector */
+    std::shared_ptr<const DetectorRayIndex> get_ray_index() const {
+      return ray_index_cache_.get(*this);
+    }
+
     /** Rotate the detector about an axis */
     void rotate_around_origin(vec3<double> axis, double angle) {
       for (std::size_t i = 0; i < size(); ++i) {
@@ -762,7 +892,33 @@ namespace dxtbx { namespace model {
       }
     }
 
-    bool has_projection_2d() {
+    /**
+     * Map an array of coordinates in mm to pixels, each on its own panel.
+     * The coordinates are gathered by panel so that each panel's px/mm
+     * strategy is called once.
+     * @param panel The panel of each coordinate
+     * @param xy The coordinates in mm
+     * @returns The coordinates in pixels
+     */
+    scitbx::af::shared<vec2<double> > millimeter_to_pixel(
+      const scitbx::af::const_ref<std::size_t> &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy) const {
+      return convert_coord_multiple(panel, xy, true);
+    }
+
+    /**
+     * Map an array of coordinates in pixels to mm, each on its own panel
+     * @param panel The panel of each coordinate
+     * @param xy The coordinates in pixels
+     * @returns The coordinates in mm
+     */
+    scitbx::af::shared<vec2<double> > pixel_to_millimeter(
+      const scitbx::af::const_ref<std::size_t> &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy) const {
+      return convert_coord_multiple(panel, xy, false);
+    }
+
+    bool has_projection_2d() const {
       for (std::size_t i = 0; i < size(); ++i) {
         if (!(*this)[i].get_projection_2d()) {
           return false;
@@ -775,22 +931,120 @@ namespace dxtbx { namespace model {
     friend std::ostream &operator<<(std::ostream &os, const Detector &d);
 
     std::shared_ptr<DetectorData> data_;
+    mutable detail::detector_ray_index_cache ray_index_cache_;
 
   private:
     /**
-     * Copy the child panels and groups, recursively, of a detector node.
+     * @returns The node tree to share with a copy of this detector: the tree
+     * itself if it is frozen, and otherwise a frozen copy of it, which is
+     * kept until the detector changes.
+     */
+    std::shared_ptr<DetectorData> shared_data() const {
+      if (data_->frozen) {
+        return data_;
+      }
+      std::size_t revision = get_revision();
+      std::lock_guard<std::mutex> lock(data_->snapshot_mutex);
+      if (!data_->snapshot || data_->snapshot_revision != revision) {
+        data_->snapshot = copy_data(*data_);
+        data_->snapshot_revision = revision;
+      }
+      return data_->snapshot;
+    }
+
+    /**
+     * @returns The node tree, for it to be changed. If the tree is shared
+     * with another detector, this detector first takes a private copy. Any
+     * frozen copy of the tree is dropped, since it may be about to go out of
+     * date without the revision changing.
+     */
+    DetectorData &mutable_data() {
+      if (data_.use_count() > 1) {
+        data_ = copy_data(*data_);
+      }
+      data_->frozen = false;
+      std::lock_guard<std::mutex> lock(data_->snapshot_mutex);
+      data_->snapshot.reset();
+      return *data_;
+    }
+
+    /** @returns A frozen copy of a node tree */
+    static std::shared_ptr<DetectorData> copy_data(const DetectorData &source) {
+      std::shared_ptr<DetectorData> result =
+        std::make_shared<DetectorData>(source.root);
+      // The initializer copies the main panel data; now do the rest
+      copy_node_subtree(&(result->root), &(source.root));
+      // Validate that everything appears to have been copied
+      DXTBX_ASSERT(result->panels.size() == source.panels.size());
+      for (std::size_t i = 0; i < result->panels.size(); ++i) {
+        DXTBX_ASSERT(result->panels[i] != NULL);
+      }
+      result->frozen = true;
+      return result;
+    }
+
+    /**
+     * Convert coordinates on several panels between pixels and mm. The
+     * coordinates are sorted by panel with a counting sort, converted a
+     * panel at a time, and then put back in their original order.
+     */
+    scitbx::af::shared<vec2<double> > convert_coord_multiple(
+      const scitbx::af::const_ref<std::size_t> &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      bool to_pixel) const {
+      DXTBX_ASSERT(panel.size() == xy.size());
+      std::vector<std::size_t> first(size() + 1, 0);
+      for (std::size_t i = 0; i < panel.size(); ++i) {
+        DXTBX_ASSERT(panel[i] < size());
+        first[panel[i] + 1]++;
+      }
+      for (std::size_t p = 0; p < size(); ++p) {
+        first[p + 1] += first[p];
+      }
+
+      // Gather the coordinates of each panel together
+      scitbx::af::shared<vec2<double> > gathered(xy.size());
+      std::vector<std::size_t> order(xy.size());
+      std::vector<std::size_t> next(first.begin(), first.end() - 1);
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        std::size_t k = next[panel[i]]++;
+        gathered[k] = xy[i];
+        order[k] = i;
+      }
+
+      // Convert them, and scatter them back
+      for (std::size_t p = 0; p < size(); ++p) {
+        scitbx::af::ref<vec2<double> > coords(gathered.begin() + first[p],
+                                              first[p + 1] - first[p]);
+        if (coords.size() == 0) {
+          continue;
+        } else if (to_pixel) {
+          (*this)[p].millimeter_to_pixel_multiple(coords, coords);
+        } else {
+          (*this)[p].pixel_to_millimeter_multiple(coords, coords);
+        }
+      }
+      scitbx::af::shared<vec2<double> > result(xy.size());
+      for (std::size_t k = 0; k < order.size(); ++k) {
+        result[order[k]] = gathered[k];
+      }
+      return result;
+    }
+
+    /**
+     * Copy the child panels and groups, recursively, of a detector node,
+     * keeping their frames and revisions.
      *
      * Note that this doesn't touch the Panel/detector contents of the
      * destination node.
      *
      * Panel children are assumed to be leafs without further hierarchy.
      */
-    void copy_node_subtree(Node::pointer dest, Node::const_pointer source) {
+    static void copy_node_subtree(Node::pointer dest, Node::const_pointer source) {
       for (Node::const_iterator it = source->begin(); it != source->end(); ++it) {
-        if (it->is_panel()) {
-          dest->add_panel(*it, it->index());
-        } else {
-          copy_node_subtree(dest->add_group(*it), &*it);
+        Node::pointer node = dest->add_copy(*it);
+        if (!it->is_panel()) {
+          copy_node_subtree(node, &*it);
         }
       }
     }
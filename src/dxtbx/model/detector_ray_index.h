@@ -0,0 +1,295 @@
+/*
+ * detector_ray_index.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_DETECTOR_RAY_INDEX_H
+#define DXTBX_MODEL_DETECTOR_RAY_INDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/constants.h>
+#include <scitbx/array_family/ref.h>
+#include <dxtbx/model/model_helpers.h>
+#include <dxtbx/model/panel.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::mat3;
+  using scitbx::vec2;
+  using scitbx::vec3;
+
+  /**
+   * An index for intersecting many rays with the panels of a detector.
+   *
+   * Each panel covers a region of directions from the sample, which lies in
+   * the cone around the panel centre that holds its corners. The sphere of
+   * directions is split into bins on the faces of a cube, and each bin keeps
+   * the panels whose cone overlaps the cone around the bin. A ray is then
+   * only tested against the panels of its bin, in the same way and order as
+   * Detector::get_ray_intersection, so the results are the same. A panel
+   * whose plane passes through the sample has no D matrix; as in
+   * Detector::get_panel_intersection no ray hits it, so it is in no bin.
+   *
+   * The index copies what it needs from the panels, so it is read only and
+   * may be shared between threads.
+   */
+  class DetectorRayIndex {
+  public:
+    typedef std::pair<int, vec2<double> > coord_type;
+
+    /**
+     * Build the index
+     * @param detector The detector, with size(), operator[] and get_revision()
+     * @param bins_per_face The number of bins along each edge of a cube face
+     */
+    template <typename DetectorType>
+    explicit DetectorRayIndex(const DetectorType &detector,
+                              std::size_t bins_per_face = 32)
+        : revision_(detector.get_revision()), nbins_(bins_per_face) {
+      DXTBX_ASSERT(bins_per_face > 0);
+      std::size_t npanels = detector.size();
+      D_.reserve(npanels);
+      size_mm_.reserve(npanels);
+      std::vector<vec3<double> > axis(npanels);
+      std::vector<double> half_angle(npanels);
+      std::vector<bool> has_D(npanels, true);
+      for (std::size_t i = 0; i < npanels; ++i) {
+        const Panel &panel = detector[i];
+        size_mm_.push_back(vec2<double>(panel.get_image_size_mm()[0],
+                                        panel.get_image_size_mm()[1]));
+        try {
+          D_.push_back(panel.get_D_matrix());
+        } catch (dxtbx::error const &) {
+          D_.push_back(mat3<double>(0, 0, 0, 0, 0, 0, 0, 0, 0));
+          has_D[i] = false;
+          continue;
+        }
+        vec2<double> s = size_mm_.back();
+        vec3<double> corners[4] = {panel.get_lab_coord(vec2<double>(0, 0)),
+                                   panel.get_lab_coord(vec2<double>(s[0], 0)),
+                                   panel.get_lab_coord(vec2<double>(0, s[1])),
+                                   panel.get_lab_coord(vec2<double>(s[0], s[1]))};
+        half_angle[i] = bounding_cone(corners, axis[i]);
+      }
+
+      // Count and then fill the panels of each bin, in panel order
+      std::size_t total = 6 * nbins_ * nbins_;
+      bin_start_.assign(total + 1, 0);
+      std::vector<std::vector<int> > bins(total);
+      for (std::size_t b = 0; b < total; ++b) {
+        vec3<double> corners[4];
+        bin_corners(b, corners);
+        vec3<double> bin_axis;
+        double bin_half_angle = bounding_cone(corners, bin_axis);
+        for (std::size_t i = 0; i < npanels; ++i) {
+          if (!has_D[i]) {
+            continue;
+          }
+          if (half_angle[i] < 0
+              || angle_safe(axis[i], bin_axis)
+                   <= half_angle[i] + bin_half_angle + cone_margin) {
+            bins[b].push_back((int)i);
+          }
+        }
+      }
+      for (std::size_t b = 0; b < total; ++b) {
+        bin_start_[b + 1] = bin_start_[b] + bins[b].size();
+      }
+      bin_panels_.reserve(bin_start_.back());
+      for (std::size_t b = 0; b < total; ++b) {
+        bin_panels_.insert(bin_panels_.end(), bins[b].begin(), bins[b].end());
+      }
+    }
+
+    /** @returns The revision of the detector the index was built for */
+    std::size_t revision() const {
+      return revision_;
+    }
+
+    /** @returns The number of bins along each edge of a cube face */
+    std::size_t bins_per_face() const {
+      return nbins_;
+    }
+
+    /**
+     * Find the panel a ray hits, and where
+     * @param s1 The ray direction
+     * @returns The panel and the mm coordinate, or panel -1 if it hits none
+     */
+    coord_type intersect(vec3<double> s1) const {
+      coord_type pxy(-1, vec2<double>(0, 0));
+      if (s1.length() == 0) {
+        return pxy;
+      }
+      double w_max = 0;
+      std::size_t b = bin(s1);
+      for (std::size_t k = bin_start_[b]; k < bin_start_[b + 1]; ++k) {
+        std::size_t i = bin_panels_[k];
+        vec3<double> v = D_[i] * s1;
+        if (v[2] > w_max) {
+          vec2<double> xy(v[0] / v[2], v[1] / v[2]);
+          if ((0 <= xy[0] && xy[0] < size_mm_[i][0])
+              && (0 <= xy[1] && xy[1] < size_mm_[i][1])) {
+            pxy = coord_type((int)i, xy);
+            w_max = v[2];
+          }
+        }
+      }
+      return pxy;
+    }
+
+    /**
+     * Find the panels many rays hit
+     * @param s1 The ray directions
+     * @param panel The panel for each ray, -1 if it hits none
+     * @param xy The mm coordinate for each ray
+     * @param nthreads The number of threads, zero for the default
+     */
+    void intersect(const scitbx::af::const_ref<vec3<double> > &s1,
+                   const scitbx::af::ref<int> &panel,
+                   const scitbx::af::ref<vec2<double> > &xy,
+                   std::size_t nthreads) const {
+      DXTBX_ASSERT(panel.size() == s1.size());
+      DXTBX_ASSERT(xy.size() == s1.size());
+      parallel_for(s1.size(), nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          coord_type pxy = intersect(s1[i]);
+          panel[i] = pxy.first;
+          xy[i] = pxy.second;
+        }
+      });
+    }
+
+  private:
+    // Slack on the cone overlap test, to keep it conservative under rounding
+    static constexpr double cone_margin = 1e-6;
+
+    /**
+     * Find the cone around the directions of the corners of a flat convex
+     * quadrilateral. Under a right angle, a cone is convex, so holding the
+     * corners means it holds the whole shape.
+     * @returns The half angle, or -1 if there is no such cone
+     */
+    static double bounding_cone(const vec3<double> (&corners)[4], vec3<double> &axis) {
+      axis = vec3<double>(0, 0, 0);
+      for (std::size_t k = 0; k < 4; ++k) {
+        if (corners[k].length() == 0) {
+          return -1;
+        }
+        axis += corners[k].normalize();
+      }
+      if (axis.length() == 0) {
+        return -1;
+      }
+      axis = axis.normalize();
+      double half_angle = 0;
+      for (std::size_t k = 0; k < 4; ++k) {
+        half_angle = std::max(half_angle, angle_safe(axis, corners[k]));
+      }
+      const double max_half_angle = 0.49 * scitbx::constants::pi;
+      return half_angle < max_half_angle ? half_angle : -1;
+    }
+
+    /** @returns The bin of a direction */
+    std::size_t bin(const vec3<double> &s1) const {
+      double ax = std::abs(s1[0]), ay = std::abs(s1[1]), az = std::abs(s1[2]);
+      std::size_t face;
+      double u, v, m;
+      if (ax >= ay && ax >= az) {
+        face = s1[0] > 0 ? 0 : 1;
+        m = ax, u = s1[1], v = s1[2];
+      } else if (ay >= az) {
+        face = s1[1] > 0 ? 2 : 3;
+        m = ay, u = s1[2], v = s1[0];
+      } else {
+        face = s1[2] > 0 ? 4 : 5;
+        m = az, u = s1[0], v = s1[1];
+      }
+      std::size_t i = cell(u / m), j = cell(v / m);
+      return (face * nbins_ + j) * nbins_ + i;
+    }
+
+    /** @returns The cell along a cube face edge of a coordinate in [-1, 1] */
+    std::size_t cell(double u) const {
+      double c = std::floor(0.5 * (u + 1.0) * nbins_);
+      return (std::size_t)std::min(std::max(c, 0.0), double(nbins_ - 1));
+    }
+
+    /** Get the corners of a bin, on the surface of the cube */
+    void bin_corners(std::size_t b, vec3<double> (&corners)[4]) const {
+      std::size_t i = b % nbins_, j = (b / nbins_) % nbins_;
+      std::size_t face = b / (nbins_ * nbins_);
+      double sign = face % 2 == 0 ? 1.0 : -1.0;
+      for (std::size_t k = 0; k < 4; ++k) {
+        double u = 2.0 * (i + k % 2) / nbins_ - 1.0;
+        double v = 2.0 * (j + k / 2) / nbins_ - 1.0;
+        switch (face / 2) {
+        case 0:
+          corners[k] = vec3<double>(sign, u, v);
+          break;
+        case 1:
+          corners[k] = vec3<double>(v, sign, u);
+          break;
+        default:
+          corners[k] = vec3<double>(u, v, sign);
+          break;
+        }
+      }
+    }
+
+    std::size_t revision_;
+    std::size_t nbins_;
+    std::vector<mat3<double> > D_;
+    std::vector<vec2<double> > size_mm_;
+    std::vector<std::size_t> bin_start_;
+    std::vector<int> bin_panels_;
+  };
+
+  namespace detail {
+
+    /**
+     * The ray index of a detector. The index is built the first time it is
+     * needed and again whenever the detector revision changes. A copy starts
+     * empty. It may be used from several threads.
+     */
+    class detector_ray_index_cache {
+    public:
+      detector_ray_index_cache() {}
+
+      detector_ray_index_cache(const detector_ray_index_cache &) {}
+
+      detector_ray_index_cache &operator=(const detector_ray_index_cache &) {
+        return *this;
+      }
+
+      /** @returns The index for the detector */
+      template <typename DetectorType>
+      std::shared_ptr<const DetectorRayIndex> get(const DetectorType &detector) {
+        std::size_t revision = detector.get_revision();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!index_ || index_->revision() != revision) {
+          index_ = std::make_shared<const DetectorRayIndex>(detector);
+        }
+        return index_;
+      }
+
+    private:
+      std::mutex mutex_;
+      std::shared_ptr<const DetectorRayIndex> index_;
+    };
+
+  }  // namespace detail
+
+}}  // namespace dxtbx::model
+
+#endif  // DXTBX_MODEL_DETECTOR_RAY_INDEX_H
@@ -11,6 +11,7 @@
 #ifndef DXTBX_MODEL_EXPERIMENT_H
 #define DXTBX_MODEL_EXPERIMENT_H
 
+#include <atomic>
 #include <iostream>
 #include <cmath>
 #include <memory>
@@ -28,6 +29,20 @@
 
 namespace dxtbx { namespace model {
 
+  namespace detail {
+
+    /**
+     * The count of changes made to the experiments of one ExperimentList.
+     * Each experiment in the list moves it on whenever one of its models or
+     * its identifier is set, so that the list can tell when its indexes may
+     * be out of date.
+     */
+    typedef std::shared_ptr<std::atomic<std::size_t> > experiment_changes_type;
+
+  }  // namespace detail
+
+  class ExperimentList;
+
   /**
    * A class to represent what's in an experiment.
    *
@@ -70,6 +85,32 @@ namespace dxtbx { namespace model {
           scaling_model_(scaling_model),
           identifier_(identifier) {}
 
+    /**
+     * Copy another experiment. The copy counts its changes for the same list
+     * until it is put in another, which at worst rebuilds an index that was
+     * still current.
+     */
+    Experiment(const Experiment &) = default;
+
+    /**
+     * Copy another experiment. Experiments are assigned in place inside an
+     * ExperimentList, so this counts as a change to the list holding this
+     * one.
+     */
+    Experiment &operator=(const Experiment &other) {
+      beam_ = other.beam_;
+      detector_ = other.detector_;
+      goniometer_ = other.goniometer_;
+      scan_ = other.scan_;
+      crystal_ = other.crystal_;
+      profile_ = other.profile_;
+      imageset_ = other.imageset_;
+      scaling_model_ = other.scaling_model_;
+      identifier_ = other.identifier_;
+      changed();
+      return *this;
+    }
+
     /**
      * Check if the beam model is the same.
      */
@@ -165,6 +206,7 @@ namespace dxtbx { namespace model {
      */
     void set_beam(std::shared_ptr<BeamBase> beam) {
       beam_ = beam;
+      changed();
     }
 
     /**
@@ -179,6 +221,7 @@ namespace dxtbx { namespace model {
      */
     void set_detector(std::shared_ptr<Detector> detector) {
       detector_ = detector;
+      changed();
     }
 
     /**
@@ -193,6 +236,7 @@ namespace dxtbx { namespace model {
      */
     void set_goniometer(std::shared_ptr<Goniometer> goniometer) {
       goniometer_ = goniometer;
+      changed();
     }
 
     /**
@@ -207,6 +251,7 @@ namespace dxtbx { namespace model {
      */
     void set_scan(std::shared_ptr<Scan> scan) {
       scan_ = scan;
+      changed();
     }
 
     /**
@@ -221,6 +266,7 @@ namespace dxtbx { namespace model {
      */
     void set_crystal(std::shared_ptr<CrystalBase> crystal) {
       crystal_ = crystal;
+      changed();
     }
 
     /**
@@ -235,6 +281,7 @@ namespace dxtbx { namespace model {
      */
     void set_profile(boost::python::object profile) {
       profile_ = profile;
+      changed();
     }
 
     /**
@@ -249,6 +296,7 @@ namespace dxtbx { namespace model {
      */
     void set_imageset(boost::python::object imageset) {
       imageset_ = imageset;
+      changed();
     }
 
     /**
@@ -263,6 +311,7 @@ namespace dxtbx { namespace model {
      */
     void set_scaling_model(boost::python::object scaling_model) {
       scaling_model_ = scaling_model;
+      changed();
     }
 
     /**
@@ -277,6 +326,7 @@ namespace dxtbx { namespace model {
      */
     void set_identifier(std::string identifier) {
       identifier_ = identifier;
+      changed();
     }
 
     /**
@@ -287,6 +337,15 @@ namespace dxtbx { namespace model {
     }
 
   protected:
+    friend class ExperimentList;
+
+    /** Count a change to the list holding the experiment, if there is one */
+    void changed() {
+      if (changes_) {
+        ++*changes_;
+      }
+    }
+
     std::shared_ptr<BeamBase> beam_;
     std::shared_ptr<Detector> detector_;
     std::shared_ptr<Goniometer> goniometer_;
@@ -296,6 +355,7 @@ namespace dxtbx { namespace model {
     boost::python::object imageset_;
     boost::python::object scaling_model_;
     std::string identifier_;
+    detail::experiment_changes_type changes_;
   };
 
 }}  // namespace dxtbx::model
@@ -14,7 +14,10 @@
 #include <iostream>
 #include <cmath>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <boost/python.hpp>
 #include <boost/python/def.hpp>
 #include <scitbx/vec3.h>
@@ -25,8 +28,51 @@
 
 namespace dxtbx { namespace model {
 
+  namespace detail {
+
+    /**
+     * The experiments that hold each model of one kind, by the address of the
+     * model, and the first experiment to hold each model, in order.
+     */
+    struct experiment_model_index {
+      std::unordered_map<const void *, std::vector<std::size_t> > experiments;
+      std::vector<std::size_t> first;
+
+      void add(const void *model, std::size_t index) {
+        std::vector<std::size_t> &indices = experiments[model];
+        if (indices.empty()) {
+          first.push_back(index);
+        }
+        indices.push_back(index);
+      }
+
+      /** @returns The experiments that hold a model */
+      scitbx::af::shared<std::size_t> find(const void *model) const {
+        auto it = experiments.find(model);
+        if (it == experiments.end()) {
+          return scitbx::af::shared<std::size_t>();
+        }
+        const std::vector<std::size_t> &indices = it->second;
+        return scitbx::af::shared<std::size_t>(indices.data(),
+                                               indices.data() + indices.size());
+      }
+
+      bool contains(const void *model) const {
+        return experiments.find(model) != experiments.end();
+      }
+    };
+
+  }  // namespace detail
+
   /**
-   * This class contains a list of experiments
+   * This class contains a list of experiments.
+   *
+   * The list keeps hash maps from the experiment identifiers, and from the
+   * beam, detector, goniometer, scan and crystal models, to the experiments
+   * that hold them. Appending keeps the maps up to date. Any other change to
+   * the list, or a change to any experiment, which may be made in place
+   * through a reference from the list, leaves them to be rebuilt in one pass
+   * when they are next needed.
    */
   class ExperimentList {
   public:
@@ -42,12 +88,8 @@ namespace dxtbx { namespace model {
      */
     ExperimentList(const const_ref_type &data) : data_(data.begin(), data.end()) {
       DXTBX_ASSERT(is_consistent());
-      // Read all the experiment identifiers into our membership set
-      for (auto &exp : data) {
-        auto identifier = exp.get_identifier();
-        if (identifier != "") {
-          _experiment_identifiers.insert(identifier);
-        }
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        data_[i].changes_ = changes_;
       }
     }
 
@@ -79,47 +121,41 @@ namespace dxtbx { namespace model {
      */
     void erase(std::size_t index) {
       DXTBX_ASSERT(index < data_.size());
-      auto identifier = data_[index].get_identifier();
-      auto iter = _experiment_identifiers.find(identifier);
-      if (identifier != "" && iter != _experiment_identifiers.end()) {
-        _experiment_identifiers.erase(iter);
-      }
       data_.erase(data_.begin() + index, data_.begin() + index + 1);
+      index_valid_ = false;
     }
 
     /**
-     * Remove experiments from the experiment list based on experiment identifiers
+     * Remove experiments from the experiment list based on experiment
+     * identifiers. Each identifier must match an experiment. The experiments
+     * are removed together in one pass.
      */
     void remove_on_experiment_identifiers(boost::python::list identifiers) {
+      std::vector<bool> keep(data_.size(), true);
       boost::python::ssize_t n = boost::python::len(identifiers);
       for (boost::python::ssize_t i = 0; i < n; i++) {
-        boost::python::object elem = identifiers[i];
-        std::string elem_str = boost::python::extract<std::string>(elem);
-        std::size_t j = find(elem_str);
-        erase(j);
-        // It's possible that we changed identifiers since adding, check
-        auto iter = _experiment_identifiers.find(elem_str);
-        if (elem_str != "" && iter != _experiment_identifiers.end()) {
-          _experiment_identifiers.erase(iter);
-        }
+        std::string elem_str = boost::python::extract<std::string>(identifiers[i]);
+        int j = find(elem_str);
+        DXTBX_ASSERT(j >= 0 && keep[j]);
+        keep[j] = false;
       }
+      erase_unless(keep);
     }
+
     /**
      * Select experiments from the experiment list based on experiment identifiers
      */
     void select_on_experiment_identifiers(boost::python::list identifiers) {
+      std::unordered_set<std::string> selected;
       boost::python::ssize_t n = boost::python::len(identifiers);
-      int n_exp = data_.size();
-      for (int i = n_exp; i > 0; i--) {
-        std::string iden = data_[i - 1].get_identifier();
-        bool in_list = false;
-        for (boost::python::ssize_t j = 0; j < n; j++) {
-          boost::python::object elem = identifiers[j];
-          std::string elem_str = boost::python::extract<std::string>(elem);
-          if (elem_str == iden) in_list = true;
-        }
-        if (in_list == false) erase(i - 1);
+      for (boost::python::ssize_t i = 0; i < n; i++) {
+        selected.insert(boost::python::extract<std::string>(identifiers[i])());
       }
+      std::vector<bool> keep(data_.size());
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        keep[i] = selected.find(data_[i].get_identifier()) != selected.end();
+      }
+      erase_unless(keep);
     }
 
     /**
@@ -162,6 +198,8 @@ namespace dxtbx { namespace model {
      */
     void clear() {
       data_.clear();
+      index_ = index_type();
+      index_valid_ = false;
     }
 
     /**
@@ -188,10 +226,9 @@ namespace dxtbx { namespace model {
     int find(std::string identifier) const {
       // If id is empty then skip
       if (identifier != "") {
-        for (std::size_t i = 0; i < data_.size(); ++i) {
-          if (data_[i].get_identifier() == identifier) {
-            return i;
-          }
+        auto it = index().identifiers.find(identifier);
+        if (it != index_.identifiers.end()) {
+          return it->second;
         }
       }
 
@@ -203,24 +240,31 @@ namespace dxtbx { namespace model {
      * Append an experiment to the list
      */
     void append(const Experiment &experiment) {
-      // Check the identifier is unique if set
+      // Check the identifier is unique if set. The experiments may have been
+      // changed in place, so this is checked against an up to date index.
       auto identifier = experiment.get_identifier();
       if (identifier != "") {
-        if (_experiment_identifiers.find(identifier) != _experiment_identifiers.end()) {
-          // We might have mutated the experiments in the list. Rebuild our identifier
-          // map before checking again. This is relatively expensive, so we only do
-          // when we have encountered a conflict.
-          rebuild_experiment_map();
-          if (_experiment_identifiers.find(identifier)
-              != _experiment_identifiers.end()) {
-            throw std::runtime_error("Experiment with identifier \"" + identifier
-                                     + "\" already in ExperimentList");
-          }
+        const index_type &current = index();
+        // If the experiments now share identifiers, we've mutated them into an
+        // inconsistent state, and shouldn't allow continuing until this is fixed.
+        if (current.duplicate_identifiers) {
+          throw std::runtime_error(
+            "ExperimentList has been mutated into an inconsistent state; please fix "
+            "before trying to extend.");
+        }
+        if (current.identifiers.find(identifier) != current.identifiers.end()) {
+          throw std::runtime_error("Experiment with identifier \"" + identifier
+                                   + "\" already in ExperimentList");
         }
-        _experiment_identifiers.insert(identifier);
       }
-      // Add the experiment
+      // Add the experiment, and keep the index up to date if it was
+      bool was_current = index_is_current();
       data_.push_back(experiment);
+      data_.back().changes_ = changes_;
+      if (was_current) {
+        index_.add(data_.back(), data_.size() - 1);
+        index_size_ = data_.size();
+      }
     }
 
     /**
@@ -237,60 +281,35 @@ namespace dxtbx { namespace model {
      * Check if an experiment contains the beam model
      */
     bool contains(const std::shared_ptr<BeamBase> &beam) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(beam)) {
-          return true;
-        }
-      }
-      return false;
+      return index().beams.contains(beam.get());
     }
 
     /**
      * Check if an experiment contains the detector model
      */
     bool contains(const std::shared_ptr<Detector> &detector) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(detector)) {
-          return true;
-        }
-      }
-      return false;
+      return index().detectors.contains(detector.get());
     }
 
     /**
      * Check if an experiment contains the goniometer model
      */
     bool contains(const std::shared_ptr<Goniometer> &goniometer) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(goniometer)) {
-          return true;
-        }
-      }
-      return false;
+      return index().goniometers.contains(goniometer.get());
     }
 
     /**
      * Check if an experiment contains the scan model
      */
     bool contains(const std::shared_ptr<Scan> &scan) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(scan)) {
-          return true;
-        }
-      }
-      return false;
+      return index().scans.contains(scan.get());
     }
 
     /**
      * Check if an experiment contains the crystal model
      */
     bool contains(const std::shared_ptr<CrystalBase> &crystal) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(crystal)) {
-          return true;
-        }
-      }
-      return false;
+      return index().crystals.contains(crystal.get());
     }
 
     /**
@@ -309,10 +328,9 @@ namespace dxtbx { namespace model {
      * Replace all beam models
      */
     void replace(std::shared_ptr<BeamBase> a, std::shared_ptr<BeamBase> b) {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_beam() == a) {
-          data_[i].set_beam(b);
-        }
+      scitbx::af::shared<std::size_t> which = indices(a);
+      for (std::size_t i = 0; i < which.size(); ++i) {
+        data_[which[i]].set_beam(b);
       }
     }
 
@@ -320,10 +338,9 @@ namespace dxtbx { namespace model {
      * Replace all detector models
      */
     void replace(std::shared_ptr<Detector> a, std::shared_ptr<Detector> b) {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_detector() == a) {
-          data_[i].set_detector(b);
-        }
+      scitbx::af::shared<std::size_t> which = indices(a);
+      for (std::size_t i = 0; i < which.size(); ++i) {
+        data_[which[i]].set_detector(b);
       }
     }
 
@@ -331,10 +348,9 @@ namespace dxtbx { namespace model {
      * Replace all goniometer models
      */
     void replace(std::shared_ptr<Goniometer> a, std::shared_ptr<Goniometer> b) {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_goniometer() == a) {
-          data_[i].set_goniometer(b);
-        }
+      scitbx::af::shared<std::size_t> which = indices(a);
+      for (std::size_t i = 0; i < which.size(); ++i) {
+        data_[which[i]].set_goniometer(b);
       }
     }
 
@@ -342,10 +358,9 @@ namespace dxtbx { namespace model {
      * Replace all scan models
      */
     void replace(std::shared_ptr<Scan> a, std::shared_ptr<Scan> b) {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_scan() == a) {
-          data_[i].set_scan(b);
-        }
+      scitbx::af::shared<std::size_t> which = indices(a);
+      for (std::size_t i = 0; i < which.size(); ++i) {
+        data_[which[i]].set_scan(b);
       }
     }
 
@@ -353,10 +368,9 @@ namespace dxtbx { namespace model {
      * Replace all crystal models
      */
     void replace(std::shared_ptr<CrystalBase> a, std::shared_ptr<CrystalBase> b) {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_crystal() == a) {
-          data_[i].set_crystal(b);
-        }
+      scitbx::af::shared<std::size_t> which = indices(a);
+      for (std::size_t i = 0; i < which.size(); ++i) {
+        data_[which[i]].set_crystal(b);
       }
     }
 
@@ -411,13 +425,7 @@ namespace dxtbx { namespace model {
      */
     scitbx::af::shared<std::size_t> indices(
       const std::shared_ptr<BeamBase> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_beam() == obj) {
-          result.push_back(i);
-        }
-      }
-      return result;
+      return index().beams.find(obj.get());
     }
 
     /**
@@ -425,13 +433,7 @@ namespace dxtbx { namespace model {
      */
     scitbx::af::shared<std::size_t> indices(
       const std::shared_ptr<Detector> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_detector() == obj) {
-          result.push_back(i);
-        }
-      }
-      return result;
+      return index().detectors.find(obj.get());
     }
 
     /**
@@ -439,26 +441,14 @@ namespace dxtbx { namespace model {
      */
     scitbx::af::shared<std::size_t> indices(
       const std::shared_ptr<Goniometer> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_goniometer() == obj) {
-          result.push_back(i);
-        }
-      }
-      return result;
+      return index().goniometers.find(obj.get());
     }
 
     /**
      * Get indices which have this model
      */
     scitbx::af::shared<std::size_t> indices(const std::shared_ptr<Scan> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_scan() == obj) {
-          result.push_back(i);
-        }
-      }
-      return result;
+      return index().scans.find(obj.get());
     }
 
     /**
@@ -466,13 +456,7 @@ namespace dxtbx { namespace model {
      */
     scitbx::af::shared<std::size_t> indices(
       const std::shared_ptr<CrystalBase> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].get_crystal() == obj) {
-          result.push_back(i);
-        }
-      }
-      return result;
+      return index().crystals.find(obj.get());
     }
 
     /**
@@ -572,36 +556,135 @@ namespace dxtbx { namespace model {
       return true;
     }
 
+    /**
+     * Get the unique beam models, in the order of the experiments that first
+     * hold them. An empty pointer stands for experiments with no beam.
+     */
+    std::vector<std::shared_ptr<BeamBase> > beams() const {
+      return unique_models(index().beams, &Experiment::get_beam);
+    }
+
+    /**
+     * Get the unique detector models, in the order of the experiments that
+     * first hold them
+     */
+    std::vector<std::shared_ptr<Detector> > detectors() const {
+      return unique_models(index().detectors, &Experiment::get_detector);
+    }
+
+    /**
+     * Get the unique goniometer models, in the order of the experiments that
+     * first hold them
+     */
+    std::vector<std::shared_ptr<Goniometer> > goniometers() const {
+      return unique_models(index().goniometers, &Experiment::get_goniometer);
+    }
+
+    /**
+     * Get the unique scan models, in the order of the experiments that first
+     * hold them
+     */
+    std::vector<std::shared_ptr<Scan> > scans() const {
+      return unique_models(index().scans, &Experiment::get_scan);
+    }
+
+    /**
+     * Get the unique crystal models, in the order of the experiments that
+     * first hold them
+     */
+    std::vector<std::shared_ptr<CrystalBase> > crystals() const {
+      return unique_models(index().crystals, &Experiment::get_crystal);
+    }
+
   protected:
-    /** Rebuild the internal experiment identifier map.
-     *
-     * This is because experiment identifiers can be mutated, making
-     * our internal reference out-of-date. This rebuilds the map with the
-     * new current identifiers for every experiment.
-     *
-     * \throws runtime_error ExperimentList has been mutated into an inconsistent state.
-     **/
-    void rebuild_experiment_map() {
-      _experiment_identifiers.clear();
-      for (auto &exp : data_) {
-        auto id = exp.get_identifier();
-        if (id == "") {
-          continue;
+    /**
+     * The maps from identifiers, and from models, to experiments. The first
+     * experiment with each identifier is kept if there are duplicates.
+     */
+    struct index_type {
+      index_type() : duplicate_identifiers(false) {}
+
+      void add(const Experiment &experiment, std::size_t i) {
+        std::string identifier = experiment.get_identifier();
+        if (identifier != "" && !identifiers.emplace(identifier, i).second) {
+          duplicate_identifiers = true;
         }
-        // Let's check that we haven't built a list of duplicates...
-        // if so, then we've mutated the experiments into an inconsistent
-        // state, and shouldn't allow continuing until this is fixed.
-        if (_experiment_identifiers.find(id) != _experiment_identifiers.end()) {
-          throw std::runtime_error(
-            "ExperimentList has been mutated into an inconsistent state; please fix "
-            "before trying to extend.");
+        beams.add(experiment.get_beam().get(), i);
+        detectors.add(experiment.get_detector().get(), i);
+        goniometers.add(experiment.get_goniometer().get(), i);
+        scans.add(experiment.get_scan().get(), i);
+        crystals.add(experiment.get_crystal().get(), i);
+      }
+
+      std::unordered_map<std::string, std::size_t> identifiers;
+      bool duplicate_identifiers;
+      detail::experiment_model_index beams;
+      detail::experiment_model_index detectors;
+      detail::experiment_model_index goniometers;
+      detail::experiment_model_index scans;
+      detail::experiment_model_index crystals;
+    };
+
+    /**
+     * Check if the index matches the experiments: it was built or kept up to
+     * date for the current list, and no experiment in it has changed since
+     */
+    bool index_is_current() const {
+      return index_valid_ && index_size_ == data_.size() && index_changes_ == *changes_;
+    }
+
+    /** @returns The index, rebuilt first if it may be out of date */
+    const index_type &index() const {
+      if (!index_is_current()) {
+        index_ = index_type();
+        for (std::size_t i = 0; i < data_.size(); ++i) {
+          index_.add(data_[i], i);
         }
-        _experiment_identifiers.insert(id);
+        index_size_ = data_.size();
+        index_changes_ = *changes_;
+        index_valid_ = true;
       }
+      return index_;
+    }
+
+    /** Remove the experiments not marked to keep, in one pass, in place */
+    void erase_unless(const std::vector<bool> &keep) {
+      DXTBX_ASSERT(keep.size() == data_.size());
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        if (keep[i]) {
+          if (n != i) {
+            data_[n] = data_[i];
+          }
+          ++n;
+        }
+      }
+      data_.erase(data_.begin() + n, data_.end());
+      index_valid_ = false;
+    }
+
+    /** Get the models of the first experiment to hold each unique model */
+    template <typename Model>
+    std::vector<std::shared_ptr<Model> > unique_models(
+      const detail::experiment_model_index &models,
+      std::shared_ptr<Model> (Experiment::*get)() const) const {
+      std::vector<std::shared_ptr<Model> > result;
+      result.reserve(models.first.size());
+      for (std::size_t i = 0; i < models.first.size(); ++i) {
+        result.push_back((data_[models.first[i]].*get)());
+      }
+      return result;
     }
 
     shared_type data_;
-    std::unordered_set<std::string> _experiment_identifiers{};
+    // The count of changes to the experiments, shared with any copy of the
+    // list since the copy shares the experiments too
+    detail::experiment_changes_type changes_ =
+      std::make_shared<std::atomic<std::size_t> >(0);
+    mutable index_type index_;
+    mutable bool index_valid_ = false;
+    mutable std::size_t index_size_ = 0;
+    mutable std::size_t index_changes_ = 0;
   };
 
 }}  // namespace dxtbx::model
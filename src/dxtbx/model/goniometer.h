@@ -11,6 +11,7 @@
 #ifndef DXTBX_MODEL_GONIOMETER_H
 #define DXTBX_MODEL_GONIOMETER_H
 
+#include <cmath>
 #include <iostream>
 #include <scitbx/vec3.h>
 #include <scitbx/mat3.h>
@@ -20,6 +21,7 @@
 #include <scitbx/array_family/simple_tiny_io.h>
 #include <scitbx/array_family/shared.h>
 #include <dxtbx/error.h>
+#include <dxtbx/parallel.h>
 #include "model_helpers.h"
 
 namespace dxtbx { namespace model {
@@ -134,6 +136,11 @@ namespace dxtbx { namespace model {
     /** Virtual destructor */
     virtual ~Goniometer() {}
 
+    /** @returns The revision, which changes whenever the goniometer does */
+    std::size_t get_revision() const {
+      return revision_.value();
+    }
+
     /** Get the orientation of the axis of the R' rotation, in the lab frame */
     vec3<double> get_rotation_axis() const {
       return setting_rotation_ * rotation_axis_;
@@ -177,22 +184,26 @@ namespace dxtbx { namespace model {
     void set_rotation_axis(vec3<double> rotation_axis) {
       DXTBX_ASSERT(rotation_axis.length() > 0);
       rotation_axis_ = setting_rotation_.inverse() * rotation_axis.normalize();
+      revision_.update();
     }
 
     /** Set the axis of the scanning rotation, R' */
     void set_rotation_axis_datum(vec3<double> rotation_axis) {
       DXTBX_ASSERT(rotation_axis.length() > 0);
       rotation_axis_ = rotation_axis.normalize();
+      revision_.update();
     }
 
     /** Set the 'fixed' rotation matrix, F */
     void set_fixed_rotation(mat3<double> fixed_rotation) {
       fixed_rotation_ = fixed_rotation;
+      revision_.update();
     }
 
     /** Set the 'setting' rotation matrix, S */
     void set_setting_rotation(mat3<double> setting_rotation) {
       setting_rotation_ = setting_rotation;
+      revision_.update();
     }
 
     /** Set the 'setting' rotation matrix at scan-points */
@@ -200,11 +211,65 @@ namespace dxtbx { namespace model {
       const scitbx::af::const_ref<mat3<double> > &S) {
       setting_rotation_at_scan_points_ =
         scitbx::af::shared<mat3<double> >(S.begin(), S.end());
+      revision_.update();
     }
 
     /** Reset the scan points */
     void reset_scan_points() {
       setting_rotation_at_scan_points_.clear();
+      revision_.update();
+    }
+
+    /**
+     * Get the full rotation S R'(phi) F at each of several scan angles.
+     *
+     * R'(phi) = I cos(phi) + [e]x sin(phi) + e e^T (1 - cos(phi)), where e
+     * is the axis at the datum and [e]x its cross product matrix, so the
+     * products with S and F are taken once and each angle only needs its
+     * sine and cosine.
+     * @param phi The scan angles in radians
+     * @param nthreads The number of threads, zero for the default
+     * @returns The rotation matrix at each angle
+     */
+    scitbx::af::shared<mat3<double> > get_rotation_matrices(
+      const scitbx::af::const_ref<double> &phi,
+      std::size_t nthreads = 0) const {
+      rotation_terms terms = get_rotation_terms();
+      scitbx::af::shared<mat3<double> > result(phi.size());
+      mat3<double> *r = result.begin();
+      parallel_for(phi.size(), nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          double c = std::cos(phi[i]), s = std::sin(phi[i]);
+          r[i] = terms.cos_term * c + terms.sin_term * s + terms.axis_term * (1 - c);
+        }
+      });
+      return result;
+    }
+
+    /**
+     * Rotate vectors by the full rotation S R'(phi) F, each at its own scan
+     * angle, without forming the matrices
+     * @param v The vectors
+     * @param phi The scan angle of each vector in radians
+     * @param nthreads The number of threads, zero for the default
+     * @returns The rotated vectors
+     */
+    scitbx::af::shared<vec3<double> > rotate_vectors(
+      const scitbx::af::const_ref<vec3<double> > &v,
+      const scitbx::af::const_ref<double> &phi,
+      std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(v.size() == phi.size());
+      rotation_terms terms = get_rotation_terms();
+      scitbx::af::shared<vec3<double> > result(v.size());
+      vec3<double> *r = result.begin();
+      parallel_for(v.size(), nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          double c = std::cos(phi[i]), s = std::sin(phi[i]);
+          r[i] = (terms.cos_term * v[i]) * c + (terms.sin_term * v[i]) * s
+                 + (terms.axis_term * v[i]) * (1 - c);
+        }
+      });
+      return result;
     }
 
     /** Check rotation axes are (almost) the same */
@@ -278,15 +343,43 @@ namespace dxtbx { namespace model {
     void rotate_around_origin(vec3<double> axis, double angle) {
       mat3<double> new_rotation = axis_and_angle_as_matrix(axis, angle);
       setting_rotation_ = new_rotation * setting_rotation_;
+      revision_.update();
     }
 
     friend std::ostream &operator<<(std::ostream &os, const Goniometer &gonio);
 
   protected:
+    /** The terms of S R'(phi) F in cos(phi), sin(phi) and 1 - cos(phi) */
+    struct rotation_terms {
+      mat3<double> cos_term;
+      mat3<double> sin_term;
+      mat3<double> axis_term;
+    };
+
+    rotation_terms get_rotation_terms() const {
+      vec3<double> e = rotation_axis_.normalize();
+      mat3<double> cross(0, -e[2], e[1], e[2], 0, -e[0], -e[1], e[0], 0);
+      mat3<double> outer(e[0] * e[0],
+                         e[0] * e[1],
+                         e[0] * e[2],
+                         e[1] * e[0],
+                         e[1] * e[1],
+                         e[1] * e[2],
+                         e[2] * e[0],
+                         e[2] * e[1],
+                         e[2] * e[2]);
+      rotation_terms terms;
+      terms.cos_term = setting_rotation_ * fixed_rotation_;
+      terms.sin_term = setting_rotation_ * cross * fixed_rotation_;
+      terms.axis_term = setting_rotation_ * outer * fixed_rotation_;
+      return terms;
+    }
+
     vec3<double> rotation_axis_;
     mat3<double> fixed_rotation_;
     mat3<double> setting_rotation_;
     scitbx::af::shared<mat3<double> > setting_rotation_at_scan_points_;
+    ModelRevision revision_;
   };
 
   /** Print goniometer data */
@@ -11,7 +11,9 @@
 #ifndef DXTBX_MODEL_MODEL_HELPERS_H
 #define DXTBX_MODEL_MODEL_HELPERS_H
 
+#include <atomic>
 #include <cmath>
+#include <cstddef>
 #include <scitbx/vec3.h>
 
 namespace dxtbx { namespace model {
@@ -29,6 +31,49 @@ namespace dxtbx { namespace model {
     return std::acos(c);
   }
 
+  /**
+   * @returns A new model revision. Revisions come from one counter shared by
+   * all the models, so they only ever increase and are never handed out
+   * twice.
+   */
+  inline std::size_t next_revision() {
+    static std::atomic<std::size_t> counter(0);
+    return ++counter;
+  }
+
+  /**
+   * The revision of a model. It starts at a new revision and is moved on to
+   * a new one by every change to the model, so a cache of anything derived
+   * from the model can be keyed on it. A copy keeps the revision, since it
+   * holds the same values, until either of them is changed. Assigning to a
+   * model moves it on to a new revision instead, as a revision taken from
+   * the source may be older than one already seen for the target.
+   */
+  class ModelRevision {
+  public:
+    ModelRevision() : value_(next_revision()) {}
+
+    ModelRevision(const ModelRevision &other) : value_(other.value_) {}
+
+    ModelRevision &operator=(const ModelRevision &) {
+      update();
+      return *this;
+    }
+
+    /** @returns The revision */
+    std::size_t value() const {
+      return value_;
+    }
+
+    /** Move on to a new revision */
+    void update() {
+      value_ = next_revision();
+    }
+
+  private:
+    std::size_t value_;
+  };
+
 }}  // namespace dxtbx::model
 
 #endif  // DXTBX_MODEL_MODEL_HELPERS_H
@@ -111,6 +111,7 @@ namespace dxtbx { namespace model {
       // if we are using the setting rotation then this should be
       // applied before this axis => do not include the setting here...
       rotation_axis_ = axes_[scan_axis_];
+      revision_.update();
     }
 
     /* Calculate the fixed rotation */
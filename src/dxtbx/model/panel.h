@@ -23,6 +23,7 @@
 #include <dxtbx/model/model_helpers.h>
 #include <dxtbx/model/virtual_panel.h>
 #include <dxtbx/model/panel_data.h>
+#include <dxtbx/model/panel_geometry_maps.h>
 #include <dxtbx/model/pixel_to_millimeter.h>
 #include <dxtbx/error.h>
 
@@ -123,6 +124,7 @@ namespace dxtbx { namespace model {
      */
     void set_identifier(std::string identifier) {
       identifier_ = identifier;
+      revision_.update();
     }
 
     /**
@@ -136,6 +138,7 @@ namespace dxtbx { namespace model {
     void set_gain(double gain) {
       DXTBX_ASSERT(gain > 0);
       gain_ = gain;
+      revision_.update();
     }
 
     /** Get the gain */
@@ -146,6 +149,7 @@ namespace dxtbx { namespace model {
     /** Set the pedestal */
     void set_pedestal(double pedestal) {
       pedestal_ = pedestal;
+      revision_.update();
     }
 
     /** Get the pedestal */
@@ -161,6 +165,7 @@ namespace dxtbx { namespace model {
     /** Set the pixel to millimetre strategy */
     void set_px_mm_strategy(std::shared_ptr<PxMmStrategy> strategy) {
       convert_coord_ = strategy;
+      revision_.update();
     }
 
     /** Get the image size in millimeters */
@@ -237,6 +242,49 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(convert_coord_ != NULL);
       return convert_coord_->to_millimeter(*this, xy, attenuation_length);
     }
+
+    /**
+     * Map an array of coordinates in mm to pixels, with one call to the
+     * px/mm strategy
+     * @param xy The coordinates in mm
+     * @param result The coordinates in pixels, which may be xy
+     */
+    void millimeter_to_pixel_multiple(
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(convert_coord_ != NULL);
+      convert_coord_->to_pixel_multiple(*this, xy, result);
+    }
+
+    /**
+     * Map an array of coordinates in pixels to mm, with one call to the
+     * px/mm strategy
+     * @param xy The coordinates in pixels
+     * @param result The coordinates in mm, which may be xy
+     */
+    void pixel_to_millimeter_multiple(
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(convert_coord_ != NULL);
+      convert_coord_->to_millimeter_multiple(*this, xy, result);
+    }
+
+    /** Map an array of coordinates in mm to pixels */
+    scitbx::af::shared<vec2<double> > millimeter_to_pixel_multiple(
+      const scitbx::af::const_ref<vec2<double> > &xy) const {
+      scitbx::af::shared<vec2<double> > result(xy.size());
+      millimeter_to_pixel_multiple(xy, result.ref());
+      return result;
+    }
+
+    /** Map an array of coordinates in pixels to mm */
+    scitbx::af::shared<vec2<double> > pixel_to_millimeter_multiple(
+      const scitbx::af::const_ref<vec2<double> > &xy) const {
+      scitbx::af::shared<vec2<double> > result(xy.size());
+      pixel_to_millimeter_multiple(xy, result.ref());
+      return result;
+    }
+
     /**
      * Get the 2theta angle at a given pixel.
      * @param s0 The incident beam vector
@@ -249,6 +297,62 @@ namespace dxtbx { namespace model {
       return angle_safe(s0, xyz);
     }
 
+    /**
+     * Get the per-pixel geometry maps for a beam. The maps are cached on the
+     * panel and are only computed again when the panel's revision or the
+     * beam changes, or more fields are needed. They are kept until then, or
+     * until clear_geometry_maps is called.
+     * @param s0 The incident beam vector
+     * @param fields The bit mask of PanelGeometryMaps fields to compute
+     * @param offset The point within each pixel, 0 for the corner and 0.5
+     * for the centre
+     * @param nthreads The number of threads, zero for the default
+     * @returns The maps
+     */
+    template <typename FloatType>
+    std::shared_ptr<const PanelGeometryMaps<FloatType> > get_geometry_maps(
+      vec3<double> s0,
+      int fields = PanelGeometryMaps<FloatType>::ALL,
+      double offset = 0.5,
+      std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(convert_coord_ != NULL);
+      DXTBX_ASSERT(s0.length() > 0);
+      return geometry_cache_.get<FloatType>(
+        *this, convert_coord_, s0, fields, offset, nthreads);
+    }
+
+    /**
+     * Compute the per-pixel geometry maps for a beam without keeping them on
+     * the panel. Maps already cached by get_geometry_maps are used if they
+     * hold the fields.
+     * @param s0 The incident beam vector
+     * @param fields The bit mask of PanelGeometryMaps fields to compute
+     * @param offset The point within each pixel
+     * @param nthreads The number of threads, zero for the default
+     * @returns The maps
+     */
+    template <typename FloatType>
+    std::shared_ptr<const PanelGeometryMaps<FloatType> > compute_geometry_maps(
+      vec3<double> s0,
+      int fields = PanelGeometryMaps<FloatType>::ALL,
+      double offset = 0.5,
+      std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(convert_coord_ != NULL);
+      DXTBX_ASSERT(s0.length() > 0);
+      std::shared_ptr<const PanelGeometryMaps<FloatType> > maps =
+        geometry_cache_.find<FloatType>(*this, convert_coord_, s0, fields, offset);
+      if (!maps) {
+        maps = std::make_shared<const PanelGeometryMaps<FloatType> >(
+          *this, convert_coord_, s0, fields, offset, nthreads);
+      }
+      return maps;
+    }
+
+    /** Drop the geometry maps cached on the panel */
+    void clear_geometry_maps() const {
+      geometry_cache_.clear();
+    }
+
     /**
      * Get the 2theta angle at every pixel.
      * @param s0 The incident beam vector
@@ -256,17 +360,10 @@ namespace dxtbx { namespace model {
      */
     scitbx::af::versa<double, scitbx::af::c_grid<2> > get_two_theta_array(
       vec3<double> s0) const {
-      DXTBX_ASSERT(s0.length() > 0);
-      size_t fast = image_size_[0], slow = image_size_[1];
-
-      scitbx::af::versa<double, scitbx::af::c_grid<2> > result(
-        scitbx::af::c_grid<2>(slow, fast));
-      for (size_t j = 0; j < slow; j++) {
-        for (size_t i = 0; i < fast; i++) {
-          result(j, i) = angle_safe(s0, get_pixel_lab_coord(vec2<double>(i, j)));
-        }
-      }
-      return result;
+      return compute_geometry_maps<double>(
+               s0, PanelGeometryMaps<double>::TWO_THETA, 0.0)
+        ->two_theta()
+        .deep_copy();
     }
 
     /**
@@ -276,19 +373,16 @@ namespace dxtbx { namespace model {
      */
     scitbx::af::versa<double, scitbx::af::c_grid<2> > get_cos2_two_theta_array(
       vec3<double> s0) const {
-      DXTBX_ASSERT(s0.length() > 0);
+      std::shared_ptr<const PanelGeometryMaps<double> > maps =
+        compute_geometry_maps<double>(s0, PanelGeometryMaps<double>::LAB_COORD, 0.0);
       s0 /= s0.length();
-      size_t fast = image_size_[0], slow = image_size_[1];
-
+      const double *p = maps->lab_coord().begin();
       scitbx::af::versa<double, scitbx::af::c_grid<2> > result(
-        scitbx::af::c_grid<2>(slow, fast));
-      for (size_t j = 0; j < slow; j++) {
-        for (size_t i = 0; i < fast; i++) {
-          vec3<double> p = get_pixel_lab_coord(vec2<double>(i, j));
-          double d1 = s0 * p;
-          double d2 = p * p;
-          result(j, i) = d1 * d1 / d2;
-        }
+        scitbx::af::c_grid<2>(image_size_[1], image_size_[0]));
+      for (std::size_t i = 0; i < result.size(); ++i, p += 3) {
+        double d1 = s0[0] * p[0] + s0[1] * p[1] + s0[2] * p[2];
+        double d2 = p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+        result[i] = d2 > 0 ? d1 * d1 / d2 : 0.0;
       }
       return result;
     }
@@ -396,9 +490,11 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(data.accessor()[0] == image_size_[1]);
       DXTBX_ASSERT(data.accessor()[1] == image_size_[0]);
       DXTBX_ASSERT(data.accessor().all_eq(mask.accessor()));
+      // Avoid short circuits so that the loop vectorises
+      const double min_trusted = trusted_range_[0];
+      const double max_trusted = trusted_range_[1];
       for (std::size_t i = 0; i < mask.size(); ++i) {
-        mask[i] =
-          mask[i] && (trusted_range_[0] <= data[i] && data[i] <= trusted_range_[1]);
+        mask[i] = mask[i] & (min_trusted <= data[i]) & (data[i] <= max_trusted);
       }
     }
 
@@ -431,10 +527,12 @@ namespace dxtbx { namespace model {
 
     void set_projection_2d(const Projection2D &projection_2d) {
       projection_2d_ = projection_2d;
+      revision_.update();
     }
 
     void set_projection_2d(int4 rotation, int2 translation) {
       projection_2d_ = Projection2D(rotation, translation);
+      revision_.update();
     }
 
     bool has_same_projection_2d(const Panel &other) const {
@@ -464,6 +562,7 @@ namespace dxtbx { namespace model {
     std::shared_ptr<PxMmStrategy> convert_coord_;
     std::string identifier_;
     boost::optional<Projection2D> projection_2d_;
+    mutable detail::panel_geometry_cache geometry_cache_;
   };
 
   /** Print panel information */
@@ -71,6 +71,7 @@ namespace dxtbx { namespace model {
     /** Set the pixel size */
     void set_pixel_size(tiny<double, 2> pixel_size) {
       pixel_size_ = pixel_size;
+      revision_.update();
     }
 
     /** Get the image size */
@@ -81,6 +82,7 @@ namespace dxtbx { namespace model {
     /** Set the image size */
     void set_image_size(tiny<std::size_t, 2> image_size) {
       image_size_ = image_size;
+      revision_.update();
     }
 
     /** Get the trusted range [p1, p2] where p1 is the minimum trusted
@@ -97,6 +99,7 @@ namespace dxtbx { namespace model {
      */
     void set_trusted_range(tiny<double, 2> trusted_range) {
       trusted_range_ = trusted_range;
+      revision_.update();
     }
 
     /** Get the thickness */
@@ -107,6 +110,7 @@ namespace dxtbx { namespace model {
     /** Set the thickness */
     void set_thickness(double thickness) {
       thickness_ = thickness;
+      revision_.update();
     }
 
     /** Get the material */
@@ -117,11 +121,13 @@ namespace dxtbx { namespace model {
     /** Set the material */
     void set_material(const std::string &material) {
       material_ = material;
+      revision_.update();
     }
 
     /** Set mu */
     void set_mu(const double mu) {
       mu_ = mu;
+      revision_.update();
     }
 
     /** Get mu */
@@ -141,6 +147,7 @@ namespace dxtbx { namespace model {
      */
     void set_raw_image_offset(int2 raw_image_offset) {
       raw_image_offset_ = raw_image_offset;
+      revision_.update();
     }
 
     /** Get the mask array */
@@ -154,11 +161,13 @@ namespace dxtbx { namespace model {
     void set_mask(const scitbx::af::const_ref<int4> &mask) {
       mask_.clear();
       std::copy(mask.begin(), mask.end(), std::back_inserter(mask_));
+      revision_.update();
     }
 
     /** Add an element to the mask */
     void add_mask(int f0, int s0, int f1, int s1) {
       mask_.push_back(int4(f0, s0, f1, s1));
+      revision_.update();
     }
 
     /** @returns True/False this is the same as the other */
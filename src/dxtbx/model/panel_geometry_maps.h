@@ -0,0 +1,410 @@
+/*
+ * panel_geometry_maps.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_PANEL_GEOMETRY_MAPS_H
+#define DXTBX_MODEL_PANEL_GEOMETRY_MAPS_H
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/model/model_helpers.h>
+#include <dxtbx/model/panel_data.h>
+#include <dxtbx/model/pixel_to_millimeter.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::mat3;
+  using scitbx::vec2;
+  using scitbx::vec3;
+
+  /**
+   * Per-pixel geometry of a panel for a given beam. The maps are computed
+   * once, at the same point within every pixel, and are then read only, so
+   * a set of maps may be shared between threads. The maps to compute are
+   * chosen with a bit mask of the fields below, since a full set for a
+   * large detector takes a lot of memory.
+   *
+   * Pixels whose coordinates cannot be converted to millimetres are given
+   * zero in every map.
+   */
+  template <typename FloatType = double>
+  class PanelGeometryMaps {
+  public:
+    typedef FloatType value_type;
+    typedef scitbx::af::versa<FloatType, scitbx::af::c_grid<2> > map_type;
+    typedef scitbx::af::versa<FloatType, scitbx::af::c_grid<3> > lab_coord_map_type;
+
+    enum Field {
+      /** The lab coordinate (mm), as a (slow, fast, 3) array */
+      LAB_COORD = 1,
+      /** The two theta angle (radians) */
+      TWO_THETA = 2,
+      /** The resolution (Angstroms) as given by Panel::get_resolution_at_pixel */
+      RESOLUTION = 4,
+      /** The cosine of the angle between the diffracted ray and the normal */
+      OBLIQUITY = 8,
+      ALL = 15
+    };
+
+    /**
+     * Compute the maps
+     * @param panel The panel
+     * @param strategy The panel's pixel to millimetre strategy
+     * @param s0 The incident beam vector
+     * @param fields The bit mask of maps to compute
+     * @param offset The point within each pixel, 0 for the corner and 0.5
+     * for the centre
+     * @param nthreads The number of threads, zero for the default
+     */
+    PanelGeometryMaps(const PanelData &panel,
+                      std::shared_ptr<PxMmStrategy> strategy,
+                      vec3<double> s0,
+                      int fields,
+                      double offset,
+                      std::size_t nthreads)
+        : strategy_(strategy),
+          revision_(panel.get_revision()),
+          d_matrix_(panel.get_d_matrix()),
+          image_size_(panel.get_image_size()[0], panel.get_image_size()[1]),
+          s0_(s0),
+          fields_(fields & ALL),
+          offset_(offset) {
+      DXTBX_ASSERT(strategy != NULL);
+      DXTBX_ASSERT(s0.length() > 0);
+      DXTBX_ASSERT(fields_ != 0 && fields_ == fields);
+      std::size_t fast = image_size_[0], slow = image_size_[1];
+      if (has(LAB_COORD)) {
+        lab_coord_ = lab_coord_map_type(scitbx::af::c_grid<3>(slow, fast, 3));
+      }
+      if (has(TWO_THETA)) {
+        two_theta_ = map_type(scitbx::af::c_grid<2>(slow, fast));
+      }
+      if (has(RESOLUTION)) {
+        resolution_ = map_type(scitbx::af::c_grid<2>(slow, fast));
+      }
+      if (has(OBLIQUITY)) {
+        obliquity_ = map_type(scitbx::af::c_grid<2>(slow, fast));
+      }
+
+      // Take raw pointers so the workers never touch the reference counts
+      FloatType *lab_coord = has(LAB_COORD) ? lab_coord_.begin() : NULL;
+      FloatType *two_theta = has(TWO_THETA) ? two_theta_.begin() : NULL;
+      FloatType *resolution = has(RESOLUTION) ? resolution_.begin() : NULL;
+      FloatType *obliquity = has(OBLIQUITY) ? obliquity_.begin() : NULL;
+      const PxMmStrategy &convert = *strategy_;
+      parallel_for(slow, nthreads, [&](std::size_t j0, std::size_t j1) {
+        std::vector<vec2<double> > xy(fast), mm(fast);
+        std::vector<double> x(fast), y(fast), z(fast);
+        std::vector<bool> valid(fast);
+        for (std::size_t j = j0; j < j1; ++j) {
+          for (std::size_t i = 0; i < fast; ++i) {
+            xy[i] = vec2<double>(i + offset, j + offset);
+          }
+          to_millimeter_row(panel, convert, xy, mm, valid);
+          compute_row(mm, valid, x, y, z);
+          std::size_t k = j * fast;
+          if (lab_coord != NULL) {
+            FloatType *row = lab_coord + 3 * k;
+            for (std::size_t i = 0; i < fast; ++i) {
+              row[3 * i + 0] = (FloatType)x[i];
+              row[3 * i + 1] = (FloatType)y[i];
+              row[3 * i + 2] = (FloatType)z[i];
+            }
+          }
+          if (two_theta != NULL || resolution != NULL) {
+            compute_angles(x, y, z, valid, two_theta, resolution, k);
+          }
+          if (obliquity != NULL) {
+            compute_obliquity(x, y, z, valid, obliquity + k);
+          }
+        }
+      });
+    }
+
+    /** @returns True/False the maps include the field */
+    bool has(int field) const {
+      return (fields_ & field) == field;
+    }
+
+    /** @returns The bit mask of the maps that were computed */
+    int fields() const {
+      return fields_;
+    }
+
+    /** @returns The point within each pixel at which the maps were computed */
+    double offset() const {
+      return offset_;
+    }
+
+    /** @returns The incident beam vector */
+    vec3<double> s0() const {
+      return s0_;
+    }
+
+    /**
+     * @returns True/False the maps hold the fields for this revision of the
+     * panel, strategy, beam and point within the pixel
+     */
+    bool is_for(const PanelData &panel,
+                const std::shared_ptr<PxMmStrategy> &strategy,
+                vec3<double> s0,
+                int fields,
+                double offset) const {
+      return has(fields) && revision_ == panel.get_revision() && strategy_ == strategy
+             && offset_ == offset && s0_.const_ref().all_eq(s0.const_ref());
+    }
+
+    /** @returns The lab coordinate map, a (slow, fast, 3) array */
+    const lab_coord_map_type &lab_coord() const {
+      DXTBX_ASSERT(has(LAB_COORD));
+      return lab_coord_;
+    }
+
+    /** @returns The two theta map */
+    const map_type &two_theta() const {
+      DXTBX_ASSERT(has(TWO_THETA));
+      return two_theta_;
+    }
+
+    /** @returns The resolution map */
+    const map_type &resolution() const {
+      DXTBX_ASSERT(has(RESOLUTION));
+      return resolution_;
+    }
+
+    /** @returns The obliquity map */
+    const map_type &obliquity() const {
+      DXTBX_ASSERT(has(OBLIQUITY));
+      return obliquity_;
+    }
+
+  private:
+    /**
+     * Convert a row of pixel coordinates in one call. If the strategy fails
+     * on the row, the pixels are converted one at a time and the ones that
+     * fail are marked invalid.
+     */
+    static void to_millimeter_row(const PanelData &panel,
+                                  const PxMmStrategy &convert,
+                                  const std::vector<vec2<double> > &xy,
+                                  std::vector<vec2<double> > &mm,
+                                  std::vector<bool> &valid) {
+      std::fill(valid.begin(), valid.end(), true);
+      try {
+        convert.to_millimeter_multiple(
+          panel,
+          scitbx::af::const_ref<vec2<double> >(&xy[0], xy.size()),
+          scitbx::af::ref<vec2<double> >(&mm[0], mm.size()));
+      } catch (dxtbx::error const &) {
+        for (std::size_t i = 0; i < xy.size(); ++i) {
+          try {
+            mm[i] = convert.to_millimeter(panel, xy[i]);
+          } catch (dxtbx::error const &) {
+            mm[i] = vec2<double>(0, 0);
+            valid[i] = false;
+          }
+        }
+      }
+    }
+
+    /** Compute the lab coordinates of a row, as Panel::get_lab_coord */
+    void compute_row(const std::vector<vec2<double> > &mm,
+                     const std::vector<bool> &valid,
+                     std::vector<double> &x,
+                     std::vector<double> &y,
+                     std::vector<double> &z) const {
+      const mat3<double> &d = d_matrix_;
+      for (std::size_t i = 0; i < mm.size(); ++i) {
+        double u = mm[i][0], v = mm[i][1];
+        x[i] = d[0] * u + d[1] * v + d[2];
+        y[i] = d[3] * u + d[4] * v + d[5];
+        z[i] = d[6] * u + d[7] * v + d[8];
+      }
+      for (std::size_t i = 0; i < mm.size(); ++i) {
+        if (!valid[i]) {
+          x[i] = y[i] = z[i] = 0;
+        }
+      }
+    }
+
+    /**
+     * Compute the two theta and resolution of a row, as angle_safe and
+     * Panel::get_resolution_at_pixel
+     */
+    void compute_angles(const std::vector<double> &x,
+                        const std::vector<double> &y,
+                        const std::vector<double> &z,
+                        const std::vector<bool> &valid,
+                        FloatType *two_theta,
+                        FloatType *resolution,
+                        std::size_t k) const {
+      const double TINY_SINE_THETA = 1e-9;
+      const double s0_length = s0_.length();
+      for (std::size_t i = 0; i < x.size(); ++i) {
+        double angle = angle_safe(s0_, vec3<double>(x[i], y[i], z[i]));
+        if (two_theta != NULL) {
+          two_theta[k + i] = valid[i] ? (FloatType)angle : FloatType(0);
+        }
+        if (resolution != NULL) {
+          double sintheta = std::max(TINY_SINE_THETA, std::sin(0.5 * angle));
+          resolution[k + i] = valid[i] ? (FloatType)(1.0 / (2.0 * s0_length * sintheta))
+                                       : FloatType(0);
+        }
+      }
+    }
+
+    /** Compute the obliquity of a row */
+    void compute_obliquity(const std::vector<double> &x,
+                           const std::vector<double> &y,
+                           const std::vector<double> &z,
+                           const std::vector<bool> &valid,
+                           FloatType *obliquity) const {
+      vec3<double> n = d_matrix_.get_column(0).cross(d_matrix_.get_column(1));
+      DXTBX_ASSERT(n.length() > 0);
+      n = n.normalize();
+      for (std::size_t i = 0; i < x.size(); ++i) {
+        double r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+        double c = r2 > 0 ? std::abs(x[i] * n[0] + y[i] * n[1] + z[i] * n[2])
+                              / std::sqrt(r2)
+                          : 0.0;
+        obliquity[i] = valid[i] ? (FloatType)std::min(c, 1.0) : FloatType(0);
+      }
+    }
+
+    std::shared_ptr<PxMmStrategy> strategy_;
+    std::size_t revision_;
+    mat3<double> d_matrix_;
+    vec2<std::size_t> image_size_;
+    vec3<double> s0_;
+    int fields_;
+    double offset_;
+    lab_coord_map_type lab_coord_;
+    map_type two_theta_;
+    map_type resolution_;
+    map_type obliquity_;
+  };
+
+  namespace detail {
+
+    /**
+     * The geometry maps of a panel. The most recently used maps of each
+     * precision are kept, so that maps at the pixel corners and the pixel
+     * centres do not push each other out. Checking the panel revision on
+     * every call means the maps are rebuilt whenever the panel, the strategy
+     * or the beam changes. A copy starts empty, so panels that are copied
+     * and then moved apart do not share maps. It may be used from several
+     * threads.
+     */
+    class panel_geometry_cache {
+    public:
+      panel_geometry_cache() {}
+
+      panel_geometry_cache(const panel_geometry_cache &) {}
+
+      panel_geometry_cache &operator=(const panel_geometry_cache &) {
+        return *this;
+      }
+
+      /** @returns Maps holding at least the requested fields */
+      template <typename FloatType>
+      std::shared_ptr<const PanelGeometryMaps<FloatType> > get(
+        const PanelData &panel,
+        const std::shared_ptr<PxMmStrategy> &strategy,
+        vec3<double> s0,
+        int fields,
+        double offset,
+        std::size_t nthreads) {
+        typedef std::shared_ptr<const PanelGeometryMaps<FloatType> > pointer;
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<pointer> &entries = this->entries<FloatType>();
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+          if (entries[i]->is_for(panel, strategy, s0, fields, offset)) {
+            std::rotate(entries.begin(), entries.begin() + i, entries.begin() + i + 1);
+            return entries.front();
+          }
+        }
+
+        // Keep the fields of maps being replaced at the same point, so that
+        // asking for the fields in turn does not rebuild the maps each time
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+          if (entries[i]->is_for(panel, strategy, s0, 0, offset)) {
+            fields |= entries[i]->fields();
+            entries.erase(entries.begin() + i);
+            break;
+          }
+        }
+        pointer maps = std::make_shared<const PanelGeometryMaps<FloatType> >(
+          panel, strategy, s0, fields, offset, nthreads);
+        entries.insert(entries.begin(), maps);
+        if (entries.size() > max_entries) {
+          entries.pop_back();
+        }
+        return maps;
+      }
+
+      /** @returns Cached maps holding at least the requested fields, or null */
+      template <typename FloatType>
+      std::shared_ptr<const PanelGeometryMaps<FloatType> > find(
+        const PanelData &panel,
+        const std::shared_ptr<PxMmStrategy> &strategy,
+        vec3<double> s0,
+        int fields,
+        double offset) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::shared_ptr<const PanelGeometryMaps<FloatType> > > &entries =
+          this->entries<FloatType>();
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+          if (entries[i]->is_for(panel, strategy, s0, fields, offset)) {
+            return entries[i];
+          }
+        }
+        return std::shared_ptr<const PanelGeometryMaps<FloatType> >();
+      }
+
+      /** Drop all the maps */
+      void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double_entries_.clear();
+        float_entries_.clear();
+      }
+
+    private:
+      static const std::size_t max_entries = 2;
+
+      template <typename FloatType>
+      std::vector<std::shared_ptr<const PanelGeometryMaps<FloatType> > > &entries();
+
+      std::mutex mutex_;
+      std::vector<std::shared_ptr<const PanelGeometryMaps<double> > > double_entries_;
+      std::vector<std::shared_ptr<const PanelGeometryMaps<float> > > float_entries_;
+    };
+
+    template <>
+    inline std::vector<std::shared_ptr<const PanelGeometryMaps<double> > > &
+    panel_geometry_cache::entries<double>() {
+      return double_entries_;
+    }
+
+    template <>
+    inline std::vector<std::shared_ptr<const PanelGeometryMaps<float> > > &
+    panel_geometry_cache::entries<float>() {
+      return float_entries_;
+    }
+
+  }  // namespace detail
+
+}}  // namespace dxtbx::model
+
+#endif  // DXTBX_MODEL_PANEL_GEOMETRY_MAPS_H
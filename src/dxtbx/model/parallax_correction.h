@@ -13,7 +13,9 @@
 
 #include <scitbx/vec2.h>
 #include <scitbx/vec3.h>
+#include <algorithm>
 #include <cmath>
+#include <vector>
 #include <dxtbx/error.h>
 
 namespace dxtbx { namespace model {
@@ -172,6 +174,195 @@ namespace dxtbx { namespace model {
     return c_xy;
   }
 
+  /**
+   * The parallax correction for one sensor, with the work that depends only
+   * on the panel done once, for correcting many coordinates. The results
+   * are the same as those of the parallax_correction and
+   * parallax_correction_inv functions that take mu and t0.
+   */
+  class ParallaxCorrector {
+  public:
+    /**
+     * @param mu Linear attenuation coefficient (mm^-1)
+     * @param t0 Sensor thickness (mm)
+     * @param fast Detector fast direction
+     * @param slow Detector slow direction
+     * @param origin Direction of detector origin
+     */
+    ParallaxCorrector(double mu,
+                      double t0,
+                      vec3<double> fast,
+                      vec3<double> slow,
+                      vec3<double> origin)
+        : mu_(mu), t0_(t0), fast_(fast), slow_(slow), origin_(origin) {
+      DXTBX_ASSERT(mu > 0);
+      normal_ = fast.cross(slow);
+      if (origin * normal_ < 0) {
+        normal_ = -normal_;
+      }
+    }
+
+    /**
+     * @returns The shift of the xy mm coordinate, which is added by the
+     * correction and taken away by the inverse correction
+     */
+    vec2<double> shift(vec2<double> xy) const {
+      vec3<double> s1 = direction(xy);
+      double o = attenuation_length(s1);
+      return vec2<double>((s1 * fast_) * o, (s1 * slow_) * o);
+    }
+
+    /** @returns The corrected xy mm coordinate */
+    vec2<double> correct(vec2<double> xy) const {
+      vec2<double> c = shift(xy);
+      return vec2<double>(xy[0] + c[0], xy[1] + c[1]);
+    }
+
+    /** @returns The xy mm coordinate with the correction reversed */
+    vec2<double> correct_inv(vec2<double> xy) const {
+      vec2<double> c = shift(xy);
+      return vec2<double>(xy[0] - c[0], xy[1] - c[1]);
+    }
+
+    /** @returns True/False this corrects the same sensor as the other */
+    bool operator==(const ParallaxCorrector &other) const {
+      return mu_ == other.mu_ && t0_ == other.t0_
+             && fast_.const_ref().all_eq(other.fast_.const_ref())
+             && slow_.const_ref().all_eq(other.slow_.const_ref())
+             && origin_.const_ref().all_eq(other.origin_.const_ref());
+    }
+
+  private:
+    vec3<double> direction(vec2<double> xy) const {
+      return (origin_ + xy[0] * fast_ + xy[1] * slow_).normalize();
+    }
+
+    double attenuation_length(vec3<double> s1) const {
+      double cos_t = s1 * normal_;
+      DXTBX_ASSERT(cos_t > 0);
+      return (1.0 / mu_) - (t0_ / cos_t + 1.0 / mu_) * exp(-mu_ * t0_ / cos_t);
+    }
+
+    double mu_;
+    double t0_;
+    vec3<double> fast_;
+    vec3<double> slow_;
+    vec3<double> origin_;
+    vec3<double> normal_;
+  };
+
+  /**
+   * A table of the parallax correction shift over a panel, for
+   * conversions that can trade some accuracy for speed. The shift is found
+   * exactly on a grid with a node every step pixels, from the panel origin
+   * to past its far edge, and bilinearly interpolated in between.
+   * Coordinates off the grid are corrected exactly.
+   */
+  class ParallaxCorrectionTable {
+  public:
+    /**
+     * @param corrector The exact correction
+     * @param pixel_size The pixel size (mm)
+     * @param image_size The panel size (pixels)
+     * @param step The distance between the grid nodes (pixels)
+     */
+    ParallaxCorrectionTable(const ParallaxCorrector &corrector,
+                            vec2<double> pixel_size,
+                            vec2<std::size_t> image_size,
+                            double step)
+        : corrector_(corrector),
+          pixel_size_(pixel_size),
+          image_size_(image_size),
+          step_(step * pixel_size[0], step * pixel_size[1]),
+          max_error_(0) {
+      DXTBX_ASSERT(step > 0);
+      nx_ = (std::size_t)std::ceil(image_size[0] / step) + 1;
+      ny_ = (std::size_t)std::ceil(image_size[1] / step) + 1;
+      shift_.resize(nx_ * ny_);
+      for (std::size_t j = 0; j < ny_; ++j) {
+        for (std::size_t i = 0; i < nx_; ++i) {
+          shift_[j * nx_ + i] =
+            corrector.shift(vec2<double>(i * step_[0], j * step_[1]));
+        }
+      }
+
+      // The interpolation is furthest from the nodes at the cell centres
+      for (std::size_t j = 0; j + 1 < ny_; ++j) {
+        for (std::size_t i = 0; i + 1 < nx_; ++i) {
+          vec2<double> xy((i + 0.5) * step_[0], (j + 0.5) * step_[1]);
+          vec2<double> c;
+          lookup(xy, c);
+          max_error_ = std::max(max_error_, (c - corrector.shift(xy)).length());
+        }
+      }
+    }
+
+    /** @returns True/False the table is for this sensor and panel size */
+    bool is_for(const ParallaxCorrector &corrector,
+                vec2<double> pixel_size,
+                vec2<std::size_t> image_size) const {
+      return corrector_ == corrector
+             && pixel_size_.const_ref().all_eq(pixel_size.const_ref())
+             && image_size_.const_ref().all_eq(image_size.const_ref());
+    }
+
+    /**
+     * @returns The largest difference (mm) between the interpolated and the
+     * exact shift at the centres of the grid cells
+     */
+    double max_error() const {
+      return max_error_;
+    }
+
+    /** @returns The corrected xy mm coordinate */
+    vec2<double> correct(vec2<double> xy) const {
+      vec2<double> c;
+      if (!lookup(xy, c)) {
+        c = corrector_.shift(xy);
+      }
+      return vec2<double>(xy[0] + c[0], xy[1] + c[1]);
+    }
+
+    /** @returns The xy mm coordinate with the correction reversed */
+    vec2<double> correct_inv(vec2<double> xy) const {
+      vec2<double> c;
+      if (!lookup(xy, c)) {
+        c = corrector_.shift(xy);
+      }
+      return vec2<double>(xy[0] - c[0], xy[1] - c[1]);
+    }
+
+  private:
+    /** Interpolate the shift at a coordinate, if it is on the grid */
+    bool lookup(vec2<double> xy, vec2<double> &c) const {
+      double u = xy[0] / step_[0];
+      double v = xy[1] / step_[1];
+      if (!(u >= 0 && v >= 0 && u <= nx_ - 1 && v <= ny_ - 1)) {
+        return false;
+      }
+      std::size_t i = std::min((std::size_t)u, nx_ - 2);
+      std::size_t j = std::min((std::size_t)v, ny_ - 2);
+      double fu = u - i, fv = v - j;
+      const vec2<double> *c0 = &shift_[j * nx_ + i];
+      const vec2<double> *c1 = c0 + nx_;
+      for (std::size_t k = 0; k < 2; ++k) {
+        double a = c0[0][k] + fu * (c0[1][k] - c0[0][k]);
+        double b = c1[0][k] + fu * (c1[1][k] - c1[0][k]);
+        c[k] = a + fv * (b - a);
+      }
+      return true;
+    }
+
+    ParallaxCorrector corrector_;
+    vec2<double> pixel_size_;
+    vec2<std::size_t> image_size_;
+    vec2<double> step_;
+    std::size_t nx_;
+    std::size_t ny_;
+    std::vector<vec2<double> > shift_;
+    double max_error_;
+  };
+
 }}  // namespace dxtbx::model
 
 #endif /* DXTBX_MODEL_PARALLAX_CORRECTION_H */
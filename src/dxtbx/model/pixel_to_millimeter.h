@@ -12,16 +12,160 @@
 #define DXTBX_MODEL_PIXEL_TO_MILLIMETER_H
 
 #include <scitbx/vec2.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
 #include <dxtbx/model/parallax_correction.h>
 #include <dxtbx/model/panel_data.h>
 #include <dxtbx/error.h>
+#include <deque>
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
 namespace dxtbx { namespace model {
 
   using scitbx::vec2;
 
+  namespace detail {
+
+    /**
+     * Look up the (dx, dy) pixel offset at a pixel coordinate, clamped to
+     * the edges of the offset map
+     */
+    inline vec2<double> pixel_offset(
+      const scitbx::af::versa<double, scitbx::af::c_grid<2> > &dx,
+      const scitbx::af::versa<double, scitbx::af::c_grid<2> > &dy,
+      vec2<double> px) {
+      int i = (int)std::floor(px[0]);
+      int j = (int)std::floor(px[1]);
+      if (i < 0) i = 0;
+      if (j < 0) j = 0;
+      if (i >= dx.accessor()[1]) i = dx.accessor()[1] - 1;
+      if (j >= dx.accessor()[0]) j = dx.accessor()[0] - 1;
+      return vec2<double>(dx(j, i), dy(j, i));
+    }
+
+    /** Check that the offset maps are the size of the panel */
+    inline void check_pixel_offset_size(
+      const PanelData &panel,
+      const scitbx::af::versa<double, scitbx::af::c_grid<2> > &dx,
+      const scitbx::af::versa<double, scitbx::af::c_grid<2> > &dy) {
+      DXTBX_ASSERT(dx.accessor().all_eq(dy.accessor()));
+      DXTBX_ASSERT(dx.accessor()[0] == panel.get_image_size()[1]);
+      DXTBX_ASSERT(dx.accessor()[1] == panel.get_image_size()[0]);
+    }
+
+    /**
+     * The parallax correction tables of a strategy, one for each panel
+     * geometry the strategy is used with, so a strategy shared by the panels
+     * of a detector keeps a table for each of them. The tables are keyed on
+     * the panel revision, and the most recently made max_tables are kept.
+     * Each thread also remembers the last few tables it used, so converting
+     * one coordinate at a time takes no lock. It may be used from several
+     * threads.
+     */
+    class parallax_table_cache {
+    public:
+      typedef std::shared_ptr<const ParallaxCorrectionTable> table_pointer;
+
+      explicit parallax_table_cache(double step) : step_(step), id_(next_revision()) {
+        DXTBX_ASSERT(step > 0);
+      }
+
+      /** @returns The distance between the grid nodes (pixels) */
+      double step() const {
+        return step_;
+      }
+
+      /** @returns The table for the panel */
+      table_pointer get(const ParallaxCorrector &corrector, const PanelData &panel) {
+        vec2<double> pixel_size(panel.get_pixel_size()[0], panel.get_pixel_size()[1]);
+        vec2<std::size_t> image_size(panel.get_image_size()[0],
+                                     panel.get_image_size()[1]);
+        std::size_t revision = panel.get_revision();
+
+        // The tables this thread used last
+        thread_local_entry *local = thread_local_entries();
+        for (std::size_t i = 0; i < num_thread_local; ++i) {
+          const thread_local_entry &entry = local[i];
+          if (entry.cache == this && entry.id == id_ && entry.revision == revision
+              && entry.table->is_for(corrector, pixel_size, image_size)) {
+            return entry.table;
+          }
+        }
+
+        table_pointer table;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          std::map<std::size_t, table_pointer>::iterator it = tables_.find(revision);
+          if (it != tables_.end()
+              && it->second->is_for(corrector, pixel_size, image_size)) {
+            table = it->second;
+          } else {
+            table = std::make_shared<const ParallaxCorrectionTable>(
+              corrector, pixel_size, image_size, step_);
+            if (it != tables_.end()) {
+              it->second = table;
+            } else {
+              tables_[revision] = table;
+              order_.push_back(revision);
+              if (order_.size() > max_tables) {
+                tables_.erase(order_.front());
+                order_.pop_front();
+              }
+            }
+          }
+        }
+
+        // Replace the oldest of this thread's entries
+        std::size_t &next = thread_local_next();
+        thread_local_entry &entry = local[next];
+        next = (next + 1) % num_thread_local;
+        entry.cache = this;
+        entry.id = id_;
+        entry.revision = revision;
+        entry.table = table;
+        return table;
+      }
+
+    private:
+      static const std::size_t max_tables = 256;
+      static const std::size_t num_thread_local = 4;
+
+      /**
+       * A table a thread used. The cache is identified by its address and
+       * id, since a new cache may be made at the address of an old one.
+       */
+      struct thread_local_entry {
+        thread_local_entry() : cache(NULL), id(0), revision(0) {}
+        const parallax_table_cache *cache;
+        std::size_t id;
+        std::size_t revision;
+        table_pointer table;
+      };
+
+      static thread_local_entry *thread_local_entries() {
+        static thread_local thread_local_entry entries[num_thread_local];
+        return entries;
+      }
+
+      static std::size_t &thread_local_next() {
+        static thread_local std::size_t next = 0;
+        return next;
+      }
+
+      double step_;
+      std::size_t id_;
+      std::mutex mutex_;
+      std::map<std::size_t, table_pointer> tables_;
+      std::deque<std::size_t> order_;
+    };
+
+  }  // namespace detail
+
   /**
    * Base class for the pixel to millimeter strategy
    */
@@ -58,6 +202,39 @@ namespace dxtbx { namespace model {
      */
     virtual vec2<double> to_pixel(const PanelData &panel, vec2<double> xy) const = 0;
 
+    /**
+     * Convert an array of pixel coordinates to millimeter coordinates. This
+     * calls to_millimeter for each coordinate; the strategies override it to
+     * do the work that depends only on the panel once per array.
+     * @param panel The panel structure
+     * @param xy The (x, y) pixel coordinates
+     * @param result The (x, y) millimeter coordinates, which may be xy
+     */
+    virtual void to_millimeter_multiple(
+      const PanelData &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        result[i] = to_millimeter(panel, xy[i]);
+      }
+    }
+
+    /**
+     * Convert an array of millimeter coordinates to pixel coordinates
+     * @param panel The panel structure
+     * @param xy The (x, y) millimeter coordinates
+     * @param result The (x, y) pixel coordinates, which may be xy
+     */
+    virtual void to_pixel_multiple(const PanelData &panel,
+                                   const scitbx::af::const_ref<vec2<double> > &xy,
+                                   const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        result[i] = to_pixel(panel, xy[i]);
+      }
+    }
+
     virtual std::string strategy_name() const {
       throw DXTBX_ERROR("Overload me");
       return std::string();
@@ -117,6 +294,27 @@ namespace dxtbx { namespace model {
       return vec2<double>(xy[0] / pixel_size[0], xy[1] / pixel_size[1]);
     }
 
+    virtual void to_millimeter_multiple(
+      const PanelData &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      vec2<double> pixel_size = panel.get_pixel_size();
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        result[i] = vec2<double>(xy[i][0] * pixel_size[0], xy[i][1] * pixel_size[1]);
+      }
+    }
+
+    virtual void to_pixel_multiple(const PanelData &panel,
+                                   const scitbx::af::const_ref<vec2<double> > &xy,
+                                   const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      vec2<double> pixel_size = panel.get_pixel_size();
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        result[i] = vec2<double>(xy[i][0] / pixel_size[0], xy[i][1] / pixel_size[1]);
+      }
+    }
+
     std::string strategy_name() const {
       return std::string("SimplePxMmStrategy\n");
     }
@@ -125,12 +323,27 @@ namespace dxtbx { namespace model {
   /**
    * The parallax corrected strategy. From the simple conversion, then
    * perform a parallax correction.
+   *
+   * With a lookup step, the correction is interpolated from a table made for
+   * each panel geometry the strategy is used with, instead of being computed
+   * exactly for each coordinate. lookup_error gives the accuracy of the table.
+   * The strategies compare equal whatever their lookup step.
    */
   class ParallaxCorrectedPxMmStrategy : public SimplePxMmStrategy {
   public:
-    ParallaxCorrectedPxMmStrategy(double mu, double t0) : mu_(mu), t0_(t0) {
+    /**
+     * @param mu The linear attenuation coefficient (mm^-1)
+     * @param t0 The sensor thickness (mm)
+     * @param lookup_step The table grid spacing (pixels), or 0 for none
+     */
+    ParallaxCorrectedPxMmStrategy(double mu, double t0, double lookup_step = 0)
+        : mu_(mu), t0_(t0) {
       DXTBX_ASSERT(mu > 0);
       DXTBX_ASSERT(t0 > 0);
+      DXTBX_ASSERT(lookup_step >= 0);
+      if (lookup_step > 0) {
+        table_cache_ = std::make_shared<detail::parallax_table_cache>(lookup_step);
+      }
     }
 
     /** Virtual destructor */
@@ -151,6 +364,20 @@ namespace dxtbx { namespace model {
       return t0_;
     }
 
+    /** @returns the lookup table grid spacing (pixels), 0 if there is none */
+    double lookup_step() const {
+      return table_cache_ ? table_cache_->step() : 0;
+    }
+
+    /**
+     * @returns the largest difference (mm) between the interpolated and the
+     * exact correction at the centres of the lookup table cells for the panel
+     */
+    double lookup_error(const PanelData &panel) const {
+      DXTBX_ASSERT(table_cache_ != NULL);
+      return correction_table(panel)->max_error();
+    }
+
     virtual double attenuation_length(const PanelData &panel, vec2<double> xy) const {
       // Convert to s1 for attenuation
       vec2<double> xy_for_pc = SimplePxMmStrategy::to_millimeter(panel, xy);
@@ -169,6 +396,10 @@ namespace dxtbx { namespace model {
      * @return The (x, y) millimeter coordinate
      */
     vec2<double> to_millimeter(const PanelData &panel, vec2<double> xy) const {
+      if (table_cache_) {
+        return correction_table(panel)->correct_inv(
+          SimplePxMmStrategy::to_millimeter(panel, xy));
+      }
       return parallax_correction_inv(mu_,
                                      t0_,
                                      SimplePxMmStrategy::to_millimeter(panel, xy),
@@ -194,6 +425,10 @@ namespace dxtbx { namespace model {
      * @return The (x, y) pixel coordinate
      */
     vec2<double> to_pixel(const PanelData &panel, vec2<double> xy) const {
+      if (table_cache_) {
+        vec2<double> xy_corr = correction_table(panel)->correct(xy);
+        return SimplePxMmStrategy::to_pixel(panel, xy_corr);
+      }
       return SimplePxMmStrategy::to_pixel(panel,
                                           parallax_correction(mu_,
                                                               t0_,
@@ -203,6 +438,42 @@ namespace dxtbx { namespace model {
                                                               panel.get_origin()));
     }
 
+    virtual void to_millimeter_multiple(
+      const PanelData &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      SimplePxMmStrategy::to_millimeter_multiple(panel, xy, result);
+      if (table_cache_) {
+        std::shared_ptr<const ParallaxCorrectionTable> table = correction_table(panel);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+          result[i] = table->correct_inv(result[i]);
+        }
+      } else {
+        ParallaxCorrector corrector = parallax_corrector(panel);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+          result[i] = corrector.correct_inv(result[i]);
+        }
+      }
+    }
+
+    virtual void to_pixel_multiple(const PanelData &panel,
+                                   const scitbx::af::const_ref<vec2<double> > &xy,
+                                   const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      if (table_cache_) {
+        std::shared_ptr<const ParallaxCorrectionTable> table = correction_table(panel);
+        for (std::size_t i = 0; i < xy.size(); ++i) {
+          result[i] = table->correct(xy[i]);
+        }
+      } else {
+        ParallaxCorrector corrector = parallax_corrector(panel);
+        for (std::size_t i = 0; i < xy.size(); ++i) {
+          result[i] = corrector.correct(xy[i]);
+        }
+      }
+      SimplePxMmStrategy::to_pixel_multiple(panel, result, result);
+    }
+
     std::string mu_t0() const {
       std::ostringstream stringStream;
       stringStream << "    mu: " << mu_ << "\n    t0: " << t0_ << "\n";
@@ -225,8 +496,21 @@ namespace dxtbx { namespace model {
     }
 
   protected:
+    /** @returns The parallax correction for the panel */
+    ParallaxCorrector parallax_corrector(const PanelData &panel) const {
+      return ParallaxCorrector(
+        mu_, t0_, panel.get_fast_axis(), panel.get_slow_axis(), panel.get_origin());
+    }
+
+    /** @returns The lookup table for the panel */
+    std::shared_ptr<const ParallaxCorrectionTable> correction_table(
+      const PanelData &panel) const {
+      return table_cache_->get(parallax_corrector(panel), panel);
+    }
+
     double mu_;
     double t0_;
+    std::shared_ptr<detail::parallax_table_cache> table_cache_;
   };
 
   /**
@@ -276,22 +560,10 @@ namespace dxtbx { namespace model {
      */
     vec2<double> to_millimeter(const PanelData &panel, vec2<double> xy) const {
       // Check map size
-      DXTBX_ASSERT(dx_.accessor().all_eq(dy_.accessor()));
-      DXTBX_ASSERT(dx_.accessor()[0] == panel.get_image_size()[1]);
-      DXTBX_ASSERT(dx_.accessor()[1] == panel.get_image_size()[0]);
+      detail::check_pixel_offset_size(panel, dx_, dy_);
 
       // Apply the correction
-      int i = (int)std::floor(xy[0]);
-      int j = (int)std::floor(xy[1]);
-      if (i < 0) i = 0;
-      if (j < 0) j = 0;
-      if (i >= dx_.accessor()[1]) i = dx_.accessor()[1] - 1;
-      if (j >= dx_.accessor()[0]) j = dx_.accessor()[0] - 1;
-      double dx = dx_(j, i);
-      double dy = dy_(j, i);
-
-      xy[0] -= dx;
-      xy[1] -= dy;
+      xy -= detail::pixel_offset(dx_, dy_, xy);
 
       // reverse the parallax correction
       vec2<double> mm = SimplePxMmStrategy::to_millimeter(panel, xy);
@@ -313,26 +585,35 @@ namespace dxtbx { namespace model {
      */
     vec2<double> to_pixel(const PanelData &panel, vec2<double> xy) const {
       // Check map size
-      DXTBX_ASSERT(dx_.accessor().all_eq(dy_.accessor()));
-      DXTBX_ASSERT(dx_.accessor()[0] == panel.get_image_size()[1]);
-      DXTBX_ASSERT(dx_.accessor()[1] == panel.get_image_size()[0]);
+      detail::check_pixel_offset_size(panel, dx_, dy_);
 
       // Do a naive mapping first
       vec2<double> px = SimplePxMmStrategy::to_pixel(panel, xy);
 
       // Apply the correction
-      int i = (int)std::floor(px[0]);
-      int j = (int)std::floor(px[1]);
-      if (i < 0) i = 0;
-      if (j < 0) j = 0;
-      if (i >= dx_.accessor()[1]) i = dx_.accessor()[1] - 1;
-      if (j >= dx_.accessor()[0]) j = dx_.accessor()[0] - 1;
-      double dx = dx_(j, i);
-      double dy = dy_(j, i);
-      px[0] += dx;
-      px[1] += dy;
+      return px + detail::pixel_offset(dx_, dy_, px);
+    }
+
+    virtual void to_millimeter_multiple(
+      const PanelData &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      detail::check_pixel_offset_size(panel, dx_, dy_);
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        result[i] = xy[i] - detail::pixel_offset(dx_, dy_, xy[i]);
+      }
+      SimplePxMmStrategy::to_millimeter_multiple(panel, result, result);
+    }
 
-      return px;
+    virtual void to_pixel_multiple(const PanelData &panel,
+                                   const scitbx::af::const_ref<vec2<double> > &xy,
+                                   const scitbx::af::ref<vec2<double> > &result) const {
+      detail::check_pixel_offset_size(panel, dx_, dy_);
+      SimplePxMmStrategy::to_pixel_multiple(panel, xy, result);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] += detail::pixel_offset(dx_, dy_, result[i]);
+      }
     }
 
     std::string strategy_name() const {
@@ -396,22 +677,10 @@ namespace dxtbx { namespace model {
      */
     vec2<double> to_millimeter(const PanelData &panel, vec2<double> xy) const {
       // Check map size
-      DXTBX_ASSERT(dx_.accessor().all_eq(dy_.accessor()));
-      DXTBX_ASSERT(dx_.accessor()[0] == panel.get_image_size()[1]);
-      DXTBX_ASSERT(dx_.accessor()[1] == panel.get_image_size()[0]);
+      detail::check_pixel_offset_size(panel, dx_, dy_);
 
       // Apply the correction
-      int i = (int)std::floor(xy[0]);
-      int j = (int)std::floor(xy[1]);
-      if (i < 0) i = 0;
-      if (j < 0) j = 0;
-      if (i >= dx_.accessor()[1]) i = dx_.accessor()[1] - 1;
-      if (j >= dx_.accessor()[0]) j = dx_.accessor()[0] - 1;
-      double dx = dx_(j, i);
-      double dy = dy_(j, i);
-
-      xy[0] -= dx;
-      xy[1] -= dy;
+      xy -= detail::pixel_offset(dx_, dy_, xy);
 
       // reverse the parallax correction
       vec2<double> mm = ParallaxCorrectedPxMmStrategy::to_millimeter(panel, xy);
@@ -434,26 +703,35 @@ namespace dxtbx { namespace model {
      */
     vec2<double> to_pixel(const PanelData &panel, vec2<double> xy) const {
       // Check map size
-      DXTBX_ASSERT(dx_.accessor().all_eq(dy_.accessor()));
-      DXTBX_ASSERT(dx_.accessor()[0] == panel.get_image_size()[1]);
-      DXTBX_ASSERT(dx_.accessor()[1] == panel.get_image_size()[0]);
+      detail::check_pixel_offset_size(panel, dx_, dy_);
 
       // Do a naive mapping first
       vec2<double> px = ParallaxCorrectedPxMmStrategy::to_pixel(panel, xy);
 
       // Apply the correction
-      int i = (int)std::floor(px[0]);
-      int j = (int)std::floor(px[1]);
-      if (i < 0) i = 0;
-      if (j < 0) j = 0;
-      if (i >= dx_.accessor()[1]) i = dx_.accessor()[1] - 1;
-      if (j >= dx_.accessor()[0]) j = dx_.accessor()[0] - 1;
-      double dx = dx_(j, i);
-      double dy = dy_(j, i);
-      px[0] += dx;
-      px[1] += dy;
-
-      return px;
+      return px + detail::pixel_offset(dx_, dy_, px);
+    }
+
+    virtual void to_millimeter_multiple(
+      const PanelData &panel,
+      const scitbx::af::const_ref<vec2<double> > &xy,
+      const scitbx::af::ref<vec2<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      detail::check_pixel_offset_size(panel, dx_, dy_);
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        result[i] = xy[i] - detail::pixel_offset(dx_, dy_, xy[i]);
+      }
+      ParallaxCorrectedPxMmStrategy::to_millimeter_multiple(panel, result, result);
+    }
+
+    virtual void to_pixel_multiple(const PanelData &panel,
+                                   const scitbx::af::const_ref<vec2<double> > &xy,
+                                   const scitbx::af::ref<vec2<double> > &result) const {
+      detail::check_pixel_offset_size(panel, dx_, dy_);
+      ParallaxCorrectedPxMmStrategy::to_pixel_multiple(panel, xy, result);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] += detail::pixel_offset(dx_, dy_, result[i]);
+      }
     }
 
     std::string strategy_name() const {
@@ -678,6 +678,109 @@ namespace dxtbx { namespace model {
       return result;
     }
 
+    /**
+     * Calculate the angles corresponding to many frames. The oscillation
+     * has a constant width, so it is read once and each angle is found in
+     * closed form, as by get_angle_from_image_index.
+     * @param index The frame numbers
+     * @returns The angle at each frame
+     */
+    scitbx::af::shared<double> get_angles_from_image_indices(
+      const scitbx::af::const_ref<double> &index) const {
+      vec2<double> oscillation = get_oscillation();
+      scitbx::af::shared<double> result(index.size());
+      for (std::size_t i = 0; i < index.size(); ++i) {
+        result[i] = oscillation[0] + (index[i] - image_range_[0]) * oscillation[1];
+      }
+      return result;
+    }
+
+    /**
+     * Calculate the angles corresponding to many zero based frames
+     * @param index The frame numbers
+     * @returns The angle at each frame
+     */
+    scitbx::af::shared<double> get_angles_from_array_indices(
+      const scitbx::af::const_ref<double> &index) const {
+      vec2<double> oscillation = get_oscillation();
+      scitbx::af::shared<double> result(index.size());
+      for (std::size_t i = 0; i < index.size(); ++i) {
+        result[i] =
+          oscillation[0] + ((index[i] + 1) - image_range_[0]) * oscillation[1];
+      }
+      return result;
+    }
+
+    /**
+     * Calculate the frames corresponding to many angles, as by
+     * get_image_index_from_angle
+     * @param angle The angles
+     * @returns The frame at each angle
+     */
+    scitbx::af::shared<double> get_image_indices_from_angles(
+      const scitbx::af::const_ref<double> &angle) const {
+      vec2<double> oscillation = get_oscillation();
+      scitbx::af::shared<double> result(angle.size());
+      for (std::size_t i = 0; i < angle.size(); ++i) {
+        result[i] = image_range_[0] + (angle[i] - oscillation[0]) / oscillation[1];
+      }
+      return result;
+    }
+
+    /**
+     * Calculate the zero based frames corresponding to many angles
+     * @param angle The angles
+     * @returns The frame at each angle
+     */
+    scitbx::af::shared<double> get_array_indices_from_angles(
+      const scitbx::af::const_ref<double> &angle) const {
+      vec2<double> oscillation = get_oscillation();
+      scitbx::af::shared<double> result(angle.size());
+      for (std::size_t i = 0; i < angle.size(); ++i) {
+        result[i] =
+          (image_range_[0] + (angle[i] - oscillation[0]) / oscillation[1]) - 1;
+      }
+      return result;
+    }
+
+    /**
+     * Find the zero based frames at which reflections with many rotation
+     * angles will be observed, as by get_array_indices_with_angle, in one
+     * pass without an array for each angle.
+     * @param angle The rotation angles of the reflections
+     * @param which The index into angle of each result
+     * @param padding The padding on each side of the oscillation range
+     * @param deg True if the padding is in degrees
+     * @returns The equivalent angle and frame number of each result
+     */
+    scitbx::af::shared<vec2<double> > get_array_indices_with_angles(
+      const scitbx::af::const_ref<double> &angle,
+      scitbx::af::shared<std::size_t> &which,
+      double padding = 0,
+      bool deg = false) const {
+      DXTBX_ASSERT(padding >= 0);
+      if (deg == true) {
+        padding = padding * pi / 180.0;
+      }
+      vec2<double> oscillation = get_oscillation();
+      vec2<double> range = get_oscillation_range();
+      range[0] -= padding;
+      range[1] += padding;
+      scitbx::af::shared<vec2<double> > result;
+      which.clear();
+      for (std::size_t i = 0; i < angle.size(); ++i) {
+        vec2<double> angle_range = get_range_of_mod2pi_angles(range, angle[i]);
+        int n_angles = 1 + (int)floor((angle_range[1] - angle_range[0]) / two_pi);
+        for (int k = 0; k < n_angles; ++k) {
+          double a = angle_range[0] + k * two_pi;
+          double index = (image_range_[0] + (a - oscillation[0]) / oscillation[1]) - 1;
+          result.push_back(vec2<double>(a, index));
+          which.push_back(i);
+        }
+      }
+      return result;
+    }
+
     Scan operator[](int index) const {
       DXTBX_ASSERT((index >= 0) && (index < get_num_images()));
 
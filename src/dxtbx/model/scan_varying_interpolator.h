@@ -0,0 +1,275 @@
+/*
+ * scan_varying_interpolator.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_SCAN_VARYING_INTERPOLATOR_H
+#define DXTBX_MODEL_SCAN_VARYING_INTERPOLATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/shared.h>
+#include <dxtbx/model/beam.h>
+#include <dxtbx/model/crystal.h>
+#include <dxtbx/model/goniometer.h>
+#include <dxtbx/model/scan.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::mat3;
+  using scitbx::vec2;
+  using scitbx::vec3;
+
+  namespace detail {
+
+    /**
+     * A table of values with N components at scan points, for linear
+     * interpolation between them. Each component of the value at the start
+     * of each interval, and its change over the interval, is held in its own
+     * contiguous array, so a block of frames is interpolated one component
+     * at a time with a single multiply-add per frame.
+     */
+    template <std::size_t N>
+    class linear_scan_point_table {
+    public:
+      linear_scan_point_table() : nintervals_(0) {}
+
+      /**
+       * Build the table
+       * @param values The N components of the value at each scan point
+       * @param npoints The number of scan points
+       */
+      linear_scan_point_table(const double *values, std::size_t npoints)
+          : nintervals_(std::max<std::size_t>(npoints, 2) - 1) {
+        DXTBX_ASSERT(npoints > 0);
+        for (std::size_t c = 0; c < N; ++c) {
+          base_[c].resize(nintervals_);
+          slope_[c].resize(nintervals_);
+          for (std::size_t i = 0; i < nintervals_; ++i) {
+            double v0 = values[std::min(i, npoints - 1) * N + c];
+            double v1 = values[std::min(i + 1, npoints - 1) * N + c];
+            base_[c][i] = v0;
+            slope_[c][i] = v1 - v0;
+          }
+        }
+      }
+
+      /** @returns The number of intervals between scan points */
+      std::size_t num_intervals() const {
+        return nintervals_;
+      }
+
+      /**
+       * Interpolate a block of values
+       * @param interval The interval of each value
+       * @param t The fraction of the interval of each value
+       * @param n The number of values
+       * @param out The N components of each value
+       */
+      void interpolate(const std::size_t *interval,
+                       const double *t,
+                       std::size_t n,
+                       double *out) const {
+        for (std::size_t c = 0; c < N; ++c) {
+          const double *base = &base_[c][0];
+          const double *slope = &slope_[c][0];
+          for (std::size_t j = 0; j < n; ++j) {
+            out[j * N + c] = base[interval[j]] + t[j] * slope[interval[j]];
+          }
+        }
+      }
+
+    private:
+      std::size_t nintervals_;
+      std::vector<double> base_[N];
+      std::vector<double> slope_[N];
+    };
+
+  }  // namespace detail
+
+  /**
+   * Interpolate the scan-varying crystal, beam and goniometer models at
+   * many frames at once. Scan point i lies at the start of zero based frame
+   * i of the scan, and the models change linearly between scan points, as
+   * in scan-varying prediction. A model with no scan points is constant;
+   * the others must all have the same number of scan points.
+   *
+   * The scan points are copied when the interpolator is made, so it does not
+   * follow later changes to the models.
+   */
+  class ScanVaryingInterpolator {
+  public:
+    /**
+     * Copy the scan points of the models
+     * @param crystal The crystal model
+     * @param beam The beam model
+     * @param goniometer The goniometer model
+     * @param scan The scan the scan points belong to
+     */
+    ScanVaryingInterpolator(const CrystalBase &crystal,
+                            const BeamBase &beam,
+                            const Goniometer &goniometer,
+                            const Scan &scan)
+        : first_frame_(scan.get_array_range()[0]) {
+      scitbx::af::shared<mat3<double> > A = crystal.get_A_at_scan_points();
+      if (A.size() == 0) {
+        A.push_back(crystal.get_A());
+      }
+      scitbx::af::shared<vec3<double> > s0 = beam.get_s0_at_scan_points();
+      if (s0.size() == 0) {
+        s0.push_back(beam.get_s0());
+      }
+      scitbx::af::shared<mat3<double> > S =
+        goniometer.get_setting_rotation_at_scan_points();
+      if (S.size() == 0) {
+        S.push_back(goniometer.get_setting_rotation());
+      }
+      std::size_t npoints = std::max(A.size(), std::max(s0.size(), S.size()));
+      DXTBX_ASSERT(A.size() == 1 || A.size() == npoints);
+      DXTBX_ASSERT(s0.size() == 1 || s0.size() == npoints);
+      DXTBX_ASSERT(S.size() == 1 || S.size() == npoints);
+      A_ = detail::linear_scan_point_table<9>(&A[0][0], A.size());
+      s0_ = detail::linear_scan_point_table<3>(&s0[0][0], s0.size());
+      S_ = detail::linear_scan_point_table<9>(&S[0][0], S.size());
+      last_frame_ = first_frame_ + double(npoints - 1);
+    }
+
+    /** @returns The range of frames covered by the scan points */
+    vec2<double> get_frame_range() const {
+      return vec2<double>(first_frame_, last_frame_);
+    }
+
+    /**
+     * Interpolate the crystal setting matrix, A, at many frames
+     * @param frame The zero based frame numbers
+     * @param nthreads The number of threads, zero for the default
+     * @returns The A matrix at each frame
+     */
+    scitbx::af::shared<mat3<double> > get_A(
+      const scitbx::af::const_ref<double> &frame,
+      std::size_t nthreads = 0) const {
+      scitbx::af::shared<mat3<double> > result(frame.size());
+      interpolate_table(A_, frame, (double *)result.begin(), nthreads);
+      return result;
+    }
+
+    /**
+     * Interpolate the beam vector, s0, at many frames
+     * @param frame The zero based frame numbers
+     * @param nthreads The number of threads, zero for the default
+     * @returns The s0 vector at each frame
+     */
+    scitbx::af::shared<vec3<double> > get_s0(
+      const scitbx::af::const_ref<double> &frame,
+      std::size_t nthreads = 0) const {
+      scitbx::af::shared<vec3<double> > result(frame.size());
+      interpolate_table(s0_, frame, (double *)result.begin(), nthreads);
+      return result;
+    }
+
+    /**
+     * Interpolate the goniometer setting rotation, S, at many frames
+     * @param frame The zero based frame numbers
+     * @param nthreads The number of threads, zero for the default
+     * @returns The S matrix at each frame
+     */
+    scitbx::af::shared<mat3<double> > get_setting_rotation(
+      const scitbx::af::const_ref<double> &frame,
+      std::size_t nthreads = 0) const {
+      scitbx::af::shared<mat3<double> > result(frame.size());
+      interpolate_table(S_, frame, (double *)result.begin(), nthreads);
+      return result;
+    }
+
+    /**
+     * Interpolate all the models at many frames in one pass
+     * @param frame The zero based frame numbers
+     * @param A The A matrix at each frame
+     * @param s0 The s0 vector at each frame
+     * @param S The S matrix at each frame
+     * @param nthreads The number of threads, zero for the default
+     */
+    void interpolate(const scitbx::af::const_ref<double> &frame,
+                     const scitbx::af::ref<mat3<double> > &A,
+                     const scitbx::af::ref<vec3<double> > &s0,
+                     const scitbx::af::ref<mat3<double> > &S,
+                     std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(A.size() == frame.size());
+      DXTBX_ASSERT(s0.size() == frame.size());
+      DXTBX_ASSERT(S.size() == frame.size());
+      parallel_for(
+        frame.size(), nthreads, [&](std::size_t first, std::size_t last) {
+          std::size_t interval[block_size];
+          double t[block_size];
+          for (std::size_t j = first; j < last; j += block_size) {
+            std::size_t n = std::min(std::size_t(block_size), last - j);
+            locate(A_, &frame[j], n, interval, t);
+            A_.interpolate(interval, t, n, &A[j][0]);
+            locate(s0_, &frame[j], n, interval, t);
+            s0_.interpolate(interval, t, n, &s0[j][0]);
+            locate(S_, &frame[j], n, interval, t);
+            S_.interpolate(interval, t, n, &S[j][0]);
+          }
+        });
+    }
+
+  private:
+    // The number of frames interpolated together, to keep the blocks in cache
+    static constexpr std::size_t block_size = 256;
+
+    /** Interpolate a table at many frames, in blocks */
+    template <std::size_t N>
+    void interpolate_table(const detail::linear_scan_point_table<N> &table,
+                           const scitbx::af::const_ref<double> &frame,
+                           double *out,
+                           std::size_t nthreads) const {
+      parallel_for(
+        frame.size(), nthreads, [&](std::size_t first, std::size_t last) {
+          std::size_t interval[block_size];
+          double t[block_size];
+          for (std::size_t j = first; j < last; j += block_size) {
+            std::size_t n = std::min(std::size_t(block_size), last - j);
+            locate(table, &frame[j], n, interval, t);
+            table.interpolate(interval, t, n, out + j * N);
+          }
+        });
+    }
+
+    /**
+     * Find the interval of a table and the fraction along it of each frame.
+     * A frame on the last scan point is at the end of the last interval.
+     */
+    template <std::size_t N>
+    void locate(const detail::linear_scan_point_table<N> &table,
+                const double *frame,
+                std::size_t n,
+                std::size_t *interval,
+                double *t) const {
+      const double last = double(table.num_intervals());
+      for (std::size_t j = 0; j < n; ++j) {
+        DXTBX_ASSERT(first_frame_ <= frame[j] && frame[j] <= last_frame_);
+        double z = std::min(frame[j] - first_frame_, last);
+        double i = std::min(std::floor(z), last - 1);
+        interval[j] = (std::size_t)i;
+        t[j] = z - i;
+      }
+    }
+
+    double first_frame_;
+    double last_frame_;
+    detail::linear_scan_point_table<9> A_;
+    detail::linear_scan_point_table<3> s0_;
+    detail::linear_scan_point_table<9> S_;
+  };
+
+}}  // namespace dxtbx::model
+
+#endif  // DXTBX_MODEL_SCAN_VARYING_INTERPOLATOR_H
@@ -13,6 +13,91 @@
 namespace dxtbx { namespace model {
   typedef scitbx::af::shared<double> vecd;
 
+  namespace detail {
+
+    /**
+     * Compute the weighted mean and variance of the energies of a spectrum,
+     * if it has any weight
+     * @param energies The energies (eV)
+     * @param weights The weights
+     * @param n The number of energies
+     * @param mean The weighted mean energy
+     * @param variance The weighted variance of the energy
+     * @returns False, leaving mean and variance unchanged, if the sum of the
+     *          weights or of the weighted energies is not positive
+     */
+    inline bool spectrum_weighted_energy_if_weighted(const double *energies,
+                                                     const double *weights,
+                                                     std::size_t n,
+                                                     double &mean,
+                                                     double &variance) {
+      double weighted_sum = 0;
+      double weighted_sum_sq = 0;
+      double summed_weights = 0;
+      for (std::size_t i = 0; i < n; i++) {
+        weighted_sum += energies[i] * weights[i];
+        weighted_sum_sq += energies[i] * energies[i] * weights[i];
+        summed_weights += weights[i];
+      }
+      if (!(weighted_sum > 0 && summed_weights > 0)) {
+        return false;
+      }
+      mean = weighted_sum / summed_weights;
+      variance = weighted_sum_sq / summed_weights - (mean * mean);
+      return true;
+    }
+
+    /**
+     * Compute the weighted mean and variance of the energies of a spectrum,
+     * which must have some weight
+     * @param energies The energies (eV)
+     * @param weights The weights
+     * @param n The number of energies
+     * @param mean The weighted mean energy
+     * @param variance The weighted variance of the energy
+     */
+    inline void spectrum_weighted_energy(const double *energies,
+                                         const double *weights,
+                                         std::size_t n,
+                                         double &mean,
+                                         double &variance) {
+      bool has_weight = spectrum_weighted_energy_if_weighted(
+        energies, weights, n, mean, variance);
+      DXTBX_ASSERT(has_weight);
+    }
+
+    /**
+     * Find the energies holding the central 98% of the weight of a spectrum.
+     * The cumulative weight is accumulated twice, once for the total, rather
+     * than stored. A bound which is not found is left unchanged.
+     * @param energies The energies (eV), in increasing order
+     * @param weights The weights
+     * @param n The number of energies
+     * @param emin The last energy below 1% of the total weight
+     * @param emax The first energy above 99% of the total weight
+     */
+    inline void spectrum_bandwidth_98_percent(const double *energies,
+                                              const double *weights,
+                                              std::size_t n,
+                                              double &emin,
+                                              double &emax) {
+      double total = 0;
+      for (std::size_t i = 0; i < n; i++) {
+        total += weights[i];
+      }
+      double cdf = 0;
+      for (std::size_t i = 0; i < n; i++) {
+        cdf += weights[i];
+        if (cdf < 0.01 * total) emin = energies[i];
+        if (cdf > 0.99 * total) {
+          emax = energies[i];
+          break;
+        }
+      }
+    }
+
+  }  // namespace detail
+
   /** A class to represent a 2D spectrum. */
   class Spectrum {
   public:
@@ -46,24 +131,8 @@ namespace dxtbx { namespace model {
 
     void bandwidth_98_percent() {
       if (energies_.size() == 0) return;
-
-      std::vector<double> cdf;
-      double total = 0;
-
-      /* Compute CDF */
-      for (size_t i = 0; i < energies_.size(); i++) {
-        total += weights_[i];
-        cdf.push_back(total);
-      }
-
-      /* Scan CDF to find 1%, 99% points */
-      for (size_t i = 0; i < energies_.size(); i++) {
-        if (cdf[i] < 0.01 * total) emin_ = energies_[i];
-        if (cdf[i] > 0.99 * total) {
-          emax_ = energies_[i];
-          break;
-        }
-      }
+      detail::spectrum_bandwidth_98_percent(
+        &energies_[0], &weights_[0], energies_.size(), emin_, emax_);
     }
 
     /* Get the bandwidth range */
@@ -91,18 +160,11 @@ namespace dxtbx { namespace model {
         weighted_energy_ = 0;
         return;
       }
-      double weighted_sum = 0;
-      double weighted_sum_sq = 0;
-      double summed_weights = 0;
-      for (size_t i = 0; i < energies_.size(); i++) {
-        weighted_sum += energies_[i] * weights_[i];
-        weighted_sum_sq += energies_[i] * energies_[i] * weights_[i];
-        summed_weights += weights_[i];
-      }
-      DXTBX_ASSERT(weighted_sum > 0 && summed_weights > 0);
-      weighted_energy_ = weighted_sum / summed_weights;
-      weighted_energy_variance_ =
-        weighted_sum_sq / summed_weights - (weighted_energy_ * weighted_energy_);
+      detail::spectrum_weighted_energy(&energies_[0],
+                                       &weights_[0],
+                                       energies_.size(),
+                                       weighted_energy_,
+                                       weighted_energy_variance_);
     }
 
     double get_weighted_wavelength() const {
@@ -0,0 +1,284 @@
+/*
+ * spectrum_batch.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_SPECTRUM_BATCH_H
+#define DXTBX_MODEL_SPECTRUM_BATCH_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <scitbx/vec2.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/model/spectrum.h>
+#include <dxtbx/parallel.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::vec2;
+
+  /**
+   * Many spectra with the same number of bins, held as rows of one
+   * contiguous 2D array of weights. The energies are either a row for each
+   * spectrum or a single row shared by all of them, as after rebinning onto
+   * a common energy grid. The statistics of Spectrum are computed for every
+   * spectrum at once, over many threads.
+   */
+  class SpectrumBatch {
+  public:
+    typedef scitbx::af::versa<double, scitbx::af::c_grid<2> > grid_type;
+
+    /** Construct an empty batch */
+    SpectrumBatch() : energies_(scitbx::af::c_grid<2>(1, 0)) {}
+
+    /**
+     * Construct with the energies of each spectrum
+     * @param energies The energies (eV), a row for each spectrum
+     * @param weights The weights, a row for each spectrum
+     */
+    SpectrumBatch(const scitbx::af::const_ref<double, scitbx::af::c_grid<2> > &energies,
+                  const scitbx::af::const_ref<double, scitbx::af::c_grid<2> > &weights)
+        : energies_(energies.accessor()), weights_(weights.accessor()) {
+      DXTBX_ASSERT(energies.accessor()[0] == weights.accessor()[0]);
+      DXTBX_ASSERT(energies.accessor()[1] == weights.accessor()[1]);
+      std::copy(energies.begin(), energies.end(), energies_.begin());
+      std::copy(weights.begin(), weights.end(), weights_.begin());
+    }
+
+    /**
+     * Construct with energies common to all the spectra
+     * @param energies The energies (eV) of every spectrum
+     * @param weights The weights, a row for each spectrum
+     */
+    SpectrumBatch(const scitbx::af::const_ref<double> &energies,
+                  const scitbx::af::const_ref<double, scitbx::af::c_grid<2> > &weights)
+        : energies_(scitbx::af::c_grid<2>(1, energies.size())),
+          weights_(weights.accessor()) {
+      DXTBX_ASSERT(energies.size() == weights.accessor()[1]);
+      std::copy(energies.begin(), energies.end(), energies_.begin());
+      std::copy(weights.begin(), weights.end(), weights_.begin());
+    }
+
+    /**
+     * Copy many spectra into a batch
+     * @param spectra The spectra, which must have the same number of bins
+     */
+    explicit SpectrumBatch(const scitbx::af::const_ref<Spectrum> &spectra) {
+      std::size_t nbins = spectra.size() > 0 ? spectra[0].get_energies_eV().size() : 0;
+      energies_ = grid_type(scitbx::af::c_grid<2>(spectra.size(), nbins));
+      weights_ = grid_type(scitbx::af::c_grid<2>(spectra.size(), nbins));
+      for (std::size_t i = 0; i < spectra.size(); ++i) {
+        vecd energies = spectra[i].get_energies_eV();
+        vecd weights = spectra[i].get_weights();
+        DXTBX_ASSERT(energies.size() == nbins && weights.size() == nbins);
+        std::copy(energies.begin(), energies.end(), energies_.begin() + i * nbins);
+        std::copy(weights.begin(), weights.end(), weights_.begin() + i * nbins);
+      }
+    }
+
+    /** @returns The number of spectra */
+    std::size_t size() const {
+      return weights_.accessor()[0];
+    }
+
+    /** @returns The number of bins in each spectrum */
+    std::size_t num_bins() const {
+      return weights_.accessor()[1];
+    }
+
+    /** @returns Do all the spectra have the same energies */
+    bool has_common_energies() const {
+      return energies_.accessor()[0] == 1;
+    }
+
+    /**
+     * Get the energies (eV). This has a single row if the energies are
+     * common to all the spectra.
+     */
+    grid_type get_energies_eV() const {
+      return energies_;
+    }
+
+    /** Get the weights, a row for each spectrum */
+    grid_type get_weights() const {
+      return weights_;
+    }
+
+    /** @returns A copy of one spectrum */
+    Spectrum get_spectrum(std::size_t index) const {
+      DXTBX_ASSERT(index < size());
+      const double *energies = energy_row(index);
+      const double *weights = weight_row(index);
+      return Spectrum(vecd(energies, energies + num_bins()),
+                      vecd(weights, weights + num_bins()));
+    }
+
+    /**
+     * Compute the weighted mean and variance of the energy of each spectrum.
+     * Both are NaN for a spectrum with no weight, such as one with no bins
+     * or all zero weights, where a Spectrum would raise an error.
+     * @param mean The weighted mean energy (eV) of each spectrum
+     * @param variance The weighted variance of the energy of each spectrum
+     * @param nthreads The number of threads, zero for the default
+     */
+    void compute_weighted_energy(const scitbx::af::ref<double> &mean,
+                                 const scitbx::af::ref<double> &variance,
+                                 std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(mean.size() == size() && variance.size() == size());
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+      parallel_for(size(), nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          if (!detail::spectrum_weighted_energy_if_weighted(
+                energy_row(i), weight_row(i), num_bins(), mean[i], variance[i])) {
+            mean[i] = nan;
+            variance[i] = nan;
+          }
+        }
+      });
+    }
+
+    /** @returns The weighted mean energy (eV) of each spectrum */
+    scitbx::af::shared<double> get_weighted_energy_eV(std::size_t nthreads = 0) const {
+      scitbx::af::shared<double> mean(size());
+      scitbx::af::shared<double> variance(size());
+      compute_weighted_energy(mean.ref(), variance.ref(), nthreads);
+      return mean;
+    }
+
+    /** @returns The weighted variance of the energy of each spectrum */
+    scitbx::af::shared<double> get_weighted_energy_variance(
+      std::size_t nthreads = 0) const {
+      scitbx::af::shared<double> mean(size());
+      scitbx::af::shared<double> variance(size());
+      compute_weighted_energy(mean.ref(), variance.ref(), nthreads);
+      return variance;
+    }
+
+    /** @returns The weighted mean wavelength (Å) of each spectrum */
+    scitbx::af::shared<double> get_weighted_wavelength(std::size_t nthreads = 0) const {
+      scitbx::af::shared<double> result = get_weighted_energy_eV(nthreads);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] = scitbx::constants::factor_ev_angstrom / result[i];
+      }
+      return result;
+    }
+
+    /**
+     * Find the energies holding the central 98% of the weight of each
+     * spectrum, as Spectrum.get_emin_eV and Spectrum.get_emax_eV
+     * @param nthreads The number of threads, zero for the default
+     * @returns The minimum and maximum energy (eV) of each spectrum
+     */
+    scitbx::af::shared<vec2<double> > get_bandwidth_98_percent(
+      std::size_t nthreads = 0) const {
+      scitbx::af::shared<vec2<double> > result(size(), vec2<double>(0, 0));
+      parallel_for(size(), nthreads, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+          detail::spectrum_bandwidth_98_percent(
+            energy_row(i), weight_row(i), num_bins(), result[i][0], result[i][1]);
+        }
+      });
+      return result;
+    }
+
+    /**
+     * Rebin every spectrum onto a common energy grid. The weight at each
+     * energy is shared between the two grid points either side of it, in
+     * proportion to how close it is to each, so the total weight and the
+     * weighted mean energy of the weight inside the grid are kept. Weight
+     * outside the grid is dropped.
+     * @param grid The energies (eV) of the new bins, in increasing order
+     * @param nthreads The number of threads, zero for the default
+     * @returns The rebinned spectra, with common energies
+     */
+    SpectrumBatch rebin(const scitbx::af::const_ref<double> &grid,
+                        std::size_t nthreads = 0) const {
+      DXTBX_ASSERT(grid.size() >= 2);
+      for (std::size_t k = 1; k < grid.size(); ++k) {
+        DXTBX_ASSERT(grid[k] > grid[k - 1]);
+      }
+      SpectrumBatch result;
+      result.energies_ = grid_type(scitbx::af::c_grid<2>(1, grid.size()));
+      std::copy(grid.begin(), grid.end(), result.energies_.begin());
+      result.weights_ = grid_type(scitbx::af::c_grid<2>(size(), grid.size()), 0.0);
+
+      // With common energies, where each energy falls on the grid is found
+      // once, and every spectrum is spread with the same table
+      std::vector<rebin_entry> common;
+      if (energies_.accessor()[0] == 1) {
+        common.resize(num_bins());
+        locate_on_grid(energy_row(0), grid, common.data());
+      }
+      parallel_for(size(), nthreads, [&](std::size_t first, std::size_t last) {
+        std::vector<rebin_entry> table(common.empty() ? num_bins() : 0);
+        for (std::size_t i = first; i < last; ++i) {
+          const rebin_entry *entry = common.data();
+          if (common.empty()) {
+            locate_on_grid(energy_row(i), grid, table.data());
+            entry = table.data();
+          }
+          const double *weights = weight_row(i);
+          double *out = result.weights_.begin() + i * grid.size();
+          for (std::size_t j = 0; j < num_bins(); ++j) {
+            out[entry[j].index] += weights[j] * entry[j].lower;
+            out[entry[j].index + 1] += weights[j] * entry[j].upper;
+          }
+        }
+      });
+      return result;
+    }
+
+  private:
+    /** Where an energy falls on a rebinning grid */
+    struct rebin_entry {
+      std::size_t index;
+      double lower;
+      double upper;
+    };
+
+    /** Find the grid interval, and the share of the weight at either end */
+    void locate_on_grid(const double *energies,
+                        const scitbx::af::const_ref<double> &grid,
+                        rebin_entry *table) const {
+      const double *begin = grid.begin();
+      const double *end = grid.end();
+      for (std::size_t j = 0; j < num_bins(); ++j) {
+        double e = energies[j];
+        rebin_entry &entry = table[j];
+        entry.index = 0;
+        entry.lower = 0;
+        entry.upper = 0;
+        if (e < grid[0] || e > grid[grid.size() - 1]) {
+          continue;
+        }
+        std::size_t k = std::upper_bound(begin, end, e) - begin;
+        k = std::min(std::max<std::size_t>(k, 1), grid.size() - 1) - 1;
+        double t = (e - grid[k]) / (grid[k + 1] - grid[k]);
+        entry.index = k;
+        entry.lower = 1.0 - t;
+        entry.upper = t;
+      }
+    }
+
+    const double *energy_row(std::size_t index) const {
+      return energies_.begin()
+             + (energies_.accessor()[0] == 1 ? 0 : index) * num_bins();
+    }
+
+    const double *weight_row(std::size_t index) const {
+      return weights_.begin() + index * num_bins();
+    }
+
+    grid_type energies_;
+    grid_type weights_;
+  };
+
+}}  // namespace dxtbx::model
+
+#endif  // DXTBX_MODEL_SPECTRUM_BATCH_H
@@ -11,6 +11,8 @@
 #ifndef DXTBX_MODEL_VIRTUAL_PANEL_H
 #define DXTBX_MODEL_VIRTUAL_PANEL_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <iostream>
 #include <boost/optional.hpp>
@@ -36,6 +38,11 @@ namespace dxtbx { namespace model {
    * A class to manage the panel virtual detector frame. This class holds
    * information about the local frame and the parent frame against which
    * the local frame is defined.
+   *
+   * The global frame, and everything derived from it, is computed from the
+   * local and parent frames when it is first read after either changes,
+   * rather than on every change. Reading it is safe from many threads at
+   * once; changing the frame is not.
    */
   class VirtualPanelFrame {
   public:
@@ -52,12 +59,38 @@ namespace dxtbx { namespace model {
           parent_origin_(0.0, 0.0, 0.0),
           parent_fast_axis_(1.0, 0.0, 0.0),
           parent_slow_axis_(0.0, 1.0, 0.0),
-          parent_normal_(0.0, 0.0, 1.0) {
-      update_global_frame();
+          parent_normal_(0.0, 0.0, 1.0),
+          distance_(0.0),
+          dirty_(true) {}
+
+    /** Copy the frame, bringing the global frame up to date first */
+    VirtualPanelFrame(const VirtualPanelFrame &other)
+        : revision_(other.revision_), dirty_(true) {
+      copy_frame(other);
+    }
+
+    /**
+     * Copy the frame, bringing the global frame up to date first. The frame
+     * moves on to a new revision, rather than taking that of the other.
+     */
+    VirtualPanelFrame &operator=(const VirtualPanelFrame &other) {
+      if (this != &other) {
+        copy_frame(other);
+        revision_.update();
+      }
+      return *this;
     }
 
     virtual ~VirtualPanelFrame() {}
 
+    /**
+     * @returns The revision, which changes whenever the frame or any other
+     * property of the panel does
+     */
+    std::size_t get_revision() const {
+      return revision_.value();
+    }
+
     /**
      * Set the global frame. Normalize the d1 and d2 axes and update the
      * local frame with this new information.
@@ -93,7 +126,7 @@ namespace dxtbx { namespace model {
       local_fast_axis_ = d1.normalize();
       local_slow_axis_ = d2.normalize();
       local_normal_ = local_fast_axis_.cross(local_slow_axis_);
-      update_global_frame();
+      invalidate_global_frame();
     }
 
     /**
@@ -110,11 +143,8 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(d1.length() > 0);
       DXTBX_ASSERT(d2.length() > 0);
       DXTBX_ASSERT((double)(d1 * d2) < EPS);
-      parent_origin_ = d0;
-      parent_fast_axis_ = d1.normalize();
-      parent_slow_axis_ = d2.normalize();
-      parent_normal_ = parent_fast_axis_.cross(parent_slow_axis_);
-      update_global_frame();
+      assign_parent_frame(d1, d2, d0);
+      invalidate_global_frame();
     }
 
     /** @return The local d matrix  */
@@ -132,6 +162,7 @@ namespace dxtbx { namespace model {
 
     /** @return The parent d matrix */
     mat3<double> get_parent_d_matrix() const {
+      refresh_global_frame();
       return mat3<double>(parent_fast_axis_[0],
                           parent_slow_axis_[0],
                           parent_origin_[0],
@@ -160,47 +191,56 @@ namespace dxtbx { namespace model {
 
     /** @returns The parent origin vector. */
     vec3<double> get_parent_origin() const {
+      refresh_global_frame();
       return parent_origin_;
     }
 
     /** @returns The parent fast axis vector. */
     vec3<double> get_parent_fast_axis() const {
+      refresh_global_frame();
       return parent_fast_axis_;
     }
 
     /** @returns The parent slow axis vector. */
     vec3<double> get_parent_slow_axis() const {
+      refresh_global_frame();
       return parent_slow_axis_;
     }
 
     /** @return The d matrix */
     mat3<double> get_d_matrix() const {
+      refresh_global_frame();
       return d_;
     }
 
     /** @return The D (inverted d) matrix */
     mat3<double> get_D_matrix() const {
+      refresh_global_frame();
       DXTBX_ASSERT(D_);
       return D_.get();
     }
 
     /** @returns The origin vector. */
     vec3<double> get_origin() const {
+      refresh_global_frame();
       return vec3<double>(d_[2], d_[5], d_[8]);
     }
 
     /** @returns The fast axis vector. */
     vec3<double> get_fast_axis() const {
+      refresh_global_frame();
       return vec3<double>(d_[0], d_[3], d_[6]);
     }
 
     /** @returns The slow axis vector. */
     vec3<double> get_slow_axis() const {
+      refresh_global_frame();
       return vec3<double>(d_[1], d_[4], d_[7]);
     }
 
     /** @returns The normal to the virtual plane. */
     vec3<double> get_normal() const {
+      refresh_global_frame();
       return normal_;
     }
 
@@ -208,16 +248,19 @@ namespace dxtbx { namespace model {
      * @returns The point on the plane where normal goes through the lab origin.
      */
     vec2<double> get_normal_origin() const {
+      refresh_global_frame();
       return normal_origin_;
     }
 
     /** @returns The distance from the lab origin to the plane. */
     double get_distance() const {
+      refresh_global_frame();
       return std::abs(distance_);
     }
 
     /** @returns The distance from the lab origin to the plane. */
     double get_directed_distance() const {
+      refresh_global_frame();
       return distance_;
     }
 
@@ -242,14 +285,52 @@ namespace dxtbx { namespace model {
      * @returns The lab coordinate.
      */
     vec3<double> get_lab_coord(vec2<double> xy) const {
+      refresh_global_frame();
       return d_ * vec3<double>(xy[0], xy[1], 1.0);
     }
 
+    /**
+     * Map many mm coordinates on the plane to lab coordinates, with the d
+     * matrix read once for them all. The loop has no branches or calls, so
+     * the compiler is free to vectorise it.
+     * @param xy The mm coordinates on the plane
+     * @param result The lab coordinates
+     */
+    void get_lab_coord_multiple(const scitbx::af::const_ref<vec2<double> > &xy,
+                                const scitbx::af::ref<vec3<double> > &result) const {
+      DXTBX_ASSERT(result.size() == xy.size());
+      refresh_global_frame();
+      const double d0 = d_[0], d1 = d_[1], d2 = d_[2];
+      const double d3 = d_[3], d4 = d_[4], d5 = d_[5];
+      const double d6 = d_[6], d7 = d_[7], d8 = d_[8];
+      const double *in = (const double *)xy.begin();
+      double *out = (double *)result.begin();
+      for (std::size_t i = 0; i < xy.size(); ++i) {
+        const double x = in[2 * i];
+        const double y = in[2 * i + 1];
+        out[3 * i] = d0 * x + d1 * y + d2;
+        out[3 * i + 1] = d3 * x + d4 * y + d5;
+        out[3 * i + 2] = d6 * x + d7 * y + d8;
+      }
+    }
+
+    /**
+     * @param xy The mm coordinates on the plane
+     * @returns The lab coordinates
+     */
+    scitbx::af::shared<vec3<double> > get_lab_coord_multiple(
+      const scitbx::af::const_ref<vec2<double> > &xy) const {
+      scitbx::af::shared<vec3<double> > result(xy.size());
+      get_lab_coord_multiple(xy, result.ref());
+      return result;
+    }
+
     /**
      * @param s1 The ray vector.
      * @returns the coordinate of a ray intersecting with the detector
      */
     vec2<double> get_ray_intersection(vec3<double> s1) const {
+      refresh_global_frame();
       DXTBX_ASSERT(D_);
       vec3<double> v = D_.get() * s1;
       DXTBX_ASSERT(v[2] > 0);
@@ -261,6 +342,7 @@ namespace dxtbx { namespace model {
      * @returns the coordinate of a ray intersecting with the detector
      */
     vec2<double> get_bidirectional_ray_intersection(vec3<double> s1) const {
+      refresh_global_frame();
       DXTBX_ASSERT(D_);
       vec3<double> v = D_.get() * s1;
       DXTBX_ASSERT(v[2] != 0);
@@ -282,6 +364,44 @@ namespace dxtbx { namespace model {
     }
 
   protected:
+    /**
+     * Mark the global frame out of date after the local or parent frame
+     * changes, so it is computed again when it is next read.
+     */
+    void invalidate_global_frame() {
+      revision_.update();
+      dirty_.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Bring the parent frame up to date before the global frame is computed
+     * from it. A frame whose parent frame is set directly has nothing to do;
+     * a detector node takes it from its parent node.
+     */
+    virtual void update_parent_frame() const {}
+
+    /** Set the parent frame, without marking the global frame out of date */
+    void assign_parent_frame(const vec3<double> &d1,
+                             const vec3<double> &d2,
+                             const vec3<double> &d0) const {
+      parent_origin_ = d0;
+      parent_fast_axis_ = d1.normalize();
+      parent_slow_axis_ = d2.normalize();
+      parent_normal_ = parent_fast_axis_.cross(parent_slow_axis_);
+    }
+
+    /** Compute the global frame if it is out of date */
+    void refresh_global_frame() const {
+      if (dirty_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (dirty_.load(std::memory_order_relaxed)) {
+          update_parent_frame();
+          update_global_frame();
+          dirty_.store(false, std::memory_order_release);
+        }
+      }
+    }
+
     /**
      * Update the global frame. Construct a matrix of the parent orientation
      * and multiply the origin, fast and slow vectors of the local frame
@@ -292,7 +412,7 @@ namespace dxtbx { namespace model {
      * constructed with an invalid frame (for example a zero length origin
      * vector) without immediately failing.
      */
-    void update_global_frame() {
+    void update_global_frame() const {
       // Construct the parent orientation matrix
       mat3<double> parent_orientation(parent_fast_axis_[0],
                                       parent_slow_axis_[0],
@@ -318,12 +438,16 @@ namespace dxtbx { namespace model {
       }
 
       // Get the normal etc
-      normal_ = get_fast_axis().cross(get_slow_axis());
-      distance_ = get_origin() * get_normal();
-      try {
-        normal_origin_ = get_bidirectional_ray_intersection(get_normal());
-      } catch (dxtbx::error const &) {
-        normal_origin_ = vec2<double>(0, 0);
+      vec3<double> fast_axis(d_[0], d_[3], d_[6]);
+      vec3<double> slow_axis(d_[1], d_[4], d_[7]);
+      normal_ = fast_axis.cross(slow_axis);
+      distance_ = vec3<double>(d_[2], d_[5], d_[8]) * normal_;
+      normal_origin_ = vec2<double>(0, 0);
+      if (D_) {
+        vec3<double> v = D_.get() * normal_;
+        if (v[2] != 0) {
+          normal_origin_ = vec2<double>(v[0] / v[2], v[1] / v[2]);
+        }
       }
     }
 
@@ -332,6 +456,9 @@ namespace dxtbx { namespace model {
     void update_local_frame(const vec3<double> &d1,
                             const vec3<double> &d2,
                             const vec3<double> &d0) {
+      // The parent frame must be up to date to find the local frame from it
+      refresh_global_frame();
+
       // Construct the parent orientation matrix
       mat3<double> parent_orientation(parent_fast_axis_[0],
                                       parent_slow_axis_[0],
@@ -356,7 +483,7 @@ namespace dxtbx { namespace model {
       local_origin_ = vec3<double>(ld[2], ld[5], ld[8]);
 
       // Update the global frame and check it's correct
-      update_global_frame();
+      invalidate_global_frame();
       double EPS = 1e-6;
       DXTBX_ASSERT(get_fast_axis().const_ref().all_approx_equal(d1.const_ref(), EPS));
       DXTBX_ASSERT(get_slow_axis().const_ref().all_approx_equal(d2.const_ref(), EPS));
@@ -367,15 +494,39 @@ namespace dxtbx { namespace model {
     vec3<double> local_fast_axis_;
     vec3<double> local_slow_axis_;
     vec3<double> local_normal_;
-    vec3<double> parent_origin_;
-    vec3<double> parent_fast_axis_;
-    vec3<double> parent_slow_axis_;
-    vec3<double> parent_normal_;
-    mat3<double> d_;
-    boost::optional<mat3<double> > D_;
-    vec3<double> normal_;
-    double distance_;
-    vec2<double> normal_origin_;
+    mutable vec3<double> parent_origin_;
+    mutable vec3<double> parent_fast_axis_;
+    mutable vec3<double> parent_slow_axis_;
+    mutable vec3<double> parent_normal_;
+    mutable mat3<double> d_;
+    mutable boost::optional<mat3<double> > D_;
+    mutable vec3<double> normal_;
+    mutable double distance_;
+    mutable vec2<double> normal_origin_;
+    ModelRevision revision_;
+
+  private:
+    /** Copy everything but the lock, with the global frame up to date */
+    void copy_frame(const VirtualPanelFrame &other) {
+      other.refresh_global_frame();
+      local_origin_ = other.local_origin_;
+      local_fast_axis_ = other.local_fast_axis_;
+      local_slow_axis_ = other.local_slow_axis_;
+      local_normal_ = other.local_normal_;
+      parent_origin_ = other.parent_origin_;
+      parent_fast_axis_ = other.parent_fast_axis_;
+      parent_slow_axis_ = other.parent_slow_axis_;
+      parent_normal_ = other.parent_normal_;
+      d_ = other.d_;
+      D_ = other.D_;
+      normal_ = other.normal_;
+      distance_ = other.distance_;
+      normal_origin_ = other.normal_origin_;
+      dirty_.store(false, std::memory_order_release);
+    }
+
+    mutable std::atomic<bool> dirty_;
+    mutable std::mutex mutex_;
   };
 
   /**
@@ -393,6 +544,7 @@ namespace dxtbx { namespace model {
     /** @param The name of the panel */
     void set_name(const std::string &name) {
       name_ = name;
+      revision_.update();
     }
 
     /** @returns The type of the panel */
@@ -403,6 +555,7 @@ namespace dxtbx { namespace model {
     /** @param The type of the panel */
     void set_type(const std::string &type) {
       type_ = type;
+      revision_.update();
     }
 
     /** @returns True/False this is the same as the other */
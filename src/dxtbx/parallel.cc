@@ -0,0 +1,54 @@
+#define DXTBX_PARALLEL_SOURCE
+#include "dxtbx/parallel.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+namespace dxtbx { namespace detail {
+
+  namespace {
+
+    // The pool of this process, created the first time it is needed
+    std::atomic<thread_pool *> process_pool(NULL);
+
+#if !defined(_WIN32)
+    /**
+     * Forget the pool in a child forked from the process. The child has none
+     * of the worker threads, and any lock the pool held at the fork stays
+     * held, so the old pool is leaked and a new one is made when needed.
+     */
+    void forget_pool_in_child() {
+      process_pool.store(NULL, std::memory_order_relaxed);
+    }
+
+    struct register_fork_handler {
+      register_fork_handler() {
+        pthread_atfork(NULL, NULL, &forget_pool_in_child);
+      }
+    } fork_handler;
+#endif
+
+  }  // namespace
+
+  std::atomic<std::size_t> &max_threads_setting() {
+    static std::atomic<std::size_t> setting(0);
+    return setting;
+  }
+
+  thread_pool &default_thread_pool() {
+    thread_pool *pool = process_pool.load(std::memory_order_acquire);
+    if (pool == NULL) {
+      // A pool starts its workers when it first runs a job, so one made by a
+      // thread which loses the race to install it is deleted unused
+      thread_pool *created = new thread_pool();
+      if (process_pool.compare_exchange_strong(pool, created)) {
+        pool = created;
+      } else {
+        delete created;
+      }
+    }
+    return *pool;
+  }
+
+}}  // namespace dxtbx::detail
@@ -0,0 +1,424 @@
+#ifndef DXTBX_PARALLEL_H
+#define DXTBX_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+// The thread pool and the thread count setting live in the dxtbx_parallel
+// shared library, so that every extension linked against it shares them
+#if defined(_WIN32)
+#if defined(DXTBX_PARALLEL_SOURCE)
+#define DXTBX_PARALLEL_API __declspec(dllexport)
+#else
+#define DXTBX_PARALLEL_API __declspec(dllimport)
+#endif
+#else
+#define DXTBX_PARALLEL_API __attribute__((visibility("default")))
+#endif
+
+namespace dxtbx {
+
+  namespace detail {
+
+    /**
+     * @returns The number of cores this process may run on. On Linux this is
+     * the CPU affinity mask, which is how cgroup cpusets, SLURM and taskset
+     * limit a job, rather than the number of cores in the machine.
+     */
+    inline std::size_t available_cpu_count() {
+#if defined(__linux__)
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        int count = CPU_COUNT(&set);
+        if (count > 0) {
+          return count;
+        }
+      }
+#endif
+      return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    /**
+     * @returns The thread count from the environment variable
+     * DXTBX_NUM_THREADS, or zero if it is unset or not a positive number
+     */
+    inline std::size_t environment_thread_count() {
+      const char *value = std::getenv("DXTBX_NUM_THREADS");
+      if (value == NULL) {
+        return 0;
+      }
+      char *end = NULL;
+      long count = std::strtol(value, &end, 10);
+      return end != value && *end == '\0' && count > 0 ? count : 0;
+    }
+
+    /** The thread count set with set_max_threads, zero if not set */
+    DXTBX_PARALLEL_API std::atomic<std::size_t> &max_threads_setting();
+
+    /**
+     * A fork-join job: a number of chunks claimed in turn by the threads
+     * running it. The job lives on the stack of the thread which started it,
+     * which waits until no other thread is still running it.
+     */
+    struct parallel_job {
+      typedef void (*function_type)(void *, std::size_t);
+
+      parallel_job(function_type function_, void *context_, std::size_t nchunks_)
+          : function(function_), context(context_), nchunks(nchunks_), next(0),
+            running(0) {}
+
+      /** Run chunks until there are none left */
+      void work() {
+        for (std::size_t chunk = next++; chunk < nchunks; chunk = next++) {
+          function(context, chunk);
+        }
+      }
+
+      /** Finish a run by another thread, started when it took the job */
+      void finish_run() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--running == 0) {
+          done.notify_all();
+        }
+      }
+
+      function_type function;
+      void *context;
+      std::size_t nchunks;
+      std::atomic<std::size_t> next;
+      std::atomic<std::size_t> running;
+      std::mutex mutex;
+      std::condition_variable done;
+    };
+
+    /**
+     * A pool of worker threads, each with its own queue of jobs to help
+     * with. A worker runs the newest job in its own queue, and when that is
+     * empty steals the oldest job from the other queues. Workers are
+     * started when they are first needed, up to a fixed limit.
+     */
+    class thread_pool {
+    public:
+      // The most worker threads a pool will start
+      static const std::size_t MAX_WORKERS = 255;
+
+      thread_pool()
+          : queues_(new worker_queue[MAX_WORKERS]), nworkers_(0), pending_(0),
+            next_queue_(0) {}
+
+      /**
+       * Run a job on the calling thread and up to nhelpers workers. Any
+       * workers which have not taken the job by the time its chunks run out
+       * are called off.
+       */
+      void run(parallel_job &job, std::size_t nhelpers) {
+        nhelpers = std::min(nhelpers, start_workers(nhelpers));
+        if (nhelpers > 0) {
+          pending_ += nhelpers;
+          std::size_t first = next_queue_.fetch_add(nhelpers);
+          for (std::size_t i = 0; i < nhelpers; ++i) {
+            worker_queue &queue = queues_[(first + i) % nworkers_.load()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(&job);
+          }
+          {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+          }
+          if (nhelpers == 1) {
+            wake_.notify_one();
+          } else {
+            wake_.notify_all();
+          }
+        }
+        job.work();
+        if (nhelpers > 0) {
+          withdraw(job);
+          std::unique_lock<std::mutex> lock(job.mutex);
+          job.done.wait(lock, [&] { return job.running == 0; });
+        }
+      }
+
+    private:
+      struct worker_queue {
+        std::mutex mutex;
+        std::deque<parallel_job *> jobs;
+      };
+
+      /** Start workers until there are at least n, returning how many */
+      std::size_t start_workers(std::size_t n) {
+        n = n < MAX_WORKERS ? n : MAX_WORKERS;
+        if (nworkers_.load() < n) {
+          std::lock_guard<std::mutex> lock(start_mutex_);
+          while (nworkers_.load() < n) {
+            std::size_t index = nworkers_.load();
+            std::thread(&thread_pool::work, this, index).detach();
+            nworkers_.store(index + 1);
+          }
+        }
+        return nworkers_.load();
+      }
+
+      /** Take a job from a queue, marking it as running */
+      parallel_job *take(std::size_t index, bool newest) {
+        worker_queue &queue = queues_[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+          return NULL;
+        }
+        parallel_job *job = newest ? queue.jobs.back() : queue.jobs.front();
+        if (newest) {
+          queue.jobs.pop_back();
+        } else {
+          queue.jobs.pop_front();
+        }
+        ++job->running;
+        --pending_;
+        return job;
+      }
+
+      /** Remove a job from every queue, once its chunks have run out */
+      void withdraw(parallel_job &job) {
+        std::size_t nworkers = nworkers_.load();
+        for (std::size_t i = 0; i < nworkers; ++i) {
+          worker_queue &queue = queues_[i];
+          std::lock_guard<std::mutex> lock(queue.mutex);
+          std::size_t before = queue.jobs.size();
+          queue.jobs.erase(std::remove(queue.jobs.begin(), queue.jobs.end(), &job),
+                           queue.jobs.end());
+          pending_ -= before - queue.jobs.size();
+        }
+      }
+
+      /** The worker loop */
+      void work(std::size_t index) {
+        for (;;) {
+          parallel_job *job = take(index, true);
+          std::size_t nworkers = nworkers_.load();
+          for (std::size_t i = 1; job == NULL && i < nworkers; ++i) {
+            job = take((index + i) % nworkers, false);
+          }
+          if (job != NULL) {
+            job->work();
+            job->finish_run();
+            continue;
+          }
+          std::unique_lock<std::mutex> lock(sleep_mutex_);
+          wake_.wait(lock, [&] { return pending_.load() > 0; });
+        }
+      }
+
+      std::unique_ptr<worker_queue[]> queues_;
+      std::atomic<std::size_t> nworkers_;
+      std::atomic<std::size_t> pending_;
+      std::atomic<std::size_t> next_queue_;
+      std::mutex start_mutex_;
+      std::mutex sleep_mutex_;
+      std::condition_variable wake_;
+    };
+
+    /**
+     * @returns The thread pool of this process, shared by every extension.
+     * The pool is never destroyed, so its workers are not joined while the
+     * process exits. A child forked from the process has none of the worker
+     * threads, so it starts a new pool of its own.
+     */
+    DXTBX_PARALLEL_API thread_pool &default_thread_pool();
+
+  }  // namespace detail
+
+  /**
+   * Set the number of threads used when none is asked for, i.e. when a
+   * function is given nthreads=0.
+   * @param nthreads The number of threads, zero for the default: the
+   * DXTBX_NUM_THREADS environment variable if it is set, and otherwise one
+   * per core available to the process
+   */
+  inline void set_max_threads(std::size_t nthreads) {
+    detail::max_threads_setting() = nthreads;
+  }
+
+  /** @returns The number of threads used when none is asked for */
+  inline std::size_t get_max_threads() {
+    std::size_t nthreads = detail::max_threads_setting();
+    if (nthreads == 0) {
+      nthreads = detail::environment_thread_count();
+    }
+    if (nthreads == 0) {
+      nthreads = detail::available_cpu_count();
+    }
+    return nthreads;
+  }
+
+  /**
+   * Resolve a requested number of threads. Zero means the default number,
+   * from get_max_threads.
+   */
+  inline std::size_t resolve_thread_count(std::size_t nthreads) {
+    if (nthreads == 0) {
+      nthreads = get_max_threads();
+    }
+    return std::max<std::size_t>(nthreads, 1);
+  }
+
+  /**
+   * @returns The number of chunks parallel_for splits the range [0, n) into
+   * for nthreads threads. A few chunks per thread lets the threads which
+   * finish early take on the work of the others.
+   */
+  inline std::size_t parallel_chunk_count(std::size_t n, std::size_t nthreads) {
+    const std::size_t chunks_per_thread = 4;
+    nthreads = std::min(resolve_thread_count(nthreads), n);
+    return nthreads <= 1 ? std::min<std::size_t>(n, 1)
+                         : std::min(n, nthreads * chunks_per_thread);
+  }
+
+  /**
+   * Split the range [0, n) into contiguous chunks and call func(begin, end)
+   * for each of them, over up to nthreads threads: the calling thread and
+   * workers from the shared thread pool. The chunks depend only on n and
+   * nthreads, not on which thread runs them, and with a single thread func
+   * is called once for the whole range on the calling thread. Any exception
+   * thrown by func is rethrown here once all threads have finished; if more
+   * than one chunk throws, it is the exception from the first of them.
+   */
+  template <typename Function>
+  void parallel_for(std::size_t n, std::size_t nthreads, Function func) {
+    nthreads = std::min(resolve_thread_count(nthreads), n);
+    if (nthreads <= 1) {
+      if (n > 0) {
+        func(std::size_t(0), n);
+      }
+      return;
+    }
+
+    struct context_type {
+      Function &func;
+      std::size_t n;
+      std::size_t nchunks;
+      std::vector<std::exception_ptr> errors;
+
+      static void run_chunk(void *self, std::size_t chunk) {
+        context_type &context = *static_cast<context_type *>(self);
+        try {
+          context.func(chunk * context.n / context.nchunks,
+                       (chunk + 1) * context.n / context.nchunks);
+        } catch (...) {
+          context.errors[chunk] = std::current_exception();
+        }
+      }
+    };
+    const std::size_t nchunks = parallel_chunk_count(n, nthreads);
+    context_type context = {
+      func, n, nchunks, std::vector<std::exception_ptr>(nchunks)};
+    detail::parallel_job job(&context_type::run_chunk, &context, nchunks);
+    detail::default_thread_pool().run(job, nthreads - 1);
+    for (auto &e : context.errors) {
+      if (e) {
+        std::rethrow_exception(e);
+      }
+    }
+  }
+
+  /**
+   * Reduce the range [0, n) over up to nthreads threads. Each chunk of the
+   * range from parallel_for is mapped to a value with map(begin, end), and
+   * the values are combined with combine(a, b) in the order of the chunks,
+   * so for a given n and nthreads the result is always the same, whatever
+   * the order the chunks ran in.
+   * @param n The size of the range
+   * @param nthreads The number of threads, zero for the default
+   * @param identity The result for an empty range
+   * @param map The function giving the value of a chunk
+   * @param combine The function combining two values
+   * @returns The combined value of every chunk
+   */
+  template <typename T, typename Map, typename Combine>
+  T parallel_reduce(std::size_t n,
+                    std::size_t nthreads,
+                    T identity,
+                    Map map,
+                    Combine combine) {
+    const std::size_t nchunks = parallel_chunk_count(n, nthreads);
+    std::vector<T> values(nchunks, identity);
+    parallel_for(nchunks, nthreads, [&](std::size_t first, std::size_t last) {
+      for (std::size_t chunk = first; chunk < last; ++chunk) {
+        values[chunk] = map(chunk * n / nchunks, (chunk + 1) * n / nchunks);
+      }
+    });
+    T result = identity;
+    for (std::size_t chunk = 0; chunk < nchunks; ++chunk) {
+      result = combine(result, values[chunk]);
+    }
+    return result;
+  }
+
+  /**
+   * Sort a range with a merge sort over up to nthreads threads. The range
+   * is split into one chunk per thread, the chunks are sorted with
+   * std::sort, and then merged in pairs, in parallel, through a buffer.
+   * The merges keep the order of equal elements from the chunks, so the
+   * result is stable if comp breaks all ties, e.g. by position.
+   * @param first The start of the range
+   * @param last The end of the range
+   * @param comp The less than comparison
+   * @param nthreads The number of threads, zero for the default
+   */
+  template <typename T, typename Compare>
+  void parallel_sort(T *first, T *last, Compare comp, std::size_t nthreads) {
+    // Chunks smaller than this are not worth a thread
+    const std::size_t min_chunk = 1 << 14;
+    const std::size_t n = last - first;
+    const std::size_t nchunks = std::min(resolve_thread_count(nthreads),
+                                         std::max<std::size_t>(n / min_chunk, 1));
+    if (nchunks <= 1) {
+      std::sort(first, last, comp);
+      return;
+    }
+
+    std::vector<std::size_t> bounds(nchunks + 1);
+    for (std::size_t i = 0; i <= nchunks; ++i) {
+      bounds[i] = i * n / nchunks;
+    }
+    parallel_for(nchunks, nchunks, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        std::sort(first + bounds[i], first + bounds[i + 1], comp);
+      }
+    });
+
+    std::vector<T> buffer(n);
+    T *src = first;
+    T *dst = &buffer[0];
+    for (std::size_t width = 1; width < nchunks; width *= 2) {
+      const std::size_t npairs = (nchunks + 2 * width - 1) / (2 * width);
+      parallel_for(npairs, nchunks, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          std::size_t lo = bounds[std::min(2 * i * width, nchunks)];
+          std::size_t mid = bounds[std::min((2 * i + 1) * width, nchunks)];
+          std::size_t hi = bounds[std::min((2 * i + 2) * width, nchunks)];
+          std::merge(src + lo, src + mid, src + mid, src + hi, dst + lo, comp);
+        }
+      });
+      std::swap(src, dst);
+    }
+    if (src != first) {
+      std::copy(src, src + n, first);
+    }
+  }
+
+}  // namespace dxtbx
+
+#endif  // DXTBX_PARALLEL_H
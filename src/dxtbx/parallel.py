@@ -0,0 +1,31 @@
+"""
+Configure the threads the C++ extensions use.
+
+Functions which take an nthreads argument split their work over a shared
+pool of threads; nthreads=0, the default, uses get_max_threads() threads.
+Unless set_max_threads is called this is the DXTBX_NUM_THREADS environment
+variable if it is set, and otherwise the number of CPUs the process may
+run on, so a job limited to some CPUs by a cgroup cpuset, a batch system
+such as SLURM or taskset does not oversubscribe them.
+"""
+
+from __future__ import annotations
+
+from dxtbx.ext import ext as _ext
+
+
+def set_max_threads(nthreads: int) -> None:
+    """
+    Set the number of threads used when a function is given nthreads=0.
+
+    Args:
+        nthreads: The number of threads, or zero to restore the default
+    """
+    if nthreads < 0:
+        raise ValueError("The number of threads must not be negative")
+    _ext._set_max_threads(nthreads)
+
+
+def get_max_threads() -> int:
+    """Get the number of threads used when a function is given nthreads=0"""
+    return _ext._get_max_threads()
@@ -0,0 +1,54 @@
+from __future__ import annotations
+
+import pytest
+
+from dxtbx.command_line import benchmark_imageset
+
+
+@pytest.mark.parametrize("fmt", ["cbf", "raw", "hdf5"])
+@pytest.mark.parametrize("nthreads", [1, 2])
+def test_benchmark_imageset(tmp_path, fmt, nthreads):
+    imageset = benchmark_imageset.make_synthetic_sweep(
+        str(tmp_path), fmt, nframes=4, shape=(16, 24)
+    )
+    assert len(imageset) == 4
+    (raw,) = imageset.get_raw_data(3)
+    assert raw.all() == (16, 24)
+
+    result = benchmark_imageset.benchmark_imageset(imageset, nthreads)
+    assert result["frames"] == 4
+    assert result["nthreads"] == nthreads
+    assert result["frames_per_second"] > 0
+    assert result["megabytes_per_second"] > 0
+    if imageset.read_statistics()["enabled"]:
+        assert set(result["stages"]) == set(benchmark_imageset.STAGES)
+        assert all(seconds >= 0 for seconds in result["stages"].values())
+
+
+def test_benchmark_imageset_run(dials_data, capsys):
+    data = dials_data("centroid_test_data", pathlib=True)
+    benchmark_imageset.run(
+        [str(data / "centroid_0001.cbf"), str(data / "centroid_0002.cbf")]
+        + "--formats raw --frames 2 --size 8 8 --nthreads 1 2".split()
+    )
+    output = capsys.readouterr().out
+    assert output.count("synthetic-raw") == 2
+    assert output.count("reference-0") == 2
+
+
+@pytest.mark.parametrize("fmt", ["cbf", "raw", "hdf5"])
+def test_benchmark_imageset_throughput(request, tmp_path, fmt):
+    # Timed with pytest-benchmark when it is installed, e.g.
+    # pytest --benchmark-only --benchmark-compare to compare with a saved run
+    pytest.importorskip("pytest_benchmark")
+    benchmark = request.getfixturevalue("benchmark")
+    imageset = benchmark_imageset.make_synthetic_sweep(
+        str(tmp_path), fmt, nframes=10, shape=(512, 512)
+    )
+    result = benchmark(benchmark_imageset.benchmark_imageset, imageset)
+    assert result["frames"] == 10
+    benchmark.extra_info.update(
+        frames_per_second=result["frames_per_second"],
+        megabytes_per_second=result["megabytes_per_second"],
+        peak_rss_megabytes=result["peak_rss_megabytes"],
+    )
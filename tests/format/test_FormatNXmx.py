@@ -43,3 +43,21 @@ def test_Format_NXmx(nxmx_example_on_disk, instrument, format_class):
         filename = g.filename
     (experiment,) = ExperimentListFactory.from_filenames([filename])
     assert experiment.imageset.get_format_class() == format_class
+
+
+def test_Format_NXmx_chunk_cache(nxmx_example_on_disk):
+    """Check the file is opened with the raw data chunk cache of the class."""
+    with nxmx_example_on_disk as g:
+        filename = g.filename
+
+    class FormatNXmxSmallCache(FormatNXmx):
+        _chunk_cache_bytes = 4 * 1024 * 1024
+        _chunk_cache_slots = 1009
+
+    for format_class in (FormatNXmx, FormatNXmxSmallCache):
+        fh = format_class(filename)._cached_file_handle
+        _, nslots, nbytes, _ = fh.id.get_access_plist().get_cache()
+        assert (nbytes, nslots) == (
+            format_class._chunk_cache_bytes,
+            format_class._chunk_cache_slots,
+        )
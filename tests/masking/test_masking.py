@@ -12,9 +12,12 @@ from scitbx.math import principal_axes_of_inertia_2d
 
 from dxtbx.masking import (
     GoniometerMaskerFactory,
+    GoniometerShadowSweepMasker,
+    ResolutionMaskGenerator,
     is_inside_polygon,
     mask_untrusted_polygon,
 )
+from dxtbx.model.beam import BeamFactory
 from dxtbx.model.detector import DetectorFactory
 from dxtbx.model.experiment_list import ExperimentListFactory
 from dxtbx.model.goniometer import GoniometerFactory
@@ -29,6 +32,56 @@ def test_polygon():
     assert list(is_inside_polygon(poly, points)) == [True, False, False, True]
 
 
+@pytest.mark.parametrize("nthreads", [1, 3])
+def test_mask_untrusted_polygon(nthreads):
+    # A concave polygon, with vertices on pixel centres and edges
+    poly = flex.vec2_double(
+        ((2, 1.5), (18.5, 3), (10, 9.5), (17, 17), (3.5, 14), (6, 8), (1, 1))
+    )
+    mask = flex.bool(flex.grid(20, 25), True)
+    mask_untrusted_polygon(mask, poly, nthreads=nthreads)
+    for j in range(20):
+        for i in range(25):
+            assert mask[j, i] == (not is_inside_polygon(poly, i + 0.5, j + 0.5))
+    assert mask.count(False) > 0
+
+
+def test_ResolutionMaskGenerator():
+    beam = BeamFactory.simple(1.0)
+    panel = DetectorFactory.simple(
+        sensor="PAD",
+        distance=100,
+        beam_centre=(3, 2),
+        fast_direction="+x",
+        slow_direction="-y",
+        pixel_size=(0.172, 0.172),
+        image_size=(40, 30),
+    )[0]
+    resolution = [
+        panel.get_resolution_at_pixel(beam.get_s0(), (i + 0.5, j + 0.5))
+        for j in range(30)
+        for i in range(40)
+    ]
+    # Overlapping ranges, and limits exactly at a pixel resolution
+    ranges = [(3.0, 4.0), (3.5, 5.0), (8.0, 10.0), (resolution[200], 20.0)]
+
+    expected = flex.bool(flex.grid(30, 40), True)
+    for k, d in enumerate(resolution):
+        if any(d_min <= d <= d_max for d_min, d_max in ranges):
+            expected[k] = False
+    assert expected.count(False) > 0
+
+    generator = ResolutionMaskGenerator(beam, panel)
+    mask = flex.bool(flex.grid(30, 40), True)
+    generator.apply(mask, flex.vec2_double(ranges))
+    assert mask.all_eq(expected)
+
+    mask = flex.bool(flex.grid(30, 40), True)
+    for d_min, d_max in ranges:
+        generator.apply(mask, d_min, d_max)
+    assert mask.all_eq(expected)
+
+
 @pytest.fixture
 def kappa_goniometer():
     def _construct_goniometer(phi, kappa, omega):
@@ -201,6 +254,8 @@ def test_GoniometerShadowMasker_kappa_180_omega_0(
     assert len(mask) == len(detector)
     assert mask[0].all() == tuple(reversed(detector[0].get_image_size()))
     assert mask[0].count(True) == pytest.approx(5570865)
+    mask_threaded = masker.get_mask(detector, scan_angle, nthreads=4)
+    assert mask_threaded[0].all_eq(mask[0])
 
     obj = pickle.dumps(masker)
     masker2 = pickle.loads(obj)
@@ -291,6 +346,33 @@ def test_GoniometerShadowMasker_kappa_m70_omega_p100(
     assert mask2[0] is None or mask2[0].count(False) == 0
 
 
+@pytest.mark.parametrize("model", ["mini_kappa", "smargon"])
+def test_GoniometerShadowSweepMasker(
+    model, kappa_goniometer, smargon_goniometer, pilatus_6M
+):
+    if model == "mini_kappa":
+        goniometer = kappa_goniometer(phi=0, kappa=180, omega=0)
+        masker = GoniometerMaskerFactory.mini_kappa(goniometer)
+    else:
+        goniometer = smargon_goniometer(phi=48, chi=45, omega=100)
+        masker = GoniometerMaskerFactory.smargon(goniometer)
+    detector = pilatus_6M(distance=170)
+    sweep = GoniometerShadowSweepMasker(masker, detector)
+
+    scan_angles = flex.double((-45, 0, 45, 100))
+    masks = sweep.get_masks(scan_angles, nthreads=2)
+    assert len(masks) == len(scan_angles)
+    for scan_angle, mask in zip(scan_angles, masks):
+        assert list(sweep.extrema_at_scan_angle(scan_angle)) == list(
+            masker.extrema_at_scan_angle(scan_angle)
+        )
+        expected = masker.get_mask(detector, scan_angle)
+        assert len(mask) == len(expected)
+        assert mask[0].all_eq(expected[0])
+        assert sweep.get_mask(scan_angle)[0].all_eq(expected[0])
+    assert any(mask[0].count(False) for mask in masks)
+
+
 def test_SmarGonShadowMasker_p48_c45_o95(
     smargon_goniometer, pilatus_6M, smargon_shadow_masker
 ):
@@ -192,6 +192,18 @@ def test_beam_self_serialization():
     assert beam == BeamFactory.from_dict(beam.to_dict())
 
 
+def test_beam_revision():
+    beam = Beam((0, 0, 1), 1.0)
+    revision = beam.get_revision()
+    assert beam.get_revision() == revision
+    beam.set_wavelength(1.1)
+    assert beam.get_revision() > revision
+    revision = beam.get_revision()
+    beam.set_s0_at_scan_points([(0, 0, -1), (0, 0.01, -1)])
+    assert beam.get_revision() > revision
+    assert Beam((0, 0, 1), 1.0).get_revision() > beam.get_revision()
+
+
 def test_polychromatic_beam_from_phil():
     params = beam_phil_scope.fetch(
         parse(
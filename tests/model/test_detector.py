@@ -11,7 +11,13 @@ from libtbx.test_utils import approx_equal
 from scitbx import matrix
 from scitbx.array_family import flex
 
-from dxtbx.model import Beam, Detector, Panel, ParallaxCorrectedPxMmStrategy
+from dxtbx.model import (
+    Beam,
+    Detector,
+    Panel,
+    PanelGeometryField,
+    ParallaxCorrectedPxMmStrategy,
+)
 from dxtbx.model.detector_helpers import (
     get_detector_projection_2d_axes,
     get_panel_projection_2d_from_axes,
@@ -180,6 +186,215 @@ def test_parallax_correction():
         assert abs(matrix.col(mm) - matrix.col(mm2)) < 1e-3
 
 
+@pytest.mark.parametrize("nthreads", [1, 4])
+def test_get_ray_intersection_multiple(nthreads):
+    other_panel = create_detector(offset=0)[0]
+    other_panel.set_frame((1, 0, 0), (0, 1, 0), (90, 0, 200))
+    detector = create_multipanel_detector(offset=0, ncols=4, nrows=4)
+
+    def check(rays):
+        panels, xy = detector.get_ray_intersection(rays, nthreads=nthreads)
+        assert len(panels) == len(xy) == len(rays)
+        for s1, panel, coord in zip(rays, panels, xy):
+            try:
+                expected = detector.get_ray_intersection(s1)
+            except RuntimeError:
+                assert panel == -1
+            else:
+                assert (panel, coord) == expected
+
+    # Rays over the detector, a margin around it, and in every direction
+    rays = flex.vec3_double(
+        (random.uniform(-20, 120), random.uniform(-20, 120), 200)
+        for _ in range(2000)
+    )
+    rays.extend(
+        flex.vec3_double(
+            (random.gauss(0, 1), random.gauss(0, 1), random.gauss(0, 1))
+            for _ in range(2000)
+        )
+    )
+    check(rays)
+
+    # The index is rebuilt when a panel moves
+    detector[3].set_frame((1, 0, 0), (0, 1, 0), (-50, -50, 100))
+    check(rays)
+
+    # and when one is assigned, even a panel older than the index, here to
+    # the right of the others
+    detector[5] = other_panel
+    panels, xy = detector.get_ray_intersection(rays, nthreads=nthreads)
+    hits = [200 * s1[0] / s1[2] for s1, panel in zip(rays, panels) if panel == 5]
+    assert hits and all(x > 89.99 for x in hits)
+    check(rays)
+
+
+@pytest.mark.parametrize("nthreads", [1, 4])
+def test_get_ray_intersection_multiple_degenerate_panel(nthreads):
+    detector = create_multipanel_detector(offset=0, ncols=4, nrows=4)
+    reference = create_multipanel_detector(offset=0, ncols=4, nrows=4)
+
+    # A panel in a plane through the sample has no D matrix. It is skipped,
+    # as a panel out of reach of the rays is.
+    detector[5].set_frame((1, 0, 0), (0, 1, 0), (0, 0, 0))
+    with pytest.raises(RuntimeError):
+        detector[5].get_D_matrix()
+    reference[5].set_frame((1, 0, 0), (0, 1, 0), (1e6, 1e6, 1))
+
+    rays = flex.vec3_double(
+        (random.uniform(-20, 120), random.uniform(-20, 120), 200)
+        for _ in range(2000)
+    )
+    rays.extend(
+        flex.vec3_double(
+            (random.gauss(0, 1), random.gauss(0, 1), random.gauss(0, 1))
+            for _ in range(2000)
+        )
+    )
+    panels, xy = detector.get_ray_intersection(rays, nthreads=nthreads)
+    expected_panels, expected_xy = reference.get_ray_intersection(
+        rays, nthreads=nthreads
+    )
+    assert 5 not in panels
+    assert list(panels) == list(expected_panels)
+    assert list(xy) == list(expected_xy)
+    assert any(panel >= 0 for panel in panels)
+
+
+def test_revision():
+    detector = create_multipanel_detector(offset=0)
+    revision = detector.get_revision()
+    assert revision == max(panel.get_revision() for panel in detector)
+    assert detector.get_revision() == revision
+
+    # A change to one panel moves the detector on
+    panel_revision = detector[1].get_revision()
+    detector[1].set_gain(2.0)
+    assert detector[1].get_revision() > panel_revision
+    assert detector.get_revision() == detector[1].get_revision()
+
+    # Moving a group moves everything below it on
+    hierarchy = detector.hierarchy()
+    revisions = [panel.get_revision() for panel in detector]
+    hierarchy.set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, 10))
+    assert all(
+        panel.get_revision() > before for panel, before in zip(detector, revisions)
+    )
+    assert detector.get_revision() > revision
+
+    # A copy keeps the revision until it is changed
+    panel = copy.copy(detector[0])
+    assert panel.get_revision() == detector[0].get_revision()
+    panel.set_px_mm_strategy(ParallaxCorrectedPxMmStrategy(1.0, 0.32))
+    assert panel.get_revision() > detector[0].get_revision()
+
+
+def test_revision_after_assignment():
+    # A panel made before the detector has an older revision
+    other = create_detector(offset=5)[0]
+    detector = create_multipanel_detector(offset=0)
+    s0 = (0, 0, -1)
+    revision = detector.get_revision()
+    maps = detector[0].get_geometry_maps(s0)
+
+    # Assigning it moves the detector on, and the maps are computed again
+    detector[0] = other
+    assert detector.get_revision() > revision
+    assert detector[0].get_revision() > other.get_revision()
+    assert detector[0].get_geometry_maps(s0).two_theta().all() != maps.two_theta().all()
+    assert list(detector[0].get_geometry_maps(s0).two_theta()) == list(
+        other.get_geometry_maps(s0).two_theta()
+    )
+
+
+def test_copy_on_write():
+    other_panel = create_detector(offset=5)[0]
+    detector = create_multipanel_detector(offset=0)
+    copies = [copy.deepcopy(detector) for i in range(3)]
+    for other in copies:
+        assert other == detector
+        assert other.get_revision() == detector.get_revision()
+
+    # Changing a copy leaves the others alone
+    copies[0][1].set_gain(2.0)
+    assert copies[0][1].get_gain() == 2.0
+    assert detector[1].get_gain() == copies[1][1].get_gain() == 1.0
+    copies[1].hierarchy().set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, 10))
+    assert copies[1][0].get_origin() != detector[0].get_origin()
+    assert copies[2] == detector
+
+    # Changing the original after copying leaves the copies alone
+    detector[2].set_pedestal(5.0)
+    assert copies[2][2].get_pedestal() == 0.0
+    assert copy.deepcopy(detector)[2].get_pedestal() == 5.0
+    assert pickle.loads(pickle.dumps(copies[0])) == copies[0]
+
+    # Assigning a panel drops the frozen copy made for the copies above
+    detector[1] = other_panel
+    assert copy.deepcopy(detector)[1] == other_panel
+    assert copies[2][1] != other_panel
+
+
+@pytest.mark.parametrize("single_precision", [False, True])
+def test_panel_geometry_maps(single_precision):
+    panel = create_detector(offset=0)[0]
+    panel.set_px_mm_strategy(ParallaxCorrectedPxMmStrategy(1.0, 0.32))
+    s0 = (matrix.col((0.02, 0.01, -1)).normalize() / 0.98).elems
+    get_maps = (
+        panel.get_geometry_maps_float if single_precision else panel.get_geometry_maps
+    )
+    eps = 1e-4 if single_precision else 1e-10
+    maps = get_maps(s0, nthreads=3)
+    assert maps.has(PanelGeometryField.ALL)
+    assert maps.offset() == 0.5
+
+    normal = matrix.col(panel.get_normal())
+    lab_coord = maps.lab_coord()
+    w, h = panel.get_image_size()
+    assert lab_coord.all() == (h, w, 3)
+    for _ in range(100):
+        i, j = random.randrange(w), random.randrange(h)
+        xyz = matrix.col(panel.get_pixel_lab_coord((i + 0.5, j + 0.5)))
+        assert tuple(lab_coord[j, i, k] for k in range(3)) == pytest.approx(
+            xyz, rel=eps
+        )
+        assert maps.two_theta()[j, i] == pytest.approx(
+            panel.get_two_theta_at_pixel(s0, (i + 0.5, j + 0.5)), rel=eps
+        )
+        assert maps.resolution()[j, i] == pytest.approx(
+            panel.get_resolution_at_pixel(s0, (i + 0.5, j + 0.5)), rel=eps
+        )
+        assert maps.obliquity()[j, i] == pytest.approx(
+            abs(xyz.normalize().dot(normal)), rel=eps
+        )
+
+    # The maps are cached until the geometry or the beam changes
+    cached = get_maps(s0, PanelGeometryField.TWO_THETA)
+    assert cached.fields() == maps.fields()
+    assert cached.two_theta().all_eq(maps.two_theta())
+    panel.set_frame((1, 0, 0), (0, 1, 0), (0, 0, 150))
+    moved = get_maps(s0, PanelGeometryField.TWO_THETA)
+    assert not moved.has(PanelGeometryField.RESOLUTION)
+    assert moved.two_theta()[0, 0] == pytest.approx(
+        panel.get_two_theta_at_pixel(s0, (0.5, 0.5)), rel=eps
+    )
+
+    # The whole-panel arrays are taken at the pixel corners
+    two_theta = panel.get_two_theta_array(s0)
+    assert two_theta[3, 7] == pytest.approx(panel.get_two_theta_at_pixel(s0, (7, 3)))
+    cos2_two_theta = panel.get_cos2_two_theta_array(s0)
+    p = matrix.col(panel.get_pixel_lab_coord((7, 3)))
+    assert cos2_two_theta[3, 7] == pytest.approx(
+        matrix.col(s0).normalize().dot(p) ** 2 / p.dot(p), rel=1e-12
+    )
+
+    # The cached maps can be dropped
+    panel.clear_geometry_maps()
+    assert get_maps(s0, PanelGeometryField.TWO_THETA).fields() == (
+        PanelGeometryField.TWO_THETA
+    )
+
+
 def test_get_names(detector):
     names = detector.get_names()
     assert len(names) == 1
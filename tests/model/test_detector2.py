@@ -8,6 +8,7 @@ import pytest
 
 from libtbx.phil import parse
 from scitbx import matrix
+from scitbx.array_family import flex
 
 from dxtbx.model import Beam, Detector
 from dxtbx.model.detector import (
@@ -261,6 +262,42 @@ def test_copy_and_reference(detector):
     assert p4.is_(new_detector[3])
 
 
+def test_frame_propagation(detector):
+    root = detector.hierarchy()
+    for panel in detector:
+        panel.set_local_frame((1, 0, 0), (0, 1, 0), (1, 2, 3))
+
+    # Changes to groups reach the panels below them when they are read
+    root.set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, -100))
+    root[1].set_local_frame((0, 1, 0), (-1, 0, 0), (10, 0, 0))
+    revision = detector[0].get_revision()
+    root[0].set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, 5))
+    assert detector[0].get_revision() != revision
+    assert detector[0].get_origin() == pytest.approx((1, 2, -92))
+    assert detector[0].get_parent_origin() == pytest.approx((0, 0, -95))
+    assert detector[2].get_fast_axis() == pytest.approx((0, 1, 0))
+    assert detector[2].get_origin() == pytest.approx((8, 1, -97))
+
+    # Setting the global frame under a changed group keeps the global frame
+    root.set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, -200))
+    detector[3].set_frame((1, 0, 0), (0, 1, 0), (5, 5, -150))
+    assert detector[3].get_origin() == pytest.approx((5, 5, -150))
+    assert detector[3].get_local_origin() == pytest.approx((5, 5, 50))
+
+    # Copies taken while the panels are out of date see the new frames
+    root.set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, -300))
+    copy = deepcopy(detector)
+    assert copy[0].get_origin() == pytest.approx((1, 2, -292))
+    assert copy[3].get_origin() == pytest.approx((5, 5, -250))
+
+    # The batch lab coordinates match those of single coordinates
+    xy = flex.vec2_double([(0.5 * i, 3.0 - i) for i in range(20)])
+    lab = detector[2].get_lab_coord(xy)
+    assert len(lab) == len(xy)
+    for x, l in zip(xy, lab):
+        assert l == pytest.approx(detector[2].get_lab_coord(x))
+
+
 def test_pickle(detector):
     # Get the detector hierarchy
     root = detector.hierarchy()
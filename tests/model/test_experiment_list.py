@@ -22,6 +22,9 @@ from dxtbx.model import (
     Experiment,
     ExperimentList,
     Goniometer,
+    MosaicCrystalSauter2014,
+    Panel,
+    PolychromaticBeam,
     Scan,
     ScanFactory,
 )
@@ -715,6 +718,139 @@ def test_experimentlist_with_identifiers():
     assert list(experiments.identifiers()) == ["bacon", "ham"]
 
 
+def test_experimentlist_lookup_after_changes():
+    b1, b2 = Beam(), Beam()
+    experiments = ExperimentList()
+    for i in range(6):
+        experiments.append(Experiment(beam=(b1, b2)[i % 2], identifier=str(i)))
+    assert experiments.find("3") == 3
+    assert list(experiments.indices(b2)) == [1, 3, 5]
+    assert experiments.beams() == [b1, b2]
+
+    # Changes made in place are seen by the lookups
+    experiments[3].identifier = "spam"
+    assert experiments.find("3") == -1
+    assert experiments.find("spam") == 3
+    experiments[0].beam = b2
+    assert list(experiments.indices(b1)) == [2, 4]
+    assert experiments.beams() == [b2, b1]
+    experiments.append(Experiment(identifier="3"))
+    assert experiments.find("3") == 6
+    assert experiments.beams() == [b2, b1, None]
+    assert None in experiments.detectors()
+
+    del experiments[0]
+    assert experiments.find("1") == 0
+    assert experiments.find("3") == 5
+    experiments.remove_on_experiment_identifiers(["1", "spam"])
+    assert list(experiments.identifiers()) == ["2", "4", "5", "3"]
+    assert list(experiments.indices(b1)) == [0, 1]
+    with pytest.raises(RuntimeError):
+        experiments.remove_on_experiment_identifiers(["1"])
+
+    experiments[0].identifier = "4"
+    with pytest.raises(RuntimeError, match="inconsistent state"):
+        experiments.append(Experiment(identifier="5"))
+
+
+def test_experimentlist_append_duplicate_identifier():
+    # The identifiers of a list made from experiments are checked on append
+    experiments = ExperimentList([Experiment(identifier=str(i)) for i in range(3)])
+    with pytest.raises(RuntimeError, match="already in ExperimentList"):
+        experiments.append(Experiment(identifier="1"))
+    with pytest.raises(RuntimeError, match="already in ExperimentList"):
+        experiments.extend(ExperimentList([Experiment(identifier="2")]))
+    assert len(experiments) == 3
+
+    # As are identifiers changed in place since the list was last indexed
+    experiments[0].identifier = "spam"
+    with pytest.raises(RuntimeError, match="already in ExperimentList"):
+        experiments.append(Experiment(identifier="spam"))
+    experiments.append(Experiment(identifier="0"))
+    assert list(experiments.identifiers()) == ["spam", "1", "2", "0"]
+
+
+def test_experimentlist_lookup_after_changes_in_another_list():
+    first = ExperimentList([Experiment(identifier=str(i)) for i in range(4)])
+    second = first[1:]
+    assert first.find("2") == 2
+    assert second.find("2") == 1
+
+    # Each list holds its own experiments, and sees only changes to them
+    second[1].identifier = "spam"
+    assert second.find("spam") == 1
+    assert first.find("spam") == -1
+    assert first.find("2") == 2
+
+    second[0] = first[0]
+    assert second.find("0") == 0
+    assert second.find("1") == -1
+    second[0].identifier = "eggs"
+    assert second.find("eggs") == 0
+    assert first.find("0") == 0
+    assert first.find("eggs") == -1
+
+
+def test_experimentlist_binary_encoding():
+    beam = Beam((0, 0, 1), 1.1)
+    detector = Detector()
+    group = detector.hierarchy().add_group()
+    group.add_panel(Panel())
+    detector.hierarchy().add_panel(Panel()).set_name("second")
+    scan = Scan((1, 10), (0, 0.5))
+    scan.set_property("intensity", flex.double(range(10)))
+    crystal = MosaicCrystalSauter2014(
+        Crystal((10, 0, 0), (0, 11, 0), (0, 0, 12), space_group_symbol="P 21 21 21")
+    )
+    crystal.set_half_mosaicity_deg(0.2)
+    crystal.set_domain_size_ang(500)
+    other_beam = PolychromaticBeam()
+    experiments = ExperimentList()
+    for i in range(4):
+        experiments.append(
+            Experiment(
+                beam=(beam, other_beam)[i // 3],
+                detector=detector,
+                goniometer=Goniometer() if i else None,
+                scan=scan,
+                crystal=crystal,
+                identifier=str(i),
+            )
+        )
+
+    for decoded in (
+        ExperimentList.from_bytes(experiments.to_bytes()),
+        ExperimentList.from_bytes(experiments.to_bytes(), nthreads=2),
+        pickle.loads(pickle.dumps(experiments)),
+    ):
+        assert len(decoded) == 4
+        assert list(decoded.identifiers()) == ["0", "1", "2", "3"]
+        assert decoded[0].beam is decoded[1].beam
+        assert decoded[0].detector is decoded[3].detector
+        assert decoded[1].goniometer is not decoded[2].goniometer
+        assert decoded[0].goniometer is None
+        assert decoded[0].beam == beam
+        assert isinstance(decoded[3].beam, PolychromaticBeam)
+        assert decoded[0].detector == detector
+        assert decoded[0].detector[1].get_name() == "second"
+        assert decoded[0].detector.hierarchy()[0].is_group()
+        assert decoded[0].scan == scan
+        assert list(decoded[0].scan.get_property("intensity")) == list(range(10))
+        assert isinstance(decoded[0].crystal, MosaicCrystalSauter2014)
+        assert decoded[0].crystal == crystal
+        assert decoded[0].crystal.get_domain_size_ang() == 500
+        assert (
+            decoded[0].crystal.get_space_group().type().number()
+            == crystal.get_space_group().type().number()
+        )
+
+    data = experiments.to_bytes()
+    with pytest.raises(RuntimeError):
+        ExperimentList.from_bytes(data[:-1])
+    with pytest.raises(RuntimeError):
+        ExperimentList.from_bytes(b"spam" + data[4:])
+
+
 def test_load_models(dials_data):
     pytest.importorskip("h5py")
     filename = (
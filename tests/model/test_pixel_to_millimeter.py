@@ -123,6 +123,72 @@ def test_inverted_axis():
     assert abs(v12[1] - v22[1]) < 1e-7
 
 
+@pytest.mark.parametrize("step", [1, 8, 32])
+def test_parallax_correction_lookup_table(step):
+    detector = DetectorFactory.simple(
+        sensor=DetectorFactory.sensor("PAD"),
+        distance=150,
+        beam_centre=[75, 75],
+        fast_direction="+x",
+        slow_direction="-y",
+        pixel_size=[0.075, 0.075],
+        image_size=[2000, 2000],
+    )
+    panel = detector[0]
+    exact = ParallaxCorrectedPxMmStrategy(5.0, 1.0)
+    lookup = ParallaxCorrectedPxMmStrategy(5.0, 1.0, lookup_step=step)
+    assert lookup.lookup_step() == step
+    assert lookup == exact
+    copy = pickle.loads(pickle.dumps(lookup))
+    assert copy.lookup_step() == step
+    with pytest.raises(RuntimeError):
+        exact.lookup_error(panel)
+
+    # The difference from the exact correction is within the reported bound,
+    # on the panel and off it, where the correction is exact
+    error = lookup.lookup_error(panel)
+    assert 0 < error < 1e-4
+    xy = flex.vec2_double(
+        (random.uniform(-100, 2100), random.uniform(-100, 2100)) for i in range(1000)
+    )
+    for convert, tolerance in (("to_millimeter", error), ("to_pixel", error / 0.075)):
+        expected = getattr(exact, convert)(panel, xy)
+        result = getattr(lookup, convert)(panel, xy)
+        assert all(
+            abs(matrix.col(a) - matrix.col(b)) <= 1.5 * tolerance
+            for a, b in zip(expected, result)
+        )
+
+    # The table follows changes to the panel
+    panel.set_frame(panel.get_fast_axis(), panel.get_slow_axis(), (-75, 75, -300))
+    assert lookup.lookup_error(panel) != error
+    assert approx_equal(
+        lookup.to_millimeter(panel, xy[0]), exact.to_millimeter(panel, xy[0]), eps=1e-4
+    )
+
+    # A strategy shared by several panels keeps a table for each of them
+    other = pickle.loads(pickle.dumps(panel))
+    other.set_frame(panel.get_fast_axis(), panel.get_slow_axis(), (0, 0, -200))
+    for i in range(4):
+        for p in (panel, other):
+            assert approx_equal(
+                lookup.to_millimeter(p, xy[i]), exact.to_millimeter(p, xy[i]), eps=1e-4
+            )
+
+    # The lookup step is kept through serialisation, and is absent from the
+    # dictionary of a strategy without one
+    panel.set_mu(5.0)
+    panel.set_thickness(1.0)
+    panel.set_px_mm_strategy(lookup)
+    d = panel.to_dict()
+    assert d["px_mm_strategy"]["lookup_step"] == step
+    assert Panel.from_dict(d).get_px_mm_strategy().lookup_step() == step
+    panel.set_px_mm_strategy(exact)
+    d = panel.to_dict()
+    assert "lookup_step" not in d["px_mm_strategy"]
+    assert Panel.from_dict(d).get_px_mm_strategy().lookup_step() == 0
+
+
 def test_offset_px_mm_strategy():
     # for future reference this is the array the same shape
     # as the image in pixels with offsets in pixels
@@ -180,3 +246,58 @@ def test_px_mm_strategy_equality():
     assert offset_parallax_corrected != simple
     assert offset_parallax_corrected != parallax_corrected
     assert offset_parallax_corrected != offset
+
+
+@pytest.mark.parametrize(
+    "strategy",
+    [
+        SimplePxMmStrategy(),
+        ParallaxCorrectedPxMmStrategy(3.9, 0.32),
+        OffsetPxMmStrategy(
+            flex.double(flex.grid(100, 200), 0.25),
+            flex.double(flex.grid(100, 200), -0.5),
+        ),
+        OffsetParallaxCorrectedPxMmStrategy(
+            3.9,
+            0.32,
+            flex.double(flex.grid(100, 200), 0.25),
+            flex.double(flex.grid(100, 200), -0.5),
+        ),
+    ],
+)
+def test_array_conversion_matches_single(strategy):
+    detector = DetectorFactory.simple(
+        sensor=DetectorFactory.sensor("PAD"),
+        distance=100,
+        beam_centre=[10, 5],
+        fast_direction="+x",
+        slow_direction="-y",
+        pixel_size=[0.1, 0.1],
+        image_size=[200, 100],
+    )
+    panel = detector[0]
+    panel.set_px_mm_strategy(strategy)
+    xy = flex.vec2_double(
+        (random.uniform(-10, 210), random.uniform(-10, 110)) for i in range(100)
+    )
+
+    for expected, mm in zip(xy, panel.pixel_to_millimeter(xy)):
+        assert approx_equal(panel.pixel_to_millimeter(expected), mm)
+    for expected, px in zip(xy, panel.millimeter_to_pixel(xy)):
+        assert approx_equal(panel.millimeter_to_pixel(expected), px)
+    assert approx_equal(
+        strategy.to_millimeter(panel, xy), panel.pixel_to_millimeter(xy)
+    )
+    assert approx_equal(strategy.to_pixel(panel, xy), panel.millimeter_to_pixel(xy))
+
+    # Coordinates on several panels are converted a panel at a time
+    detector.add_panel(panel)
+    detector[1].set_px_mm_strategy(SimplePxMmStrategy())
+    panels = flex.size_t(i % 2 for i in range(len(xy)))
+    mm = detector.pixel_to_millimeter(panels, xy)
+    px = detector.millimeter_to_pixel(panels, xy)
+    for i, p in enumerate(panels):
+        assert approx_equal(detector[p].pixel_to_millimeter(xy[i]), mm[i])
+        assert approx_equal(detector[p].millimeter_to_pixel(xy[i]), px[i])
+    with pytest.raises(RuntimeError):
+        detector.pixel_to_millimeter(flex.size_t(len(xy), 2), xy)
@@ -7,6 +7,7 @@ import pytest
 import cctbx.array_family.flex as flex
 
 from dxtbx.model import Scan, ScanFactory
+from dxtbx_model_ext import scan_property_table
 
 
 def test_scan_to_string_does_not_crash_on_empty_scan():
@@ -29,6 +30,39 @@ def test_scan_wrap_around_zero():
     assert s0.get_image_range() == (350, 369)
 
 
+@pytest.mark.parametrize("deg", [True, False])
+def test_scan_batch_angle_lookup(deg):
+    scan = Scan((5, 104), (-10.0, 0.25))
+    angles = flex.double([-12.0, -10.0, 0.1, 7.3, 14.99, 15.0, 20.0, 370.1])
+    if not deg:
+        angles = angles * 0.0174533
+    index = flex.double([-3.5, 0, 1.25, 50, 99, 99.9, 101])
+
+    assert list(scan.get_image_index_from_angle(angles, deg=deg)) == [
+        scan.get_image_index_from_angle(a, deg=deg) for a in angles
+    ]
+    assert list(scan.get_array_index_from_angle(angles, deg=deg)) == [
+        scan.get_array_index_from_angle(a, deg=deg) for a in angles
+    ]
+    assert list(scan.get_angle_from_image_index(index, deg=deg)) == [
+        scan.get_angle_from_image_index(i, deg=deg) for i in index
+    ]
+    assert list(scan.get_angle_from_array_index(index, deg=deg)) == [
+        scan.get_angle_from_array_index(i, deg=deg) for i in index
+    ]
+
+    which, result = scan.get_array_indices_with_angles(angles, deg=deg)
+    assert len(which) == len(result)
+    expected = [
+        (i, tuple(r))
+        for i, a in enumerate(angles)
+        for r in scan.get_array_indices_with_angle(a, deg=deg)
+    ]
+    assert [(i, tuple(r)) for i, r in zip(which, result)] == expected
+    assert {2, 3, 4, 7} <= set(which)
+    assert not {0, 6} & set(which)
+
+
 def test_make_scan_from_properties():
     image_range = (1, 10)
 
@@ -179,6 +213,235 @@ def test_scan_properties_pickle():
             assert result[key][i] == pytest.approx(value[i])
 
 
+def test_scan_property_table_pickle():
+    table = scan_property_table()
+    table["int"] = flex.int(list(range(1000)))
+    table["double"] = flex.double(list(range(1000))) / 3
+    table["vec3"] = flex.vec3_double(1000, (1.0, 2.0, 3.0))
+    table["string"] = flex.std_string([str(i) for i in range(1000)])
+
+    def check(copy):
+        assert copy.nrows() == 1000
+        assert sorted(copy.keys()) == sorted(table.keys())
+        for key in table.keys():
+            assert type(copy[key]) is type(table[key])
+            assert list(copy[key]) == list(table[key])
+
+    # Plain data columns are handed out of band, without copying
+    buffers = []
+    data = pickle.dumps(table, protocol=5, buffer_callback=buffers.append)
+    assert len(buffers) == 3
+    assert sum(len(b.raw()) for b in buffers) == 1000 * (4 + 8 + 24)
+    check(pickle.loads(data, buffers=buffers))
+
+    # In-band protocol 5, and version 1 states for older protocols
+    for protocol in (2, 4, 5):
+        check(pickle.loads(pickle.dumps(table, protocol=protocol)))
+    assert table.__reduce__()[2][0] == 1
+
+
+@pytest.mark.parametrize("nthreads", [1, 3])
+def test_scan_property_table_sort_by_columns(nthreads):
+    # Enough rows for the parallel sort to split the work into several chunks
+    n = 40000
+    a = [(i * 37) % 11 for i in range(n)]
+    b = [float((i * 13) % 7) for i in range(n)]
+
+    def make_table():
+        table = scan_property_table()
+        table["a"] = flex.int(a)
+        table["b"] = flex.double(b)
+        table["c"] = flex.std_string([str(i) for i in range(n)])
+        return table
+
+    # Ascending by a, descending by b, and then by position
+    table = make_table()
+    column = table["c"]
+    index = table.sort_by_columns(
+        ["a", "b"], reverse=[False, True], stable=True, nthreads=nthreads
+    )
+    expected = sorted(range(n), key=lambda i: (a[i], -b[i], i))
+    assert list(index) == expected
+    assert list(table["a"]) == [a[i] for i in expected]
+    assert list(table["b"]) == [b[i] for i in expected]
+    assert list(table["c"]) == [str(i) for i in expected]
+
+    # A column fetched before the sort shares its storage with the table
+    assert list(column) == list(table["c"])
+
+    # The result does not depend on the number of threads, with the unique
+    # column as the last key so that the order is fully determined
+    keys = ["b", "a", "c"]
+    serial = make_table()
+    serial_index = serial.sort_by_columns(keys, reverse=True, nthreads=1)
+    table = make_table()
+    index = table.sort_by_columns(keys, reverse=True, nthreads=nthreads)
+    assert list(index) == list(serial_index)
+    assert list(table["c"]) == list(serial["c"])
+
+    table.sort_by_columns(["c"], reverse=True, nthreads=nthreads)
+    assert list(table["c"]) == sorted((str(i) for i in range(n)), reverse=True)
+    with pytest.raises(KeyError):
+        table.sort_by_columns(["missing"])
+
+    # Reordering by anything other than a permutation still copies the rows
+    table = scan_property_table()
+    table["c"] = flex.std_string(["x", "y", "z"])
+    table.reorder(flex.size_t([0, 0, 2]))
+    assert table.nrows() == 3
+    assert list(table["c"]) == ["x", "x", "z"]
+
+
+def test_scan_property_table_index():
+    def make_table(ids, names, values):
+        table = scan_property_table()
+        table["id"] = flex.int(ids)
+        table["name"] = flex.std_string(names)
+        table["value"] = flex.double(values)
+        return table
+
+    n = 200
+    ids = [i % 7 for i in range(n)]
+    names = [str(i % 5) for i in range(n)]
+    values = [float((i * 31) % 50) for i in range(n)]
+    table = make_table(ids, names, values)
+    table.create_index(["id", "name"])
+    table.create_index("value", ordered=True)
+    assert table.has_index(["id", "name"])
+    assert table.has_index("value", ordered=True)
+    assert not table.has_index("id")
+
+    def check(probe):
+        rows, probe_rows = table.join(probe, ["id", "name"])
+        expected = [
+            (i, j)
+            for j in range(probe.nrows())
+            for i in range(table.nrows())
+            if table["id"][i] == probe["id"][j] and table["name"][i] == probe["name"][j]
+        ]
+        assert list(zip(rows, probe_rows)) == expected
+        first = table.lookup(probe, ["id", "name"])
+        for j, row in enumerate(first):
+            matches = [i for i, k in expected if k == j]
+            assert row == (matches[0] if matches else -1)
+
+        selected = table.select_range("value", 10.0, 20.0)
+        column = list(table["value"])
+        assert list(selected) == sorted(
+            (i for i, v in enumerate(column) if 10 <= v < 20), key=lambda i: column[i]
+        )
+        assert list(table.select_range("value", high=5.0)) == sorted(
+            (i for i, v in enumerate(column) if v < 5), key=lambda i: column[i]
+        )
+
+    probe = make_table([0, 3, 6, 9], ["0", "3", "1", "0"], [0, 0, 0, 0])
+    check(probe)
+
+    # The indexes follow rows being added, deleted and changed
+    table.extend(make_table([9, 9], ["0", "0"], [12.5, 100.0]))
+    table.append({"id": 3, "name": "3", "value": 10.0})
+    check(probe)
+    table.del_selected(flex.size_t(range(0, n, 3)))
+    del table[5]
+    check(probe)
+    table[0] = {"id": 6, "name": "1", "value": 15.0}
+    table["id"] = flex.int(table.nrows(), 0)
+    check(probe)
+    table.sort("value")
+    check(probe)
+
+    table.drop_index("value", ordered=True)
+    assert not table.has_index("value", ordered=True)
+    check(probe)
+    with pytest.raises(KeyError):
+        table.drop_index("value", ordered=True)
+    with pytest.raises(RuntimeError):
+        table.create_index("value")
+
+
+@pytest.mark.parametrize("nthreads", [1, 3])
+def test_scan_property_table_concatenate(nthreads):
+    def make_table(ids, offset):
+        table = scan_property_table()
+        table["id"] = flex.int(ids)
+        table["name"] = flex.std_string([str(offset + i) for i in range(len(ids))])
+        table["value"] = flex.vec3_double([(offset + i, 0, 0) for i in range(len(ids))])
+        return table
+
+    # Tables with no columns, as for images without spots, are skipped
+    ids = [[0, 1, -1], [], [2, 0], [-1], [0]]
+    tables = [scan_property_table()]
+    offset = 0
+    for table_ids in ids:
+        tables.append(make_table(table_ids, offset))
+        offset += len(table_ids)
+
+    result = scan_property_table.concatenate(tables, nthreads=nthreads)
+    assert result.nrows() == offset
+    assert list(result["id"]) == sum(ids, [])
+    assert list(result["name"]) == [str(i) for i in range(offset)]
+    assert [v[0] for v in result["value"]] == list(range(offset))
+
+    # Each table's ids follow those of the tables before it
+    result = scan_property_table.concatenate(tables, id_key="id", nthreads=nthreads)
+    assert list(result["id"]) == [0, 1, -1, 4, 2, -1, 5]
+    assert list(tables[1]["id"]) == [0, 1, -1]
+
+    assert scan_property_table.concatenate([]).nrows() == 0
+    del tables[2]["name"]
+    with pytest.raises(RuntimeError):
+        scan_property_table.concatenate(tables)
+    with pytest.raises(KeyError):
+        scan_property_table.concatenate(tables[:2], id_key="missing")
+    with pytest.raises(RuntimeError):
+        scan_property_table.concatenate(tables[:2], id_key="value")
+
+
+def test_scan_property_table_columnar_file(tmp_path):
+    table = scan_property_table()
+    table["int"] = flex.int(list(range(1000)))
+    table["double"] = flex.double(list(range(1000))) / 3
+    table["vec3"] = flex.vec3_double(1000, (1.0, 2.0, 3.0))
+    table["string"] = flex.std_string([str(i) * (i % 4) for i in range(1000)])
+    table["bool"] = flex.bool([i % 3 == 0 for i in range(1000)])
+    filename = str(tmp_path / "table.tbl")
+    table.as_columnar_file(filename)
+
+    copy = scan_property_table.from_columnar_file(filename)
+    assert copy.nrows() == 1000
+    assert sorted(copy.keys()) == sorted(table.keys())
+    for key in table.keys():
+        assert type(copy[key]) is type(table[key])
+        assert list(copy[key]) == list(table[key])
+
+    # Mapped columns can be changed and grown without touching the file
+    column = copy["int"]
+    column[0] = -1
+    copy.extend(copy)
+    assert copy.nrows() == 2000
+    assert list(copy["int"])[:3] == [-1, 1, 2]
+    original = scan_property_table.from_columnar_file(filename)
+    assert list(original["int"])[:3] == [0, 1, 2]
+
+    subset = scan_property_table.from_columnar_file(filename, keys=["double", "string"])
+    assert sorted(subset.keys()) == ["double", "string"]
+    assert list(subset["string"]) == list(table["string"])
+    with pytest.raises(RuntimeError):
+        scan_property_table.from_columnar_file(filename, keys=["missing"])
+
+    # Writing over the file leaves tables mapping it reading the old one
+    small = scan_property_table()
+    small["int"] = flex.int([7])
+    small.as_columnar_file(filename)
+    assert list(original["int"]) == list(range(1000))
+    assert list(scan_property_table.from_columnar_file(filename)["int"]) == [7]
+    assert sorted(p.name for p in tmp_path.iterdir()) == ["table.tbl"]
+
+    (tmp_path / "bad.tbl").write_bytes(b"not a table")
+    with pytest.raises(RuntimeError):
+        scan_property_table.from_columnar_file(str(tmp_path / "bad.tbl"))
+
+
 def test_scan_properties_to_dict():
     image_range = (1, 10)
     properties = {
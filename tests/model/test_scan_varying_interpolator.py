@@ -0,0 +1,72 @@
+from __future__ import annotations
+
+import math
+import random
+
+import pytest
+
+from scitbx import matrix
+from scitbx.array_family import flex
+from scitbx.math import euler_angles
+
+from dxtbx.model import (
+    BeamFactory,
+    Crystal,
+    GoniometerFactory,
+    Scan,
+    ScanVaryingInterpolator,
+)
+
+
+@pytest.fixture
+def models():
+    crystal = Crystal((10, 0, 0), (0, 11, 0), (0, 0, 12), space_group_symbol="P1")
+    A = [matrix.sqr(crystal.get_A())]
+    for i in range(10):
+        A.append(A[-1] * matrix.sqr(euler_angles.xyz_matrix(0.1, 0.2, 0.3)))
+    crystal.set_A_at_scan_points(A)
+    beam = BeamFactory.simple(1.0)
+    s0 = matrix.col(beam.get_s0())
+    beam.set_s0_at_scan_points([s0 + matrix.col((0.001 * i, 0, 0)) for i in range(11)])
+    goniometer = GoniometerFactory.known_axis((1, 0, 0))
+    scan = Scan((3, 12), (0.0, 1.0))
+    return crystal, beam, goniometer, scan
+
+
+@pytest.mark.parametrize("nthreads", [1, 2])
+def test_scan_varying_interpolator(models, nthreads):
+    crystal, beam, goniometer, scan = models
+    interpolator = ScanVaryingInterpolator(crystal, beam, goniometer, scan)
+    assert interpolator.get_frame_range() == (2, 12)
+
+    random.seed(0)
+    frame = flex.double(random.uniform(2, 12) for i in range(1000))
+    frame.extend(flex.double([2, 7, 12]))
+    A = interpolator.get_A(frame, nthreads=nthreads)
+    s0 = interpolator.get_s0(frame, nthreads=nthreads)
+    S = interpolator.get_setting_rotation(frame, nthreads=nthreads)
+    for z, A_z, s0_z, S_z in zip(frame, A, s0, S):
+        i = min(int(math.floor(z - 2)), 9)
+        t = z - 2 - i
+        A1 = matrix.sqr(crystal.get_A_at_scan_point(i))
+        A2 = matrix.sqr(crystal.get_A_at_scan_point(i + 1))
+        assert A_z == pytest.approx((A1 + t * (A2 - A1)).elems, abs=1e-14)
+        s01 = matrix.col(beam.get_s0_at_scan_point(i))
+        s02 = matrix.col(beam.get_s0_at_scan_point(i + 1))
+        assert s0_z == pytest.approx((s01 + t * (s02 - s01)).elems, abs=1e-14)
+        assert S_z == goniometer.get_setting_rotation()
+
+    A_all, s0_all, S_all = interpolator.interpolate(frame, nthreads=nthreads)
+    assert list(A_all) == list(A)
+    assert list(s0_all) == list(s0)
+    assert list(S_all) == list(S)
+
+    with pytest.raises(RuntimeError):
+        interpolator.get_A(flex.double([12.5]))
+
+
+def test_scan_varying_interpolator_mismatched_scan_points(models):
+    crystal, beam, goniometer, scan = models
+    beam.set_s0_at_scan_points([beam.get_s0()] * 5)
+    with pytest.raises(RuntimeError):
+        ScanVaryingInterpolator(crystal, beam, goniometer, scan)
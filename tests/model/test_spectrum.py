@@ -8,7 +8,7 @@ import pytest
 from cctbx import factor_ev_angstrom
 from scitbx.array_family import flex
 
-from dxtbx.model import Spectrum
+from dxtbx.model import Spectrum, SpectrumBatch
 
 
 def test_spectrum():
@@ -57,6 +57,69 @@ def test_spectrum_weighted_mean_variance():
     assert variance == pytest.approx(w * w, abs=1e-3)
 
 
+@pytest.mark.parametrize("nthreads", [1, 3])
+def test_spectrum_batch(nthreads):
+    spectra = []
+    for peak in (11880, 11900, 11920, 11940):
+        spectra.append(Spectrum(*__generate_simple(peak, 1000.0, 5.0)))
+    batch = SpectrumBatch(spectra)
+    assert len(batch) == 4
+    assert batch.num_bins() == 2000
+    assert not batch.has_common_energies()
+    assert batch.get_weights().all() == (4, 2000)
+
+    mean, variance = batch.compute_weighted_energy(nthreads=nthreads)
+    bandwidth = batch.get_bandwidth_98_percent(nthreads=nthreads)
+    wavelength = batch.get_weighted_wavelength(nthreads=nthreads)
+    for i, spectrum in enumerate(spectra):
+        assert mean[i] == spectrum.get_weighted_energy_eV()
+        assert variance[i] == spectrum.get_weighted_energy_variance()
+        assert bandwidth[i] == (spectrum.get_emin_eV(), spectrum.get_emax_eV())
+        assert wavelength[i] == spectrum.get_weighted_wavelength()
+    assert list(batch.get_weighted_energy_eV(nthreads=nthreads)) == list(mean)
+    assert list(batch.get_weighted_energy_variance()) == list(variance)
+    assert list(batch.get_spectrum(2).get_weights()) == list(spectra[2].get_weights())
+
+    # Rebinning onto a coarser grid keeps the weight and its mean energy
+    grid = flex.double(11790 + 0.35 * i for i in range(600))
+    rebinned = batch.rebin(grid, nthreads=nthreads)
+    assert rebinned.has_common_energies()
+    assert list(rebinned.get_energies_eV()) == list(grid)
+    weights = rebinned.get_weights().as_1d()
+    for i, spectrum in enumerate(spectra):
+        row = weights[i * len(grid) : (i + 1) * len(grid)]
+        assert flex.sum(row) == pytest.approx(flex.sum(spectrum.get_weights()))
+    assert list(rebinned.get_weighted_energy_eV()) == pytest.approx(list(mean))
+
+    energies = flex.double(11800 + i for i in range(20))
+    weights = flex.double(range(40))
+    weights.reshape(flex.grid(2, 20))
+    batch = SpectrumBatch(energies, weights)
+    assert batch.has_common_energies()
+    row = flex.double(range(20, 40))
+    assert batch.get_spectrum(1).get_weighted_energy_eV() == pytest.approx(
+        flex.sum(energies * row) / flex.sum(row)
+    )
+    with pytest.raises(RuntimeError):
+        batch.rebin(flex.double([1.0]))
+
+    # A spectrum with no weight gives NaN, rather than an error as for Spectrum
+    energies = flex.double([11800, 11801, 11802])
+    weights = flex.double([1, 2, 3, 0, 0, 0])
+    weights.reshape(flex.grid(2, 3))
+    with pytest.raises(RuntimeError):
+        Spectrum(energies, flex.double(3, 0))
+    batch = SpectrumBatch(energies, weights)
+    mean, variance = batch.compute_weighted_energy(nthreads=nthreads)
+    assert mean[0] == pytest.approx(11800 + 8 / 6)
+    assert math.isnan(mean[1]) and math.isnan(variance[1])
+    assert math.isnan(batch.get_weighted_wavelength(nthreads=nthreads)[1])
+    assert batch.get_bandwidth_98_percent(nthreads=nthreads)[1] == (0, 0)
+    empty = SpectrumBatch([Spectrum(), Spectrum()])
+    assert empty.num_bins() == 0
+    assert all(math.isnan(e) for e in empty.get_weighted_energy_eV(nthreads=nthreads))
+
+
 def __generate_spectrum():
     energies = flex.double()
     counts = flex.double()
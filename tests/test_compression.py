@@ -2,7 +2,14 @@ from __future__ import annotations
 
 from scitbx.array_family import flex
 
-from dxtbx.ext import compress, uncompress
+from dxtbx.ext import (
+    compress,
+    uncompress,
+    uncompress_batch,
+    uncompress_into,
+    uncompress_rod_TY6,
+    uncompress_rod_TY6_batch,
+)
 
 
 def test_compress_decompress():
@@ -15,3 +22,99 @@ def test_compress_decompress():
     uncompressed = uncompress(compressed, x, y)
 
     assert list(data) == list(uncompressed)
+
+
+def test_compress_decompress_mixed_deltas():
+    # Mix of 1-, 2- and 4-byte deltas over lengths that don't fill whole
+    # vector blocks, so the escape and tail handling of the decoder is exercised
+    values = [0, 1, -1, 5, 127, -127, 200, -300, 40000, -70000, 2**30, -(2**30)]
+    for size in (1, 15, 16, 17, 31, 32, 33, 1000, 1001):
+        data = flex.int(size)
+        for i in range(size):
+            if i % 37 == 0:
+                data[i] = values[(i // 37) % len(values)]
+            else:
+                data[i] = i % 64
+        compressed = compress(data)
+        uncompressed = uncompress(compressed, 1, size)
+        assert list(data) == list(uncompressed)
+
+
+def test_compress_multithreaded():
+    size = 1000000
+    data = flex.int(size)
+    for i in range(0, size, 1001):
+        data[i] = 70000
+    for i in range(5, size, 997):
+        data[i] = 300
+    expected = compress(data)
+    for nthreads in (2, 3, 0):
+        assert compress(data, nthreads=nthreads) == expected
+    assert list(uncompress(compress(data, nthreads=4), 1000, 1000)) == list(data)
+
+
+def test_uncompress_batch():
+    slow, fast = 7, 9
+    frames = []
+    for n in range(5):
+        data = flex.int(slow * fast, n)
+        data[n] = 44369 * n
+        frames.append(data)
+    packed = [compress(frame) for frame in frames]
+
+    stack = uncompress_batch(packed, slow, fast, nthreads=2)
+    assert stack.all() == (5, slow, fast)
+    flat = list(stack)
+    for n, frame in enumerate(frames):
+        assert flat[n * slow * fast : (n + 1) * slow * fast] == list(frame)
+
+    assert uncompress_batch([], slow, fast).all() == (0, slow, fast)
+
+
+def test_uncompress_into():
+    x, y = 10, 10
+    data = flex.int(x * y, 1)
+    data[10] = 44369
+    data[11] = -2
+    data[12] = 70000
+    compressed = compress(data)
+
+    # Into the second frame of a stack of three
+    stack = flex.int(flex.grid(3, y, x), 0)
+    assert uncompress_into(compressed, stack, x, y, offset=x * y) == 0
+    flat = list(stack)
+    assert flat[x * y : 2 * x * y] == list(data)
+    assert set(flat[: x * y]) == set(flat[2 * x * y :]) == {0}
+
+    out = flex.uint16(flex.grid(y, x))
+    assert uncompress_into(compressed, out, x, y) == 2
+    assert out[10] == 44369
+    assert out[11] == 0
+    assert out[12] == 65535
+
+    out = flex.int16(flex.grid(y, x))
+    assert uncompress_into(compressed, out, x, y) == 2
+    assert out[10] == 32767
+    assert out[11] == -2
+
+
+def test_uncompress_rod_TY6():
+    # Each row: a first pixel of 10, one pair of 1-bit blocks holding a single
+    # +1 difference each, then a short-overflow and a plain 1-byte difference
+    first = bytes([127 + 10])
+    blocks = bytes([0x11, 0b00000001, 0b10000000])
+    rest = bytes([254]) + (1000).to_bytes(2, "little", signed=True) + bytes([127 - 3])
+    row = first + blocks + rest
+    slow, fast = 4, 19
+    data = row * slow
+    offsets = b"".join((i * len(row)).to_bytes(4, "little") for i in range(slow))
+    expected = [10] + [11] * 15 + [12, 1012, 1009]
+
+    for nthreads in (1, 2):
+        image = uncompress_rod_TY6(data, offsets, slow, fast, nthreads=nthreads)
+        assert image.all() == (slow, fast)
+        assert list(image) == expected * slow
+
+    stack = uncompress_rod_TY6_batch([data, data], [offsets, offsets], slow, fast)
+    assert stack.all() == (2, slow, fast)
+    assert list(stack) == expected * slow * 2
@@ -5,12 +5,19 @@ import hdf5plugin
 import numpy
 import pytest
 
-from scitbx.array_family import flex  # noqa: F401; boost python bindings
+from scitbx.array_family import flex
 
+from dxtbx import flumpy
+from dxtbx.format.nexus import dataset_as_flex, dataset_frames_as_flex, frame_stream
 from dxtbx_format_nexus_ext import (
     dataset_as_flex_double,
     dataset_as_flex_float,
     dataset_as_flex_int,
+    dataset_frames_as_flex_double,
+    dataset_frames_as_flex_int,
+    dataset_frames_into_flex_uint16,
+    dataset_into_flex_int,
+    dataset_into_flex_uint16,
 )
 
 
@@ -22,6 +29,15 @@ def uncompressed(file, shape, type_name):
     )
 
 
+def chunked(file, shape, type_name):
+    return file.create_dataset(
+        "data",
+        shape,
+        chunks=(3, 7, 20),
+        dtype=type_name,
+    )
+
+
 def gzip(file, shape, type_name):
     return file.create_dataset(
         "data",
@@ -44,6 +60,7 @@ def bshuf_lz4(file, shape, type_name):
     "creator",
     [
         uncompressed,
+        chunked,
         gzip,
         bshuf_lz4,
     ],
@@ -73,3 +90,128 @@ def test_dataset_as_flex(type_name, creator, converter):
     foo = converter(dataset.id.id, selection)
 
     assert foo.as_numpy_array() == pytest.approx(original)
+
+
+@pytest.mark.parametrize("creator", [uncompressed, chunked, gzip, bshuf_lz4])
+def test_dataset_as_flex_selection(creator):
+    f = h5py.File("selection.h5", "w", driver="core", backing_store=False)
+
+    shape = (20, 20, 20)
+    dataset = creator(f, shape, "uint32")
+    original = (numpy.arange(8000) * 7919 % 100000).reshape(shape).astype("uint32")
+    # Values too large for an int are clamped, as HDF5 does
+    original[4, 6, 8] = 2**32 - 1
+    dataset[:] = original
+
+    # A selection which cuts across chunks in every dimension
+    selection = slice(2, 17, 1), slice(5, 19, 1), slice(1, 13, 1)
+    expected = numpy.minimum(original[2:17, 5:19, 1:13], 2**31 - 1)
+    foo = dataset_as_flex_int(dataset.id.id, selection)
+    assert foo.all() == expected.shape
+    assert list(foo) == list(expected.flatten())
+
+    foo = dataset_as_flex_double(dataset.id.id, selection)
+    assert list(foo) == list(original[2:17, 5:19, 1:13].astype(float).flatten())
+
+
+@pytest.mark.parametrize("creator", [uncompressed, chunked, gzip, bshuf_lz4])
+@pytest.mark.parametrize("frames", [[3, 4, 5, 9, 1], range(2, 10), [7]])
+def test_dataset_frames_as_flex(creator, frames):
+    f = h5py.File("frames.h5", "w", driver="core", backing_store=False)
+
+    shape = (20, 20, 20)
+    dataset = creator(f, shape, "int")
+    original = (numpy.arange(8000) * 7919 % 100000).reshape(shape).astype("int")
+    dataset[:] = original
+
+    stack = dataset_frames_as_flex_int(dataset.id.id, frames)
+    assert stack.all() == (len(frames), 20, 20)
+    assert list(stack) == list(original[list(frames)].flatten())
+
+    stack = dataset_frames_as_flex_double(dataset.id.id, frames)
+    assert list(stack) == list(original[list(frames)].astype(float).flatten())
+
+    with pytest.raises(RuntimeError):
+        dataset_frames_as_flex_int(dataset.id.id, [20])
+
+
+@pytest.mark.parametrize("creator", [uncompressed, chunked, gzip, bshuf_lz4])
+@pytest.mark.parametrize("type_name", ["uint8", "uint16", "uint32"])
+def test_dataset_as_flex_native(creator, type_name):
+    f = h5py.File("native.h5", "w", driver="core", backing_store=False)
+
+    shape = (20, 20, 20)
+    dataset = creator(f, shape, type_name)
+    original = (numpy.arange(8000) * 7919 % 250).reshape(shape).astype(type_name)
+    dataset[:] = original
+
+    selection = slice(2, 17, 1), slice(5, 19, 1), slice(1, 13, 1)
+    foo = dataset_as_flex(dataset, selection, native=True)
+    assert isinstance(foo, getattr(flex, type_name))
+    assert list(foo) == list(original[2:17, 5:19, 1:13].flatten())
+    assert isinstance(dataset_as_flex(dataset, selection), flex.int)
+
+    stack = dataset_frames_as_flex(dataset, [4, 2], native=True)
+    assert isinstance(stack, getattr(flex, type_name))
+    assert list(stack) == list(original[[4, 2]].flatten())
+
+
+@pytest.mark.parametrize("creator", [uncompressed, chunked, bshuf_lz4])
+def test_dataset_into_flex(creator):
+    f = h5py.File("into.h5", "w", driver="core", backing_store=False)
+
+    shape = (20, 20, 20)
+    dataset = creator(f, shape, "uint16")
+    original = (numpy.arange(8000) * 7919 % 65536).reshape(shape).astype("uint16")
+    dataset[:] = original
+
+    # One buffer reused for every frame, with the shape left as it is
+    buffer = flex.uint16(flex.grid(20, 20))
+    for i in range(3):
+        selection = slice(i, i + 1, 1), slice(0, 20, 1), slice(0, 20, 1)
+        dataset_into_flex_uint16(dataset.id.id, selection, buffer)
+        assert buffer.all() == (20, 20)
+        assert list(buffer) == list(original[i].flatten())
+
+    # A numpy buffer, through a flex array sharing its memory
+    array = numpy.zeros((2, 20, 20), dtype="uint16")
+    dataset_frames_into_flex_uint16(dataset.id.id, [7, 3], flumpy.from_numpy(array))
+    assert (array == original[[7, 3]]).all()
+
+    with pytest.raises(RuntimeError):
+        dataset_into_flex_int(dataset.id.id, selection, flex.int(10))
+
+
+def test_frame_stream(tmp_path):
+    filename = str(tmp_path / "stream.h5")
+    writer = h5py.File(filename, "w", libver="latest")
+    dataset = writer.create_dataset(
+        "data", (0, 20, 20), maxshape=(None, 20, 20), chunks=(1, 20, 20), dtype="i4"
+    )
+    writer.swmr_mode = True
+    original = (numpy.arange(2000) * 7919 % 65536).reshape(5, 20, 20)
+
+    stream = frame_stream(filename, "data")
+    assert len(stream) == 0
+    assert stream.next().all() == (0, 20, 20)
+    assert stream.wait(0.01) == 0
+
+    # Frames become visible once they are flushed
+    dataset.resize((3, 20, 20))
+    dataset[:3] = original[:3]
+    dataset.flush()
+    assert stream.wait(1.0) == 3
+    stack = stream.next(2)
+    assert isinstance(stack, flex.int)
+    assert list(stack) == list(original[:2].flatten())
+    assert stream.position() == 2
+
+    dataset.resize((5, 20, 20))
+    dataset[3:] = original[3:]
+    dataset.flush()
+    assert stream.refresh() == 5
+    assert list(stream.next()) == list(original[2:].flatten())
+    assert list(stream.read(1)) == list(original[1].flatten())
+    stream.seek(4)
+    assert list(stream.next()) == list(original[4].flatten())
+    writer.close()
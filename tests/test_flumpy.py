@@ -9,6 +9,7 @@ import cctbx.array_family.flex as cctbx_flex
 import scitbx.array_family.flex as flex
 
 import dxtbx.flumpy as flumpy
+from dxtbx.format.image import ImageBuffer, ImageInt, ImageTileInt, MappedImage
 
 # A mapping of which flex type should map to which numpy dtype - for verification
 lookup_flex_type_to_numpy = {
@@ -354,29 +355,42 @@ def test_numpy_loop_nesting():
 
 
 def test_noncontiguous():
-    npo = np.zeros((10, 4, 3))
-    flumpy.from_numpy(npo)
-
-    with pytest.raises(ValueError):
-        flumpy.from_numpy(npo[:, 1:])
-
-    with pytest.raises(ValueError):
-        flumpy.vec_from_numpy(npo[:, 1:])
-
-    with pytest.raises(ValueError):
-        flumpy.mat3_from_numpy(npo[:, 1:])
-
-    # Test fortran order
-    npo_f = np.zeros((10, 4, 3), order="F")
-
-    with pytest.raises(ValueError):
-        flumpy.from_numpy(npo_f)
-
-    with pytest.raises(ValueError):
-        flumpy.vec_from_numpy(npo_f)
+    npo = np.arange(120, dtype=float).reshape(10, 4, 3)
+    fo = flumpy.from_numpy(npo)
+    fo[0] = -1
+    assert npo[0, 0, 0] == -1
+
+    # Strided arrays are gathered into a copy
+    sliced = npo[:, 1:]
+    fo = flumpy.from_numpy(sliced)
+    assert fo.all() == (10, 3, 3)
+    assert list(fo) == sliced.flatten().tolist()
+    fo[0] = 42
+    assert sliced[0, 0, 0] != 42
+
+    vecs = flumpy.vec_from_numpy(npo[:, 1:])
+    assert isinstance(vecs, flex.vec3_double)
+    assert vecs.all() == (10, 3)
+    assert vecs[4] == tuple(sliced[1, 1])
+    mats = flumpy.mat3_from_numpy(npo[:, 1:])
+    assert len(mats) == 10
+    assert mats[2] == tuple(sliced[2].flatten())
+
+    # Test fortran order and negative strides
+    npo_f = np.asfortranarray(npo)
+    assert list(flumpy.from_numpy(npo_f)) == npo.flatten().tolist()
+    assert list(flumpy.vec_from_numpy(npo_f)) == [tuple(v) for v in npo.reshape(-1, 3)]
+    assert list(flumpy.from_numpy(npo[::-2, :, ::-1])) == (
+        npo[::-2, :, ::-1].flatten().tolist()
+    )
+
+    # Large enough to be gathered over several threads
+    big = np.arange(2 * 1024 * 1024, dtype="int32").reshape(1024, 2048)
+    assert (flumpy.to_numpy(flumpy.from_numpy(big[:, ::2])) == big[:, ::2]).all()
+    assert (flumpy.to_numpy(flumpy.from_numpy(big.T)) == big.T).all()
 
     with pytest.raises(ValueError):
-        flumpy.mat3_from_numpy(npo_f)
+        flumpy.from_numpy(np.array(["a", "b", "c", "d"], dtype=object)[::2])
 
 
 def test_nonowning():
@@ -410,3 +424,44 @@ def test_single_entry_vec_from_numpy():
     ao = flumpy.vec_from_numpy(np.array([[2.0, 3.0, 4.0]]))
     assert len(ao) == 1
     assert ao[0] == pytest.approx([2.0, 3.0, 4.0])
+
+
+def test_image_to_numpy(tmp_path):
+    tiles = [flex.int(flex.grid(3, 4), i) for i in range(2)]
+    tiles.append(flex.int(flex.grid(2, 4), 2))
+    image = ImageInt(ImageTileInt(tiles[0], "0"))
+    for i, tile in enumerate(tiles[1:], 1):
+        image.append(ImageTileInt(tile, str(i)))
+
+    # Separate tiles give a tuple of views, sharing memory with each tile
+    for arrays in (flumpy.to_numpy(image), flumpy.to_numpy(ImageBuffer(image))):
+        assert isinstance(arrays, tuple)
+        assert [a.shape for a in arrays] == [(3, 4), (3, 4), (2, 4)]
+        arrays[2][1, 3] = 42
+        assert tiles[2][1, 3] == 42
+
+    # A contiguous image gives one stacked view, which keeps the memory alive
+    image = ImageInt(ImageTileInt(tiles[0], "0"))
+    image.append(ImageTileInt(tiles[1], "1"))
+    block = ImageBuffer(image).as_double()
+    assert block.is_contiguous()
+    array = flumpy.to_numpy(ImageBuffer(block))
+    assert array.shape == (2, 3, 4)
+    assert array.dtype == np.float64
+    array[1, 2, 3] = 7
+    assert block.tile(1).data()[2, 3] == 7
+    del block
+    assert array[1, 2, 3] == 7
+    assert array[0].sum() == 0
+
+    # A memory mapped image is viewed read-only, in its stored type
+    path = tmp_path / "image.raw"
+    path.write_bytes(b"header" + np.arange(6, dtype=">u2").tobytes())
+    mapped = MappedImage(str(path), 6, "uint16", True, (2, 3))
+    array = flumpy.to_numpy(ImageBuffer(mapped))
+    assert array.dtype == np.dtype(">u2")
+    assert array.tolist() == [[0, 1, 2], [3, 4, 5]]
+    assert not array.flags.writeable
+
+    with pytest.raises(ValueError):
+        flumpy.to_numpy(ImageBuffer())
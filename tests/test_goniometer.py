@@ -346,6 +346,36 @@ def test_scan_varying():
     assert g.get_setting_rotation_at_scan_points().size() == 0
 
 
+@pytest.mark.parametrize("nthreads", [1, 2])
+def test_rotation_matrices(nthreads):
+    axes = flex.vec3_double(((1, 0, 0), (0.914, 0.279, -0.297), (1, 0, 0)))
+    angles = flex.double((20, 30, -10))
+    names = flex.std_string(("phi", "kappa", "omega"))
+    for scan_axis in range(3):
+        g = GoniometerFactory.multi_axis(axes, angles, names, scan_axis)
+        S = matrix.sqr(g.get_setting_rotation())
+        F = matrix.sqr(g.get_fixed_rotation())
+        axis = matrix.col(g.get_rotation_axis_datum())
+
+        phi = flex.double_range(-180, 180, step=7)
+        vectors = flex.vec3_double(
+            [(math.cos(p), 0.5, math.sin(2 * p)) for p in range(len(phi))]
+        )
+        matrices = g.get_rotation_matrices(phi, nthreads=nthreads)
+        rotated = g.rotate_vectors(vectors, phi, nthreads=nthreads)
+        assert len(matrices) == len(rotated) == len(phi)
+        for angle, R, v, w in zip(phi, matrices, vectors, rotated):
+            expected = (
+                S * axis.axis_and_angle_as_r3_rotation_matrix(angle, deg=True) * F
+            )
+            assert R == pytest.approx(expected.elems, abs=1e-12)
+            assert w == pytest.approx((expected * matrix.col(v)).elems, abs=1e-12)
+
+        radians = g.get_rotation_matrices(phi * math.pi / 180, deg=False)
+        for R1, R2 in zip(matrices, radians):
+            assert R1 == pytest.approx(R2, abs=1e-12)
+
+
 def test_comparison():
     # Setting rotation for small random offset
     offset_ax = matrix.col.random(3, -1.0, 1.0).normalize()
@@ -0,0 +1,195 @@
+from __future__ import annotations
+
+import pickle
+import struct
+
+import h5py
+import numpy as np
+import pytest
+
+from scitbx.array_family import flex
+
+from dxtbx.ext import compress
+from dxtbx.format.image import (
+    CBFByteOffsetReader,
+    HDF5ImageReader,
+    RawImageReader,
+    read_cbf_images,
+)
+from dxtbx.imageset import ImageSet, ImageSetData
+
+HEADER = b"header padding!\n"
+
+
+def write_cbf(path, values, slow, fast, byte_offset=True):
+    if byte_offset:
+        packed = compress(flex.int(values))
+        conversions = "x-CBF_BYTE_OFFSET"
+    else:
+        packed = struct.pack("<%di" % len(values), *values)
+        conversions = "x-CBF_NONE"
+    header = (
+        "###CBF: VERSION 1.5\r\n"
+        "--CIF-BINARY-FORMAT-SECTION--\r\n"
+        "Content-Type: application/octet-stream;\r\n"
+        f'     conversions="{conversions}"\r\n'
+        f"X-Binary-Size: {len(packed)}\r\n"
+        f"X-Binary-Number-of-Elements: {len(values)}\r\n"
+        f"X-Binary-Size-Fastest-Dimension: {fast}\r\n"
+        f"X-Binary-Size-Second-Dimension: {slow}\r\n"
+        "\r\n"
+    )
+    path.write_bytes(header.encode() + b"\x0c\x1a\x04\xd5" + packed + b"\r\n--")
+    return str(path)
+
+
+@pytest.mark.parametrize("byte_offset", [True, False])
+def test_cbf_reader(tmp_path, byte_offset):
+    frames = [[i * 1000 - 5, 3, 70000, -40000, i, 0] for i in range(3)]
+    paths = [
+        write_cbf(tmp_path / f"image_{i}.cbf", frame, 2, 3, byte_offset)
+        for i, frame in enumerate(frames)
+    ]
+    reader = CBFByteOffsetReader(paths)
+    assert len(reader) == 3
+    for i, frame in enumerate(frames):
+        buffer = reader.read(i)
+        assert buffer.is_int()
+        data = buffer.as_int().tile(0).data()
+        assert data.focus() == (2, 3)
+        assert list(data) == frame
+
+    copy = pickle.loads(pickle.dumps(reader))
+    assert copy.paths() == paths
+    with pytest.raises(RuntimeError):
+        reader.read(3)
+
+    (tmp_path / "bad.cbf").write_bytes(b"no binary section")
+    with pytest.raises(RuntimeError):
+        CBFByteOffsetReader([str(tmp_path / "bad.cbf")]).read(0)
+
+
+@pytest.mark.parametrize("nthreads", [1, 3])
+def test_read_cbf_images(tmp_path, nthreads):
+    frames = [[i * 1000 - 5, 3, 70000, -40000, i, 0] for i in range(5)]
+    paths = [
+        write_cbf(tmp_path / f"image_{i}.cbf", frame, 2, 3, i % 2 == 0)
+        for i, frame in enumerate(frames)
+    ]
+    images = read_cbf_images(paths, nthreads)
+    assert len(images) == 5
+    for (header, data), frame in zip(images, frames):
+        assert header.startswith("###CBF: VERSION 1.5")
+        assert "X-Binary-Size-Fastest-Dimension: 3" in header
+        assert isinstance(data, flex.int)
+        assert data.all() == (2, 3)
+        assert list(data) == frame
+
+    assert read_cbf_images([]) == []
+    with pytest.raises(RuntimeError):
+        read_cbf_images(paths + [str(tmp_path / "missing.cbf")], nthreads)
+
+
+def test_raw_reader(tmp_path):
+    frames = [[i * 10 + j for j in range(4)] for i in range(3)]
+    paths = []
+    for i, frame in enumerate(frames):
+        path = tmp_path / f"image_{i}.raw"
+        path.write_bytes(HEADER + struct.pack(">4H", *frame))
+        paths.append(str(path))
+    reader = RawImageReader(paths, len(HEADER), "uint16", True, (2, 2))
+    assert len(reader) == 3
+    for i, frame in enumerate(frames):
+        buffer = reader.read(i)
+        assert buffer.is_mapped()
+        assert list(buffer.as_int().tile(0).data()) == frame
+
+    # A stack of frames in one file
+    stack = tmp_path / "stack.raw"
+    stack.write_bytes(HEADER + struct.pack("<12H", *sum(frames, [])))
+    reader = RawImageReader([str(stack)], len(HEADER), "uint16", False, (2, 2), 3)
+    assert len(reader) == 3
+    for i, frame in enumerate(frames):
+        assert list(reader.read(i).as_int().tile(0).data()) == frame
+    copy = pickle.loads(pickle.dumps(reader))
+    assert copy.images_per_file() == 3
+    assert list(copy.read(2).as_int().tile(0).data()) == frames[2]
+
+    reader = RawImageReader([str(stack)], len(HEADER), "uint16", False, (2, 2), 4)
+    with pytest.raises(RuntimeError):
+        reader.read(3)
+
+
+@pytest.mark.parametrize("dtype", ["uint16", "uint8", "int32"])
+def test_hdf5_reader_native_type(tmp_path, dtype):
+    frames = (np.arange(24) * 7 % 250).reshape(2, 3, 4).astype(dtype)
+    filename = str(tmp_path / "data.h5")
+    with h5py.File(filename, "w") as f:
+        f.create_dataset("entry/data", data=frames)
+
+    reader = HDF5ImageReader(filename, "entry/data")
+    assert len(reader) == 2
+    buffer = reader.read(1)
+    assert buffer.is_uint16() == (dtype == "uint16")
+    assert buffer.is_uint8() == (dtype == "uint8")
+    assert buffer.is_int() == (dtype == "int32")
+    assert list(buffer.as_int().tile(0).data()) == list(frames[1].flatten())
+    assert list(buffer.as_double().tile(0).data()) == list(frames[1].flatten())
+
+    class Reader:
+        def __len__(self):
+            return 2
+
+        def read(self, index):
+            raise AssertionError("Python reader called")
+
+    # Narrow data is held in its own type, but given to Python as int
+    data = ImageSetData(Reader(), None)
+    data.set_native_reader(reader)
+    imageset = ImageSet(data)
+    (raw,) = imageset.get_raw_data(0)
+    assert isinstance(raw, flex.int)
+    assert list(raw) == list(frames[0].flatten())
+    (block,) = imageset.get_raw_data_block(0, 2)
+    assert block.all() == (2, 3, 4)
+    assert list(block) == list(frames.flatten())
+
+
+def test_imageset_data_native_reader(tmp_path):
+    frames = [[i, -i, 2 * i, 100000 * i] for i in range(4)]
+    paths = [
+        write_cbf(tmp_path / f"image_{i}.cbf", frame, 2, 2)
+        for i, frame in enumerate(frames)
+    ]
+
+    class Reader:
+        def __init__(self, paths):
+            self._paths = paths
+
+        def __len__(self):
+            return len(self._paths)
+
+        def read(self, index):
+            raise AssertionError("Python reader called")
+
+    data = ImageSetData(Reader(paths), None)
+    assert not data.has_native_reader()
+    data.set_native_reader(CBFByteOffsetReader(paths))
+    assert data.has_native_reader()
+    for i, frame in enumerate(frames):
+        assert list(data.get_data(i).as_int().tile(0).data()) == frame
+
+    # The native reader times the decompression as well as the read
+    stats = ImageSet(data).read_statistics()
+    if stats["enabled"]:
+        assert stats["read_count"] == 4
+        assert stats["decompress_count"] == 4
+
+    # The native reader follows a partial copy only if it covers the same images
+    assert data.partial_data(Reader(paths), 1, 3).has_native_reader()
+    assert not data.partial_data(Reader(paths[1:3]), 1, 3).has_native_reader()
+
+    with pytest.raises(RuntimeError):
+        data.set_native_reader(CBFByteOffsetReader(paths[:2]))
+    data.set_native_reader(None)
+    assert data.native_reader() is None
@@ -14,8 +14,14 @@ import dxtbx.format.FormatHDF5SaclaMPCCD
 import dxtbx.format.image
 import dxtbx.format.Registry
 from dxtbx.format.FormatCBFMiniPilatus import FormatCBFMiniPilatus as FormatClass
-from dxtbx.imageset import ExternalLookup, ImageSequence, ImageSetData, ImageSetFactory
-from dxtbx.model import Beam, Detector, Panel
+from dxtbx.imageset import (
+    ExternalLookup,
+    ImageSequence,
+    ImageSet,
+    ImageSetData,
+    ImageSetFactory,
+)
+from dxtbx.model import Beam, Detector, Goniometer, Panel, Scan
 from dxtbx.model.beam import BeamFactory
 from dxtbx.model.experiment_list import ExperimentListFactory
 
@@ -141,6 +147,58 @@ def test_image_buffer():
     assert b.is_empty() is False
 
 
+def test_image_buffer_conversion():
+    # An odd number of pixels, so the conversions have a scalar tail
+    values = [(-1) ** i * (i * 7919 + 3) for i in range(21)]
+    data = flex.int(values)
+    data.reshape(flex.grid(7, 3))
+    b = dxtbx.format.image.ImageBuffer(dxtbx.format.image.ImageInt(data))
+    assert list(b.as_double().tile(0).data()) == values
+    doubles = flex.double([v / 4 for v in values])
+    doubles.reshape(flex.grid(7, 3))
+    d = dxtbx.format.image.ImageBuffer(dxtbx.format.image.ImageDouble(doubles))
+    assert list(d.as_int().tile(0).data()) == [int(v / 4) for v in values]
+
+    # The same type is handed back without a copy
+    b.as_int().tile(0).data()[0] = 42
+    assert data[0] == 42
+
+    # Conversion into an existing image
+    out = dxtbx.format.image.ImageDouble(flex.double(flex.grid(7, 3)))
+    b.copy_to(out)
+    assert list(out.tile(0).data()) == [42] + values[1:]
+    with pytest.raises(RuntimeError):
+        b.copy_to(dxtbx.format.image.ImageDouble(flex.double(flex.grid(3, 7))))
+
+
+def test_image_contiguous_block():
+    image = dxtbx.format.image.ImageInt()
+    for i in range(3):
+        image.append(
+            dxtbx.format.image.ImageTileInt(flex.int(flex.grid(2, 4), i), "Tile%d" % i)
+        )
+    # Separately allocated tiles are copied into a block
+    assert not image.is_contiguous()
+    block = image.as_block()
+    assert block.focus() == (3, 2, 4)
+    assert list(block) == [0] * 8 + [1] * 8 + [2] * 8
+
+    # A converted image has all its tiles in one arena, seen by the block
+    converted = dxtbx.format.image.ImageBuffer(image).as_double()
+    assert converted.is_contiguous()
+    block = converted.as_block()
+    assert block.focus() == (3, 2, 4)
+    block[8] = 42
+    assert converted.tile(1).data()[0] == 42
+    data = converted.tile(2).data()
+    del converted, block
+    assert list(data) == [2] * 8
+
+    # The tiles are views of the arena, so they cannot be grown
+    with pytest.raises(ValueError):
+        data.resize(flex.grid(4, 4))
+
+
 def test_external_lookup():
     mask = flex.bool(flex.grid(10, 10), True)
     gain = flex.double(flex.grid(10, 10), 1)
@@ -648,6 +706,299 @@ def test_get_corrected_data(centroid_files):
     data3 = sequence.get_corrected_data(0)[0]
     assert flex.mean(data3) == pytest.approx(flex.mean(data2) - 1.0 / 2.0)
 
+    # The maps follow changes to the panel
+    assert set(sequence.get_gain(0)[0]) == {2}
+    assert set(sequence.get_pedestal(0)[0]) == {1}
+    panel.set_gain(4)
+    assert set(sequence.get_gain(0)[0]) == {4}
+    data4 = sequence.get_corrected_data(0)[0]
+    assert flex.mean(data4) == pytest.approx(flex.mean(data3) / 2.0)
+
+
+@pytest.mark.parametrize("raw", [flex.int, flex.double])
+def test_get_corrected_data_external(raw):
+    class Reader:
+        def __len__(self):
+            return 1
+
+        def read(self, index):
+            return raw(flex.grid(2, 3), 7)
+
+    handle = ImageSetData(Reader(), None)
+    gain = flex.double(flex.grid(2, 3), 2)
+    gain[1, 2] = 4
+    handle.external_lookup.gain.data = dxtbx.format.image.ImageDouble(
+        dxtbx.format.image.ImageTileDouble(gain)
+    )
+    handle.external_lookup.pedestal.data = dxtbx.format.image.ImageDouble(
+        dxtbx.format.image.ImageTileDouble(flex.double(flex.grid(2, 3), 1))
+    )
+    imageset = ImageSet(handle)
+    data = imageset.get_corrected_data(0)[0]
+    assert data.focus() == (2, 3)
+    assert list(data) == pytest.approx([3, 3, 3, 3, 3, 1.5])
+    assert list(imageset.get_corrected_data(0)[0]) == list(data)
+
+    # Setting the same arrays again after changing them is seen
+    gain[1, 2] = 3
+    imageset.external_lookup.gain.data = dxtbx.format.image.ImageDouble(
+        dxtbx.format.image.ImageTileDouble(gain)
+    )
+    assert list(imageset.get_corrected_data(0)[0]) == pytest.approx([3, 3, 3, 3, 3, 2])
+    assert list(imageset.get_corrected_data(0, True)[0]) == pytest.approx(
+        [3, 3, 3, 3, 3, 2]
+    )
+
+    # A non-positive gain is rejected
+    gain[0, 0] = 0
+    handle.external_lookup.gain.data = dxtbx.format.image.ImageDouble(
+        dxtbx.format.image.ImageTileDouble(gain)
+    )
+    with pytest.raises(RuntimeError):
+        ImageSet(handle).get_corrected_data(0)
+
+
+@pytest.mark.parametrize("raw", [flex.int, flex.float, flex.double])
+def test_get_corrected_data_single_precision(raw):
+    class Reader:
+        def __len__(self):
+            return 2
+
+        def read(self, index):
+            return raw(flex.grid(2, 3), 7)
+
+    handle = ImageSetData(Reader(), None)
+    gain = flex.double(flex.grid(2, 3), 2)
+    gain[1, 2] = 4
+    handle.external_lookup.gain.data = dxtbx.format.image.ImageDouble(
+        dxtbx.format.image.ImageTileDouble(gain)
+    )
+    handle.external_lookup.pedestal.data = dxtbx.format.image.ImageDouble(
+        dxtbx.format.image.ImageTileDouble(flex.double(flex.grid(2, 3), 1))
+    )
+    imageset = ImageSet(handle)
+    assert not imageset.get_single_precision()
+    assert isinstance(imageset.get_corrected_data(0)[0], flex.double)
+
+    # Per call
+    data = imageset.get_corrected_data(0, single_precision=True)[0]
+    assert isinstance(data, flex.float)
+    assert list(data) == pytest.approx([3, 3, 3, 3, 3, 1.5])
+
+    # Per imageset, which a call can still override
+    imageset.set_single_precision(True)
+    assert isinstance(imageset.get_corrected_data(1)[0], flex.float)
+    assert isinstance(imageset.get_frame(1)[2][0], flex.float)
+    assert isinstance(imageset.get_corrected_data(1, False)[0], flex.double)
+    (block,) = imageset.get_corrected_data_block(0, 2)
+    assert isinstance(block, flex.float)
+    assert block.focus() == (2, 2, 3)
+    assert list(block) == pytest.approx([3, 3, 3, 3, 3, 1.5] * 2)
+
+
+def test_mask_cache():
+    class Reader:
+        def __len__(self):
+            return 2
+
+        def read(self, index):
+            data = flex.int([0, 5, -1, 20, 3, 4])
+            data.reshape(flex.grid(2, 3))
+            return data
+
+    detector = Detector()
+    panel = detector.add_panel()
+    panel.set_image_size((3, 2))
+    panel.set_trusted_range((0, 10))
+    panel.add_mask(0, 0, 1, 1)
+    handle = ImageSetData(Reader(), None)
+    external = flex.bool(flex.grid(2, 3), True)
+    external[1, 1] = False
+    handle.external_lookup.mask.data = dxtbx.format.image.ImageBool(
+        dxtbx.format.image.ImageTileBool(external)
+    )
+    imageset = ImageSet(handle)
+    imageset.set_detector(detector, 0)
+    imageset.set_detector(detector, 1)
+
+    expected = [False, True, False, False, False, True]
+    for index in (0, 1, 0):
+        assert list(imageset.get_mask(index)[0]) == expected
+
+    # Changes to the untrusted rectangles are picked up
+    imageset.get_detector(0)[0].add_mask(2, 1, 3, 2)
+    expected[5] = False
+    assert list(imageset.get_mask(0)[0]) == expected
+
+    # As is a new external mask
+    imageset.external_lookup.mask.data = dxtbx.format.image.ImageBool(
+        dxtbx.format.image.ImageTileBool(flex.bool(flex.grid(2, 3), True))
+    )
+    expected[4] = True
+    assert list(imageset.get_mask(0)[0]) == expected
+
+    data, mask, corrected = imageset.get_frame(1)
+    assert list(data[0]) == [0, 5, -1, 20, 3, 4]
+    assert list(mask[0]) == expected
+    assert list(corrected[0]) == [0, 5, -1, 20, 3, 4]
+
+
+@pytest.mark.parametrize("nthreads", [1, 0])
+def test_data_block(nthreads):
+    np = pytest.importorskip("numpy")
+    from dxtbx import flumpy
+
+    class Reader:
+        def __len__(self):
+            return 4
+
+        def read(self, index):
+            return (
+                flex.int(flex.grid(2, 3), index),
+                flex.int(flex.grid(4, 5), 10 * index),
+            )
+
+    handle = ImageSetData(Reader(), None)
+    imageset = ImageSet(handle)
+    block = imageset.get_raw_data_block(1, 4, nthreads)
+    assert len(block) == 2
+    assert isinstance(block[0], flex.int)
+    assert block[0].focus() == (3, 2, 3)
+    assert block[1].focus() == (3, 4, 5)
+    assert list(block[1]) == [10] * 20 + [20] * 20 + [30] * 20
+
+    # The block can be viewed from numpy without a copy
+    array = flumpy.to_numpy(block[0])
+    assert array.shape == (3, 2, 3)
+    assert (array[:, 0, 0] == np.array([1, 2, 3])).all()
+
+    for item, value in (
+        (handle.external_lookup.gain, 2),
+        (handle.external_lookup.pedestal, 1),
+    ):
+        image = dxtbx.format.image.ImageDouble(
+            dxtbx.format.image.ImageTileDouble(flex.double(flex.grid(2, 3), value))
+        )
+        image.append(
+            dxtbx.format.image.ImageTileDouble(flex.double(flex.grid(4, 5), value))
+        )
+        item.data = image
+    imageset = ImageSet(handle)
+    block = imageset.get_corrected_data_block(0, 4, nthreads)
+    assert block[0].focus() == (4, 2, 3)
+    assert list(block[1])[::20] == pytest.approx([-0.5, 4.5, 9.5, 14.5])
+    for index in range(4):
+        corrected = imageset.get_corrected_data(index)
+        assert list(block[0])[index * 6 : (index + 1) * 6] == list(corrected[0])
+
+    with pytest.raises(RuntimeError):
+        imageset.get_raw_data_block(2, 1, nthreads)
+
+
+def test_frame_cache():
+    class CountingReader:
+        def __init__(self):
+            self.reads = []
+
+        def __len__(self):
+            return 10
+
+        def read(self, index):
+            self.reads.append(index)
+            return flex.int(flex.grid(10, 10), index)
+
+    reader = CountingReader()
+    imageset = ImageSet(ImageSetData(reader, None))
+    frame_bytes = 10 * 10 * 4
+
+    # By default only the last image is kept
+    assert imageset.get_cache_size() == 0
+    for index in (0, 1, 0, 0):
+        assert imageset.get_raw_data(index)[0][0] == index
+    assert reader.reads == [0, 1, 0]
+
+    # Going back and forth inside a window hits the cache
+    imageset.set_cache_size(3 * frame_bytes)
+    reader.reads = []
+    for index in (2, 3, 4, 2, 3, 4, 3):
+        assert imageset.get_raw_data(index)[0][0] == index
+    assert reader.reads == [2, 3, 4]
+    stats = imageset.cache_statistics()
+    assert stats["size"] == 3
+    assert stats["nbytes"] == 3 * frame_bytes
+
+    # The least recently used image is evicted first
+    imageset.get_raw_data(5)
+    reader.reads = []
+    imageset.get_raw_data(3)
+    imageset.get_raw_data(4)
+    assert reader.reads == []
+    imageset.get_raw_data(2)
+    assert reader.reads == [2]
+
+    hits = imageset.cache_statistics()["hits"]
+    imageset.clear_cache()
+    stats = imageset.cache_statistics()
+    assert stats["size"] == 0 and stats["nbytes"] == 0
+    assert stats["hits"] == hits
+    imageset.get_raw_data(2)
+    assert reader.reads == [2, 2]
+
+
+@pytest.mark.parametrize("nthreads", [1, 2])
+def test_prefetch(nthreads):
+    class Reader:
+        def __init__(self):
+            self.reads = []
+
+        def __len__(self):
+            return 10
+
+        def read(self, index):
+            self.reads.append(index)
+            return flex.int(flex.grid(10, 10), index)
+
+    reader = Reader()
+    sequence = ImageSequence(
+        ImageSetData(reader, None),
+        Beam(),
+        Detector(),
+        Goniometer(),
+        Scan((1, 10), (0, 0.1)),
+    )
+    assert sequence.get_prefetch_depth() == 0
+    sequence.set_cache_size(10 * 10 * 4 * 4)
+    sequence.enable_prefetch(depth=3, nthreads=nthreads)
+    assert sequence.get_prefetch_depth() == 3
+
+    # Every image is still read exactly once
+    for index in range(7):
+        assert sequence.get_raw_data(index)[0][0] == index
+    assert all(reader.reads.count(index) == 1 for index in range(7))
+
+    # Errors are raised by the consumer, not lost on the worker
+    class BadReader(Reader):
+        def read(self, index):
+            if index == 2:
+                raise ValueError("bad image")
+            return super().read(index)
+
+    sequence = ImageSequence(
+        ImageSetData(BadReader(), None),
+        Beam(),
+        Detector(),
+        Goniometer(),
+        Scan((1, 10), (0, 0.1)),
+    )
+    sequence.enable_prefetch(depth=2, nthreads=nthreads)
+    assert sequence.get_raw_data(1)[0][0] == 1
+    with pytest.raises(ValueError):
+        sequence.get_raw_data(2)
+
+    sequence.disable_prefetch()
+    assert sequence.get_prefetch_depth() == 0
+    assert sequence.get_raw_data(3)[0][0] == 3
+
 
 def test_multi_panel_gain_map(dials_data):
     pytest.importorskip("h5py")
@@ -700,3 +1051,206 @@ def test_scan_imageset_slice_consistency(dials_data):
     assert expt.scan[0:8] == expt.scan
     # The following doesn't work, and expects expt.imageset[1:9]
     assert expt.imageset[0:8] == expt.imageset
+
+
+def test_native_cbf_reader(centroid_files):
+    format_class = dxtbx.format.Registry.get_format_class_for_file(centroid_files[0])
+    sequence = format_class.get_imageset(centroid_files)
+    assert sequence.data().has_native_reader()
+
+    python_data = sequence.data()
+    python_data.set_native_reader(None)
+    for i in (0, 4):
+        native = sequence.get_raw_data(i)[0]
+        assert native.all_eq(python_data.get_data(i).as_int().tile(0).data())
+    assert sequence[2:5].data().has_native_reader()
+
+
+@pytest.mark.parametrize("nthreads", [1, 2])
+def test_dynamic_mask_cache(nthreads):
+    import math
+
+    from dxtbx.masking import GoniometerMaskerFactory
+    from dxtbx.model.detector import DetectorFactory
+    from dxtbx.model.goniometer import GoniometerFactory
+
+    class Reader:
+        def __len__(self):
+            return 20
+
+        def read(self, index):
+            return flex.int(flex.grid(619, 487), 0)
+
+    detector = DetectorFactory.simple(
+        sensor="PAD",
+        distance=90.29,
+        beam_centre=(41.20, 51.69),
+        fast_direction="+x",
+        slow_direction="-y",
+        pixel_size=(0.172, 0.172),
+        image_size=(487, 619),
+        trusted_range=(-1, 1e8),
+    )
+    goniometer = GoniometerFactory.make_multi_axis_goniometer(
+        flex.vec3_double(((1, 0, 0), (0.642788, -0.766044, 0), (1, 0, 0))),
+        flex.double((-35, 0, -90)),
+        flex.std_string(("GON_PHI", "GON_KAPPA", "GON_OMEGA")),
+        scan_axis=2,
+    )
+    masker = GoniometerMaskerFactory.diamond_anvil_cell(
+        goniometer, cone_opening_angle=2 * 38 * math.pi / 180
+    )
+    scan = Scan((1, 20), (-40, 0.1))
+    sequence = ImageSequence(
+        ImageSetData(Reader(), masker), Beam(), detector, goniometer, scan
+    )
+    uncached = [sequence.get_mask(i)[0] for i in range(20)]
+    assert sequence.get_dynamic_mask_tolerance() == 0
+
+    def expected_masks(tolerance):
+        bins = [
+            math.floor(math.degrees(scan.get_angle_from_image_index(i + 1)) / tolerance)
+            for i in range(20)
+        ]
+        masks = [masker.get_mask(detector, (b + 0.5) * tolerance)[0] for b in bins]
+        return bins, masks
+
+    bins, expected = expected_masks(0.5)
+    sequence.enable_dynamic_mask_cache(0.5, 2 * 619 * 487)
+    assert sequence.get_dynamic_mask_tolerance() == 0.5
+    for i in range(20):
+        assert sequence.get_mask(i)[0].all_eq(expected[i])
+    stats = sequence.dynamic_mask_cache_statistics()
+    assert stats["misses"] == len(set(bins))
+    assert stats["hits"] == 20 - len(set(bins))
+    assert stats["size"] == 2
+
+    # Masks handed out are copies, so changing one leaves the cache alone
+    sequence.get_mask(0)[0].fill(False)
+    assert sequence.get_mask(0)[0].all_eq(expected[0])
+
+    # Precomputing fills the cache from the start of the scan
+    bins, expected = expected_masks(0.25)
+    sequence.enable_dynamic_mask_cache(0.25, 100 * 619 * 487)
+    assert sequence.dynamic_mask_cache_statistics()["size"] == 0
+    sequence.precompute_dynamic_masks(nthreads)
+    stats = sequence.dynamic_mask_cache_statistics()
+    assert stats["size"] == len(set(bins))
+    misses = stats["misses"]
+    for i in range(20):
+        assert sequence.get_mask(i)[0].all_eq(expected[i])
+    assert sequence.dynamic_mask_cache_statistics()["misses"] == misses
+
+    sequence.disable_dynamic_mask_cache()
+    assert sequence.get_dynamic_mask_tolerance() == 0
+    assert sequence.dynamic_mask_cache_statistics()["size"] == 0
+    assert sequence.get_mask(3)[0].all_eq(uncached[3])
+
+    # Moving a panel or changing the goniometer in place empties the cache
+    bins, expected = expected_masks(0.5)
+    sequence.enable_dynamic_mask_cache(0.5, 2 * 619 * 487)
+    assert sequence.get_mask(0)[0].all_eq(expected[0])
+    panel = detector[0]
+    x, y, z = panel.get_origin()
+    panel.set_frame(panel.get_fast_axis(), panel.get_slow_axis(), (x + 10, y, z))
+    _, moved = expected_masks(0.5)
+    assert not moved[0].all_eq(expected[0])
+    assert sequence.get_mask(0)[0].all_eq(moved[0])
+    misses = sequence.dynamic_mask_cache_statistics()["misses"]
+    sequence.get_goniometer().set_setting_rotation((0, 1, 0, -1, 0, 0, 0, 0, 1))
+    assert sequence.get_mask(0)[0].all_eq(moved[0])
+    assert sequence.dynamic_mask_cache_statistics()["misses"] == misses + 1
+
+
+def test_read_statistics():
+    class Reader:
+        def __len__(self):
+            return 3
+
+        def read(self, index):
+            return flex.int(flex.grid(4, 5), index)
+
+    detector = Detector()
+    panel = detector.add_panel()
+    panel.set_image_size((5, 4))
+    panel.set_trusted_range((-1, 10))
+    imageset = ImageSet(ImageSetData(Reader(), None))
+    for index in range(3):
+        imageset.set_detector(detector, index)
+    stats = imageset.read_statistics()
+    assert stats["enabled"] == imageset.get_read_statistics_enabled()
+    if not stats["enabled"]:
+        pytest.skip("Read statistics are not compiled in")
+    assert stats["read_count"] == 0 and stats["bytes_read"] == 0
+
+    for index in (0, 1, 1):
+        imageset.get_corrected_data(index)
+        imageset.get_mask(index)
+    stats = imageset.read_statistics()
+    assert stats["read_count"] == 2
+    assert stats["bytes_read"] == 2 * 4 * 5 * 4
+    assert stats["convert_count"] == 2
+    assert stats["mask_count"] == 3
+    assert stats["cache_hits"] > 0 and stats["cache_misses"] == 2
+    assert stats["read_time"] > 0
+    assert stats["decompress_count"] == 0
+
+    # Slices share the statistics of the data they were made from
+    imageset.partial_set(Reader(), 1, 3).get_raw_data(1)
+    assert imageset.read_statistics()["read_count"] == 3
+
+    imageset.reset_read_statistics()
+    stats = imageset.read_statistics()
+    assert stats["read_count"] == 0 and stats["read_time"] == 0
+    assert stats["cache_hits"] == 0 and stats["cache_misses"] == 0
+
+    # The mask and corrected data of a frame come from the one raw image
+    imageset.get_frame(2)
+    stats = imageset.read_statistics()
+    assert stats["cache_hits"] == 0 and stats["cache_misses"] == 1
+
+    imageset.set_read_statistics_enabled(False)
+    imageset.clear_cache()
+    imageset.get_raw_data(0)
+    assert imageset.read_statistics()["read_count"] == 0
+    assert not imageset.get_read_statistics_enabled()
+
+
+def test_thread_safe(centroid_files):
+    from concurrent.futures import ThreadPoolExecutor
+
+    format_class = dxtbx.format.Registry.get_format_class_for_file(centroid_files[0])
+    sequence = format_class.get_imageset(centroid_files)
+
+    def frame(index):
+        return (
+            sequence.get_raw_data(index)[0],
+            sequence.get_mask(index)[0],
+            sequence.get_corrected_data(index)[0],
+        )
+
+    expected = [frame(i) for i in range(len(sequence))]
+    sequence.clear_cache()
+    sequence.set_cache_size(3 * expected[0][0].size() * 4)
+    assert not sequence.is_thread_safe()
+    sequence.set_thread_safe(True)
+    assert sequence.is_thread_safe()
+
+    indices = list(range(len(sequence))) * 3
+    with ThreadPoolExecutor(max_workers=4) as pool:
+        results = list(pool.map(frame, indices))
+    for index, (raw, mask, corrected) in zip(indices, results):
+        assert raw.all_eq(expected[index][0])
+        assert mask.all_eq(expected[index][1])
+        assert corrected.all_eq(expected[index][2])
+
+    # The images returned do not share arrays with the cache
+    sequence.get_raw_data(0)[0].fill(0)
+    assert sequence.get_raw_data(0)[0].all_eq(expected[0][0])
+
+    with pytest.raises(RuntimeError):
+        sequence.enable_prefetch(depth=2)
+    sequence.set_thread_safe(False)
+    sequence.enable_prefetch(depth=2)
+    with pytest.raises(RuntimeError):
+        sequence.set_thread_safe(True)
@@ -0,0 +1,132 @@
+from __future__ import annotations
+
+import pickle
+import struct
+
+import pytest
+
+from dxtbx.format.image import ImageBuffer, MappedImage
+from dxtbx.imageset import ImageSetData
+
+HEADER = b"header padding!\n"
+
+
+def write_image(path, fmt, values):
+    path.write_bytes(HEADER + struct.pack(fmt, *values) + b"trailer")
+    return str(path)
+
+
+@pytest.mark.parametrize(
+    "dtype,code",
+    [
+        ("uint8", "B"),
+        ("int16", "h"),
+        ("uint16", "H"),
+        ("int32", "i"),
+        ("uint32", "I"),
+    ],
+)
+@pytest.mark.parametrize("big_endian", [False, True])
+def test_mapped_integers(tmp_path, dtype, code, big_endian):
+    values = [0, 1, 2, 3, 100, 127]
+    if dtype.startswith("int"):
+        values[1] = -1
+    fmt = (">" if big_endian else "<") + code * len(values)
+    filename = write_image(tmp_path / "image.raw", fmt, values)
+
+    image = MappedImage(filename, len(HEADER), dtype, big_endian, (2, 3))
+    assert image.dtype() == dtype
+    assert image.is_integer()
+    assert image.shape() == (2, 3)
+    assert len(image) == 6
+    assert image.nbytes() == 6 * struct.calcsize(code)
+
+    data = image.as_int()
+    assert data.focus() == (2, 3)
+    assert list(data) == values
+    assert list(image.as_double()) == pytest.approx(values)
+
+
+@pytest.mark.parametrize("dtype,code", [("float32", "f"), ("float64", "d")])
+@pytest.mark.parametrize("big_endian", [False, True])
+def test_mapped_floats(tmp_path, dtype, code, big_endian):
+    values = [0.5, -1.25, 3.0, 1e6]
+    fmt = (">" if big_endian else "<") + code * len(values)
+    filename = write_image(tmp_path / "image.raw", fmt, values)
+
+    image = MappedImage(filename, len(HEADER), dtype, big_endian, (2, 2))
+    assert not image.is_integer()
+    assert list(image.as_double()) == pytest.approx(values)
+    assert list(image.as_float()) == pytest.approx(values)
+
+
+def test_mapped_floats_as_int(tmp_path):
+    # Values which do not fit an int are clamped, and NaN becomes 0
+    values = [1.75, -2.5, float("nan"), 1e300, -1e300, 2.0**31]
+    filename = write_image(tmp_path / "image.raw", "<" + "d" * 6, values)
+    image = MappedImage(filename, len(HEADER), "float64", False, (2, 3))
+    assert list(image.as_int()) == [1, -2, 0, 2**31 - 1, -(2**31), 2**31 - 1]
+
+
+def test_mapped_stack(tmp_path):
+    frames = [[i * 10 + j for j in range(4)] for i in range(3)]
+    filename = write_image(tmp_path / "stack.raw", "<" + "H" * 12, sum(frames, []))
+    first = MappedImage(filename, len(HEADER), "uint16", False, (2, 2))
+    for i, frame in enumerate(frames):
+        image = first.at_offset(len(HEADER) + i * first.nbytes())
+        assert list(image.as_int()) == frame
+
+
+def test_mapped_errors(tmp_path):
+    filename = write_image(tmp_path / "image.raw", "<HHHH", [1, 2, 3, 4])
+    with pytest.raises(RuntimeError):
+        MappedImage(filename, len(HEADER), "uint16", False, (10, 10))
+    with pytest.raises(RuntimeError):
+        MappedImage(filename, len(HEADER), "complex64", False, (2, 2))
+    with pytest.raises(RuntimeError):
+        MappedImage(str(tmp_path / "missing.raw"), 0, "uint16", False, (2, 2))
+    image = MappedImage(filename, len(HEADER), "uint16", False, (2, 2))
+    with pytest.raises(RuntimeError):
+        image.at_offset(len(HEADER) + 8)
+
+    # uint32 values above INT_MAX cannot be read as int
+    filename = write_image(tmp_path / "big.raw", "<I", [2**31])
+    image = MappedImage(filename, len(HEADER), "uint32", False, (1, 1))
+    with pytest.raises(RuntimeError):
+        image.as_int()
+    assert list(image.as_double()) == [2**31]
+
+
+def test_mapped_pickle(tmp_path):
+    filename = write_image(tmp_path / "image.raw", ">iiii", [1, -2, 3, -4])
+    image = MappedImage(filename, len(HEADER), "int32", True, (2, 2))
+    copy = pickle.loads(pickle.dumps(image))
+    assert copy.path() == filename
+    assert copy.offset() == len(HEADER)
+    assert copy.is_big_endian()
+    assert list(copy.as_int()) == [1, -2, 3, -4]
+
+
+def test_mapped_image_buffer(tmp_path):
+    filename = write_image(tmp_path / "image.raw", "<HHHH", [1, 2, 3, 4])
+    image = MappedImage(filename, len(HEADER), "uint16", False, (2, 2))
+
+    buffer = ImageBuffer(image)
+    assert buffer.is_mapped()
+    assert not buffer.is_int()
+    assert buffer.as_mapped().path() == filename
+    assert list(buffer.as_int().tile(0).data()) == [1, 2, 3, 4]
+    assert list(buffer.as_double().tile(0).data()) == [1, 2, 3, 4]
+    assert not ImageBuffer().is_mapped()
+
+    class Reader:
+        def __len__(self):
+            return 1
+
+        def read(self, index):
+            return image
+
+    handle = ImageSetData(Reader(), None)
+    buffer = handle.get_data(0)
+    assert buffer.is_mapped()
+    assert list(buffer.as_int().tile(0).data()) == [1, 2, 3, 4]
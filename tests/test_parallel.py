@@ -0,0 +1,65 @@
+from __future__ import annotations
+
+import os
+import subprocess
+import sys
+
+import pytest
+
+from scitbx.array_family import flex
+
+from dxtbx import parallel
+from dxtbx.ext import compress, uncompress
+
+
+@pytest.fixture
+def max_threads():
+    yield
+    parallel.set_max_threads(0)
+
+
+def test_set_max_threads(max_threads):
+    default = parallel.get_max_threads()
+    assert default >= 1
+    parallel.set_max_threads(3)
+    assert parallel.get_max_threads() == 3
+    parallel.set_max_threads(0)
+    assert parallel.get_max_threads() == default
+    with pytest.raises(ValueError):
+        parallel.set_max_threads(-1)
+
+
+def test_max_threads_results(max_threads):
+    data = flex.int(range(-50000, 50000)) * 97
+    expected = compress(data, nthreads=1)
+    for nthreads in (1, 2, 5):
+        parallel.set_max_threads(nthreads)
+        packed = compress(data, nthreads=0)
+        assert packed == expected
+        assert list(uncompress(packed, 100, 1000)) == list(data)
+
+
+def test_max_threads_environment():
+    environment = dict(os.environ, DXTBX_NUM_THREADS="3")
+    command = "import dxtbx.parallel; print(dxtbx.parallel.get_max_threads())"
+    result = subprocess.run(
+        [sys.executable, "-c", command],
+        env=environment,
+        capture_output=True,
+        text=True,
+    )
+    assert not result.returncode, result.stderr
+    assert result.stdout.strip() == "3"
+
+
+@pytest.mark.skipif(not hasattr(os, "fork"), reason="Needs os.fork")
+def test_thread_pool_after_fork():
+    data = flex.int(range(-50000, 50000)) * 97
+    expected = compress(data, nthreads=1)
+    # Start the workers of the pool before forking
+    assert compress(data, nthreads=2) == expected
+    pid = os.fork()
+    if pid == 0:
+        os._exit(0 if compress(data, nthreads=2) == expected else 1)
+    _, status = os.waitpid(pid, 0)
+    assert os.WIFEXITED(status) and os.WEXITSTATUS(status) == 0
@@ -0,0 +1,97 @@
+from __future__ import annotations
+
+import math
+import random
+
+import pytest
+
+from scitbx.array_family import flex
+
+from dxtbx.ext import RadialAverage, radial_average
+
+
+def make_frame(slow, fast, seed):
+    random.seed(seed)
+    data = flex.double([random.uniform(-5, 100) for _ in range(slow * fast)])
+    data.reshape(flex.grid(slow, fast))
+    return data
+
+
+def reference_radial_average(
+    data, mask, beam_center, n_bins, pixel_size, distance, upper_left, lower_right
+):
+    """Bin the positive unmasked pixels of a frame one at a time in Python"""
+    extent_two_theta = math.degrees(math.atan(n_bins * pixel_size / distance))
+    sums = [0.0] * n_bins
+    sums_sq = [0.0] * n_bins
+    counts = [0] * n_bins
+    for x in range(upper_left[0], lower_right[0]):
+        for y in range(upper_left[1], lower_right[1]):
+            value = data[x, y]
+            if value <= 0 or not mask[x, y]:
+                continue
+            d_in_mm = math.hypot(beam_center[0] - x, beam_center[1] - y) * pixel_size
+            two_theta = math.degrees(math.atan(d_in_mm / distance))
+            index = math.floor(two_theta * n_bins / extent_two_theta)
+            if index < n_bins:
+                sums[index] += value
+                sums_sq[index] += value * value
+                counts[index] += 1
+    return sums, sums_sq, counts
+
+
+@pytest.mark.parametrize("nthreads", [1, 3, 0])
+def test_radial_average_lookup_table(nthreads):
+    slow, fast, n_bins = 97, 113, 60
+    mask = flex.bool(flex.grid(slow, fast), True)
+    mask[10, 20] = False
+    geometry = ((40, 50), n_bins, 0.172, 100.0, (2, 3), (slow - 1, fast - 4))
+    data = make_frame(slow, fast, 0)
+    sums, sums_sq, counts = reference_radial_average(data, mask, *geometry)
+    assert sum(counts) > 0
+
+    # The function gives the same bins as the Python reference
+    function_sums = flex.double(n_bins, 0)
+    function_sums_sq = flex.double(n_bins, 0)
+    function_counts = flex.int(n_bins, 0)
+    radial_average(
+        data,
+        mask,
+        geometry[0],
+        function_sums,
+        function_sums_sq,
+        function_counts,
+        *geometry[2:],
+    )
+    assert list(function_counts) == counts
+    assert list(function_sums) == pytest.approx(sums)
+    assert list(function_sums_sq) == pytest.approx(sums_sq)
+
+    integrator = RadialAverage(mask, *geometry)
+    assert integrator.n_bins() == n_bins
+    assert 0 < integrator.n_pixels() < slow * fast
+    lut_sums = flex.double(n_bins, 0)
+    lut_sums_sq = flex.double(n_bins, 0)
+    lut_counts = flex.int(n_bins, 0)
+    integrator.accumulate(data, lut_sums, lut_sums_sq, lut_counts, nthreads)
+    assert list(lut_counts) == counts
+    assert list(lut_sums) == pytest.approx(sums)
+    assert list(lut_sums_sq) == pytest.approx(sums_sq)
+
+    # The batch gives one row per frame
+    frames = [data, make_frame(slow, fast, 1), data]
+    batch_sums, batch_sums_sq, batch_counts = integrator.accumulate_batch(
+        frames, nthreads
+    )
+    assert batch_sums.focus() == (3, n_bins)
+    batch_counts = list(batch_counts)
+    assert batch_counts[:n_bins] == counts
+    assert batch_counts[2 * n_bins :] == counts
+    assert list(batch_sums)[:n_bins] == pytest.approx(sums)
+    assert list(batch_sums_sq)[2 * n_bins :] == pytest.approx(sums_sq)
+    other_sums, _, other_counts = reference_radial_average(frames[1], mask, *geometry)
+    assert batch_counts[n_bins : 2 * n_bins] == other_counts
+    assert list(batch_sums)[n_bins : 2 * n_bins] == pytest.approx(other_sums)
+
+    with pytest.raises(RuntimeError):
+        integrator.accumulate_batch([make_frame(slow, fast - 1, 2)])
@@ -0,0 +1,108 @@
+from __future__ import annotations
+
+import io
+import pickle
+import struct
+
+import pytest
+
+from boost_adaptbx.boost.python import streambuf
+
+from dxtbx.ext import (
+    read_float32,
+    read_int16,
+    read_int32,
+    read_native_float32,
+    read_native_int16,
+    read_native_uint16,
+    read_native_uint32,
+    read_uint8,
+    read_uint16,
+    read_uint16_bs,
+    read_uint32,
+    read_uint32_bs,
+)
+
+
+@pytest.mark.parametrize(
+    "reader,fmt,values",
+    [
+        (read_uint8, "<5B", [0, 1, 2, 254, 255]),
+        (read_uint16, "<5H", [0, 1, 300, 40000, 65535]),
+        (read_uint16_bs, ">5H", [0, 1, 300, 40000, 65535]),
+        (read_uint32, "<5I", [0, 1, 70000, 2**31 - 2, 5]),
+        (read_uint32_bs, ">5I", [0, 1, 70000, 2**31 - 2, 5]),
+        (read_int16, "<5h", [0, -1, 300, -32768, 32767]),
+        (read_int32, "<5i", [0, -1, 70000, -(2**31), 2**31 - 1]),
+        (read_float32, "<5f", [0.0, -1.5, 0.25, 1024.0, 3.0]),
+    ],
+)
+def test_read_widened(reader, fmt, values):
+    data = b"header" + struct.pack(fmt, *values) + b"trailer"
+
+    # From a plain file object, leaving the position just after the data
+    f = io.BytesIO(data)
+    f.seek(6)
+    assert list(reader(f, 5)) == values
+    assert f.read() == b"trailer"
+
+    # Through the streambuf wrapper, as before
+    f = io.BytesIO(data)
+    f.seek(6)
+    assert list(reader(streambuf(f), 5)) == values
+
+
+@pytest.mark.parametrize("wrap", [lambda f: f, streambuf])
+@pytest.mark.parametrize(
+    "reader,fmt", [(read_uint16, "<2H"), (read_int32, "<2i"), (read_uint32, "<2I")]
+)
+def test_read_past_end_of_file_is_zero(wrap, reader, fmt):
+    f = io.BytesIO(struct.pack(fmt, 7, 8))
+    assert list(reader(wrap(f), 4)) == [7, 8, 0, 0]
+
+
+def test_read_uint32_out_of_int_range():
+    with pytest.raises(RuntimeError):
+        read_uint32(io.BytesIO(struct.pack("<I", 2**31)), 1)
+
+
+def test_read_native():
+    values = [0, 1, 300, 40000, 65535]
+    data = read_native_uint16(io.BytesIO(struct.pack("<5H", *values)), 5)
+    assert data.all() == (5,)
+    assert list(data) == values
+    data = read_native_uint16(
+        io.BytesIO(struct.pack(">5H", *values)), 5, byte_swap=True
+    )
+    assert list(data) == values
+
+    assert list(
+        read_native_uint32(io.BytesIO(struct.pack(">2I", 2**32 - 1, 3)), 2, True)
+    ) == [2**32 - 1, 3]
+    assert list(read_native_int16(io.BytesIO(struct.pack("<2h", -5, 5)), 2)) == [
+        -5,
+        5,
+    ]
+    assert list(
+        read_native_float32(io.BytesIO(struct.pack(">2f", 1.5, -2)), 2, True)
+    ) == [1.5, -2]
+
+
+def test_readinto_buffer_is_released():
+    class KeepsBuffer(io.BytesIO):
+        def readinto(self, buffer):
+            self.kept = buffer
+            return super().readinto(buffer)
+
+    f = KeepsBuffer(struct.pack("<2i", 7, 8))
+    assert list(read_int32(f, 2)) == [7, 8]
+    with pytest.raises(ValueError):
+        f.kept[0] = 1
+
+    class ExportsBuffer(io.BytesIO):
+        def readinto(self, buffer):
+            self.kept = pickle.PickleBuffer(buffer)
+            return super().readinto(buffer)
+
+    with pytest.raises(RuntimeError):
+        read_int32(ExportsBuffer(struct.pack("<2i", 7, 8)), 2)